@@ -0,0 +1,26 @@
+# Common settings of the standalone tools (cxbxr-pbreplay and the cxbxr-*bench projects)
+#
+# Each of them only builds the parts of the emulator it checks or times, which were written
+# without Windows dependencies for this very purpose, so that it can also be configured on
+# its own from its project directory, on any host, and run under ctest (see the -test options)
+
+set(CMAKE_CXX_STANDARD_REQUIRED ON)
+set(CMAKE_CXX_STANDARD 17)
+
+if (NOT CXBXR_ROOT_DIR)
+ get_filename_component(CXBXR_ROOT_DIR "${CMAKE_CURRENT_LIST_DIR}/../.." ABSOLUTE)
+endif()
+
+# Suppress extra stuff from generated solution
+set(CMAKE_SUPPRESS_REGENERATION true)
+
+if ("${CMAKE_CXX_COMPILER_ID}" STREQUAL "MSVC")
+ add_compile_definitions(
+ _CRT_SECURE_NO_WARNINGS
+ )
+ add_compile_options(/W4)
+else()
+ add_compile_options(-Wall -Wextra)
+endif()
+
+enable_testing()
@@ -0,0 +1,272 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of Cxbx-Reloaded.
+// *
+// *  Cxbx-Reloaded is free software; you can redistribute it
+// *  and/or modify it under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+// Checks and times XADPCM_Decode, which DirectSound uses to turn Xbox ADPCM
+// into PCM, against TXboxAdpcmDecoder_Decode_Memory it replaced.
+//
+// The test decodes random mono and stereo input of every block count up to a
+// few dozen (so whole and partial SIMD lane groups), with trailing bytes that
+// don't make a whole block and with headers out of the step index range, and
+// requires every implementation the host supports to return the same length
+// and write the same bytes as the reference, and nothing past them. It then
+// runs XADPCM_DecodeCached through hits, inputs sharing a hash key (the hash
+// below is deliberately weak) and evictions, and requires the same output as
+// decoding directly.
+//
+// The benchmark reports the PCM output rate of each implementation, and of a
+// cache hit.
+//
+// Usage : cxbxr-adpcmbench [blocks] [seconds]
+//         cxbxr-adpcmbench -test
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "common/XADPCM.h"
+#include "common/audio/XADPCMDecoder.h"
+#include "common/util/hasher.h"
+
+// Output bytes after the expected output, which the decoders must leave alone
+#define TEST_GUARD_BYTES 64
+#define TEST_GUARD_VALUE 0xCD
+// Every block count up to this is tested (per channel), then TEST_LONG_RUNS random ones up to TEST_LONG_MAX
+#define TEST_ALL_BLOCKS 40
+#define TEST_LONG_RUNS 100
+#define TEST_LONG_MAX 3000
+// Same as in XADPCMDecoder.cpp
+#define XADPCM_CACHE_MIN_INPUT_SIZE (XBOX_ADPCM_SRCSIZE * 64)
+#define XADPCM_CACHE_MAX_TOTAL_SIZE (16 * 1024 * 1024)
+
+static unsigned g_Failures = 0;
+
+static const char *ImplementationNames[] = { "plain", "SSE2", "AVX2" };
+
+// Replaces the emulator's hasher: only the first bytes of the input count, so that inputs which only differ
+// further on share a cache key, like real collisions would
+uint64_t ComputeHash(void* data, size_t len)
+{
+	uint64_t Hash = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < len && i < 16; i++) {
+		Hash = (Hash ^ ((uint8_t *)data)[i]) * 0x100000001b3ull;
+	}
+	return Hash;
+}
+
+// Random ADPCM, with headers of any step index (the decoders clamp it) once in a while
+static void RandomInput(std::mt19937 &rng, std::vector<uint8_t> &Input, int FChannels)
+{
+	for (auto &Byte : Input) {
+		Byte = (uint8_t)rng();
+	}
+	for (size_t Block = 0; Block + XBOX_ADPCM_SRCSIZE * FChannels <= Input.size(); Block += XBOX_ADPCM_SRCSIZE * FChannels) {
+		for (int c = 0; c < FChannels; c++) {
+			if (rng() % 4 != 0) {
+				Input[Block + c * 4 + 2] = (uint8_t)(rng() % 89);
+				Input[Block + c * 4 + 3] = 0;
+			}
+		}
+	}
+}
+
+// Decodes with the reference, into a buffer with guard bytes
+static std::vector<uint8_t> RefDecode(std::vector<uint8_t> &Input, int FChannels, int &RefLength)
+{
+	std::vector<uint8_t> Expected(TXboxAdpcmDecoder_guess_output_size((int)Input.size()) + TEST_GUARD_BYTES, TEST_GUARD_VALUE);
+	RefLength = TXboxAdpcmDecoder_Decode_Memory(Input.data(), (int)Input.size(), Expected.data(), FChannels);
+	return Expected;
+}
+
+static void TestBlocks(std::mt19937 &rng, int BlockCount, int FChannels, const char *szMode)
+{
+	// Up to a block's worth of trailing bytes, which don't get decoded
+	std::vector<uint8_t> Input(BlockCount * XBOX_ADPCM_SRCSIZE * FChannels + rng() % (XBOX_ADPCM_SRCSIZE * FChannels));
+	RandomInput(rng, Input, FChannels);
+
+	int RefLength;
+	std::vector<uint8_t> Expected = RefDecode(Input, FChannels, RefLength);
+	std::vector<uint8_t> Output(Expected.size(), TEST_GUARD_VALUE);
+
+	int Length = XADPCM_Decode(Input.data(), (int)Input.size(), Output.data(), FChannels);
+	if (Length != RefLength || Output != Expected) {
+		printf("FAIL : %s XADPCM_Decode of %d %s blocks (%zu bytes)\n", szMode, BlockCount, FChannels == 1 ? "mono" : "stereo", Input.size());
+		g_Failures++;
+	}
+}
+
+static void TestImplementation(XADPCMImplementation Implementation)
+{
+	if (!XADPCM_UseImplementation(Implementation)) {
+		printf("This host has no %s, skipped\n", ImplementationNames[Implementation]);
+		return;
+	}
+
+	std::mt19937 rng(0xADC0 + Implementation);
+	for (int FChannels = 1; FChannels <= 2; FChannels++) {
+		for (int BlockCount = 0; BlockCount <= TEST_ALL_BLOCKS; BlockCount++) {
+			TestBlocks(rng, BlockCount, FChannels, ImplementationNames[Implementation]);
+		}
+		for (int i = 0; i < TEST_LONG_RUNS; i++) {
+			TestBlocks(rng, 1 + rng() % TEST_LONG_MAX, FChannels, ImplementationNames[Implementation]);
+		}
+	}
+}
+
+// Decodes through the cache, and requires the same output as the reference
+static void TestCached(std::vector<uint8_t> &Input, int FChannels, const char *szCase)
+{
+	int RefLength;
+	std::vector<uint8_t> Expected = RefDecode(Input, FChannels, RefLength);
+	std::vector<uint8_t> Output(Expected.size(), TEST_GUARD_VALUE);
+
+	int Length = XADPCM_DecodeCached(Input.data(), (int)Input.size(), Output.data(), FChannels);
+	if (Length != RefLength || Output != Expected) {
+		printf("FAIL : XADPCM_DecodeCached, %s (%zu bytes, %d channel(s))\n", szCase, Input.size(), FChannels);
+		g_Failures++;
+	}
+}
+
+static void TestCache()
+{
+	XADPCM_UseImplementation(XADPCM_NOSIMD);
+	std::mt19937 rng(0xCAC4E);
+
+	// Misses, then hits
+	std::vector<std::vector<uint8_t>> Inputs;
+	for (int i = 0; i < 8; i++) {
+		int FChannels = 1 + i % 2;
+		Inputs.emplace_back(XADPCM_CACHE_MIN_INPUT_SIZE * FChannels * (1 + i));
+		RandomInput(rng, Inputs.back(), FChannels);
+		TestCached(Inputs.back(), FChannels, "first decode");
+	}
+	for (int i = 0; i < 8; i++) {
+		TestCached(Inputs[i], 1 + i % 2, "hit");
+	}
+
+	// The same input decoded as mono and stereo needs separate entries
+	TestCached(Inputs[1], 1, "other channel count");
+	TestCached(Inputs[1], 2, "channel count back");
+
+	// Inputs sharing the key of a cached one, and the cached one again afterwards
+	for (int i = 0; i < 8; i++) {
+		std::vector<uint8_t> Colliding = Inputs[i];
+		Colliding[Colliding.size() - 1 - rng() % 1000] ^= 1 + rng() % 255;
+		TestCached(Colliding, 1 + i % 2, "colliding input");
+		TestCached(Inputs[i], 1 + i % 2, "after a collision");
+		TestCached(Colliding, 1 + i % 2, "colliding input again");
+	}
+
+	// Enough distinct input to evict everything several times over, revisiting older inputs on the way
+	size_t Total = 0;
+	std::vector<std::vector<uint8_t>> Recent;
+	while (Total < 4 * XADPCM_CACHE_MAX_TOTAL_SIZE) {
+		std::vector<uint8_t> Input(XADPCM_CACHE_MIN_INPUT_SIZE * (1 + rng() % 400));
+		RandomInput(rng, Input, 2);
+		TestCached(Input, 2, "filling");
+		Total += Input.size() * 5;
+		Recent.push_back(std::move(Input));
+		if (Recent.size() > 32) {
+			Recent.erase(Recent.begin());
+		}
+		std::vector<uint8_t> &Old = Recent[rng() % Recent.size()];
+		TestCached(Old, 2, "revisit while evicting");
+	}
+
+	// An input larger than the whole cache is decoded, but not kept
+	std::vector<uint8_t> Huge(XADPCM_CACHE_MAX_TOTAL_SIZE / 4 * 3);
+	RandomInput(rng, Huge, 2);
+	TestCached(Huge, 2, "larger than the cache");
+	TestCached(Huge, 2, "larger than the cache again");
+	for (auto &Input : Recent) {
+		TestCached(Input, 2, "after a large input");
+	}
+}
+
+typedef std::chrono::steady_clock BenchClock;
+
+// Runs Decode over and over for the given time, and returns the PCM bytes it wrote per second
+template<typename Decoder>
+static double Measure(double Seconds, Decoder Decode)
+{
+	uint64_t Bytes = 0;
+	auto Start = BenchClock::now();
+	double Elapsed;
+	do {
+		for (unsigned i = 0; i < 16; i++) {
+			Bytes += Decode();
+		}
+		Elapsed = std::chrono::duration<double>(BenchClock::now() - Start).count();
+	} while (Elapsed < Seconds);
+	return (double)Bytes / Elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 2 && strcmp(argv[1], "-test") == 0) {
+		TestImplementation(XADPCM_NOSIMD);
+		TestImplementation(XADPCM_SSE2);
+		TestImplementation(XADPCM_AVX2);
+		TestCache();
+		printf("%u failure(s)\n", g_Failures);
+		return g_Failures ? 1 : 0;
+	}
+
+	if (argc > 1 && (argv[1][0] < '0' || argv[1][0] > '9')) {
+		printf("Usage : cxbxr-adpcmbench [blocks] [seconds]\n");
+		printf("        cxbxr-adpcmbench -test\n");
+		return 1;
+	}
+
+	// A stereo buffer of about a second at 44.1 kHz
+	int BlockCount = (argc > 1) ? atoi(argv[1]) : 680;
+	double Seconds = (argc > 2) ? atof(argv[2]) : 1.0;
+	if (BlockCount <= 0) {
+		BlockCount = 1;
+	}
+
+	std::mt19937 rng(0xADC0);
+	std::vector<uint8_t> Input(BlockCount * XBOX_ADPCM_SRCSIZE * 2);
+	RandomInput(rng, Input, 2);
+	std::vector<uint8_t> Output(BlockCount * XBOX_ADPCM_DSTSIZE * 2);
+
+	printf("%d stereo blocks, PCM MB per second\n", BlockCount);
+	for (XADPCMImplementation Implementation : { XADPCM_NOSIMD, XADPCM_SSE2, XADPCM_AVX2 }) {
+		if (!XADPCM_UseImplementation(Implementation)) {
+			printf("%-24s %10s\n", ImplementationNames[Implementation], "n/a");
+			continue;
+		}
+		double Rate = Measure(Seconds, [&]() { return XADPCM_Decode(Input.data(), (int)Input.size(), Output.data(), 2); });
+		printf("%-24s %10.1f\n", ImplementationNames[Implementation], Rate / 1e6);
+	}
+
+	// Includes hashing and comparing the input, which the emulator's hasher does faster than the one above
+	double Rate = Measure(Seconds, [&]() { return XADPCM_DecodeCached(Input.data(), (int)Input.size(), Output.data(), 2); });
+	printf("%-24s %10.1f\n", "cache hit", Rate / 1e6);
+
+	return 0;
+}
@@ -31,8 +31,11 @@
 #include <thread>
 #include <vector>
 #include <mutex>
+#include <algorithm>
 #include "Timer.h"
+#include "TimerDelay.h"
 #include "common\util\CxbxUtil.h"
+#include "common\util\CPUID.h"
 #include "core\kernel\init\CxbxKrnl.h"
 #ifdef __linux__
 #include <time.h>
@@ -51,6 +54,8 @@ static std::vector<TimerObject*> TimerList;
 uint64_t HostClockFrequency;
 // Lock to acquire when accessing TimerList
 std::mutex TimerMtx;
+// The clock Timer_Delay_US spins on (the TSC when it runs at a constant rate, otherwise QPC)
+static DelayClock HostDelayClock;
 
 
 // Returns the current time of the timer
@@ -157,6 +162,55 @@ void Timer_Start(TimerObject* Timer, uint64_t Expire_MS)
 	std::thread(ClockThread, Timer).detach();
 }
 
+static uint64_t ReadTsc()
+{
+	return __rdtsc();
+}
+
+static uint64_t ReadQpc()
+{
+	LARGE_INTEGER li;
+	QueryPerformanceCounter(&li);
+	return li.QuadPart;
+}
+
+// Selects and calibrates the clock of Timer_Delay_US, and measures how precise host sleeps are
+static void Timer_InitDelay()
+{
+	HostDelayClock.Read = ReadQpc;
+	HostDelayClock.Frequency = HostClockFrequency;
+
+	// The TSC is cheaper to read than QPC, but only usable when it's invariant (CPUID 0x80000007 EDX bit 8)
+	if (CPUID(0x80000000).EAX().to_ulong() >= 0x80000007 && CPUID(0x80000007).EDX()[8]) {
+		uint64_t QpcStart = ReadQpc();
+		uint64_t TscStart = __rdtsc();
+		uint64_t QpcEnd;
+		do {
+			QpcEnd = ReadQpc();
+		} while (QpcEnd - QpcStart < HostClockFrequency / 50); // 20 ms
+		uint64_t TscEnd = __rdtsc();
+
+		HostDelayClock.Frequency = Muldiv64(TscEnd - TscStart, (uint32_t)HostClockFrequency, (uint32_t)(QpcEnd - QpcStart));
+		HostDelayClock.Read = ReadTsc;
+	}
+
+	// Note : this is measured after timeBeginPeriod(1), so usually comes out well below a millisecond
+	HostDelayClock.SleepOvershoot_US = DelayClock_MeasureSleepOvershoot(HostDelayClock);
+
+	EmuLogEx(CXBXR_MODULE::INIT, LOG_LEVEL::INFO, "Delays spin on the %s at %llu Hz, host sleeps return up to %llu us late",
+		(HostDelayClock.Read == ReadTsc) ? "TSC" : "QPC", HostDelayClock.Frequency, HostDelayClock.SleepOvershoot_US);
+}
+
+void Timer_Delay_US(uint64_t Microseconds)
+{
+	DelayClock_Stall_US(HostDelayClock, Microseconds);
+}
+
+bool Timer_Wait(uint64_t Interval)
+{
+	return DelayHostWait(Interval);
+}
+
 // Retrives the frequency of the high resolution clock of the host
 void Timer_Init()
 {
@@ -164,6 +218,7 @@ void Timer_Init()
 	LARGE_INTEGER freq;
 	QueryPerformanceFrequency(&freq);
 	HostClockFrequency = freq.QuadPart;
+	Timer_InitDelay();
 #elif __linux__
 	ClockFrequency = 0;
 #else
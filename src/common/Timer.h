@@ -63,4 +63,13 @@ void Timer_ChangeExpireTime(TimerObject* Timer, uint64_t Expire_ms);
 uint64_t GetTime_NS(TimerObject* Timer);
 void Timer_Init();
 
+/* Precise delays, calibrated by Timer_Init */
+// Stalls at least Microseconds : short stalls spin, medium ones yield the core while spinning,
+// long ones sleep through the scheduler and spin only the last part (which Sleep can't resolve).
+// This keeps the core busy, so it's only meant for the few us a driver stalls for.
+void Timer_Delay_US(uint64_t Microseconds);
+// Blocks for at least Interval (in 100 ns units) on a high resolution host timer, without spinning.
+// Returns false when the host has no such timer.
+bool Timer_Wait(uint64_t Interval);
+
 #endif
@@ -0,0 +1,159 @@
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+#ifndef TIMERDELAY_H
+#define TIMERDELAY_H
+
+// The delay strategies behind Timer_Delay_US and Timer_Wait, kept free of emulator
+// dependencies so that cxbxr-delaybench can measure the very same code on any host.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#ifdef _WIN32
+#include <windows.h>
+#include <intrin.h>
+#else
+#include <time.h>
+#include <sched.h>
+#include <immintrin.h>
+#endif
+
+// Remaining stalls up to this long (in us) are spun, longer ones yield the core in between
+#define DELAY_SPIN_US 50
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002 // Windows 10 1803 and later
+#endif
+
+// The clock stalls spin on, and how precise host sleeps are
+struct DelayClock {
+	uint64_t(*Read)();
+	uint64_t Frequency;
+	// How much later than requested a host sleep returns (in us)
+	uint64_t SleepOvershoot_US;
+};
+
+static inline uint64_t DelayClockTicksFromUS(const DelayClock &Clock, uint64_t Microseconds)
+{
+	// Split in whole seconds and the rest, so that long waits don't overflow
+	return ((Microseconds / 1000000) * Clock.Frequency) + (((Microseconds % 1000000) * Clock.Frequency) / 1000000);
+}
+
+static inline uint64_t DelayClockTicksToUS(const DelayClock &Clock, uint64_t Ticks)
+{
+	return ((Ticks / Clock.Frequency) * 1000000) + (((Ticks % Clock.Frequency) * 1000000) / Clock.Frequency);
+}
+
+static inline void DelayHostSleep_MS(uint32_t Milliseconds)
+{
+#ifdef _WIN32
+	Sleep(Milliseconds);
+#else
+	struct timespec ts = { (time_t)(Milliseconds / 1000), (long)(Milliseconds % 1000) * 1000000 };
+	nanosleep(&ts, nullptr);
+#endif
+}
+
+static inline void DelayHostYield()
+{
+#ifdef _WIN32
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+}
+
+// Measures how much later than requested a one millisecond host sleep returns, at worst
+static inline uint64_t DelayClock_MeasureSleepOvershoot(const DelayClock &Clock)
+{
+	uint64_t Overshoot_US = 0;
+	for (int i = 0; i < 5; i++) {
+		uint64_t Start = Clock.Read();
+		DelayHostSleep_MS(1);
+		uint64_t Slept_US = DelayClockTicksToUS(Clock, Clock.Read() - Start);
+		if (Slept_US > 1000 && Overshoot_US < Slept_US - 1000) {
+			Overshoot_US = Slept_US - 1000;
+		}
+	}
+
+	return Overshoot_US;
+}
+
+// Stalls at least Microseconds, precisely but at the cost of keeping the core busy
+static inline void DelayClock_Stall_US(const DelayClock &Clock, uint64_t Microseconds)
+{
+	uint64_t Now = Clock.Read();
+	uint64_t Deadline = Now + DelayClockTicksFromUS(Clock, Microseconds);
+
+	while (Now < Deadline) {
+		uint64_t Remaining_US = DelayClockTicksToUS(Clock, Deadline - Now);
+		if (Remaining_US >= 1000 + Clock.SleepOvershoot_US + DELAY_SPIN_US) {
+			// Long : let the scheduler have the core, but wake up early enough to spin the rest
+			DelayHostSleep_MS((uint32_t)std::min<uint64_t>((Remaining_US - Clock.SleepOvershoot_US) / 1000, UINT32_MAX));
+		} else if (Remaining_US > DELAY_SPIN_US) {
+			// Medium : let other ready threads run, without waiting for a scheduler tick
+			DelayHostYield();
+		} else {
+			// Short : spin, but tell the core so it can save power and favor its sibling hyperthread
+			_mm_pause();
+		}
+
+		Now = Clock.Read();
+	}
+}
+
+// Blocks the calling thread for at least Interval (in 100 ns units) on a high resolution host timer,
+// without spinning. Returns false when the host has no such timer, so that the caller can fall back.
+static inline bool DelayHostWait(uint64_t Interval)
+{
+#ifdef _WIN32
+	// One timer per thread, created on first use and closed when the thread exits
+	struct HostTimer {
+		HANDLE hTimer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+		~HostTimer() { if (hTimer != nullptr) CloseHandle(hTimer); }
+	};
+	static thread_local HostTimer Timer;
+	if (Timer.hTimer == nullptr) {
+		return false;
+	}
+
+	LARGE_INTEGER DueTime;
+	DueTime.QuadPart = -(LONGLONG)Interval; // Relative
+	if (!SetWaitableTimer(Timer.hTimer, &DueTime, 0, nullptr, nullptr, FALSE)) {
+		return false;
+	}
+
+	return WaitForSingleObject(Timer.hTimer, INFINITE) == WAIT_OBJECT_0;
+#else
+	struct timespec ts = { (time_t)(Interval / 10000000), (long)(Interval % 10000000) * 100 };
+	while (nanosleep(&ts, &ts) != 0) {
+		if (errno != EINTR) {
+			return false;
+		}
+		// Interrupted by a signal, wait for the rest
+	}
+	return true;
+#endif
+}
+
+#endif
@@ -0,0 +1,383 @@
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+#include <emmintrin.h> // SSE2
+#include <immintrin.h> // AVX2
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "common/XADPCM.h"
+#include "common/util/CPUID.h"
+#include "common/util/hasher.h"
+#include "XADPCMDecoder.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+// MSVC allows AVX2 intrinsics anywhere, other compilers only in functions built for it (the CPU is checked at run time)
+#define XADPCM_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define XADPCM_TARGET_AVX2
+#endif
+
+// Number of 16 bit samples decoded from one 36 byte block (header sample + 8 words of 8 nibbles)
+#define XADPCM_BLOCK_SAMPLES (XBOX_ADPCM_DSTSIZE / 2)
+
+// A single channel of a single block; the unit that gets assigned to a SIMD lane
+typedef struct {
+	const uint8_t *pHeader; // 4 byte block header of this channel
+	const uint8_t *pCodes;  // First 4 byte code word of this channel
+	int16_t       *pOut;    // Header sample of this channel in the interleaved output
+} XADPCMChannelBlock;
+
+static const int32_t StepTable32[89] = {
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+	19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+	130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+	337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+	876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+	2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+	5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+// Reads the block header the way TXboxAdpcmDecoder_Decode_Memory does, including
+// the truncation of the 16 bit index into the decoder's int8_t Index field
+static inline void XADPCM_ReadHeader(const uint8_t *pHeader, int32_t &Predictor, int32_t &Index)
+{
+	Predictor = (int16_t)(pHeader[0] | (pHeader[1] << 8));
+	Index = (int8_t)pHeader[2];
+	if (Index > 88) {
+		Index = 88;
+	} else if (Index < 0) {
+		Index = 0;
+	}
+}
+
+static inline uint32_t XADPCM_ReadCodeWord(const uint8_t *pCodes)
+{
+	return pCodes[0] | (pCodes[1] << 8) | (pCodes[2] << 16) | (pCodes[3] << 24);
+}
+
+// Default implementation, one channel block at a time
+static void XADPCM_DecodeChannelBlock_NoSIMD(const XADPCMChannelBlock &Block, const int FChannels)
+{
+	TAdpcmState State;
+	int32_t Predictor, Index;
+	XADPCM_ReadHeader(Block.pHeader, Predictor, Index);
+	State.Predictor = (int16_t)Predictor;
+	State.Index = (int8_t)Index;
+	State.StepSize = StepTable[State.Index];
+
+	int16_t *pOut = Block.pOut;
+	*pOut = State.Predictor;
+	pOut += FChannels;
+
+	for (int i = 0; i < 8; i++) {
+		uint32_t CodeBuf = XADPCM_ReadCodeWord(Block.pCodes + (i * 4 * FChannels));
+		for (int j = 0; j < 8; j++) {
+			*pOut = (int16_t)TXboxAdpcmDecoder_DecodeSample(CodeBuf & 15, &State);
+			pOut += FChannels;
+			CodeBuf >>= 4;
+		}
+	}
+}
+
+// SSE2 implementation, decodes 4 channel blocks side by side
+static void XADPCM_DecodeChannelBlocks_SSE2(const XADPCMChannelBlock *pBlocks, const int FChannels)
+{
+	alignas(16) int32_t Predictors[4];
+	alignas(16) int32_t Indices[4];
+	alignas(16) int16_t Samples[8];
+
+	for (int l = 0; l < 4; l++) {
+		XADPCM_ReadHeader(pBlocks[l].pHeader, Predictors[l], Indices[l]);
+		pBlocks[l].pOut[0] = (int16_t)Predictors[l];
+	}
+
+	__m128i predictor = _mm_load_si128((__m128i*)Predictors);
+	__m128i index = _mm_load_si128((__m128i*)Indices);
+	__m128i step = _mm_setr_epi32(StepTable32[Indices[0]], StepTable32[Indices[1]], StepTable32[Indices[2]], StepTable32[Indices[3]]);
+
+	const __m128i nibble_mask = _mm_set1_epi32(15);
+	const __m128i bit1 = _mm_set1_epi32(1);
+	const __m128i bit2 = _mm_set1_epi32(2);
+	const __m128i bit4 = _mm_set1_epi32(4);
+	const __m128i bit8 = _mm_set1_epi32(8);
+	const __m128i low3_mask = _mm_set1_epi32(7);
+	const __m128i three = _mm_set1_epi32(3);
+	const __m128i six = _mm_set1_epi32(6);
+	const __m128i minus_one = _mm_set1_epi32(-1);
+	const __m128i index_max = _mm_set1_epi32(88);
+
+	int OutOffset = FChannels;
+	for (int i = 0; i < 8; i++) {
+		const int CodeOffset = i * 4 * FChannels;
+		__m128i codes = _mm_setr_epi32(
+			XADPCM_ReadCodeWord(pBlocks[0].pCodes + CodeOffset),
+			XADPCM_ReadCodeWord(pBlocks[1].pCodes + CodeOffset),
+			XADPCM_ReadCodeWord(pBlocks[2].pCodes + CodeOffset),
+			XADPCM_ReadCodeWord(pBlocks[3].pCodes + CodeOffset));
+
+		for (int j = 0; j < 8; j++) {
+			__m128i code = _mm_and_si128(codes, nibble_mask);
+			codes = _mm_srli_epi32(codes, 4);
+
+			// Delta = (StepSize >> 3) [+ StepSize] [+ StepSize >> 1] [+ StepSize >> 2], negated when bit 3 is set
+			__m128i delta = _mm_srai_epi32(step, 3);
+			delta = _mm_add_epi32(delta, _mm_and_si128(step, _mm_cmpeq_epi32(_mm_and_si128(code, bit4), bit4)));
+			delta = _mm_add_epi32(delta, _mm_and_si128(_mm_srai_epi32(step, 1), _mm_cmpeq_epi32(_mm_and_si128(code, bit2), bit2)));
+			delta = _mm_add_epi32(delta, _mm_and_si128(_mm_srai_epi32(step, 2), _mm_cmpeq_epi32(_mm_and_si128(code, bit1), bit1)));
+			__m128i sign = _mm_cmpeq_epi32(_mm_and_si128(code, bit8), bit8);
+			delta = _mm_sub_epi32(_mm_xor_si128(delta, sign), sign);
+
+			// Signed saturation while packing to 16 bit is exactly the [-32768, 32767] clamp
+			__m128i result16 = _mm_packs_epi32(_mm_add_epi32(predictor, delta), _mm_setzero_si128());
+			predictor = _mm_srai_epi32(_mm_unpacklo_epi16(result16, result16), 16);
+
+			// IndexTable[Code] is -1 for (Code & 7) < 4, otherwise (Code & 7) * 2 - 6
+			__m128i low3 = _mm_and_si128(code, low3_mask);
+			__m128i large = _mm_cmpgt_epi32(low3, three);
+			__m128i index_delta = _mm_or_si128(
+				_mm_and_si128(large, _mm_sub_epi32(_mm_slli_epi32(low3, 1), six)),
+				_mm_andnot_si128(large, minus_one));
+			index = _mm_add_epi32(index, index_delta);
+			// Index stays within [-1, 96], so 16 bit min/max on the 32 bit lanes clamps correctly
+			index = _mm_min_epi16(_mm_max_epi16(index, _mm_setzero_si128()), index_max);
+
+			// SSE2 has no gather, so look up the new step sizes one lane at a time
+			_mm_store_si128((__m128i*)Indices, index);
+			step = _mm_setr_epi32(StepTable32[Indices[0]], StepTable32[Indices[1]], StepTable32[Indices[2]], StepTable32[Indices[3]]);
+
+			_mm_storel_epi64((__m128i*)Samples, result16);
+			pBlocks[0].pOut[OutOffset] = Samples[0];
+			pBlocks[1].pOut[OutOffset] = Samples[1];
+			pBlocks[2].pOut[OutOffset] = Samples[2];
+			pBlocks[3].pOut[OutOffset] = Samples[3];
+			OutOffset += FChannels;
+		}
+	}
+}
+
+// AVX2 implementation, decodes 8 channel blocks side by side
+XADPCM_TARGET_AVX2 static void XADPCM_DecodeChannelBlocks_AVX2(const XADPCMChannelBlock *pBlocks, const int FChannels)
+{
+	alignas(32) int32_t Predictors[8];
+	alignas(32) int32_t Indices[8];
+	alignas(32) int32_t Codes[8];
+	alignas(32) int32_t Samples[8];
+
+	for (int l = 0; l < 8; l++) {
+		XADPCM_ReadHeader(pBlocks[l].pHeader, Predictors[l], Indices[l]);
+		pBlocks[l].pOut[0] = (int16_t)Predictors[l];
+	}
+
+	__m256i predictor = _mm256_load_si256((__m256i*)Predictors);
+	__m256i index = _mm256_load_si256((__m256i*)Indices);
+	__m256i step = _mm256_i32gather_epi32(StepTable32, index, 4);
+
+	const __m256i nibble_mask = _mm256_set1_epi32(15);
+	const __m256i bit1 = _mm256_set1_epi32(1);
+	const __m256i bit2 = _mm256_set1_epi32(2);
+	const __m256i bit4 = _mm256_set1_epi32(4);
+	const __m256i bit8 = _mm256_set1_epi32(8);
+	const __m256i low3_mask = _mm256_set1_epi32(7);
+	const __m256i three = _mm256_set1_epi32(3);
+	const __m256i six = _mm256_set1_epi32(6);
+	const __m256i minus_one = _mm256_set1_epi32(-1);
+	const __m256i index_max = _mm256_set1_epi32(88);
+	const __m256i sample_min = _mm256_set1_epi32(-32768);
+	const __m256i sample_max = _mm256_set1_epi32(32767);
+
+	int OutOffset = FChannels;
+	for (int i = 0; i < 8; i++) {
+		const int CodeOffset = i * 4 * FChannels;
+		for (int l = 0; l < 8; l++) {
+			Codes[l] = XADPCM_ReadCodeWord(pBlocks[l].pCodes + CodeOffset);
+		}
+		__m256i codes = _mm256_load_si256((__m256i*)Codes);
+
+		for (int j = 0; j < 8; j++) {
+			__m256i code = _mm256_and_si256(codes, nibble_mask);
+			codes = _mm256_srli_epi32(codes, 4);
+
+			__m256i delta = _mm256_srai_epi32(step, 3);
+			delta = _mm256_add_epi32(delta, _mm256_and_si256(step, _mm256_cmpeq_epi32(_mm256_and_si256(code, bit4), bit4)));
+			delta = _mm256_add_epi32(delta, _mm256_and_si256(_mm256_srai_epi32(step, 1), _mm256_cmpeq_epi32(_mm256_and_si256(code, bit2), bit2)));
+			delta = _mm256_add_epi32(delta, _mm256_and_si256(_mm256_srai_epi32(step, 2), _mm256_cmpeq_epi32(_mm256_and_si256(code, bit1), bit1)));
+			__m256i sign = _mm256_cmpeq_epi32(_mm256_and_si256(code, bit8), bit8);
+			delta = _mm256_sub_epi32(_mm256_xor_si256(delta, sign), sign);
+
+			predictor = _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(predictor, delta), sample_min), sample_max);
+
+			__m256i low3 = _mm256_and_si256(code, low3_mask);
+			__m256i large = _mm256_cmpgt_epi32(low3, three);
+			__m256i index_delta = _mm256_blendv_epi8(minus_one, _mm256_sub_epi32(_mm256_slli_epi32(low3, 1), six), large);
+			index = _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(index, index_delta), _mm256_setzero_si256()), index_max);
+			step = _mm256_i32gather_epi32(StepTable32, index, 4);
+
+			_mm256_store_si256((__m256i*)Samples, predictor);
+			for (int l = 0; l < 8; l++) {
+				pBlocks[l].pOut[OutOffset] = (int16_t)Samples[l];
+			}
+			OutOffset += FChannels;
+		}
+	}
+}
+
+// Splits the input into channel blocks and feeds them to the given kernel, LaneCount at a time
+template<int LaneCount>
+static int XADPCM_DecodeLanes(uint8_t *in, int inlen, uint8_t *out, const int FChannels, void(*Kernel)(const XADPCMChannelBlock *, const int))
+{
+	const int BlockCount = (inlen / XBOX_ADPCM_SRCSIZE) / FChannels;
+	XADPCMChannelBlock Lanes[LaneCount];
+	int LaneIndex = 0;
+
+	for (int b = 0; b < BlockCount; b++) {
+		const uint8_t *pBlockIn = in + (b * XBOX_ADPCM_SRCSIZE * FChannels);
+		int16_t *pBlockOut = (int16_t*)out + (b * XADPCM_BLOCK_SAMPLES * FChannels);
+
+		for (int c = 0; c < FChannels; c++) {
+			Lanes[LaneIndex].pHeader = pBlockIn + (c * 4);
+			Lanes[LaneIndex].pCodes = pBlockIn + (FChannels * 4) + (c * 4);
+			Lanes[LaneIndex].pOut = pBlockOut + c;
+
+			if (++LaneIndex == LaneCount) {
+				Kernel(Lanes, FChannels);
+				LaneIndex = 0;
+			}
+		}
+	}
+
+	// Whatever doesn't fill all lanes is decoded one channel block at a time
+	for (int l = 0; l < LaneIndex; l++) {
+		XADPCM_DecodeChannelBlock_NoSIMD(Lanes[l], FChannels);
+	}
+
+	return BlockCount * XBOX_ADPCM_DSTSIZE * FChannels;
+}
+
+static int XADPCM_Decode_SSE2(uint8_t *in, int inlen, uint8_t *out, const int FChannels)
+{
+	return XADPCM_DecodeLanes<4>(in, inlen, out, FChannels, XADPCM_DecodeChannelBlocks_SSE2);
+}
+
+static int XADPCM_Decode_AVX2(uint8_t *in, int inlen, uint8_t *out, const int FChannels)
+{
+	return XADPCM_DecodeLanes<8>(in, inlen, out, FChannels, XADPCM_DecodeChannelBlocks_AVX2);
+}
+
+// Detect SIMD support to select real implementation on first call
+int(*XADPCM_Decode)(uint8_t *, int, uint8_t *, const int) =
+[](uint8_t *in, int inlen, uint8_t *out, const int FChannels)
+{
+	if (!XADPCM_UseImplementation(XADPCM_AVX2) && !XADPCM_UseImplementation(XADPCM_SSE2))
+		XADPCM_UseImplementation(XADPCM_NOSIMD);
+
+	return XADPCM_Decode(in, inlen, out, FChannels);
+};
+
+bool XADPCM_UseImplementation(XADPCMImplementation Implementation)
+{
+	SimdCaps supports;
+	switch (Implementation) {
+	case XADPCM_AVX2:
+		if (!supports.AVX2())
+			return false;
+		XADPCM_Decode = XADPCM_Decode_AVX2;
+		return true;
+	case XADPCM_SSE2:
+		if (!supports.SSE2())
+			return false;
+		XADPCM_Decode = XADPCM_Decode_SSE2;
+		return true;
+	default:
+		XADPCM_Decode = TXboxAdpcmDecoder_Decode_Memory;
+		return true;
+	}
+}
+
+// Decoded PCM cache
+// Small uploads are cheaper to decode than to hash and look up, so they bypass the cache
+#define XADPCM_CACHE_MIN_INPUT_SIZE (XBOX_ADPCM_SRCSIZE * 64)
+#define XADPCM_CACHE_MAX_TOTAL_SIZE (16 * 1024 * 1024)
+
+typedef struct _XADPCMCacheEntry
+{
+	std::vector<uint8_t>          Input;  // Kept to compare against, since different input can share a hash
+	std::vector<uint8_t>          Output;
+	std::list<uint64_t>::iterator Order;  // Position of this entry in g_XADPCMCacheOrder
+}
+XADPCMCacheEntry;
+
+static std::mutex                                     g_XADPCMCacheMutex;
+static std::unordered_map<uint64_t, XADPCMCacheEntry> g_XADPCMCache;
+static std::list<uint64_t>                            g_XADPCMCacheOrder; // Oldest entry first
+static size_t                                         g_XADPCMCacheSize = 0;
+
+static void XADPCM_CacheErase(std::unordered_map<uint64_t, XADPCMCacheEntry>::iterator it)
+{
+	g_XADPCMCacheSize -= it->second.Input.size() + it->second.Output.size();
+	g_XADPCMCacheOrder.erase(it->second.Order);
+	g_XADPCMCache.erase(it);
+}
+
+int XADPCM_DecodeCached(uint8_t *in, int inlen, uint8_t *out, const int FChannels)
+{
+	if (inlen < XADPCM_CACHE_MIN_INPUT_SIZE) {
+		return XADPCM_Decode(in, inlen, out, FChannels);
+	}
+
+	// The channel count changes the output layout of identical input, so it is part of the key
+	uint64_t key = ComputeHash(in, inlen) ^ ((uint64_t)FChannels << 56) ^ (uint64_t)inlen;
+
+	std::lock_guard<std::mutex> lock(g_XADPCMCacheMutex);
+
+	auto it = g_XADPCMCache.find(key);
+	if (it != g_XADPCMCache.end()) {
+		// Only a hit when the whole input matches, a colliding entry is replaced below
+		if (it->second.Input.size() == (size_t)inlen && std::memcmp(it->second.Input.data(), in, inlen) == 0) {
+			std::memcpy(out, it->second.Output.data(), it->second.Output.size());
+			return (int)it->second.Output.size();
+		}
+
+		XADPCM_CacheErase(it);
+	}
+
+	int outlen = XADPCM_Decode(in, inlen, out, FChannels);
+	size_t entrySize = (size_t)inlen + outlen;
+
+	// Evict the oldest entries to stay within budget
+	while (g_XADPCMCacheSize + entrySize > XADPCM_CACHE_MAX_TOTAL_SIZE && !g_XADPCMCacheOrder.empty()) {
+		XADPCM_CacheErase(g_XADPCMCache.find(g_XADPCMCacheOrder.front()));
+	}
+
+	if (entrySize <= XADPCM_CACHE_MAX_TOTAL_SIZE) {
+		g_XADPCMCache.emplace(key, XADPCMCacheEntry{ std::vector<uint8_t>(in, in + inlen), std::vector<uint8_t>(out, out + outlen),
+			g_XADPCMCacheOrder.insert(g_XADPCMCacheOrder.end(), key) });
+		g_XADPCMCacheSize += entrySize;
+	}
+
+	return outlen;
+}
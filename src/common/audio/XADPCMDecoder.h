@@ -0,0 +1,57 @@
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+#ifndef XADPCMDECODER_H
+#define XADPCMDECODER_H
+
+#include <cstdint>
+
+// Decodes Xbox ADPCM into 16 bit PCM, with the same input/output layout and return value as
+// TXboxAdpcmDecoder_Decode_Memory. Every 36 byte block (per channel) starts from its own header,
+// so blocks are independent and are decoded several at once in SIMD lanes when the host allows it.
+extern int(*XADPCM_Decode)
+(
+	uint8_t *in,
+	int inlen,
+	uint8_t *out,
+	const int FChannels
+);
+
+// The implementations of XADPCM_Decode
+typedef enum _XADPCMImplementation
+{
+	XADPCM_NOSIMD, // TXboxAdpcmDecoder_Decode_Memory itself
+	XADPCM_SSE2,
+	XADPCM_AVX2
+}
+XADPCMImplementation;
+
+// Selects an implementation of XADPCM_Decode instead of the best one the host supports (the default),
+// returns false and keeps the current one when the host lacks the instructions it needs
+bool XADPCM_UseImplementation(XADPCMImplementation Implementation);
+
+// Same as XADPCM_Decode, but re-uses previously decoded PCM of identical input (found by content hash,
+// then compared in full).
+// Intended for static buffers which titles often re-create or re-upload unchanged.
+int XADPCM_DecodeCached(uint8_t *in, int inlen, uint8_t *out, const int FChannels);
+
+#endif // XADPCMDECODER_H
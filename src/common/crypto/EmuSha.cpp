@@ -50,8 +50,17 @@ A million repetitions of "a"
 
 #include <stdio.h>
 #include <string.h>
+#include <immintrin.h> // SHA
+#include "common/util/CPUID.h"
 #include "EmuSha.h"
 
+#if defined(__GNUC__) || defined(__clang__)
+// MSVC allows SHA intrinsics anywhere, other compilers only in functions built for it (the CPU is checked at run time)
+#define SHA1_TARGET_SHA __attribute__((target("sha,sse4.1")))
+#else
+#define SHA1_TARGET_SHA
+#endif
+
 
 #define rol(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
 
@@ -199,6 +208,133 @@ void SHA1Transform(uint32_t state[5], const unsigned char buffer[64])
 #endif
 }
 
+static void SHA1TransformBlocks_NoSIMD(uint32_t state[5], const unsigned char* data, uint32_t blocks)
+{
+	for (; blocks > 0; blocks--, data += 64) {
+		SHA1Transform(state, data);
+	}
+}
+
+// Four rounds with the SHA extensions, while expanding the message words needed four rounds later
+#define SHA1_ROUNDS4(E, ENext, M0, M1, M2, M3, Func) \
+	E = _mm_sha1nexte_epu32(E, M0);                  \
+	ENext = ABCD;                                    \
+	M1 = _mm_sha1msg2_epu32(M1, M0);                 \
+	ABCD = _mm_sha1rnds4_epu32(ABCD, E, Func);       \
+	M3 = _mm_sha1msg1_epu32(M3, M0);                 \
+	M2 = _mm_xor_si128(M2, M0);
+
+/* Hash consecutive 512-bit blocks with the SHA extensions (Goldmont, Zen and Ice Lake onwards) */
+SHA1_TARGET_SHA static void SHA1TransformBlocks_SHA(uint32_t state[5], const unsigned char* data, uint32_t blocks)
+{
+	const __m128i ByteSwap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+	// The instructions keep a, b, c, d in one register (a in the highest lane) and e in the highest lane of another
+	__m128i ABCD = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0x1B);
+	__m128i E0 = _mm_set_epi32(state[4], 0, 0, 0);
+	__m128i E1, MSG0, MSG1, MSG2, MSG3;
+
+	for (; blocks > 0; blocks--, data += 64) {
+		__m128i ABCDSave = ABCD;
+		__m128i E0Save = E0;
+
+		// Rounds 0-3
+		MSG0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 0)), ByteSwap);
+		E0 = _mm_add_epi32(E0, MSG0);
+		E1 = ABCD;
+		ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
+
+		// Rounds 4-7
+		MSG1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), ByteSwap);
+		E1 = _mm_sha1nexte_epu32(E1, MSG1);
+		E0 = ABCD;
+		ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 0);
+		MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+
+		// Rounds 8-11
+		MSG2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), ByteSwap);
+		E0 = _mm_sha1nexte_epu32(E0, MSG2);
+		E1 = ABCD;
+		ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
+		MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+		MSG0 = _mm_xor_si128(MSG0, MSG2);
+
+		// Rounds 12-15
+		MSG3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), ByteSwap);
+		E1 = _mm_sha1nexte_epu32(E1, MSG3);
+		E0 = ABCD;
+		MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+		ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 0);
+		MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+		MSG1 = _mm_xor_si128(MSG1, MSG3);
+
+		// Rounds 16-67
+		SHA1_ROUNDS4(E0, E1, MSG0, MSG1, MSG2, MSG3, 0);
+		SHA1_ROUNDS4(E1, E0, MSG1, MSG2, MSG3, MSG0, 1);
+		SHA1_ROUNDS4(E0, E1, MSG2, MSG3, MSG0, MSG1, 1);
+		SHA1_ROUNDS4(E1, E0, MSG3, MSG0, MSG1, MSG2, 1);
+		SHA1_ROUNDS4(E0, E1, MSG0, MSG1, MSG2, MSG3, 1);
+		SHA1_ROUNDS4(E1, E0, MSG1, MSG2, MSG3, MSG0, 1);
+		SHA1_ROUNDS4(E0, E1, MSG2, MSG3, MSG0, MSG1, 2);
+		SHA1_ROUNDS4(E1, E0, MSG3, MSG0, MSG1, MSG2, 2);
+		SHA1_ROUNDS4(E0, E1, MSG0, MSG1, MSG2, MSG3, 2);
+		SHA1_ROUNDS4(E1, E0, MSG1, MSG2, MSG3, MSG0, 2);
+		SHA1_ROUNDS4(E0, E1, MSG2, MSG3, MSG0, MSG1, 2);
+		SHA1_ROUNDS4(E1, E0, MSG3, MSG0, MSG1, MSG2, 3);
+		SHA1_ROUNDS4(E0, E1, MSG0, MSG1, MSG2, MSG3, 3);
+
+		// Rounds 68-71
+		E1 = _mm_sha1nexte_epu32(E1, MSG1);
+		E0 = ABCD;
+		MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+		ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 3);
+		MSG3 = _mm_xor_si128(MSG3, MSG1);
+
+		// Rounds 72-75
+		E0 = _mm_sha1nexte_epu32(E0, MSG2);
+		E1 = ABCD;
+		MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+		ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 3);
+
+		// Rounds 76-79
+		E1 = _mm_sha1nexte_epu32(E1, MSG3);
+		E0 = ABCD;
+		ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 3);
+
+		// Add the working vars back
+		E0 = _mm_sha1nexte_epu32(E0, E0Save);
+		ABCD = _mm_add_epi32(ABCD, ABCDSave);
+	}
+
+	_mm_storeu_si128((__m128i*)state, _mm_shuffle_epi32(ABCD, 0x1B));
+	state[4] = _mm_extract_epi32(E0, 3);
+}
+
+// Detect SHA extensions support to select real implementation on first call
+static void(*SHA1TransformBlocks)(uint32_t[5], const unsigned char*, uint32_t) =
+[](uint32_t state[5], const unsigned char* data, uint32_t blocks)
+{
+	if (!SHA1_UseImplementation(SHA1_SHA))
+		SHA1_UseImplementation(SHA1_NOSIMD);
+
+	SHA1TransformBlocks(state, data, blocks);
+};
+
+bool SHA1_UseImplementation(SHA1Implementation Implementation)
+{
+	SimdCaps supports;
+	switch (Implementation) {
+	case SHA1_SHA:
+		if (!supports.SHA() || !supports.SSE41())
+			return false;
+		SHA1TransformBlocks = SHA1TransformBlocks_SHA;
+		return true;
+	default:
+		SHA1TransformBlocks = SHA1TransformBlocks_NoSIMD;
+		return true;
+	}
+}
+
 /* SHA1Init - Initialize new context */
 void SHA1Init(SHA1_CTX* context)
 {
@@ -226,10 +362,13 @@ void SHA1Update(SHA1_CTX* context, const unsigned char* data, uint32_t len)
 	if ((j + len) > 63)
 	{
 		memcpy(&context->buffer[j], data, (i = 64 - j));
-		SHA1Transform(context->state, context->buffer);
-		for (; i + 63 < len; i += 64)
+		SHA1TransformBlocks(context->state, context->buffer, 1);
+		// Hash all whole blocks of the input in one go, straight from the caller's buffer
+		uint32_t blocks = (len - i) / 64;
+		if (blocks > 0)
 		{
-			SHA1Transform(context->state, &data[i]);
+			SHA1TransformBlocks(context->state, &data[i], blocks);
+			i += blocks * 64;
 		}
 		j = 0;
 	}
@@ -246,8 +385,6 @@ void SHA1Final(unsigned char digest[A_SHA_DIGEST_LEN], SHA1_CTX* context)
 
 	unsigned char finalcount[8];
 
-	unsigned char c;
-
 #if 0    /* untested "improvement" by DHR */
 	/* Convert context->count to a sequence of bytes
 	* in finalcount.  Second element first, but
@@ -271,13 +408,10 @@ void SHA1Final(unsigned char digest[A_SHA_DIGEST_LEN], SHA1_CTX* context)
 		finalcount[i] = (unsigned char)((context->count[(i >= 4 ? 0 : 1)] >> ((3 - (i & 3)) * 8)) & 255);      /* Endian independent */
 	}
 #endif
-	c = 0200;
-	SHA1Update(context, &c, 1);
-	while ((context->count[0] & 504) != 448)
-	{
-		c = 0000;
-		SHA1Update(context, &c, 1);
-	}
+	/* Pad with 0x80 and zeroes up to 56 bytes into a block, in one update instead of byte by byte */
+	static const unsigned char padding[64] = { 0200 };
+	uint32_t used = (context->count[0] >> 3) & 63;
+	SHA1Update(context, padding, (used < 56) ? (56 - used) : (120 - used));
 	SHA1Update(context, finalcount, 8); /* Should cause a SHA1Transform() */
 	for (i = 0; i < A_SHA_DIGEST_LEN; i++)
 	{
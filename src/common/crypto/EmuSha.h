@@ -43,4 +43,16 @@ void SHA1Update(SHA1_CTX* context, const unsigned char* data, uint32_t len);
 void SHA1Final(unsigned char digest[A_SHA_DIGEST_LEN], SHA1_CTX* context);
 void CalcSHA1Hash(unsigned char digest[A_SHA_DIGEST_LEN], const unsigned char* data, uint32_t len);
 
+// The implementations of the SHA1 block transform
+typedef enum _SHA1Implementation
+{
+	SHA1_NOSIMD, // SHA1Transform
+	SHA1_SHA     // The SHA extensions
+}
+SHA1Implementation;
+
+// Selects an implementation instead of the best one the host supports (the default), returns
+// false and keeps the current one when the host lacks the instructions it needs
+bool SHA1_UseImplementation(SHA1Implementation Implementation);
+
 #endif
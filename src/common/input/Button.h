@@ -32,6 +32,8 @@
 #include <string>
 
 #define XBOX_CTRL_NUM_BUTTONS 25
+// The rumble is the last binding of an xbox controller, after its 24 inputs
+#define XBOX_CTRL_RUMBLE_BINDING (XBOX_CTRL_NUM_BUTTONS - 1)
 
 
 /* Represents the gui buttons of the xbox device currently being configured */
@@ -35,6 +35,7 @@
 #include "InputDevice.h"
 #include "common\util\CxbxUtil.h"
 #include <algorithm>
+#include <cassert>
 
 
 std::string GetInputDeviceName(int dev_type)
@@ -115,6 +116,13 @@ void InputDevice::AddOutput(Output* const Out)
 	m_Outputs.push_back(Out);
 }
 
+void InputDevice::SetBindings(int XButton, IoControl* Control)
+{
+	assert(XButton >= 0 && XButton < INPUT_MAX_BINDINGS);
+	m_InputBindings[XButton].store(dynamic_cast<Input*>(Control), std::memory_order_relaxed);
+	m_OutputBindings[XButton].store(dynamic_cast<Output*>(Control), std::memory_order_relaxed);
+}
+
 std::string InputDevice::GetQualifiedName() const
 {
 	return this->GetAPI() + "/" + std::to_string(GetId()) + "/" + this->GetDeviceName();
@@ -48,6 +48,9 @@
 #define DIRECTION_IN      0
 #define DIRECTION_OUT     1
 
+// Bindings slots of a device, enough for any emulated xbox device
+#define INPUT_MAX_BINDINGS 32
+
 
 typedef double ControlState;
 
@@ -129,20 +132,14 @@ protected:
 	void AddOutput(Output* const Out);
 	// indicates that the device has new input data available
 	bool m_bDirty;
-	// lock for the bindings map
-	mutable std::mutex m_BindingsMtx;
 
 public:
-	// retrieves the map of input bindings
-	const std::map<int, IoControl*> GetBindings() const {
-		std::lock_guard<std::mutex> lck(m_BindingsMtx);
-		return m_Bindings;
-	}
-	// sets a pair in the map of the input bindings
-	void SetBindings(int XButton, IoControl* Control) {
-		std::lock_guard<std::mutex> lck(m_BindingsMtx);
-		m_Bindings[XButton] = Control;
-	}
+	// retrieves the input bound to the xbox button, nullptr if unbound or bound to an output
+	Input* GetInputBinding(int XButton) const { return m_InputBindings[XButton].load(std::memory_order_relaxed); }
+	// retrieves the output bound to the xbox button, nullptr if unbound or bound to an input
+	Output* GetOutputBinding(int XButton) const { return m_OutputBindings[XButton].load(std::memory_order_relaxed); }
+	// binds a control to the xbox button, resolving its kind once here instead of on every poll
+	void SetBindings(int XButton, IoControl* Control);
 
 protected:
 	class FullAnalogSurface : public Input
@@ -178,8 +175,9 @@ private:
 	std::vector<Output*> m_Outputs;
 	// xbox port(s) this device is attached to
 	bool m_XboxPort[4] = { false };
-	// button bindings to the xbox device buttons
-	std::map<int, IoControl*> m_Bindings;
+	// button bindings to the xbox device buttons, read without locks by the input polling thread
+	std::atomic<Input*> m_InputBindings[INPUT_MAX_BINDINGS] = {};
+	std::atomic<Output*> m_OutputBindings[INPUT_MAX_BINDINGS] = {};
 };
 
 #endif
@@ -37,12 +37,15 @@
 
 
 #include <xboxkrnl/xboxkrnl.h> // For PKINTERRUPT, etc.
+#include <chrono>
+#include <cstring>
 #include "SdlJoystick.h"
 #include "XInputPad.h"
 #include "DInputKeyboardMouse.h"
 #include "InputManager.h"
 #include "..\devices\usb\XidGamepad.h"
 #include "core\kernel\exports\EmuKrnl.h" // For EmuLog
+#include "core\kernel\support\Emu.h" // For g_CPUOthers
 #include "EmuShared.h"
 #include "devices\usb\OHCI.h"
 
@@ -72,6 +75,8 @@ extern CXBX_CONTROLLER_HOST_BRIDGE g_XboxControllerHostBridge[4]; // hle xinput
 
 InputDeviceManager g_InputDeviceManager;
 
+static_assert(XBOX_CTRL_NUM_BUTTONS <= INPUT_MAX_BINDINGS, "Device bindings can't hold all the buttons of the xbox controller");
+
 void InputDeviceManager::Initialize(bool is_gui)
 {
 	// Sdl::Init must be called last since it blocks when it succeeds
@@ -100,6 +105,8 @@ void InputDeviceManager::Initialize(bool is_gui)
 		UpdateDevices(PORT_2, false);
 		UpdateDevices(PORT_3, false);
 		UpdateDevices(PORT_4, false);
+
+		m_PortPollingThread = std::thread(&InputDeviceManager::PollXboxPorts, this);
 	}
 }
 
@@ -108,6 +115,11 @@ void InputDeviceManager::Shutdown()
 	// Prevent additional devices from being added during shutdown.
 	m_bPendingShutdown = true;
 
+	if (m_PortPollingThread.joinable()) {
+		m_PortPollingThread.join();
+	}
+	m_Recorder.reset();
+
 	std::lock_guard<std::mutex> lk(m_Mtx);
 	for (const auto& d : m_Devices)
 	{
@@ -329,6 +341,7 @@ void InputDeviceManager::BindHostDevice(int port, int usb_port, int type)
 			dev->SetBindings(index, (it != controls.end()) ? *it : nullptr);
 		}
 		dev->SetPort(usb_port, true);
+		m_bBindingsChanged = true;
 	}
 }
 
@@ -339,106 +352,224 @@ bool InputDeviceManager::UpdateXboxPortInput(int usb_port, void* Buffer, int Dir
 		xid_type < to_underlying(XBOX_INPUT_DEVICE::DEVICE_MAX));
 	bool has_changed = false;
 
-	// If somebody else is currently holding the lock, we won't wait and instead report no input changes
-	if (m_Mtx.try_lock()) {
-		for (auto dev_ptr : m_Devices) {
-			if (dev_ptr->GetPort(usb_port)) {
-				switch (xid_type)
-				{
-				case to_underlying(XBOX_INPUT_DEVICE::MS_CONTROLLER_DUKE):
-                case to_underlying(XBOX_INPUT_DEVICE::MS_CONTROLLER_S): {
-					has_changed = UpdateInputXpad(dev_ptr, Buffer, Direction);
-				}
-				break;
-
-				case to_underlying(XBOX_INPUT_DEVICE::LIGHT_GUN):
-				case to_underlying(XBOX_INPUT_DEVICE::STEERING_WHEEL):
-				case to_underlying(XBOX_INPUT_DEVICE::MEMORY_UNIT):
-				case to_underlying(XBOX_INPUT_DEVICE::IR_DONGLE):
-				case to_underlying(XBOX_INPUT_DEVICE::STEEL_BATTALION_CONTROLLER): {
-					EmuLog(LOG_LEVEL::WARNING, "An unsupported device is attached at port %d! The device was %s",
-						Gui2XboxPortArray[usb_port], GetInputDeviceName(xid_type).c_str());
-				}
-				break;
-
-				default: {
-					EmuLog(LOG_LEVEL::WARNING, "An unknown device attached at port %d! The type was %s",
-						Gui2XboxPortArray[usb_port], GetInputDeviceName(xid_type).c_str());
-				}
+	switch (xid_type)
+	{
+	case to_underlying(XBOX_INPUT_DEVICE::MS_CONTROLLER_DUKE):
+	case to_underlying(XBOX_INPUT_DEVICE::MS_CONTROLLER_S): {
+		if (Direction == DIRECTION_IN) {
+			//XpadInput* in_buf = reinterpret_cast<XpadInput*>(static_cast<uint8_t*>(Buffer) + 2); lle usb
+			XpadInput* in_buf = reinterpret_cast<XpadInput*>(Buffer);
+			if (m_ReplayDevices[usb_port] != nullptr) {
+				// Replay runs on the guest's own poll, so reports land on the tick they were recorded at
+				has_changed = m_ReplayDevices[usb_port]->UpdateInput();
+				if (has_changed) {
+					m_ReplayDevices[usb_port]->GetXpadInput(in_buf);
 				}
 			}
+			else {
+				// The polling thread already read the host device, so this never waits on it
+				has_changed = ReadXpadSnapshot(usb_port, in_buf);
+			}
+			if (has_changed && m_Recorder != nullptr) {
+				m_Recorder->Record(xbox::KeTickCount, usb_port, INPUT_LOG_XPAD, in_buf, sizeof(XpadInput));
+			}
 		}
-		m_Mtx.unlock();
+		else {
+			// Setting the host rumble needs m_Mtx, which the polling thread holds while it reads the devices, so
+			// the guest only leaves the strengths here and the polling thread applies them on its next pass
+			//XpadOutput* out_buf = reinterpret_cast<XpadOutput*>(static_cast<uint8_t*>(Buffer) + 2); lle usb
+			XpadOutput* out_buf = reinterpret_cast<XpadOutput*>(Buffer);
+			m_XpadRumble[usb_port].Set(out_buf);
+			has_changed = (m_XpadSnapshots[usb_port].PacketNumber.load(std::memory_order_relaxed) != 0);
+		}
+	}
+	break;
+
+	case to_underlying(XBOX_INPUT_DEVICE::LIGHT_GUN):
+	case to_underlying(XBOX_INPUT_DEVICE::STEERING_WHEEL):
+	case to_underlying(XBOX_INPUT_DEVICE::MEMORY_UNIT):
+	case to_underlying(XBOX_INPUT_DEVICE::IR_DONGLE):
+	case to_underlying(XBOX_INPUT_DEVICE::STEEL_BATTALION_CONTROLLER): {
+		EmuLog(LOG_LEVEL::WARNING, "An unsupported device is attached at port %d! The device was %s",
+			Gui2XboxPortArray[usb_port], GetInputDeviceName(xid_type).c_str());
+	}
+	break;
+
+	default: {
+		EmuLog(LOG_LEVEL::WARNING, "An unknown device attached at port %d! The type was %s",
+			Gui2XboxPortArray[usb_port], GetInputDeviceName(xid_type).c_str());
+	}
 	}
+
 	return has_changed;
 }
 
-bool InputDeviceManager::UpdateInputXpad(std::shared_ptr<InputDevice>& Device, void* Buffer, int Direction)
+bool InputDeviceManager::StartInputRecording(const std::string& Path, uint32_t TitleId)
 {
-	std::map<int, InputDevice::IoControl*> bindings = Device->GetBindings();
-	assert(bindings.size() == static_cast<size_t>(dev_num_buttons[to_underlying(XBOX_INPUT_DEVICE::MS_CONTROLLER_DUKE)]));
+	auto recorder = std::make_unique<InputRecorder>();
+	if (!recorder->Open(Path, TitleId)) {
+		return false;
+	}
+	m_Recorder = std::move(recorder);
+	return true;
+}
 
-	if (Direction == DIRECTION_IN) {
-		//XpadInput* in_buf = reinterpret_cast<XpadInput*>(static_cast<uint8_t*>(Buffer) + 2); lle usb
-		XpadInput* in_buf = reinterpret_cast<XpadInput*>(Buffer);
-		if (!Device->UpdateInput()) {
+bool InputDeviceManager::StartInputReplay(const std::string& Path, uint32_t TitleId)
+{
+	// Open every port before installing any, so that a failure leaves all ports on their host devices
+	std::shared_ptr<InputReplayDevice> replays[4];
+	for (int port = PORT_1; port <= PORT_4; port++) {
+		replays[port] = std::make_shared<InputReplayDevice>(port);
+		if (!replays[port]->Open(Path, TitleId)) {
 			return false;
 		}
+	}
+	for (int port = PORT_1; port <= PORT_4; port++) {
+		m_ReplayDevices[port] = std::move(replays[port]);
+	}
+	EmuLog(LOG_LEVEL::INFO, "Replaying input from %s", Path.c_str());
+	return true;
+}
 
-		for (int i = 0; i < 8; i++) {
-			ControlState state = (bindings[i] != nullptr) ? dynamic_cast<InputDevice::Input*>(bindings[i])->GetState() : 0.0;
-			if (state) {
-				in_buf->wButtons |= (1 << i);
-			}
-			else {
-				in_buf->wButtons &= ~(1 << i);
+void InputDeviceManager::PollXboxPorts()
+{
+	// Device each port was last published from, the packet number of its last snapshot and the rumble last set on it
+	InputDevice* polled_dev[4] = { nullptr };
+	uint32_t packet_number[4] = { 0 };
+	uint32_t rumble_applied[4] = { 0 };
+
+	SetThreadAffinityMask(GetCurrentThread(), g_CPUOthers);
+
+	while (!m_bPendingShutdown) {
+		// A changed binding must be published even if the device itself reports no new input
+		bool bindings_changed = m_bBindingsChanged.exchange(false);
+
+		std::unique_lock<std::mutex> lck(m_Mtx);
+		for (int port = PORT_1; port <= PORT_4; port++) {
+			InputDevice* dev = nullptr;
+			XBOX_INPUT_DEVICE type = g_XboxControllerHostBridge[port].XboxType;
+			if (type == XBOX_INPUT_DEVICE::MS_CONTROLLER_DUKE || type == XBOX_INPUT_DEVICE::MS_CONTROLLER_S) {
+				auto it = std::find_if(m_Devices.begin(), m_Devices.end(), [port](const auto& Device) {
+					return Device->GetPort(port);
+					});
+				if (it != m_Devices.end()) {
+					dev = it->get();
+				}
 			}
-		}
-		for (int i = 8, j = 0; i < 16; i++, j++) {
-			ControlState state = (bindings[i] != nullptr) ? dynamic_cast<InputDevice::Input*>(bindings[i])->GetState() : 0.0;
-			in_buf->bAnalogButtons[j] = static_cast<uint8_t>(state * 0xFF);
-		}
 
-		for (int i = 16, j = 0; i < 24; i += 2, j++) {
-			ControlState state_plus = (bindings[i] != nullptr) ? dynamic_cast<InputDevice::Input*>(bindings[i])->GetState() : 0.0;
-			ControlState state_minus = (bindings[i + 1] != nullptr) ? dynamic_cast<InputDevice::Input*>(bindings[i + 1])->GetState() : 0.0;
-			ControlState state = state_plus ? state_plus * 0x7FFF : state_minus ? -state_minus * 0x8000 : 0.0;
-			switch (j)
-			{
-			case 0: {
-				in_buf->sThumbLX = static_cast<int16_t>(state);
+			if (dev == nullptr) {
+				if (polled_dev[port] != nullptr) {
+					polled_dev[port] = nullptr;
+					m_XpadSnapshots[port].Publish(nullptr, 0);
+				}
+				continue;
 			}
-			break;
 
-			case 1: {
-				in_buf->sThumbLY = static_cast<int16_t>(state);
+			// A newly attached device starts with the rumble the guest currently wants
+			bool dev_changed = (dev != polled_dev[port]) || bindings_changed;
+			uint32_t rumble_strengths = m_XpadRumble[port].Get();
+			if (rumble_strengths != rumble_applied[port] || dev_changed) {
+				InputDevice::Output* rumble = dev->GetOutputBinding(XBOX_CTRL_RUMBLE_BINDING);
+				if (rumble != nullptr) {
+					rumble->SetState(XpadRumble::Left(rumble_strengths) / static_cast<ControlState>(0xFFFF),
+						XpadRumble::Right(rumble_strengths) / static_cast<ControlState>(0xFFFF));
+				}
+				rumble_applied[port] = rumble_strengths;
 			}
-			break;
 
-			case 2: {
-				in_buf->sThumbRX = static_cast<int16_t>(state);
+			// NOTE: UpdateInput must be called on every poll, since it also acknowledges the device's new data
+			if (dev->UpdateInput() || dev_changed) {
+				XpadInput in_buf = {};
+				UpdateInputXpad(dev, &in_buf);
+				polled_dev[port] = dev;
+				// Zero is reserved for ports without a device
+				if (++packet_number[port] == 0) {
+					packet_number[port] = 1;
+				}
+				m_XpadSnapshots[port].Publish(&in_buf, packet_number[port]);
+				if (m_XpadWakeup[port]) {
+					m_XpadWakeup[port]();
+				}
 			}
-			break;
+		}
+		lck.unlock();
 
-			case 3: {
-				in_buf->sThumbRY = static_cast<int16_t>(state);
-			}
-			break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(XPAD_POLL_INTERVAL_MS));
+	}
+}
 
-			default: {
-				// unreachable
-			}
-			}
+void InputDeviceManager::UpdateInputXpad(InputDevice* Device, XpadInput* in_buf)
+{
+	for (int i = 0; i < 8; i++) {
+		InputDevice::Input* input = Device->GetInputBinding(i);
+		ControlState state = (input != nullptr) ? input->GetState() : 0.0;
+		if (state) {
+			in_buf->wButtons |= (1 << i);
+		}
+		else {
+			in_buf->wButtons &= ~(1 << i);
 		}
 	}
-	else {
-		if (bindings[24] != nullptr) {
-			//XpadOutput* out_buf = reinterpret_cast<XpadOutput*>(static_cast<uint8_t*>(Buffer) + 2); lle usb
-			XpadOutput* out_buf = reinterpret_cast<XpadOutput*>(Buffer);
-			dynamic_cast<InputDevice::Output*>(bindings[24])->SetState(out_buf->left_actuator_strength / static_cast<ControlState>(0xFFFF),
-				out_buf->right_actuator_strength / static_cast<ControlState>(0xFFFF));
+	for (int i = 8, j = 0; i < 16; i++, j++) {
+		InputDevice::Input* input = Device->GetInputBinding(i);
+		ControlState state = (input != nullptr) ? input->GetState() : 0.0;
+		in_buf->bAnalogButtons[j] = static_cast<uint8_t>(state * 0xFF);
+	}
+
+	for (int i = 16, j = 0; i < 24; i += 2, j++) {
+		InputDevice::Input* input_plus = Device->GetInputBinding(i);
+		InputDevice::Input* input_minus = Device->GetInputBinding(i + 1);
+		ControlState state_plus = (input_plus != nullptr) ? input_plus->GetState() : 0.0;
+		ControlState state_minus = (input_minus != nullptr) ? input_minus->GetState() : 0.0;
+		ControlState state = state_plus ? state_plus * 0x7FFF : state_minus ? -state_minus * 0x8000 : 0.0;
+		switch (j)
+		{
+		case 0: {
+			in_buf->sThumbLX = static_cast<int16_t>(state);
+		}
+		break;
+
+		case 1: {
+			in_buf->sThumbLY = static_cast<int16_t>(state);
+		}
+		break;
+
+		case 2: {
+			in_buf->sThumbRX = static_cast<int16_t>(state);
+		}
+		break;
+
+		case 3: {
+			in_buf->sThumbRY = static_cast<int16_t>(state);
+		}
+		break;
+
+		default: {
+			// unreachable
+		}
 		}
 	}
+}
+
+void InputDeviceManager::SetXpadWakeup(int usb_port, std::function<void()> Wakeup)
+{
+	// The polling thread calls it with m_Mtx held, so once this returns the old function isn't running anymore
+	std::lock_guard<std::mutex> lck(m_Mtx);
+	m_XpadWakeup[usb_port] = Wakeup;
+}
+
+bool InputDeviceManager::ReadXpadSnapshot(int usb_port, XpadInput* in_buf)
+{
+	XpadInput snapshot_buf;
+	uint32_t packet_number = m_XpadSnapshots[usb_port].Read(&snapshot_buf);
+
+	// No device, or nothing new since the last read : leave the guest's report as it is
+	if (packet_number == 0 || packet_number == m_XpadLastPacket[usb_port]) {
+		return false;
+	}
+
+	m_XpadLastPacket[usb_port] = packet_number;
+	std::memcpy(in_buf, &snapshot_buf, sizeof(XpadInput));
 	return true;
 }
 
@@ -28,9 +28,13 @@
 #ifndef INPUTMANAGER_H_
 #define INPUTMANAGER_H_
 
+#include <atomic>
+#include <memory>
 #include <thread>
 #include "InputDevice.h"
 #include "EmuDevice.h"
+#include "InputRecorder.h"
+#include "XpadSnapshot.h"
 
 // Prevent a collision with the SetPort provided by Windows
 #ifdef WIN32
@@ -39,26 +43,6 @@
 
 extern int dev_num_buttons[to_underlying(XBOX_INPUT_DEVICE::DEVICE_MAX)];
 
-#pragma pack(1)
-
-// xpad in/out buffers stripped of the first two bytes
-struct XpadInput {
-	uint16_t wButtons;
-	uint8_t bAnalogButtons[8];
-	int16_t sThumbLX;
-	int16_t sThumbLY;
-	int16_t sThumbRX;
-	int16_t sThumbRY;
-};
-
-struct XpadOutput {
-	uint16_t left_actuator_strength;
-	uint16_t right_actuator_strength;
-};
-
-#pragma pack()
-
-
 class InputDeviceManager
 {
 public:
@@ -82,11 +66,21 @@ public:
 	std::shared_ptr<InputDevice> FindDevice(int usb_port, int dummy) const;
 	// attach/detach guest devices to the emulated machine
 	void UpdateDevices(int port, bool ack);
+	// log the input reports received by the guest, see InputRecorder.h
+	bool StartInputRecording(const std::string& Path, uint32_t TitleId);
+	// feed the guest the input reports of a log instead of the host devices
+	bool StartInputReplay(const std::string& Path, uint32_t TitleId);
+	// set the function the polling thread calls when the input of an xbox port changes (nullptr to remove it)
+	void SetXpadWakeup(int usb_port, std::function<void()> Wakeup);
 
 
 private:
-	// update input for an xbox controller
-	bool UpdateInputXpad(std::shared_ptr<InputDevice>& Device, void* Buffer, int Direction);
+	// polls the host devices attached to xbox ports and publishes their input snapshots
+	void PollXboxPorts();
+	// reads the bound host controls of an xbox controller into its input report
+	void UpdateInputXpad(InputDevice* Device, XpadInput* in_buf);
+	// reads the input snapshot of an xbox port, returns false if the input didn't change since the last read
+	bool ReadXpadSnapshot(int usb_port, XpadInput* in_buf);
 	// bind a host device to an emulated device
 	void BindHostDevice(int port, int usb_port, int type);
 	// connect a device to the emulated machine
@@ -102,8 +96,23 @@ private:
 	std::condition_variable m_Cv;
 	// input polling thread
 	std::thread m_PollingThread;
+	// xbox port polling thread
+	std::thread m_PortPollingThread;
 	// used to indicate that the manager is shutting down
-	bool m_bPendingShutdown;
+	std::atomic<bool> m_bPendingShutdown;
+	// set when a port gets new bindings, so that the polling thread republishes its snapshot
+	std::atomic<bool> m_bBindingsChanged { false };
+	// per port input snapshots, and the last packet number the guest has seen of each
+	XpadSnapshot m_XpadSnapshots[4] = {};
+	uint32_t m_XpadLastPacket[4] = {};
+	// per port rumble requested by the guest, applied to the host device by the polling thread
+	XpadRumble m_XpadRumble[4] = {};
+	// per port functions called after new input is published, so that lle usb devices can wake the host controller
+	std::function<void()> m_XpadWakeup[4];
+	// input log being written, if any
+	std::unique_ptr<InputRecorder> m_Recorder;
+	// per port replay sources, these take the place of the host devices when set
+	std::shared_ptr<InputReplayDevice> m_ReplayDevices[4];
 };
 
 extern InputDeviceManager g_InputDeviceManager;
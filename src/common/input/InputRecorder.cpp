@@ -0,0 +1,211 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+#define _XBOXKRNL_DEFEXTRN_
+#define LOG_PREFIX CXBXR_MODULE::INPSYS
+
+#include <xboxkrnl/xboxkrnl.h> // For KeTickCount
+#include <cstring>
+#include "InputRecorder.h"
+#include "InputManager.h"
+#include "core\kernel\exports\EmuKrnl.h" // For EmuLog
+
+static_assert(sizeof(XpadInput) <= sizeof(InputLogRecord::Data), "Input log records can't hold an xpad report");
+
+bool InputRecorder::Open(const std::string& Path, uint32_t TitleId)
+{
+	std::lock_guard<std::mutex> lck(m_Mtx);
+
+	m_File = fopen(Path.c_str(), "wb");
+	if (m_File == nullptr) {
+		EmuLog(LOG_LEVEL::WARNING, "Couldn't create input log %s", Path.c_str());
+		return false;
+	}
+
+	InputLogHeader header;
+	header.Magic = INPUT_LOG_MAGIC;
+	header.Version = INPUT_LOG_VERSION;
+	header.HeaderSize = sizeof(InputLogHeader);
+	header.RecordSize = sizeof(InputLogRecord);
+	header.TitleId = TitleId;
+	fwrite(&header, sizeof(header), 1, m_File);
+
+	EmuLog(LOG_LEVEL::INFO, "Recording input to %s", Path.c_str());
+	return true;
+}
+
+void InputRecorder::Record(uint32_t Tick, int Port, uint8_t Type, const void* Data, uint16_t Size)
+{
+	std::lock_guard<std::mutex> lck(m_Mtx);
+
+	if (m_File == nullptr) {
+		return;
+	}
+
+	InputLogRecord record = { 0 };
+	record.Tick = Tick;
+	record.Port = static_cast<uint8_t>(Port);
+	record.Type = Type;
+	record.Size = Size;
+	std::memcpy(record.Data, Data, Size);
+	fwrite(&record, sizeof(record), 1, m_File);
+	// Input only changes a few times per frame at most, so keep the log complete in case of a crash
+	fflush(m_File);
+}
+
+void InputRecorder::Close()
+{
+	std::lock_guard<std::mutex> lck(m_Mtx);
+
+	if (m_File != nullptr) {
+		fclose(m_File);
+		m_File = nullptr;
+	}
+}
+
+InputReplayDevice::InputReplayDevice(int Port) : m_Port(Port)
+{
+	// Same layout as the xbox controller bindings : 8 digital buttons, 8 analog buttons,
+	// then the positive and negative halves of the four thumbstick axes
+	for (int i = 0; i < 24; i++) {
+		AddInput(new Control(*this, i));
+	}
+}
+
+InputReplayDevice::~InputReplayDevice()
+{
+	if (m_File != nullptr) {
+		fclose(m_File);
+	}
+}
+
+bool InputReplayDevice::Open(const std::string& Path, uint32_t TitleId)
+{
+	m_File = fopen(Path.c_str(), "rb");
+	if (m_File == nullptr) {
+		EmuLog(LOG_LEVEL::WARNING, "Couldn't open input log %s", Path.c_str());
+		return false;
+	}
+
+	InputLogHeader header;
+	if (fread(&header, sizeof(header), 1, m_File) != 1 || header.Magic != INPUT_LOG_MAGIC) {
+		EmuLog(LOG_LEVEL::WARNING, "%s is not an input log", Path.c_str());
+		return false;
+	}
+
+	// Newer logs are readable as long as they only appended fields
+	if (header.Version > INPUT_LOG_VERSION || header.HeaderSize < sizeof(InputLogHeader) || header.RecordSize < sizeof(InputLogRecord)) {
+		EmuLog(LOG_LEVEL::WARNING, "Input log %s has an unsupported version (%u)", Path.c_str(), header.Version);
+		return false;
+	}
+
+	if (header.TitleId != TitleId) {
+		EmuLog(LOG_LEVEL::WARNING, "Input log %s was recorded with another title (%08X), replay will likely diverge", Path.c_str(), header.TitleId);
+	}
+
+	m_RecordSize = header.RecordSize;
+	fseek(m_File, header.HeaderSize, SEEK_SET);
+	m_bHasNext = ReadNextRecord();
+	return true;
+}
+
+bool InputReplayDevice::ReadNextRecord()
+{
+	uint8_t record[256];
+	if (m_RecordSize > sizeof(record)) {
+		return false;
+	}
+
+	while (fread(record, m_RecordSize, 1, m_File) == 1) {
+		std::memcpy(&m_Next, record, sizeof(m_Next));
+		if (m_Next.Port == m_Port && m_Next.Type == INPUT_LOG_XPAD && m_Next.Size <= sizeof(m_Next.Data)) {
+			return true;
+		}
+	}
+
+	EmuLog(LOG_LEVEL::INFO, "Input replay of port %d finished", PORT_INC(m_Port));
+	return false;
+}
+
+bool InputReplayDevice::Advance(uint32_t Tick)
+{
+	std::lock_guard<std::mutex> lck(m_Mtx);
+
+	bool has_changed = false;
+	while (m_bHasNext && m_Next.Tick <= Tick) {
+		std::memcpy(m_State, m_Next.Data, m_Next.Size);
+		has_changed = true;
+		m_bHasNext = ReadNextRecord();
+	}
+	return has_changed;
+}
+
+void InputReplayDevice::GetXpadInput(void* Buffer) const
+{
+	std::lock_guard<std::mutex> lck(m_Mtx);
+	std::memcpy(Buffer, m_State, sizeof(XpadInput));
+}
+
+bool InputReplayDevice::UpdateInput()
+{
+	return Advance(xbox::KeTickCount);
+}
+
+std::string InputReplayDevice::GetDeviceName() const
+{
+	return "Port " + std::to_string(PORT_INC(m_Port));
+}
+
+std::string InputReplayDevice::Control::GetName() const
+{
+	return "Control " + std::to_string(m_Index);
+}
+
+ControlState InputReplayDevice::Control::GetState() const
+{
+	XpadInput state;
+	m_Device.GetXpadInput(&state);
+
+	if (m_Index < 8) {
+		return (state.wButtons & (1 << m_Index)) ? 1.0 : 0.0;
+	}
+	if (m_Index < 16) {
+		return state.bAnalogButtons[m_Index - 8] / static_cast<ControlState>(0xFF);
+	}
+
+	int16_t axis;
+	switch ((m_Index - 16) / 2)
+	{
+	case 0: axis = state.sThumbLX; break;
+	case 1: axis = state.sThumbLY; break;
+	case 2: axis = state.sThumbRX; break;
+	default: axis = state.sThumbRY; break;
+	}
+	// Even indices are the positive half of the axis, odd ones the negative half
+	if ((m_Index & 1) == 0) {
+		return (axis > 0) ? axis / static_cast<ControlState>(0x7FFF) : 0.0;
+	}
+	return (axis < 0) ? -axis / static_cast<ControlState>(0x8000) : 0.0;
+}
@@ -0,0 +1,123 @@
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+#ifndef INPUTRECORDER_H_
+#define INPUTRECORDER_H_
+
+#include <cstdio>
+#include <mutex>
+#include "InputDevice.h"
+
+// Input logs hold the input reports the guest received, stamped with KeTickCount (ms since boot).
+// Replaying one feeds the same reports back at the same ticks, which makes runs repeatable enough
+// to compare frame times between builds. Start either with the /input_record or /input_replay
+// command line switch, e.g. cxbxr-ldr.exe /load "default.xbe" /input_replay "run.cxbxinput"
+// NOTE: The emulated ports must be configured with the same device types as when recording.
+
+#define INPUT_LOG_MAGIC   0x52495843 // "CXIR"
+#define INPUT_LOG_VERSION 1
+
+// Record types
+#define INPUT_LOG_XPAD 0 // Data holds an XpadInput
+
+#pragma pack(1)
+
+struct InputLogHeader {
+	uint32_t Magic;
+	uint16_t Version;
+	uint16_t HeaderSize; // Records start at this offset, newer versions may add fields
+	uint32_t RecordSize; // Size of each record, newer versions may add fields
+	uint32_t TitleId;    // Title the log was recorded with
+};
+
+struct InputLogRecord {
+	uint32_t Tick; // KeTickCount when the guest received this report
+	uint8_t  Port;
+	uint8_t  Type;
+	uint16_t Size; // Used bytes of Data
+	uint8_t  Data[20];
+};
+
+#pragma pack()
+
+// Appends the input reports received by the guest to a log
+class InputRecorder
+{
+public:
+	~InputRecorder() { Close(); }
+
+	bool Open(const std::string& Path, uint32_t TitleId);
+	void Record(uint32_t Tick, int Port, uint8_t Type, const void* Data, uint16_t Size);
+	void Close();
+
+private:
+	FILE* m_File = nullptr;
+	// guest threads may poll different ports at the same time
+	std::mutex m_Mtx;
+};
+
+// Replays the reports of one port of an input log, as a host device
+class InputReplayDevice : public InputDevice
+{
+public:
+	InputReplayDevice(int Port);
+	~InputReplayDevice();
+
+	bool Open(const std::string& Path, uint32_t TitleId);
+	// applies every record up to the given tick, returns true if the report changed
+	bool Advance(uint32_t Tick);
+	// retrieves the current report exactly as recorded
+	void GetXpadInput(void* Buffer) const;
+
+	std::string GetDeviceName() const override;
+	std::string GetAPI() const override { return "Replay"; }
+	// advances to the current KeTickCount
+	bool UpdateInput() override;
+
+private:
+	class Control : public Input
+	{
+	public:
+		Control(const InputReplayDevice& Device, int Index) : m_Device(Device), m_Index(Index) {}
+		std::string GetName() const override;
+		ControlState GetState() const override;
+
+	private:
+		const InputReplayDevice& m_Device;
+		const int m_Index;
+	};
+
+	bool ReadNextRecord();
+
+	int m_Port;
+	FILE* m_File = nullptr;
+	uint32_t m_RecordSize = 0;
+	// next record of this port not applied yet
+	InputLogRecord m_Next;
+	bool m_bHasNext = false;
+	// current report, raw
+	uint8_t m_State[sizeof(InputLogRecord::Data)] = { 0 };
+	mutable std::mutex m_Mtx;
+};
+
+#endif
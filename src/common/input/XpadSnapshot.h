@@ -0,0 +1,132 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+#ifndef XPADSNAPSHOT_H_
+#define XPADSNAPSHOT_H_
+
+// Exchange of xpad state between the port polling thread and the guest, without locks.
+// Kept free of host device dependencies, so cxbxr-inputbench can test it on its own.
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+
+#pragma pack(1)
+
+// xpad in/out buffers stripped of the first two bytes
+struct XpadInput {
+	uint16_t wButtons;
+	uint8_t bAnalogButtons[8];
+	int16_t sThumbLX;
+	int16_t sThumbLY;
+	int16_t sThumbRX;
+	int16_t sThumbRY;
+};
+
+struct XpadOutput {
+	uint16_t left_actuator_strength;
+	uint16_t right_actuator_strength;
+};
+
+#pragma pack()
+
+// Interval at which the host devices attached to xbox ports are polled, same as the xpad's interrupt endpoint
+#define XPAD_POLL_INTERVAL_MS 4
+#define XPAD_SNAPSHOT_WORDS ((sizeof(XpadInput) + sizeof(uint32_t) - 1) / sizeof(uint32_t))
+
+// Latest input of an xbox port, published by the polling thread and read lock-free by the guest (seqlock)
+struct XpadSnapshot {
+	// odd while the polling thread is writing
+	std::atomic<uint32_t> Sequence;
+	// incremented whenever the input changes, zero means no host device is attached
+	std::atomic<uint32_t> PacketNumber;
+	std::atomic<uint32_t> Data[XPAD_SNAPSHOT_WORDS];
+
+	// only called by the polling thread; a null in_buf publishes an all zero report
+	void Publish(const XpadInput* in_buf, uint32_t packet_number)
+	{
+		uint32_t data[XPAD_SNAPSHOT_WORDS] = { 0 };
+		if (in_buf != nullptr) {
+			std::memcpy(data, in_buf, sizeof(XpadInput));
+		}
+
+		// Readers retry while the sequence is odd or has changed under them
+		uint32_t sequence = Sequence.load(std::memory_order_relaxed);
+		Sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		PacketNumber.store(packet_number, std::memory_order_relaxed);
+		for (size_t i = 0; i < XPAD_SNAPSHOT_WORDS; i++) {
+			Data[i].store(data[i], std::memory_order_relaxed);
+		}
+		Sequence.store(sequence + 2, std::memory_order_release);
+	}
+
+	// copies the latest report into in_buf, and returns its packet number
+	uint32_t Read(XpadInput* in_buf) const
+	{
+		uint32_t data[XPAD_SNAPSHOT_WORDS];
+		uint32_t packet_number;
+
+		while (true) {
+			uint32_t sequence = Sequence.load(std::memory_order_acquire);
+			if (sequence & 1) {
+				// The polling thread is in the middle of a (very short) update
+				std::this_thread::yield();
+				continue;
+			}
+			packet_number = PacketNumber.load(std::memory_order_relaxed);
+			for (size_t i = 0; i < XPAD_SNAPSHOT_WORDS; i++) {
+				data[i] = Data[i].load(std::memory_order_relaxed);
+			}
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (Sequence.load(std::memory_order_relaxed) == sequence) {
+				break;
+			}
+		}
+
+		std::memcpy(in_buf, data, sizeof(XpadInput));
+		return packet_number;
+	}
+};
+
+// Latest rumble strengths the guest asked for on an xbox port; the guest only stores them,
+// the polling thread hands them to the host device (which needs the device manager's lock)
+struct XpadRumble {
+	std::atomic<uint32_t> Strengths; // left actuator in the high half, right in the low half
+
+	void Set(const XpadOutput* out_buf)
+	{
+		Strengths.store(((uint32_t)out_buf->left_actuator_strength << 16) | out_buf->right_actuator_strength,
+			std::memory_order_relaxed);
+	}
+
+	uint32_t Get() const { return Strengths.load(std::memory_order_relaxed); }
+
+	static uint16_t Left(uint32_t strengths) { return (uint16_t)(strengths >> 16); }
+	static uint16_t Right(uint32_t strengths) { return (uint16_t)strengths; }
+};
+
+#endif
@@ -3,10 +3,11 @@
 #ifndef CPUID_H
 #define CPUID_H
 
+#include <bitset>
+
 #ifdef _WIN32
 #include <limits.h>
 #include <intrin.h>
-#include <bitset>
 typedef unsigned __int32  uint32_t;
 
 #else
@@ -38,14 +39,15 @@ public:
 class SimdCaps {
 
 public:
-	const bool SSE(void) { return f_1.EDX()[25]; }
-	const bool SSE2(void) { return f_1.EDX()[26]; }
-	const bool SSE3(void) { return f_1.ECX()[0]; }
-	const bool SSSE3(void) { return f_1.ECX()[9]; }
-	const bool SSE41(void) { return f_1.ECX()[19]; }
-	const bool SSE42(void) { return f_1.ECX()[20]; }
-	const bool AVX(void) { return f_1.ECX()[1]; }
-	const bool AVX2(void) { return f_7.EBX()[5]; }
+	bool SSE(void) { return f_1.EDX()[25]; }
+	bool SSE2(void) { return f_1.EDX()[26]; }
+	bool SSE3(void) { return f_1.ECX()[0]; }
+	bool SSSE3(void) { return f_1.ECX()[9]; }
+	bool SSE41(void) { return f_1.ECX()[19]; }
+	bool SSE42(void) { return f_1.ECX()[20]; }
+	bool AVX(void) { return f_1.ECX()[1]; }
+	bool AVX2(void) { return f_7.EBX()[5]; }
+	bool SHA(void) { return f_7.EBX()[29]; }
 
 private:
 	const CPUID f_1 = CPUID(1);
@@ -0,0 +1,123 @@
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+#ifndef PRESTARTEDPOOL_H
+#define PRESTARTEDPOOL_H
+
+// A pool of items that are expensive to create (like host threads), created ahead of time by a thread
+// of its own so that taking one is only a dequeue. Kept free of emulator dependencies, so that
+// cxbxr-threadbench can measure the very same pool as PsCreateSystemThreadEx uses.
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+template<typename T>
+class PrestartedPool
+{
+public:
+	PrestartedPool(size_t Size, std::function<T()> Spawn) : m_Size(Size), m_Spawn(Spawn) {}
+	~PrestartedPool() { Shutdown(); }
+
+	// Starts filling the pool (Acquire does so as well, when called first)
+	void Start()
+	{
+		std::lock_guard<std::mutex> lock(m_Mtx);
+		StartRefill();
+	}
+
+	// Takes an item from the pool and lets the refill thread replace it. Only when the refill thread
+	// fell behind (a burst of more than Size acquires), the item is created on the caller's thread.
+	T Acquire(bool *pFromPool = nullptr)
+	{
+		std::unique_lock<std::mutex> lock(m_Mtx);
+		StartRefill();
+
+		bool bFromPool = !m_Items.empty();
+		T Item = T();
+		if (bFromPool) {
+			Item = m_Items.back();
+			m_Items.pop_back();
+		}
+		m_Cv.notify_one();
+		lock.unlock();
+
+		if (pFromPool != nullptr) {
+			*pFromPool = bFromPool;
+		}
+
+		return bFromPool ? Item : m_Spawn();
+	}
+
+	// Stops the refill thread, and hands back the items still in the pool
+	std::vector<T> Shutdown()
+	{
+		std::unique_lock<std::mutex> lock(m_Mtx);
+		m_bShutdown = true;
+		m_Cv.notify_one();
+		lock.unlock();
+		if (m_RefillThread.joinable()) {
+			m_RefillThread.join();
+		}
+
+		lock.lock();
+		std::vector<T> Items;
+		Items.swap(m_Items);
+		return Items;
+	}
+
+private:
+	void StartRefill()
+	{
+		if (!m_RefillThread.joinable() && !m_bShutdown) {
+			m_RefillThread = std::thread(&PrestartedPool::RefillThread, this);
+		}
+	}
+
+	void RefillThread()
+	{
+		std::unique_lock<std::mutex> lock(m_Mtx);
+		while (!m_bShutdown) {
+			if (m_Items.size() < m_Size) {
+				// Create outside of the lock, so that acquires never wait on it
+				lock.unlock();
+				T Item = m_Spawn();
+				lock.lock();
+				m_Items.push_back(Item);
+			} else {
+				m_Cv.wait(lock);
+			}
+		}
+	}
+
+	size_t m_Size;
+	std::function<T()> m_Spawn;
+	std::mutex m_Mtx;
+	std::condition_variable m_Cv;
+	std::vector<T> m_Items;
+	std::thread m_RefillThread;
+	bool m_bShutdown = false;
+};
+
+#endif
@@ -0,0 +1,77 @@
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+// A sequence lock, for data that's read far more often than it's written (like the settings that
+// EmuShared shares between the GUI and the emulation process). Kept free of emulator dependencies,
+// so that cxbxr-sharedbench can measure the very same code on a POSIX shared memory mapping.
+//
+// Writers make Version odd while they copy, and readers retry when it changed while they copied,
+// so readers never block. Writers must exclude each other themselves. Version must be lock-free
+// (and so address-free) when it's shared between processes.
+
+#include <atomic>
+#include <thread>
+#ifdef _WIN32
+#include <intrin.h>
+#else
+#include <immintrin.h>
+#endif
+
+// Retries a reader spins before it lets the writer have the core
+#define SEQLOCK_SPIN_RETRIES 64
+
+template<typename Copy>
+static inline void SeqLock_Read(const std::atomic_uint &Version, Copy copy)
+{
+	for (unsigned Retries = 0; ; Retries++) {
+		unsigned int version = Version.load(std::memory_order_acquire);
+		if ((version & 1) == 0) {
+			copy();
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (Version.load(std::memory_order_relaxed) == version) {
+				return;
+			}
+		}
+
+		// A writer is busy, or was while we copied. When it takes long, it probably lost its core.
+		if (Retries < SEQLOCK_SPIN_RETRIES) {
+			_mm_pause();
+		} else {
+			std::this_thread::yield();
+		}
+	}
+}
+
+template<typename Copy>
+static inline void SeqLock_Write(std::atomic_uint &Version, Copy copy)
+{
+	unsigned int version = Version.load(std::memory_order_relaxed);
+	Version.store(version + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	copy();
+	Version.store(version + 2, std::memory_order_release);
+}
+
+#endif
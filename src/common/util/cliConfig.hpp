@@ -41,6 +41,8 @@ static constexpr char sid[] = "sid";
 static constexpr char system_retail[] = "retail";
 static constexpr char system_devkit[] = "devkit";
 static constexpr char system_chihiro[] = "chihiro";
+static constexpr char input_record[] = "input_record";
+static constexpr char input_replay[] = "input_replay";
 
 bool GenConfig(char** argv, int argc);
 size_t ConfigSize();
@@ -152,6 +152,7 @@ EmuShared::EmuShared()
 	m_bDebugging = false;
 	m_bEmulating_status = false;
 	m_bFirstLaunch = false;
+	m_SettingsVersion = 0;
 
 	// Reserve space (default to 0)
 	m_bReserved2 = false;
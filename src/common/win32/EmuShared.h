@@ -30,8 +30,10 @@
 #include "Mutex.h"
 #include "common\IPCHybrid.hpp"
 #include "common\input\Button.h"
+#include "common\util\SeqLock.h"
 
 #include <memory.h>
+#include <atomic>
 
 extern HMODULE hActiveModule; // Equals EXE Module handle in (GUI) Cxbx.exe / cxbxr.exe, equals DLL Module handle in cxbxr-emu.dll
 
@@ -52,9 +54,18 @@ enum {
 	BOOT_QUICK_REBOOT =   1 << 4,
 };
 
+// Scalars in shared memory are accessed as atomics (from both processes), which only works
+// when they're lock-free and have the layout of the plain type
+static_assert(sizeof(std::atomic<int>) == sizeof(int) && sizeof(std::atomic<bool>) == sizeof(bool) && sizeof(std::atomic<float>) == sizeof(float),
+	"EmuShared atomics must have the layout of their plain types");
+
 // ******************************************************************
 // * EmuShared : Shared memory
 // ******************************************************************
+// Scalars are atomics, and settings blocks are published through a sequence lock (writers make
+// m_SettingsVersion odd while they copy, readers retry when it changed while they copied), so the
+// accessors never wait for each other. Lock() is still used by writers of settings (to exclude
+// each other) and for multi-field transactions like Reset.
 class EmuShared : public Mutex
 {
 	public:
@@ -78,163 +89,163 @@ class EmuShared : public Mutex
 		// ******************************************************************
 		// * Check if shared memory is used on launch
 		// ******************************************************************
-		void GetIsFirstLaunch(bool *isFirstLaunch) { Lock(); *isFirstLaunch = m_bFirstLaunch; Unlock(); }
-		void SetIsFirstLaunch(const bool isFirstLaunch) { Lock(); m_bFirstLaunch = isFirstLaunch; Unlock(); }
+		void GetIsFirstLaunch(bool *isFirstLaunch) { *isFirstLaunch = m_bFirstLaunch; }
+		void SetIsFirstLaunch(const bool isFirstLaunch) { m_bFirstLaunch = isFirstLaunch; }
 
 		// ******************************************************************
 		// * Check if parent process is emulating title
 		// ******************************************************************
-		void GetIsEmulating(bool *isEmulating) { Lock(); *isEmulating = m_bEmulating_status; Unlock(); }
-		void SetIsEmulating(const bool isEmulating) { Lock(); m_bEmulating_status = isEmulating; Unlock(); }
+		void GetIsEmulating(bool *isEmulating) { *isEmulating = m_bEmulating_status; }
+		void SetIsEmulating(const bool isEmulating) { m_bEmulating_status = isEmulating; }
 
 		// ******************************************************************
 		// * Each child process need to wait until parent process is ready
 		// ******************************************************************
-		void GetIsReady(bool *isReady) { Lock(); *isReady = m_bReady_status; Unlock(); }
-		void SetIsReady(const bool isReady) { Lock(); m_bReady_status = isReady; Unlock(); }
+		void GetIsReady(bool *isReady) { *isReady = m_bReady_status; }
+		void SetIsReady(const bool isReady) { m_bReady_status = isReady; }
 
 		// ******************************************************************
 		// * Check if previous kernel mode process is running.
 		// ******************************************************************
-		void GetKrnlProcID(unsigned int *krnlProcID) { Lock(); *krnlProcID = m_dwKrnlProcID; Unlock(); }
-		void SetKrnlProcID(const unsigned int krnlProcID) { Lock(); m_dwKrnlProcID = krnlProcID; Unlock(); }
+		void GetKrnlProcID(unsigned int *krnlProcID) { *krnlProcID = m_dwKrnlProcID; }
+		void SetKrnlProcID(const unsigned int krnlProcID) { m_dwKrnlProcID = krnlProcID; }
 
 		// ******************************************************************
 		// * Xbox Core Accessors
 		// ******************************************************************
-		void GetCoreSettings(      Settings::s_core *emulate) { Lock(); *emulate = m_core; Unlock(); }
-		void SetCoreSettings(const Settings::s_core *emulate) { Lock(); m_core = *emulate; Unlock(); }
+		void GetCoreSettings(      Settings::s_core *emulate) { ReadSettings([&] { *emulate = m_core; }); }
+		void SetCoreSettings(const Settings::s_core *emulate) { WriteSettings([&] { m_core = *emulate; }); }
 
 		// ******************************************************************
 		// * Xbox Video Accessors
 		// ******************************************************************
-		void GetVideoSettings(      Settings::s_video *video) { Lock(); *video = m_video; Unlock(); }
-		void SetVideoSettings(const Settings::s_video *video) { Lock(); m_video = *video; Unlock(); }
+		void GetVideoSettings(      Settings::s_video *video) { ReadSettings([&] { *video = m_video; }); }
+		void SetVideoSettings(const Settings::s_video *video) { WriteSettings([&] { m_video = *video; }); }
 
 		// ******************************************************************
 		// * Xbox Audio Accessors
 		// ******************************************************************
-		void GetAudioSettings(      Settings::s_audio *audio) { Lock(); *audio = m_audio; Unlock(); }
-		void SetAudioSettings(const Settings::s_audio *audio) { Lock(); m_audio = *audio; Unlock(); }
+		void GetAudioSettings(      Settings::s_audio *audio) { ReadSettings([&] { *audio = m_audio; }); }
+		void SetAudioSettings(const Settings::s_audio *audio) { WriteSettings([&] { m_audio = *audio; }); }
 
 		// ******************************************************************
 		// * Xbox Network Accessors
 		// ******************************************************************
-		void GetNetworkSettings(Settings::s_network *network) { Lock(); *network = m_network; Unlock(); }
-		void SetNetworkSettings(const Settings::s_network *network) { Lock(); m_network = *network; Unlock(); }
+		void GetNetworkSettings(Settings::s_network *network) { ReadSettings([&] { *network = m_network; }); }
+		void SetNetworkSettings(const Settings::s_network *network) { WriteSettings([&] { m_network = *network; }); }
 
 		// ******************************************************************
 		// * Input config Accessors
 		// ******************************************************************
-		void GetInputDevTypeSettings(int* type, int port) { Lock(); *type = m_DeviceType[port]; Unlock(); }
-		void SetInputDevTypeSettings(const int* type, int port) { Lock(); m_DeviceType[port] = *type; Unlock(); }
-		void GetInputDevNameSettings(char* name, int port) { Lock(); strncpy(name, m_DeviceName[port], 50); Unlock(); }
-		void SetInputDevNameSettings(const char* name, int port) { Lock(); strncpy(m_DeviceName[port], name, 50); Unlock(); }
+		void GetInputDevTypeSettings(int* type, int port) { *type = m_DeviceType[port]; }
+		void SetInputDevTypeSettings(const int* type, int port) { m_DeviceType[port] = *type; }
+		void GetInputDevNameSettings(char* name, int port) { ReadSettings([&] { strncpy(name, m_DeviceName[port], 50); }); }
+		void SetInputDevNameSettings(const char* name, int port) { WriteSettings([&] { strncpy(m_DeviceName[port], name, 50); }); }
 		void GetInputBindingsSettings(char button_str[][30], int max_num_buttons, int port)
 		{
 			assert(max_num_buttons <= XBOX_CTRL_NUM_BUTTONS);
-			Lock();
-			for (int i = 0; i < max_num_buttons; i++) {
-				strncpy(button_str[i], m_DeviceControlNames[port][i], 30);
-			}
-			Unlock();
+			ReadSettings([&] {
+				for (int i = 0; i < max_num_buttons; i++) {
+					strncpy(button_str[i], m_DeviceControlNames[port][i], 30);
+				}
+			});
 		}
 		void SetInputBindingsSettings(const char button_str[][30], int max_num_buttons, int port)
 		{
 			assert(max_num_buttons <= XBOX_CTRL_NUM_BUTTONS);
-			Lock();
-			for (int i = 0; i < max_num_buttons; i++) {
-				strncpy(m_DeviceControlNames[port][i], button_str[i], 30);
-			}
-			Unlock();
+			WriteSettings([&] {
+				for (int i = 0; i < max_num_buttons; i++) {
+					strncpy(m_DeviceControlNames[port][i], button_str[i], 30);
+				}
+			});
 		}
 
 		// ******************************************************************
 		// * LLE Flags Accessors
 		// ******************************************************************
-		void GetFlagsLLE(unsigned int *flags) { Lock(); *flags = m_core.FlagsLLE; Unlock(); }
-		void SetFlagsLLE(const unsigned int *flags) { Lock(); m_core.FlagsLLE = *flags; Unlock(); }
+		void GetFlagsLLE(unsigned int *flags) { ReadSettings([&] { *flags = m_core.FlagsLLE; }); }
+		void SetFlagsLLE(const unsigned int *flags) { WriteSettings([&] { m_core.FlagsLLE = *flags; }); }
 
 		// ******************************************************************
 		// * Boot flag Accessors
 		// ******************************************************************
-		void GetBootFlags(int *value) { Lock(); *value = m_BootFlags_status; Unlock(); }
-		void SetBootFlags(const int *value) { Lock(); m_BootFlags_status = *value; Unlock(); }
+		void GetBootFlags(int *value) { *value = m_BootFlags_status; }
+		void SetBootFlags(const int *value) { m_BootFlags_status = *value; }
 
 		// ******************************************************************
 		// * Hack Flag Accessors
 		// ******************************************************************
-		void GetHackSettings(Settings::s_hack *hacks) { Lock(); *hacks = m_hacks; Unlock(); }
-		void SetHackSettings(Settings::s_hack *hacks) { Lock(); m_hacks = *hacks; Unlock(); }
+		void GetHackSettings(Settings::s_hack *hacks) { ReadSettings([&] { *hacks = m_hacks; }); }
+		void SetHackSettings(Settings::s_hack *hacks) { WriteSettings([&] { m_hacks = *hacks; }); }
 
-		void GetDisablePixelShaders(int* value) { Lock(); *value = m_hacks.DisablePixelShaders; Unlock(); }
-		void SetDisablePixelShaders(const int* value) { Lock(); m_hacks.DisablePixelShaders = *value; Unlock(); }
-		void GetUseAllCores(int* value) { Lock(); *value = m_hacks.UseAllCores; Unlock(); }
-		void SetUseAllCores(const int* value) { Lock(); m_hacks.UseAllCores = *value; Unlock(); }
-		void GetSkipRdtscPatching(int* value) { Lock(); *value = m_hacks.SkipRdtscPatching; Unlock(); }
-		void SetSkipRdtscPatching(const int* value) { Lock(); m_hacks.SkipRdtscPatching = *value; Unlock(); }
+		void GetDisablePixelShaders(int* value) { ReadSettings([&] { *value = m_hacks.DisablePixelShaders; }); }
+		void SetDisablePixelShaders(const int* value) { WriteSettings([&] { m_hacks.DisablePixelShaders = *value; }); }
+		void GetUseAllCores(int* value) { ReadSettings([&] { *value = m_hacks.UseAllCores; }); }
+		void SetUseAllCores(const int* value) { WriteSettings([&] { m_hacks.UseAllCores = *value; }); }
+		void GetSkipRdtscPatching(int* value) { ReadSettings([&] { *value = m_hacks.SkipRdtscPatching; }); }
+		void SetSkipRdtscPatching(const int* value) { WriteSettings([&] { m_hacks.SkipRdtscPatching = *value; }); }
 
 		// ******************************************************************
 		// * FPS/Benchmark values Accessors
 		// ******************************************************************
-		void GetCurrentFPS(float *value) { Lock(); *value = m_FPS_status; Unlock(); }
-		void SetCurrentFPS(const float *value) { Lock(); m_FPS_status = *value; Unlock(); }
+		void GetCurrentFPS(float *value) { *value = m_FPS_status; }
+		void SetCurrentFPS(const float *value) { m_FPS_status = *value; }
 
 		// ******************************************************************
 		// * FPS/Benchmark values Accessors
 		// ******************************************************************
-		void GetIsKrnlLogEnabled(bool *value) { Lock(); *value = m_Krnl_Log_enabled; Unlock(); }
-		void SetIsKrnlLogEnabled(const bool value) { Lock(); m_Krnl_Log_enabled = value; Unlock(); }
+		void GetIsKrnlLogEnabled(bool *value) { *value = m_Krnl_Log_enabled; }
+		void SetIsKrnlLogEnabled(const bool value) { m_Krnl_Log_enabled = value; }
 
 		// ******************************************************************
 		// * Debugging flag Accessors
 		// ******************************************************************
-		void GetDebuggingFlag(bool *value) { Lock(); *value = m_bDebugging; Unlock(); }
-		void SetDebuggingFlag(const bool *value) { Lock(); m_bDebugging = *value; Unlock(); }
+		void GetDebuggingFlag(bool *value) { *value = m_bDebugging; }
+		void SetDebuggingFlag(const bool *value) { m_bDebugging = *value; }
 #ifndef CXBX_LOADER // Temporary usage for cxbx.exe's emu
 		// ******************************************************************
 		// * Previous Memory Layout value Accessors
 		// ******************************************************************
-		void GetMmLayout(unsigned int* value) { Lock(); *value = m_PreviousMmLayout; Unlock(); }
-		void SetMmLayout(unsigned int* value) { Lock(); m_PreviousMmLayout = *value; Unlock(); }
+		void GetMmLayout(unsigned int* value) { *value = m_PreviousMmLayout; }
+		void SetMmLayout(unsigned int* value) { m_PreviousMmLayout = *value; }
 #endif
 		// ******************************************************************
 		// * Log Level value Accessors
 		// ******************************************************************
-		void GetLogLv(int *value) { Lock(); *value = m_core.LogLevel; Unlock(); }
-		void SetLogLv(int *value) { Lock(); m_core.LogLevel = *value; Unlock(); }
+		void GetLogLv(int *value) { ReadSettings([&] { *value = m_core.LogLevel; }); }
+		void SetLogLv(int *value) { WriteSettings([&] { m_core.LogLevel = *value; }); }
 
 		// ******************************************************************
 		// * Log modules value Accessors
 		// ******************************************************************
 		void GetLogModules(unsigned int *value)
 		{
-			Lock();
-			for (int i = 0; i < NUM_INTEGERS_LOG; ++i) {
-				value[i] = m_core.LoggedModules[i];
-			}
-			Unlock();
+			ReadSettings([&] {
+				for (int i = 0; i < NUM_INTEGERS_LOG; ++i) {
+					value[i] = m_core.LoggedModules[i];
+				}
+			});
 		}
 		void SetLogModules(unsigned int *value)
 		{
-			Lock();
-			for (int i = 0; i < NUM_INTEGERS_LOG; ++i) {
-				m_core.LoggedModules[i] = value[i];
-			}
-			Unlock();
+			WriteSettings([&] {
+				for (int i = 0; i < NUM_INTEGERS_LOG; ++i) {
+					m_core.LoggedModules[i] = value[i];
+				}
+			});
 		}
 
 		// ******************************************************************
 		// * Log Level value Accessors
 		// ******************************************************************
-		void GetLogPopupTestCase(bool *value) { Lock(); *value = m_core.bLogPopupTestCase; Unlock(); }
-		void SetLogPopupTestCase(const bool value) { Lock(); m_core.bLogPopupTestCase = value; Unlock(); }
+		void GetLogPopupTestCase(bool *value) { ReadSettings([&] { *value = m_core.bLogPopupTestCase; }); }
+		void SetLogPopupTestCase(const bool value) { WriteSettings([&] { m_core.bLogPopupTestCase = value; }); }
 
 		// ******************************************************************
 		// * File storage location
 		// ******************************************************************
-		void GetStorageLocation(char *path) { Lock(); strncpy(path, m_core.szStorageLocation, MAX_PATH); Unlock(); }
-		void SetStorageLocation(const char *path) { Lock(); strncpy(m_core.szStorageLocation, path, MAX_PATH); Unlock(); }
+		void GetStorageLocation(char *path) { ReadSettings([&] { strncpy(path, m_core.szStorageLocation, MAX_PATH); }); }
+		void SetStorageLocation(const char *path) { WriteSettings([&] { strncpy(m_core.szStorageLocation, path, MAX_PATH); }); }
 
 		// ******************************************************************
 		// * Reset specific variables to default for kernel mode.
@@ -266,32 +277,39 @@ class EmuShared : public Mutex
 		EmuShared();
 		~EmuShared();
 
+		// ******************************************************************
+		// * Settings sequence lock
+		// ******************************************************************
+		template<typename Copy> void ReadSettings(Copy copy) { SeqLock_Read(m_SettingsVersion, copy); }
+		template<typename Copy> void WriteSettings(Copy copy) { Lock(); SeqLock_Write(m_SettingsVersion, copy); Unlock(); }
+
 		// ******************************************************************
 		// * Shared configuration
 		// ******************************************************************
-		int          m_BootFlags_status;
-		unsigned int m_Reserved5;
-		float        m_Reserved6;
-		float        m_FPS_status; // NOTE: If move into ipc_send_gui_update will spam GUI's message system (one message per frame)
-		bool         m_Krnl_Log_enabled; // Is require in order to preserve previous set for support multi-xbe.
-		bool         m_bDebugging;
-		bool         m_bReady_status;
-		bool         m_bEmulating_status;
+		std::atomic_int   m_BootFlags_status;
+		unsigned int      m_Reserved5;
+		float             m_Reserved6;
+		std::atomic<float> m_FPS_status; // NOTE: If move into ipc_send_gui_update will spam GUI's message system (one message per frame)
+		std::atomic_bool  m_Krnl_Log_enabled; // Is require in order to preserve previous set for support multi-xbe.
+		std::atomic_bool  m_bDebugging;
+		std::atomic_bool  m_bReady_status;
+		std::atomic_bool  m_bEmulating_status;
 #ifndef CXBX_LOADER // Temporary usage for cxbx.exe's emu
-		unsigned int m_PreviousMmLayout;
-		int          m_Reserved7[3];
+		std::atomic_uint  m_PreviousMmLayout;
+		int               m_Reserved7[3];
 #else
-		int          m_Reserved7[4];
+		int               m_Reserved7[4];
 #endif
-		bool         m_bFirstLaunch;
-		bool         m_bReserved2;
-		bool         m_bReserved3;
-		bool         m_bReserved4;
-		unsigned int m_dwKrnlProcID; // Only used for kernel mode level.
-		int          m_DeviceType[4];
-		char         m_DeviceControlNames[4][XBOX_CTRL_NUM_BUTTONS][30]; // macro should be num of buttons of dev with highest num buttons
-		char         m_DeviceName[4][50];
-		int          m_Reserved99[28]; // Reserve space
+		std::atomic_bool  m_bFirstLaunch;
+		bool              m_bReserved2;
+		bool              m_bReserved3;
+		bool              m_bReserved4;
+		std::atomic_uint  m_dwKrnlProcID; // Only used for kernel mode level.
+		std::atomic_int   m_DeviceType[4];
+		char              m_DeviceControlNames[4][XBOX_CTRL_NUM_BUTTONS][30]; // macro should be num of buttons of dev with highest num buttons
+		char              m_DeviceName[4][50];
+		std::atomic_uint  m_SettingsVersion; // Odd while settings (m_core etc. and the device names above) are being written
+		int               m_Reserved99[27]; // Reserve space
 
 		// Settings class in memory should not be tampered by third-party.
 		// Third-party program should only be allow to edit settings.ini file.
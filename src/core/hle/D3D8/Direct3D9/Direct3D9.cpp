@@ -58,6 +58,7 @@
 #include "..\XbD3D8Logging.h"
 #include "core\hle\Intercept.hpp" // for bLLE_GPU
 #include "devices\video\nv2a.h" // For GET_MASK, NV_PGRAPH_CONTROL_0, PUSH_METHOD
+#include "devices\video\nv2a_pbcapture.h" // For nv2a_pbcapture_request
 #include "gui/resource/ResCxbx.h"
 #include "RenderStates.h"
 #include "TextureStates.h"
@@ -1928,6 +1929,11 @@ static LRESULT WINAPI EmuMsgProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lPar
             {
                 VertexBufferConverter.PrintStats();
             }
+            else if (wParam == VK_F2)
+            {
+                // Capture the pushbuffer of the next few frames, for replay by cxbxr-pbreplay
+                nv2a_pbcapture_request(10);
+            }
             else if (wParam == VK_F6)
             {
                 // For some unknown reason, F6 isn't handled in WndMain::WndProc
@@ -2609,57 +2615,6 @@ constexpr UINT QuadToTriangleVertexCount(UINT NrOfQuadVertices)
 // TODO : Move to own file (or argument of all users)
 bool bUseClockWiseWindingOrder = true; // TODO : Should this be fetched from X_D3DRS_FRONTFACE (or X_D3DRS_CULLMODE)?
 
-// TODO : Move to own file
-// This function convertes quad to triangle indices.
-// When pXboxQuadIndexData is set, original quad indices are read from this buffer
-// (this use-case is for when an indexed quad draw is to be emulated).
-// When pXboxQuadIndexData is null, quad-emulating indices are generated
-// (this use-case is for when a non-indexed quad draw is to be emulated).
-// The number of indices to generate is specified through uNrOfTriangleIndices.
-// Resulting triangle indices are written to pTriangleIndexData, which must
-// be pre-allocated to fit the output data.
-// (Note, this function is marked 'constexpr' to allow the compiler to optimize
-// the case when pXboxQuadIndexData is null)
-constexpr void CxbxConvertQuadListToTriangleListIndices(
-	INDEX16* pXboxQuadIndexData,
-	unsigned uNrOfTriangleIndices,
-	INDEX16* pTriangleIndexData)
-{
-	assert(uNrOfTriangleIndices > 0);
-	assert(pTriangleIndexData);
-
-	unsigned i = 0;
-	unsigned j = 0;
-	while (i + (VERTICES_PER_TRIANGLE * TRIANGLES_PER_QUAD) <= uNrOfTriangleIndices) {
-		if (bUseClockWiseWindingOrder) {
-			// ABCD becomes ABC+CDA, so this is triangle 1 :
-			pTriangleIndexData[i + 0] = pXboxQuadIndexData ? pXboxQuadIndexData[j + 0] : j + 0; // A
-			pTriangleIndexData[i + 1] = pXboxQuadIndexData ? pXboxQuadIndexData[j + 1] : j + 1; // B
-			pTriangleIndexData[i + 2] = pXboxQuadIndexData ? pXboxQuadIndexData[j + 2] : j + 2; // C
-			i += VERTICES_PER_TRIANGLE;
-			// And this is triangle 2 :
-			pTriangleIndexData[i + 0] = pXboxQuadIndexData ? pXboxQuadIndexData[j + 2] : j + 2; // C
-			pTriangleIndexData[i + 1] = pXboxQuadIndexData ? pXboxQuadIndexData[j + 3] : j + 3; // D
-			pTriangleIndexData[i + 2] = pXboxQuadIndexData ? pXboxQuadIndexData[j + 0] : j + 0; // A
-			i += VERTICES_PER_TRIANGLE;
-		} else {
-			// ABCD becomes ADC+CBA, so this is triangle 1 :
-			pTriangleIndexData[i + 0] = pXboxQuadIndexData ? pXboxQuadIndexData[j + 0] : j + 0; // A
-			pTriangleIndexData[i + 1] = pXboxQuadIndexData ? pXboxQuadIndexData[j + 3] : j + 3; // D
-			pTriangleIndexData[i + 2] = pXboxQuadIndexData ? pXboxQuadIndexData[j + 2] : j + 2; // C
-			i += VERTICES_PER_TRIANGLE;
-			// And this is triangle 2 :
-			pTriangleIndexData[i + 0] = pXboxQuadIndexData ? pXboxQuadIndexData[j + 2] : j + 2; // C
-			pTriangleIndexData[i + 1] = pXboxQuadIndexData ? pXboxQuadIndexData[j + 1] : j + 1; // B
-			pTriangleIndexData[i + 2] = pXboxQuadIndexData ? pXboxQuadIndexData[j + 0] : j + 0; // A
-			i += VERTICES_PER_TRIANGLE;
-		}
-
-		// Next quad, please :
-		j += VERTICES_PER_QUAD;
-	}
-}
-
 // TODO : Move to own file
 // Called from EMUPATCH(D3DDevice_DrawIndexedVerticesUP) when PrimitiveType == X_D3DPT_QUADLIST.
 // This API receives the number of vertices to draw (VertexCount), the index data that references
@@ -2670,38 +2625,36 @@ constexpr void CxbxConvertQuadListToTriangleListIndices(
 // whereby the quad indices are converted to triangle indices. This implies for every four
 // quad indices, we have to generate (two times three is) six triangle indices. (Note, that
 // vertex data undergoes it's own Xbox-to-host conversion, independent from these indices.)
-INDEX16* CxbxCreateQuadListToTriangleListIndexData(INDEX16* pXboxQuadIndexData, unsigned QuadVertexCount)
+// The triangle indices are written to a scratch buffer that's re-used by the next call (and only
+// grows), while LowIndex and HighIndex are determined in the same pass over the quad indices.
+static std::vector<INDEX16> g_QuadListToTriangleListIndexData;
+
+INDEX16* CxbxCreateQuadListToTriangleListIndexData(INDEX16* pXboxQuadIndexData, unsigned QuadVertexCount, INDEX16 &LowIndex, INDEX16 &HighIndex)
 {
 	UINT NrOfTriangleIndices = QuadToTriangleVertexCount(QuadVertexCount);
-	INDEX16* pQuadToTriangleIndexBuffer = (INDEX16*)malloc(NrOfTriangleIndices * sizeof(INDEX16));
-	CxbxConvertQuadListToTriangleListIndices(pXboxQuadIndexData, NrOfTriangleIndices, pQuadToTriangleIndexBuffer);
-	return pQuadToTriangleIndexBuffer;
-}
+	if (g_QuadListToTriangleListIndexData.size() < NrOfTriangleIndices) {
+		g_QuadListToTriangleListIndexData.resize(NrOfTriangleIndices);
+	}
 
-// TODO : Move to own file
-void CxbxReleaseQuadListToTriangleListIndexData(void* pHostIndexData)
-{
-	free(pHostIndexData);
+	WalkAndConvertQuadListIndices(LowIndex, HighIndex, g_QuadListToTriangleListIndexData.data(), pXboxQuadIndexData, QuadVertexCount, bUseClockWiseWindingOrder);
+	return g_QuadListToTriangleListIndexData.data();
 }
 
-class ConvertedIndexBuffer {
-public:
-	uint64_t Hash = 0;
-	DWORD IndexCount = 0;
-	IDirect3DIndexBuffer* pHostIndexBuffer = nullptr;
+// Indices of indexed draws are streamed into one large dynamic index buffer : each draw appends
+// its indices using D3DLOCK_NOOVERWRITE (so the driver doesn't have to wait for earlier draws that
+// still read the buffer), and the buffer is only discarded when it wraps around.
+#define INDEX_RING_MIN_SIZE (1024 * 1024) // In indices (2 MiB)
+
+static IDirect3DIndexBuffer* g_pIndexRingHostIndexBuffer = nullptr;
+static UINT g_IndexRingSize = 0; // In indices
+static UINT g_IndexRingOffset = 0; // In indices, where the indices of the next draw will be written
+
+struct ActiveIndexRange {
 	INDEX16 LowIndex = 0;
 	INDEX16 HighIndex = 0;
-
-	~ConvertedIndexBuffer()
-	{
-		if (pHostIndexBuffer != nullptr) {
-			pHostIndexBuffer->Release();
-		}
-	}
+	UINT StartIndex = 0; // Position of the first index of this draw in the active index buffer
 };
 
-std::unordered_map<uint32_t, ConvertedIndexBuffer> g_IndexBufferCache;
-	
 void CxbxRemoveIndexBuffer(PWORD pData)
 {
 	// HACK: Never Free
@@ -2740,7 +2693,7 @@ IDirect3DIndexBuffer* CxbxCreateIndexBuffer(unsigned IndexCount)
 	return Result;
 }
 
-ConvertedIndexBuffer& CxbxUpdateActiveIndexBuffer
+ActiveIndexRange CxbxUpdateActiveIndexBuffer
 (
 	INDEX16* pXboxIndexData,
 	unsigned XboxIndexCount,
@@ -2749,84 +2702,70 @@ ConvertedIndexBuffer& CxbxUpdateActiveIndexBuffer
 {
 	LOG_INIT; // Allows use of DEBUG_D3DRESULT
 
-	uint32_t LookupKey = (uint32_t)pXboxIndexData;
 	unsigned RequiredIndexCount = XboxIndexCount;
 
 	if (bConvertQuadListToTriangleList) {
 		LOG_TEST_CASE("bConvertQuadListToTriangleList");
 		RequiredIndexCount = QuadToTriangleVertexCount(XboxIndexCount);
-		// For now, indicate the quad-to-triangles case using the otherwise
-		// (due to alignment) always-zero least significant bit :
-		LookupKey |= 1;
-	}
-
-	// Poor-mans eviction policy : when exceeding treshold, clear entire cache :
-	if (g_IndexBufferCache.size() > 256) {
-		g_IndexBufferCache.clear(); // Note : ConvertedIndexBuffer destructor will release any assigned pHostIndexBuffer
 	}
 
-	// Create a reference to the active buffer
-	ConvertedIndexBuffer& CacheEntry = g_IndexBufferCache[LookupKey];
+	// If a single draw doesn't fit in the ring, re-create it large enough
+	if (g_IndexRingSize < RequiredIndexCount) {
+		if (g_pIndexRingHostIndexBuffer != nullptr) {
+			g_pIndexRingHostIndexBuffer->Release();
+		}
 
-	// If the current index buffer size is too small, free it, so it'll get re-created
-	bool bNeedRepopulation = CacheEntry.IndexCount < RequiredIndexCount;
-	if (bNeedRepopulation) {
-		if (CacheEntry.pHostIndexBuffer != nullptr)
-			CacheEntry.pHostIndexBuffer->Release();
+		g_IndexRingSize = RoundUp(RequiredIndexCount, INDEX_RING_MIN_SIZE);
+		g_pIndexRingHostIndexBuffer = CxbxCreateIndexBuffer(g_IndexRingSize);
+		if (!g_pIndexRingHostIndexBuffer)
+			CxbxKrnlCleanup("CxbxUpdateActiveIndexBuffer: IndexBuffer Create Failed!");
 
-		CacheEntry = {};
+		g_IndexRingOffset = 0;
 	}
 
-	// If we need to create an index buffer, do so.
-	if (CacheEntry.pHostIndexBuffer == nullptr) {
-		CacheEntry.pHostIndexBuffer = CxbxCreateIndexBuffer(RequiredIndexCount);
-		if (!CacheEntry.pHostIndexBuffer)
-			CxbxKrnlCleanup("CxbxUpdateActiveIndexBuffer: IndexBuffer Create Failed!");
+	// Append behind the indices of earlier draws, or start over in a fresh buffer when they don't fit anymore
+	DWORD LockFlags = D3DLOCK_NOOVERWRITE;
+	if (g_IndexRingOffset == 0 || g_IndexRingOffset + RequiredIndexCount > g_IndexRingSize) {
+		LockFlags = D3DLOCK_DISCARD;
+		g_IndexRingOffset = 0;
 	}
 
-	// TODO : Speeds this up, perhaps by hashing less often, and/or by
-	// doing two hashes : a small subset regularly, all data less frequently.
-	uint64_t uiHash = ComputeHash(pXboxIndexData, XboxIndexCount * sizeof(INDEX16));
-
-	// If the data needs updating, do so
-	bNeedRepopulation |= (uiHash != CacheEntry.Hash);
-	if (bNeedRepopulation)	{
-		// Update the Index Count and the hash
-		CacheEntry.IndexCount = RequiredIndexCount;
-		CacheEntry.Hash = uiHash;
-
-		// Update the host index buffer
-		INDEX16* pHostIndexBufferData = nullptr;
-		HRESULT hRet = CacheEntry.pHostIndexBuffer->Lock(0, /*entire SizeToLock=*/0, (D3DLockData **)&pHostIndexBufferData, D3DLOCK_DISCARD);
-		DEBUG_D3DRESULT(hRet, "CacheEntry.pHostIndexBuffer->Lock");
-		if (pHostIndexBufferData == nullptr) {
-			CxbxKrnlCleanup("CxbxUpdateActiveIndexBuffer: Could not lock index buffer!");
-		}
+	ActiveIndexRange Result;
+	Result.StartIndex = g_IndexRingOffset;
 
-		// Determine highest and lowest index in use :
-		WalkIndexBuffer(CacheEntry.LowIndex, CacheEntry.HighIndex, pXboxIndexData, XboxIndexCount);
-		if (bConvertQuadListToTriangleList) {
-			// Note, that LowIndex and HighIndex won't change due to any quad-to-triangle conversion,
-			// so it's less work to WalkIndexBuffer over the input instead of the converted index buffer.
-			EmuLog(LOG_LEVEL::DEBUG, "CxbxUpdateActiveIndexBuffer: Converting quads to %d triangle indices (D3DFMT_INDEX16)", RequiredIndexCount);
-			CxbxConvertQuadListToTriangleListIndices(pXboxIndexData, RequiredIndexCount, pHostIndexBufferData);
-		} else {
-			EmuLog(LOG_LEVEL::DEBUG, "CxbxUpdateActiveIndexBuffer: Copying %d indices (D3DFMT_INDEX16)", XboxIndexCount);
-			memcpy(pHostIndexBufferData, pXboxIndexData, XboxIndexCount * sizeof(INDEX16));
-		}
+	INDEX16* pHostIndexBufferData = nullptr;
+	HRESULT hRet = g_pIndexRingHostIndexBuffer->Lock(
+		g_IndexRingOffset * sizeof(INDEX16),
+		RequiredIndexCount * sizeof(INDEX16),
+		(D3DLockData **)&pHostIndexBufferData,
+		LockFlags);
+	DEBUG_D3DRESULT(hRet, "g_pIndexRingHostIndexBuffer->Lock");
+	if (pHostIndexBufferData == nullptr) {
+		CxbxKrnlCleanup("CxbxUpdateActiveIndexBuffer: Could not lock index buffer!");
+	}
 
-		CacheEntry.pHostIndexBuffer->Unlock();
+	// Determine highest and lowest index in use, in the same pass that writes the host indices
+	// (LowIndex and HighIndex won't change due to any quad-to-triangle conversion)
+	if (bConvertQuadListToTriangleList) {
+		EmuLog(LOG_LEVEL::DEBUG, "CxbxUpdateActiveIndexBuffer: Converting quads to %d triangle indices (D3DFMT_INDEX16)", RequiredIndexCount);
+		WalkAndConvertQuadListIndices(Result.LowIndex, Result.HighIndex, pHostIndexBufferData, pXboxIndexData, XboxIndexCount, bUseClockWiseWindingOrder);
+	} else {
+		EmuLog(LOG_LEVEL::DEBUG, "CxbxUpdateActiveIndexBuffer: Copying %d indices (D3DFMT_INDEX16)", XboxIndexCount);
+		WalkAndCopyIndexBuffer(Result.LowIndex, Result.HighIndex, pHostIndexBufferData, pXboxIndexData, XboxIndexCount);
 	}
 
-	// Activate the new native index buffer :
-	HRESULT hRet = g_pD3DDevice->SetIndices(CacheEntry.pHostIndexBuffer);
+	g_pIndexRingHostIndexBuffer->Unlock();
+	g_IndexRingOffset += RequiredIndexCount;
+
+	// Activate the index ring (other index buffers may have been set since the previous draw) :
+	hRet = g_pD3DDevice->SetIndices(g_pIndexRingHostIndexBuffer);
 	// Note : Under Direct3D 9, the BaseVertexIndex argument is moved towards DrawIndexedPrimitive
 	DEBUG_D3DRESULT(hRet, "g_pD3DDevice->SetIndices");
 
 	if (FAILED(hRet))
 		CxbxKrnlCleanup("CxbxUpdateActiveIndexBuffer: SetIndices Failed!");
 
-	return CacheEntry;
+	return Result;
 }
 
 void UpdateHostBackBufferDesc()
@@ -4422,6 +4361,7 @@ VOID WINAPI xbox::EMUPATCH(D3DDevice_SetVertexData2s)
 
 extern uint32_t HLE_read_NV2A_pgraph_register(const int reg); // Declared in PushBuffer.cpp
 extern void HLE_write_NV2A_vertex_attribute_slot(unsigned slot, uint32_t parameter); // Declared in PushBuffer.cpp
+extern void HLE_NV2A_frame_boundary(); // Declared in PushBuffer.cpp
 extern uint32_t HLE_read_NV2A_vertex_attribute_slot(unsigned VertexSlot); // Declared in PushBuffer.cpp
 
 extern NV2ADevice* g_NV2A;
@@ -5293,6 +5233,12 @@ DWORD WINAPI xbox::EMUPATCH(D3DDevice_Swap)
     // RenderStates need reapplying each frame, but can be re-used between draw calls
     // This forces them to be reset
     XboxRenderStates.SetDirty();
+    XboxTextureStates.ReportFrameStatistics();
+    XboxTextureStates.SetDirty();
+
+    if (g_NV2A) {
+        HLE_NV2A_frame_boundary();
+    }
 
     // Check if we need to enable our frame-limiter
     DWORD presentationInverval = g_Xbox_PresentationInterval_Override > 0 ? g_Xbox_PresentationInterval_Override : g_Xbox_PresentationInterval_Default;
@@ -6601,7 +6547,7 @@ INDEX16 *CxbxAssureQuadListIndexData(UINT NrOfQuadIndices)
 		}
 
 		g_pQuadToTriangleIndexData = (INDEX16 *)malloc(NrOfTriangleIndices * sizeof(INDEX16));
-		CxbxConvertQuadListToTriangleListIndices(nullptr, NrOfTriangleIndices, g_pQuadToTriangleIndexData);
+		GenerateQuadListIndices(g_pQuadToTriangleIndexData, g_QuadToTriangleIndexData_Size, bUseClockWiseWindingOrder);
 	}
 
 	return g_pQuadToTriangleIndexData;
@@ -6753,12 +6699,12 @@ void CxbxDrawIndexed(CxbxDrawContext &DrawContext)
 	assert(IsValidCurrentShader());
 
 	bool bConvertQuadListToTriangleList = (DrawContext.XboxPrimitiveType == xbox::X_D3DPT_QUADLIST);
-	ConvertedIndexBuffer& CacheEntry = CxbxUpdateActiveIndexBuffer(DrawContext.pXboxIndexData, DrawContext.dwVertexCount, bConvertQuadListToTriangleList);
+	ActiveIndexRange IndexRange = CxbxUpdateActiveIndexBuffer(DrawContext.pXboxIndexData, DrawContext.dwVertexCount, bConvertQuadListToTriangleList);
 	// Note : CxbxUpdateActiveIndexBuffer calls SetIndices
 
 	// Set LowIndex and HighIndex *before* VerticesInBuffer gets derived
-	DrawContext.LowIndex = CacheEntry.LowIndex;
-	DrawContext.HighIndex = CacheEntry.HighIndex;
+	DrawContext.LowIndex = IndexRange.LowIndex;
+	DrawContext.HighIndex = IndexRange.HighIndex;
 
 	VertexBufferConverter.Apply(&DrawContext); // Sets dwHostPrimitiveCount
 
@@ -6783,9 +6729,9 @@ void CxbxDrawIndexed(CxbxDrawContext &DrawContext)
 	HRESULT hRet = g_pD3DDevice->DrawIndexedPrimitive(
 		/* PrimitiveType = */EmuXB2PC_D3DPrimitiveType(DrawContext.XboxPrimitiveType),
 		BaseVertexIndex,
-		/* MinVertexIndex = */CacheEntry.LowIndex,
-		/* NumVertices = */(CacheEntry.HighIndex - CacheEntry.LowIndex) + 1,
-		/* startIndex = DrawContext.dwStartVertex = */0,
+		/* MinVertexIndex = */IndexRange.LowIndex,
+		/* NumVertices = */(IndexRange.HighIndex - IndexRange.LowIndex) + 1,
+		/* startIndex = */IndexRange.StartIndex, // Note : DrawContext.dwStartVertex is always 0 here
 		primCount);
 	DEBUG_D3DRESULT(hRet, "g_pD3DDevice->DrawIndexedPrimitive");
 
@@ -7450,29 +7396,31 @@ VOID WINAPI xbox::EMUPATCH(D3DDevice_DrawIndexedVerticesUP)
 		DrawContext.pXboxVertexStreamZeroData = pVertexStreamZeroData;
 		DrawContext.uiXboxVertexStreamZeroStride = VertexStreamZeroStride;
 
-		// Determine LowIndex and HighIndex *before* VerticesInBuffer gets derived
-		WalkIndexBuffer(DrawContext.LowIndex, DrawContext.HighIndex, pXboxIndexData, VertexCount);
-
-		VertexBufferConverter.Apply(&DrawContext);
-
 		INDEX16* pHostIndexData;
-		UINT PrimitiveCount = DrawContext.dwHostPrimitiveCount;
 
+		// Determine LowIndex and HighIndex *before* VerticesInBuffer gets derived
 		bool bConvertQuadListToTriangleList = (DrawContext.XboxPrimitiveType == X_D3DPT_QUADLIST);
 		if (bConvertQuadListToTriangleList) {
 			LOG_TEST_CASE("X_D3DPT_QUADLIST");
 			// Test-case : Buffy: The Vampire Slayer
 			// Test-case : XDK samples : FastLoad, BackBufferScale, DisplacementMap, Donuts3D, VolumeLight, PersistDisplay, PolynomialTextureMaps, SwapCallback, Tiling, VolumeFog, DebugKeyboard, Gamepad
-			// Convert draw arguments from quads to triangles :
-			pHostIndexData = CxbxCreateQuadListToTriangleListIndexData(pXboxIndexData, VertexCount);
-			PrimitiveCount *= TRIANGLES_PER_QUAD;
-			// Note, that LowIndex and HighIndex won't change due to this quad-to-triangle conversion,
-			// so it's less work to WalkIndexBuffer over the input instead of the converted index buffer.
+			// Convert the quad indices to triangle indices, which walks the quad indices for LowIndex and HighIndex as well
+			// (these won't change due to this quad-to-triangle conversion)
+			pHostIndexData = CxbxCreateQuadListToTriangleListIndexData(pXboxIndexData, VertexCount, DrawContext.LowIndex, DrawContext.HighIndex);
 		} else {
 			// LOG_TEST_CASE("DrawIndexedPrimitiveUP"); // Test-case : Burnout, Namco Museum 50th Anniversary
+			WalkIndexBuffer(DrawContext.LowIndex, DrawContext.HighIndex, pXboxIndexData, VertexCount);
 			pHostIndexData = pXboxIndexData;
 		}
 
+		VertexBufferConverter.Apply(&DrawContext);
+
+		UINT PrimitiveCount = DrawContext.dwHostPrimitiveCount;
+		if (bConvertQuadListToTriangleList) {
+			// Convert draw arguments from quads to triangles :
+			PrimitiveCount *= TRIANGLES_PER_QUAD;
+		}
+
 		HRESULT hRet = g_pD3DDevice->DrawIndexedPrimitiveUP(
 			/*PrimitiveType=*/EmuXB2PC_D3DPrimitiveType(DrawContext.XboxPrimitiveType),
 			/*MinVertexIndex=*/DrawContext.LowIndex,
@@ -7485,10 +7433,6 @@ VOID WINAPI xbox::EMUPATCH(D3DDevice_DrawIndexedVerticesUP)
 		);
 		DEBUG_D3DRESULT(hRet, "g_pD3DDevice->DrawIndexedPrimitiveUP");
 
-		if (bConvertQuadListToTriangleList) {
-			CxbxReleaseQuadListToTriangleListIndexData(pHostIndexData);
-		}
-
 		g_dwPrimPerFrame += PrimitiveCount;
 		if (DrawContext.XboxPrimitiveType == X_D3DPT_LINELOOP) {
 			// Close line-loops using a final single line, drawn from the end to the start vertex
@@ -0,0 +1,88 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+#ifndef RENDERSTATEDIFF_H
+#define RENDERSTATEDIFF_H
+
+// Finds the Xbox render states that changed since the previous XboxRenderStateConverter::Apply.
+// Kept free of emulator dependencies, so that cxbxr-renderstatebench can check and time the very
+// same code against the per-state loop Apply used before.
+
+#include <cstdint>
+#include <emmintrin.h> // SSE2
+#ifdef _WIN32
+#include <intrin.h> // For _BitScanForward
+#endif
+
+// Compares Count render states against their values at the previous Apply, copies them over, and
+// sets the bit of every state that changed in pChangedStates (one bit per state, 32 per word)
+static inline void DiffRenderStates_NoSIMD(const uint32_t* pValues, uint32_t* pPreviousValues, unsigned Count, uint32_t* pChangedStates)
+{
+    for (unsigned i = 0; i < Count; i++) {
+        if (pValues[i] != pPreviousValues[i]) {
+            pPreviousValues[i] = pValues[i];
+            pChangedStates[i / 32] |= 1u << (i % 32);
+        }
+    }
+}
+
+static inline void DiffRenderStates_SSE2(const uint32_t* pValues, uint32_t* pPreviousValues, unsigned Count, uint32_t* pChangedStates)
+{
+    unsigned i = 0;
+    for (; i + 32 <= Count; i += 32) {
+        uint32_t Changed = 0;
+        for (unsigned j = 0; j < 32; j += 4) {
+            __m128i Values = _mm_loadu_si128((const __m128i*)(pValues + i + j));
+            __m128i Previous = _mm_loadu_si128((const __m128i*)(pPreviousValues + i + j));
+            // One bit per equal state
+            uint32_t Equal = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(Values, Previous)));
+            Changed |= (~Equal & 0xF) << j;
+            // Store exactly what was compared, the title could be changing states concurrently
+            _mm_storeu_si128((__m128i*)(pPreviousValues + i + j), Values);
+        }
+        pChangedStates[i / 32] |= Changed;
+    }
+    DiffRenderStates_NoSIMD(pValues + i, pPreviousValues + i, Count - i, pChangedStates + i / 32);
+}
+
+// Calls Visit(Index) for every bit set in the Words words of pBits, lowest index first
+template<typename TVisit>
+static inline void ForEachRenderStateBit(const uint32_t* pBits, unsigned Words, TVisit Visit)
+{
+    for (unsigned Word = 0; Word < Words; Word++) {
+        uint32_t Bits = pBits[Word];
+        while (Bits != 0) {
+#ifdef _WIN32
+            unsigned long Bit;
+            _BitScanForward(&Bit, Bits);
+#else
+            unsigned Bit = __builtin_ctz(Bits);
+#endif
+            Bits &= Bits - 1;
+            Visit((Word * 32) + Bit);
+        }
+    }
+}
+
+#endif
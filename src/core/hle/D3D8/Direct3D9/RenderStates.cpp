@@ -28,9 +28,24 @@
 
 
 #include "RenderStates.h"
+#include "RenderStateDiff.h"
 #include "Logging.h"
 #include "core/hle/D3D8/Direct3D9/Direct3D9.h" // For g_pD3DDevice
 #include "core/hle/D3D8/XbConvert.h"
+#include "common/util/CPUID.h"
+
+// Detect SIMD support to select real implementation on first call
+static void(*DiffRenderStates)(const uint32_t*, uint32_t*, unsigned, uint32_t*) =
+[](const uint32_t* pValues, uint32_t* pPreviousValues, unsigned Count, uint32_t* pChangedStates)
+{
+    SimdCaps supports;
+    if (supports.SSE2())
+        DiffRenderStates = DiffRenderStates_SSE2;
+    else
+        DiffRenderStates = DiffRenderStates_NoSIMD;
+
+    DiffRenderStates(pValues, pPreviousValues, Count, pChangedStates);
+};
 
 bool XboxRenderStateConverter::Init()
 {
@@ -51,6 +66,9 @@ bool XboxRenderStateConverter::Init()
     // Build a mapping of Cxbx Render State indexes to indexes within the current XDK
     BuildRenderStateMappingTable();
 
+    // Decide once how each render state of the current XDK is applied
+    BuildApplyTable();
+
     // Set Initial Values
     StoreInitialValues();
 
@@ -134,30 +152,59 @@ void XboxRenderStateConverter::BuildRenderStateMappingTable()
 
         EmuLog(LOG_LEVEL::INFO, "%s Not Present", RenderStateInfo.S);
     }
+
+    XboxRenderStateCount = XboxIndex;
 }
 
-void XboxRenderStateConverter::SetDirty()
+void XboxRenderStateConverter::BuildApplyTable()
 {
-    PreviousRenderStateValues.fill(-1);
+    ApplyRenderStateTable.fill({ 0, nullptr });
+
+    // We start at X_D3DRS_SIMPLE_FIRST, to skip the pixel shader renderstates handled elsewhere
+    for (unsigned int RenderState = xbox::X_D3DRS_SIMPLE_FIRST; RenderState <= xbox::X_D3DRS_LAST; RenderState++) {
+        // Skip any renderstate that does not exist in the current XDK
+        // Also skip PSTextureModes, which is a special case used by Pixel Shaders
+        if (!XboxRenderStateExists(RenderState) || RenderState == xbox::X_D3DRS_PSTEXTUREMODES) {
+            continue;
+        }
+
+        auto& Entry = ApplyRenderStateTable[XboxRenderStateOffsets[RenderState]];
+        Entry.State = RenderState;
+        if (RenderState <= xbox::X_D3DRS_SIMPLE_LAST) {
+            Entry.Fn = &XboxRenderStateConverter::ApplySimpleRenderState;
+        } else if (RenderState <= xbox::X_D3DRS_DEFERRED_LAST) {
+            Entry.Fn = &XboxRenderStateConverter::ApplyDeferredRenderState;
+        } else if (RenderState <= xbox::X_D3DRS_COMPLEX_LAST) {
+            Entry.Fn = &XboxRenderStateConverter::ApplyComplexRenderState;
+        }
+    }
 }
 
-void* XboxRenderStateConverter::GetPixelShaderRenderStatePointer()
+void XboxRenderStateConverter::SetDirty()
 {
-    return &D3D__RenderState[xbox::X_D3DRS_PS_FIRST];
+    // Only mark the states of the current XDK, Apply looks up every set bit
+    ForceDirtyStates.fill(0);
+    for (unsigned i = 0; i < XboxRenderStateCount; i++) {
+        ForceDirtyStates[i / 32] |= 1u << (i % 32);
+    }
 }
 
-bool XboxRenderStateConverter::XboxRenderStateExists(uint32_t State)
+void XboxRenderStateConverter::SetXboxRenderStateDirty(uint32_t State)
 {
-    if (XboxRenderStateOffsets[State] >= 0) {
-        return true;
+    if (XboxRenderStateExists(State)) {
+        int Offset = XboxRenderStateOffsets[State];
+        ForceDirtyStates[Offset / 32] |= 1u << (Offset % 32);
     }
+}
 
-    return false;
+void* XboxRenderStateConverter::GetPixelShaderRenderStatePointer()
+{
+    return &D3D__RenderState[xbox::X_D3DRS_PS_FIRST];
 }
 
-bool XboxRenderStateConverter::XboxRenderStateValueChanged(uint32_t State)
+bool XboxRenderStateConverter::XboxRenderStateExists(uint32_t State)
 {
-    if (XboxRenderStateExists(State) && GetXboxRenderState(State) != PreviousRenderStateValues[State]) {
+    if (XboxRenderStateOffsets[State] >= 0) {
         return true;
     }
 
@@ -186,14 +233,8 @@ uint32_t XboxRenderStateConverter::GetXboxRenderState(uint32_t State)
 
 void XboxRenderStateConverter::StoreInitialValues()
 {
-    for (unsigned int RenderState = xbox::X_D3DRS_FIRST; RenderState <= xbox::X_D3DRS_LAST; RenderState++) {
-        // Skip Render States that don't exist within this XDK
-        if (!XboxRenderStateExists(RenderState)) {
-            continue;
-        }
-
-        PreviousRenderStateValues[RenderState] = GetXboxRenderState(RenderState);
-    }
+    std::copy(D3D__RenderState, D3D__RenderState + XboxRenderStateCount, PreviousRenderStateValues.begin());
+    ForceDirtyStates.fill(0);
 }
 
 void XboxRenderStateConverter::SetWireFrameMode(int wireframe)
@@ -202,33 +243,31 @@ void XboxRenderStateConverter::SetWireFrameMode(int wireframe)
 
     // Wireframe mode changed, so we must force the Fill Mode renderstate to dirty
     // At next call to Apply, the desired WireFrame mode will be set
-    PreviousRenderStateValues[xbox::X_D3DRS_FILLMODE] = -1;
+    SetXboxRenderStateDirty(xbox::X_D3DRS_FILLMODE);
 }
 
 void XboxRenderStateConverter::Apply()
 {
-    // Iterate through each RenderState and set the associated host render state
-    // We start counting at X_D3DRS_SIMPLE_FIRST, to skip the pixel shader renderstates handled elsewhere
-    for (unsigned int RenderState = xbox::X_D3DRS_SIMPLE_FIRST; RenderState <= xbox::X_D3DRS_LAST; RenderState++) {
-        // Skip any renderstate that does not exist in the current XDK, or have not changed since the previous update call
-        // Also skip PSTextureModes, which is a special case used by Pixel Shaders
-        if (!XboxRenderStateExists(RenderState) || !XboxRenderStateValueChanged(RenderState) || RenderState == xbox::X_D3DRS_PSTEXTUREMODES) {
-            continue;
+    // Compare the whole Xbox render state block against the previous Apply, which gives a bitmap
+    // (indexed like D3D__RenderState) of the states to set on the host
+    decltype(ForceDirtyStates) DirtyStates = ForceDirtyStates;
+    ForceDirtyStates.fill(0);
+    DiffRenderStates(D3D__RenderState, PreviousRenderStateValues.data(), XboxRenderStateCount, DirtyStates.data());
+
+    ForEachRenderStateBit(DirtyStates.data(), (unsigned)DirtyStates.size(), [this](unsigned Index) {
+        // Skip the states Apply doesn't handle (see BuildApplyTable)
+        const auto& Entry = ApplyRenderStateTable[Index];
+        if (Entry.Fn == nullptr) {
+            return;
         }
 
-        auto Value = GetXboxRenderState(RenderState);
-        EmuLog(LOG_LEVEL::DEBUG, "XboxRenderStateConverter::Apply(%s, %X)\n", GetDxbxRenderStateInfo(RenderState).S, Value);
-
-        if (RenderState <= xbox::X_D3DRS_SIMPLE_LAST) {
-            ApplySimpleRenderState(RenderState, Value);
-        } else if (RenderState <= xbox::X_D3DRS_DEFERRED_LAST) {
-            ApplyDeferredRenderState(RenderState, Value);
-        } else if (RenderState <= xbox::X_D3DRS_COMPLEX_LAST) {
-            ApplyComplexRenderState(RenderState, Value);
+        auto Value = PreviousRenderStateValues[Index];
+        LOG_CHECK_ENABLED(LOG_LEVEL::DEBUG) {
+            EmuLog(LOG_LEVEL::DEBUG, "XboxRenderStateConverter::Apply(%s, %X)\n", GetDxbxRenderStateInfo(Entry.State).S, Value);
         }
 
-        PreviousRenderStateValues[RenderState] = Value;
-    }
+        (this->*Entry.Fn)(Entry.State, Value);
+    });
 }
 
 void XboxRenderStateConverter::ApplySimpleRenderState(uint32_t State, uint32_t Value)
@@ -51,16 +51,28 @@ private:
     void DeriveRenderStateOffsetFromDeferredRenderStateOffset();
     void StoreInitialValues();
     void BuildRenderStateMappingTable();
-
-    bool XboxRenderStateValueChanged(uint32_t State);
+    void BuildApplyTable();
+    void SetXboxRenderStateDirty(uint32_t State);
 
     void ApplySimpleRenderState(uint32_t State, uint32_t Value);
     void ApplyDeferredRenderState(uint32_t State, uint32_t Value);
     void ApplyComplexRenderState(uint32_t State, uint32_t Value);
 
+    typedef void (XboxRenderStateConverter::*ApplyRenderStateFn)(uint32_t State, uint32_t Value);
+    struct ApplyRenderStateEntry {
+        uint32_t State;          // The Cxbx render state
+        ApplyRenderStateFn Fn;   // nullptr for the states Apply skips
+    };
+
     uint32_t* D3D__RenderState = nullptr;
     int WireFrameMode = 0;
-    // NOTE: RenderStates are 32bit values, but using a 64bit value allows the upper bits to be used as a 'force dirty' flag
-    std::array<uint64_t, xbox::X_D3DRS_LAST + 1> PreviousRenderStateValues;
+    // Number of render states in the current XDK, all the arrays below are indexed like D3D__RenderState
+    unsigned XboxRenderStateCount = 0;
+    // The Xbox render states as of the previous Apply
+    std::array<uint32_t, xbox::X_D3DRS_LAST + 1> PreviousRenderStateValues;
+    // One bit per render state, set when it must be re-applied regardless of whether the Xbox value changed
+    std::array<uint32_t, (xbox::X_D3DRS_LAST + 32) / 32> ForceDirtyStates;
+    // How each render state is applied, built once for the current XDK
+    std::array<ApplyRenderStateEntry, xbox::X_D3DRS_LAST + 1> ApplyRenderStateTable;
     std::array<int, xbox::X_D3DRS_LAST + 1>  XboxRenderStateOffsets;
 };
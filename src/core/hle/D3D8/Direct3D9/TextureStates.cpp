@@ -92,12 +92,16 @@ bool XboxTextureStateConverter::Init(XboxRenderStateConverter* pState)
     // This is used to check for Point Sprites
     pXboxRenderStates = pState;
 
+    // Nothing has been passed to the host yet, so the first Apply must set everything
+    SetDirty();
+
     return true;
 }
 
 void XboxTextureStateConverter::BuildTextureStateMappingTable()
 {
     EmuLog(LOG_LEVEL::INFO, "Building Cxbx to XDK Texture State Mapping Table");
+    HostStatesPerStage = 0;
     for (int State = xbox::X_D3DTSS_FIRST; State <= xbox::X_D3DTSS_LAST; State++) {
         int index = State;
 
@@ -116,6 +120,10 @@ void XboxTextureStateConverter::BuildTextureStateMappingTable()
 
         EmuLog(LOG_LEVEL::INFO, "%s = %d", CxbxTextureStateInfo[State].S, index);
         XboxTextureStateOffsets[State] = index;
+
+        if (CxbxTextureStateInfo[State].PC != 0) {
+            HostStatesPerStage++;
+        }
     }
 }
 
@@ -156,106 +164,163 @@ DWORD XboxTextureStateConverter::GetHostTextureOpValue(DWORD Value)
 
 }
 
-void XboxTextureStateConverter::Apply()
+DWORD XboxTextureStateConverter::ConvertXboxTextureStateValue(DWORD State, DWORD Value)
 {
-    // Iterate through all texture states/stages
+    switch (State) {
+        // These types map 1:1 but have some unsupported values
+        case xbox::X_D3DTSS_ADDRESSU: case xbox::X_D3DTSS_ADDRESSV: case xbox::X_D3DTSS_ADDRESSW:
+            if (Value == xbox::X_D3DTADDRESS_CLAMPTOEDGE) {
+                EmuLog(LOG_LEVEL::WARNING, "D3DTADDRESS_CLAMPTOEDGE is unsupported");
+                // D3DTADDRESS_BORDER is the closest host match, CLAMPTOEDGE is identical
+                // Except it has additional restrictions.
+                Value = D3DTADDRESS_BORDER; 
+                break;
+            }
+            break;
+        case xbox::X_D3DTSS_MAGFILTER: case xbox::X_D3DTSS_MINFILTER: case xbox::X_D3DTSS_MIPFILTER:
+            if (Value == xbox::X_D3DTEXF_QUINCUNX) {
+                EmuLog(LOG_LEVEL::WARNING, "D3DTEXF_QUINCUNX is unsupported");
+                // Fallback to D3DTEXF_ANISOTROPIC 
+                Value = D3DTEXF_ANISOTROPIC;
+                break;
+            }
+            break;
+        case xbox::X_D3DTSS_TEXCOORDINDEX:
+            switch (Value) {
+                case 0x00040000:
+                    // This value is TCI_OBJECT on Xbox,which is not supported by the host
+                    // In this case, we reset to 0.
+                    EmuLog(LOG_LEVEL::WARNING, "EmuD3DDevice_SetTextureState_TexCoordIndex: D3DTSS_TCI_OBJECT is unsupported", Value);
+                    Value = 0;
+                    break;
+                case 0x00050000:
+                    // This value is TCI_SPHERE on Xbox, let's map it to D3DTSS_TCI_SPHEREMAP for the host
+                    Value = D3DTSS_TCI_SPHEREMAP;
+                    break;
+            }
+            break;
+        // These types require value remapping for all supported values
+        case xbox::X_D3DTSS_COLOROP: case xbox::X_D3DTSS_ALPHAOP:
+            Value = GetHostTextureOpValue(Value);
+            break;
+        // These types  require no conversion, so we just pass through as-is
+        case xbox::X_D3DTSS_COLORARG0: case xbox::X_D3DTSS_COLORARG1: case xbox::X_D3DTSS_COLORARG2:
+        case xbox::X_D3DTSS_ALPHAARG0: case xbox::X_D3DTSS_ALPHAARG1: case xbox::X_D3DTSS_ALPHAARG2:
+        case xbox::X_D3DTSS_RESULTARG: case xbox::X_D3DTSS_TEXTURETRANSFORMFLAGS:
+        case xbox::X_D3DTSS_BUMPENVMAT00: case xbox::X_D3DTSS_BUMPENVMAT01:
+        case xbox::X_D3DTSS_BUMPENVMAT11: case xbox::X_D3DTSS_BUMPENVMAT10:
+        case xbox::X_D3DTSS_BUMPENVLSCALE: case xbox::X_D3DTSS_BUMPENVLOFFSET:
+        case xbox::X_D3DTSS_BORDERCOLOR: case xbox::X_D3DTSS_MIPMAPLODBIAS:
+        case xbox::X_D3DTSS_MAXMIPLEVEL: case xbox::X_D3DTSS_MAXANISOTROPY:
+            break;
+        default:
+            // Only log missing state if it has a PC counterpart
+            if (CxbxTextureStateInfo[State].PC != 0) {
+                EmuLog(LOG_LEVEL::WARNING, "XboxTextureStateConverter::Apply(%s, 0x%.08X) is unimplemented!", CxbxTextureStateInfo[State].S, Value);
+            }
+            break;
+    }
 
-    // Track if we need to overwrite state 0 with 3 because of Point Sprites
-    // The Xbox NV2A uses only Stage 3 for point-sprites, so we emulate this
-    // by mapping Stage 3 to Stage 0, and disabling all stages > 0
-    bool pointSpriteOverride = false;
-    bool pointSpritesEnabled = pXboxRenderStates->GetXboxRenderState(xbox::X_D3DRS_POINTSPRITEENABLE);
-    if (pointSpritesEnabled) {
-        pointSpriteOverride = true;
+    return Value;
+}
+
+void XboxTextureStateConverter::SetDirty()
+{
+    ForceDirtyStates.fill(~0u);
+
+    for (auto& HostStageValues : HostTextureStateValues) {
+        HostStageValues.fill(-1);
     }
+}
 
-    for (int XboxStage = 0; XboxStage < xbox::X_D3DTS_STAGECOUNT; XboxStage++) {
-        // If point sprites are enabled, we need to overwrite our existing state 0 with State 3 also
-        DWORD HostStage = (pointSpriteOverride && XboxStage == 3) ? 0 : XboxStage;
+uint32_t XboxTextureStateConverter::CollectDirtyStates(DWORD XboxStage)
+{
+    // Compare the Xbox texture states of this stage against the values seen during the previous Apply
+    // and return a bitmask of the states (indexed like D3D__TextureState) that need to be re-applied
+    uint32_t DirtyStates = ForceDirtyStates[XboxStage];
+    uint32_t* pXboxValues = &D3D__TextureState[XboxStage * xbox::X_D3DTS_STAGESIZE];
+    auto& PreviousValues = PreviousTextureStateValues[XboxStage];
 
-        for (int StateIndex = xbox::X_D3DTSS_FIRST; StateIndex <= xbox::X_D3DTSS_LAST; StateIndex++) {
-            // Read the value of the current stage/state from the Xbox data structure
-            DWORD Value = D3D__TextureState[(XboxStage * xbox::X_D3DTS_STAGESIZE) + StateIndex];
+    for (int StateIndex = xbox::X_D3DTSS_FIRST; StateIndex <= xbox::X_D3DTSS_LAST; StateIndex++) {
+        if (pXboxValues[StateIndex] != PreviousValues[StateIndex]) {
+            PreviousValues[StateIndex] = pXboxValues[StateIndex];
+            DirtyStates |= 1u << StateIndex;
+        }
+    }
 
-            // Convert the index of the current state to an index that we can use
-            // This handles the case when XDKs have different state values
-            DWORD State = XboxTextureStateOffsets[StateIndex];
+    ForceDirtyStates[XboxStage] = 0;
+    return DirtyStates;
+}
 
-            switch (State) {
-                // These types map 1:1 but have some unsupported values
-                case xbox::X_D3DTSS_ADDRESSU: case xbox::X_D3DTSS_ADDRESSV: case xbox::X_D3DTSS_ADDRESSW:
-                    if (Value == xbox::X_D3DTADDRESS_CLAMPTOEDGE) {
-                        EmuLog(LOG_LEVEL::WARNING, "D3DTADDRESS_CLAMPTOEDGE is unsupported");
-                        // D3DTADDRESS_BORDER is the closest host match, CLAMPTOEDGE is identical
-                        // Except it has additional restrictions.
-                        Value = D3DTADDRESS_BORDER; 
-                        break;
-                    }
-                    break;
-                case xbox::X_D3DTSS_MAGFILTER: case xbox::X_D3DTSS_MINFILTER: case xbox::X_D3DTSS_MIPFILTER:
-                    if (Value == xbox::X_D3DTEXF_QUINCUNX) {
-                        EmuLog(LOG_LEVEL::WARNING, "D3DTEXF_QUINCUNX is unsupported");
-                        // Fallback to D3DTEXF_ANISOTROPIC 
-                        Value = D3DTEXF_ANISOTROPIC;
-                        break;
-                    }
-                    break;
-                case xbox::X_D3DTSS_TEXCOORDINDEX:
-                    switch (Value) {
-                        case 0x00040000:
-                            // This value is TCI_OBJECT on Xbox,which is not supported by the host
-                            // In this case, we reset to 0.
-                            EmuLog(LOG_LEVEL::WARNING, "EmuD3DDevice_SetTextureState_TexCoordIndex: D3DTSS_TCI_OBJECT is unsupported", Value);
-                            Value = 0;
-                            break;
-                        case 0x00050000:
-                            // This value is TCI_SPHERE on Xbox, let's map it to D3DTSS_TCI_SPHEREMAP for the host
-                            Value = D3DTSS_TCI_SPHEREMAP;
-                            break;
-                    }
-                    break;
-                // These types require value remapping for all supported values
-                case xbox::X_D3DTSS_COLOROP: case xbox::X_D3DTSS_ALPHAOP:
-                    Value = GetHostTextureOpValue(Value);
-                    break;
-                // These types  require no conversion, so we just pass through as-is
-                case xbox::X_D3DTSS_COLORARG0: case xbox::X_D3DTSS_COLORARG1: case xbox::X_D3DTSS_COLORARG2:
-                case xbox::X_D3DTSS_ALPHAARG0: case xbox::X_D3DTSS_ALPHAARG1: case xbox::X_D3DTSS_ALPHAARG2:
-                case xbox::X_D3DTSS_RESULTARG: case xbox::X_D3DTSS_TEXTURETRANSFORMFLAGS:
-                case xbox::X_D3DTSS_BUMPENVMAT00: case xbox::X_D3DTSS_BUMPENVMAT01:
-                case xbox::X_D3DTSS_BUMPENVMAT11: case xbox::X_D3DTSS_BUMPENVMAT10:
-                case xbox::X_D3DTSS_BUMPENVLSCALE: case xbox::X_D3DTSS_BUMPENVLOFFSET:
-                case xbox::X_D3DTSS_BORDERCOLOR: case xbox::X_D3DTSS_MIPMAPLODBIAS:
-                case xbox::X_D3DTSS_MAXMIPLEVEL: case xbox::X_D3DTSS_MAXANISOTROPY:
-                    break;
-                default:
-                    // Only log missing state if it has a PC counterpart
-                    if (CxbxTextureStateInfo[State].PC != 0) {
-                        EmuLog(LOG_LEVEL::WARNING, "XboxTextureStateConverter::Apply(%s, 0x%.08X) is unimplemented!", CxbxTextureStateInfo[State].S, Value);
-                    }
-                    break;
-            }
+void XboxTextureStateConverter::SetHostTextureState(DWORD HostStage, DWORD State, DWORD Value)
+{
+    // Skip the host call if it would not change anything
+    if (HostTextureStateValues[HostStage][State] == Value) {
+        return;
+    }
 
-            // Skip Texture States that don't have a defined PC counterpart
-            if (CxbxTextureStateInfo[State].PC == 0) {
-                continue;
-            }
+    HostTextureStateValues[HostStage][State] = Value;
+    HostStateCalls++;
 
-            if (CxbxTextureStateInfo[State].IsSamplerState) {
-                g_pD3DDevice->SetSamplerState(HostStage, (D3DSAMPLERSTATETYPE)CxbxTextureStateInfo[State].PC, Value);
-            } else {
-                g_pD3DDevice->SetTextureStageState(HostStage, (D3DTEXTURESTAGESTATETYPE)CxbxTextureStateInfo[State].PC, Value);
-            }
+    if (CxbxTextureStateInfo[State].IsSamplerState) {
+        g_pD3DDevice->SetSamplerState(HostStage, (D3DSAMPLERSTATETYPE)CxbxTextureStateInfo[State].PC, Value);
+    } else {
+        g_pD3DDevice->SetTextureStageState(HostStage, (D3DTEXTURESTAGESTATETYPE)CxbxTextureStateInfo[State].PC, Value);
+    }
+}
+
+void XboxTextureStateConverter::ApplyDirtyStates(DWORD XboxStage, DWORD HostStage, uint32_t DirtyStates)
+{
+    for (int StateIndex = xbox::X_D3DTSS_FIRST; DirtyStates != 0 && StateIndex <= xbox::X_D3DTSS_LAST; StateIndex++, DirtyStates >>= 1) {
+        if ((DirtyStates & 1) == 0) {
+            continue;
         }
 
-        // Make sure we only do this once
-        if (pointSpriteOverride && XboxStage == 3) {
-            pointSpriteOverride = false;
-            XboxStage--;
+        // Convert the index of the current state to an index that we can use
+        // This handles the case when XDKs have different state values
+        DWORD State = XboxTextureStateOffsets[StateIndex];
+
+        // Skip Texture States that don't have a defined PC counterpart
+        if (CxbxTextureStateInfo[State].PC == 0) {
+            continue;
         }
+
+        // Read the value of the current stage/state from the Xbox data structure
+        DWORD Value = D3D__TextureState[(XboxStage * xbox::X_D3DTS_STAGESIZE) + StateIndex];
+        SetHostTextureState(HostStage, State, ConvertXboxTextureStateValue(State, Value));
+    }
+}
+
+void XboxTextureStateConverter::Apply()
+{
+    // The Xbox NV2A uses only Stage 3 for point-sprites, so we emulate this
+    // by mapping Stage 3 to Stage 0, and disabling all stages > 0
+    bool pointSpritesEnabled = pXboxRenderStates->GetXboxRenderState(xbox::X_D3DRS_POINTSPRITEENABLE);
+
+    // Toggling point sprites changes which Xbox stage feeds host stage 0 (and overrides stage 1),
+    // so everything must be re-applied when that happens
+    if (pointSpritesEnabled != PreviousPointSpritesEnabled) {
+        PreviousPointSpritesEnabled = pointSpritesEnabled;
+        SetDirty();
+    }
+
+    std::array<uint32_t, xbox::X_D3DTS_STAGECOUNT> DirtyStates;
+    for (DWORD XboxStage = 0; XboxStage < xbox::X_D3DTS_STAGECOUNT; XboxStage++) {
+        DirtyStates[XboxStage] = CollectDirtyStates(XboxStage);
+    }
+
+    for (DWORD XboxStage = 0; XboxStage < xbox::X_D3DTS_STAGECOUNT; XboxStage++) {
+        // With point sprites, host stage 0 shows Stage 3, so changes to Stage 0 itself are not visible
+        if (pointSpritesEnabled && XboxStage == 0) {
+            continue;
+        }
+
+        ApplyDirtyStates(XboxStage, XboxStage, DirtyStates[XboxStage]);
     }
 
     if (pointSpritesEnabled) {
+        ApplyDirtyStates(3, 0, DirtyStates[3]);
+
         IDirect3DBaseTexture* pTexture;
 
         // set the point sprites texture
@@ -267,9 +332,64 @@ void XboxTextureStateConverter::Apply()
             pTexture->Release();
 
         // disable all other stages
-        g_pD3DDevice->SetTextureStageState(1, D3DTSS_COLOROP, D3DTOP_DISABLE);
-        g_pD3DDevice->SetTextureStageState(1, D3DTSS_ALPHAOP, D3DTOP_DISABLE);
+        SetHostTextureState(1, xbox::X_D3DTSS_COLOROP, D3DTOP_DISABLE);
+        SetHostTextureState(1, xbox::X_D3DTSS_ALPHAOP, D3DTOP_DISABLE);
+    }
+
+    // What a full re-apply of all stages would have cost
+    HostStateCallsFullApply += HostStatesPerStage * (xbox::X_D3DTS_STAGECOUNT + (pointSpritesEnabled ? 1 : 0)) + (pointSpritesEnabled ? 2 : 0);
 
-        // no need to actually copy here, since it was handled in the loop above
+#ifdef _DEBUG_VERIFY_TEXTURE_STATES
+    VerifyAgainstFullApply(pointSpritesEnabled);
+#endif
+}
+
+#ifdef _DEBUG_VERIFY_TEXTURE_STATES
+void XboxTextureStateConverter::VerifyAgainstFullApply(bool pointSpritesEnabled)
+{
+    // Recompute every host texture state the way a full re-apply would, and compare against the device
+    for (DWORD HostStage = 0; HostStage < xbox::X_D3DTS_STAGECOUNT; HostStage++) {
+        DWORD XboxStage = (pointSpritesEnabled && HostStage == 0) ? 3 : HostStage;
+
+        for (int StateIndex = xbox::X_D3DTSS_FIRST; StateIndex <= xbox::X_D3DTSS_LAST; StateIndex++) {
+            DWORD State = XboxTextureStateOffsets[StateIndex];
+            if (CxbxTextureStateInfo[State].PC == 0) {
+                continue;
+            }
+
+            DWORD Expected = ConvertXboxTextureStateValue(State, D3D__TextureState[(XboxStage * xbox::X_D3DTS_STAGESIZE) + StateIndex]);
+            if (pointSpritesEnabled && HostStage == 1 && (State == xbox::X_D3DTSS_COLOROP || State == xbox::X_D3DTSS_ALPHAOP)) {
+                Expected = D3DTOP_DISABLE;
+            }
+
+            DWORD Actual = 0;
+            if (CxbxTextureStateInfo[State].IsSamplerState) {
+                g_pD3DDevice->GetSamplerState(HostStage, (D3DSAMPLERSTATETYPE)CxbxTextureStateInfo[State].PC, &Actual);
+            } else {
+                g_pD3DDevice->GetTextureStageState(HostStage, (D3DTEXTURESTAGESTATETYPE)CxbxTextureStateInfo[State].PC, &Actual);
+            }
+
+            if (Actual != Expected) {
+                EmuLog(LOG_LEVEL::ERROR2, "Texture state tracking mismatch : Stage %d %s = 0x%.08X, expected 0x%.08X", HostStage, CxbxTextureStateInfo[State].S, Actual, Expected);
+            }
+        }
     }
 }
+#endif
+
+void XboxTextureStateConverter::ReportFrameStatistics()
+{
+    // Only report once every STATISTICS_REPORT_FRAMES frames, so the log isn't flooded
+    if (++StatisticsFrames < STATISTICS_REPORT_FRAMES) {
+        return;
+    }
+
+    LOG_CHECK_ENABLED(LOG_LEVEL::DEBUG) {
+        EmuLog(LOG_LEVEL::DEBUG, "Texture state host calls per frame : %u (full re-apply would need %u)",
+            HostStateCalls / StatisticsFrames, HostStateCallsFullApply / StatisticsFrames);
+    }
+
+    StatisticsFrames = 0;
+    HostStateCalls = 0;
+    HostStateCallsFullApply = 0;
+}
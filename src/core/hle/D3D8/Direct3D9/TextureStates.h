@@ -31,6 +31,9 @@
 
 #define CXBX_D3DRS_UNSUPPORTED (xbox::X_D3DRS_LAST + 1)
 
+// Uncomment to check every incremental Apply against a full re-apply of all texture states
+// #define _DEBUG_VERIFY_TEXTURE_STATES
+
 class XboxRenderStateConverter;
 
 class XboxTextureStateConverter
@@ -38,12 +41,37 @@ class XboxTextureStateConverter
 public:
     bool Init(XboxRenderStateConverter* state);
     void Apply();
+    void SetDirty();
+    void ReportFrameStatistics();
 
 private:
     void BuildTextureStateMappingTable();
     DWORD GetHostTextureOpValue(DWORD XboxTextureOp);
+    DWORD ConvertXboxTextureStateValue(DWORD State, DWORD Value);
+    uint32_t CollectDirtyStates(DWORD XboxStage);
+    void ApplyDirtyStates(DWORD XboxStage, DWORD HostStage, uint32_t DirtyStates);
+    void SetHostTextureState(DWORD HostStage, DWORD State, DWORD Value);
+#ifdef _DEBUG_VERIFY_TEXTURE_STATES
+    void VerifyAgainstFullApply(bool pointSpritesEnabled);
+#endif
 
     uint32_t* D3D__TextureState = nullptr;
     std::array<int, xbox::X_D3DTSS_LAST + 1> XboxTextureStateOffsets;
     XboxRenderStateConverter* pXboxRenderStates;
+
+    // One bit per texture state (indexed like D3D__TextureState), set when the stage must be re-applied
+    // regardless of whether the Xbox value changed
+    std::array<uint32_t, xbox::X_D3DTS_STAGECOUNT> ForceDirtyStates;
+    std::array<std::array<uint32_t, xbox::X_D3DTS_STAGESIZE>, xbox::X_D3DTS_STAGECOUNT> PreviousTextureStateValues;
+    // Last value passed to the host per (host stage, Cxbx state), to skip redundant host calls
+    // NOTE : 64bit so the upper bits can mark an entry as unknown
+    std::array<std::array<uint64_t, xbox::X_D3DTSS_LAST + 1>, xbox::X_D3DTS_STAGECOUNT> HostTextureStateValues;
+    bool PreviousPointSpritesEnabled = false;
+    unsigned HostStatesPerStage = 0;
+
+    // Counters showing the host calls saved by change tracking, averaged over STATISTICS_REPORT_FRAMES frames
+    static constexpr unsigned STATISTICS_REPORT_FRAMES = 60;
+    unsigned StatisticsFrames = 0;
+    unsigned HostStateCalls = 0;
+    unsigned HostStateCallsFullApply = 0;
 };
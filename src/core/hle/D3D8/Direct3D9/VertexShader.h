@@ -22,4 +22,11 @@ extern HRESULT EmuCompileShader
     ID3DBlob** ppHostShader
 );
 
+// Translates the shader straight into vs_3_0 bytecode, fails for shaders that must be compiled from HLSL
+extern HRESULT EmuEmitShaderBytecode
+(
+    IntermediateVertexShader* pIntermediateShader,
+    ID3DBlob** ppHostShader
+);
+
 #endif
@@ -0,0 +1,566 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+#include <cfloat>
+#include <cstring>
+#include <initializer_list>
+#include "VertexShaderBytecode.h"
+
+// D3D9 shader token encoding (see d3d9types.h), spelled out so this doesn't need the Direct3D headers
+#define D3DVS_VERSION_3_0_TOKEN  0xFFFE0300
+#define D3DVS_END_TOKEN          0x0000FFFF
+#define D3DVS_PARAMETER_TOKEN    0x80000000
+#define D3DVS_INSTLENGTH_SHIFT   24
+#define D3DVS_WRITEMASK_SHIFT    16
+#define D3DVS_WRITEMASK_ALL      0xF
+#define D3DVS_SWIZZLE_SHIFT      16
+#define D3DVS_SWIZZLE_MASK       (0xFF << D3DVS_SWIZZLE_SHIFT)
+#define D3DVS_NOSWIZZLE          0xE4 // .xyzw, two bits per component
+#define D3DVS_SRCMOD_NEG         (1 << 24)
+#define D3DVS_DSTMOD_SATURATE    (1 << 20)
+#define D3DVS_ADDRMODE_RELATIVE  (1 << 13)
+#define D3DVS_USAGEINDEX_SHIFT   16
+
+enum HostOpcode {
+	HOST_MOV  = 1,
+	HOST_ADD  = 2,
+	HOST_MAD  = 4,
+	HOST_MUL  = 5,
+	HOST_RCP  = 6,
+	HOST_RSQ  = 7,
+	HOST_DP3  = 8,
+	HOST_DP4  = 9,
+	HOST_MIN  = 10,
+	HOST_MAX  = 11,
+	HOST_SLT  = 12,
+	HOST_SGE  = 13,
+	HOST_EXP  = 14,
+	HOST_LOG  = 15,
+	HOST_LIT  = 16,
+	HOST_DST  = 17,
+	HOST_LRP  = 18,
+	HOST_FRC  = 19,
+	HOST_DCL  = 31,
+	HOST_MOVA = 46,
+	HOST_DEF  = 81
+};
+
+enum HostRegisterType {
+	HOST_REG_TEMP   = 0,
+	HOST_REG_INPUT  = 1,
+	HOST_REG_CONST  = 2,
+	HOST_REG_ADDR   = 3,
+	HOST_REG_OUTPUT = 6
+};
+
+enum HostUsage {
+	HOST_USAGE_POSITION = 0,
+	HOST_USAGE_PSIZE    = 4,
+	HOST_USAGE_TEXCOORD = 5,
+	HOST_USAGE_COLOR    = 10,
+	HOST_USAGE_FOG      = 11
+};
+
+// Host register layout, must match CxbxVertexShaderTemplate.hlsl (and the CXBX_D3DVS_* registers in XbD3D8Types.h)
+#define HOST_CONSTREG_CORRECTION             96 // X_D3DSCM_CORRECTION
+#define HOST_CONSTREG_XBOX_COUNT             192 // X_D3DVS_CONSTREG_COUNT
+#define HOST_CONSTREG_VREGDEFAULTS_BASE      192
+#define HOST_CONSTREG_VREGDEFAULTS_FLAG_BASE 208
+#define HOST_CONSTREG_VIEWPORT_SCALE         212
+#define HOST_CONSTREG_VIEWPORT_OFFSET        213
+#define HOST_CONSTREG_LITERAL_BASE           214 // Literals are defined in the registers nobody sets
+#define HOST_CONSTREG_COUNT                  256
+#define HOST_TEMPREG_OPOS                    12 // Xbox r12 and oPos are the same register
+#define HOST_TEMPREG_A0                      13 // Holds a0.x + HOST_CONSTREG_CORRECTION
+#define HOST_TEMPREG_SCRATCH                 14
+#define HOST_TEMPREG_SCRATCH2                15
+#define HOST_TEMPREG_V_BASE                  16 // v0..v15, with their defaults applied
+#define HOST_MAX_INSTRUCTION_COUNT           512 // The minimum vs_3_0 guarantees
+
+// See x_floor in CxbxVertexShaderTemplate.hlsl
+#define BIAS 0.001f
+
+// Host output registers, indexed with VSH_OREG_NAME (-1 for those that don't exist)
+static const int HostOutputRegister[/*VSH_OREG_NAME*/] = { 0, -1, -1, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, -1, -1, -1 };
+
+// Host output register declarations, like the VS_OUTPUT struct of the HLSL template
+static const struct {
+	HostUsage Usage;
+	unsigned UsageIndex;
+	bool bSaturate; // Colors are saturated on output
+	bool bScalar; // Only x is output
+} HostOutputs[] = {
+	{ HOST_USAGE_POSITION, 0, false, false }, // oPos
+	{ HOST_USAGE_COLOR,    0, true,  false }, // oD0
+	{ HOST_USAGE_COLOR,    1, true,  false }, // oD1
+	{ HOST_USAGE_FOG,      0, false, true  }, // oFog
+	{ HOST_USAGE_PSIZE,    0, false, true  }, // oPts
+	{ HOST_USAGE_TEXCOORD, 4, true,  false }, // oB0
+	{ HOST_USAGE_TEXCOORD, 5, true,  false }, // oB1
+	{ HOST_USAGE_TEXCOORD, 0, false, false }, // oT0
+	{ HOST_USAGE_TEXCOORD, 1, false, false }, // oT1
+	{ HOST_USAGE_TEXCOORD, 2, false, false }, // oT2
+	{ HOST_USAGE_TEXCOORD, 3, false, false }, // oT3
+};
+
+struct HostParameter {
+	uint32_t Token;
+	bool bRelative; // Indexed with a0.x
+};
+
+static inline uint32_t HostRegister(HostRegisterType Type, unsigned Number)
+{
+	return D3DVS_PARAMETER_TOKEN | ((Type << 28) & 0x70000000) | ((Type << 8) & 0x00001800) | (Number & 0x7FF);
+}
+
+static inline uint32_t HostDestination(HostRegisterType Type, unsigned Number, unsigned WriteMask = D3DVS_WRITEMASK_ALL, bool bSaturate = false)
+{
+	return HostRegister(Type, Number) | (WriteMask << D3DVS_WRITEMASK_SHIFT) | (bSaturate ? D3DVS_DSTMOD_SATURATE : 0);
+}
+
+static inline HostParameter HostSource(HostRegisterType Type, unsigned Number, unsigned Swizzle = D3DVS_NOSWIZZLE, bool bNeg = false)
+{
+	return { HostRegister(Type, Number) | (Swizzle << D3DVS_SWIZZLE_SHIFT) | (bNeg ? D3DVS_SRCMOD_NEG : 0), false };
+}
+
+static inline unsigned HostSwizzle(unsigned X, unsigned Y, unsigned Z, unsigned W)
+{
+	return X | (Y << 2) | (Z << 4) | (W << 6);
+}
+
+// Replicates one component (after swizzling) across the whole source
+static inline HostParameter Scalar(HostParameter Src, unsigned Component)
+{
+	unsigned Selected = (Src.Token >> (D3DVS_SWIZZLE_SHIFT + (Component * 2))) & 3;
+	Src.Token = (Src.Token & ~D3DVS_SWIZZLE_MASK) | ((Selected * 0x55) << D3DVS_SWIZZLE_SHIFT);
+	return Src;
+}
+
+static inline HostParameter Neg(HostParameter Src)
+{
+	Src.Token ^= D3DVS_SRCMOD_NEG;
+	return Src;
+}
+
+// Converts an Xbox mask (x is the highest bit) to a host write mask (x is the lowest bit)
+static inline unsigned HostWriteMask(int8_t XboxMask)
+{
+	return ((XboxMask & MASK_X) ? 1 : 0) | ((XboxMask & MASK_Y) ? 2 : 0) | ((XboxMask & MASK_Z) ? 4 : 0) | ((XboxMask & MASK_W) ? 8 : 0);
+}
+
+class VshBytecodeEmitter
+{
+private:
+	std::vector<uint32_t> Code;
+	unsigned InstructionCount = 0;
+	std::vector<float> Literals = { 0.0f, 1.0f }; // So that c[HOST_CONSTREG_LITERAL_BASE].xxxy reads (0, 0, 0, 1)
+	bool bTempRead[HOST_TEMPREG_OPOS] = {};
+	bool bVRead[16] = {};
+	bool bUsesA0 = false;
+	bool bRelativeLoaded = false; // Whether the host address register still holds the index for RelativeOffset
+	int16_t RelativeOffset = 0;
+
+	void Emit(HostOpcode Opcode, uint32_t Dest, std::initializer_list<HostParameter> Sources)
+	{
+		uint32_t Length = 1;
+		for (auto& Src : Sources) {
+			Length += Src.bRelative ? 2 : 1;
+		}
+
+		Code.push_back(Opcode | (Length << D3DVS_INSTLENGTH_SHIFT));
+		Code.push_back(Dest);
+		for (auto& Src : Sources) {
+			if (Src.bRelative) {
+				Code.push_back(Src.Token | D3DVS_ADDRMODE_RELATIVE);
+				Code.push_back(HostRegister(HOST_REG_ADDR, 0) | (HostSwizzle(0, 0, 0, 0) << D3DVS_SWIZZLE_SHIFT)); // a0.x
+			} else {
+				Code.push_back(Src.Token);
+			}
+		}
+
+		InstructionCount++;
+	}
+
+	HostParameter Literal(float Value)
+	{
+		unsigned Index = 0;
+		while (Index < Literals.size() && std::memcmp(&Literals[Index], &Value, sizeof(float)) != 0) {
+			Index++;
+		}
+
+		if (Index == Literals.size()) {
+			Literals.push_back(Value);
+		}
+
+		return HostSource(HOST_REG_CONST, HOST_CONSTREG_LITERAL_BASE + (Index / 4), (Index % 4) * 0x55);
+	}
+
+	HostParameter ZeroOne()
+	{
+		return HostSource(HOST_REG_CONST, HOST_CONSTREG_LITERAL_BASE, HostSwizzle(0, 0, 0, 1));
+	}
+
+	bool Parameter(const VSH_IMD_PARAMETER& Param, bool bIndexesWithA0_X, HostParameter& Src)
+	{
+		unsigned Swizzle = HostSwizzle(Param.Swizzle[0], Param.Swizzle[1], Param.Swizzle[2], Param.Swizzle[3]);
+
+		switch (Param.ParameterType) {
+		case PARAM_R:
+			if (Param.Address < 0 || Param.Address > HOST_TEMPREG_OPOS) {
+				return false;
+			}
+
+			if (Param.Address < HOST_TEMPREG_OPOS) {
+				bTempRead[Param.Address] = true;
+			}
+
+			Src = HostSource(HOST_REG_TEMP, Param.Address, Swizzle, Param.Neg);
+			return true;
+		case PARAM_V:
+			if (Param.Address < 0 || Param.Address >= 16) {
+				return false;
+			}
+
+			bVRead[Param.Address] = true;
+			Src = HostSource(HOST_REG_TEMP, HOST_TEMPREG_V_BASE + Param.Address, Swizzle, Param.Neg);
+			return true;
+		case PARAM_C:
+			if (bIndexesWithA0_X) {
+				// The index is calculated into the host address register beforehand (see RelativeIndex)
+				Src = HostSource(HOST_REG_CONST, 0, Swizzle, Param.Neg);
+				Src.bRelative = true;
+				return true;
+			}
+
+			if (Param.Address + HOST_CONSTREG_CORRECTION < 0 || Param.Address + HOST_CONSTREG_CORRECTION >= HOST_CONSTREG_XBOX_COUNT) {
+				// Out-of-range constants read as zero, like c() in the HLSL template
+				Src = Param.Neg ? Neg(Literal(0.0f)) : Literal(0.0f);
+				return true;
+			}
+
+			Src = HostSource(HOST_REG_CONST, Param.Address + HOST_CONSTREG_CORRECTION, Swizzle, Param.Neg);
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	// Loads the host address register for c[a0.x + Offset] reads, mirroring c() in the HLSL template :
+	// indices past the Xbox constants become -1, so (like negative indices) they read as zero
+	void RelativeIndex(int16_t Offset)
+	{
+		if (bRelativeLoaded && Offset == RelativeOffset) {
+			return;
+		}
+
+		HostParameter Index = HostSource(HOST_REG_TEMP, HOST_TEMPREG_SCRATCH, HostSwizzle(0, 0, 0, 0));
+		HostParameter OutOfRange = HostSource(HOST_REG_TEMP, HOST_TEMPREG_SCRATCH, HostSwizzle(1, 1, 1, 1));
+		HostParameter MinusOneMinusIndex = HostSource(HOST_REG_TEMP, HOST_TEMPREG_SCRATCH, HostSwizzle(2, 2, 2, 2));
+
+		bUsesA0 = true;
+		Emit(HOST_ADD, HostDestination(HOST_REG_TEMP, HOST_TEMPREG_SCRATCH, 1), { HostSource(HOST_REG_TEMP, HOST_TEMPREG_A0, HostSwizzle(0, 0, 0, 0)), Literal((float)Offset) });
+		Emit(HOST_SGE, HostDestination(HOST_REG_TEMP, HOST_TEMPREG_SCRATCH, 2), { Index, Literal((float)HOST_CONSTREG_XBOX_COUNT) });
+		Emit(HOST_ADD, HostDestination(HOST_REG_TEMP, HOST_TEMPREG_SCRATCH, 4), { Neg(Index), Literal(-1.0f) });
+		Emit(HOST_MAD, HostDestination(HOST_REG_TEMP, HOST_TEMPREG_SCRATCH, 1), { OutOfRange, MinusOneMinusIndex, Index });
+		Emit(HOST_MOVA, HostDestination(HOST_REG_ADDR, 0, 1), { Index });
+		bRelativeLoaded = true;
+		RelativeOffset = Offset;
+	}
+
+	// Emits floor(Src + BIAS) into Scratch.x, like x_floor in the HLSL template
+	void Floor(HostParameter Src)
+	{
+		HostParameter Biased = HostSource(HOST_REG_TEMP, HOST_TEMPREG_SCRATCH, HostSwizzle(0, 0, 0, 0));
+		HostParameter Fraction = HostSource(HOST_REG_TEMP, HOST_TEMPREG_SCRATCH, HostSwizzle(1, 1, 1, 1));
+
+		Emit(HOST_ADD, HostDestination(HOST_REG_TEMP, HOST_TEMPREG_SCRATCH, 1), { Src, Literal(BIAS) });
+		Emit(HOST_FRC, HostDestination(HOST_REG_TEMP, HOST_TEMPREG_SCRATCH, 2), { Biased });
+		Emit(HOST_ADD, HostDestination(HOST_REG_TEMP, HOST_TEMPREG_SCRATCH, 1), { Biased, Neg(Fraction) });
+	}
+
+	bool Destination(const VSH_IMD_OUTPUT& Output, uint32_t& Dest)
+	{
+		unsigned WriteMask = HostWriteMask(Output.Mask);
+
+		switch (Output.Type) {
+		case IMD_OUTPUT_R:
+			if (Output.Address < 0 || Output.Address > HOST_TEMPREG_OPOS) {
+				return false;
+			}
+
+			Dest = HostDestination(HOST_REG_TEMP, Output.Address, WriteMask);
+			return true;
+		case IMD_OUTPUT_O: {
+			if (Output.Address < 0 || Output.Address >= OREG_A0X || HostOutputRegister[Output.Address] < 0) {
+				return false;
+			}
+
+			if (Output.Address == OREG_OPOS) {
+				Dest = HostDestination(HOST_REG_TEMP, HOST_TEMPREG_OPOS, WriteMask);
+				return true;
+			}
+
+			int Register = HostOutputRegister[Output.Address];
+			if (HostOutputs[Register].bScalar) {
+				// Only x is output, writes to the other components have no effect
+				WriteMask &= 1;
+			}
+
+			Dest = HostDestination(HOST_REG_OUTPUT, Register, WriteMask, HostOutputs[Register].bSaturate);
+			return true;
+		}
+		default:
+			// Writes to constants can't be expressed in host bytecode
+			return false;
+		}
+	}
+
+public:
+	bool Instruction(const VSH_INTERMEDIATE_FORMAT& Intermediate)
+	{
+		HostParameter Src[3];
+		for (unsigned i = 0; i < Intermediate.ParamCount; i++) {
+			if (!Parameter(Intermediate.Parameters[i], Intermediate.IndexesWithA0_X, Src[i])) {
+				return false;
+			}
+		}
+
+		if (Intermediate.MAC == MAC_ARL) {
+			if (Intermediate.Output.Type != IMD_OUTPUT_A0X || Intermediate.ParamCount < 1) {
+				return false;
+			}
+		} else if (Intermediate.Output.Type == IMD_OUTPUT_A0X) {
+			return false;
+		}
+
+		uint32_t Dest = 0;
+		if (Intermediate.MAC != MAC_ARL) {
+			if (!Destination(Intermediate.Output, Dest)) {
+				return false;
+			}
+
+			if (((Dest >> D3DVS_WRITEMASK_SHIFT) & D3DVS_WRITEMASK_ALL) == 0) {
+				return true; // Nothing observable is written
+			}
+		}
+
+		if (Intermediate.IndexesWithA0_X) {
+			for (unsigned i = 0; i < Intermediate.ParamCount; i++) {
+				if (Intermediate.Parameters[i].ParameterType == PARAM_C) {
+					// All constant parameters of an Xbox instruction share a single address
+					RelativeIndex(Intermediate.Parameters[i].Address);
+					break;
+				}
+			}
+		}
+
+		HostParameter Scratch = HostSource(HOST_REG_TEMP, HOST_TEMPREG_SCRATCH);
+		HostParameter Scratch2 = HostSource(HOST_REG_TEMP, HOST_TEMPREG_SCRATCH2);
+		auto ScratchDest = [](unsigned Component) { return HostDestination(HOST_REG_TEMP, HOST_TEMPREG_SCRATCH, 1 << Component); };
+		auto Scratch2Dest = [](unsigned Component) { return HostDestination(HOST_REG_TEMP, HOST_TEMPREG_SCRATCH2, 1 << Component); };
+
+		switch (Intermediate.MAC) {
+		case MAC_NOP:
+			break;
+		case MAC_MOV: Emit(HOST_MOV, Dest, { Src[0] }); return true;
+		case MAC_MUL: Emit(HOST_MUL, Dest, { Src[0], Src[1] }); return true;
+		case MAC_ADD: Emit(HOST_ADD, Dest, { Src[0], Src[1] }); return true;
+		case MAC_MAD: Emit(HOST_MAD, Dest, { Src[0], Src[1], Src[2] }); return true;
+		case MAC_DP3: Emit(HOST_DP3, Dest, { Src[0], Src[1] }); return true;
+		case MAC_DPH:
+			// dot(src0.xyz, src1.xyz) + src1.w
+			Emit(HOST_DP3, ScratchDest(0), { Src[0], Src[1] });
+			Emit(HOST_ADD, Dest, { Scalar(Scratch, 0), Scalar(Src[1], 3) });
+			return true;
+		case MAC_DP4: Emit(HOST_DP4, Dest, { Src[0], Src[1] }); return true;
+		case MAC_DST: Emit(HOST_DST, Dest, { Src[0], Src[1] }); return true;
+		case MAC_MIN: Emit(HOST_MIN, Dest, { Src[0], Src[1] }); return true;
+		case MAC_MAX: Emit(HOST_MAX, Dest, { Src[0], Src[1] }); return true;
+		case MAC_SLT: Emit(HOST_SLT, Dest, { Src[0], Src[1] }); return true;
+		case MAC_SGE: Emit(HOST_SGE, Dest, { Src[0], Src[1] }); return true;
+		case MAC_ARL:
+			// a0.x = x_floor(src0.x), kept as a float with the constant index correction applied
+			Floor(Scalar(Src[0], 0));
+			Emit(HOST_ADD, HostDestination(HOST_REG_TEMP, HOST_TEMPREG_A0, 1), { Scalar(Scratch, 0), Literal((float)HOST_CONSTREG_CORRECTION) });
+			bUsesA0 = true;
+			bRelativeLoaded = false;
+			return true;
+		default:
+			return false;
+		}
+
+		switch (Intermediate.ILU) {
+		case ILU_MOV: Emit(HOST_MOV, Dest, { Src[0] }); return true;
+		case ILU_RCP: Emit(HOST_RCP, Dest, { Scalar(Src[0], 0) }); return true;
+		case ILU_RCC:
+			// 1 / src, with its magnitude clamped to [5.42101e-020, 1.84467e+019], keeping the sign
+			Emit(HOST_RCP, ScratchDest(0), { Scalar(Src[0], 0) });
+			Emit(HOST_MAX, ScratchDest(1), { Scalar(Scratch, 0), Neg(Scalar(Scratch, 0)) });
+			Emit(HOST_MAX, ScratchDest(1), { Scalar(Scratch, 1), Literal(5.42101e-020f) });
+			Emit(HOST_MIN, ScratchDest(1), { Scalar(Scratch, 1), Literal(1.84467e+019f) });
+			Emit(HOST_SGE, ScratchDest(2), { Scalar(Scratch, 0), Literal(0.0f) });
+			Emit(HOST_MAD, ScratchDest(2), { Scalar(Scratch, 2), Literal(2.0f), Literal(-1.0f) });
+			Emit(HOST_MUL, Dest, { Scalar(Scratch, 1), Scalar(Scratch, 2) });
+			return true;
+		case ILU_RSQ: Emit(HOST_RSQ, Dest, { Scalar(Src[0], 0) }); return true; // rsq already works on abs(src)
+		case ILU_EXP:
+			// (exp2(x_floor(src)), src - x_floor(src), exp2(src), 1)
+			Floor(Scalar(Src[0], 0));
+			Emit(HOST_EXP, Scratch2Dest(0), { Scalar(Scratch, 0) });
+			Emit(HOST_ADD, Scratch2Dest(1), { Scalar(Src[0], 0), Neg(Scalar(Scratch, 0)) });
+			Emit(HOST_EXP, Scratch2Dest(2), { Scalar(Src[0], 0) });
+			Emit(HOST_MOV, Scratch2Dest(3), { Literal(1.0f) });
+			Emit(HOST_MOV, Dest, { Scratch2 });
+			return true;
+		case ILU_LOG:
+			// (exponent, mantissa, log2(src), 1), where frexp(src) gives a mantissa in [0.5, 1) (and zero for both when src is zero)
+			Emit(HOST_MAX, ScratchDest(0), { Scalar(Src[0], 0), Neg(Scalar(Src[0], 0)) });
+			Emit(HOST_SLT, ScratchDest(3), { Literal(0.0f), Scalar(Scratch, 0) });
+			Emit(HOST_MAX, ScratchDest(0), { Scalar(Scratch, 0), Literal(FLT_MIN) });
+			Emit(HOST_LOG, ScratchDest(0), { Scalar(Scratch, 0) });
+			Emit(HOST_FRC, ScratchDest(1), { Scalar(Scratch, 0) });
+			Emit(HOST_ADD, ScratchDest(1), { Scalar(Scratch, 0), Neg(Scalar(Scratch, 1)) });
+			Emit(HOST_ADD, ScratchDest(1), { Scalar(Scratch, 1), Literal(1.0f) });
+			Emit(HOST_MAD, Scratch2Dest(0), { Scalar(Scratch, 1), Scalar(Scratch, 3), Literal(0.0f) }); // Adding zero turns -0 into 0
+			Emit(HOST_EXP, ScratchDest(2), { Neg(Scalar(Scratch, 1)) });
+			Emit(HOST_MUL, ScratchDest(2), { Scalar(Scratch, 2), Scalar(Scratch, 3) });
+			Emit(HOST_MUL, Scratch2Dest(1), { Scalar(Src[0], 0), Scalar(Scratch, 2) });
+			Emit(HOST_LOG, Scratch2Dest(2), { Scalar(Src[0], 0) });
+			Emit(HOST_MOV, Scratch2Dest(3), { Literal(1.0f) });
+			Emit(HOST_MOV, Dest, { Scratch2 });
+			return true;
+		case ILU_LIT: Emit(HOST_LIT, Dest, { Src[0] }); return true; // Clamps the power to +/-(128 - 1/256) itself
+		default:
+			return false;
+		}
+	}
+
+	bool Finish(std::vector<uint32_t>& Tokens)
+	{
+		std::vector<uint32_t> Body = std::move(Code);
+		unsigned BodyInstructionCount = InstructionCount;
+		Code.clear();
+		InstructionCount = 0;
+
+		// Prologue : initialize registers like the HLSL template does
+		for (unsigned i = 0; i < HOST_TEMPREG_OPOS; i++) {
+			if (bTempRead[i]) {
+				Emit(HOST_MOV, HostDestination(HOST_REG_TEMP, i), { Literal(0.0f) });
+			}
+		}
+
+		Emit(HOST_MOV, HostDestination(HOST_REG_TEMP, HOST_TEMPREG_OPOS), { ZeroOne() });
+		for (unsigned i = 1; i < sizeof(HostOutputs) / sizeof(HostOutputs[0]); i++) {
+			if (HostOutputs[i].bScalar) {
+				Emit(HOST_MOV, HostDestination(HOST_REG_OUTPUT, i, 1), { Literal(0.0f) });
+			} else {
+				Emit(HOST_MOV, HostDestination(HOST_REG_OUTPUT, i), { ZeroOne() });
+			}
+		}
+
+		if (bUsesA0) {
+			Emit(HOST_MOV, HostDestination(HOST_REG_TEMP, HOST_TEMPREG_A0, 1), { Literal((float)HOST_CONSTREG_CORRECTION) });
+		}
+
+		// v = lerp(input, default, flag)
+		for (unsigned i = 0; i < 16; i++) {
+			if (bVRead[i]) {
+				Emit(HOST_LRP, HostDestination(HOST_REG_TEMP, HOST_TEMPREG_V_BASE + i), {
+					HostSource(HOST_REG_CONST, HOST_CONSTREG_VREGDEFAULTS_FLAG_BASE + (i / 4), (i % 4) * 0x55),
+					HostSource(HOST_REG_CONST, HOST_CONSTREG_VREGDEFAULTS_BASE + i),
+					HostSource(HOST_REG_INPUT, i) });
+			}
+		}
+
+		Code.insert(Code.end(), Body.begin(), Body.end());
+		InstructionCount += BodyInstructionCount;
+
+		// Epilogue : reverseScreenspaceTransform
+		HostParameter OPos = HostSource(HOST_REG_TEMP, HOST_TEMPREG_OPOS);
+		uint32_t OPosXYZ = HostDestination(HOST_REG_TEMP, HOST_TEMPREG_OPOS, 7);
+		Emit(HOST_ADD, OPosXYZ, { OPos, Neg(HostSource(HOST_REG_CONST, HOST_CONSTREG_VIEWPORT_OFFSET)) });
+		Emit(HOST_MUL, OPosXYZ, { OPos, Scalar(OPos, 3) });
+		for (unsigned i = 0; i < 3; i++) {
+			Emit(HOST_RCP, HostDestination(HOST_REG_TEMP, HOST_TEMPREG_SCRATCH, 1 << i), { HostSource(HOST_REG_CONST, HOST_CONSTREG_VIEWPORT_SCALE, i * 0x55) });
+		}
+		Emit(HOST_MUL, HostDestination(HOST_REG_OUTPUT, 0, 7), { OPos, HostSource(HOST_REG_TEMP, HOST_TEMPREG_SCRATCH) });
+		Emit(HOST_MOV, HostDestination(HOST_REG_OUTPUT, 0, 8), { OPos });
+
+		unsigned LiteralRegisterCount = (unsigned)(Literals.size() + 3) / 4;
+		if (InstructionCount > HOST_MAX_INSTRUCTION_COUNT || HOST_CONSTREG_LITERAL_BASE + LiteralRegisterCount > HOST_CONSTREG_COUNT) {
+			return false;
+		}
+
+		Tokens.clear();
+		Tokens.push_back(D3DVS_VERSION_3_0_TOKEN);
+
+		// Declarations
+		for (unsigned i = 0; i < 16; i++) {
+			if (bVRead[i]) {
+				Tokens.push_back(HOST_DCL | (2 << D3DVS_INSTLENGTH_SHIFT));
+				Tokens.push_back(D3DVS_PARAMETER_TOKEN | HOST_USAGE_TEXCOORD | (i << D3DVS_USAGEINDEX_SHIFT));
+				Tokens.push_back(HostDestination(HOST_REG_INPUT, i));
+			}
+		}
+
+		for (unsigned i = 0; i < sizeof(HostOutputs) / sizeof(HostOutputs[0]); i++) {
+			Tokens.push_back(HOST_DCL | (2 << D3DVS_INSTLENGTH_SHIFT));
+			Tokens.push_back(D3DVS_PARAMETER_TOKEN | HostOutputs[i].Usage | (HostOutputs[i].UsageIndex << D3DVS_USAGEINDEX_SHIFT));
+			Tokens.push_back(HostDestination(HOST_REG_OUTPUT, i, HostOutputs[i].bScalar ? 1 : D3DVS_WRITEMASK_ALL));
+		}
+
+		Literals.resize(LiteralRegisterCount * 4, 0.0f);
+		for (unsigned i = 0; i < LiteralRegisterCount; i++) {
+			Tokens.push_back(HOST_DEF | (5 << D3DVS_INSTLENGTH_SHIFT));
+			Tokens.push_back(HostDestination(HOST_REG_CONST, HOST_CONSTREG_LITERAL_BASE + i));
+			for (unsigned c = 0; c < 4; c++) {
+				uint32_t Bits;
+				std::memcpy(&Bits, &Literals[(i * 4) + c], sizeof(Bits));
+				Tokens.push_back(Bits);
+			}
+		}
+
+		Tokens.insert(Tokens.end(), Code.begin(), Code.end());
+		Tokens.push_back(D3DVS_END_TOKEN);
+		return true;
+	}
+};
+
+bool VshEmitBytecode
+(
+	const std::vector<VSH_INTERMEDIATE_FORMAT>& Instructions,
+	std::vector<uint32_t>& Tokens
+)
+{
+	VshBytecodeEmitter Emitter;
+
+	for (auto& Intermediate : Instructions) {
+		if (!Emitter.Instruction(Intermediate)) {
+			return false;
+		}
+	}
+
+	return Emitter.Finish(Tokens);
+}
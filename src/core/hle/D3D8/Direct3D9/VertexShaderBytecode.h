@@ -0,0 +1,17 @@
+#ifndef DIRECT3D9VERTEXSHADERBYTECODE_H
+#define DIRECT3D9VERTEXSHADERBYTECODE_H
+
+#include <vector>
+
+#include "core/hle/D3D8/XbVertexShaderIntermediate.h"
+
+// Translates intermediate Xbox vertex shader instructions straight into host vs_3_0 token bytecode,
+// following the semantics of CxbxVertexShaderTemplate.hlsl (which stays the reference implementation).
+// Returns false for shaders this can't express (like those writing to constants), those need the HLSL path.
+extern bool VshEmitBytecode
+(
+	const std::vector<VSH_INTERMEDIATE_FORMAT>& Instructions,
+	std::vector<uint32_t>& Tokens
+);
+
+#endif
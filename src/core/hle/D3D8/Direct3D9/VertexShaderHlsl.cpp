@@ -0,0 +1,199 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+#include <cassert>
+#include "VertexShaderHlsl.h"
+
+#define X_D3DSCM_CORRECTION 96 // Same as in XbD3D8Types.h
+
+static void OutputHlsl(std::stringstream& hlsl, const VSH_IMD_OUTPUT& dest)
+{
+	static const char* OReg_Name[/*VSH_OREG_NAME*/] = {
+		"oPos",
+		"???",
+		"???",
+		"oD0",
+		"oD1",
+		"oFog",
+		"oPts",
+		"oB0",
+		"oB1",
+		"oT0",
+		"oT1",
+		"oT2",
+		"oT3",
+		"???",
+		"???",
+		"a0.x"
+	};
+
+	switch (dest.Type) {
+	case IMD_OUTPUT_C:
+		// Access the HLSL capital C[] constants array, with the index bias applied :
+		// TODO : Avoid out-of-bound writes (perhaps writing to a reserved index?)
+		hlsl << "C[" << dest.Address + X_D3DSCM_CORRECTION << "]";
+		break;
+	case IMD_OUTPUT_R:
+		hlsl << "r" << dest.Address;
+		break;
+	case IMD_OUTPUT_O:
+		assert(dest.Address < OREG_A0X);
+		hlsl << OReg_Name[dest.Address];
+		break;
+	case IMD_OUTPUT_A0X:
+		hlsl << "a0";
+		break;
+	default:
+		assert(false);
+		break;
+	}
+
+	// Write the mask as a separate argument to the opcode defines
+	// (No space, so that "dest,mask, ..." looks close to "dest.mask, ...")
+	hlsl << ",";
+	if (dest.Mask & MASK_X) hlsl << "x";
+	if (dest.Mask & MASK_Y) hlsl << "y";
+	if (dest.Mask & MASK_Z) hlsl << "z";
+	if (dest.Mask & MASK_W) hlsl << "w";
+}
+
+static void ParameterHlsl(std::stringstream& hlsl, const VSH_IMD_PARAMETER& param, bool IndexesWithA0_X)
+{
+	static const char* RegisterName[/*VSH_PARAMETER_TYPE*/] = {
+		"?", // PARAM_UNKNOWN = 0,
+		"r", // PARAM_R,          // Temporary (scRatch) registers
+		"v", // PARAM_V,          // Vertex registers
+		"c", // PARAM_C,          // Constant registers, set by SetVertexShaderConstant
+		"oPos" // PARAM_O // = 0??
+	};
+
+	if (param.Neg) {
+		hlsl << "-";
+	}
+
+	if (param.ParameterType == PARAM_C) {
+		// Access constant registers through our HLSL c() function,
+		// which allows dumping negative indices (like Xbox shaders),
+		// and which returns zero when out-of-bounds indices are passed in:
+		if (IndexesWithA0_X) {
+			if (param.Address == 0) {
+				hlsl << "c(a0.x)"; // Hide the offset if it's 0
+			}
+			else if (param.Address < 0) {
+				hlsl << "c(a0.x" << param.Address << ")"; // minus is part of the offset
+			}
+			else {
+				hlsl << "c(a0.x+" << param.Address << ")"; // show addition character
+			}
+		}
+		else {
+			hlsl << "c(" << param.Address << ")";
+		}
+	}
+	else {
+		hlsl << RegisterName[param.ParameterType] << param.Address;
+	}
+
+	// Write the swizzle if we need to
+	// Only bother printing the swizzle if it is not the default .xyzw
+	if (!(param.Swizzle[0] == SWIZZLE_X &&
+		param.Swizzle[1] == SWIZZLE_Y &&
+		param.Swizzle[2] == SWIZZLE_Z &&
+		param.Swizzle[3] == SWIZZLE_W)) {
+		// We'll try to simplify swizzles if we can
+		// If all swizzles are the same, we only need to write one out
+		unsigned swizzles = 1;
+
+		// Otherwise, we need to use the full swizzle
+		if (param.Swizzle[0] != param.Swizzle[1] ||
+			param.Swizzle[0] != param.Swizzle[2] ||
+			param.Swizzle[0] != param.Swizzle[3]) {
+			// Note, we can't remove trailing repeats, like in VS asm,
+			// as it may change the type from float4 to float3, float2 or float1!
+			swizzles = 4;
+		}
+
+		hlsl << ".";
+		for (unsigned i = 0; i < swizzles; i++) {
+			hlsl << "xyzw"[param.Swizzle[i]];
+		}
+	}
+}
+
+void BuildShader(const std::vector<VSH_INTERMEDIATE_FORMAT>& Instructions, std::stringstream& hlsl)
+{
+	// HLSL strings for all MAC opcodes, indexed with VSH_MAC
+	static std::string VSH_MAC_HLSL[/*VSH_MAC*/] = {
+		/*MAC_NOP:*/"",
+		/*MAC_MOV:*/"x_mov",
+		/*MAC_MUL:*/"x_mul",
+		/*MAC_ADD:*/"x_add",
+		/*MAC_MAD:*/"x_mad",
+		/*MAC_DP3:*/"x_dp3",
+		/*MAC_DPH:*/"x_dph",
+		/*MAC_DP4:*/"x_dp4",
+		/*MAC_DST:*/"x_dst",
+		/*MAC_MIN:*/"x_min",
+		/*MAC_MAX:*/"x_max",
+		/*MAC_SLT:*/"x_slt",
+		/*MAC_SGE:*/"x_sge",
+		/*MAC_ARL:*/"x_arl",
+					"",
+					"" // VSH_MAC 2 final values of the 4 bits are undefined/unknown  TODO : Investigate their effect (if any) and emulate that as well
+	};
+
+	// HLSL strings for all ILU opcodes, indexed with VSH_ILU
+	static std::string VSH_ILU_HLSL[/*VSH_ILU*/] = {
+		/*ILU_NOP:*/"",
+		/*ILU_MOV:*/"x_mov",
+		/*ILU_RCP:*/"x_rcp",
+		/*ILU_RCC:*/"x_rcc",
+		/*ILU_RSQ:*/"x_rsq",
+		/*ILU_EXP:*/"x_expp",
+		/*ILU_LOG:*/"x_logp",
+		/*ILU_LIT:*/"x_lit" // = 7 - all values of the 3 bits are used
+	};
+
+	for (size_t i = 0; i < Instructions.size(); i++) {
+		const VSH_INTERMEDIATE_FORMAT& IntermediateInstruction = Instructions[i];
+
+		std::string str;
+		if (IntermediateInstruction.MAC > MAC_NOP) {
+			str = VSH_MAC_HLSL[IntermediateInstruction.MAC];
+		}
+		else {
+			str = VSH_ILU_HLSL[IntermediateInstruction.ILU];
+		}
+
+		hlsl << "\n  " << str << "("; // opcode
+		OutputHlsl(hlsl, IntermediateInstruction.Output);
+		for (unsigned i = 0; i < IntermediateInstruction.ParamCount; i++) {
+			hlsl << ", ";
+			ParameterHlsl(hlsl, IntermediateInstruction.Parameters[i], IntermediateInstruction.IndexesWithA0_X);
+		}
+
+		hlsl << ");";
+	}
+}
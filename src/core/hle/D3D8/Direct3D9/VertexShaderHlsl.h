@@ -0,0 +1,17 @@
+#ifndef DIRECT3D9VERTEXSHADERHLSL_H
+#define DIRECT3D9VERTEXSHADERHLSL_H
+
+#include <sstream>
+#include <vector>
+
+#include "core/hle/D3D8/XbVertexShaderIntermediate.h"
+
+// Writes the HLSL statements of the intermediate Xbox vertex shader instructions, which go in between
+// the header and footer of CxbxVertexShaderTemplate.hlsl
+extern void BuildShader
+(
+	const std::vector<VSH_INTERMEDIATE_FORMAT>& Instructions,
+	std::stringstream& hlsl
+);
+
+#endif
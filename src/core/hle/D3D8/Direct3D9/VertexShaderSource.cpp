@@ -70,7 +70,16 @@ ShaderKey VertexShaderSource::CreateShader(const DWORD* pXboxFunction, DWORD *pX
 
 	auto shaderType = EmuGetShaderInfo(&intermediateShader);
 
-	if (shaderType == ShaderType::Compilable)
+	ID3DBlob* pEmittedShader = nullptr;
+	if (shaderType == ShaderType::Compilable && SUCCEEDED(EmuEmitShaderBytecode(&intermediateShader, &pEmittedShader)))
+	{
+		// Emitting the bytecode directly is quick, so there's nothing to wait for
+		EmuLog(LOG_LEVEL::DEBUG, "Emitted vertex shader %llx size %d", key, *pXboxFunctionSize);
+		std::promise<ID3DBlob*> emitted;
+		emitted.set_value(pEmittedShader);
+		newShader.compileResult = emitted.get_future();
+	}
+	else if (shaderType == ShaderType::Compilable)
 	{
 		// Start compiling the shader in the background
 		// TODO proper threading / threadpool.
@@ -5,19 +5,20 @@
 #include <smmintrin.h> // SSE4.1
 //#include <nmmintrin.h> // SSE4.2
 //#include <immintrin.h> // AVX
-#include "common\util\CPUID.h"
+#include <climits>
+#include "common/util/CPUID.h"
 #include "WalkIndexBuffer.h"
 
 // Walk an index buffer to find the minimum and maximum indices
 
 // Default implementation
-void WalkIndexBuffer_NoSIMD(INDEX16 & LowIndex, INDEX16 & HighIndex, INDEX16 * pIndexData, DWORD dwIndexCount)
+void WalkIndexBuffer_NoSIMD(uint16_t & LowIndex, uint16_t & HighIndex, uint16_t * pIndexData, uint32_t dwIndexCount)
 {
 	// Determine highest and lowest index in use 
 	LowIndex = pIndexData[0];
 	HighIndex = LowIndex;
 	for (unsigned int i = 1; i < dwIndexCount; i++) {
-		INDEX16 Index = pIndexData[i];
+		uint16_t Index = pIndexData[i];
 		if (LowIndex > Index)
 			LowIndex = Index;
 		if (HighIndex < Index)
@@ -26,11 +27,11 @@ void WalkIndexBuffer_NoSIMD(INDEX16 & LowIndex, INDEX16 & HighIndex, INDEX16 * p
 }
 
 //SSE 4.1 implementation
-void WalkIndexBuffer_SSE41(INDEX16 & LowIndex, INDEX16 & HighIndex, INDEX16 * pIndexData, DWORD dwIndexCount)
+void WalkIndexBuffer_SSE41(uint16_t & LowIndex, uint16_t & HighIndex, uint16_t * pIndexData, uint32_t dwIndexCount)
 {
 	// We can fit 8 ushorts into 128 bit SIMD registers
 	int iterations = dwIndexCount / 8;
-	DWORD remainder = dwIndexCount % 8;
+	uint32_t remainder = dwIndexCount % 8;
 
 	// Fallback to basic function if we can't even min / max 2 registers together
 	if (iterations < 2) {
@@ -58,11 +59,11 @@ void WalkIndexBuffer_SSE41(INDEX16 & LowIndex, INDEX16 & HighIndex, INDEX16 * pI
 	max = _mm_minpos_epu16(max);
 
 	// Get the min and max out
-	LowIndex = (INDEX16) _mm_cvtsi128_si32(min);
-	HighIndex = (INDEX16) USHRT_MAX - _mm_cvtsi128_si32(max); // invert back
+	LowIndex = (uint16_t) _mm_cvtsi128_si32(min);
+	HighIndex = (uint16_t) USHRT_MAX - _mm_cvtsi128_si32(max); // invert back
 
 	// Compare with the remaining values that didn't fit neatly into the SIMD registers
-	for (DWORD i = dwIndexCount - remainder; i < dwIndexCount; i++) {
+	for (uint32_t i = dwIndexCount - remainder; i < dwIndexCount; i++) {
 		if (pIndexData[i] < LowIndex)
 			LowIndex = pIndexData[i];
 		else if (pIndexData[i] > HighIndex)
@@ -74,14 +75,267 @@ void WalkIndexBuffer_SSE41(INDEX16 & LowIndex, INDEX16 & HighIndex, INDEX16 * pI
 // TODO AVX2, AVX512 implementations
 
 // Detect SSE support to select real implementation on first call
-void(*WalkIndexBuffer)(INDEX16 &, INDEX16 &, INDEX16 *, DWORD) =
-[](INDEX16 &LowIndex, INDEX16 &HighIndex, INDEX16 *pIndexData, DWORD dwIndexCount)
+void(*WalkIndexBuffer)(uint16_t &, uint16_t &, uint16_t *, uint32_t) =
+[](uint16_t &LowIndex, uint16_t &HighIndex, uint16_t *pIndexData, uint32_t dwIndexCount)
+{
+	IndexKernelsUseSIMD(true);
+
+	WalkIndexBuffer(LowIndex, HighIndex, pIndexData, dwIndexCount);
+};
+
+// The kernels below produce the index data for the host while they walk the Xbox index data,
+// so the lowest and highest index come for free instead of costing another pass.
+
+// Quad ABCD becomes triangles ABC+CDA (clockwise) or ADC+CBA (counter-clockwise)
+static const unsigned QuadToTriangleCW[6] = { 0, 1, 2, 2, 3, 0 };
+static const unsigned QuadToTriangleCCW[6] = { 0, 3, 2, 2, 1, 0 };
+
+static inline void MinMaxIndex(uint16_t &LowIndex, uint16_t &HighIndex, uint16_t Index)
+{
+	if (LowIndex > Index)
+		LowIndex = Index;
+	if (HighIndex < Index)
+		HighIndex = Index;
+}
+
+// Default implementations
+void WalkAndCopyIndexBuffer_NoSIMD(uint16_t &LowIndex, uint16_t &HighIndex, uint16_t *pOutput, uint16_t *pIndexData, uint32_t dwIndexCount)
+{
+	LowIndex = pIndexData[0];
+	HighIndex = LowIndex;
+	for (uint32_t i = 0; i < dwIndexCount; i++) {
+		uint16_t Index = pIndexData[i];
+		MinMaxIndex(LowIndex, HighIndex, Index);
+		pOutput[i] = Index;
+	}
+}
+
+template<bool bClockWise>
+void WalkAndConvertQuadListIndices_NoSIMD(uint16_t &LowIndex, uint16_t &HighIndex, uint16_t *pOutput, uint16_t *pQuadIndexData, uint32_t dwQuadIndexCount)
+{
+	const unsigned *Order = bClockWise ? QuadToTriangleCW : QuadToTriangleCCW;
+
+	LowIndex = pQuadIndexData[0];
+	HighIndex = LowIndex;
+	uint32_t i = 0;
+	for (; i + 4 <= dwQuadIndexCount; i += 4) {
+		for (unsigned v = 0; v < 4; v++) {
+			MinMaxIndex(LowIndex, HighIndex, pQuadIndexData[i + v]);
+		}
+		for (unsigned v = 0; v < 6; v++) {
+			*pOutput++ = pQuadIndexData[i + Order[v]];
+		}
+	}
+
+	// Indices of an incomplete quad aren't drawn, but were always part of the walked range
+	for (; i < dwQuadIndexCount; i++) {
+		MinMaxIndex(LowIndex, HighIndex, pQuadIndexData[i]);
+	}
+}
+
+template<bool bClockWise>
+void GenerateQuadListIndices_NoSIMD(uint16_t *pOutput, uint32_t dwQuadIndexCount)
+{
+	const unsigned *Order = bClockWise ? QuadToTriangleCW : QuadToTriangleCCW;
+
+	for (uint32_t i = 0; i + 4 <= dwQuadIndexCount; i += 4) {
+		for (unsigned v = 0; v < 6; v++) {
+			*pOutput++ = (uint16_t)(i + Order[v]);
+		}
+	}
+}
+
+// Returns the pshufb mask that moves the indices of register Source (of 8 consecutive input indices)
+// to their place in output register Output (of 8 consecutive triangle indices), zeroing the others
+static __m128i QuadToTriangleShuffleMask(const unsigned *Order, unsigned Output, unsigned Source)
+{
+	alignas(16) uint8_t Mask[16];
+	for (unsigned Lane = 0; Lane < 8; Lane++) {
+		unsigned TriangleIndex = (Output * 8) + Lane;
+		unsigned QuadIndex = ((TriangleIndex / 6) * 4) + Order[TriangleIndex % 6];
+		if (QuadIndex / 8 == Source) {
+			Mask[Lane * 2 + 0] = (uint8_t)((QuadIndex % 8) * 2 + 0);
+			Mask[Lane * 2 + 1] = (uint8_t)((QuadIndex % 8) * 2 + 1);
+		} else {
+			Mask[Lane * 2 + 0] = 0x80;
+			Mask[Lane * 2 + 1] = 0x80;
+		}
+	}
+
+	return _mm_load_si128((__m128i*)Mask);
+}
+
+static void HorizontalMinMax(uint16_t &LowIndex, uint16_t &HighIndex, __m128i min, __m128i max)
+{
+	min = _mm_minpos_epu16(min);
+	max = _mm_minpos_epu16(_mm_subs_epu16(_mm_set1_epi16((short)(USHRT_MAX)), max)); // invert, as there's no maxpos
+	LowIndex = (uint16_t)_mm_cvtsi128_si32(min);
+	HighIndex = (uint16_t)(USHRT_MAX - _mm_cvtsi128_si32(max)); // invert back
+}
+
+// SSE 4.1 implementations
+void WalkAndCopyIndexBuffer_SSE41(uint16_t &LowIndex, uint16_t &HighIndex, uint16_t *pOutput, uint16_t *pIndexData, uint32_t dwIndexCount)
+{
+	uint32_t iterations = dwIndexCount / 8;
+	if (iterations < 2) {
+		WalkAndCopyIndexBuffer_NoSIMD(LowIndex, HighIndex, pOutput, pIndexData, dwIndexCount);
+		return;
+	}
+
+	__m128i min = _mm_set1_epi16((short)(USHRT_MAX));
+	__m128i max = _mm_setzero_si128();
+	for (uint32_t i = 0; i < iterations; i++) {
+		__m128i indices = _mm_loadu_si128((__m128i*)pIndexData + i);
+		min = _mm_min_epu16(indices, min);
+		max = _mm_max_epu16(indices, max);
+		_mm_storeu_si128((__m128i*)pOutput + i, indices);
+	}
+
+	HorizontalMinMax(LowIndex, HighIndex, min, max);
+
+	for (uint32_t i = iterations * 8; i < dwIndexCount; i++) {
+		MinMaxIndex(LowIndex, HighIndex, pIndexData[i]);
+		pOutput[i] = pIndexData[i];
+	}
+}
+
+template<bool bClockWise>
+void WalkAndConvertQuadListIndices_SSE41(uint16_t &LowIndex, uint16_t &HighIndex, uint16_t *pOutput, uint16_t *pQuadIndexData, uint32_t dwQuadIndexCount)
+{
+	// Four quads (two registers of input) become 24 triangle indices (three registers of output)
+	uint32_t iterations = dwQuadIndexCount / 16;
+	if (iterations < 1) {
+		WalkAndConvertQuadListIndices_NoSIMD<bClockWise>(LowIndex, HighIndex, pOutput, pQuadIndexData, dwQuadIndexCount);
+		return;
+	}
+
+	const unsigned *Order = bClockWise ? QuadToTriangleCW : QuadToTriangleCCW;
+	const __m128i Output0First = QuadToTriangleShuffleMask(Order, 0, 0);
+	const __m128i Output1First = QuadToTriangleShuffleMask(Order, 1, 0);
+	const __m128i Output1Second = QuadToTriangleShuffleMask(Order, 1, 1);
+	const __m128i Output2Second = QuadToTriangleShuffleMask(Order, 2, 1);
+
+	__m128i min = _mm_set1_epi16((short)(USHRT_MAX));
+	__m128i max = _mm_setzero_si128();
+	__m128i *pInput = (__m128i*)pQuadIndexData;
+	__m128i *pOutputVector = (__m128i*)pOutput;
+	for (uint32_t i = 0; i < iterations; i++) {
+		__m128i First = _mm_loadu_si128(pInput++);
+		__m128i Second = _mm_loadu_si128(pInput++);
+		min = _mm_min_epu16(_mm_min_epu16(First, Second), min);
+		max = _mm_max_epu16(_mm_max_epu16(First, Second), max);
+
+		_mm_storeu_si128(pOutputVector++, _mm_shuffle_epi8(First, Output0First));
+		_mm_storeu_si128(pOutputVector++, _mm_or_si128(_mm_shuffle_epi8(First, Output1First), _mm_shuffle_epi8(Second, Output1Second)));
+		_mm_storeu_si128(pOutputVector++, _mm_shuffle_epi8(Second, Output2Second));
+	}
+
+	HorizontalMinMax(LowIndex, HighIndex, min, max);
+
+	// Convert the remaining quads, and walk any incomplete quad
+	uint32_t i = iterations * 16;
+	pOutput += iterations * 24;
+	for (; i + 4 <= dwQuadIndexCount; i += 4) {
+		for (unsigned v = 0; v < 4; v++) {
+			MinMaxIndex(LowIndex, HighIndex, pQuadIndexData[i + v]);
+		}
+		for (unsigned v = 0; v < 6; v++) {
+			*pOutput++ = pQuadIndexData[i + Order[v]];
+		}
+	}
+	for (; i < dwQuadIndexCount; i++) {
+		MinMaxIndex(LowIndex, HighIndex, pQuadIndexData[i]);
+	}
+}
+
+template<bool bClockWise>
+void GenerateQuadListIndices_SSE41(uint16_t *pOutput, uint32_t dwQuadIndexCount)
+{
+	// The triangle indices of quads 0-3, each next four quads are the same plus 16
+	const unsigned *Order = bClockWise ? QuadToTriangleCW : QuadToTriangleCCW;
+	alignas(16) uint16_t Pattern[24];
+	for (unsigned v = 0; v < 24; v++) {
+		Pattern[v] = (uint16_t)(((v / 6) * 4) + Order[v % 6]);
+	}
+
+	__m128i Output0 = _mm_load_si128((__m128i*)Pattern + 0);
+	__m128i Output1 = _mm_load_si128((__m128i*)Pattern + 1);
+	__m128i Output2 = _mm_load_si128((__m128i*)Pattern + 2);
+	const __m128i Step = _mm_set1_epi16(16);
+
+	uint32_t iterations = dwQuadIndexCount / 16;
+	__m128i *pOutputVector = (__m128i*)pOutput;
+	for (uint32_t i = 0; i < iterations; i++) {
+		_mm_storeu_si128(pOutputVector++, Output0);
+		_mm_storeu_si128(pOutputVector++, Output1);
+		_mm_storeu_si128(pOutputVector++, Output2);
+		Output0 = _mm_add_epi16(Output0, Step);
+		Output1 = _mm_add_epi16(Output1, Step);
+		Output2 = _mm_add_epi16(Output2, Step);
+	}
+
+	pOutput += iterations * 24;
+	for (uint32_t i = iterations * 16; i + 4 <= dwQuadIndexCount; i += 4) {
+		for (unsigned v = 0; v < 6; v++) {
+			*pOutput++ = (uint16_t)(i + Order[v]);
+		}
+	}
+}
+
+// Detect SSE support to select real implementations on first call
+void(*WalkAndCopyIndexBuffer)(uint16_t &, uint16_t &, uint16_t *, uint16_t *, uint32_t) =
+[](uint16_t &LowIndex, uint16_t &HighIndex, uint16_t *pOutput, uint16_t *pIndexData, uint32_t dwIndexCount)
+{
+	IndexKernelsUseSIMD(true);
+
+	WalkAndCopyIndexBuffer(LowIndex, HighIndex, pOutput, pIndexData, dwIndexCount);
+};
+
+static void(*WalkAndConvertQuadListIndicesCW)(uint16_t &, uint16_t &, uint16_t *, uint16_t *, uint32_t) = nullptr;
+static void(*WalkAndConvertQuadListIndicesCCW)(uint16_t &, uint16_t &, uint16_t *, uint16_t *, uint32_t) = nullptr;
+static void(*GenerateQuadListIndicesCW)(uint16_t *, uint32_t) = nullptr;
+static void(*GenerateQuadListIndicesCCW)(uint16_t *, uint32_t) = nullptr;
+
+void IndexKernelsUseSIMD(bool bEnable)
 {
 	SimdCaps supports;
-	if (supports.SSE41())
+	if (bEnable && supports.SSE41()) {
 		WalkIndexBuffer = WalkIndexBuffer_SSE41;
-	else
+		WalkAndCopyIndexBuffer = WalkAndCopyIndexBuffer_SSE41;
+		WalkAndConvertQuadListIndicesCW = WalkAndConvertQuadListIndices_SSE41<true>;
+		WalkAndConvertQuadListIndicesCCW = WalkAndConvertQuadListIndices_SSE41<false>;
+		GenerateQuadListIndicesCW = GenerateQuadListIndices_SSE41<true>;
+		GenerateQuadListIndicesCCW = GenerateQuadListIndices_SSE41<false>;
+	} else {
 		WalkIndexBuffer = WalkIndexBuffer_NoSIMD;
+		WalkAndCopyIndexBuffer = WalkAndCopyIndexBuffer_NoSIMD;
+		WalkAndConvertQuadListIndicesCW = WalkAndConvertQuadListIndices_NoSIMD<true>;
+		WalkAndConvertQuadListIndicesCCW = WalkAndConvertQuadListIndices_NoSIMD<false>;
+		GenerateQuadListIndicesCW = GenerateQuadListIndices_NoSIMD<true>;
+		GenerateQuadListIndicesCCW = GenerateQuadListIndices_NoSIMD<false>;
+	}
+}
 
-	WalkIndexBuffer(LowIndex, HighIndex, pIndexData, dwIndexCount);
-};
+void WalkAndConvertQuadListIndices(uint16_t &LowIndex, uint16_t &HighIndex, uint16_t *pOutput, uint16_t *pQuadIndexData, uint32_t dwQuadIndexCount, bool bClockWise)
+{
+	if (WalkAndConvertQuadListIndicesCW == nullptr) {
+		IndexKernelsUseSIMD(true);
+	}
+
+	if (bClockWise)
+		WalkAndConvertQuadListIndicesCW(LowIndex, HighIndex, pOutput, pQuadIndexData, dwQuadIndexCount);
+	else
+		WalkAndConvertQuadListIndicesCCW(LowIndex, HighIndex, pOutput, pQuadIndexData, dwQuadIndexCount);
+}
+
+void GenerateQuadListIndices(uint16_t *pOutput, uint32_t dwQuadIndexCount, bool bClockWise)
+{
+	if (GenerateQuadListIndicesCW == nullptr) {
+		IndexKernelsUseSIMD(true);
+	}
+
+	if (bClockWise)
+		GenerateQuadListIndicesCW(pOutput, dwQuadIndexCount);
+	else
+		GenerateQuadListIndicesCCW(pOutput, dwQuadIndexCount);
+}
@@ -1,14 +1,49 @@
 #ifndef WALKINDEXBUFFER_H
 #define WALKINDEXBUFFER_H
 
-#include "core\kernel\support\Emu.h"
+// Index kernels of the draw calls, kept free of emulator dependencies so that
+// cxbxr-indexbench can check the SIMD versions against the scalar ones
+#include <cstdint>
 
 extern void(*WalkIndexBuffer)
 (
-	INDEX16 &LowIndex,
-	INDEX16 &HighIndex,
-	INDEX16 *pIndexData,
-	DWORD dwIndexCount
+	uint16_t &LowIndex,
+	uint16_t &HighIndex,
+	uint16_t *pIndexData,
+	uint32_t dwIndexCount
 );
 
+// Copies dwIndexCount indices to pOutput, while determining the lowest and highest index
+extern void(*WalkAndCopyIndexBuffer)
+(
+	uint16_t &LowIndex,
+	uint16_t &HighIndex,
+	uint16_t *pOutput,
+	uint16_t *pIndexData,
+	uint32_t dwIndexCount
+);
+
+// Writes two triangles (6 indices) to pOutput per quad (4 indices) in pQuadIndexData,
+// while determining the lowest and highest index (incomplete quads included)
+void WalkAndConvertQuadListIndices
+(
+	uint16_t &LowIndex,
+	uint16_t &HighIndex,
+	uint16_t *pOutput,
+	uint16_t *pQuadIndexData,
+	uint32_t dwQuadIndexCount,
+	bool bClockWise
+);
+
+// Writes the triangle indices of a non-indexed quad list of dwQuadIndexCount vertices to pOutput
+void GenerateQuadListIndices
+(
+	uint16_t *pOutput,
+	uint32_t dwQuadIndexCount,
+	bool bClockWise
+);
+
+// Selects the SSE4.1 (default, when the host supports it) or the plain implementation of all the kernels above
+void IndexKernelsUseSIMD(bool bEnable);
+
 #endif
@@ -32,6 +32,7 @@
 #include "core\kernel\support\Emu.h"
 
 #include "XbConvert.h"
+#include "XbSwizzle.h"
 
 // About format color components:
 // A = alpha, byte : 0 = fully opaque, 255 = fully transparent
@@ -1236,106 +1237,12 @@ void EmuUnswizzleBox
 	CONST DWORD dwDstSlicePitch
 ) // Source : Dxbx
 {
-	DWORD dwMaskX = 0, dwMaskY = 0, dwMaskZ = 0;
-	for (unsigned int i=1, j=1; (i < dwWidth) || (i < dwHeight) || (i < dwDepth); i <<= 1) {
-		if (i < dwWidth) {
-			dwMaskX |= j;
-			j <<= 1;
-		}
-
-		if (i < dwHeight) {
-			dwMaskY |= j;
-			j <<= 1;
-		}
-
-		if (i < dwDepth) {
-			dwMaskZ |= j;
-			j <<= 1;
-		}
-	}
-
-	const DWORD dwStartX = 0;
-	const DWORD dwStartY = 0;
-	const DWORD dwStartZ = 0;
-
-	DWORD dwZ = dwStartZ;
-	switch (dwBytesPerPixel) {
-	case 1: {
-		const uint8_t *pSrc = (uint8_t *)pSrcBuff;
-		uint8_t *pDestSlice = (uint8_t *)pDstBuff;
-
-		for (unsigned int z = 0; z < dwDepth; z++) {
-			uint8_t *pDestRow = pDestSlice;
-			DWORD dwY = dwStartY;
-			for (unsigned int y = 0; y < dwHeight; y++) {
-				DWORD dwYZ = dwY | dwZ;
-				DWORD dwX = dwStartX;
-				for (unsigned int x = 0; x < dwWidth; x++) {
-					unsigned int delta = dwX | dwYZ;
-					pDestRow[x] = pSrc[delta]; // copy one pixel
-					dwX = (dwX - dwMaskX) & dwMaskX; // step to next pixel in source
-				}
-
-				pDestRow += dwDstRowPitch; // / 1; // = / dwBPP; // step to next line in destination
-				dwY = (dwY - dwMaskY) & dwMaskY; // step to next line in source
-			}
-
-			pDestSlice += dwDstSlicePitch; // / 1; // = / dwBPP; // step to next level in destination
-			dwZ = (dwZ - dwMaskZ) & dwMaskZ; // step to next level in source
-		}
-		break;
-	}
-	case 2: {
-		const uint16_t *pSrc = (uint16_t *)pSrcBuff;
-		uint16_t *pDestSlice = (uint16_t *)pDstBuff;
-
-		for (unsigned int z = 0; z < dwDepth; z++) {
-			uint16_t *pDestRow = pDestSlice;
-			DWORD dwY = dwStartY;
-			for (unsigned int y = 0; y < dwHeight; y++) {
-				DWORD dwYZ = dwY | dwZ;
-				DWORD dwX = dwStartX;
-				for (unsigned int x = 0; x < dwWidth; x++) {
-					unsigned int delta = dwX | dwYZ;
-					pDestRow[x] = pSrc[delta]; // copy one pixel
-					dwX = (dwX - dwMaskX) & dwMaskX; // step to next pixel in source
-				}
-
-				pDestRow += dwDstRowPitch / 2; // = dwBPP; // step to next line in destination
-				dwY = (dwY - dwMaskY) & dwMaskY; // step to next line in source
-			}
-
-			pDestSlice += dwDstSlicePitch / 2; // = dwBPP; // step to next level in destination
-			dwZ = (dwZ - dwMaskZ) & dwMaskZ; // step to next level in source
-		}
-		break;
-	}
-	case 4: {
-		const uint32_t *pSrc = (uint32_t *)pSrcBuff;
-		uint32_t *pDestSlice = (uint32_t *)pDstBuff;
-
-		for (unsigned int z = 0; z < dwDepth; z++) {
-			uint32_t *pDestRow = pDestSlice;
-			DWORD dwY = dwStartY;
-			for (unsigned int y = 0; y < dwHeight; y++) {
-				DWORD dwYZ = dwY | dwZ;
-				DWORD dwX = dwStartX;
-				for (unsigned int x = 0; x < dwWidth; x++) {
-					unsigned int delta = dwX | dwYZ;
-					pDestRow[x] = pSrc[delta]; // copy one pixel
-					dwX = (dwX - dwMaskX) & dwMaskX; // step to next pixel in source
-				}
-
-				pDestRow += dwDstRowPitch / 4; // = dwBPP; // step to next line in destination
-				dwY = (dwY - dwMaskY) & dwMaskY; // step to next line in source
-			}
-
-			pDestSlice += dwDstSlicePitch / 4; // = dwBPP; // step to next level in destination
-			dwZ = (dwZ - dwMaskZ) & dwMaskZ; // step to next level in source
-		}
-		break;
-	}
-	}
+	UnswizzleBox(
+		pSrcBuff, dwWidth, dwHeight, dwDepth,
+		0, 0, 0, dwWidth, dwHeight, dwDepth,
+		pDstBuff, dwDstRowPitch, dwDstSlicePitch,
+		dwBytesPerPixel
+	);
 } // EmuUnswizzleBox NOPATCH
 
 // Notes :
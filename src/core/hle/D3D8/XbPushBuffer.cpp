@@ -37,6 +37,8 @@
 #include "core\hle\D3D8\XbConvert.h"
 #include "devices/video/nv2a.h" // For g_NV2A, PGRAPHState
 #include "devices/video/nv2a_int.h" // For NV** defines
+#include "devices/video/nv2a_pushbuffer.h" // For nv2a_pushbuffer_run
+#include "devices/video/nv2a_pbcapture.h" // For nv2a_pbcapture_*
 #include "Logging.h"
 
 // TODO: Find somewhere to put this that doesn't conflict with xbox::
@@ -347,6 +349,8 @@ extern void pgraph_handle_method(
 	unsigned int method,
 	uint32_t parameter);
 
+extern void pgraph_frame_boundary(NV2AState *d);
+
 // LLE NV2A
 extern NV2ADevice* g_NV2A;
 
@@ -366,6 +370,13 @@ void HLE_write_NV2A_vertex_attribute_slot(unsigned slot, uint32_t parameter)
 		parameter);
 }
 
+void HLE_NV2A_frame_boundary()
+{
+	// The patched D3DDevice_Swap never pushes a flip, so let the LLE NV2A
+	// device do its per-frame bookkeeping (like pushbuffer capture) here
+	pgraph_frame_boundary(g_NV2A->GetDeviceState());
+}
+
 uint32_t HLE_read_NV2A_vertex_attribute_slot(unsigned slot)
 {
 	NV2AState* dev = g_NV2A->GetDeviceState();
@@ -383,55 +394,49 @@ uint32_t HLE_read_NV2A_vertex_attribute_slot(unsigned slot)
 	return value;
 }
 
-// For now, skip the cache, but handle the pgraph method directly
-// Note : Here's where the method gets multiplied by four!
-// Note 2 : d is read from local scope, and ni is unused (same in LLE)
-// Note 3 : Keep EmuExecutePushBufferRaw skipping all commands not intended for channel 0 (3D)
-// Note 4 : Prevent a crash during shutdown when g_NV2A gets deleted
-#define CACHE_PUSH(subc, mthd, word, ni) \
-	if (subc == 0) { \
-		if (g_NV2A) { \
-			pgraph_handle_method(d, subc, mthd << 2, word); \
-		} \
+// Method and event sink for nv2a_pushbuffer_run, used by EmuExecutePushBufferRaw
+struct HLEPushBufferHandler {
+	NV2AState *d;
+
+	// For now, skip the cache, but handle the pgraph method directly
+	// Note : Here's where the method gets multiplied by four!
+	// Note 2 : ni is unused (same in LLE)
+	// Note 3 : Keep EmuExecutePushBufferRaw skipping all commands not intended for channel 0 (3D)
+	// Note 4 : Prevent a crash during shutdown when g_NV2A gets deleted
+	void Method(uint32_t subc, uint32_t mthd, uint32_t word, bool ni)
+	{
+		if (subc == 0) {
+			if (g_NV2A) {
+				pgraph_handle_method(d, subc, mthd << 2, word);
+			}
+		}
 	}
 
-typedef union {
-/* https://envytools.readthedocs.io/en/latest/hw/fifo/dma-pusher.html#the-commands-pre-gf100-format
-
-	000 CCCCCCCCCCC 00 SSS MMMMMMMMMMM 00	increasing methods [NV4+]
-	000 00000000000 10 000 00000000000 00	return [NV1A+, NV4-style only]
-	001 JJJJJJJJJJJ JJ JJJ JJJJJJJJJJJ 00	old jump [NV4+, NV4-style only]
-	010 CCCCCCCCCCC 00 SSS MMMMMMMMMMM 00	non-increasing methods [NV10+]
-	JJJ JJJJJJJJJJJ JJ JJJ JJJJJJJJJJJ 01	jump [NV1A+, NV4-style only]
-	JJJ JJJJJJJJJJJ JJ JJJ JJJJJJJJJJJ 10	call [NV1A+, NV4-style only]
+	uint32_t *JumpTarget(uint32_t address)
+	{
+		return (uint32_t *)(CONTIGUOUS_MEMORY_BASE | address);
+	}
 
-	C = method Count, S = Subchannel, M = first Method, J = Jump address
-*/
-	// Entire 32 bit command word, and an overlay for the above use-cases :
-	uint32_t            word;                    /*  0 .. 31 */
-	struct {
-		uint32_t        type         : 2;        /*  0 ..  1 */
-			// See https://envytools.readthedocs.io/en/latest/hw/fifo/dma-pusher.html#nv4-control-flow-commands
-				#define COMMAND_TYPE_NONE        0
-				#define COMMAND_TYPE_JUMP_LONG   1
-				#define COMMAND_TYPE_CALL        2
-		uint32_t        method       : 11;       /*  2 .. 12 */
-		uint32_t        subchannel   : 3;        /* 13 .. 15 */
-		uint32_t        flags        : 2;        /* 16 .. 17 */
-			// See https://envytools.readthedocs.io/en/latest/hw/fifo/dma-pusher.html#nv4-method-submission-commands
-				#define COMMAND_FLAGS_NONE                         0
-				#define COMMAND_FLAGS_SLI_CONDITIONAL              1 // (NV40+)
-				#define COMMAND_FLAGS_RETURN                       2
-				#define COMMAND_FLAGS_LONG_NON_INCREASING_METHODS  3 // [IB-mode only] 
-		uint32_t        method_count : 11;       /* 18 .. 28 */
-		uint32_t        instruction  : 3;        /* 29 .. 31 */
-				#define COMMAND_INSTRUCTION_INCREASING_METHODS     0
-				#define COMMAND_INSTRUCTION_JUMP                   1
-				#define COMMAND_INSTRUCTION_NON_INCREASING_METHODS 2
-	};
-	#define COMMAND_WORD_MASK_JUMP      0x1FFFFFFC /*  2 .. 31 */
-	#define COMMAND_WORD_MASK_JUMP_LONG 0xFFFFFFFC /*  2 .. 28 */
-} nv_fifo_command;
+	void Event(nv_pusher_event event)
+	{
+		switch (event) {
+		case NV_PUSHER_EVENT_END_OF_DATA_EXCEEDED: LOG_TEST_CASE("Last pushbuffer instruction exceeds END of Data"); break;
+		case NV_PUSHER_EVENT_JUMP_LONG: LOG_TEST_CASE("Pushbuffer COMMAND_TYPE_JUMP_LONG"); break;
+		case NV_PUSHER_EVENT_CALL: LOG_TEST_CASE("Pushbuffer COMMAND_TYPE_CALL"); break;
+		case NV_PUSHER_EVENT_CALL_WHILE_ACTIVE: LOG_TEST_CASE("Pushbuffer COMMAND_TYPE_CALL while another call was active!"); break;
+		case NV_PUSHER_EVENT_UNKNOWN_TYPE: LOG_TEST_CASE("Pushbuffer COMMAND_TYPE unknown"); break;
+		case NV_PUSHER_EVENT_JUMP: LOG_TEST_CASE("Pushbuffer COMMAND_INSTRUCTION_JUMP"); break;
+		case NV_PUSHER_EVENT_UNKNOWN_INSTRUCTION: LOG_TEST_CASE("Pushbuffer COMMAND_INSTRUCTION unknown"); break;
+		case NV_PUSHER_EVENT_RETURN: LOG_TEST_CASE("Pushbuffer COMMAND_FLAGS_RETURN"); break;
+		case NV_PUSHER_EVENT_RETURN_EXTRA_BITS: LOG_TEST_CASE("Pushbuffer COMMAND_FLAGS_RETURN with additional bits?!"); break;
+		case NV_PUSHER_EVENT_RETURN_WHILE_INACTIVE: LOG_TEST_CASE("Pushbuffer COMMAND_FLAGS_RETURN while another call was active!"); break;
+		case NV_PUSHER_EVENT_SLI_CONDITIONAL: LOG_TEST_CASE("Pushbuffer COMMAND_FLAGS_SLI_CONDITIONAL (NV40+) not available on NV2A"); break;
+		case NV_PUSHER_EVENT_LONG_NON_INCREASING: LOG_TEST_CASE("Pushbuffer COMMAND_FLAGS_LONG_NON_INCREASING_METHODS [IB-mode only] not available on NV2A"); break;
+		case NV_PUSHER_EVENT_UNKNOWN_FLAGS: LOG_TEST_CASE("Pushbuffer COMMAND_FLAGS unknown"); break;
+		default: break;
+		}
+	}
+};
 
 extern void EmuExecutePushBufferRaw
 (
@@ -465,170 +470,20 @@ extern void EmuExecutePushBufferRaw
 	NV2AState *d = g_NV2A->GetDeviceState();
 	d->pgraph.regs[NV_PGRAPH_CTX_CONTROL] |= NV_PGRAPH_CTX_CONTROL_CHID; // avoid assert in pgraph_handle_method()
 
-
-	// DMA Pusher state -- see https://envytools.readthedocs.io/en/latest/hw/fifo/dma-pusher.html#pusher-state
-#if 0
-	static xbox::addr dma_pushbuffer; // the pushbuffer and IB DMA object
-#endif
-	uint32_t *dma_limit; // pushbuffer size limit
-	uint32_t *dma_put; // pushbuffer current end address
-	uint32_t *dma_get; //pushbuffer current read address
-	struct {
-		xbox::NV2AMETHOD mthd; // Current method
-		uint32_t subc; // :3 = Current subchannel
-		uint32_t mcnt; // :24 = Current method count
-		bool ni; // Current command's NI (non-increasing) flag
-	} dma_state;
-
-	static uint32_t dcount_shadow = 0; // [NV5:] Number of already-processed methods in cmd]
-	static bool subr_active = false; // Subroutine active
-	static uint32_t *subr_return = nullptr; // Subroutine return address
-	// static bool big_endian = false; // Pushbuffer endian switch
-
-	// DMA troubleshooting values -- see https://envytools.readthedocs.io/en/latest/hw/fifo/dma-pusher.html#errors
-	static uint32_t *dma_get_jmp_shadow = nullptr; // value of dma_get before the last jump
-	static uint32_t rsvd_shadow = 0; // the first word of last-read command
-	static uint32_t data_shadow = 0; // the last-read data word
-
-	// Overlay, to ease decoding the PFIFO command word
-	union {
-		uint32_t word;
-		nv_fifo_command command;
-	};
+	// The subroutine and troubleshooting parts of the pusher state persist between calls
+	static nv_pusher_state pusher_state = {};
 
 	// Initialize working variables
-	dma_limit = (uint32_t*)((xbox::addr)pPushData + uSizeInBytes); // TODO : If this an absolute addresss?
-	dma_put = (uint32_t*)((xbox::addr)pPushData + uSizeInBytes);
-	dma_get = (uint32_t*)pPushData;
-	dma_state = {};
-
-	// NV-4-style PFIFO DMA command stream pusher
-	// See https://envytools.readthedocs.io/en/latest/hw/fifo/dma-pusher.html#the-pusher-pseudocode-pre-gf100
-    while (dma_get != dma_put) {
-		// Check if loop reaches end of pushbuffer
-		if (dma_get >= dma_limit) {
-			LOG_TEST_CASE("Last pushbuffer instruction exceeds END of Data");
-			// TODO : throw DMA_PUSHER(MEM_FAULT);
-			return; // For now, don't even attempt to run through
-		}
-
-		// Read a DWORD from the current push buffer pointer
-		word = *dma_get++;
-		/* now, see if we're in the middle of a command */
-		if (dma_state.mcnt) {
-			/* data word of methods command */
-			data_shadow = word;
-#if 0
-			if (!PULLER_KNOWS_MTHD(dma_state.mthd)) {
-				throw DMA_PUSHER(INVALID_MTHD);				
-				return; // For now, don't even attempt to run through
-			}
-
-#endif
-			CACHE_PUSH(dma_state.subc, dma_state.mthd, word, dma_state.ni);
-			if (!dma_state.ni) {
-				dma_state.mthd++;
-			}
-
-			dma_state.mcnt--;
-			dcount_shadow++;
-			continue; // while
-		}
-
-		/* no command active - this is the first word of a new one */
-		rsvd_shadow = word;
-		// Check and handle command type, then instruction, then flags
-		switch (command.type) {
-		case COMMAND_TYPE_NONE:
-			break; // fall through
-		case COMMAND_TYPE_JUMP_LONG:
-			LOG_TEST_CASE("Pushbuffer COMMAND_TYPE_JUMP_LONG");
-			dma_get_jmp_shadow = dma_get;
-			dma_get = (uint32_t *)(CONTIGUOUS_MEMORY_BASE | (word & COMMAND_WORD_MASK_JUMP_LONG));
-			continue; // while
-		case COMMAND_TYPE_CALL: // Note : NV2A return is said not to work?
-			if (subr_active) {
-				LOG_TEST_CASE("Pushbuffer COMMAND_TYPE_CALL while another call was active!");
-				// TODO : throw DMA_PUSHER(CALL_SUBR_ACTIVE);
-				return; // For now, don't even attempt to run through
-			}
-			else {
-				LOG_TEST_CASE("Pushbuffer COMMAND_TYPE_CALL");
-			}
-
-			subr_return = dma_get;
-			subr_active = true;
-			dma_get = (uint32_t *)(CONTIGUOUS_MEMORY_BASE | (word & COMMAND_WORD_MASK_JUMP_LONG));
-			continue; // while
-		default:
-			LOG_TEST_CASE("Pushbuffer COMMAND_TYPE unknown");
-			// TODO : throw DMA_PUSHER(INVALID_CMD);
-			return; // For now, don't even attempt to run through
-		} // switch type
-
-		switch (command.instruction) {
-		case COMMAND_INSTRUCTION_INCREASING_METHODS:
-			dma_state.ni = false;
-			break;
-		case COMMAND_INSTRUCTION_JUMP:
-			LOG_TEST_CASE("Pushbuffer COMMAND_INSTRUCTION_JUMP");
-			dma_get_jmp_shadow = dma_get;
-			dma_get = (uint32_t *)(CONTIGUOUS_MEMORY_BASE | (word & COMMAND_WORD_MASK_JUMP));
-			continue; // while
-		case COMMAND_INSTRUCTION_NON_INCREASING_METHODS:
-			dma_state.ni = true;
-			break;
-		default:
-			LOG_TEST_CASE("Pushbuffer COMMAND_INSTRUCTION unknown");
-			// TODO : throw DMA_PUSHER(INVALID_CMD);
-			return; // For now, don't even attempt to run through
-		} // switch instruction
-
-		switch (command.flags) {
-		case COMMAND_FLAGS_NONE: // Decode push buffer method & size (inverse of D3DPUSH_ENCODE)
-			dma_state.mthd = command.method;
-			dma_state.subc = command.subchannel;
-			dma_state.mcnt = command.method_count;
-			break; // fall through
-		case COMMAND_FLAGS_RETURN: // Note : NV2A return is said not to work?
-			if (word != 0x00020000) {
-				LOG_TEST_CASE("Pushbuffer COMMAND_FLAGS_RETURN with additional bits?!");
-				return; // For now, don't even attempt to run through
-			}
-			else {
-				LOG_TEST_CASE("Pushbuffer COMMAND_FLAGS_RETURN");
-			}
-
-			if (!subr_active) {
-				LOG_TEST_CASE("Pushbuffer COMMAND_FLAGS_RETURN while another call was active!");
-				// TODO : throw DMA_PUSHER(RET_SUBR_INACTIVE);
-				return; // For now, don't even attempt to run through
-			}
-
-			dma_get = subr_return;
-			subr_active = false;
-			continue; // while
-		default:
-			if (command.flags == COMMAND_FLAGS_SLI_CONDITIONAL) {
-				LOG_TEST_CASE("Pushbuffer COMMAND_FLAGS_SLI_CONDITIONAL (NV40+) not available on NV2A");
-			} else if (command.flags == COMMAND_FLAGS_LONG_NON_INCREASING_METHODS) {
-				LOG_TEST_CASE("Pushbuffer COMMAND_FLAGS_LONG_NON_INCREASING_METHODS [IB-mode only] not available on NV2A");
-				/// No need to do: dma_state.mthd = command.method; dma_state.ni = true;
-				/// dma_state.mcnt = *dma_get++ & 0x00FFFFFF; // Long NI method command count is read from low 24 bits of next word
-				/// dma_get += dma_state.mcnt; // To be safe, skip method data
-				/// continue;
-			} else {
-				LOG_TEST_CASE("Pushbuffer COMMAND_FLAGS unknown");
-			}
+	uint32_t *dma_limit = (uint32_t*)((xbox::addr)pPushData + uSizeInBytes); // TODO : If this an absolute addresss?
+	uint32_t *dma_put = (uint32_t*)((xbox::addr)pPushData + uSizeInBytes);
+	uint32_t *dma_get = (uint32_t*)pPushData;
 
-			/// dma_get += command.method_count; // To be safe, skip method data
-			/// continue;
-			// TODO : throw DMA_PUSHER(INVALID_CMD);
-			return; // For now, don't even attempt to run through
-		} // switch flags
+	if (g_nv2a_pbcapture_active) {
+		nv2a_pbcapture_commands((uint32_t*)pPushData, (uint32_t)(xbox::addr)pPushData, uSizeInBytes, NV2A_PBCAPTURE_COMMANDS_HLE);
+	}
 
-		dcount_shadow = 0;
-    } // while (dma_get != dma_put)
+	HLEPushBufferHandler handler = { d };
+	nv2a_pushbuffer_run(pusher_state, dma_get, dma_put, dma_limit, handler);
 }
 
 const char *NV2AMethodToString(DWORD dwMethod)
@@ -0,0 +1,295 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+#include <cstring>
+#include "XbSwizzle.h"
+
+// The swizzled offset of a texel is the OR of its coordinates, each spread over the bits of their mask
+typedef struct _SwizzleMasks
+{
+	uint32_t X, Y, Z;
+}
+SwizzleMasks;
+
+static SwizzleMasks GetSwizzleMasks(uint32_t Width, uint32_t Height, uint32_t Depth)
+{
+	SwizzleMasks Masks = { 0, 0, 0 };
+	for (uint32_t i = 1, j = 1; (i < Width) || (i < Height) || (i < Depth); i <<= 1) {
+		if (i < Width) {
+			Masks.X |= j;
+			j <<= 1;
+		}
+
+		if (i < Height) {
+			Masks.Y |= j;
+			j <<= 1;
+		}
+
+		if (i < Depth) {
+			Masks.Z |= j;
+			j <<= 1;
+		}
+	}
+
+	return Masks;
+}
+
+// Spreads the bits of Value over the set bits of Mask
+static inline uint32_t SwizzleCoordinate(uint32_t Value, uint32_t Mask)
+{
+	uint32_t Result = 0;
+	while (Mask != 0) {
+		uint32_t Lowest = Mask & (0 - Mask);
+		if (Value & 1) {
+			Result |= Lowest;
+		}
+
+		Value >>= 1;
+		Mask ^= Lowest;
+	}
+
+	return Result;
+}
+
+// Steps a swizzled coordinate to the next value, without unswizzling it
+static inline uint32_t SwizzleIncrement(uint32_t Swizzled, uint32_t Mask)
+{
+	return (Swizzled - Mask) & Mask;
+}
+
+// Copies one texel (or Size bytes, when the texel size isn't one of the known ones)
+template<unsigned Bpp>
+static inline void CopyTexels(uint8_t *pDst, const uint8_t *pSrc, unsigned Size)
+{
+	std::memcpy(pDst, pSrc, Bpp ? Bpp : Size);
+}
+
+// Texel by texel copy, like the XDK does it
+template<unsigned Bpp, bool bSwizzle>
+static void CopyBoxTexels
+(
+	uint8_t *pLinear,
+	uint32_t RowPitch,
+	uint32_t SlicePitch,
+	uint8_t *pSwizzled,
+	const SwizzleMasks &Masks,
+	uint32_t X,
+	uint32_t Y,
+	uint32_t Z,
+	uint32_t BoxWidth,
+	uint32_t BoxHeight,
+	uint32_t BoxDepth,
+	uint32_t BytesPerPixel
+)
+{
+	if (BoxWidth == 0 || BoxHeight == 0) {
+		return;
+	}
+
+	const uint32_t StartX = SwizzleCoordinate(X, Masks.X);
+	uint32_t SwizzledZ = SwizzleCoordinate(Z, Masks.Z);
+	for (uint32_t z = 0; z < BoxDepth; z++) {
+		uint8_t *pRow = pLinear;
+		uint32_t SwizzledY = SwizzleCoordinate(Y, Masks.Y);
+		for (uint32_t y = 0; y < BoxHeight; y++) {
+			uint8_t *pTexel = pRow;
+			uint32_t SwizzledYZ = SwizzledY | SwizzledZ;
+			uint32_t SwizzledX = StartX;
+			for (uint32_t x = 0; x < BoxWidth; x++) {
+				uint8_t *pSwizzledTexel = pSwizzled + ((SwizzledX | SwizzledYZ) * BytesPerPixel);
+				if (bSwizzle) {
+					CopyTexels<Bpp>(pSwizzledTexel, pTexel, BytesPerPixel);
+				} else {
+					CopyTexels<Bpp>(pTexel, pSwizzledTexel, BytesPerPixel);
+				}
+
+				pTexel += BytesPerPixel;
+				SwizzledX = SwizzleIncrement(SwizzledX, Masks.X);
+			}
+
+			pRow += RowPitch;
+			SwizzledY = SwizzleIncrement(SwizzledY, Masks.Y);
+		}
+
+		pLinear += SlicePitch;
+		SwizzledZ = SwizzleIncrement(SwizzledZ, Masks.Z);
+	}
+}
+
+// Copies an aligned 4x4 tile, which is 16 consecutive texels when swizzled :
+// four 2x2 blocks, each made of two texels of one row followed by the two below them
+template<unsigned Bpp, bool bSwizzle>
+static inline void CopyTile(uint8_t *pLinear, uint32_t RowPitch, uint8_t *pTile)
+{
+	for (unsigned BlockY = 0; BlockY < 4; BlockY += 2) {
+		for (unsigned BlockX = 0; BlockX < 4; BlockX += 2) {
+			uint8_t *pRow0 = pLinear + (BlockY * RowPitch) + (BlockX * Bpp);
+			uint8_t *pRow1 = pRow0 + RowPitch;
+			if (bSwizzle) {
+				std::memcpy(pTile, pRow0, 2 * Bpp);
+				std::memcpy(pTile + (2 * Bpp), pRow1, 2 * Bpp);
+			} else {
+				std::memcpy(pRow0, pTile, 2 * Bpp);
+				std::memcpy(pRow1, pTile + (2 * Bpp), 2 * Bpp);
+			}
+
+			pTile += 4 * Bpp;
+		}
+	}
+}
+
+template<unsigned Bpp, bool bSwizzle>
+static void CopyBox
+(
+	uint8_t *pLinear,
+	uint32_t RowPitch,
+	uint32_t SlicePitch,
+	uint8_t *pSwizzled,
+	uint32_t Width,
+	uint32_t Height,
+	uint32_t Depth,
+	uint32_t X,
+	uint32_t Y,
+	uint32_t Z,
+	uint32_t BoxWidth,
+	uint32_t BoxHeight,
+	uint32_t BoxDepth,
+	uint32_t BytesPerPixel
+)
+{
+	SwizzleMasks Masks = GetSwizzleMasks(Width, Height, Depth);
+
+	// Whole 4x4 tiles can be copied at once when the lowest swizzled bits are x0, y0, x1, y1
+	// (so not for 3D textures, nor for textures narrower or lower than 4 texels)
+	const uint32_t TileX0 = (X + 3) & ~3u;
+	const uint32_t TileY0 = (Y + 3) & ~3u;
+	const uint32_t TileX1 = (X + BoxWidth) & ~3u;
+	const uint32_t TileY1 = (Y + BoxHeight) & ~3u;
+	if (Bpp == 0 || (Masks.X & 0xF) != 0x5 || (Masks.Y & 0xF) != 0xA || BoxDepth != 1 || TileX0 >= TileX1 || TileY0 >= TileY1) {
+		CopyBoxTexels<Bpp, bSwizzle>(pLinear, RowPitch, SlicePitch, pSwizzled, Masks, X, Y, Z, BoxWidth, BoxHeight, BoxDepth, BytesPerPixel);
+		return;
+	}
+
+	// The unaligned edges go texel by texel : the rows above and below the tiles, then the columns left and right of them
+	CopyBoxTexels<Bpp, bSwizzle>(pLinear, RowPitch, SlicePitch, pSwizzled, Masks,
+		X, Y, Z, BoxWidth, TileY0 - Y, 1, BytesPerPixel);
+	CopyBoxTexels<Bpp, bSwizzle>(pLinear + ((TileY1 - Y) * RowPitch), RowPitch, SlicePitch, pSwizzled, Masks,
+		X, TileY1, Z, BoxWidth, (Y + BoxHeight) - TileY1, 1, BytesPerPixel);
+	CopyBoxTexels<Bpp, bSwizzle>(pLinear + ((TileY0 - Y) * RowPitch), RowPitch, SlicePitch, pSwizzled, Masks,
+		X, TileY0, Z, TileX0 - X, TileY1 - TileY0, 1, BytesPerPixel);
+	CopyBoxTexels<Bpp, bSwizzle>(pLinear + ((TileY0 - Y) * RowPitch) + ((TileX1 - X) * Bpp), RowPitch, SlicePitch, pSwizzled, Masks,
+		TileX1, TileY0, Z, (X + BoxWidth) - TileX1, TileY1 - TileY0, 1, BytesPerPixel);
+
+	// Step through the tiles using only the bits above the ones within a tile
+	const uint32_t TileMaskX = Masks.X & ~0x5u;
+	const uint32_t TileMaskY = Masks.Y & ~0xAu;
+	const uint32_t SwizzledZ = SwizzleCoordinate(Z, Masks.Z);
+	const uint32_t StartX = SwizzleCoordinate(TileX0, Masks.X);
+	uint32_t SwizzledY = SwizzleCoordinate(TileY0, Masks.Y);
+	uint8_t *pRow = pLinear + ((TileY0 - Y) * RowPitch) + ((TileX0 - X) * Bpp);
+	for (uint32_t y = TileY0; y < TileY1; y += 4) {
+		uint8_t *pTile = pRow;
+		uint32_t SwizzledX = StartX;
+		for (uint32_t x = TileX0; x < TileX1; x += 4) {
+			CopyTile<Bpp, bSwizzle>(pTile, RowPitch, pSwizzled + ((SwizzledX | SwizzledY | SwizzledZ) * Bpp));
+			pTile += 4 * Bpp;
+			SwizzledX = SwizzleIncrement(SwizzledX, TileMaskX);
+		}
+
+		pRow += 4 * RowPitch;
+		SwizzledY = SwizzleIncrement(SwizzledY, TileMaskY);
+	}
+}
+
+template<bool bSwizzle>
+static void CopyBox
+(
+	uint8_t *pLinear,
+	uint32_t RowPitch,
+	uint32_t SlicePitch,
+	uint8_t *pSwizzled,
+	uint32_t Width,
+	uint32_t Height,
+	uint32_t Depth,
+	uint32_t X,
+	uint32_t Y,
+	uint32_t Z,
+	uint32_t BoxWidth,
+	uint32_t BoxHeight,
+	uint32_t BoxDepth,
+	uint32_t BytesPerPixel
+)
+{
+	switch (BytesPerPixel) {
+	case 1: CopyBox<1, bSwizzle>(pLinear, RowPitch, SlicePitch, pSwizzled, Width, Height, Depth, X, Y, Z, BoxWidth, BoxHeight, BoxDepth, BytesPerPixel); break;
+	case 2: CopyBox<2, bSwizzle>(pLinear, RowPitch, SlicePitch, pSwizzled, Width, Height, Depth, X, Y, Z, BoxWidth, BoxHeight, BoxDepth, BytesPerPixel); break;
+	case 4: CopyBox<4, bSwizzle>(pLinear, RowPitch, SlicePitch, pSwizzled, Width, Height, Depth, X, Y, Z, BoxWidth, BoxHeight, BoxDepth, BytesPerPixel); break;
+	case 8: CopyBox<8, bSwizzle>(pLinear, RowPitch, SlicePitch, pSwizzled, Width, Height, Depth, X, Y, Z, BoxWidth, BoxHeight, BoxDepth, BytesPerPixel); break;
+	case 16: CopyBox<16, bSwizzle>(pLinear, RowPitch, SlicePitch, pSwizzled, Width, Height, Depth, X, Y, Z, BoxWidth, BoxHeight, BoxDepth, BytesPerPixel); break;
+	default: CopyBox<0, bSwizzle>(pLinear, RowPitch, SlicePitch, pSwizzled, Width, Height, Depth, X, Y, Z, BoxWidth, BoxHeight, BoxDepth, BytesPerPixel); break;
+	}
+}
+
+void SwizzleBox
+(
+	const void *pLinear,
+	uint32_t    RowPitch,
+	uint32_t    SlicePitch,
+	void       *pSwizzled,
+	uint32_t    Width,
+	uint32_t    Height,
+	uint32_t    Depth,
+	uint32_t    X,
+	uint32_t    Y,
+	uint32_t    Z,
+	uint32_t    BoxWidth,
+	uint32_t    BoxHeight,
+	uint32_t    BoxDepth,
+	uint32_t    BytesPerPixel
+)
+{
+	CopyBox<true>((uint8_t *)pLinear, RowPitch, SlicePitch, (uint8_t *)pSwizzled, Width, Height, Depth, X, Y, Z, BoxWidth, BoxHeight, BoxDepth, BytesPerPixel);
+}
+
+void UnswizzleBox
+(
+	const void *pSwizzled,
+	uint32_t    Width,
+	uint32_t    Height,
+	uint32_t    Depth,
+	uint32_t    X,
+	uint32_t    Y,
+	uint32_t    Z,
+	uint32_t    BoxWidth,
+	uint32_t    BoxHeight,
+	uint32_t    BoxDepth,
+	void       *pLinear,
+	uint32_t    RowPitch,
+	uint32_t    SlicePitch,
+	uint32_t    BytesPerPixel
+)
+{
+	CopyBox<false>((uint8_t *)pLinear, RowPitch, SlicePitch, (uint8_t *)pSwizzled, Width, Height, Depth, X, Y, Z, BoxWidth, BoxHeight, BoxDepth, BytesPerPixel);
+}
@@ -0,0 +1,71 @@
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+#ifndef XBSWIZZLE_H
+#define XBSWIZZLE_H
+
+#include <cstdint>
+
+// Xbox textures are swizzled in Morton order : the bits of the x, y and z coordinates are interleaved
+// (x first), and a dimension drops out once all its bits are used. Width, Height and Depth are the
+// dimensions of the whole swizzled texture, X/Y/Z and BoxWidth/BoxHeight/BoxDepth select the part to copy.
+// The linear buffer points at the first texel of the box, and can use any row and slice pitch.
+
+// Copies a box from a linear buffer into a swizzled texture
+extern void SwizzleBox
+(
+	const void *pLinear,
+	uint32_t    RowPitch,
+	uint32_t    SlicePitch,
+	void       *pSwizzled,
+	uint32_t    Width,
+	uint32_t    Height,
+	uint32_t    Depth,
+	uint32_t    X,
+	uint32_t    Y,
+	uint32_t    Z,
+	uint32_t    BoxWidth,
+	uint32_t    BoxHeight,
+	uint32_t    BoxDepth,
+	uint32_t    BytesPerPixel
+);
+
+// Copies a box from a swizzled texture into a linear buffer
+extern void UnswizzleBox
+(
+	const void *pSwizzled,
+	uint32_t    Width,
+	uint32_t    Height,
+	uint32_t    Depth,
+	uint32_t    X,
+	uint32_t    Y,
+	uint32_t    Z,
+	uint32_t    BoxWidth,
+	uint32_t    BoxHeight,
+	uint32_t    BoxDepth,
+	void       *pLinear,
+	uint32_t    RowPitch,
+	uint32_t    SlicePitch,
+	uint32_t    BytesPerPixel
+);
+
+#endif
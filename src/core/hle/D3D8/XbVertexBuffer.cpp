@@ -161,24 +161,38 @@ UINT CxbxVertexBufferConverter::GetNbrStreams(CxbxDrawContext *pDrawContext)
     return 0;
 }
 
-inline FLOAT PackedIntToFloat(const int value, const FLOAT PosFactor, const FLOAT NegFactor)
+void CxbxCompileVertexStreamConversion(CxbxVertexShaderStreamInfo *pStreamInfo)
 {
-	if (value >= 0) {
-		return ((FLOAT)value) / PosFactor;
-	}
-	else {
-		return ((FLOAT)value) / NegFactor;
+	extern D3DCAPS g_D3DCaps;
+
+	// The host declaration types were chosen using these same caps (see VshConvertToken_STREAMDATA_REG)
+	CxbxVertexStreamConversionCaps Caps;
+	Caps.bShort2N = (g_D3DCaps.DeclTypes & D3DDTCAPS_SHORT2N) != 0;
+	Caps.bShort4N = (g_D3DCaps.DeclTypes & D3DDTCAPS_SHORT4N) != 0;
+	Caps.bUByte4N = (g_D3DCaps.DeclTypes & D3DDTCAPS_UBYTE4N) != 0;
+
+	for (DWORD i = 0; i < pStreamInfo->NumberOfVertexElements; i++) {
+		if (pStreamInfo->VertexElements[i].XboxType == xbox::X_D3DVSDT_NONE) {
+			// Test-case : WWE RAW2
+			// Test-case : PetitCopter 
+			LOG_TEST_CASE("X_D3DVSDT_NONE");
+		}
 	}
-}
 
-inline FLOAT NormShortToFloat(const SHORT value)
-{
-	return PackedIntToFloat((int)value, 32767.0f, 32768.0f);
+	pStreamInfo->NumberOfConversionOps = CxbxCompileVertexElementConversions(pStreamInfo->VertexElements, pStreamInfo->NumberOfVertexElements, Caps, pStreamInfo->ConversionOps);
 }
 
-inline FLOAT ByteToFloat(const BYTE value)
+void CxbxExecuteVertexStreamConversion
+(
+	const CxbxVertexShaderStreamInfo *pStreamInfo,
+	const uint8_t *pXboxVertexData,
+	uint8_t       *pHostVertexData,
+	UINT           uiVertexCount,
+	UINT           uiXboxVertexStride,
+	UINT           uiHostVertexStride
+)
 {
-	return ((FLOAT)value) / 255.0f;
+	CxbxExecuteVertexElementConversions(pStreamInfo->ConversionOps, pStreamInfo->NumberOfConversionOps, pXboxVertexData, pHostVertexData, uiVertexCount, uiXboxVertexStride, uiHostVertexStride);
 }
 
 CxbxPatchedStream& CxbxVertexBufferConverter::GetPatchedStream(uint64_t key)
@@ -214,6 +228,12 @@ void CxbxVertexBufferConverter::PrintStats()
     printf("- Cache Size: %d\n", m_PatchedStreams.size());
     printf("- Hits: %d\n", m_TotalCacheHits);
     printf("- Misses: %d\n", m_TotalCacheMisses);
+    printf("- Converted vertices: %llu\n", m_TotalVerticesConverted);
+#ifdef _DEBUG_TIME_VERTEX_CONVERSIONS
+    if (m_TotalConversionSeconds > 0) {
+        printf("- Conversion rate: %.0f vertices/sec\n", m_TotalVerticesConverted / m_TotalConversionSeconds);
+    }
+#endif
 }
 
 void CxbxVertexBufferConverter::ConvertStream
@@ -222,8 +242,6 @@ void CxbxVertexBufferConverter::ConvertStream
     UINT             uiStream
 )
 {
-	extern D3DCAPS g_D3DCaps;
-
 	bool bVshHandleIsFVF = VshHandleIsFVF(g_Xbox_VertexShader_Handle);
 	DWORD XboxFVF = bVshHandleIsFVF ? g_Xbox_VertexShader_Handle : 0;
 	// Texture normalization can only be set for FVF shaders
@@ -422,224 +440,16 @@ void CxbxVertexBufferConverter::ConvertStream
 	
 	if (bNeedVertexPatching) {
 	    // assert(bNeedStreamCopy || "bNeedVertexPatching implies bNeedStreamCopy (but copies via conversions");
-		for (uint32_t uiVertex = 0; uiVertex < uiVertexCount; uiVertex++) {
-			uint8_t *pXboxVertexAsByte = &pXboxVertexData[uiVertex * uiXboxVertexStride];
-			uint8_t *pHostVertexAsByte = &pHostVertexData[uiVertex * uiHostVertexStride];
-			for (UINT uiElement = 0; uiElement < pVertexShaderStreamInfo->NumberOfVertexElements; uiElement++) {
-				FLOAT *pXboxVertexAsFloat = (FLOAT*)pXboxVertexAsByte;
-				SHORT *pXboxVertexAsShort = (SHORT*)pXboxVertexAsByte;
-				const int XboxElementByteSize = pVertexShaderStreamInfo->VertexElements[uiElement].XboxByteSize;
-				FLOAT *pHostVertexAsFloat = (FLOAT*)pHostVertexAsByte;
-				SHORT *pHostVertexAsShort = (SHORT*)pHostVertexAsByte;
-				// Dxbx note : The following code handles only the D3DVSDT enums that need conversion;
-				// All other cases are catched by the memcpy in the default-block.
-				switch (pVertexShaderStreamInfo->VertexElements[uiElement].XboxType) {
-				case xbox::X_D3DVSDT_NORMSHORT1: { // 0x11:
-					// Test-cases : Halo - Combat Evolved
-					if (g_D3DCaps.DeclTypes & D3DDTCAPS_SHORT2N) {
-						// Make it SHORT2N
-						pHostVertexAsShort[0] = pXboxVertexAsShort[0];
-						pHostVertexAsShort[1] = 0;
-					}
-					else
-					{
-						// Make it FLOAT1
-						pHostVertexAsFloat[0] = NormShortToFloat(pXboxVertexAsShort[0]);
-						//pHostVertexAsFloat[1] = 0.0f; // Would be needed for FLOAT2
-					}
-					break;
-				}
-				case xbox::X_D3DVSDT_NORMSHORT2: { // 0x21:
-					// Test-cases : Baldur's Gate: Dark Alliance 2, F1 2002, Gun, Halo - Combat Evolved, Scrapland 
-					if (g_D3DCaps.DeclTypes & D3DDTCAPS_SHORT2N) {
-						// No need for patching when D3D9 supports D3DDECLTYPE_SHORT2N
-						// TODO : goto default; // ??
-						//memcpy(pHostVertexAsByte, pXboxVertexAsByte, XboxElementByteSize);
-						// Make it SHORT2N
-						pHostVertexAsShort[0] = pXboxVertexAsShort[0];
-						pHostVertexAsShort[1] = pXboxVertexAsShort[1];
-					}
-					else
-					{
-						// Make it FLOAT2
-						pHostVertexAsFloat[0] = NormShortToFloat(pXboxVertexAsShort[0]);
-						pHostVertexAsFloat[1] = NormShortToFloat(pXboxVertexAsShort[1]);
-					}
-					break;
-				}
-				case xbox::X_D3DVSDT_NORMSHORT3: { // 0x31:
-					// Test-cases : Cel Damage, Constantine, Destroy All Humans!
-					if (g_D3DCaps.DeclTypes & D3DDTCAPS_SHORT4N) {
-						// Make it SHORT4N
-						pHostVertexAsShort[0] = pXboxVertexAsShort[0];
-						pHostVertexAsShort[1] = pXboxVertexAsShort[1];
-						pHostVertexAsShort[2] = pXboxVertexAsShort[2];
-						pHostVertexAsShort[3] = 32767; // TODO : verify
-					}
-					else
-					{
-						// Make it FLOAT3
-						pHostVertexAsFloat[0] = NormShortToFloat(pXboxVertexAsShort[0]);
-						pHostVertexAsFloat[1] = NormShortToFloat(pXboxVertexAsShort[1]);
-						pHostVertexAsFloat[2] = NormShortToFloat(pXboxVertexAsShort[2]);
-					}
-					break;
-				}
-				case xbox::X_D3DVSDT_NORMSHORT4: { // 0x41:
-					// Test-cases : Judge Dredd: Dredd vs Death, NHL Hitz 2002, Silent Hill 2, Sneakers, Tony Hawk Pro Skater 4
-					if (g_D3DCaps.DeclTypes & D3DDTCAPS_SHORT4N) {
-						// No need for patching when D3D9 supports D3DDECLTYPE_SHORT4N
-						// TODO : goto default; // ??
-						//memcpy(pHostVertexAsByte, pXboxVertexAsByte, XboxElementByteSize);
-						// Make it SHORT4N
-						pHostVertexAsShort[0] = pXboxVertexAsShort[0];
-						pHostVertexAsShort[1] = pXboxVertexAsShort[1];
-						pHostVertexAsShort[2] = pXboxVertexAsShort[2];
-						pHostVertexAsShort[3] = pXboxVertexAsShort[3];
-					}
-					else
-					{
-						// Make it FLOAT4
-						pHostVertexAsFloat[0] = NormShortToFloat(pXboxVertexAsShort[0]);
-						pHostVertexAsFloat[1] = NormShortToFloat(pXboxVertexAsShort[1]);
-						pHostVertexAsFloat[2] = NormShortToFloat(pXboxVertexAsShort[2]);
-						pHostVertexAsFloat[3] = NormShortToFloat(pXboxVertexAsShort[3]);
-					}
-					break;
-				}
-				case xbox::X_D3DVSDT_NORMPACKED3: { // 0x16:
-					// Test-cases : Dashboard
-					// Make it FLOAT3
-					union {
-                        int32_t value;
-						struct {
-							int x : 11;
-							int y : 11;
-							int z : 10;
-						};
-					} NormPacked3;
-
-					NormPacked3.value = ((int32_t*)pXboxVertexAsByte)[0];
-
-					pHostVertexAsFloat[0] = PackedIntToFloat(NormPacked3.x, 1023.0f, 1024.f);
-					pHostVertexAsFloat[1] = PackedIntToFloat(NormPacked3.y, 1023.0f, 1024.f);
-					pHostVertexAsFloat[2] = PackedIntToFloat(NormPacked3.z, 511.0f, 512.f);
-					break;
-				}
-				case xbox::X_D3DVSDT_SHORT1: { // 0x15:
-					// Make it SHORT2 and set the second short to 0
-					pHostVertexAsShort[0] = pXboxVertexAsShort[0];
-					pHostVertexAsShort[1] = 0;
-					break;
-				}
-				case xbox::X_D3DVSDT_SHORT3: { // 0x35:
-					// Test-cases : Turok
-					// Make it a SHORT4 and set the fourth short to 1
-					pHostVertexAsShort[0] = pXboxVertexAsShort[0];
-					pHostVertexAsShort[1] = pXboxVertexAsShort[1];
-					pHostVertexAsShort[2] = pXboxVertexAsShort[2];
-					pHostVertexAsShort[3] = 1; // Turok verified (character disappears when this is 32767)
-					break;
-				}
-				case xbox::X_D3DVSDT_PBYTE1: { // 0x14:
-					if (g_D3DCaps.DeclTypes & D3DDTCAPS_UBYTE4N) {
-						// Make it UBYTE4N
-						pHostVertexAsByte[0] = pXboxVertexAsByte[0];
-						pHostVertexAsByte[1] = 0;
-						pHostVertexAsByte[2] = 0;
-						pHostVertexAsByte[3] = 255; // TODO : Verify
-					}
-					else
-					{
-						// Make it FLOAT1
-						pHostVertexAsFloat[0] = ByteToFloat(pXboxVertexAsByte[0]);
-					}
-					break;
-				}
-				case xbox::X_D3DVSDT_PBYTE2: { // 0x24:
-					if (g_D3DCaps.DeclTypes & D3DDTCAPS_UBYTE4N) {
-						// Make it UBYTE4N
-						pHostVertexAsByte[0] = pXboxVertexAsByte[0];
-						pHostVertexAsByte[1] = pXboxVertexAsByte[1];
-						pHostVertexAsByte[2] = 0;
-						pHostVertexAsByte[3] = 255; // TODO : Verify
-					}
-					else
-					{
-						// Make it FLOAT2
-						pHostVertexAsFloat[0] = ByteToFloat(pXboxVertexAsByte[0]);
-						pHostVertexAsFloat[1] = ByteToFloat(pXboxVertexAsByte[1]);
-					}
-					break;
-				}
-				case xbox::X_D3DVSDT_PBYTE3: { // 0x34:
-					// Test-cases : Turok
-					if (g_D3DCaps.DeclTypes & D3DDTCAPS_UBYTE4N) {
-						// Make it UBYTE4N
-						pHostVertexAsByte[0] = pXboxVertexAsByte[0];
-						pHostVertexAsByte[1] = pXboxVertexAsByte[1];
-						pHostVertexAsByte[2] = pXboxVertexAsByte[2];
-						pHostVertexAsByte[3] = 255; // TODO : Verify
-					}
-					else
-					{
-						// Make it FLOAT3
-						pHostVertexAsFloat[0] = ByteToFloat(pXboxVertexAsByte[0]);
-						pHostVertexAsFloat[1] = ByteToFloat(pXboxVertexAsByte[1]);
-						pHostVertexAsFloat[2] = ByteToFloat(pXboxVertexAsByte[2]);
-					}
-					break;
-				}
-				case xbox::X_D3DVSDT_PBYTE4: { // 0x44:
-					// Test-case : Jet Set Radio Future
-					if (g_D3DCaps.DeclTypes & D3DDTCAPS_UBYTE4N) {
-						// No need for patching when D3D9 supports D3DDECLTYPE_UBYTE4N
-						// TODO : goto default; // ??
-						//memcpy(pHostVertexAsByte, pXboxVertexAsByte, XboxElementByteSize);
-						// Make it UBYTE4N
-						pHostVertexAsByte[0] = pXboxVertexAsByte[0];
-						pHostVertexAsByte[1] = pXboxVertexAsByte[1];
-						pHostVertexAsByte[2] = pXboxVertexAsByte[2];
-						pHostVertexAsByte[3] = pXboxVertexAsByte[3];
-					}
-					else
-					{
-						// Make it FLOAT4
-						pHostVertexAsFloat[0] = ByteToFloat(pXboxVertexAsByte[0]);
-						pHostVertexAsFloat[1] = ByteToFloat(pXboxVertexAsByte[1]);
-						pHostVertexAsFloat[2] = ByteToFloat(pXboxVertexAsByte[2]);
-						pHostVertexAsFloat[3] = ByteToFloat(pXboxVertexAsByte[3]);
-					}
-					break;
-				}
-				case xbox::X_D3DVSDT_FLOAT2H: { // 0x72:
-					// Make it FLOAT4 and set the third float to 0.0
-					pHostVertexAsFloat[0] = pXboxVertexAsFloat[0];
-					pHostVertexAsFloat[1] = pXboxVertexAsFloat[1];
-					pHostVertexAsFloat[2] = 0.0f;
-					pHostVertexAsFloat[3] = pXboxVertexAsFloat[2];
-					break;
-				}
-				case xbox::X_D3DVSDT_NONE: { // 0x02:
-					// Test-case : WWE RAW2
-					// Test-case : PetitCopter 
-					LOG_TEST_CASE("X_D3DVSDT_NONE");
-					// No host element data (but Xbox size can be above zero, when used for X_D3DVSD_MASK_SKIP*
-					break;
-				}
-				default: {
-					// Generic 'conversion' - just make a copy :
-					memcpy(pHostVertexAsByte, pXboxVertexAsByte, XboxElementByteSize);
-					break;
-				}
-				} // switch
-
-				// Increment the Xbox pointer :
-				pXboxVertexAsByte += XboxElementByteSize;
-				// Increment the host pointer :
-				pHostVertexAsByte += pVertexShaderStreamInfo->VertexElements[uiElement].HostByteSize;
-			} // for NumberOfVertexElements
-		} // for uiVertexCount
+#ifdef _DEBUG_TIME_VERTEX_CONVERSIONS
+		auto conversionStart = std::chrono::steady_clock::now();
+#endif
+
+		CxbxExecuteVertexStreamConversion(pVertexShaderStreamInfo, pXboxVertexData, pHostVertexData, uiVertexCount, uiXboxVertexStride, uiHostVertexStride);
+
+#ifdef _DEBUG_TIME_VERTEX_CONVERSIONS
+		m_TotalConversionSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - conversionStart).count();
+#endif
+		m_TotalVerticesConverted += uiVertexCount;
     }
     else {
 		if (bNeedStreamCopy) {
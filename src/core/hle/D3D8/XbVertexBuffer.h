@@ -32,6 +32,9 @@
 
 #include "core\hle\D3D8\XbVertexShader.h"
 
+// Define this to time the vertex stream conversions (reported by PrintStats)
+// #define _DEBUG_TIME_VERTEX_CONVERSIONS
+
 typedef struct _CxbxDrawContext
 {
     IN     xbox::X_D3DPRIMITIVETYPE    XboxPrimitiveType;
@@ -83,6 +86,10 @@ class CxbxVertexBufferConverter
         // Stack tracking
         ULONG m_TotalCacheHits = 0;
         ULONG m_TotalCacheMisses = 0;
+        ULONGLONG m_TotalVerticesConverted = 0;
+#ifdef _DEBUG_TIME_VERTEX_CONVERSIONS
+        double m_TotalConversionSeconds = 0;
+#endif
 
         UINT m_MaxCacheSize = 2000;                                        // Maximum number of entries in the cache
         UINT m_CacheElasticity = 200;                                      // Cache is allowed to grow this much more than maximum before being purged to maximum
@@ -99,6 +106,20 @@ class CxbxVertexBufferConverter
         void ConvertStream(CxbxDrawContext *pPatchDesc, UINT uiStream);
 };
 
+// Compiles the per-element conversion of a patched stream into a flat list of converters
+extern void CxbxCompileVertexStreamConversion(CxbxVertexShaderStreamInfo *pStreamInfo);
+
+// Runs a compiled conversion over uiVertexCount vertices
+extern void CxbxExecuteVertexStreamConversion
+(
+	const CxbxVertexShaderStreamInfo *pStreamInfo,
+	const uint8_t *pXboxVertexData,
+	uint8_t       *pHostVertexData,
+	UINT           uiVertexCount,
+	UINT           uiXboxVertexStride,
+	UINT           uiHostVertexStride
+);
+
 // inline vertex buffer emulation
 extern xbox::X_D3DPRIMITIVETYPE      g_InlineVertexBuffer_PrimitiveType;
 extern DWORD                   g_InlineVertexBuffer_FVF;
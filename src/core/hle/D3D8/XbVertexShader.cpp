@@ -34,6 +34,7 @@
 #include "core\hle\D3D8\Direct3D9\Direct3D9.h" // For g_Xbox_VertexShader_Handle
 #include "core\hle\D3D8\Direct3D9\VertexShaderSource.h" // For g_VertexShaderSource
 #include "core\hle\D3D8\XbVertexShader.h"
+#include "core\hle\D3D8\XbVertexBuffer.h" // For CxbxCompileVertexStreamConversion
 #include "core\hle\D3D8\XbD3D8Logging.h" // For DEBUG_D3DRESULT
 #include "common\Logging.h" // For LOG_INIT
 
@@ -1208,6 +1209,14 @@ D3DVERTEXELEMENT *EmuRecompileVshDeclaration
 
 	*pXboxDeclarationCount = Converter.XboxDeclarationCount;
 
+	// Compile the stream conversions once here, instead of interpreting the elements on every draw
+	for (UINT uiStream = 0; uiStream < X_VSH_MAX_STREAMS; uiStream++) {
+		CxbxVertexShaderStreamInfo *pStreamInfo = &(pCxbxVertexDeclaration->VertexStreams[uiStream]);
+		if (pStreamInfo->NeedPatch) {
+			CxbxCompileVertexStreamConversion(pStreamInfo);
+		}
+	}
+
     return pHostVertexElements;
 }
 
@@ -0,0 +1,306 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+#include <cstring>
+
+#include "XbVertexStreamConversion.h"
+
+static inline float PackedIntToFloat(const int value, const float PosFactor, const float NegFactor)
+{
+	if (value >= 0) {
+		return ((float)value) / PosFactor;
+	}
+	else {
+		return ((float)value) / NegFactor;
+	}
+}
+
+static inline float NormShortToFloat(const int16_t value)
+{
+	return PackedIntToFloat((int)value, 32767.0f, 32768.0f);
+}
+
+static inline float ByteToFloat(const uint8_t value)
+{
+	return ((float)value) / 255.0f;
+}
+
+// Vertex element converters; each one handles a single element column for all vertices of a stream,
+// so the inner loops have fixed element types and sizes (see CxbxCompileVertexElementConversions)
+
+// Generic 'conversion' - just make a copy
+static void ConvertVertexElement_Copy(const uint8_t *pXbox, uint8_t *pHost, unsigned uiVertexCount, unsigned uiXboxStride, unsigned uiHostStride, unsigned uiByteCount)
+{
+	for (unsigned uiVertex = 0; uiVertex < uiVertexCount; uiVertex++) {
+		memcpy(pHost, pXbox, uiByteCount);
+		pXbox += uiXboxStride;
+		pHost += uiHostStride;
+	}
+}
+
+template<unsigned ByteCount>
+static void ConvertVertexElement_CopyFixed(const uint8_t *pXbox, uint8_t *pHost, unsigned uiVertexCount, unsigned uiXboxStride, unsigned uiHostStride, unsigned)
+{
+	for (unsigned uiVertex = 0; uiVertex < uiVertexCount; uiVertex++) {
+		memcpy(pHost, pXbox, ByteCount);
+		pXbox += uiXboxStride;
+		pHost += uiHostStride;
+	}
+}
+
+// NORMSHORT1..4 to FLOAT1..4
+template<int Count>
+static void ConvertVertexElement_NormShortToFloat(const uint8_t *pXbox, uint8_t *pHost, unsigned uiVertexCount, unsigned uiXboxStride, unsigned uiHostStride, unsigned)
+{
+	for (unsigned uiVertex = 0; uiVertex < uiVertexCount; uiVertex++) {
+		const int16_t *pXboxShorts = (const int16_t *)pXbox;
+		float *pHostFloats = (float *)pHost;
+		for (int i = 0; i < Count; i++) {
+			pHostFloats[i] = NormShortToFloat(pXboxShorts[i]);
+		}
+		pXbox += uiXboxStride;
+		pHost += uiHostStride;
+	}
+}
+
+// SHORT1 to SHORT2, SHORT3 to SHORT4 (and their normalized variants), filling the last short with Pad
+template<int Count, int16_t Pad>
+static void ConvertVertexElement_PadShorts(const uint8_t *pXbox, uint8_t *pHost, unsigned uiVertexCount, unsigned uiXboxStride, unsigned uiHostStride, unsigned)
+{
+	for (unsigned uiVertex = 0; uiVertex < uiVertexCount; uiVertex++) {
+		const int16_t *pXboxShorts = (const int16_t *)pXbox;
+		int16_t *pHostShorts = (int16_t *)pHost;
+		for (int i = 0; i < Count; i++) {
+			pHostShorts[i] = pXboxShorts[i];
+		}
+		pHostShorts[Count] = Pad;
+		pXbox += uiXboxStride;
+		pHost += uiHostStride;
+	}
+}
+
+// PBYTE1..3 to UBYTE4N
+template<int Count>
+static void ConvertVertexElement_PadBytes(const uint8_t *pXbox, uint8_t *pHost, unsigned uiVertexCount, unsigned uiXboxStride, unsigned uiHostStride, unsigned)
+{
+	for (unsigned uiVertex = 0; uiVertex < uiVertexCount; uiVertex++) {
+		for (int i = 0; i < 3; i++) {
+			pHost[i] = (i < Count) ? pXbox[i] : 0;
+		}
+		pHost[3] = 255; // TODO : Verify
+		pXbox += uiXboxStride;
+		pHost += uiHostStride;
+	}
+}
+
+// PBYTE1..4 to FLOAT1..4
+template<int Count>
+static void ConvertVertexElement_ByteToFloat(const uint8_t *pXbox, uint8_t *pHost, unsigned uiVertexCount, unsigned uiXboxStride, unsigned uiHostStride, unsigned)
+{
+	for (unsigned uiVertex = 0; uiVertex < uiVertexCount; uiVertex++) {
+		float *pHostFloats = (float *)pHost;
+		for (int i = 0; i < Count; i++) {
+			pHostFloats[i] = ByteToFloat(pXbox[i]);
+		}
+		pXbox += uiXboxStride;
+		pHost += uiHostStride;
+	}
+}
+
+// NORMPACKED3 to FLOAT3
+static void ConvertVertexElement_NormPacked3(const uint8_t *pXbox, uint8_t *pHost, unsigned uiVertexCount, unsigned uiXboxStride, unsigned uiHostStride, unsigned)
+{
+	for (unsigned uiVertex = 0; uiVertex < uiVertexCount; uiVertex++) {
+		union {
+			int32_t value;
+			struct {
+				int x : 11;
+				int y : 11;
+				int z : 10;
+			};
+		} NormPacked3;
+
+		NormPacked3.value = ((const int32_t*)pXbox)[0];
+
+		float *pHostFloats = (float *)pHost;
+		pHostFloats[0] = PackedIntToFloat(NormPacked3.x, 1023.0f, 1024.f);
+		pHostFloats[1] = PackedIntToFloat(NormPacked3.y, 1023.0f, 1024.f);
+		pHostFloats[2] = PackedIntToFloat(NormPacked3.z, 511.0f, 512.f);
+		pXbox += uiXboxStride;
+		pHost += uiHostStride;
+	}
+}
+
+// FLOAT2H to FLOAT4, setting the third float to 0.0
+static void ConvertVertexElement_Float2H(const uint8_t *pXbox, uint8_t *pHost, unsigned uiVertexCount, unsigned uiXboxStride, unsigned uiHostStride, unsigned)
+{
+	for (unsigned uiVertex = 0; uiVertex < uiVertexCount; uiVertex++) {
+		const float *pXboxFloats = (const float *)pXbox;
+		float *pHostFloats = (float *)pHost;
+		pHostFloats[0] = pXboxFloats[0];
+		pHostFloats[1] = pXboxFloats[1];
+		pHostFloats[2] = 0.0f;
+		pHostFloats[3] = pXboxFloats[2];
+		pXbox += uiXboxStride;
+		pHost += uiHostStride;
+	}
+}
+
+static CxbxVertexElementConverter GetFixedSizeCopyConverter(unsigned uiByteCount)
+{
+	switch (uiByteCount) {
+	case 4: return ConvertVertexElement_CopyFixed<4>;
+	case 8: return ConvertVertexElement_CopyFixed<8>;
+	case 12: return ConvertVertexElement_CopyFixed<12>;
+	case 16: return ConvertVertexElement_CopyFixed<16>;
+	case 20: return ConvertVertexElement_CopyFixed<20>;
+	case 24: return ConvertVertexElement_CopyFixed<24>;
+	case 28: return ConvertVertexElement_CopyFixed<28>;
+	case 32: return ConvertVertexElement_CopyFixed<32>;
+	}
+
+	return ConvertVertexElement_Copy;
+}
+
+unsigned CxbxCompileVertexElementConversions
+(
+	const CxbxVertexShaderStreamElement  *pElements,
+	unsigned                              uiElementCount,
+	const CxbxVertexStreamConversionCaps &Caps,
+	CxbxVertexStreamConversionOp         *pOps
+)
+{
+	unsigned uiOpCount = 0;
+	unsigned uiXboxOffset = 0;
+	unsigned uiHostOffset = 0;
+	for (unsigned uiElement = 0; uiElement < uiElementCount; uiElement++) {
+		const CxbxVertexShaderStreamElement &Element = pElements[uiElement];
+		CxbxVertexElementConverter Convert = nullptr; // nullptr means the element is copied as-is
+
+		switch (Element.XboxType) {
+		case xbox::X_D3DVSDT_NORMSHORT1: // 0x11:
+			// Test-cases : Halo - Combat Evolved
+			Convert = Caps.bShort2N ? ConvertVertexElement_PadShorts<1, 0> : ConvertVertexElement_NormShortToFloat<1>;
+			break;
+		case xbox::X_D3DVSDT_NORMSHORT2: // 0x21:
+			// Test-cases : Baldur's Gate: Dark Alliance 2, F1 2002, Gun, Halo - Combat Evolved, Scrapland 
+			Convert = Caps.bShort2N ? nullptr : ConvertVertexElement_NormShortToFloat<2>;
+			break;
+		case xbox::X_D3DVSDT_NORMSHORT3: // 0x31:
+			// Test-cases : Cel Damage, Constantine, Destroy All Humans!
+			Convert = Caps.bShort4N ? ConvertVertexElement_PadShorts<3, 32767> : ConvertVertexElement_NormShortToFloat<3>; // TODO : verify 32767
+			break;
+		case xbox::X_D3DVSDT_NORMSHORT4: // 0x41:
+			// Test-cases : Judge Dredd: Dredd vs Death, NHL Hitz 2002, Silent Hill 2, Sneakers, Tony Hawk Pro Skater 4
+			Convert = Caps.bShort4N ? nullptr : ConvertVertexElement_NormShortToFloat<4>;
+			break;
+		case xbox::X_D3DVSDT_NORMPACKED3: // 0x16:
+			// Test-cases : Dashboard
+			Convert = ConvertVertexElement_NormPacked3;
+			break;
+		case xbox::X_D3DVSDT_SHORT1: // 0x15:
+			Convert = ConvertVertexElement_PadShorts<1, 0>;
+			break;
+		case xbox::X_D3DVSDT_SHORT3: // 0x35:
+			// Test-cases : Turok (character disappears when the fourth short is 32767 instead of 1)
+			Convert = ConvertVertexElement_PadShorts<3, 1>;
+			break;
+		case xbox::X_D3DVSDT_PBYTE1: // 0x14:
+			Convert = Caps.bUByte4N ? ConvertVertexElement_PadBytes<1> : ConvertVertexElement_ByteToFloat<1>;
+			break;
+		case xbox::X_D3DVSDT_PBYTE2: // 0x24:
+			Convert = Caps.bUByte4N ? ConvertVertexElement_PadBytes<2> : ConvertVertexElement_ByteToFloat<2>;
+			break;
+		case xbox::X_D3DVSDT_PBYTE3: // 0x34:
+			// Test-cases : Turok
+			Convert = Caps.bUByte4N ? ConvertVertexElement_PadBytes<3> : ConvertVertexElement_ByteToFloat<3>;
+			break;
+		case xbox::X_D3DVSDT_PBYTE4: // 0x44:
+			// Test-case : Jet Set Radio Future
+			Convert = Caps.bUByte4N ? nullptr : ConvertVertexElement_ByteToFloat<4>;
+			break;
+		case xbox::X_D3DVSDT_FLOAT2H: // 0x72:
+			Convert = ConvertVertexElement_Float2H;
+			break;
+		case xbox::X_D3DVSDT_NONE: // 0x02:
+			// Test-case : WWE RAW2
+			// Test-case : PetitCopter 
+			// No host element data (but Xbox size can be above zero, when used for X_D3DVSD_MASK_SKIP*
+			uiXboxOffset += Element.XboxByteSize;
+			uiHostOffset += Element.HostByteSize;
+			continue;
+		}
+
+		CxbxVertexStreamConversionOp *pPreviousOp = (uiOpCount > 0) ? &(pOps[uiOpCount - 1]) : nullptr;
+		if (Convert == nullptr) {
+			// Extend the previous copy when both the Xbox and host side continue where it ended
+			if (pPreviousOp != nullptr && pPreviousOp->Convert == ConvertVertexElement_Copy &&
+				pPreviousOp->XboxOffset + pPreviousOp->ByteCount == uiXboxOffset &&
+				pPreviousOp->HostOffset + pPreviousOp->ByteCount == uiHostOffset) {
+				pPreviousOp->ByteCount += Element.XboxByteSize;
+				uiXboxOffset += Element.XboxByteSize;
+				uiHostOffset += Element.HostByteSize;
+				continue;
+			}
+
+			Convert = ConvertVertexElement_Copy;
+		}
+
+		CxbxVertexStreamConversionOp *pOp = &(pOps[uiOpCount++]);
+		pOp->Convert = Convert;
+		pOp->XboxOffset = (uint16_t)uiXboxOffset;
+		pOp->HostOffset = (uint16_t)uiHostOffset;
+		pOp->ByteCount = (Convert == ConvertVertexElement_Copy) ? Element.XboxByteSize : 0;
+
+		uiXboxOffset += Element.XboxByteSize;
+		uiHostOffset += Element.HostByteSize;
+	}
+
+	// Now that all copies are merged, switch them over to fixed size copies where possible
+	for (unsigned i = 0; i < uiOpCount; i++) {
+		if (pOps[i].Convert == ConvertVertexElement_Copy) {
+			pOps[i].Convert = GetFixedSizeCopyConverter(pOps[i].ByteCount);
+		}
+	}
+
+	return uiOpCount;
+}
+
+void CxbxExecuteVertexElementConversions
+(
+	const CxbxVertexStreamConversionOp *pOps,
+	unsigned                            uiOpCount,
+	const uint8_t                      *pXboxVertexData,
+	uint8_t                            *pHostVertexData,
+	unsigned                            uiVertexCount,
+	unsigned                            uiXboxVertexStride,
+	unsigned                            uiHostVertexStride
+)
+{
+	for (unsigned i = 0; i < uiOpCount; i++) {
+		const CxbxVertexStreamConversionOp &Op = pOps[i];
+		Op.Convert(pXboxVertexData + Op.XboxOffset, pHostVertexData + Op.HostOffset, uiVertexCount, uiXboxVertexStride, uiHostVertexStride, Op.ByteCount);
+	}
+}
@@ -0,0 +1,93 @@
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+#ifndef XBVERTEXSTREAMCONVERSION_H
+#define XBVERTEXSTREAMCONVERSION_H
+
+// Conversion of Xbox vertex stream elements to the host declaration types
+// Note : Kept free of Direct3D dependencies, so cxbxr-vertexbench can check it against the per-vertex conversion it replaced
+
+#include <cstdint>
+
+#include "core/hle/D3D8/XbVertexDataTypes.h"
+
+typedef struct _CxbxVertexShaderStreamElement
+{
+	unsigned XboxType; // The stream element data types (xbox)
+	unsigned XboxByteSize; // The stream element data sizes (xbox)
+	unsigned HostByteSize; // The stream element data sizes (pc)
+}
+CxbxVertexShaderStreamElement;
+
+// Converts one element (or a run of elements that only need copying) for a range of vertices
+typedef void(*CxbxVertexElementConverter)
+(
+	const uint8_t *pXboxVertexData,
+	uint8_t       *pHostVertexData,
+	unsigned       uiVertexCount,
+	unsigned       uiXboxVertexStride,
+	unsigned       uiHostVertexStride,
+	unsigned       uiByteCount // Only used by the generic copy
+);
+
+typedef struct _CxbxVertexStreamConversionOp
+{
+	CxbxVertexElementConverter Convert;
+	uint16_t XboxOffset; // Offset of the element(s) within an Xbox vertex
+	uint16_t HostOffset; // Offset of the element(s) within a host vertex
+	unsigned ByteCount;
+}
+CxbxVertexStreamConversionOp;
+
+// The normalized host declaration types the elements can be converted to, instead of floats
+// (the host declaration types must have been chosen with the same caps, see VshConvertToken_STREAMDATA_REG)
+typedef struct _CxbxVertexStreamConversionCaps
+{
+	bool bShort2N;
+	bool bShort4N;
+	bool bUByte4N;
+}
+CxbxVertexStreamConversionCaps;
+
+// Compiles the per-element conversion of a stream into a flat list of converters in pOps
+// (which needs room for one per element), returns the number of converters
+extern unsigned CxbxCompileVertexElementConversions
+(
+	const CxbxVertexShaderStreamElement  *pElements,
+	unsigned                              uiElementCount,
+	const CxbxVertexStreamConversionCaps &Caps,
+	CxbxVertexStreamConversionOp         *pOps
+);
+
+// Runs compiled converters over uiVertexCount vertices
+extern void CxbxExecuteVertexElementConversions
+(
+	const CxbxVertexStreamConversionOp *pOps,
+	unsigned                            uiOpCount,
+	const uint8_t                      *pXboxVertexData,
+	uint8_t                            *pHostVertexData,
+	unsigned                            uiVertexCount,
+	unsigned                            uiXboxVertexStride,
+	unsigned                            uiHostVertexStride
+);
+
+#endif
@@ -73,7 +73,9 @@ void DSStream_Packet_Clear(
     )
 {
 
-    free(buffer->pBuffer_data);
+    if (!buffer->isGuestData) {
+        DSVoice_Pool_Free(buffer->pBuffer_data, buffer->xmp_data.dwMaxSize);
+    }
 
     // Peform release only, don't trigger any events below.
     if (status == XMP_STATUS_RELEASE_CXBXR) {
@@ -208,7 +210,7 @@ static void DSStream_Packet_Prefill(
     }
 }
 
-bool DSStream_Packet_Process(
+static bool DSStream_Packet_Process_Internal(
     xbox::X_CDirectSoundStream* pThis
     )
 {
@@ -341,6 +343,15 @@ bool DSStream_Packet_Process(
     return 1;
 }
 
+bool DSStream_Packet_Process(
+    xbox::X_CDirectSoundStream* pThis
+    )
+{
+    bool isProcessing = DSStream_Packet_Process_Internal(pThis);
+    DSStream_Packet_Schedule(pThis);
+    return isProcessing;
+}
+
 void DSStream_Packet_FlushEx_Reset(
     xbox::X_CDirectSoundStream* pThis
     )
@@ -350,7 +361,7 @@ void DSStream_Packet_FlushEx_Reset(
     pThis->Xb_rtFlushEx = 0LL;
 }
 
-bool DSStream_Packet_Flush(
+static bool DSStream_Packet_Flush_Internal(
     xbox::X_CDirectSoundStream* pThis
     )
 {
@@ -376,3 +387,62 @@ bool DSStream_Packet_Flush(
     pThis->Xb_Status = 0;
     return false;
 }
+
+bool DSStream_Packet_Flush(
+    xbox::X_CDirectSoundStream* pThis
+    )
+{
+    bool isBusy = DSStream_Packet_Flush_Internal(pThis);
+    DSStream_Packet_Schedule(pThis);
+    return isBusy;
+}
+
+static REFERENCE_TIME DSStream_Packet_NextWork(
+    xbox::X_CDirectSoundStream* pThis,
+    REFERENCE_TIME              rtNow
+    )
+{
+    if (pThis->Host_BufferPacketArray.size() == 0) {
+        return DSSTREAM_WORK_IDLE;
+    }
+
+    REFERENCE_TIME rtNextWork;
+    // Flush is waiting for its time stamp, or for host's audio to stop playing.
+    if ((pThis->EmuFlags & DSE_FLAG_FLUSH_ASYNC) > 0) {
+        rtNextWork = pThis->Xb_rtFlushEx;
+    }
+    // Paused packets have been prefilled already, only a pause time stamp needs the worker.
+    else if ((pThis->EmuFlags & DSE_FLAG_PAUSE) > 0 ||
+             (pThis->EmuFlags & DSE_FLAG_SYNCHPLAYBACK_CONTROL) > 0) {
+        if (pThis->Xb_rtPauseEx == 0LL) {
+            return DSSTREAM_WORK_IDLE;
+        }
+        rtNextWork = pThis->Xb_rtPauseEx;
+    }
+    else if (pThis->Host_isProcessing) {
+        vector_hvp_iterator packetCurrent = pThis->Host_BufferPacketArray.begin();
+        rtNextWork = rtNow + DSStream_Packet_TimeUntilWork(packetCurrent->xmp_data.dwMaxSize, packetCurrent->bufPlayed,
+                                                           packetCurrent->bufWrittenBytes, pThis->EmuBufferDesc.lpwfxFormat->nAvgBytesPerSec);
+    }
+    // Stopped with packets left (end of stream), only Process, Pause(Ex) or SynchPlayback can start it again.
+    else {
+        return DSSTREAM_WORK_IDLE;
+    }
+
+    return DSStream_Packet_ClampNextWork(rtNextWork, rtNow);
+}
+
+void DSStream_Packet_Schedule(
+    xbox::X_CDirectSoundStream* pThis
+    )
+{
+    xbox::LARGE_INTEGER getTime;
+    xbox::KeQuerySystemTime(&getTime);
+    pThis->Host_rtNextWork = DSStream_Packet_NextWork(pThis, getTime.QuadPart);
+
+    // NOTE: g_rtDSoundWorkerNextWork is zero while the worker thread itself is processing streams.
+    if (pThis->Host_rtNextWork < g_rtDSoundWorkerNextWork && g_hDSoundWorkerEvent != nullptr) {
+        g_rtDSoundWorkerNextWork = pThis->Host_rtNextWork;
+        SetEvent(g_hDSoundWorkerEvent);
+    }
+}
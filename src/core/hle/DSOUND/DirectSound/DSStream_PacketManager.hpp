@@ -27,9 +27,14 @@
 #include <vector>
 
 #include "DirectSound.hpp"
+#include "DSStream_Schedule.hpp"
 
 #define vector_hvp_iterator std::vector<xbox::host_voice_packet>::iterator
 
+// PCM packets don't need any conversion, so read them straight from title's packet buffer, which must stay
+// untouched until the packet is completed anyway. Disable to copy them at submission time instead.
+#define DSSTREAM_ALIAS_GUEST_PCM 1
+
 extern void DSStream_Packet_Clear(
     vector_hvp_iterator        &buffer,
     DWORD                       status,
@@ -42,3 +47,7 @@ extern bool DSStream_Packet_Process(xbox::X_CDirectSoundStream* pThis);
 extern void DSStream_Packet_FlushEx_Reset(xbox::X_CDirectSoundStream* pThis);
 
 extern bool DSStream_Packet_Flush(xbox::X_CDirectSoundStream* pThis);
+
+// Computes when the worker thread next needs to process the stream (packet completion, partial
+// upload, pause or flush time stamp), and wakes the worker up if it would otherwise sleep past it.
+extern void DSStream_Packet_Schedule(xbox::X_CDirectSoundStream* pThis);
@@ -0,0 +1,68 @@
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+#pragma once
+
+// Stream worker scheduling, kept free of DirectSound and kernel dependencies so
+// cxbxr-dsstreambench can use the very same rules as DSStream_PacketManager.
+
+#include <cstdint>
+
+// Host_rtNextWork value of a stream with nothing to do until the title calls in (no packets, paused or stopped).
+#define DSSTREAM_WORK_IDLE INT64_MAX
+// The worker thread looks at a given stream at most this often (in 100ns units, so 4 ms).
+// Test case: Gauntlet Dark Legacy, intro videos starve if streams are processed every millisecond.
+#define DSSTREAM_WORK_MIN_INTERVAL 40000LL
+
+// Time (in 100ns units) until the playing packet needs the worker again : when the packet is completed,
+// or when DSStream_Packet_UploadPartial needs to upload more of it, whichever comes first.
+static inline int64_t DSStream_Packet_TimeUntilWork(
+    uint32_t dwMaxSize,
+    uint32_t bufPlayed,
+    uint32_t bufWrittenBytes,
+    uint32_t dwAvgBytesPerSec
+    )
+{
+    // Bytes left until the current packet is completed...
+    uint32_t dwBytes = dwMaxSize - bufPlayed;
+    // ...or until one second worth of uploaded data is left to play.
+    if (bufWrittenBytes < dwMaxSize) {
+        uint32_t dwUploadAhead = bufPlayed + dwAvgBytesPerSec;
+        uint32_t dwBytesUpload = (bufWrittenBytes > dwUploadAhead) ? bufWrittenBytes - dwUploadAhead : 0;
+        if (dwBytesUpload < dwBytes) {
+            dwBytes = dwBytesUpload;
+        }
+    }
+    return (int64_t)dwBytes * 10000000LL / dwAvgBytesPerSec;
+}
+
+// Clamps a stream's next work time, so the worker doesn't revisit it more often than DSSTREAM_WORK_MIN_INTERVAL
+static inline int64_t DSStream_Packet_ClampNextWork(
+    int64_t rtNextWork,
+    int64_t rtNow
+    )
+{
+    if (rtNextWork < rtNow + DSSTREAM_WORK_MIN_INTERVAL) {
+        return rtNow + DSSTREAM_WORK_MIN_INTERVAL;
+    }
+    return rtNextWork;
+}
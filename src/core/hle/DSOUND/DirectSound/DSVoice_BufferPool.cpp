@@ -0,0 +1,112 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  (c) 2017-2020 RadWolfie
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+#include <cstdlib>
+#include <vector>
+
+#include "DSVoice_BufferPool.hpp"
+
+#define DSVOICE_POOL_CLASS_COUNT 11 // DSVOICE_POOL_MIN_SIZE << 10 == DSVOICE_POOL_MAX_SIZE
+// Free blocks kept per size class, in bytes (at least two blocks of each class are kept).
+#define DSVOICE_POOL_CLASS_KEEP 0x800000
+
+static std::vector<void *> g_DSVoicePoolFree[DSVOICE_POOL_CLASS_COUNT];
+static DSVoicePoolStats g_DSVoicePoolStats = {};
+
+// Returns the size class for the given size, or -1 if it bypasses the pool.
+static int DSVoice_Pool_GetClass(uint32_t dwSize)
+{
+    if (dwSize > DSVOICE_POOL_MAX_SIZE) {
+        return -1;
+    }
+
+    int sizeClass = 0;
+    uint32_t dwClassSize = DSVOICE_POOL_MIN_SIZE;
+    while (dwClassSize < dwSize) {
+        dwClassSize <<= 1;
+        sizeClass++;
+    }
+    return sizeClass;
+}
+
+void *DSVoice_Pool_Alloc(uint32_t dwSize)
+{
+    g_DSVoicePoolStats.Allocs++;
+
+    int sizeClass = DSVoice_Pool_GetClass(dwSize);
+    if (sizeClass < 0) {
+        g_DSVoicePoolStats.Bypassed++;
+        return malloc(dwSize);
+    }
+
+    std::vector<void *> &freeBlocks = g_DSVoicePoolFree[sizeClass];
+    if (!freeBlocks.empty()) {
+        void *pBuffer = freeBlocks.back();
+        freeBlocks.pop_back();
+        g_DSVoicePoolStats.Reused++;
+        return pBuffer;
+    }
+
+    return malloc(DSVOICE_POOL_MIN_SIZE << sizeClass);
+}
+
+void DSVoice_Pool_Free(void *pBuffer, uint32_t dwSize)
+{
+    if (pBuffer == nullptr) {
+        return;
+    }
+
+    int sizeClass = DSVoice_Pool_GetClass(dwSize);
+    if (sizeClass < 0) {
+        free(pBuffer);
+        return;
+    }
+
+    std::vector<void *> &freeBlocks = g_DSVoicePoolFree[sizeClass];
+    size_t keepCount = DSVOICE_POOL_CLASS_KEEP / (DSVOICE_POOL_MIN_SIZE << sizeClass);
+    if (freeBlocks.size() < keepCount || freeBlocks.size() < 2) {
+        freeBlocks.push_back(pBuffer);
+    } else {
+        g_DSVoicePoolStats.Released++;
+        free(pBuffer);
+    }
+}
+
+bool DSVoice_Pool_CanResize(uint32_t dwSizeOld, uint32_t dwSizeNew)
+{
+    int sizeClass = DSVoice_Pool_GetClass(dwSizeOld);
+    if (sizeClass >= 0 && sizeClass == DSVoice_Pool_GetClass(dwSizeNew)) {
+        g_DSVoicePoolStats.Kept++;
+        return true;
+    }
+    return false;
+}
+
+DSVoicePoolStats DSVoice_Pool_GetStats()
+{
+    return g_DSVoicePoolStats;
+}
@@ -0,0 +1,58 @@
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  (c) 2017-2020 RadWolfie
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+#pragma once
+
+#include <cstdint>
+
+// Size-classed pool for emulated voice storage : the xbox buffer cache of DirectSoundBuffers, and the
+// packet data of DirectSoundStreams. Titles which resize their buffers or stream packets every frame
+// would otherwise go through malloc/free (and copy the whole buffer) for each of them.
+// Blocks are rounded up to a power of two, from DSVOICE_POOL_MIN_SIZE up to DSVOICE_POOL_MAX_SIZE;
+// bigger requests bypass the pool. Callers must hold g_DSoundMutex.
+// Note : Kept free of Windows dependencies, so cxbxr-voicepoolbench can check it.
+#define DSVOICE_POOL_MIN_SIZE 0x1000
+#define DSVOICE_POOL_MAX_SIZE 0x400000
+
+typedef struct _DSVoicePoolStats
+{
+    uint64_t Allocs;   // DSVoice_Pool_Alloc calls...
+    uint64_t Reused;   // ...served with a block from the pool, instead of malloc
+    uint64_t Bypassed; // ...larger than DSVOICE_POOL_MAX_SIZE
+    uint64_t Kept;     // Resizes which kept their block (see DSVoice_Pool_CanResize)
+    uint64_t Released; // Blocks given back to the host, as the pool held enough of their size already
+}
+DSVoicePoolStats;
+
+// Returns a block for at least dwSize bytes, content is undefined.
+extern void *DSVoice_Pool_Alloc(uint32_t dwSize);
+
+// Returns the block to the pool, dwSize must be the size it was allocated (or resized) for.
+extern void DSVoice_Pool_Free(void *pBuffer, uint32_t dwSize);
+
+// Whether a block allocated for dwSizeOld can hold dwSizeNew bytes as is (counted as kept if so).
+extern bool DSVoice_Pool_CanResize(uint32_t dwSizeOld, uint32_t dwSizeNew);
+
+// Counters since startup; Reused + Kept is the number of allocations (and copies) the pool avoided.
+extern DSVoicePoolStats DSVoice_Pool_GetStats();
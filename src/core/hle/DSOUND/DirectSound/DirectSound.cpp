@@ -141,6 +141,7 @@ HRESULT WINAPI xbox::EMUPATCH(DirectSoundCreate)
     HRESULT hRet = DS_OK;
 
     if (!initialized) {
+        g_hDSoundWorkerEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
         dsound_thread = std::thread(dsound_thread_worker, nullptr);
     }
 
@@ -378,27 +379,43 @@ VOID WINAPI xbox::EMUPATCH(DirectSoundDoWork)()
     DirectSoundDoWork_Buffer(getTime);
 
     // Actually, DirectSoundStream need to process buffer packets here.
-    DirectSoundDoWork_Stream(getTime);
+    DirectSoundDoWork_Stream(getTime, false);
 
     return;
 }
+
+// Longest time the worker thread sleeps without any stream needing it, in milliseconds.
+#define DSOUND_WORKER_MAX_WAIT_MS 300
+
 // For Async process purpose only
 static void dsound_thread_worker(LPVOID nullPtr)
 {
 	SetThreadAffinityMask(GetCurrentThread(), g_CPUOthers);
 
     while (true) {
-        // Testcase: Gauntlet Dark Legacy, if Sleep(1) then intro videos start to starved often
-        // unless console is open with logging enabled. This is the cause of stopping intro videos often.
-        Sleep(300);
+        DWORD dwWaitMs;
         // Enforce mutex guard lock only occur inside below bracket for proper compile build.
         {
             DSoundMutexGuardLock;
 
             xbox::LARGE_INTEGER getTime;
             xbox::KeQuerySystemTime(&getTime);
-            DirectSoundDoWork_Stream(getTime);
+
+            // Only process streams which are due; each of them is rescheduled to its next packet completion or
+            // partial upload, and titles wake the worker up earlier when they submit packets (see DSStream_Packet_Schedule).
+            g_rtDSoundWorkerNextWork = 0LL;
+            REFERENCE_TIME rtNextWork = DirectSoundDoWork_Stream(getTime, true);
+            REFERENCE_TIME rtMaxWait = getTime.QuadPart + (REFERENCE_TIME)DSOUND_WORKER_MAX_WAIT_MS * 10000;
+            if (rtNextWork > rtMaxWait) {
+                rtNextWork = rtMaxWait;
+            }
+            g_rtDSoundWorkerNextWork = rtNextWork;
+
+            // Round up, so the earliest stream is due by the time the worker wakes up.
+            REFERENCE_TIME rtWait = rtNextWork - getTime.QuadPart;
+            dwWaitMs = (rtWait > 0) ? (DWORD)((rtWait + 9999) / 10000) : 0;
         }
+        WaitForSingleObject(g_hDSoundWorkerEvent, dwWaitMs);
     }
 }
 
@@ -107,6 +107,8 @@ struct EmuDirectSoundBuffer
     DSoundBuffer_Lock       X_lock;
     REFERENCE_TIME          Xb_rtPauseEx;
     REFERENCE_TIME          Xb_rtStopEx;
+    bool                    Host_isPendingWork; // Listed in g_pDSoundBufferPendingWork
+    DWORD                   Host_dwCacheIndex; // Position in g_pDSoundBufferCache
     LONG                    Xb_VolumeMixbin;
     X_DSENVOLOPEDESC        Xb_EnvolopeDesc;
     X_DSVOICEPROPS          Xb_VoiceProperties;
@@ -192,6 +194,7 @@ struct host_voice_packet {
     DWORD   bufWrittenBytes;
     bool    isPlayed;
     bool    isStreamEnd;
+    bool    isGuestData; // pBuffer_data is title's packet buffer, see DSSTREAM_ALIAS_GUEST_PCM
 };
 
 // ******************************************************************
@@ -274,6 +277,8 @@ class X_CDirectSoundStream
         std::vector<struct host_voice_packet>   Host_BufferPacketArray;
         DWORD                                   Host_dwWriteOffsetNext;
         bool                                    Host_isProcessing;
+        REFERENCE_TIME                          Host_rtNextWork; // See DSStream_Packet_Schedule
+        DWORD                                   Host_dwCacheIndex; // Position in g_pDSoundStreamCache
         LPFNXMOCALLBACK                         Xb_lpfnCallback;
         LPVOID                                  Xb_lpvContext;
         REFERENCE_TIME                          Xb_rtFlushEx;
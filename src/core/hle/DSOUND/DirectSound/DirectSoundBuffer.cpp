@@ -58,11 +58,18 @@
 // ******************************************************************
 void DirectSoundDoWork_Buffer(xbox::LARGE_INTEGER &time)
 {
-
-    vector_ds_buffer::iterator ppDSBuffer = g_pDSoundBufferCache.begin();
-    for (; ppDSBuffer != g_pDSoundBufferCache.end(); ppDSBuffer++) {
+    // Only buffers with an outstanding host lock have anything to do here, see IDirectSoundBuffer_Lock.
+    vector_ds_buffer::iterator ppDSBuffer = g_pDSoundBufferPendingWork.begin();
+    while (ppDSBuffer != g_pDSoundBufferPendingWork.end()) {
         xbox::EmuDirectSoundBuffer* pThis = ((*ppDSBuffer)->emuDSBuffer);
-        if (pThis->Host_lock.pLockPtr1 == nullptr || pThis->EmuBufferToggle != xbox::X_DSB_TOGGLE_DEFAULT) {
+        // Title has unlocked it in the meantime.
+        if (pThis->Host_lock.pLockPtr1 == nullptr) {
+            pThis->Host_isPendingWork = false;
+            ppDSBuffer = g_pDSoundBufferPendingWork.erase(ppDSBuffer);
+            continue;
+        }
+        if (pThis->EmuBufferToggle != xbox::X_DSB_TOGGLE_DEFAULT) {
+            ppDSBuffer++;
             continue;
         }
         // However there's a chance of locked buffers has been set which needs to be unlock.
@@ -86,6 +93,9 @@ void DirectSoundDoWork_Buffer(xbox::LARGE_INTEGER &time)
             pThis->Xb_rtStopEx = 0LL;
             pThis->EmuDirectSoundBuffer8->Stop();
         }
+
+        pThis->Host_isPendingWork = false;
+        ppDSBuffer = g_pDSoundBufferPendingWork.erase(ppDSBuffer);
     }
 }
 
@@ -116,16 +126,19 @@ xbox::EmuDirectSoundBuffer::~EmuDirectSoundBuffer()
     }
 
     // remove cache entry
-    vector_ds_buffer::iterator ppDSBuffer = std::find(g_pDSoundBufferCache.begin(), g_pDSoundBufferCache.end(), this->pHybridThis);
-    if (ppDSBuffer != g_pDSoundBufferCache.end()) {
-        g_pDSoundBufferCache.erase(ppDSBuffer);
+    DSoundBufferCacheRemove(this->pHybridThis);
+    if (this->Host_isPendingWork) {
+        vector_ds_buffer::iterator ppDSBuffer = std::find(g_pDSoundBufferPendingWork.begin(), g_pDSoundBufferPendingWork.end(), this->pHybridThis);
+        if (ppDSBuffer != g_pDSoundBufferPendingWork.end()) {
+            g_pDSoundBufferPendingWork.erase(ppDSBuffer);
+        }
     }
 
     if (this->EmuBufferDesc.lpwfxFormat != nullptr) {
         free(this->EmuBufferDesc.lpwfxFormat);
     }
     if (this->X_BufferCache != xbox::zeroptr && (this->EmuFlags & DSE_FLAG_BUFFER_EXTERNAL) == 0) {
-        free(this->X_BufferCache);
+        DSVoice_Pool_Free(this->X_BufferCache, this->X_BufferCacheSize);
         DSoundSGEMemDealloc(this->X_BufferCacheSize);
     }
 }
@@ -219,6 +232,8 @@ HRESULT WINAPI xbox::EMUPATCH(DirectSoundCreateBuffer)
         DSoundBufferSetDefault(pEmuBuffer, 0, pdsbd->dwFlags);
         pEmuBuffer->Host_lock = { 0 };
         pEmuBuffer->Xb_rtStopEx = 0LL;
+        pEmuBuffer->Host_isPendingWork = false;
+        pEmuBuffer->Host_dwCacheIndex = 0;
 
         DSoundBufferRegionSetDefault(pEmuBuffer);
 
@@ -251,7 +266,7 @@ HRESULT WINAPI xbox::EMUPATCH(DirectSoundCreateBuffer)
             HybridDirectSoundBuffer_SetVolume(pEmuBuffer->EmuDirectSoundBuffer8, 0L, pEmuBuffer->EmuFlags,
                 pEmuBuffer->Xb_VolumeMixbin, pHybridBuffer->p_CDSVoice);
 
-            g_pDSoundBufferCache.push_back(pHybridBuffer);
+            DSoundBufferCacheAdd(pHybridBuffer);
         }
     }
 
@@ -463,6 +478,12 @@ HRESULT WINAPI xbox::EMUPATCH(IDirectSoundBuffer_Lock)
         CxbxKrnlCleanup("IDirectSoundBuffer_Lock Failed!");
     }
 
+    // Let DirectSoundDoWork_Buffer unlock it, if the title doesn't.
+    if (!pThis->Host_isPendingWork) {
+        pThis->Host_isPendingWork = true;
+        g_pDSoundBufferPendingWork.push_back(pHybridThis);
+    }
+
     // Host lock position
     pThis->Host_lock.dwLockOffset = pcmOffset;
     pThis->Host_lock.dwLockFlags = dwFlags;
@@ -769,13 +790,18 @@ HRESULT WINAPI xbox::EMUPATCH(IDirectSoundBuffer_SetBufferData)
         // Confirmed it perform a reset to default.
         DSoundBufferRegionSetDefault(pThis);
 
+        // Title's buffer must not be resized (nor freed later on), start over with an internal one.
+        if ((pThis->EmuFlags & DSE_FLAG_BUFFER_EXTERNAL) > 0) {
+            pThis->X_BufferCache = xbox::zeroptr;
+            pThis->X_BufferCacheSize = 0;
+            pThis->EmuFlags &= ~DSE_FLAG_BUFFER_EXTERNAL;
+        }
+
         GenerateXboxBufferCache(pThis->EmuBufferDesc, pThis->EmuFlags, dwBufferBytes, &pThis->X_BufferCache, pThis->X_BufferCacheSize);
 
         // Copy if given valid pointer.
         memcpy_s(pThis->X_BufferCache, pThis->X_BufferCacheSize, pvBufferData, dwBufferBytes);
 
-        pThis->EmuFlags  ^= DSE_FLAG_BUFFER_EXTERNAL;
-
         DSoundDebugMuteFlag(pThis->X_BufferCacheSize, pThis->EmuFlags);
 
         // Only perform a resize, for lock emulation purpose.
@@ -784,7 +810,7 @@ HRESULT WINAPI xbox::EMUPATCH(IDirectSoundBuffer_SetBufferData)
     } else if (pvBufferData != xbox::zeroptr) {
         // Free internal buffer cache if exist
         if ((pThis->EmuFlags & DSE_FLAG_BUFFER_EXTERNAL) == 0) {
-            free(pThis->X_BufferCache);
+            DSVoice_Pool_Free(pThis->X_BufferCache, pThis->X_BufferCacheSize);
             DSoundSGEMemDealloc(pThis->X_BufferCacheSize);
         }
         pThis->X_BufferCache = pvBufferData;
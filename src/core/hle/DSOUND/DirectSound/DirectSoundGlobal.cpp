@@ -39,6 +39,9 @@ std::recursive_mutex         g_DSoundMutex;
 
 vector_ds_buffer                    g_pDSoundBufferCache;
 vector_ds_stream                    g_pDSoundStreamCache;
+vector_ds_buffer                    g_pDSoundBufferPendingWork;
+HANDLE                              g_hDSoundWorkerEvent = nullptr;
+REFERENCE_TIME                      g_rtDSoundWorkerNextWork = 0LL;
 LPDIRECTSOUND8               g_pDSound8 = nullptr; //This is necessary in order to allow share with EmuDSoundInline.hpp
 LPDIRECTSOUNDBUFFER          g_pDSoundPrimaryBuffer = nullptr;
 //TODO: RadWolfie - How to implement support if primary does not permit it for DSP usage?
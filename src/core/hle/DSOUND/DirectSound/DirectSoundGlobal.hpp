@@ -49,6 +49,11 @@ extern std::recursive_mutex         g_DSoundMutex;
 #define vector_ds_stream std::vector<xbox::X_CDirectSoundStream*>
 extern vector_ds_buffer                    g_pDSoundBufferCache;
 extern vector_ds_stream                    g_pDSoundStreamCache;
+// Buffers with an outstanding host lock, for DirectSoundDoWork_Buffer
+extern vector_ds_buffer                    g_pDSoundBufferPendingWork;
+// Stream worker thread wake up event, and when it is going to wake up on its own (see dsound_thread_worker)
+extern HANDLE                              g_hDSoundWorkerEvent;
+extern REFERENCE_TIME                      g_rtDSoundWorkerNextWork;
 extern LPDIRECTSOUND8               g_pDSound8; //This is necessary in order to allow share with EmuDSoundInline.hpp
 extern LPDIRECTSOUNDBUFFER          g_pDSoundPrimaryBuffer;
 //TODO: RadWolfie - How to implement support if primary does not permit it for DSP usage?
@@ -72,5 +77,40 @@ extern DWORD                               g_dwFree3DBuffers;
     EmuLog(LOG_LEVEL::WARNING, "An issue has been found. Please report game title and console's output of return result," \
     " function, and file name to https://github.com/Cxbx-Reloaded/Cxbx-Reloaded/issues/485"); } return hRet; }
 
+// Buffer and stream caches are unordered, each entry knows its own position so that removal doesn't need to search.
+static inline void DSoundBufferCacheAdd(xbox::XbHybridDSBuffer* pHybridBuffer)
+{
+    pHybridBuffer->emuDSBuffer->Host_dwCacheIndex = (DWORD)g_pDSoundBufferCache.size();
+    g_pDSoundBufferCache.push_back(pHybridBuffer);
+}
+
+static inline void DSoundBufferCacheRemove(xbox::XbHybridDSBuffer* pHybridBuffer)
+{
+    DWORD index = pHybridBuffer->emuDSBuffer->Host_dwCacheIndex;
+    if (index >= g_pDSoundBufferCache.size() || g_pDSoundBufferCache[index] != pHybridBuffer) {
+        return;
+    }
+    g_pDSoundBufferCache[index] = g_pDSoundBufferCache.back();
+    g_pDSoundBufferCache[index]->emuDSBuffer->Host_dwCacheIndex = index;
+    g_pDSoundBufferCache.pop_back();
+}
+
+static inline void DSoundStreamCacheAdd(xbox::X_CDirectSoundStream* pStream)
+{
+    pStream->Host_dwCacheIndex = (DWORD)g_pDSoundStreamCache.size();
+    g_pDSoundStreamCache.push_back(pStream);
+}
+
+static inline void DSoundStreamCacheRemove(xbox::X_CDirectSoundStream* pStream)
+{
+    DWORD index = pStream->Host_dwCacheIndex;
+    if (index >= g_pDSoundStreamCache.size() || g_pDSoundStreamCache[index] != pStream) {
+        return;
+    }
+    g_pDSoundStreamCache[index] = g_pDSoundStreamCache.back();
+    g_pDSoundStreamCache[index]->Host_dwCacheIndex = index;
+    g_pDSoundStreamCache.pop_back();
+}
+
 extern void DirectSoundDoWork_Buffer(xbox::LARGE_INTEGER& time);
-extern void DirectSoundDoWork_Stream(xbox::LARGE_INTEGER& time);
+extern REFERENCE_TIME DirectSoundDoWork_Stream(xbox::LARGE_INTEGER& time, bool bDueOnly);
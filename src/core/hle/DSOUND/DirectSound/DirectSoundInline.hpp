@@ -29,8 +29,10 @@
 #include <mutex>
 
 #include "common/XADPCM.h"
+#include "common/audio/XADPCMDecoder.h"
 #include "core/hle/DSOUND/XbDSoundTypes.h"
 #include "core/hle/DSOUND/common/windows/WFXformat.hpp"
+#include "DSVoice_BufferPool.hpp"
 
 #include <mmreg.h>
 
@@ -78,10 +80,15 @@ static inline void DSoundDebugMuteFlag(DWORD Xb_bufferBytes, DWORD &EmuFlags) {
 #define DSoundDebugMuteFlag
 #endif
 
-static void DSoundBufferOutputXBtoHost(DWORD emuFlags, DSBUFFERDESC &DSBufferDesc, LPVOID pXBaudioPtr, DWORD dwXBAudioBytes, LPVOID pPCaudioPtr, DWORD dwPCMAudioBytes) {
+// NOTE: bStaticData is set for buffer (not stream) uploads, which are likely to repeat the same content
+static void DSoundBufferOutputXBtoHost(DWORD emuFlags, DSBUFFERDESC &DSBufferDesc, LPVOID pXBaudioPtr, DWORD dwXBAudioBytes, LPVOID pPCaudioPtr, DWORD dwPCMAudioBytes, bool bStaticData) {
     if ((emuFlags & DSE_FLAG_XADPCM) > 0) {
 
-        TXboxAdpcmDecoder_Decode_Memory((uint8_t*)pXBaudioPtr, dwXBAudioBytes, (uint8_t*)pPCaudioPtr, DSBufferDesc.lpwfxFormat->nChannels);
+        if (bStaticData) {
+            XADPCM_DecodeCached((uint8_t*)pXBaudioPtr, dwXBAudioBytes, (uint8_t*)pPCaudioPtr, DSBufferDesc.lpwfxFormat->nChannels);
+        } else {
+            XADPCM_Decode((uint8_t*)pXBaudioPtr, dwXBAudioBytes, (uint8_t*)pPCaudioPtr, DSBufferDesc.lpwfxFormat->nChannels);
+        }
 
     // PCM format, no changes requirement.
     } else {
@@ -101,20 +108,25 @@ static inline void GenerateXboxBufferCache(
     if (X_BufferCacheSize != X_BufferSizeRequest) {
         // Check if buffer cache exist, then copy over old ones.
         if (*X_BufferCache != xbox::zeroptr && (dwEmuFlags & DSE_FLAG_BUFFER_EXTERNAL) == 0) {
-            LPVOID tempBuffer = *X_BufferCache;
-            *X_BufferCache = malloc(X_BufferSizeRequest);
-
             // This will perform partial alloc/dealloc instead of call twice for alloc and dealloc functions.
             DSoundSGEMemAlloc(X_BufferSizeRequest - X_BufferCacheSize);
 
-            // Don't copy over the limit.
-            if (X_BufferCacheSize > X_BufferSizeRequest) {
-                X_BufferCacheSize = X_BufferSizeRequest;
+            // Pool's block may already be big enough, then there's nothing to copy.
+            if (!DSVoice_Pool_CanResize(X_BufferCacheSize, X_BufferSizeRequest)) {
+                LPVOID tempBuffer = *X_BufferCache;
+                *X_BufferCache = DSVoice_Pool_Alloc(X_BufferSizeRequest);
+
+                // Don't copy over the limit.
+                DWORD copySize = X_BufferCacheSize;
+                if (copySize > X_BufferSizeRequest) {
+                    copySize = X_BufferSizeRequest;
+                }
+                memcpy_s(*X_BufferCache, X_BufferSizeRequest, tempBuffer, copySize);
+                DSVoice_Pool_Free(tempBuffer, X_BufferCacheSize);
             }
-            memcpy_s(*X_BufferCache, X_BufferSizeRequest, tempBuffer, X_BufferCacheSize);
-            free(tempBuffer);
         } else {
-            *X_BufferCache = calloc(1, X_BufferSizeRequest);
+            *X_BufferCache = DSVoice_Pool_Alloc(X_BufferSizeRequest);
+            memset(*X_BufferCache, 0, X_BufferSizeRequest);
             DSoundSGEMemAlloc(X_BufferSizeRequest);
         }
         X_BufferCacheSize = X_BufferSizeRequest;
@@ -343,11 +355,11 @@ static inline void DSoundGenericUnlock(
 
 
         if (X_BufferCache != xbox::zeroptr) {
-            DSoundBufferOutputXBtoHost(dwEmuFlags, DSBufferDesc, ((PBYTE)X_BufferCache + X_Offset), X_dwLockBytes1, Host_lock.pLockPtr1, Host_lock.dwLockBytes1);
+            DSoundBufferOutputXBtoHost(dwEmuFlags, DSBufferDesc, ((PBYTE)X_BufferCache + X_Offset), X_dwLockBytes1, Host_lock.pLockPtr1, Host_lock.dwLockBytes1, true);
 
             if (Host_lock.pLockPtr2 != nullptr) {
 
-                DSoundBufferOutputXBtoHost(dwEmuFlags, DSBufferDesc, X_BufferCache, X_dwLockBytes2, Host_lock.pLockPtr2, Host_lock.dwLockBytes2);
+                DSoundBufferOutputXBtoHost(dwEmuFlags, DSBufferDesc, X_BufferCache, X_dwLockBytes2, Host_lock.pLockPtr2, Host_lock.dwLockBytes2, true);
             }
         }
 
@@ -87,8 +87,10 @@ xbox::X_CDirectSoundStream::_vtbl xbox::X_CDirectSoundStream::vtbl =
 // ******************************************************************
 // * patch: DirectSoundDoWork (stream)
 // ******************************************************************
-void DirectSoundDoWork_Stream(xbox::LARGE_INTEGER& time)
+REFERENCE_TIME DirectSoundDoWork_Stream(xbox::LARGE_INTEGER& time, bool bDueOnly)
 {
+    REFERENCE_TIME rtNextWork = DSSTREAM_WORK_IDLE;
+
     // Actually, DirectSoundStream need to process buffer packets here.
     vector_ds_stream::iterator ppDSStream = g_pDSoundStreamCache.begin();
     for (; ppDSStream != g_pDSoundStreamCache.end(); ppDSStream++) {
@@ -96,6 +98,13 @@ void DirectSoundDoWork_Stream(xbox::LARGE_INTEGER& time)
             continue;
         }
         xbox::X_CDirectSoundStream* pThis = (*ppDSStream);
+        // Worker thread only processes the streams which are due, see DSStream_Packet_Schedule.
+        if (bDueOnly && pThis->Host_rtNextWork > time.QuadPart) {
+            if (pThis->Host_rtNextWork < rtNextWork) {
+                rtNextWork = pThis->Host_rtNextWork;
+            }
+            continue;
+        }
         // TODO: Do we need this in async thread loop?
         if (pThis->Xb_rtPauseEx != 0LL && pThis->Xb_rtPauseEx <= time.QuadPart) {
             pThis->Xb_rtPauseEx = 0LL;
@@ -111,7 +120,13 @@ void DirectSoundDoWork_Stream(xbox::LARGE_INTEGER& time)
         } else {
             DSStream_Packet_Process(pThis);
         }
+        // Both of the above have rescheduled the stream.
+        if (pThis->Host_rtNextWork < rtNextWork) {
+            rtNextWork = pThis->Host_rtNextWork;
+        }
     }
+
+    return rtNextWork;
 }
 
 // ******************************************************************
@@ -151,10 +166,7 @@ ULONG WINAPI xbox::EMUPATCH(CDirectSoundStream_Release)
             }
 
             // remove cache entry
-            vector_ds_stream::iterator ppDSStream = std::find(g_pDSoundStreamCache.begin(), g_pDSoundStreamCache.end(), pThis);
-            if (ppDSStream != g_pDSoundStreamCache.end()) {
-                g_pDSoundStreamCache.erase(ppDSStream);
-            }
+            DSoundStreamCacheRemove(pThis);
 
             for (auto buffer = pThis->Host_BufferPacketArray.begin(); buffer != pThis->Host_BufferPacketArray.end();) {
                 DSStream_Packet_Clear(buffer, XMP_STATUS_RELEASE_CXBXR, nullptr, nullptr, pThis);
@@ -248,6 +260,8 @@ HRESULT WINAPI xbox::EMUPATCH(DirectSoundCreateStream)
         (*ppStream)->Host_dwWriteOffsetNext = 0;
         (*ppStream)->Host_dwLastWritePos = 0;
         (*ppStream)->Host_isProcessing = false;
+        (*ppStream)->Host_rtNextWork = DSSTREAM_WORK_IDLE;
+        (*ppStream)->Host_dwCacheIndex = 0;
         (*ppStream)->Xb_lpfnCallback = pdssd->lpfnCallback;
         (*ppStream)->Xb_lpvContext = pdssd->lpvContext;
         (*ppStream)->Xb_Status = 0;
@@ -278,7 +292,7 @@ HRESULT WINAPI xbox::EMUPATCH(DirectSoundCreateStream)
             HybridDirectSoundBuffer_SetVolume((*ppStream)->EmuDirectSoundBuffer8, 0L, (*ppStream)->EmuFlags,
                 (*ppStream)->Xb_VolumeMixbin, &(*ppStream)->Xb_Voice);
 
-            g_pDSoundStreamCache.push_back(*ppStream);
+            DSoundStreamCacheAdd(*ppStream);
         }
     }
 
@@ -422,6 +436,8 @@ HRESULT WINAPI xbox::EMUPATCH(CDirectSoundStream_FlushEx)
         else {
             pThis->EmuFlags ^= DSE_FLAG_ENVELOPE2;
         }
+
+        DSStream_Packet_Schedule(pThis);
     }
 
     return hRet;
@@ -561,6 +577,8 @@ HRESULT WINAPI xbox::EMUPATCH(CDirectSoundStream_Pause)
         DSStream_Packet_Process(pThis);
     }
 
+    DSStream_Packet_Schedule(pThis);
+
     return hRet;
 }
 
@@ -587,6 +605,13 @@ HRESULT WINAPI xbox::EMUPATCH(CDirectSoundStream_PauseEx)
     HRESULT hRet = HybridDirectSoundBuffer_Pause(pThis->EmuDirectSoundBuffer8, dwPause, pThis->EmuFlags, pThis->EmuPlayFlags, 
                                                 pThis->Host_isProcessing, rtTimestamp, pThis->Xb_rtPauseEx);
 
+    // A resumed stream isn't picked up by the worker thread on its own, see DSStream_Packet_Schedule.
+    if ((pThis->EmuFlags & DSE_FLAG_PAUSE) == 0 && !pThis->Host_isProcessing) {
+        DSStream_Packet_Process(pThis);
+    }
+
+    DSStream_Packet_Schedule(pThis);
+
     return hRet;
 }
 
@@ -619,10 +644,18 @@ HRESULT WINAPI xbox::EMUPATCH(CDirectSoundStream_Process)
             if (pThis->Host_BufferPacketArray.size() != pThis->X_MaxAttachedPackets) {
                 host_voice_packet packet_input;
                 packet_input.pBuffer_data = nullptr;
+                packet_input.isGuestData = false;
                 packet_input.xmp_data = *pInputBuffer;
                 packet_input.xmp_data.dwMaxSize = DSoundBufferGetPCMBufferSize(pThis->EmuFlags, pInputBuffer->dwMaxSize);
                 if (packet_input.xmp_data.dwMaxSize != 0) {
-                    packet_input.pBuffer_data = malloc(packet_input.xmp_data.dwMaxSize);
+#if DSSTREAM_ALIAS_GUEST_PCM
+                    packet_input.isGuestData = (pThis->EmuFlags & DSE_FLAG_XADPCM) == 0;
+#endif
+                    if (packet_input.isGuestData) {
+                        packet_input.pBuffer_data = pInputBuffer->pvBuffer;
+                    } else {
+                        packet_input.pBuffer_data = DSVoice_Pool_Alloc(packet_input.xmp_data.dwMaxSize);
+                    }
                     DSoundSGEMemAlloc(packet_input.xmp_data.dwMaxSize);
                 }
                 packet_input.nextWriteOffset = pThis->Host_dwWriteOffsetNext;
@@ -637,7 +670,9 @@ HRESULT WINAPI xbox::EMUPATCH(CDirectSoundStream_Process)
                 packet_input.isPlayed = false;
                 packet_input.isStreamEnd = false;
 
-                DSoundBufferOutputXBtoHost(pThis->EmuFlags, pThis->EmuBufferDesc, pInputBuffer->pvBuffer, pInputBuffer->dwMaxSize, packet_input.pBuffer_data, packet_input.xmp_data.dwMaxSize);
+                if (!packet_input.isGuestData) {
+                    DSoundBufferOutputXBtoHost(pThis->EmuFlags, pThis->EmuBufferDesc, pInputBuffer->pvBuffer, pInputBuffer->dwMaxSize, packet_input.pBuffer_data, packet_input.xmp_data.dwMaxSize, false);
+                }
 
                 pThis->Host_BufferPacketArray.push_back(packet_input);
 
@@ -30,6 +30,7 @@
 #include "core\kernel\support\Emu.h"
 #include "core\hle\D3D8\Direct3D9/Direct3D9.h"
 #include "core\hle\DSOUND\DirectSound\DirectSound.hpp"
+#include "core\hle\XGRAPHIC\XGraphic.h"
 #include "Patches.hpp"
 #include "Intercept.hpp"
 
@@ -353,6 +354,12 @@ std::map<const std::string, const xbox_patch_t> g_PatchTable = {
 	PATCH_ENTRY("XSetProcessQuantumLength", xbox::EMUPATCH(XSetProcessQuantumLength), PATCH_ALWAYS),
 	PATCH_ENTRY("timeKillEvent", xbox::EMUPATCH(timeKillEvent), PATCH_ALWAYS),
 	PATCH_ENTRY("timeSetEvent", xbox::EMUPATCH(timeSetEvent), PATCH_ALWAYS),
+
+	// XGRAPHIC
+	PATCH_ENTRY("XGSwizzleBox", xbox::EMUPATCH(XGSwizzleBox), PATCH_ALWAYS),
+	PATCH_ENTRY("XGSwizzleRect", xbox::EMUPATCH(XGSwizzleRect), PATCH_ALWAYS),
+	PATCH_ENTRY("XGUnswizzleBox", xbox::EMUPATCH(XGUnswizzleBox), PATCH_ALWAYS),
+	PATCH_ENTRY("XGUnswizzleRect", xbox::EMUPATCH(XGUnswizzleRect), PATCH_ALWAYS),
 };
 
 std::unordered_map<std::string, subhook::Hook> g_FunctionHooks;
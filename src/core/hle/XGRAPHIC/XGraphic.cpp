@@ -36,6 +36,7 @@
 #include "core\hle\XAPI\Xapi.h" // For EMUPATCH
 #include "core\hle\D3D8\XbD3D8Logging.h" // for log rendering of X_D3DFORMAT, etc.
 #include "core\hle\XGRAPHIC\XGraphic.h"
+#include "core\hle\D3D8\XbSwizzle.h"
 
 // ******************************************************************
 // * patch: XGIsSwizzledFormat
@@ -50,7 +51,6 @@ PVOID WINAPI xbox::EMUPATCH(XGIsSwizzledFormat)
 	RETURN(FALSE);
 }
 
-#if 0 // Leave unpatched
 // ******************************************************************
 // * patch: XGSwizzleRect
 // ******************************************************************
@@ -66,7 +66,6 @@ VOID WINAPI xbox::EMUPATCH(XGSwizzleRect)
     DWORD         BytesPerPixel
 )
 {
-
 	LOG_FUNC_BEGIN
 		LOG_FUNC_ARG(pSource)
 		LOG_FUNC_ARG(Pitch)
@@ -78,39 +77,31 @@ VOID WINAPI xbox::EMUPATCH(XGSwizzleRect)
 		LOG_FUNC_ARG(BytesPerPixel)
 		LOG_FUNC_END;
 
-    if(pRect == NULL && pPoint == NULL && Pitch == 0)
-    {
-        memcpy(pDest, pSource, Width*Height*BytesPerPixel);
-    }
-    else
-    {
-        if(pPoint != NULL && (pPoint->x != 0 || pPoint->y != 0))
-            CxbxKrnlCleanup("Temporarily unsupported swizzle (very easy fix)");
-
-        DWORD dwMaxY = Height;
-        DWORD dwChunkSize = Width;
-
-        uint8_t *pSrc = (uint8_t*)pSource;
-        uint8_t *pDst = (uint8_t*)pDest;
-
-        if(pRect != 0)
-        {
-            pSrc += pRect->top*Pitch;
-            pSrc += pRect->left;
-
-            dwMaxY = pRect->bottom - pRect->top;
-            dwChunkSize = pRect->right - pRect->left;
-        }
-
-        for(DWORD y=0;y<dwMaxY;y++)
-        {
-            memcpy(pSrc, pDst, dwChunkSize);
-            pSrc += Pitch;
-            pDst += Pitch;
-        }
-    }
+	// Without a rect, the whole texture is copied, and without a point, it goes to the top-left
+	RECT Rect = { 0, 0, (LONG)Width, (LONG)Height };
+	if (pRect != nullptr) {
+		Rect = *pRect;
+	}
+
+	POINT Point = { 0, 0 };
+	if (pPoint != nullptr) {
+		Point = *pPoint;
+	}
+
+	const DWORD RectWidth = Rect.right - Rect.left;
+	const DWORD RectHeight = Rect.bottom - Rect.top;
+	if (Pitch == 0) {
+		Pitch = RectWidth * BytesPerPixel;
+	}
+
+	SwizzleBox(
+		(uint8_t *)pSource + (Rect.top * Pitch) + (Rect.left * BytesPerPixel), Pitch, 0,
+		pDest, Width, Height, 1,
+		Point.x, Point.y, 0,
+		RectWidth, RectHeight, 1,
+		BytesPerPixel
+	);
 }
-#endif
 
 // ******************************************************************
 // * patch: XGSwizzleBox
@@ -142,41 +133,146 @@ VOID WINAPI xbox::EMUPATCH(XGSwizzleBox)
 		LOG_FUNC_ARG(BytesPerPixel)
 		LOG_FUNC_END;
 
-	if(pDest != (LPVOID) 0x80000000)
-	{
-		if(pBox == NULL && pPoint == NULL && RowPitch == 0 && SlicePitch == 0)
-		{
-			memcpy(pDest, pSource, Width*Height*Depth*BytesPerPixel);
-		}
-		else
-		{
-			if(pPoint != NULL && (pPoint->u != 0 || pPoint->v != 0 || pPoint->w != 0))
-				CxbxKrnlCleanup("Temporarily unsupported swizzle (very easy fix)");
-
-			DWORD dwMaxY = Height;
-			DWORD dwMaxZ = Depth;
-			DWORD dwChunkSize = Width;
-
-			uint8_t *pSrc = (uint8_t*)pSource;
-			uint8_t *pDst = (uint8_t*)pDest;
-
-			if(pBox != 0)
-			{
-				pSrc += pBox->Top*RowPitch;
-				pSrc += pBox->Left;
-
-				dwMaxY = pBox->Bottom - pBox->Top;
-				dwChunkSize = pBox->Right - pBox->Left;
-			}
-
-			for(DWORD y=0;y<dwMaxY;y++)
-			{
-				memcpy(pSrc, pDst, dwChunkSize);
-				pSrc += RowPitch;
-				pDst += RowPitch;
-			}
-        }
+	D3DBOX Box = { 0, 0, Width, Height, 0, Depth };
+	if (pBox != nullptr) {
+		Box = *pBox;
+	}
+
+	XGPOINT3D Point = { 0, 0, 0 };
+	if (pPoint != nullptr) {
+		Point = *pPoint;
+	}
+
+	const DWORD BoxWidth = Box.Right - Box.Left;
+	const DWORD BoxHeight = Box.Bottom - Box.Top;
+	const DWORD BoxDepth = Box.Back - Box.Front;
+	if (RowPitch == 0) {
+		RowPitch = BoxWidth * BytesPerPixel;
+	}
+
+	if (SlicePitch == 0) {
+		SlicePitch = RowPitch * BoxHeight;
+	}
+
+	SwizzleBox(
+		(uint8_t *)pSource + (Box.Front * SlicePitch) + (Box.Top * RowPitch) + (Box.Left * BytesPerPixel), RowPitch, SlicePitch,
+		pDest, Width, Height, Depth,
+		Point.u, Point.v, Point.w,
+		BoxWidth, BoxHeight, BoxDepth,
+		BytesPerPixel
+	);
+}
+
+// ******************************************************************
+// * patch: XGUnswizzleRect
+// ******************************************************************
+VOID WINAPI xbox::EMUPATCH(XGUnswizzleRect)
+(
+    LPCVOID       pSource,
+    DWORD         Width,
+    DWORD         Height,
+    LPCRECT       pRect,
+    LPVOID        pDest,
+    DWORD         Pitch,
+    CONST LPPOINT pPoint,
+    DWORD         BytesPerPixel
+)
+{
+	LOG_FUNC_BEGIN
+		LOG_FUNC_ARG(pSource)
+		LOG_FUNC_ARG(Width)
+		LOG_FUNC_ARG(Height)
+		LOG_FUNC_ARG(pRect)
+		LOG_FUNC_ARG(pDest)
+		LOG_FUNC_ARG(Pitch)
+		LOG_FUNC_ARG(pPoint)
+		LOG_FUNC_ARG(BytesPerPixel)
+		LOG_FUNC_END;
+
+	// Here the rect selects texels from the swizzled texture, and the point places them in the linear one
+	RECT Rect = { 0, 0, (LONG)Width, (LONG)Height };
+	if (pRect != nullptr) {
+		Rect = *pRect;
+	}
+
+	POINT Point = { 0, 0 };
+	if (pPoint != nullptr) {
+		Point = *pPoint;
+	}
+
+	const DWORD RectWidth = Rect.right - Rect.left;
+	const DWORD RectHeight = Rect.bottom - Rect.top;
+	if (Pitch == 0) {
+		Pitch = RectWidth * BytesPerPixel;
+	}
+
+	UnswizzleBox(
+		pSource, Width, Height, 1,
+		Rect.left, Rect.top, 0,
+		RectWidth, RectHeight, 1,
+		(uint8_t *)pDest + (Point.y * Pitch) + (Point.x * BytesPerPixel), Pitch, 0,
+		BytesPerPixel
+	);
+}
+
+// ******************************************************************
+// * patch: XGUnswizzleBox
+// ******************************************************************
+VOID WINAPI xbox::EMUPATCH(XGUnswizzleBox)
+(
+    LPCVOID          pSource,
+    DWORD            Width,
+    DWORD            Height,
+    DWORD            Depth,
+    CONST D3DBOX    *pBox,
+    LPVOID           pDest,
+    DWORD            RowPitch,
+    DWORD            SlicePitch,
+    CONST XGPOINT3D *pPoint,
+    DWORD            BytesPerPixel
+)
+{
+	LOG_FUNC_BEGIN
+		LOG_FUNC_ARG(pSource)
+		LOG_FUNC_ARG(Width)
+		LOG_FUNC_ARG(Height)
+		LOG_FUNC_ARG(Depth)
+		LOG_FUNC_ARG(pBox)
+		LOG_FUNC_ARG(pDest)
+		LOG_FUNC_ARG(RowPitch)
+		LOG_FUNC_ARG(SlicePitch)
+		LOG_FUNC_ARG(pPoint)
+		LOG_FUNC_ARG(BytesPerPixel)
+		LOG_FUNC_END;
+
+	D3DBOX Box = { 0, 0, Width, Height, 0, Depth };
+	if (pBox != nullptr) {
+		Box = *pBox;
+	}
+
+	XGPOINT3D Point = { 0, 0, 0 };
+	if (pPoint != nullptr) {
+		Point = *pPoint;
 	}
+
+	const DWORD BoxWidth = Box.Right - Box.Left;
+	const DWORD BoxHeight = Box.Bottom - Box.Top;
+	const DWORD BoxDepth = Box.Back - Box.Front;
+	if (RowPitch == 0) {
+		RowPitch = BoxWidth * BytesPerPixel;
+	}
+
+	if (SlicePitch == 0) {
+		SlicePitch = RowPitch * BoxHeight;
+	}
+
+	UnswizzleBox(
+		pSource, Width, Height, Depth,
+		Box.Left, Box.Top, Box.Front,
+		BoxWidth, BoxHeight, BoxDepth,
+		(uint8_t *)pDest + (Point.w * SlicePitch) + (Point.v * RowPitch) + (Point.u * BytesPerPixel), RowPitch, SlicePitch,
+		BytesPerPixel
+	);
 }
 
 // ******************************************************************
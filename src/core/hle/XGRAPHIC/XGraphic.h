@@ -45,7 +45,6 @@ PVOID WINAPI EMUPATCH(XGIsSwizzledFormat)
     X_D3DFORMAT     Format
 );
 
-#if 0 // Leave unpatched
 // ******************************************************************
 // * patch: XGSwizzleRect
 // ******************************************************************
@@ -60,7 +59,6 @@ VOID WINAPI EMUPATCH(XGSwizzleRect)
     CONST LPPOINT pPoint,
     DWORD         BytesPerPixel
 );
-#endif
 
 // ******************************************************************
 // * patch: XGSwizzleBox
@@ -79,6 +77,38 @@ VOID WINAPI EMUPATCH(XGSwizzleBox)
     DWORD            BytesPerPixel
 );
 
+// ******************************************************************
+// * patch: XGUnswizzleRect
+// ******************************************************************
+VOID WINAPI EMUPATCH(XGUnswizzleRect)
+(
+    LPCVOID       pSource,
+    DWORD         Width,
+    DWORD         Height,
+    LPCRECT       pRect,
+    LPVOID        pDest,
+    DWORD         Pitch,
+    CONST LPPOINT pPoint,
+    DWORD         BytesPerPixel
+);
+
+// ******************************************************************
+// * patch: XGUnswizzleBox
+// ******************************************************************
+VOID WINAPI EMUPATCH(XGUnswizzleBox)
+(
+    LPCVOID          pSource,
+    DWORD            Width,
+    DWORD            Height,
+    DWORD            Depth,
+    CONST D3DBOX    *pBox,
+    LPVOID           pDest,
+    DWORD            RowPitch,
+    DWORD            SlicePitch,
+    CONST XGPOINT3D *pPoint,
+    DWORD            BytesPerPixel
+);
+
 // ******************************************************************
 // * patch: XGWriteSurfaceOrTextureToXPR
 // ******************************************************************
@@ -81,6 +81,7 @@ namespace NtDll
 #include "EmuKrnlKi.h" // For KiRemoveTreeTimer(), KiInsertTreeTimer()
 #include "EmuKrnlKe.h"
 #include "core\kernel\support\EmuFile.h" // For IsEmuHandle(), NtStatusToString()
+#include "core\kernel\support\DpcQueue.h"
 #include "Timer.h"
 
 #include <chrono>
@@ -90,13 +91,8 @@ namespace NtDll
 
 // Copied over from Dxbx. 
 // TODO : Move towards thread-simulation based Dpc emulation
-typedef struct _DpcData {
-	CRITICAL_SECTION Lock;
-	HANDLE DpcEvent;
-	xbox::LIST_ENTRY DpcQueue; // TODO : Use KeGetCurrentPrcb()->DpcListHead instead
-} DpcData;
-
-DpcData g_DpcData = { 0 }; // Note : g_DpcData is initialized in InitDpcThread()
+// DPCs are run by the DISPATCH_LEVEL software interrupt, on the thread lowering the IRQL below it
+DpcQueue<xbox::KDPC> g_DpcQueue;
 
 xbox::ULONGLONG LARGE_INTEGER2ULONGLONG(xbox::LARGE_INTEGER value)
 {
@@ -274,54 +270,20 @@ xbox::VOID NTAPI xbox::KeInitializeTimer
 
 void ExecuteDpcQueue()
 {
-	xbox::PKDPC pkdpc;
-
-	// While we're working with the DpcQueue, we need to be thread-safe :
-	EnterCriticalSection(&(g_DpcData.Lock));
-
-//    if (g_DpcData._fShutdown)
-//        break; // while 
-
-//    Assert(g_DpcData._dwThreadId == GetCurrentThreadId());
-//    Assert(g_DpcData._dwDpcThreadId == 0);
-//    g_DpcData._dwDpcThreadId = g_DpcData._dwThreadId;
-//    Assert(g_DpcData._dwDpcThreadId != 0);
-
-	// Are there entries in the DpqQueue?
-	while (!IsListEmpty(&(g_DpcData.DpcQueue)))
-	{
-		// Extract the head entry and retrieve the containing KDPC pointer for it:
-		pkdpc = CONTAINING_RECORD(RemoveHeadList(&(g_DpcData.DpcQueue)), xbox::KDPC, DpcListEntry);
-		// Mark it as no longer linked into the DpcQueue
-		pkdpc->Inserted = FALSE;
+	g_DpcQueue.Run([](xbox::PKDPC pkdpc, const xbox::KDPC &Dpc) {
 		// Set DpcRoutineActive to support KeIsExecutingDpc:
 		KeGetCurrentPrcb()->DpcRoutineActive = TRUE; // Experimental
-		EmuLog(LOG_LEVEL::DEBUG, "Global DpcQueue, calling DPC at 0x%.8X", pkdpc->DeferredRoutine);
+		EmuLog(LOG_LEVEL::DEBUG, "Global DpcQueue, calling DPC at 0x%.8X", Dpc.DeferredRoutine);
 
-		// Call the Deferred Procedure  :
-		pkdpc->DeferredRoutine(
+		// Call the Deferred Procedure (with the arguments it had when it was taken off the queue) :
+		Dpc.DeferredRoutine(
 			pkdpc,
-			pkdpc->DeferredContext,
-			pkdpc->SystemArgument1,
-			pkdpc->SystemArgument2);
+			Dpc.DeferredContext,
+			Dpc.SystemArgument1,
+			Dpc.SystemArgument2);
 
 		KeGetCurrentPrcb()->DpcRoutineActive = FALSE; // Experimental
-	}
-
-//    Assert(g_DpcData._dwThreadId == GetCurrentThreadId());
-//    Assert(g_DpcData._dwDpcThreadId == g_DpcData._dwThreadId);
-//    g_DpcData._dwDpcThreadId = 0;
-	LeaveCriticalSection(&(g_DpcData.Lock));
-}
-
-void InitDpcThread()
-{
-	DWORD dwThreadId = 0;
-
-	InitializeCriticalSection(&(g_DpcData.Lock));
-	InitializeListHead(&(g_DpcData.DpcQueue));
-	EmuLogEx(CXBXR_MODULE::INIT, LOG_LEVEL::DEBUG, "Creating DPC event\n");
-	g_DpcData.DpcEvent = CreateEvent(/*lpEventAttributes=*/nullptr, /*bManualReset=*/FALSE, /*bInitialState=*/FALSE, /*lpName=*/nullptr);
+	});
 }
 
 #define XBOX_TSC_FREQUENCY 733333333 // Xbox Time Stamp Counter Frequency = 733333333 (CPU Clock)
@@ -361,10 +323,6 @@ void CxbxInitPerformanceCounters()
 	t *= HostClockFrequency;
 	t /= XBOX_ACPI_FREQUENCY;
 	NativeToXbox_FactorForAcpi = t;
-
-	// Let's initialize the Dpc handling thread too,
-	// here for now (should be called by our caller)
-	InitDpcThread();
 }
 
 // ******************************************************************
@@ -573,6 +531,15 @@ XBSYSAPI EXPORTNUM(99) xbox::NTSTATUS NTAPI xbox::KeDelayExecutionThread
 		LOG_FUNC_ARG(Interval)
 		LOG_FUNC_END;
 
+	// Short relative delays (like the 1 ms of XAPI Sleep(1)) would take a scheduler tick or more when
+	// left to NtDelayExecution, so wait on a high resolution timer instead when the host has one. This
+	// blocks like the host delay does, the thread must not spin (it could be anywhere in the title).
+	// Alertable waits still need the host to deliver APCs, and absolute (positive) or zero intervals
+	// keep their host semantics as well.
+	if (!Alertable && Interval->QuadPart < 0 && Timer_Wait(-Interval->QuadPart)) {
+		RETURN(STATUS_SUCCESS);
+	}
+
 	NTSTATUS ret = NtDll::NtDelayExecution(Alertable, (NtDll::LARGE_INTEGER*)Interval);
 
 	RETURN(ret);
@@ -1057,19 +1024,10 @@ XBSYSAPI EXPORTNUM(119) xbox::BOOLEAN NTAPI xbox::KeInsertQueueDpc
 		LOG_FUNC_ARG(SystemArgument2)
 		LOG_FUNC_END;
 
-	// For thread safety, enter the Dpc lock:
-	EnterCriticalSection(&(g_DpcData.Lock));
-	// TODO : Instead, disable interrupts - use KeRaiseIrql(HIGH_LEVEL, &(KIRQL)OldIrql) ?
-
-	BOOLEAN NeedsInsertion = (Dpc->Inserted == FALSE);
+	// Remember the arguments and link it into our DpcQueue (this doesn't wait for running DPCs) :
+	BOOLEAN NeedsInsertion = g_DpcQueue.Insert(Dpc, SystemArgument1, SystemArgument2);
 
 	if (NeedsInsertion) {
-		// Remember the arguments and link it into our DpcQueue :
-		Dpc->Inserted = TRUE;
-		Dpc->SystemArgument1 = SystemArgument1;
-		Dpc->SystemArgument2 = SystemArgument2;
-		InsertTailList(&(g_DpcData.DpcQueue), &(Dpc->DpcListEntry));
-		// TODO : Instead of DpcQueue, add the DPC to KeGetCurrentPrcb()->DpcListHead
 		// Signal the Dpc handling code there's work to do
 		HalRequestSoftwareInterrupt(DISPATCH_LEVEL);
 		// OpenXbox has this instead:
@@ -1077,10 +1035,6 @@ XBSYSAPI EXPORTNUM(119) xbox::BOOLEAN NTAPI xbox::KeInsertQueueDpc
 		//	pKPRCB->DpcInterruptRequested = TRUE;
 	}
 
-	// Thread-safety is no longer required anymore
-	LeaveCriticalSection(&(g_DpcData.Lock));
-	// TODO : Instead, enable interrupts - use KeLowerIrql(OldIrql) ?
-
 	RETURN(NeedsInsertion);
 }
 
@@ -1473,21 +1427,8 @@ XBSYSAPI EXPORTNUM(137) xbox::BOOLEAN NTAPI xbox::KeRemoveQueueDpc
 {
 	LOG_FUNC_ONE_ARG(Dpc);
 
-	// TODO : Instead of using a lock, emulate the Clear Interrupt Flag (cli) instruction
-	// See https://msdn.microsoft.com/is-is/library/y14401ab(v=vs.80).aspx
-	EnterCriticalSection(&(g_DpcData.Lock));
-
-	BOOLEAN Inserted = Dpc->Inserted;
-
-	if (Inserted)
-	{
-		RemoveEntryList(&(Dpc->DpcListEntry));
-		Dpc->Inserted = FALSE;
-	}
-
-	// TODO : Instead of using a lock, emulate the Set Interrupt Flag (sti) instruction
-	// See https://msdn.microsoft.com/en-us/library/ad820yz3(v=vs.80).aspx
-	LeaveCriticalSection(&(g_DpcData.Lock));
+	// This unlinks it right away, so the DPC memory may be freed once this returns
+	BOOLEAN Inserted = g_DpcQueue.Remove(Dpc);
 
 	RETURN(Inserted);
 }
@@ -1858,10 +1799,9 @@ XBSYSAPI EXPORTNUM(151) xbox::VOID NTAPI xbox::KeStallExecutionProcessor
 {
 	LOG_FUNC_ONE_ARG(MicroSeconds);
 
-	// WinAPI Sleep usually sleeps for a minimum of 15ms, we want us. 
-	// Thanks to C++11, we can do this in a nice way without resorting to
-	// QueryPerformanceCounter
-	std::this_thread::sleep_for(std::chrono::microseconds(MicroSeconds));
+	// Host sleeps take at least a scheduler tick (1-15 ms), while drivers stall for a few us at a time,
+	// so spin on the calibrated delay clock instead
+	Timer_Delay_US(MicroSeconds);
 }
 
 // ******************************************************************
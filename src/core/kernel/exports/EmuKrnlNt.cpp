@@ -44,6 +44,7 @@ namespace NtDll
 #include "core\kernel\support\Emu.h" // For EmuLog(LOG_LEVEL::WARNING, )
 #include "core\kernel\support\EmuFile.h" // For EmuNtSymbolicLinkObject, NtStatusToString(), etc.
 #include "core\kernel\memory-manager\VMManager.h" // For g_VMManager
+#include "devices\video\nv2a_write_watch.h" // For nv2a_write_watch_release
 #include "CxbxDebugger.h"
 
 #pragma warning(disable:4005) // Ignore redefined status values
@@ -1648,6 +1649,9 @@ XBSYSAPI EXPORTNUM(219) xbox::NTSTATUS NTAPI xbox::NtReadFile
 		CxbxDebugger::ReportFileRead(FileHandle, Length, Offset);
 	}
 
+	// The host would fail writing to pages watched by NV2A, instead of faulting
+	nv2a_write_watch_release(Buffer, Length);
+
 	NTSTATUS ret = NtDll::NtReadFile(
 		FileHandle,
 		Event,
@@ -35,6 +35,7 @@
 #include "core\kernel\init\CxbxKrnl.h" // For CxbxKrnlCleanup
 #include "EmuKrnl.h" // For OBJECT_TO_OBJECT_HEADER()
 #include "core\kernel\support\EmuFile.h" // For EmuNtSymbolicLinkObject, NtStatusToString(), etc.
+#include "core\kernel\support\ObLookupCache.h"
 #include <cassert>
 
 #pragma warning(disable:4005) // Ignore redefined status values
@@ -66,6 +67,9 @@ XBSYSAPI EXPORTNUM(245) xbox::OBJECT_HANDLE_TABLE xbox::ObpObjectHandleTable = {
 
 xbox::PVOID ObpDosDevicesDriveLetterMap['Z' - 'A' + 1];
 
+// Last name resolved per (directory, name hash) slot, see ObLookupCache.h
+static ObLookupCache<xbox::OBJECT_DIRECTORY, xbox::OBJECT_HEADER_NAME_INFO, OB_NUMBER_HASH_BUCKETS> ObpLookupCache;
+
 xbox::BOOLEAN xbox::ObpCreatePermanentDirectoryObject(
 	IN xbox::POBJECT_STRING DirectoryName OPTIONAL,
 	OUT xbox::POBJECT_DIRECTORY *DirectoryObject
@@ -244,6 +248,7 @@ xbox::BOOLEAN xbox::ObInitSystem()
 	ObpObjectHandleTable.RootTable = NULL;
 
 	RtlZeroMemory(ObpDosDevicesDriveLetterMap, sizeof(ObpDosDevicesDriveLetterMap));
+	ObpLookupCache.Clear();
 
 	if (!ObpCreatePermanentDirectoryObject(NULL, &ObpRootDirectoryObject)) {
 		return FALSE;
@@ -498,27 +503,7 @@ xbox::ULONG FASTCALL xbox::ObpComputeHashIndex(
 	IN POBJECT_STRING ElementName
 )
 {
-
-	ULONG HashIndex = 0;
-	PUCHAR Buffer = (PUCHAR)ElementName->Buffer;
-	PUCHAR BufferEnd = Buffer + ElementName->Length;
-	
-	// Calculate hash of string data
-	UCHAR Char;
-	while (Buffer < BufferEnd) {
-		Char = *Buffer++;
-		// Skip special characters
-		if (Char >= 0x80) {
-			continue;
-		}
-
-		// Force all characters to be lowercase
-		Char |= 0x20;
-
-		HashIndex += (HashIndex << 1) + (HashIndex >> 1) + Char;
-	}
-
-	return HashIndex % OB_NUMBER_HASH_BUCKETS;
+	return ObpComputeNameHash(ElementName->Buffer, ElementName->Length) % OB_NUMBER_HASH_BUCKETS;
 }
 
 xbox::PVOID xbox::ObpGetObjectHandleReference(HANDLE Handle)
@@ -566,25 +551,23 @@ xbox::BOOLEAN xbox::ObpLookupElementNameInDirectory(
 		}
 	}
 	
-	ULONG HashIndex = ObpComputeHashIndex(ElementName);
-	POBJECT_HEADER_NAME_INFO ObjectHeaderNameInfo = Directory->HashBuckets[HashIndex];
-	
-	while (ObjectHeaderNameInfo != NULL) {
-		if (RtlEqualString(&ObjectHeaderNameInfo->Name, ElementName, TRUE)) {
-			Object = OBJECT_HEADER_NAME_INFO_TO_OBJECT(ObjectHeaderNameInfo);
-			if (ResolveSymbolicLink && (OBJECT_TO_OBJECT_HEADER(Object)->Type == &ObSymbolicLinkObjectType)) {
-				Object = ((POBJECT_SYMBOLIC_LINK)Object)->LinkTargetObject;
-			}
+	// The hash is case folded, so it matches the name in any case
+	POBJECT_HEADER_NAME_INFO ObjectHeaderNameInfo = ObpLookupCache.Lookup(Directory,
+		ObpComputeNameHash(ElementName->Buffer, ElementName->Length), ElementName->Length,
+		[ElementName](POBJECT_HEADER_NAME_INFO NameInfo) { return RtlEqualString(&NameInfo->Name, ElementName, TRUE) != FALSE; });
 
-			*ReturnedObject = Object;
-			return TRUE;
-		}
+	if (ObjectHeaderNameInfo == NULL) {
+		*ReturnedObject = NULL;
+		return FALSE;
+	}
 
-		ObjectHeaderNameInfo = ObjectHeaderNameInfo->ChainLink;
+	Object = OBJECT_HEADER_NAME_INFO_TO_OBJECT(ObjectHeaderNameInfo);
+	if (ResolveSymbolicLink && (OBJECT_TO_OBJECT_HEADER(Object)->Type == &ObSymbolicLinkObjectType)) {
+		Object = ((POBJECT_SYMBOLIC_LINK)Object)->LinkTargetObject;
 	}
 
-	*ReturnedObject = NULL;
-	return FALSE;
+	*ReturnedObject = Object;
+	return TRUE;
 }
 
 // ******************************************************************
@@ -961,6 +944,9 @@ XBSYSAPI EXPORTNUM(250) xbox::VOID FASTCALL xbox::ObfDereferenceObject
 		PVOID ObjectBase;
 		if (ObpIsFlagSet(ObjectHeader->Flags, OB_FLAG_NAMED_OBJECT)) {
 			ObjectBase = OBJECT_HEADER_TO_OBJECT_HEADER_NAME_INFO(ObjectHeader);
+			if (((POBJECT_HEADER_NAME_INFO)ObjectBase)->Directory != NULL) {
+				ObpLookupCache.Purge((POBJECT_HEADER_NAME_INFO)ObjectBase);
+			}
 		} else {
 			ObjectBase = ObjectHeader;
 		}
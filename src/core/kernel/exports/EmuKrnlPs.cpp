@@ -33,6 +33,7 @@
 #include <xboxkrnl/xboxkrnl.h> // For PsCreateSystemThreadEx, etc.
 #include <process.h> // For __beginthreadex(), etc.
 #include <float.h> // For _controlfp constants
+#include "common\util\PrestartedPool.h"
 
 #include "Logging.h" // For LOG_FUNC()
 #include "EmuKrnlLogging.h"
@@ -55,10 +56,20 @@ typedef struct _PCSTProxyParam
 	IN PVOID  StartContext;
 	IN PVOID  SystemRoutine;
 	IN BOOL   StartSuspended;
-	IN HANDLE hStartedEvent;
+	IN HANDLE hStartEvent;   // Set by PsCreateSystemThreadEx once the above are filled in
+	IN HANDLE hStartedEvent; // Set by the proxy once its Xbox thread environment is set up
+	HANDLE    hThread;
+	DWORD     dwThreadId;
+	LONG      RefCount;      // Both the creator and the proxy release it, the last one frees it
 }
 PCSTProxyParam;
 
+// Proxy threads are started ahead of time (by the pool's refill thread) and wait until PsCreateSystemThreadEx
+// hands them a start routine, so creating an Xbox thread doesn't have to wait for the host to create one
+#define PCST_POOL_SIZE 4
+// Stack size of the pooled proxy threads, Xbox threads that need more get a proxy of their own
+#define PCST_POOL_STACK_SIZE (KERNEL_STACK_SIZE * 8)
+
 // Global Variable(s)
 extern PVOID g_pfnThreadNotification[PSP_MAX_CREATE_THREAD_NOTIFY] = { NULL };
 extern int g_iThreadNotificationCount = 0;
@@ -96,6 +107,53 @@ void InitXboxThread(DWORD_PTR cores)
 	}
 }
 
+static void PCSTProxyRelease(PCSTProxyParam *iPCSTProxyParam)
+{
+	if (InterlockedDecrement(&iPCSTProxyParam->RefCount) == 0) {
+		CloseHandle(iPCSTProxyParam->hStartEvent);
+		CloseHandle(iPCSTProxyParam->hStartedEvent);
+		free(iPCSTProxyParam);
+	}
+}
+
+static unsigned int WINAPI PCSTProxy(IN PVOID Parameter);
+
+// Starts a proxy thread, which waits for its start routine
+static PCSTProxyParam *PCSTProxySpawn(ULONG KernelStackSize)
+{
+	PCSTProxyParam *iPCSTProxyParam = (PCSTProxyParam*)calloc(1, sizeof(PCSTProxyParam));
+
+	iPCSTProxyParam->hStartEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	iPCSTProxyParam->hStartedEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (iPCSTProxyParam->hStartEvent == NULL || iPCSTProxyParam->hStartedEvent == NULL) {
+		std::string errorMessage = CxbxGetLastErrorString("PsCreateSystemThreadEx could not create PCSTProxyEvent");
+		CxbxKrnlCleanup(errorMessage.c_str());
+	}
+
+	iPCSTProxyParam->RefCount = 2;
+	iPCSTProxyParam->hThread = (HANDLE)_beginthreadex(NULL, KernelStackSize, PCSTProxy, iPCSTProxyParam, NULL, (unsigned int*)&iPCSTProxyParam->dwThreadId);
+	if (iPCSTProxyParam->hThread == NULL) {
+		std::string errorMessage = CxbxGetLastErrorString("PsCreateSystemThreadEx could not create a proxy thread");
+		CxbxKrnlCleanup(errorMessage.c_str());
+	}
+
+	return iPCSTProxyParam;
+}
+
+// Never destroyed, as its refill thread is already gone by the time static destructors run at exit
+static PrestartedPool<PCSTProxyParam*> *g_PCSTPool = new PrestartedPool<PCSTProxyParam*>(PCST_POOL_SIZE,
+	[]() { return PCSTProxySpawn(PCST_POOL_STACK_SIZE); });
+
+// Takes a proxy from the pool, or starts a new one when its stacks are too small
+static PCSTProxyParam *PCSTProxyAcquire(ULONG KernelStackSize)
+{
+	if (KernelStackSize <= PCST_POOL_STACK_SIZE) {
+		return g_PCSTPool->Acquire();
+	}
+
+	return PCSTProxySpawn(KernelStackSize);
+}
+
 // PsCreateSystemThread proxy procedure
 // Dxbx Note : The signature of PCSTProxy should conform to System.TThreadFunc !
 static unsigned int WINAPI PCSTProxy
@@ -107,15 +165,15 @@ static unsigned int WINAPI PCSTProxy
 
 	PCSTProxyParam *iPCSTProxyParam = (PCSTProxyParam*)Parameter;
 
+	// Wait until PsCreateSystemThreadEx takes this proxy into use
+	WaitForSingleObject(iPCSTProxyParam->hStartEvent, INFINITE);
+
 	PVOID StartRoutine = iPCSTProxyParam->StartRoutine;
 	PVOID StartContext = iPCSTProxyParam->StartContext;
 	PVOID SystemRoutine = iPCSTProxyParam->SystemRoutine;
 	BOOL StartSuspended = iPCSTProxyParam->StartSuspended;
 	HANDLE hStartedEvent = iPCSTProxyParam->hStartedEvent;
 
-	// Once deleted, unable to directly access iPCSTProxyParam in remainder of function.
-	free(iPCSTProxyParam);
-
 	LOG_PCSTProxy(
 		StartRoutine,
 		StartContext,
@@ -127,11 +185,11 @@ static unsigned int WINAPI PCSTProxy
 	// Do minimal thread initialization
 	InitXboxThread(g_CPUXbox);
 
+	// Complete the startup handshake (suspended threads are suspended by PsCreateSystemThreadEx itself)
 	SetEvent(hStartedEvent);
 
-	if (StartSuspended == TRUE) {
-		SuspendThread(GetCurrentThread());
-	}
+	// Once released, unable to directly access iPCSTProxyParam in remainder of function.
+	PCSTProxyRelease(iPCSTProxyParam);
 
 	auto routine = (xbox::PKSYSTEM_ROUTINE)SystemRoutine;
 	// Debugging notice : When the below line shows up with an Exception dialog and a
@@ -243,24 +301,21 @@ XBSYSAPI EXPORTNUM(255) xbox::NTSTATUS NTAPI xbox::PsCreateSystemThreadEx
 	// round up to the next page boundary if un-aligned
 	KernelStackSize = RoundUp(KernelStackSize, PAGE_SIZE);
 
-    // create thread, using our special proxy technique
-    {
-        DWORD dwThreadId = 0, dwThreadWait;
-        bool bWait = true;
-		HANDLE hStartedEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
-		if (hStartedEvent == NULL) {
-			std::string errorMessage = CxbxGetLastErrorString("PsCreateSystemThreadEx could not create PCSTProxyEvent");
-			CxbxKrnlCleanup(errorMessage.c_str());
-		}
+	// create thread, using our special proxy technique
+	{
+		DWORD dwThreadWait;
+		bool bWait = true;
 
-        // PCSTProxy is responsible for cleaning up this pointer
-		PCSTProxyParam *iPCSTProxyParam = (PCSTProxyParam*)malloc(sizeof(PCSTProxyParam));
+		// The proxy waits for its parameters, and is responsible for cleaning up this pointer together with us
+		PCSTProxyParam *iPCSTProxyParam = PCSTProxyAcquire(KernelStackSize);
+		HANDLE hThread = iPCSTProxyParam->hThread;
+		DWORD dwThreadId = iPCSTProxyParam->dwThreadId;
+		HANDLE hStartedEvent = iPCSTProxyParam->hStartedEvent;
 
-        iPCSTProxyParam->StartRoutine = (PVOID)StartRoutine;
-        iPCSTProxyParam->StartContext = StartContext;
-        iPCSTProxyParam->SystemRoutine = (PVOID)SystemRoutine; // NULL, XapiThreadStartup or unknown?
-        iPCSTProxyParam->StartSuspended = CreateSuspended;
-	    iPCSTProxyParam->hStartedEvent = hStartedEvent;
+		iPCSTProxyParam->StartRoutine = (PVOID)StartRoutine;
+		iPCSTProxyParam->StartContext = StartContext;
+		iPCSTProxyParam->SystemRoutine = (PVOID)SystemRoutine; // NULL, XapiThreadStartup or unknown?
+		iPCSTProxyParam->StartSuspended = CreateSuspended;
 
 		/*
 		// call thread notification routine(s)
@@ -284,10 +339,25 @@ XBSYSAPI EXPORTNUM(255) xbox::NTSTATUS NTAPI xbox::PsCreateSystemThreadEx
 			}
 		}*/
 
-        *ThreadHandle = (HANDLE)_beginthreadex(NULL, KernelStackSize, PCSTProxy, iPCSTProxyParam, NULL, (unsigned int*)&dwThreadId);
-		// Note : DO NOT use iPCSTProxyParam anymore, since ownership is transferred to the proxy (which frees it too)
+		// Register the thread before any of it runs, so it's included when all Xbox threads are suspended
+		CxbxKrnlRegisterThread(hThread);
 
-		EmuLog(LOG_LEVEL::DEBUG, "Waiting for Xbox proxy thread to start...");
+		*ThreadHandle = hThread;
+		if (ThreadId != NULL)
+			*ThreadId = (xbox::HANDLE)dwThreadId;
+
+		if (CreateSuspended) {
+			// The proxy is still waiting for its parameters, so suspending it now guarantees nothing of the
+			// Xbox thread runs before it's resumed. (Waiting for the handshake here would never return.)
+			SuspendThread(hThread);
+			bWait = false;
+		}
+
+		SetEvent(iPCSTProxyParam->hStartEvent);
+
+		if (bWait) {
+			EmuLog(LOG_LEVEL::DEBUG, "Waiting for Xbox proxy thread to start...");
+		}
 
         while (bWait) {
             dwThreadWait = WaitForSingleObject(hStartedEvent, INFINITE);
@@ -313,23 +383,13 @@ XBSYSAPI EXPORTNUM(255) xbox::NTSTATUS NTAPI xbox::PsCreateSystemThreadEx
             }
         }
 
-
-		// Release the event
-		CloseHandle(hStartedEvent);
-		hStartedEvent = NULL;
+		// Note : DO NOT use iPCSTProxyParam anymore, the proxy frees it once it's done with it as well
+		PCSTProxyRelease(iPCSTProxyParam);
 
 		// Log ThreadID identical to how GetCurrentThreadID() is rendered :
-		EmuLog(LOG_LEVEL::DEBUG, "Created Xbox proxy thread. Handle : 0x%X, ThreadId : [0x%.4X]", *ThreadHandle, dwThreadId);
-
-		CxbxKrnlRegisterThread(*ThreadHandle);
-
-		if (ThreadId != NULL)
-			*ThreadId = (xbox::HANDLE)dwThreadId;
+		EmuLog(LOG_LEVEL::DEBUG, "Created Xbox proxy thread. Handle : 0x%X, ThreadId : [0x%.4X]", hThread, dwThreadId);
 	}
 
-	SwitchToThread();
-	Sleep(10);
-
 	RETURN(STATUS_SUCCESS);
 }
 
@@ -1479,6 +1479,17 @@ __declspec(noreturn) void CxbxKrnlInit
 
 	g_InputDeviceManager.Initialize(false);
 
+	// Input recording / replay, for repeatable runs
+	{
+		std::string inputLogPath;
+		if (cli_config::GetValue(cli_config::input_replay, &inputLogPath)) {
+			g_InputDeviceManager.StartInputReplay(inputLogPath, g_pCertificate->dwTitleId);
+		}
+		if (cli_config::GetValue(cli_config::input_record, &inputLogPath)) {
+			g_InputDeviceManager.StartInputRecording(inputLogPath, g_pCertificate->dwTitleId);
+		}
+	}
+
 	// Now the hardware devices exist, couple the EEPROM buffer to it's device
 	g_EEPROM->SetEEPROM((uint8_t*)EEPROM);
 
@@ -0,0 +1,195 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+#include "PhysicalFreeBlocks.h"
+#include <assert.h>
+#include <iterator>
+
+
+bool PhysicalFreeBlocks::RemoveFree(PFN_COUNT NumberOfPages, PFN* result, PFN_COUNT PfnAlignment, PFN start, PFN end)
+{
+	PFN PfnStart;
+	PFN PfnEnd;
+	PFN IntersectionStart;
+	PFN IntersectionEnd;
+	PFN_COUNT PfnAlignmentMask;
+	PFN_COUNT PfnAlignmentSubtraction;
+
+	// The caller should already guarantee that there are enough free pages available
+	if (NumberOfPages == 0) { result = nullptr; return false; }
+
+	if (PfnAlignment)
+	{
+		// Calculate some alignment parameters if one is requested
+
+		PfnAlignmentMask = ~(PfnAlignment - 1);
+		PfnAlignmentSubtraction = ((NumberOfPages + PfnAlignment - 1) & PfnAlignmentMask) - NumberOfPages + 1;
+	}
+
+	// Search from the top, starting from the highest block which can intersect the requested range
+	FreeBlockIter it = m_FreeBlocks.upper_bound(end);
+
+	while (it != m_FreeBlocks.begin())
+	{
+		--it;
+		PfnStart = it->first;
+		PfnEnd = PfnStart + it->second - 1;
+
+		if (PfnEnd < start)
+		{
+			// This and all the blocks below it are outside the requested range, stop searching
+
+			break;
+		}
+
+		if (it->second < NumberOfPages) { continue; } // search for a block with enough pages
+
+		IntersectionStart = start >= PfnStart ? start : PfnStart;
+		IntersectionEnd = end <= PfnEnd ? end : PfnEnd;
+
+		if (IntersectionEnd - IntersectionStart + 1 < NumberOfPages)
+		{
+			// There is not enough free space inside the free block so this is an invalid block.
+			// We have to check again since the free size could have shrinked because of the intersection
+			// check done above
+
+			continue;
+		}
+
+		if (PfnAlignment)
+		{
+			PFN AlignedEnd = (IntersectionEnd + 1) & PfnAlignmentMask;
+
+			if (AlignedEnd < PfnAlignmentSubtraction)
+			{
+				// The aligned pages would start below pfn zero
+
+				continue;
+			}
+
+			IntersectionEnd = AlignedEnd - PfnAlignmentSubtraction;
+
+			if (IntersectionEnd < IntersectionStart || IntersectionEnd - IntersectionStart + 1 < NumberOfPages)
+			{
+				// This free block doesn't honor the alignment requested, so this is another invalid block
+
+				continue;
+			}
+		}
+
+		// Now we know that we have a usable free block with enough pages, take them from the top of the intersection
+
+		*result = IntersectionEnd - NumberOfPages + 1;
+		CarveFreeBlock(it, *result, NumberOfPages);
+		return true;
+	}
+	result = nullptr;
+	return false;
+}
+
+PFN_COUNT PhysicalFreeBlocks::RemoveFreeRun(PFN_COUNT NumberOfPages, PFN* result, PFN start, PFN end)
+{
+	// This takes the same pages that NumberOfPages calls to RemoveFree(1, ...) would, but a whole run at a time:
+	// only the highest block intersecting the range matters, since every single page fits in it
+
+	FreeBlockIter it = m_FreeBlocks.upper_bound(end);
+
+	if (NumberOfPages == 0 || it == m_FreeBlocks.begin()) { return 0; }
+
+	--it;
+	PFN PfnStart = it->first;
+	PFN PfnEnd = PfnStart + it->second - 1;
+
+	if (PfnEnd < start) { return 0; }
+
+	PFN IntersectionStart = start >= PfnStart ? start : PfnStart;
+	PFN IntersectionEnd = end <= PfnEnd ? end : PfnEnd;
+	PFN_COUNT PfnCount = IntersectionEnd - IntersectionStart + 1;
+
+	if (PfnCount > NumberOfPages) { PfnCount = NumberOfPages; }
+
+	*result = IntersectionEnd - PfnCount + 1;
+	CarveFreeBlock(it, *result, PfnCount);
+
+	return PfnCount;
+}
+
+void PhysicalFreeBlocks::CarveFreeBlock(FreeBlockIter it, PFN start, PFN_COUNT NumberOfPages)
+{
+	PFN BlockStart = it->first;
+	PFN BlockEnd = BlockStart + it->second - 1;
+	PFN end = start + NumberOfPages - 1;
+
+	assert(start >= BlockStart && end <= BlockEnd);
+
+	if (end < BlockEnd)
+	{
+		// Create a new block with the remaining pages after the removed ones
+
+		m_FreeBlocks.emplace_hint(std::next(it), end + 1, BlockEnd - end);
+	}
+
+	if (start > BlockStart)
+	{
+		// Keep the remaining pages before the removed ones in the original block
+
+		it->second = start - BlockStart;
+	}
+	else { m_FreeBlocks.erase(it); } // delete the entry if there is no free space left before the removed pages
+}
+
+void PhysicalFreeBlocks::InsertFree(PFN start, PFN end)
+{
+	PFN_COUNT size = end - start + 1;
+	FreeBlockIter next = m_FreeBlocks.upper_bound(start);
+	FreeBlockIter block = m_FreeBlocks.end();
+
+	// Ensure that we are not freeing a part of the next block
+	assert(next == m_FreeBlocks.end() || next->first > end);
+
+	if (next != m_FreeBlocks.begin())
+	{
+		FreeBlockIter prev = std::prev(next);
+
+		// Ensure that we are not freeing a part of the previous block
+		assert(prev->first + prev->second - 1 < start);
+
+		if (prev->first + prev->second == start)
+		{
+			// Merge backward
+			prev->second += size;
+			block = prev;
+		}
+	}
+
+	if (block == m_FreeBlocks.end()) { block = m_FreeBlocks.emplace_hint(next, start, size); }
+
+	if (next != m_FreeBlocks.end() && end + 1 == next->first)
+	{
+		// Merge forward
+		block->second += next->second;
+		m_FreeBlocks.erase(next);
+	}
+}
@@ -0,0 +1,75 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+#ifndef PHYSICAL_FREE_BLOCKS_H
+#define PHYSICAL_FREE_BLOCKS_H
+
+// The free physical pages of PhysicalMemory, kept free of emulator dependencies so that
+// cxbxr-pagebench can check and time the very same code against the free list it replaced.
+
+#include <map>
+
+
+typedef unsigned int PFN;
+typedef unsigned int PFN_COUNT;
+
+
+/* Index of the free pages on the system, mapping the starting page of each free block to its number of pages */
+typedef std::map<PFN, PFN_COUNT> FreeBlockMap;
+typedef FreeBlockMap::iterator FreeBlockIter;
+
+
+/* PhysicalFreeBlocks class */
+class PhysicalFreeBlocks
+{
+	public:
+		// make the NumberOfPages pages from pfn zero the only free block
+		void Reset(PFN_COUNT NumberOfPages) { m_FreeBlocks.clear(); m_FreeBlocks.emplace(0, NumberOfPages); }
+		// take NumberOfPages contiguous pages from the top of the highest block in range which can hold them
+		bool RemoveFree(PFN_COUNT NumberOfPages, PFN* result, PFN_COUNT PfnAlignment, PFN start, PFN end);
+		// take up to NumberOfPages contiguous pages from the highest free block in range, returns the number taken
+		PFN_COUNT RemoveFreeRun(PFN_COUNT NumberOfPages, PFN* result, PFN start, PFN end);
+		// give back a contiguous number of pages, merging them with the adjacent free blocks
+		void InsertFree(PFN start, PFN end);
+		// the free blocks, lowest first
+		const FreeBlockMap& Blocks() const { return m_FreeBlocks; }
+
+	private:
+		// sorted, non-adjacent runs of free physical pages
+		FreeBlockMap m_FreeBlocks;
+
+		// removes the supplied pages from a free block, splitting it if necessary
+		void CarveFreeBlock(FreeBlockIter it, PFN start, PFN_COUNT NumberOfPages);
+};
+
+// Returns how many of the NumberOfPages pages from start are at or above FirstUpperPage
+inline PFN_COUNT PagesAbove(PFN start, PFN_COUNT NumberOfPages, PFN FirstUpperPage)
+{
+	if (start + NumberOfPages <= FirstUpperPage) { return 0; }
+
+	return start >= FirstUpperPage ? NumberOfPages : start + NumberOfPages - FirstUpperPage;
+}
+
+#endif
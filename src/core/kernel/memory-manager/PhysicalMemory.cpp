@@ -30,19 +30,8 @@
 
 #include "PhysicalMemory.h"
 #include "Logging.h"
-#include "core\kernel\exports\EmuKrnl.h" // For InitializeListHead(), etc.
 #include <assert.h>
 
-// See the links below for the details about the kernel structure LIST_ENTRY and the related functions
-// https://www.codeproject.com/Articles/800404/Understanding-LIST-ENTRY-Lists-and-Its-Importance
-// https://docs.microsoft.com/en-us/windows-hardware/drivers/kernel/singly-and-doubly-linked-lists
-#define LIST_ENTRY_INITIALIZE(ListEntry) ((ListEntry)->Flink = (ListEntry)->Blink = nullptr)
-
-inline FreeBlock* ListEntryToFreeBlock(xbox::PLIST_ENTRY pListEntry)
-{
-	return CONTAINING_RECORD(pListEntry, FreeBlock, ListEntry);
-}
-
 void PhysicalMemory::InitializePageDirectory()
 {
 	PMMPTE pPde;
@@ -79,42 +68,50 @@ void PhysicalMemory::InitializePageDirectory()
 void PhysicalMemory::WritePfn(PFN pfn_start, PFN pfn_end, PMMPTE pPte, PageType BusyType, bool bZero)
 {
 	XBOX_PFN TempPF;
+	PXBOX_PFN PfnElement;
+	PFN_COUNT PfnCount = 0;
+
+	// The pfn entries of a range are contiguous too, so select the database only once
+	if (m_MmLayoutRetail || m_MmLayoutDebug) {
+		PfnElement = XBOX_PFN_ELEMENT(pfn_start);
+	}
+	else { PfnElement = CHIHIRO_PFN_ELEMENT(pfn_start); }
 
 	if (bZero)
 	{
 		TempPF.Default = 0;
 		while (pfn_start <= pfn_end)
 		{
-			if (m_MmLayoutRetail || m_MmLayoutDebug) {
-				*XBOX_PFN_ELEMENT(pfn_start) = TempPF;
-			}
-			else { *CHIHIRO_PFN_ELEMENT(pfn_start) = TempPF; }
+			*PfnElement = TempPF;
 
-			m_PagesByUsage[BusyType]--;
+			PfnElement++;
+			PfnCount++;
 			pfn_start++;
 		}
+		m_PagesByUsage[BusyType] -= PfnCount;
 	}
 	else
 	{
+		TempPF.Default = 0;
+		TempPF.Busy.Busy = 1;
+		TempPF.Busy.BusyType = BusyType;
+		if (BusyType == VirtualPageTableType || BusyType == SystemPageTableType) {
+			TempPF.PTPageFrame.PtesUsed = 0; // we are writing a pfn of a PT
+		}
+
 		while (pfn_start <= pfn_end)
 		{
-			TempPF.Default = 0;
-			TempPF.Busy.Busy = 1;
-			TempPF.Busy.BusyType = BusyType;
 			if (BusyType != VirtualPageTableType && BusyType != SystemPageTableType) {
 				TempPF.Busy.PteIndex = GetPteOffset(GetVAddrMappedByPte(pPte));
 			}
-			else { TempPF.PTPageFrame.PtesUsed = 0; } // we are writing a pfn of a PT
+			*PfnElement = TempPF;
 
-			if (m_MmLayoutRetail || m_MmLayoutDebug) {
-				*XBOX_PFN_ELEMENT(pfn_start) = TempPF;
-			}
-			else { *CHIHIRO_PFN_ELEMENT(pfn_start) = TempPF; }
-
-			m_PagesByUsage[BusyType]++;
+			PfnElement++;
+			PfnCount++;
 			pfn_start++;
 			pPte++;
 		}
+		m_PagesByUsage[BusyType] += PfnCount;
 	}
 }
 
@@ -165,212 +162,123 @@ void PhysicalMemory::WritePte(PMMPTE pPteStart, PMMPTE pPteEnd, MMPTE Pte, PFN p
 
 bool PhysicalMemory::RemoveFree(PFN_COUNT NumberOfPages, PFN* result, PFN_COUNT PfnAlignment, PFN start, PFN end)
 {
-	xbox::PLIST_ENTRY ListEntry;
-	PFN PfnStart;
-	PFN PfnEnd;
-	PFN IntersectionStart;
-	PFN IntersectionEnd;
-	PFN_COUNT PfnCount;
-	PFN_COUNT PfnAlignmentMask;
-	PFN_COUNT PfnAlignmentSubtraction;
+	if (!m_FreeBlocks.RemoveFree(NumberOfPages, result, PfnAlignment, start, end)) { return false; }
 
-	// The caller should already guarantee that there are enough free pages available
-	if (NumberOfPages == 0) { result = nullptr; return false; }
-
-	if (PfnAlignment)
-	{
-		// Calculate some alignment parameters if one is requested
+	UpdateAvailablePages(*result, NumberOfPages, false);
+	return true;
+}
 
-		PfnAlignmentMask = ~(PfnAlignment - 1);
-		PfnAlignmentSubtraction = ((NumberOfPages + PfnAlignment - 1) & PfnAlignmentMask) - NumberOfPages + 1;
-	}
+PFN_COUNT PhysicalMemory::RemoveFreeRun(PFN_COUNT NumberOfPages, PFN* result, PFN start, PFN end)
+{
+	PFN_COUNT PfnCount = m_FreeBlocks.RemoveFreeRun(NumberOfPages, result, start, end);
 
-	ListEntry = FreeList.Blink; // search from the top
+	if (PfnCount) { UpdateAvailablePages(*result, PfnCount, false); }
 
-	while (ListEntry != &FreeList)
-	{
-		if (ListEntryToFreeBlock(ListEntry)->size >= NumberOfPages) // search for a block with enough pages
-		{
-			PfnStart = ListEntryToFreeBlock(ListEntry)->start;
-			PfnCount = ListEntryToFreeBlock(ListEntry)->size;
-			PfnEnd = PfnStart + PfnCount - 1;
-			IntersectionStart = start >= PfnStart ? start : PfnStart;
-			IntersectionEnd = end <= PfnEnd ? end : PfnEnd;
+	return PfnCount;
+}
 
-			if (IntersectionEnd < IntersectionStart)
-			{
-				// Not inside the requested range, keep searching
+void PhysicalMemory::InsertFree(PFN start, PFN end)
+{
+	m_FreeBlocks.InsertFree(start, end);
+	UpdateAvailablePages(start, end - start + 1, true);
+}
 
-				goto InvalidBlock;
-			}
+void PhysicalMemory::UpdateAvailablePages(PFN start, PFN_COUNT NumberOfPages, bool bFree)
+{
+	// On devkits, the pages of the upper 64 MiB are accounted as debugger pages
+	PFN_COUNT DebuggerPages = m_MmLayoutDebug ? PagesAbove(start, NumberOfPages, DEBUGKIT_FIRST_UPPER_HALF_PAGE) : 0;
 
-			if (IntersectionEnd - IntersectionStart + 1 < NumberOfPages)
-			{
-				// There is not enough free space inside the free block so this is an invalid block.
-				// We have to check again since the free size could have shrinked because of the intersection
-				// check done above
+	if (bFree) {
+		m_DebuggerPagesAvailable += DebuggerPages;
+		m_PhysicalPagesAvailable += NumberOfPages - DebuggerPages;
+	}
+	else {
+		m_DebuggerPagesAvailable -= DebuggerPages;
+		m_PhysicalPagesAvailable -= NumberOfPages - DebuggerPages;
+	}
+	assert(m_DebuggerPagesAvailable <= DEBUGKIT_FIRST_UPPER_HALF_PAGE);
+	assert(m_PhysicalPagesAvailable <= m_HighestPage + 1);
+}
 
-				goto InvalidBlock;
-			}
+void PhysicalMemory::CommitPtes(PMMPTE pPteStart, PMMPTE pPteEnd, MMPTE Pte, PageType BusyType, PFN LowestPfn, PFN HighestPfn)
+{
+	// The caller should already guarantee that there are enough free pages available (with IsMappable)
 
-			if (PfnAlignment)
-			{
-				IntersectionEnd = ((IntersectionEnd + 1) & PfnAlignmentMask) - PfnAlignmentSubtraction;
+	PMMPTE PointerPte = pPteStart;
+	PMMPTE RunEndPte;
+	PFN pfn;
+	PFN_COUNT PfnCount;
 
-				if (IntersectionEnd < IntersectionStart || IntersectionEnd - IntersectionStart + 1 < NumberOfPages)
-				{
-					// This free block doesn't honor the alignment requested, so this is another invalid block
+	while (PointerPte <= pPteEnd)
+	{
+		if (PointerPte->Default != 0)
+		{
+			PointerPte++;
+			continue;
+		}
 
-					goto InvalidBlock;
-				}
-			}
+		// Find the run of uncommitted pte's starting here, and map it to as few free blocks as possible
 
-			// Now we know that we have a usable free block with enough pages
+		RunEndPte = PointerPte;
+		while (RunEndPte < pPteEnd && (RunEndPte + 1)->Default == 0) { RunEndPte++; }
 
-			if (IntersectionStart == PfnStart)
-			{
-				if (IntersectionEnd == PfnEnd)
-				{
-					// The block is totally inside the range, just shrink its size
-
-					PfnCount -= NumberOfPages;
-					if (!PfnCount)
-					{
-						// delete the entry if there is no free space left
-
-						RemoveEntryList(ListEntry);
-						delete ListEntryToFreeBlock(ListEntry);
-					}
-					else { ListEntryToFreeBlock(ListEntry)->size = PfnCount; }
-				}
-				else
-				{
-					// Create a new block with the remaining pages after the block
-
-					PFreeBlock block = new FreeBlock;
-					block->start = IntersectionEnd + 1;
-					block->size = PfnStart + PfnCount - IntersectionEnd - 1;
-					LIST_ENTRY_INITIALIZE(&block->ListEntry);
-					InsertHeadList(ListEntry, &block->ListEntry);
-
-					PfnCount = IntersectionEnd - PfnStart - NumberOfPages + 1;
-					if (!PfnCount)
-					{
-						// delete the entry if there is no free space left
-
-						RemoveEntryList(ListEntry);
-						delete ListEntryToFreeBlock(ListEntry);
-					}
-					else { ListEntryToFreeBlock(ListEntry)->size = PfnCount; }
-				}
-			}
-			else
+		while (PointerPte <= RunEndPte)
+		{
+			PfnCount = RemoveFreeRun(RunEndPte - PointerPte + 1, &pfn, LowestPfn, HighestPfn);
+			if (PfnCount == 0)
 			{
-				// Starting address of the free block is lower than the intersection start
-
-				if (IntersectionEnd == PfnEnd)
-				{
-					// The free block extends before IntersectionStart
-
-					PfnCount -= NumberOfPages;
-					ListEntryToFreeBlock(ListEntry)->size = PfnCount;
-				}
-				else
-				{
-					// The free block extends in both directions
-
-					PFreeBlock block = new FreeBlock;
-					block->start = IntersectionEnd + 1;
-					block->size = PfnStart + PfnCount - IntersectionEnd - 1;
-					LIST_ENTRY_INITIALIZE(&block->ListEntry);
-					InsertHeadList(ListEntry, &block->ListEntry);
-
-					PfnCount = IntersectionEnd - PfnStart - NumberOfPages + 1;
-					ListEntryToFreeBlock(ListEntry)->size = PfnCount;
-				}
-			}
-			if (m_MmLayoutDebug && (PfnStart + PfnCount >= DEBUGKIT_FIRST_UPPER_HALF_PAGE)) {
-				m_DebuggerPagesAvailable -= NumberOfPages;
-				assert(m_DebuggerPagesAvailable <= DEBUGKIT_FIRST_UPPER_HALF_PAGE);
+				EmuLog(LOG_LEVEL::WARNING, "%s: out of physical memory!", __func__);
+				assert(0);
+				return;
 			}
-			else {
-				m_PhysicalPagesAvailable -= NumberOfPages;
-				assert(m_PhysicalPagesAvailable <= m_HighestPage + 1);
-			}
-			*result = PfnStart + PfnCount;
-			return true;
+
+			WritePfn(pfn, pfn + PfnCount - 1, PointerPte, BusyType);
+			WritePte(PointerPte, PointerPte + PfnCount - 1, Pte, pfn);
+			PointerPte += PfnCount;
 		}
-		InvalidBlock:
-		ListEntry = ListEntry->Blink;
 	}
-	result = nullptr;
-	return false;
 }
 
-void PhysicalMemory::InsertFree(PFN start, PFN end)
+void PhysicalMemory::DecommitPtes(PMMPTE pPteStart, PMMPTE pPteEnd)
 {
-	xbox::PLIST_ENTRY ListEntry;
-	PFN_COUNT size = end - start + 1;
+	// This only releases the pages and their pfn's, the caller still has to zero the pte's
 
-	ListEntry = FreeList.Blink; // search from the top
+	PMMPTE PointerPte = pPteStart;
+	PMMPTE RunStartPte;
+	PXBOX_PFN PfnElement;
+	PFN pfn;
+	PFN_COUNT PfnCount;
+	ULONG BusyType;
 
-	while (true)
+	while (PointerPte <= pPteEnd)
 	{
-		if (ListEntryToFreeBlock(ListEntry)->start < start || ListEntry == &FreeList)
+		if (PointerPte->Default == 0)
 		{
-			PFreeBlock block = new FreeBlock;
-			block->start = start;
-			block->size = size;
-			LIST_ENTRY_INITIALIZE(&block->ListEntry);
-			InsertHeadList(ListEntry, &block->ListEntry);
-
-			// Ensure that we are not freeing a part of the previous block
-			if (ListEntry != &FreeList) {
-				assert(ListEntryToFreeBlock(ListEntry)->start +
-					ListEntryToFreeBlock(ListEntry)->size - 1 < start);
-			}
+			PointerPte++;
+			continue;
+		}
 
-			ListEntry = ListEntry->Flink; // move to the new created block
+		// Extend the run while the next pte maps the next pfn, with the same usage type
 
-			// Ensure that we are not freeing a part of the next block
-			if (ListEntry->Flink != &FreeList) {
-				assert(ListEntryToFreeBlock(ListEntry->Flink)->start > end);
-			}
-
-			// Check if merging is possible
-			if (ListEntry->Flink != &FreeList &&
-				start + size == ListEntryToFreeBlock(ListEntry->Flink)->start)
-			{
-				// Merge forward
-				xbox::PLIST_ENTRY temp = ListEntry->Flink;
-				ListEntryToFreeBlock(ListEntry)->size +=
-					ListEntryToFreeBlock(temp)->size;
-				RemoveEntryList(temp);
-				delete ListEntryToFreeBlock(temp);
-			}
-			if (ListEntry->Blink != &FreeList &&
-				ListEntryToFreeBlock(ListEntry->Blink)->start +
-				ListEntryToFreeBlock(ListEntry->Blink)->size == start)
-			{
-				// Merge backward
-				ListEntryToFreeBlock(ListEntry->Blink)->size +=
-					ListEntryToFreeBlock(ListEntry)->size;
-				RemoveEntryList(ListEntry);
-				delete block;
-			}
-
-			if (m_MmLayoutDebug && (start >= DEBUGKIT_FIRST_UPPER_HALF_PAGE)) {
-				m_DebuggerPagesAvailable += size;
-				assert(m_DebuggerPagesAvailable <= DEBUGKIT_FIRST_UPPER_HALF_PAGE);
-			}
-			else {
-				m_PhysicalPagesAvailable += size;
-				assert(m_PhysicalPagesAvailable <= m_HighestPage + 1);
-			}
+		RunStartPte = PointerPte;
+		pfn = PointerPte->Hardware.PFN;
+		if (m_MmLayoutRetail || m_MmLayoutDebug) {
+			PfnElement = XBOX_PFN_ELEMENT(pfn);
+		}
+		else { PfnElement = CHIHIRO_PFN_ELEMENT(pfn); }
+		BusyType = PfnElement->Busy.BusyType;
+		PfnCount = 1;
+		PointerPte++;
 
-			return;
+		while (PointerPte <= pPteEnd && PointerPte->Default != 0 && PointerPte->Hardware.PFN == pfn + PfnCount &&
+			PfnElement[PfnCount].Busy.BusyType == BusyType)
+		{
+			PfnCount++;
+			PointerPte++;
 		}
-		ListEntry = ListEntry->Blink;
+
+		InsertFree(pfn, pfn + PfnCount - 1);
+		WritePfn(pfn, pfn + PfnCount - 1, RunStartPte, (PageType)BusyType, true);
 	}
 }
 
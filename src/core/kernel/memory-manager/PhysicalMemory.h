@@ -33,24 +33,13 @@
 #include "core\kernel\support\Emu.h"
 #include "core\kernel\init\CxbxKrnl.h"
 #include <windows.h>
-#include <map>
+#include "PhysicalFreeBlocks.h"
 
 
 /* Global typedefs */
 typedef uintptr_t VAddr;
 typedef uintptr_t PAddr;
 typedef uint32_t u32;
-typedef unsigned int PFN;
-typedef unsigned int PFN_COUNT;
-
-
-/* An entry of the list tracking the free pages on the system */
-typedef struct _FreeBlock
-{
-	PFN start;                        // starting page of the block
-	PFN_COUNT size;                   // number of pages in the block
-	xbox::LIST_ENTRY ListEntry;
-}FreeBlock, *PFreeBlock;
 
 
 /* The Xbox PTE, modelled around the Intel 386 PTE specification */
@@ -196,8 +185,8 @@ typedef enum _MmLayout
 class PhysicalMemory
 {
 	protected:
-		// doubly linked list tracking the free physical pages
-		xbox::LIST_ENTRY FreeList = { &FreeList , &FreeList };
+		// sorted, non-adjacent runs of free physical pages
+		PhysicalFreeBlocks m_FreeBlocks;
 		// highest pfn available for contiguous allocations
 		PAddr m_MaxContiguousPfn = XBOX_CONTIGUOUS_MEMORY_LIMIT;
 		// amount of free physical pages available for non-debugger usage
@@ -234,8 +223,14 @@ class PhysicalMemory
 		PXBOX_PFN GetPfnOfPT(PMMPTE pPte);
 		// commit a contiguous number of pages
 		bool RemoveFree(PFN_COUNT NumberOfPages, PFN* result, PFN_COUNT PfnAlignment, PFN start, PFN end);
+		// commit up to NumberOfPages contiguous pages from the highest free block in range, returns the number committed
+		PFN_COUNT RemoveFreeRun(PFN_COUNT NumberOfPages, PFN* result, PFN start, PFN end);
 		// release a contiguous number of pages
 		void InsertFree(PFN start, PFN end);
+		// commit physical pages for the pte's in the range which are not committed yet, one free run at a time
+		void CommitPtes(PMMPTE pPteStart, PMMPTE pPteEnd, MMPTE Pte, PageType BusyType, PFN LowestPfn, PFN HighestPfn);
+		// release the physical pages of the committed pte's in the range, one contiguous pfn run at a time
+		void DecommitPtes(PMMPTE pPteStart, PMMPTE pPteEnd);
 		// convert from Xbox to the desired system pte protection (if possible) and return it
 		bool ConvertXboxToSystemPtePermissions(DWORD perms, PMMPTE pPte);
 		// convert from Xbox to non-system pte protection (if possible) and return it
@@ -252,6 +247,10 @@ class PhysicalMemory
 		void DeallocatePT(size_t Size, VAddr addr);
 		// checks if enough free pages are available for the allocation (doesn't account for fragmentation)
 		bool IsMappable(PFN_COUNT PagesRequested, bool bRetailRegion, bool bDebugRegion);
+
+	private:
+		// updates the free page counters of the retail and debugger memory
+		void UpdateAvailablePages(PFN start, PFN_COUNT NumberOfPages, bool bFree);
 };
 
 #endif
@@ -41,6 +41,7 @@
 #include "EmuShared.h"
 #include "core\kernel\exports\EmuKrnl.h" // For InitializeListHead(), etc.
 #include "common/util/cliConfig.hpp" // For GetSessionID
+#include "devices/video/nv2a_write_watch.h" // For nv2a_write_watch_release
 #include <assert.h>
 // Temporary usage for need ReserveAddressRanges func with cxbx.exe's emulation.
 #ifndef CXBXR_EMU
@@ -148,13 +149,8 @@ void VMManager::Initialize(unsigned int SystemType, int BootFlags, blocks_reserv
 		if (CxbxKrnl_Xbe->m_Header.dwInitFlags.bLimit64MB) { m_bAllowNonDebuggerOnTop64MiB = false; }
 	}
 
-	// Insert all the pages available on the system in the free list
-	xbox::PLIST_ENTRY ListEntry = FreeList.Blink;
-	PFreeBlock block = new FreeBlock;
-	block->start = 0;
-	block->size = m_HighestPage + 1;
-	block->ListEntry.Flink = block->ListEntry.Blink = nullptr; // Was LIST_ENTRY_INITIALIZE()
-	InsertHeadList(ListEntry, &block->ListEntry);
+	// Insert all the pages available on the system in the free blocks
+	m_FreeBlocks.Reset(m_HighestPage + 1);
 
 	if ((BootFlags & BOOT_QUICK_REBOOT) == 0) {
 		InitializeSystemAllocations();
@@ -662,7 +658,6 @@ VAddr VMManager::Allocate(size_t Size)
 	MMPTE TempPte;
 	PMMPTE PointerPte;
 	PMMPTE EndingPte;
-	PFN pfn;
 	PFN_COUNT PteNumber;
 	VAddr addr;
 
@@ -690,15 +685,8 @@ VAddr VMManager::Allocate(size_t Size)
 	PointerPte = GetPteAddress(addr);
 	EndingPte = PointerPte + PteNumber - 1;
 
-	while (PointerPte <= EndingPte)
-	{
-		RemoveFree(1, &pfn, 0, 0, m_MmLayoutDebug && !m_bAllowNonDebuggerOnTop64MiB ? XBOX_HIGHEST_PHYSICAL_PAGE
-			: m_HighestPage);
-		WritePfn(pfn, pfn, PointerPte, ImageType);
-		WritePte(PointerPte, PointerPte, TempPte, pfn);
-
-		PointerPte++;
-	}
+	CommitPtes(PointerPte, EndingPte, TempPte, ImageType, 0, m_MmLayoutDebug && !m_bAllowNonDebuggerOnTop64MiB ? XBOX_HIGHEST_PHYSICAL_PAGE
+		: m_HighestPage);
 
 	ConstructVMA(addr, PteNumber << PAGE_SHIFT, UserRegion, AllocatedVma);
 	UpdateMemoryPermissions(addr, PteNumber << PAGE_SHIFT, XBOX_PAGE_EXECUTE_READWRITE);
@@ -733,7 +721,6 @@ VAddr VMManager::AllocateSystemMemory(PageType BusyType, DWORD Perms, size_t Siz
 	MMPTE TempPte;
 	PMMPTE PointerPte;
 	PMMPTE EndingPte;
-	PFN pfn;
 	PFN LowestAcceptablePfn;
 	PFN HighestAcceptablePfn;
 	PFN_COUNT PteNumber;
@@ -793,14 +780,7 @@ VAddr VMManager::AllocateSystemMemory(PageType BusyType, DWORD Perms, size_t Siz
 	}
 	EndingPte = PointerPte + PagesNumber - 1;
 
-	while (PointerPte <= EndingPte)
-	{
-		RemoveFree(1, &pfn, 0, LowestAcceptablePfn, HighestAcceptablePfn);
-		WritePfn(pfn, pfn, PointerPte, BusyType);
-		WritePte(PointerPte, PointerPte, TempPte, pfn);
-
-		PointerPte++;
-	}
+	CommitPtes(PointerPte, EndingPte, TempPte, BusyType, LowestAcceptablePfn, HighestAcceptablePfn);
 	EndingPte->Hardware.GuardOrEnd = 1;
 
 	UpdateMemoryPermissions(bAddGuardPage ? addr + PAGE_SIZE : addr, PagesNumber << PAGE_SHIFT, Perms);
@@ -1387,7 +1367,6 @@ xbox::NTSTATUS VMManager::XbAllocateVirtualMemory(VAddr* addr, ULONG ZeroBits, s
 	PMMPTE EndingPte;
 	PMMPTE StartingPte;
 	PFN_COUNT PteNumber = 0;
-	PFN TempPfn;
 	PageType BusyType;
 	xbox::NTSTATUS status;
 	VAddr CapturedBase = *addr;
@@ -1583,22 +1562,13 @@ xbox::NTSTATUS VMManager::XbAllocateVirtualMemory(VAddr* addr, ULONG ZeroBits, s
 		goto Exit;
 	}
 
-	// With VirtualAlloc we grab one page at a time to avoid fragmentation issues
+	// The pages don't need to be physically contiguous, so each run of uncommitted pte's is backed by the highest free
+	// blocks, a whole block at a time
 
 	BusyType = (Protect & (XBOX_PAGE_EXECUTE | XBOX_PAGE_EXECUTE_READ | XBOX_PAGE_EXECUTE_READWRITE
 		| XBOX_PAGE_EXECUTE_WRITECOPY)) ? ImageType : VirtualMemoryType;
-	PointerPte = StartingPte;
-	while (PointerPte <= EndingPte)
-	{
-		if (PointerPte->Default == 0)
-		{
-			RemoveFree(1, &TempPfn, 0, 0, m_MmLayoutDebug && !m_bAllowNonDebuggerOnTop64MiB ? XBOX_HIGHEST_PHYSICAL_PAGE : m_HighestPage);
-			WritePfn(TempPfn, TempPfn, PointerPte, BusyType);
-			WritePte(PointerPte, PointerPte, TempPte, TempPfn);
-		}
-
-		PointerPte++;
-	}
+	CommitPtes(StartingPte, EndingPte, TempPte, BusyType, 0,
+		m_MmLayoutDebug && !m_bAllowNonDebuggerOnTop64MiB ? XBOX_HIGHEST_PHYSICAL_PAGE : m_HighestPage);
 
 	// Because VirtualAlloc always zeros the memory for us, XBOX_MEM_NOZERO is still unsupported
 
@@ -1647,8 +1617,6 @@ xbox::NTSTATUS VMManager::XbFreeVirtualMemory(VAddr* addr, size_t* Size, DWORD F
 	PMMPTE PointerPte;
 	PMMPTE EndingPte;
 	PMMPTE StartingPte;
-	PFN TempPfn;
-	PageType BusyType;
 	VMAIter it;
 	bool bOverflow;
 
@@ -1746,24 +1714,9 @@ xbox::NTSTATUS VMManager::XbFreeVirtualMemory(VAddr* addr, size_t* Size, DWORD F
 	EndingPte = GetPteAddress(AlignedCapturedBase + AlignedCapturedSize - 1);
 	StartingPte = PointerPte;
 
-	// With VirtualAlloc we free one page at a time since the allocated pfn's are not contiguous
-
-	while (PointerPte <= EndingPte)
-	{
-		if (PointerPte->Default != 0)
-		{
-			TempPfn = PointerPte->Hardware.PFN;
-			InsertFree(TempPfn, TempPfn);
-			if (m_MmLayoutRetail || m_MmLayoutDebug) {
-				BusyType = (PageType)(XBOX_PFN_ELEMENT(TempPfn)->Busy.BusyType);
-			}
-			else { BusyType = (PageType)(CHIHIRO_PFN_ELEMENT(TempPfn)->Busy.BusyType); }
-			WritePfn(TempPfn, TempPfn, PointerPte, BusyType, true);
-		}
-
-		PointerPte++;
-	}
+	// The allocated pfn's are not necessarily contiguous, so free them one contiguous run at a time
 
+	DecommitPtes(StartingPte, EndingPte);
 	WritePte(StartingPte, EndingPte, *StartingPte, 0, true);
 	DeallocatePT((EndingPte - StartingPte + 1) << PAGE_SHIFT, AlignedCapturedBase);
 
@@ -2189,11 +2142,34 @@ VAddr VMManager::MapMemoryBlock(MemoryRegionType Type, PFN_COUNT PteNumber, DWOR
 
 VAddr VMManager::MapHostMemory(VAddr StartingAddr, size_t Size, size_t VmaEnd, DWORD Permissions)
 {
-	for (; StartingAddr + Size - 1 < VmaEnd; StartingAddr += m_AllocationGranularity)
+	// The vma's only track the allocations of the manager, so a free vma can still contain host allocations. Instead of
+	// trying every granule with VirtualAlloc, ask the host for the state of the whole region at StartingAddr and skip past
+	// it when it can't hold the block. Reserving needs free host memory, while committing needs memory the loader reserved
+
+	MEMORY_BASIC_INFORMATION HostInfo;
+	bool bReserve = (Permissions & MEM_RESERVE) != 0;
+
+	while (StartingAddr + Size - 1 < VmaEnd)
 	{
-		if ((VAddr)VirtualAlloc((void*)StartingAddr, Size, Permissions, PAGE_EXECUTE_READWRITE) == StartingAddr)
+		if (VirtualQuery((void*)StartingAddr, &HostInfo, sizeof(HostInfo)) == 0) { break; }
+
+		VAddr HostRegionEnd = (VAddr)HostInfo.BaseAddress + HostInfo.RegionSize;
+		bool bUsable = bReserve ? (HostInfo.State == MEM_FREE && StartingAddr + Size - 1 < HostRegionEnd) : (HostInfo.State != MEM_FREE);
+
+		if (bUsable)
+		{
+			if ((VAddr)VirtualAlloc((void*)StartingAddr, Size, Permissions, PAGE_EXECUTE_READWRITE) == StartingAddr)
+			{
+				return StartingAddr;
+			}
+			StartingAddr += m_AllocationGranularity;
+		}
+		else
 		{
-			return StartingAddr;
+			// Jump to the first granule after the unusable host region
+
+			VAddr NextAddr = ROUND_UP(HostRegionEnd, m_AllocationGranularity);
+			StartingAddr = NextAddr > StartingAddr ? NextAddr : StartingAddr + m_AllocationGranularity;
 		}
 	}
 	return NULL;
@@ -2414,6 +2390,9 @@ void VMManager::UpdateMemoryPermissions(VAddr addr, size_t Size, DWORD Perms)
 
 	DWORD WindowsPerms = ConvertXboxToWinPermissions(PatchXboxPermissions(Perms));
 
+	// Pages watched by NV2A would otherwise keep the protection set below unnoticed
+	nv2a_write_watch_release((void*)addr, Size);
+
 	DWORD dummy;
 	if (!VirtualProtect((void*)addr, Size, WindowsPerms & ~(PAGE_WRITECOMBINE | PAGE_NOCACHE), &dummy))
 	{
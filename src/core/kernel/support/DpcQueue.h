@@ -0,0 +1,127 @@
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+#ifndef DPCQUEUE_H
+#define DPCQUEUE_H
+
+// The queue behind KeInsertQueueDpc, KeRemoveQueueDpc and the DISPATCH_LEVEL software interrupt,
+// kept free of emulator dependencies so that cxbxr-dpcbench can stress the very same code.
+//
+// The queue lock is only held while a DPC is linked or unlinked, never while a deferred routine
+// runs, so inserting a DPC never waits for a running one. Removing a DPC unlinks it right away,
+// after which the queue doesn't touch it anymore (so its memory may be freed).
+
+#include <cstddef>
+#include <mutex>
+
+// TDpc needs the fields of a KDPC : Inserted, DpcListEntry (with Flink and Blink), DeferredRoutine,
+// DeferredContext, SystemArgument1 and SystemArgument2
+template<typename TDpc>
+class DpcQueue
+{
+public:
+	typedef decltype(TDpc::DpcListEntry) ListEntry;
+	typedef decltype(TDpc::SystemArgument1) Argument;
+
+	DpcQueue() { m_Head.Flink = m_Head.Blink = &m_Head; }
+
+	// Remembers the arguments and links the DPC at the tail, returns false if it was already queued
+	bool Insert(TDpc *Dpc, Argument SystemArgument1, Argument SystemArgument2)
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		if (Dpc->Inserted) {
+			return false;
+		}
+
+		Dpc->Inserted = true;
+		Dpc->SystemArgument1 = SystemArgument1;
+		Dpc->SystemArgument2 = SystemArgument2;
+		Dpc->DpcListEntry.Flink = &m_Head;
+		Dpc->DpcListEntry.Blink = m_Head.Blink;
+		m_Head.Blink->Flink = &(Dpc->DpcListEntry);
+		m_Head.Blink = &(Dpc->DpcListEntry);
+		return true;
+	}
+
+	// Unlinks the DPC, returns false if it wasn't queued
+	bool Remove(TDpc *Dpc)
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		if (!Dpc->Inserted) {
+			return false;
+		}
+
+		Unlink(Dpc);
+		return true;
+	}
+
+	// Calls Call(Dpc, Snapshot) for each queued DPC in insertion order, with Snapshot a copy taken
+	// while unlinking it (the DPC can be queued again as soon as it's unlinked). Like on the single
+	// Xbox CPU, only one thread runs DPCs at a time : the DPCs queued while another thread runs them
+	// are left to that thread, which checks for more before it stops.
+	template<typename TCall>
+	void Run(TCall Call)
+	{
+		while (HasQueued() && m_RunLock.try_lock()) {
+			TDpc Snapshot;
+			while (TDpc *Dpc = Dequeue(Snapshot)) {
+				Call(Dpc, Snapshot);
+			}
+
+			m_RunLock.unlock();
+		}
+	}
+
+private:
+	bool HasQueued()
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		return m_Head.Flink != &m_Head;
+	}
+
+	TDpc *Dequeue(TDpc &Snapshot)
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		if (m_Head.Flink == &m_Head) {
+			return nullptr;
+		}
+
+		TDpc *Dpc = (TDpc *)((char *)m_Head.Flink - offsetof(TDpc, DpcListEntry));
+		Unlink(Dpc);
+		Snapshot = *Dpc;
+		return Dpc;
+	}
+
+	void Unlink(TDpc *Dpc)
+	{
+		Dpc->DpcListEntry.Blink->Flink = Dpc->DpcListEntry.Flink;
+		Dpc->DpcListEntry.Flink->Blink = Dpc->DpcListEntry.Blink;
+		Dpc->Inserted = false;
+	}
+
+	ListEntry m_Head;
+	std::mutex m_Lock;
+	// Recursive, so that a deferred routine lowering the IRQL still runs the DPCs it queued
+	std::recursive_mutex m_RunLock;
+};
+
+#endif
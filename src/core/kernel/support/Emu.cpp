@@ -32,6 +32,7 @@
 #include "core\kernel\init\CxbxKrnl.h"
 #include "Emu.h"
 #include "devices\x86\EmuX86.h"
+#include "devices\video\nv2a_write_watch.h" // For nv2a_write_watch_handle_fault
 #include "EmuShared.h"
 #include "core\hle\Intercept.hpp"
 #include "CxbxDebugger.h"
@@ -248,6 +249,13 @@ bool lleTryHandleException(EXCEPTION_POINTERS *e)
 	// Initalize local thread variable
 	bOverrideEmuException = false;
 
+	// Writes to guest memory watched by NV2A can come from host code too, so check these first
+	if (e->ExceptionRecord->ExceptionCode == EXCEPTION_ACCESS_VIOLATION
+		&& e->ExceptionRecord->ExceptionInformation[0] == 1 // write access
+		&& nv2a_write_watch_handle_fault((void*)e->ExceptionRecord->ExceptionInformation[1])) {
+		return true;
+	}
+
 	// Only handle exceptions which originate from Xbox code
 	if (!IsXboxCodeAddress(e->ContextRecord->Eip)) {
 		return false;
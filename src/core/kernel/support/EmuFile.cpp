@@ -28,6 +28,7 @@
 #define LOG_PREFIX CXBXR_MODULE::FILE
 
 #include "EmuFile.h"
+#include "EmuFilePathCache.h"
 #include <vector>
 #include <string>
 #include <sstream>
@@ -242,6 +243,8 @@ const char CxbxDefaultXbeDriveLetter = 'D';
 int CxbxDefaultXbeDriveIndex = -1;
 EmuNtSymbolicLinkObject* NtSymbolicLinkObjects[26];
 std::vector<XboxDevice> Devices;
+// Results of CxbxConvertFilePath, flushed whenever a drive is (un)mounted or a device is registered
+EmuFilePathCache g_EmuFilePathCache;
 
 EmuHandle::EmuHandle(EmuNtObject* ntObject)
 {
@@ -483,7 +486,7 @@ NTSTATUS CxbxConvertFilePath(
 NTSTATUS CxbxObjectAttributesToNT(
 	xbox::POBJECT_ATTRIBUTES ObjectAttributes, 
 	OUT NativeObjectAttributes& nativeObjectAttributes, 
-	const std::string aFileAPIName,
+	const char *aFileAPIName,
 	bool partitionHeader)
 {
 	if (ObjectAttributes == NULL)
@@ -494,28 +497,55 @@ NTSTATUS CxbxObjectAttributesToNT(
 	}
 
 	// Pick up the ObjectName, and let's see what to make of it :
-	std::string ObjectName = "";
-	if (ObjectAttributes->ObjectName != NULL) {
-		ObjectName = PSTRING_to_string(ObjectAttributes->ObjectName);
+	const char *ObjectName = "";
+	size_t ObjectNameLength = 0;
+	if (ObjectAttributes->ObjectName != NULL && ObjectAttributes->ObjectName->Buffer != NULL) {
+		ObjectName = ObjectAttributes->ObjectName->Buffer;
+		ObjectNameLength = ObjectAttributes->ObjectName->Length;
 	}
-	std::wstring RelativeHostPath;
 	NtDll::HANDLE RootDirectory = ObjectAttributes->RootDirectory;
 
 	// Is there a filename API given?
-	if (aFileAPIName.size() > 0) {
-		// Then interpret the ObjectName as a filename, and update it to host relative :
-		NTSTATUS result = CxbxConvertFilePath(ObjectName, /*OUT*/RelativeHostPath, /*IN OUT*/&RootDirectory, aFileAPIName, partitionHeader);
-		if (FAILED(result)) {
-			return result;
+	if (aFileAPIName[0] != '\0') {
+		// The same files get opened over and over, so first try the paths converted before; on a hit,
+		// the host path is copied straight into nativeObjectAttributes without any string copies.
+		// '\??\' is always trimmed off, so leave it out of the key. Handle -4 (BaseNamedObjects) is the
+		// exception, its conversion keeps the prefix; those aren't files, so simply don't cache them.
+		const char *XboxPath = ObjectName;
+		size_t XboxPathLength = ObjectNameLength;
+		if (XboxPathLength >= DrivePrefix.length() && memcmp(XboxPath, DrivePrefix.c_str(), DrivePrefix.length()) == 0) {
+			XboxPath += DrivePrefix.length();
+			XboxPathLength -= DrivePrefix.length();
+		}
+		bool bCacheable = (XboxPathLength < PATH_CACHE_MAX_PATH) && (RootDirectory != (NtDll::HANDLE)-4);
+		uint32_t CacheGeneration = 0;
+		if (bCacheable && g_EmuFilePathCache.Lookup(XboxPath, XboxPathLength, RootDirectory, partitionHeader,
+			/*OUT*/&RootDirectory, nativeObjectAttributes.wszObjectName, ARRAYSIZE(nativeObjectAttributes.wszObjectName), /*OUT*/&CacheGeneration)) {
+			if (g_bPrintfOn) {
+				EmuLog(LOG_LEVEL::DEBUG, "%s Cached path \"%.*s\" -> \"%ls\"", aFileAPIName, (int)ObjectNameLength, ObjectName, nativeObjectAttributes.wszObjectName);
+			}
+		}
+		else {
+			// Then interpret the ObjectName as a filename, and update it to host relative :
+			std::wstring RelativeHostPath;
+			NTSTATUS result = CxbxConvertFilePath(std::string(ObjectName, ObjectNameLength), /*OUT*/RelativeHostPath, /*IN OUT*/&RootDirectory, aFileAPIName, partitionHeader);
+			if (FAILED(result)) {
+				return result;
+			}
+
+			if (bCacheable) {
+				g_EmuFilePathCache.Insert(CacheGeneration, XboxPath, XboxPathLength, ObjectAttributes->RootDirectory, partitionHeader, RootDirectory, RelativeHostPath);
+			}
+
+			// Copy the wide string to the unicode string
+			wcscpy_s(nativeObjectAttributes.wszObjectName, RelativeHostPath.c_str());
 		}
 	}
 	else {
 		// When not called from a file-handling API, just convert the ObjectName to a wide string :
-		RelativeHostPath = string_to_wstring(ObjectName);
+		wcscpy_s(nativeObjectAttributes.wszObjectName, string_to_wstring(std::string(ObjectName, ObjectNameLength)).c_str());
 	}
 
-	// Copy the wide string to the unicode string
-	wcscpy_s(nativeObjectAttributes.wszObjectName, RelativeHostPath.c_str());
 	NtDll::RtlInitUnicodeString(&nativeObjectAttributes.NtUnicodeString, nativeObjectAttributes.wszObjectName);
 	// And initialize the NT ObjectAttributes with that :
 	InitializeObjectAttributes(&nativeObjectAttributes.NtObjAttr, &nativeObjectAttributes.NtUnicodeString, ObjectAttributes->Attributes, RootDirectory, NULL);
@@ -570,6 +600,7 @@ int CxbxRegisterDeviceHostPath(std::string XboxDevicePath, std::string HostDevic
 	if (status == STATUS_SUCCESS || status == ERROR_ALREADY_EXISTS) {
 		Devices.push_back(newDevice);
 		result = Devices.size() - 1;
+		g_EmuFilePathCache.Invalidate();
 	}
 
 	return result;
@@ -663,6 +694,7 @@ NTSTATUS EmuNtSymbolicLinkObject::Init(std::string aSymbolicLinkName, std::strin
 				else
 				{
 					NtSymbolicLinkObjects[DriveLetter - 'A'] = this;
+					g_EmuFilePathCache.Invalidate();
 					EmuLog(LOG_LEVEL::DEBUG, "Linked \"%s\" to \"%s\" (residing at \"%s\")", aSymbolicLinkName.c_str(), aFullPath.c_str(), HostSymbolicLinkPath.c_str());
 				}
 			}
@@ -677,6 +709,7 @@ NTSTATUS EmuNtSymbolicLinkObject::Init(std::string aSymbolicLinkName, std::strin
 	if (DriveLetter >= 'A' && DriveLetter <= 'Z') {
 		NtSymbolicLinkObjects[DriveLetter - 'A'] = NULL;
 		NtDll::NtClose(RootDirectoryHandle);
+		g_EmuFilePathCache.Invalidate();
 	}
 }
 
@@ -0,0 +1,178 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+#include <algorithm>
+#include <cstring>
+#include "EmuFilePathCache.h"
+
+#define PATH_CACHE_BUCKETS (PATH_CACHE_ENTRIES * 2) // Must be a power of two
+#define PATH_CACHE_NONE 0xFFFFFFFF
+
+EmuFilePathCache::EmuFilePathCache()
+	: m_Buckets(PATH_CACHE_BUCKETS, PATH_CACHE_NONE), m_LruHead(PATH_CACHE_NONE), m_LruTail(PATH_CACHE_NONE),
+	m_Generation(0), m_Hits(0), m_Misses(0)
+{
+	m_Entries.reserve(PATH_CACHE_ENTRIES);
+}
+
+uint32_t EmuFilePathCache::Hash(const char *XboxPath, size_t Length, void *RootDirectory, bool bPartitionHeader)
+{
+	// FNV-1a over the path, then the other parts of the key
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < Length; i++) {
+		hash = (hash ^ (uint8_t)XboxPath[i]) * 16777619u;
+	}
+	hash = (hash ^ (uint32_t)(uintptr_t)RootDirectory) * 16777619u;
+	hash = (hash ^ (bPartitionHeader ? 1u : 0u)) * 16777619u;
+	return hash;
+}
+
+uint32_t EmuFilePathCache::Find(uint32_t Hash, const char *XboxPath, size_t Length, void *RootDirectory, bool bPartitionHeader) const
+{
+	for (uint32_t i = m_Buckets[Hash & (PATH_CACHE_BUCKETS - 1)]; i != PATH_CACHE_NONE; i = m_Entries[i].HashNext) {
+		const Entry &entry = m_Entries[i];
+		if (entry.Hash == Hash && entry.RootDirectory == RootDirectory && entry.bPartitionHeader == bPartitionHeader &&
+			entry.XboxPath.size() == Length && std::memcmp(entry.XboxPath.data(), XboxPath, Length) == 0) {
+			return i;
+		}
+	}
+
+	return PATH_CACHE_NONE;
+}
+
+void EmuFilePathCache::LruUnlink(uint32_t Index)
+{
+	Entry &entry = m_Entries[Index];
+	if (entry.LruPrev != PATH_CACHE_NONE) {
+		m_Entries[entry.LruPrev].LruNext = entry.LruNext;
+	} else {
+		m_LruHead = entry.LruNext;
+	}
+	if (entry.LruNext != PATH_CACHE_NONE) {
+		m_Entries[entry.LruNext].LruPrev = entry.LruPrev;
+	} else {
+		m_LruTail = entry.LruPrev;
+	}
+}
+
+void EmuFilePathCache::LruPushFront(uint32_t Index)
+{
+	Entry &entry = m_Entries[Index];
+	entry.LruPrev = PATH_CACHE_NONE;
+	entry.LruNext = m_LruHead;
+	if (m_LruHead != PATH_CACHE_NONE) {
+		m_Entries[m_LruHead].LruPrev = Index;
+	} else {
+		m_LruTail = Index;
+	}
+	m_LruHead = Index;
+}
+
+void EmuFilePathCache::BucketUnlink(uint32_t Index)
+{
+	uint32_t *pLink = &m_Buckets[m_Entries[Index].Hash & (PATH_CACHE_BUCKETS - 1)];
+	while (*pLink != Index) {
+		pLink = &m_Entries[*pLink].HashNext;
+	}
+	*pLink = m_Entries[Index].HashNext;
+}
+
+bool EmuFilePathCache::Lookup(const char *XboxPath, size_t Length, void *RootDirectory, bool bPartitionHeader,
+	void **pHostRootDirectory, wchar_t *HostPath, size_t HostPathChars, uint32_t *pGeneration)
+{
+	std::lock_guard<std::mutex> lck(m_Mtx);
+
+	*pGeneration = m_Generation;
+
+	uint32_t Index = Find(Hash(XboxPath, Length, RootDirectory, bPartitionHeader), XboxPath, Length, RootDirectory, bPartitionHeader);
+	if (Index == PATH_CACHE_NONE || m_Entries[Index].HostPath.size() >= HostPathChars) {
+		m_Misses++;
+		return false;
+	}
+
+	const Entry &entry = m_Entries[Index];
+	*pHostRootDirectory = entry.HostRootDirectory;
+	std::memcpy(HostPath, entry.HostPath.c_str(), (entry.HostPath.size() + 1) * sizeof(wchar_t));
+
+	if (m_LruHead != Index) {
+		LruUnlink(Index);
+		LruPushFront(Index);
+	}
+
+	m_Hits++;
+	return true;
+}
+
+void EmuFilePathCache::Insert(uint32_t Generation, const char *XboxPath, size_t Length, void *RootDirectory, bool bPartitionHeader,
+	void *HostRootDirectory, const std::wstring &HostPath)
+{
+	std::lock_guard<std::mutex> lck(m_Mtx);
+
+	// The symbolic links changed while this path was converted, the result might be stale
+	if (Generation != m_Generation) {
+		return;
+	}
+
+	uint32_t hash = Hash(XboxPath, Length, RootDirectory, bPartitionHeader);
+	uint32_t Index = Find(hash, XboxPath, Length, RootDirectory, bPartitionHeader);
+	if (Index != PATH_CACHE_NONE) {
+		// Another thread converted the same path in the meantime
+		return;
+	}
+
+	if (m_Entries.size() < PATH_CACHE_ENTRIES) {
+		Index = (uint32_t)m_Entries.size();
+		m_Entries.emplace_back();
+	} else {
+		// Replace the least recently used entry
+		Index = m_LruTail;
+		LruUnlink(Index);
+		BucketUnlink(Index);
+	}
+
+	Entry &entry = m_Entries[Index];
+	entry.XboxPath.assign(XboxPath, Length);
+	entry.HostPath = HostPath;
+	entry.RootDirectory = RootDirectory;
+	entry.HostRootDirectory = HostRootDirectory;
+	entry.bPartitionHeader = bPartitionHeader;
+	entry.Hash = hash;
+
+	uint32_t &bucket = m_Buckets[hash & (PATH_CACHE_BUCKETS - 1)];
+	entry.HashNext = bucket;
+	bucket = Index;
+	LruPushFront(Index);
+}
+
+void EmuFilePathCache::Invalidate()
+{
+	std::lock_guard<std::mutex> lck(m_Mtx);
+
+	m_Generation++;
+	m_Entries.clear();
+	std::fill(m_Buckets.begin(), m_Buckets.end(), PATH_CACHE_NONE);
+	m_LruHead = PATH_CACHE_NONE;
+	m_LruTail = PATH_CACHE_NONE;
+}
@@ -0,0 +1,87 @@
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+#ifndef EMUFILEPATHCACHE_H
+#define EMUFILEPATHCACHE_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Resolved paths kept, the least recently used one is replaced when full
+#define PATH_CACHE_ENTRIES 1024
+// Longest Xbox path (without the '\??\' prefix) that is cached, also the size of the stack buffers used
+#define PATH_CACHE_MAX_PATH 260
+
+// Remembers what CxbxConvertFilePath made of an Xbox path : the host root directory handle and the
+// path relative to it. Titles open the same files over and over (and thousands of them while loading),
+// a hit skips the symbolic link searches and all the string copies of the conversion.
+// Results depend on the symbolic links and devices, so Invalidate must be called whenever those change.
+class EmuFilePathCache
+{
+public:
+	EmuFilePathCache();
+
+	// Copies the cached host path (including the terminator) to HostPath when present and it fits.
+	// Always returns the generation to pass to Insert, so results of a conversion that raced with
+	// an Invalidate are dropped instead of cached.
+	bool Lookup(const char *XboxPath, size_t Length, void *RootDirectory, bool bPartitionHeader,
+		void **pHostRootDirectory, wchar_t *HostPath, size_t HostPathChars, uint32_t *pGeneration);
+	void Insert(uint32_t Generation, const char *XboxPath, size_t Length, void *RootDirectory, bool bPartitionHeader,
+		void *HostRootDirectory, const std::wstring &HostPath);
+	void Invalidate();
+
+	uint64_t GetHits() const { return m_Hits; }
+	uint64_t GetMisses() const { return m_Misses; }
+
+private:
+	struct Entry {
+		std::string  XboxPath; // Interned key, its storage is reused when the entry is replaced
+		std::wstring HostPath;
+		void        *RootDirectory;
+		void        *HostRootDirectory;
+		uint32_t     Hash;
+		uint32_t     HashNext; // Next entry in the same bucket
+		uint32_t     LruPrev;  // Towards the most recently used entry
+		uint32_t     LruNext;  // Towards the least recently used entry
+		bool         bPartitionHeader;
+	};
+
+	static uint32_t Hash(const char *XboxPath, size_t Length, void *RootDirectory, bool bPartitionHeader);
+	uint32_t Find(uint32_t Hash, const char *XboxPath, size_t Length, void *RootDirectory, bool bPartitionHeader) const;
+	void LruUnlink(uint32_t Index);
+	void LruPushFront(uint32_t Index);
+	void BucketUnlink(uint32_t Index);
+
+	std::vector<Entry>    m_Entries;
+	std::vector<uint32_t> m_Buckets; // First entry of each bucket
+	uint32_t              m_LruHead;
+	uint32_t              m_LruTail;
+	uint32_t              m_Generation;
+	uint64_t              m_Hits;
+	uint64_t              m_Misses;
+	// Guest threads open files concurrently
+	std::mutex            m_Mtx;
+};
+
+#endif // EMUFILEPATHCACHE_H
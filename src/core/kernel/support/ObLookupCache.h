@@ -0,0 +1,131 @@
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+#ifndef OBLOOKUPCACHE_H
+#define OBLOOKUPCACHE_H
+
+// The name hash and lookup cache behind ObpLookupElementNameInDirectory, kept free of emulator
+// dependencies so that cxbxr-oblookupbench can check the very same code.
+//
+// A directory only has OB_NUMBER_HASH_BUCKETS chains, which get long once a title created a lot of
+// named objects. The cache remembers the last name resolved per (directory, name hash) slot, so
+// looking up the same names over and over mostly skips the chain walk. Entries are always verified
+// against the name info they point to, a stale or colliding entry is just a miss. Name infos must be
+// purged before they are freed though, as verifying reads them.
+
+#include <cstddef>
+#include <cstdint>
+
+// Case folded hash of an object name, ObpComputeHashIndex reduces it to a bucket index
+static inline uint32_t ObpComputeNameHash(const char *Name, size_t Length)
+{
+	uint32_t HashIndex = 0;
+	const uint8_t *Buffer = (const uint8_t *)Name;
+	const uint8_t *BufferEnd = Buffer + Length;
+
+	// Calculate hash of string data
+	uint8_t Char;
+	while (Buffer < BufferEnd) {
+		Char = *Buffer++;
+		// Skip special characters
+		if (Char >= 0x80) {
+			continue;
+		}
+
+		// Force all characters to be lowercase
+		Char |= 0x20;
+
+		HashIndex += (HashIndex << 1) + (HashIndex >> 1) + Char;
+	}
+
+	return HashIndex;
+}
+
+// TDirectory needs the HashBuckets of an OBJECT_DIRECTORY (NumberOfBuckets of them), TNameInfo the
+// ChainLink, Directory and Name (with Buffer and Length) of an OBJECT_HEADER_NAME_INFO
+template<typename TDirectory, typename TNameInfo, unsigned NumberOfBuckets, unsigned Size = 256>
+class ObLookupCache
+{
+	static_assert((Size & (Size - 1)) == 0, "Size must be a power of two");
+
+public:
+	ObLookupCache() { Clear(); }
+
+	void Clear()
+	{
+		for (Entry &CacheEntry : m_Entries) {
+			CacheEntry.Directory = nullptr;
+			CacheEntry.NameHash = 0;
+			CacheEntry.NameInfo = nullptr;
+		}
+	}
+
+	// Returns the name info in Directory that Equal(NameInfo) accepts, nullptr if there's none. NameHash
+	// must be ObpComputeNameHash of the name looked up, Equal is only called for names of NameLength.
+	template<typename TEqual>
+	TNameInfo *Lookup(TDirectory *Directory, uint32_t NameHash, size_t NameLength, TEqual Equal)
+	{
+		Entry &CacheEntry = GetEntry(Directory, NameHash);
+		TNameInfo *NameInfo = CacheEntry.NameInfo;
+		if ((NameInfo != nullptr) && (CacheEntry.Directory == Directory) && (CacheEntry.NameHash == NameHash) &&
+			(NameInfo->Directory == Directory) && (NameInfo->Name.Length == NameLength) && Equal(NameInfo)) {
+			return NameInfo;
+		}
+
+		for (NameInfo = Directory->HashBuckets[NameHash % NumberOfBuckets]; NameInfo != nullptr; NameInfo = NameInfo->ChainLink) {
+			// Check the length first, most names in a chain differ in length
+			if ((NameInfo->Name.Length == NameLength) && Equal(NameInfo)) {
+				CacheEntry.Directory = Directory;
+				CacheEntry.NameHash = NameHash;
+				CacheEntry.NameInfo = NameInfo;
+				return NameInfo;
+			}
+		}
+
+		return nullptr;
+	}
+
+	// Forgets the name info (if cached), which must still be in its directory
+	void Purge(TNameInfo *NameInfo)
+	{
+		Entry &CacheEntry = GetEntry(NameInfo->Directory, ObpComputeNameHash(NameInfo->Name.Buffer, NameInfo->Name.Length));
+		if (CacheEntry.NameInfo == NameInfo) {
+			CacheEntry.NameInfo = nullptr;
+		}
+	}
+
+private:
+	struct Entry {
+		TDirectory *Directory;
+		uint32_t    NameHash;
+		TNameInfo  *NameInfo;
+	};
+
+	Entry &GetEntry(TDirectory *Directory, uint32_t NameHash)
+	{
+		return m_Entries[(NameHash ^ (uint32_t)((uintptr_t)Directory >> 4)) & (Size - 1)];
+	}
+
+	Entry m_Entries[Size];
+};
+
+#endif // OBLOOKUPCACHE_H
@@ -0,0 +1,228 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of Cxbx-Reloaded.
+// *
+// *  Cxbx-Reloaded is free software; you can redistribute it
+// *  and/or modify it under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+// Checks and times the SHA1 behind XcSHA*, XcHMAC and the XBE hash checks.
+//
+// The test hashes the FIPS 180-1 vectors, and inputs of every length around
+// the padding edges (55 bytes still fit the length in the last block, 56 need
+// another block, 64 fill one), with every implementation the host supports,
+// and requires the known digests. It then hashes random inputs split into
+// random chunks, and requires the same digest as hashing them in one go with
+// the portable implementation, and checks CalcSHA1Hash, which hashes the
+// length first.
+//
+// The benchmark reports the hash rate of each implementation.
+//
+// Usage : cxbxr-cryptobench [buffer KB] [seconds]
+//         cxbxr-cryptobench -test
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "common/crypto/EmuSha.h"
+
+#define TEST_RANDOM_INPUTS 2000
+#define TEST_RANDOM_MAX 1000
+
+static unsigned g_Failures = 0;
+
+static const char *ImplementationNames[] = { "portable", "SHA extensions" };
+
+static std::string ToHex(const unsigned char digest[A_SHA_DIGEST_LEN])
+{
+	char Hex[A_SHA_DIGEST_LEN * 2 + 1];
+	for (int i = 0; i < A_SHA_DIGEST_LEN; i++) {
+		sprintf(&Hex[i * 2], "%02x", digest[i]);
+	}
+	return Hex;
+}
+
+// Hashes the input in chunks of the given sizes (the last one takes the rest)
+static std::string Hash(const std::vector<unsigned char> &Input, const std::vector<uint32_t> &Chunks = {})
+{
+	SHA1_CTX Context;
+	SHA1Init(&Context);
+	uint32_t Offset = 0;
+	for (uint32_t Chunk : Chunks) {
+		Chunk = std::min<uint32_t>(Chunk, (uint32_t)Input.size() - Offset);
+		SHA1Update(&Context, Input.data() + Offset, Chunk);
+		Offset += Chunk;
+	}
+	SHA1Update(&Context, Input.data() + Offset, (uint32_t)Input.size() - Offset);
+	unsigned char Digest[A_SHA_DIGEST_LEN];
+	SHA1Final(Digest, &Context);
+	return ToHex(Digest);
+}
+
+static void TestKnownAnswers(const char *szImplementation)
+{
+	static const struct { const char *Text; size_t Repeat; const char *Digest; } Vectors[] = {
+		{ "abc", 1, "a9993e364706816aba3e25717850c26c9cd0d89d" },
+		{ "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1, "84983e441c3bd26ebaae4aa1f95129e5e54670f1" },
+		{ "a", 1000000, "34aa973cd4c4daa4f61eeb2bdbad27316534016f" },
+		// Around the padding edges
+		{ "", 1, "da39a3ee5e6b4b0d3255bfef95601890afd80709" },
+		{ "a", 1, "86f7e437faa5a7fce15d1ddcb9eaeaea377667b8" },
+		{ "a", 55, "c1c8bbdc22796e28c0e15163d20899b65621d65a" },
+		{ "a", 56, "c2db330f6083854c99d4b5bfb6e8f29f201be699" },
+		{ "a", 57, "f08f24908d682555111be7ff6f004e78283d989a" },
+		{ "a", 63, "03f09f5b158a7a8cdad920bddc29b81c18a551f5" },
+		{ "a", 64, "0098ba824b5c16427bd7a1122a5a442a25ec644d" },
+		{ "a", 65, "11655326c708d70319be2610e8a57d9a5b959d3b" },
+		{ "a", 119, "ee971065aaa017e0632a8ca6c77bb3bf8b1dfc56" },
+		{ "a", 120, "f34c1488385346a55709ba056ddd08280dd4c6d6" },
+		{ "a", 128, "ad5b3fdbcb526778c2839d2f151ea753995e26a0" },
+	};
+
+	for (const auto &Vector : Vectors) {
+		std::vector<unsigned char> Input;
+		for (size_t i = 0; i < Vector.Repeat; i++) {
+			Input.insert(Input.end(), Vector.Text, Vector.Text + strlen(Vector.Text));
+		}
+		// In one go, and a byte at a time (except the million bytes)
+		std::string Digest = Hash(Input);
+		std::string Bytewise = (Input.size() > 1000) ? Digest : Hash(Input, std::vector<uint32_t>(Input.size(), 1));
+		if (Digest != Vector.Digest || Bytewise != Vector.Digest) {
+			printf("FAIL : %s SHA1 of %zu bytes of \"%.8s\" is %s instead of %s\n", szImplementation, Input.size(), Vector.Text,
+				(Digest != Vector.Digest) ? Digest.c_str() : Bytewise.c_str(), Vector.Digest);
+			g_Failures++;
+		}
+	}
+
+	// Hashes the length (as 4 bytes) before the data
+	static const unsigned char abc[] = { 'a', 'b', 'c' };
+	unsigned char Digest[A_SHA_DIGEST_LEN];
+	CalcSHA1Hash(Digest, abc, 3);
+	if (ToHex(Digest) != "0e384d8eefcc8717159331382cd1fcc9411a7352") {
+		printf("FAIL : %s CalcSHA1Hash of \"abc\" is %s\n", szImplementation, ToHex(Digest).c_str());
+		g_Failures++;
+	}
+}
+
+// Random inputs in random chunks, against hashing them in one go with the portable implementation
+static void TestChunks(SHA1Implementation Implementation)
+{
+	std::mt19937 rng(0x5A1 + Implementation);
+	for (int i = 0; i < TEST_RANDOM_INPUTS; i++) {
+		std::vector<unsigned char> Input(rng() % TEST_RANDOM_MAX);
+		for (auto &Byte : Input) {
+			Byte = (unsigned char)rng();
+		}
+		std::vector<uint32_t> Chunks;
+		for (uint32_t Total = 0; Total < Input.size(); ) {
+			// Mostly short chunks, with whole blocks and longer ones once in a while
+			uint32_t Chunk = (rng() % 4 == 0) ? 64 * (rng() % 4) : (rng() % 4 == 0) ? rng() % 300 : rng() % 70;
+			Chunks.push_back(Chunk);
+			Total += Chunk;
+		}
+
+		SHA1_UseImplementation(SHA1_NOSIMD);
+		std::string Expected = Hash(Input);
+		SHA1_UseImplementation(Implementation);
+		std::string Digest = Hash(Input, Chunks);
+		if (Digest != Expected) {
+			printf("FAIL : %s SHA1 of %zu random bytes in %zu chunks is %s instead of %s\n", ImplementationNames[Implementation],
+				Input.size(), Chunks.size() + 1, Digest.c_str(), Expected.c_str());
+			g_Failures++;
+		}
+	}
+}
+
+static void TestImplementation(SHA1Implementation Implementation)
+{
+	if (!SHA1_UseImplementation(Implementation)) {
+		printf("This host has no %s, skipped\n", ImplementationNames[Implementation]);
+		return;
+	}
+
+	TestKnownAnswers(ImplementationNames[Implementation]);
+	TestChunks(Implementation);
+}
+
+typedef std::chrono::steady_clock BenchClock;
+
+// Runs Run over and over for the given time, and returns the bytes it processed per second
+template<typename Runner>
+static double Measure(double Seconds, Runner Run)
+{
+	uint64_t Bytes = 0;
+	auto Start = BenchClock::now();
+	double Elapsed;
+	do {
+		for (unsigned i = 0; i < 4; i++) {
+			Bytes += Run();
+		}
+		Elapsed = std::chrono::duration<double>(BenchClock::now() - Start).count();
+	} while (Elapsed < Seconds);
+	return (double)Bytes / Elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 2 && strcmp(argv[1], "-test") == 0) {
+		TestImplementation(SHA1_NOSIMD);
+		TestImplementation(SHA1_SHA);
+		printf("%u failure(s)\n", g_Failures);
+		return g_Failures ? 1 : 0;
+	}
+
+	if (argc > 1 && (argv[1][0] < '0' || argv[1][0] > '9')) {
+		printf("Usage : cxbxr-cryptobench [buffer KB] [seconds]\n");
+		printf("        cxbxr-cryptobench -test\n");
+		return 1;
+	}
+
+	// About the size of an XBE section
+	uint32_t BufferSize = (argc > 1) ? (uint32_t)atoi(argv[1]) * 1024 : 1024 * 1024;
+	double Seconds = (argc > 2) ? atof(argv[2]) : 1.0;
+	if (BufferSize == 0) {
+		BufferSize = 1;
+	}
+
+	std::mt19937 rng(0x5A1);
+	std::vector<unsigned char> Input(BufferSize);
+	for (auto &Byte : Input) {
+		Byte = (unsigned char)rng();
+	}
+
+	printf("%u byte buffer, SHA1 MB per second\n", BufferSize);
+	for (SHA1Implementation Implementation : { SHA1_NOSIMD, SHA1_SHA }) {
+		if (!SHA1_UseImplementation(Implementation)) {
+			printf("%-24s %10s\n", ImplementationNames[Implementation], "n/a");
+			continue;
+		}
+		unsigned char Digest[A_SHA_DIGEST_LEN];
+		double Rate = Measure(Seconds, [&]() { CalcSHA1Hash(Digest, Input.data(), BufferSize); return BufferSize; });
+		printf("%-24s %10.1f\n", ImplementationNames[Implementation], Rate / 1e6);
+	}
+
+	return 0;
+}
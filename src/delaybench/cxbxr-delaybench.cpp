@@ -0,0 +1,216 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of Cxbx-Reloaded.
+// *
+// *  Cxbx-Reloaded is free software; you can redistribute it
+// *  and/or modify it under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+// Measures how long the delays of TimerDelay.h actually take, and how much
+// CPU time they burn doing so : the stall behind KeStallExecutionProcessor,
+// and the timer wait behind KeDelayExecutionThread. Each size is repeated
+// and the distribution of the overshoot (actual minus requested time) is
+// printed, along with the CPU time as a share of the time waited.
+//
+// With -test, the stall and the wait must never return early. How late they
+// return and how much CPU time they take depend on the host and its load, so
+// those are only reported. On a fake clock, which advances a fixed step per
+// read, the stall must return at the first read at or past its deadline (so
+// a longer stall never ends before a shorter one), and the sleep overshoot
+// calibration must find the overshoot of the fake sleeps.
+//
+// Usage : cxbxr-delaybench [runs per size]
+//         cxbxr-delaybench -test
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "common/TimerDelay.h"
+
+#define TEST_RUNS 100
+
+static unsigned g_Failures = 0;
+
+static uint64_t ReadSteadyClock()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// CPU time of the calling thread, in ns
+static uint64_t ThreadCpuTime()
+{
+#ifdef _WIN32
+	FILETIME Creation, Exit, Kernel, User;
+	GetThreadTimes(GetCurrentThread(), &Creation, &Exit, &Kernel, &User);
+	return ((((uint64_t)Kernel.dwHighDateTime << 32) | Kernel.dwLowDateTime) +
+		(((uint64_t)User.dwHighDateTime << 32) | User.dwLowDateTime)) * 100;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+struct DelayStats {
+	double p50_US;
+	double p99_US;
+	double max_US;
+	double min_US;   // Negative when the delay returned early
+	double cpuShare; // CPU time over wall time
+};
+
+// Runs Delay(Microseconds) Runs times, and returns the distribution of its overshoot
+template<typename Delay>
+static DelayStats Measure(uint64_t Microseconds, unsigned Runs, Delay delay)
+{
+	std::vector<double> Overshoot_US(Runs);
+	uint64_t WallStart = ReadSteadyClock();
+	uint64_t CpuStart = ThreadCpuTime();
+	for (unsigned i = 0; i < Runs; i++) {
+		uint64_t Start = ReadSteadyClock();
+		delay(Microseconds);
+		Overshoot_US[i] = (ReadSteadyClock() - Start) / 1000.0 - Microseconds;
+	}
+	uint64_t Cpu = ThreadCpuTime() - CpuStart;
+	uint64_t Wall = ReadSteadyClock() - WallStart;
+
+	std::sort(Overshoot_US.begin(), Overshoot_US.end());
+	DelayStats Stats;
+	Stats.min_US = Overshoot_US.front();
+	Stats.p50_US = Overshoot_US[Runs / 2];
+	Stats.p99_US = Overshoot_US[std::min<size_t>(Runs - 1, (Runs * 99) / 100)];
+	Stats.max_US = Overshoot_US.back();
+	Stats.cpuShare = (double)Cpu / Wall;
+	return Stats;
+}
+
+static void PrintStats(const char *szName, uint64_t Microseconds, const DelayStats &Stats)
+{
+	printf("%-6s %6llu us : overshoot p50 %8.1f, p99 %8.1f, max %8.1f us, cpu %5.1f%%\n", szName,
+		(unsigned long long)Microseconds, Stats.p50_US, Stats.p99_US, Stats.max_US, Stats.cpuShare * 100);
+}
+
+// A clock on which every host sleep takes 1 ms and 123 us (two reads per sleep)
+static uint64_t g_FakeClockReads;
+static uint64_t ReadFakeClock()
+{
+	return ((g_FakeClockReads++ + 1) / 2) * 1123;
+}
+
+// A clock that advances g_FakeClockStep ticks (us) on every read
+static uint64_t g_FakeClockStep;
+static uint64_t g_FakeClockNow;
+static uint64_t ReadSteppedClock()
+{
+	g_FakeClockNow += g_FakeClockStep;
+	return g_FakeClockNow;
+}
+
+static void TestStallDeadline()
+{
+	DelayClock Clock = { ReadSteppedClock, 1000000, 0 };
+	for (uint64_t Step : { 1, 7, 100 }) {
+		// Up to where the stall would sleep, which the fake clock doesn't see
+		uint64_t PreviousEnd = 0;
+		for (uint64_t Microseconds : { 0, 1, 10, 49, 50, 51, 100, 999 }) {
+			g_FakeClockStep = Step;
+			g_FakeClockNow = 0;
+			DelayClock_Stall_US(Clock, Microseconds);
+			// The first read is the start, the last one must be the first at or past the deadline
+			uint64_t Start = Step;
+			uint64_t End = g_FakeClockNow;
+			if (End < Start + Microseconds || End >= Start + Microseconds + Step || End < PreviousEnd) {
+				printf("FAIL : a stall of %llu us on a clock of %llu us per read ended after %llu us\n",
+					(unsigned long long)Microseconds, (unsigned long long)Step, (unsigned long long)(End - Start));
+				g_Failures++;
+			}
+			PreviousEnd = End;
+		}
+	}
+}
+
+static void TestCalibration()
+{
+	DelayClock Clock = { ReadFakeClock, 1000000, 0 };
+	uint64_t Overshoot_US = DelayClock_MeasureSleepOvershoot(Clock);
+	if (Overshoot_US != 123) {
+		printf("FAIL : a 1 ms sleep taking 1123 us was calibrated as %llu us late\n", (unsigned long long)Overshoot_US);
+		g_Failures++;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	bool bTest = (argc == 2 && strcmp(argv[1], "-test") == 0);
+	if (argc > 1 && !bTest && (argv[1][0] < '0' || argv[1][0] > '9')) {
+		printf("Usage : cxbxr-delaybench [runs per size]\n");
+		printf("        cxbxr-delaybench -test\n");
+		return 1;
+	}
+	unsigned Runs = (argc > 1 && !bTest) ? strtoul(argv[1], nullptr, 0) : TEST_RUNS;
+	if (Runs == 0) {
+		Runs = 1;
+	}
+
+	if (bTest) {
+		TestStallDeadline();
+		TestCalibration();
+	}
+
+	DelayClock Clock = { ReadSteadyClock, 1000000000, 0 };
+	Clock.SleepOvershoot_US = DelayClock_MeasureSleepOvershoot(Clock);
+	printf("Host sleeps return up to %llu us late\n", (unsigned long long)Clock.SleepOvershoot_US);
+
+	// Stalls are what drivers do, a few us up to a millisecond or so
+	for (uint64_t Microseconds : { 10, 50, 100, 500, 1000, 3000 }) {
+		DelayStats Stats = Measure(Microseconds, Runs, [&](uint64_t us) { DelayClock_Stall_US(Clock, us); });
+		PrintStats("stall", Microseconds, Stats);
+		if (bTest && Stats.min_US < 0) {
+			printf("FAIL : a stall of %llu us returned early\n", (unsigned long long)Microseconds);
+			g_Failures++;
+		}
+	}
+
+	// Waits are what titles do, from Sleep(1) up
+	for (uint64_t Microseconds : { 100, 500, 1000, 2000, 5000 }) {
+		bool bWaited = true;
+		DelayStats Stats = Measure(Microseconds, Runs, [&](uint64_t us) { bWaited &= DelayHostWait(us * 10); });
+		if (!bWaited) {
+			printf("wait : the host has no high resolution timer, the emulator uses NtDelayExecution\n");
+			break;
+		}
+		PrintStats("wait", Microseconds, Stats);
+		if (bTest && Stats.min_US < 0) {
+			printf("FAIL : a wait of %llu us returned early\n", (unsigned long long)Microseconds);
+			g_Failures++;
+		}
+	}
+
+	if (bTest) {
+		printf("%u failure(s)\n", g_Failures);
+		return g_Failures ? 1 : 0;
+	}
+
+	return 0;
+}
@@ -53,6 +53,7 @@
 
 
 #include <xboxkrnl/xboxkrnl.h>
+#include <algorithm>
 #include "OHCI.h"
 #include "core\kernel\exports\EmuKrnl.h"  // For HalSystemInterrupt
 #include "common\util\CxbxUtil.h"
@@ -287,6 +288,15 @@ void OHCI::OHCI_FrameBoundaryWrapper(void* pVoid)
 void OHCI::OHCI_FrameBoundaryWorker()
 {
 	OHCI_HCCA hcca;
+	uint64_t Frames;
+	bool bScheduled;
+
+	// The number of frames since the last processed one follows from the elapsed time, not from the number
+	// of timer ticks, which also means idle frames can simply be skipped
+	Frames = m_FrameSchedule.Begin(OHCI_GetElapsedFrames(), &bScheduled);
+	if (Frames == 0) {
+		return;
+	}
 
 	m_FrameTimeMutex.lock();
 
@@ -301,8 +311,15 @@ void OHCI::OHCI_FrameBoundaryWorker()
 	if (m_Registers.HcControl & OHCI_CTL_PLE) {
 		// From the OHCI standard: "The head pointer used for a particular frame is determined by using the last 5 bits of the
 		// Frame Counter as an offset into the interrupt array within the HCCA."
-		int n = m_Registers.HcFmNumber & 0x1F;
-		OHCI_ServiceEDlist(hcca.HccaInterrruptTable[n], 0); // dropped little -> big endian conversion from QEMU
+		// Skipped frames are serviced here too (up to a whole pass over the interrupt array), so that no
+		// endpoint misses its polling interval
+		uint32_t FmNumber = m_Registers.HcFmNumber;
+		for (uint64_t i = Frames - std::min<uint64_t>(Frames, 32); i < Frames; i++) {
+			m_Registers.HcFmNumber = (FmNumber + i) & 0xFFFF; // the iso TDs are relative to it
+			int n = m_Registers.HcFmNumber & 0x1F;
+			OHCI_ServiceEDlist(hcca.HccaInterrruptTable[n], 0); // dropped little -> big endian conversion from QEMU
+		}
+		m_Registers.HcFmNumber = FmNumber;
 	}
 
 	// Cancel all pending packets if either of the lists has been disabled
@@ -328,9 +345,10 @@ void OHCI::OHCI_FrameBoundaryWorker()
 		m_Registers.HcFmRemaining & ~OHCI_FMR_FRT : m_Registers.HcFmRemaining | OHCI_FMR_FRT;
 
 	// Increment frame number
-	m_Registers.HcFmNumber = (m_Registers.HcFmNumber + 1) & 0xFFFF; // prevent overflow
+	m_Registers.HcFmNumber = (m_Registers.HcFmNumber + Frames) & 0xFFFF; // prevent overflow
 	hcca.HccaFrameNumber = m_Registers.HcFmNumber; // dropped big -> little endian conversion from QEMU
 
+	bool bWroteBack = false;
 	if (m_DoneCount == 0 && !(m_Registers.HcInterruptStatus & OHCI_INTR_WD)) {
 		if (!m_Registers.HcDoneHead) {
 			// From the OHCI standard: "This is set to zero whenever HC writes the content of this
@@ -350,13 +368,20 @@ void OHCI::OHCI_FrameBoundaryWorker()
 		m_Registers.HcDoneHead = 0;
 		m_DoneCount = 7;
 		OHCI_SetInterrupt(OHCI_INTR_WD);
+		bWroteBack = true;
 	}
 
 	if (m_DoneCount != 7 && m_DoneCount != 0) {
 		// decrease Done Queue counter
-		m_DoneCount--;
+		m_DoneCount -= static_cast<int>(std::min<uint64_t>(Frames, m_DoneCount));
 	}
 
+	// The controller is idle when no TD was retired, no transfer is in flight, the control and bulk lists are
+	// empty and the HCD doesn't want a SOF interrupt. A scheduled frame (see OHCI_ScheduleFrame) is never idle,
+	// since the HCD usually follows up by queuing more TDs
+	m_FrameSchedule.End(Frames, bScheduled || bWroteBack || m_Registers.HcDoneHead || m_DoneCount != 7 || m_AsyncTD ||
+		(m_Registers.HcCommandStatus & (OHCI_STATUS_CLF | OHCI_STATUS_BLF)) || (m_Registers.HcInterrupt & OHCI_INTR_SF));
+
 	// Do SOF stuff here
 	OHCI_SOF(false);
 
@@ -896,11 +921,12 @@ void OHCI::OHCI_BusStop()
 
 void OHCI::OHCI_SOF(bool bCreate)
 {
-	// set current SOF time
-	m_SOFtime = GetTime_NS(m_pEOFtimer);
-
 	// make timer expire at SOF + 1 ms from now
 	if (bCreate) {
+		// set the time of the first SOF, the next ones are sent every m_UsbFrameTime
+		m_SOFtime = GetTime_NS(m_pEOFtimer);
+		m_SOFnumber = m_Registers.HcFmNumber;
+		m_FrameSchedule.Reset();
 		Timer_Start(m_pEOFtimer, m_UsbFrameTime);
 	}
 
@@ -1035,7 +1061,7 @@ uint32_t OHCI::OHCI_ReadRegister(xbox::addr Addr)
 				break;
 
 			case 15: // HcFmNumber
-				ret = m_Registers.HcFmNumber;
+				ret = OHCI_GetFrameNumber();
 				DUMP_REG_R(ret);
 				break;
 
@@ -1100,6 +1126,9 @@ void OHCI::OHCI_WriteRegister(xbox::addr Addr, uint32_t Value)
 		return;
 	}
 	else {
+		// Whatever the HCD changed (a list filled, interrupts acknowledged, ...), make sure the next frame sees it
+		OHCI_ScheduleFrame();
+
 		switch (Addr >> 2)
 		{
 			case 0: // HcRevision
@@ -1277,13 +1306,9 @@ uint32_t OHCI::OHCI_GetFrameRemaining()
 		return m_Registers.HcFmRemaining & OHCI_FMR_FRT;
 	}
 
-	// Being in USB operational state guarantees that m_pEOFtimer and m_SOFtime were set already
-	ticks = GetTime_NS(m_pEOFtimer) - m_SOFtime;
-
-	// Avoid Muldiv64 if possible
-	if (ticks >= m_UsbFrameTime) {
-		return m_Registers.HcFmRemaining & OHCI_FMR_FRT;
-	}
+	// Being in USB operational state guarantees that m_pEOFtimer and m_SOFtime were set already.
+	// Frames are sent every m_UsbFrameTime since the first SOF, whether they were processed or not
+	ticks = (GetTime_NS(m_pEOFtimer) - m_SOFtime) % m_UsbFrameTime;
 
 	ticks = Muldiv64(1, (uint32_t)ticks, (uint32_t)m_TicksPerUsbTick);
 	frame = static_cast<uint16_t>((m_Registers.HcFmInterval & OHCI_FMI_FI) - ticks);
@@ -1291,6 +1316,21 @@ uint32_t OHCI::OHCI_GetFrameRemaining()
 	return (m_Registers.HcFmRemaining & OHCI_FMR_FRT) | frame;
 }
 
+uint32_t OHCI::OHCI_GetFrameNumber()
+{
+	if ((m_Registers.HcControl & OHCI_CTL_HCFS) != Operational) {
+		return m_Registers.HcFmNumber;
+	}
+
+	// Idle frames aren't processed, so m_Registers.HcFmNumber can lag behind the frame on the bus
+	return (m_SOFnumber + OHCI_GetElapsedFrames()) & 0xFFFF;
+}
+
+uint64_t OHCI::OHCI_GetElapsedFrames()
+{
+	return (GetTime_NS(m_pEOFtimer) - m_SOFtime) / m_UsbFrameTime;
+}
+
 void OHCI::OHCI_StopEndpoints()
 {
 	XboxDeviceState* dev;
@@ -1525,6 +1565,7 @@ void OHCI::OHCI_AsyncCompletePacket(USBPort* port, USBPacket* packet)
 #endif
 	m_AsyncComplete = 1;
 	OHCI_ProcessLists(1);
+	OHCI_ScheduleFrame();
 }
 
 void OHCI::OHCI_AsyncCancelDevice(XboxDeviceState* dev)
@@ -28,8 +28,10 @@
 #ifndef OHCI_H_
 #define OHCI_H_
 
+#include <atomic>
 #include <mutex>
 #include "USBDevice.h"
+#include "OHCIFrameSchedule.h"
 #include "Timer.h"
 
 
@@ -145,6 +147,8 @@ class OHCI
 		uint32_t OHCI_ReadRegister(xbox::addr Addr);
 		// write a register
 		void OHCI_WriteRegister(xbox::addr Addr, uint32_t Value);
+		// process the next frame even if the controller is idle (a TD was queued or a device has new data)
+		void OHCI_ScheduleFrame() { m_FrameSchedule.Schedule(); }
 
 
 	private:
@@ -154,8 +158,12 @@ class OHCI
 		OHCI_Registers m_Registers;
 		// end-of-frame timer
 		TimerObject* m_pEOFtimer = nullptr;
-		// time at which a SOF was sent
+		// time at which the first SOF was sent after the bus started, the following frames are derived from it
 		uint64_t m_SOFtime;
+		// frame number of the first SOF
+		uint32_t m_SOFnumber;
+		// which frames are processed and which are skipped because the controller is idle
+		OHCIFrameSchedule m_FrameSchedule;
 		// the duration of a usb frame
 		uint64_t m_UsbFrameTime;
 		// ticks per usb tick
@@ -197,6 +205,10 @@ class OHCI
 		void OHCI_SetInterrupt(uint32_t Value);
 		// calculate frame time remaining
 		uint32_t OHCI_GetFrameRemaining();
+		// calculate the current frame number
+		uint32_t OHCI_GetFrameNumber();
+		// frames whose SOF was sent since the first SOF
+		uint64_t OHCI_GetElapsedFrames();
 		// halt the endpoints of the device
 		void OHCI_StopEndpoints();
 		// set root hub status
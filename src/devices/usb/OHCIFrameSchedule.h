@@ -0,0 +1,80 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+#ifndef OHCIFRAMESCHEDULE_H_
+#define OHCIFRAMESCHEDULE_H_
+
+// Decides which ticks of the OHCI end-of-frame timer process the lists, and which skip them because the
+// controller is idle. Kept free of emulator dependencies, so cxbxr-usbbench can drive it with simulated frames.
+
+#include <atomic>
+#include <cstdint>
+
+// Consecutive frames with nothing to service after which the controller is idle, and stops processing every frame
+#define OHCI_IDLE_FRAMES       8
+// An idle controller still polls the periodic list this often (in frames), since the HCD can queue interrupt TDs
+// without writing any register. The frames in between are serviced in a batch
+#define OHCI_IDLE_POLL_FRAMES  8
+
+class OHCIFrameSchedule
+{
+	public:
+		// start counting from the first SOF
+		void Reset() { m_FrameCount = 0; m_IdleFrames = 0; }
+		// process the next frame even if the controller is idle (a TD was queued or a device has new data)
+		void Schedule() { m_bScheduled = true; }
+		// returns how many frames (since the last processed one) to process now, or zero to skip this tick.
+		// ElapsedFrames is the number of frames since the first SOF, *pScheduled is set when the frame was scheduled
+		uint64_t Begin(uint64_t ElapsedFrames, bool* pScheduled)
+		{
+			uint64_t Frames = ElapsedFrames - m_FrameCount;
+			if (Frames == 0) {
+				return 0;
+			}
+			bool bScheduled = m_bScheduled.exchange(false);
+			if (!bScheduled && m_IdleFrames >= OHCI_IDLE_FRAMES && Frames < OHCI_IDLE_POLL_FRAMES) {
+				return 0;
+			}
+			*pScheduled = bScheduled;
+			return Frames;
+		}
+		// accounts for the frames returned by Begin once they are processed, bBusy tells if they serviced anything
+		void End(uint64_t Frames, bool bBusy)
+		{
+			m_FrameCount += Frames;
+			m_IdleFrames = bBusy ? 0 : m_IdleFrames + Frames;
+		}
+
+
+	private:
+		// frames since the first SOF that were processed
+		uint64_t m_FrameCount = 0;
+		// consecutive processed frames which had nothing to service
+		uint64_t m_IdleFrames = 0;
+		// set when the next frame must be processed even if the controller is idle
+		std::atomic_bool m_bScheduled { false };
+};
+
+#endif
@@ -160,6 +160,9 @@ void USBDevice::USB_Wakeup(USBEndpoint* ep)
 {
 	XboxDeviceState* dev = ep->Dev;
 
+	// The endpoint has new data, so the controller must poll it even if it was idle
+	m_HostController->OHCI_ScheduleFrame();
+
 	if (dev->RemoteWakeup && dev->Port && dev->Port->Operations->wakeup) {
 		dev->Port->Operations->wakeup(dev->Port);
 	}
@@ -219,6 +219,9 @@ int XidGamepad::Init(int port)
 
 	m_UsbDev->m_HostController->m_FrameTimeMutex.unlock();
 
+	// An idle host controller only polls the interrupt list every few frames, so it's woken up when the input changes
+	g_InputDeviceManager.SetXpadWakeup(PORT_DEC(m_Port), std::bind(&XidGamepad::UsbXid_InputChanged, this));
+
 	return 0;
 }
 
@@ -492,31 +495,18 @@ void XidGamepad::UsbXid_HandleData(XboxDeviceState* dev, USBPacket* p)
 	switch (p->Pid) {
 	case USB_TOKEN_IN: {
 		if (p->Endpoint->Num == 2) {
-#if 0 // Reenable this when LLE USB actually works
-			SDL2Devices* controller = g_InputDeviceManager->FindDeviceFromXboxPort(m_Port);
-			if (controller != nullptr) {
-				bool ret;
-				ret = controller->ReadButtonState(&m_XidState->in_state.wButtons, m_XidState->in_state.bAnalogButtons,
-					&m_XidState->in_state.sThumbLX, &m_XidState->in_state.sThumbLY, &m_XidState->in_state.sThumbRX,
-					&m_XidState->in_state.sThumbRY);
-				if (ret) {
-					m_UsbDev->USB_PacketCopy(p, &m_XidState->in_state, m_XidState->in_state.bLength);
-				}
-				else {
-#endif
-					p->Status = USB_RET_NAK;
-				}
-#if 0 // Reenable this when LLE USB actually works
+			// Only report the input when it changed since the last report, like the real gamepad does
+			if (g_InputDeviceManager.UpdateXboxPortInput(PORT_DEC(m_Port), &m_XidState->in_state.wButtons, DIRECTION_IN,
+				to_underlying(XBOX_INPUT_DEVICE::MS_CONTROLLER_DUKE))) {
+				m_UsbDev->USB_PacketCopy(p, &m_XidState->in_state, m_XidState->in_state.bLength);
 			}
 			else {
-				p->Status = USB_RET_STALL;
-				assert(0);
+				p->Status = USB_RET_NAK;
 			}
 		}
 		else {
 			assert(0);
 		}
-#endif
 		break;
 	}
 
@@ -538,8 +528,18 @@ void XidGamepad::UsbXid_HandleData(XboxDeviceState* dev, USBPacket* p)
 	}
 }
 
+void XidGamepad::UsbXid_InputChanged()
+{
+	// Called by the input polling thread. This only schedules the next frame instead of calling USB_Wakeup, since
+	// the gamepad doesn't do remote wakeup and the port wakeup would change the OHCI state without m_FrameTimeMutex
+	m_UsbDev->m_HostController->OHCI_ScheduleFrame();
+}
+
 void XidGamepad::XpadCleanUp()
 {
+	if (m_Port != 0) {
+		g_InputDeviceManager.SetXpadWakeup(PORT_DEC(m_Port), nullptr);
+	}
 	delete m_pPeripheralFuncStruct;
 	delete m_XidState;
 	m_pPeripheralFuncStruct = nullptr;
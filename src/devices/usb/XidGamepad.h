@@ -67,6 +67,8 @@ class XidGamepad
 		void UsbXid_HandleControl(XboxDeviceState* dev, USBPacket* p,
 			int request, int value, int index, int length, uint8_t* data);
 		void UsbXid_HandleData(XboxDeviceState* dev, USBPacket* p);
+		// wake up the host controller when the input of this gamepad changed
+		void UsbXid_InputChanged();
 		// this should update the vibration strenght of the real controller this gamepad represents.
 		// It doesn't do anything at the moment
 		void UpdateForceFeedback();
@@ -33,15 +33,26 @@
 // *
 // ******************************************************************
 
-typedef struct RAMHTEntry {
-	uint32_t handle;
-	xbox::addr instance;
-	enum FIFOEngine engine;
-	unsigned int channel_id : 5;
-	bool valid;
-} RAMHTEntry;
+static RAMHTEntry ramht_lookup_cached(NV2AState *d, uint32_t handle); // forward declaration
+static void ramht_cache_flush(NV2AState *d); // forward declaration
 
-static RAMHTEntry ramht_lookup(NV2AState *d, uint32_t handle); // forward declaration
+// Lets nv2a_puller_fill_batch resolve handles through the RAMHT cache, and wake the pusher
+struct PullerBackend {
+	NV2AState *d;
+
+	RAMHTEntry RamhtLookup(uint32_t handle)
+	{
+		return ramht_lookup_cached(d, handle);
+	}
+
+	void SignalPusher()
+	{
+		qemu_cond_signal(&d->pfifo.pusher_cond);
+	}
+};
+
+// Number of puller batches between two puller statistics reports
+#define NV2A_PULLER_REPORT_BATCHES 4096
 
 /* PFIFO - MMIO and DMA FIFO submission to PGRAPH and VPE */
 DEVICE_READ32(PFIFO)
@@ -87,6 +98,11 @@ DEVICE_WRITE32(PFIFO)
 			d->pfifo.enabled_interrupts = value;
 			update_irq(d);
 			break;
+		case NV_PFIFO_RAMHT:
+			// A moved or resized RAMHT invalidates all cached slot offsets
+			ramht_cache_flush(d);
+			DEVICE_WRITE32_REG(pfifo);
+			break;
 		default:
 			DEVICE_WRITE32_REG(pfifo); // Was : DEBUG_WRITE32_UNHANDLED(PFIFO);
 			break;
@@ -103,116 +119,51 @@ DEVICE_WRITE32(PFIFO)
 static void pfifo_run_puller(NV2AState *d)
 {
     uint32_t *pull0 = &d->pfifo.regs[NV_PFIFO_CACHE1_PULL0];
-    uint32_t *pull1 = &d->pfifo.regs[NV_PFIFO_CACHE1_PULL1];
-    uint32_t *engine_reg = &d->pfifo.regs[NV_PFIFO_CACHE1_ENGINE];
-
-    uint32_t *status = &d->pfifo.regs[NV_PFIFO_CACHE1_STATUS];
-    uint32_t *get_reg = &d->pfifo.regs[NV_PFIFO_CACHE1_GET];
-    uint32_t *put_reg = &d->pfifo.regs[NV_PFIFO_CACHE1_PUT];
-
-    // TODO
-    // CacheEntry working_cache[NV2A_CACHE1_SIZE];
-    // int working_cache_size = 0;
-    // pull everything into our own queue
 
-    // TODO think more about locking
+    // Instead of bouncing between pfifo_lock and pgraph_lock for every
+    // single method, CACHE1 is drained into a local batch under one
+    // pfifo_lock hold, after which the whole batch is handed to PGRAPH
+    // under a single pgraph_lock hold.
+    PullerMethod working_cache[NV2A_CACHE1_SIZE];
+    PullerBackend backend = { d };
 
     while (true) {
         if (!GET_MASK(*pull0, NV_PFIFO_CACHE1_PULL0_ACCESS)) return;
 
-        /* empty cache1 */
-        if (*status & NV_PFIFO_CACHE1_STATUS_LOW_MARK) break;
-
-        uint32_t get = *get_reg;
-        uint32_t put = *put_reg;
-
-        assert(get < 128*4 && (get % 4) == 0);
-        uint32_t method_entry = d->pfifo.regs[NV_PFIFO_CACHE1_METHOD + get*2];
-        uint32_t parameter = d->pfifo.regs[NV_PFIFO_CACHE1_DATA + get*2];
-
-        uint32_t new_get = (get+4) & 0x1fc;
-        *get_reg = new_get;
-
-        if (new_get == put) {
-            // set low mark
-            *status |= NV_PFIFO_CACHE1_STATUS_LOW_MARK;
-        }
-        if (*status & NV_PFIFO_CACHE1_STATUS_HIGH_MARK) {
-            // unset high mark
-            *status &= ~NV_PFIFO_CACHE1_STATUS_HIGH_MARK;
-            // signal pusher
-            qemu_cond_signal(&d->pfifo.pusher_cond);            
-        }
-
-
-        uint32_t method = method_entry & 0x1FFC;
-        uint32_t subchannel = GET_MASK(method_entry, NV_PFIFO_CACHE1_METHOD_SUBCHANNEL);
+        int working_cache_size = nv2a_puller_fill_batch(d->pfifo.regs, working_cache, backend);
+        if (working_cache_size == 0) break;
 
-        // NV2A_DPRINTF("pull %d 0x%08X 0x%08X - subch %d\n", get/4, method_entry, parameter, subchannel);
+        qemu_mutex_lock(&d->pgraph.pgraph_lock);
+        //make pgraph busy
+        qemu_mutex_unlock(&d->pfifo.pfifo_lock);
 
-        if (method == 0) {
-            RAMHTEntry entry = ramht_lookup(d, parameter);
-            assert(entry.valid);
-
-            // assert(entry.channel_id == state->channel_id);
-
-            assert(entry.engine == ENGINE_GRAPHICS);
-
-
-            /* the engine is bound to the subchannel */
-            assert(subchannel < 8);
-            SET_MASK(*engine_reg, 3 << (4*subchannel), entry.engine);
-            SET_MASK(*pull1, NV_PFIFO_CACHE1_PULL1_ENGINE, entry.engine);
-            // NV2A_DPRINTF("engine_reg1 %d 0x%08X\n", subchannel, *engine_reg);
-
-
-            // TODO: this is fucked
-            qemu_mutex_lock(&d->pgraph.pgraph_lock);
-            //make pgraph busy
-            qemu_mutex_unlock(&d->pfifo.pfifo_lock);
-
-            pgraph_switch_context(d, entry.channel_id);
-            pgraph_wait_fifo_access(d);
-            pgraph_handle_method(d, subchannel, 0, entry.instance);
-
-            // make pgraph not busy
-            qemu_mutex_unlock(&d->pgraph.pgraph_lock);
-            qemu_mutex_lock(&d->pfifo.pfifo_lock);
-
-        } else if (method >= 0x100) {
-            // method passed to engine
-
-            /* methods that take objects.
-             * TODO: Check this range is correct for the nv2a */
-            if (method >= 0x180 && method < 0x200) {
-                //qemu_mutex_lock_iothread();
-                RAMHTEntry entry = ramht_lookup(d, parameter);
-                assert(entry.valid);
-                // assert(entry.channel_id == state->channel_id);
-                parameter = entry.instance;
-                //qemu_mutex_unlock_iothread();
+        for (int i = 0; i < working_cache_size; i++) {
+            PullerMethod *pulled = &working_cache[i];
+            if (pulled->channel_id >= 0) {
+                pgraph_switch_context(d, pulled->channel_id);
             }
 
-            enum FIFOEngine engine = (enum FIFOEngine)GET_MASK(*engine_reg, 3 << (4*subchannel));
-            // NV2A_DPRINTF("engine_reg2 %d 0x%08X\n", subchannel, *engine_reg);
-            assert(engine == ENGINE_GRAPHICS);
-            SET_MASK(*pull1, NV_PFIFO_CACHE1_PULL1_ENGINE, engine);
-
-            // TODO: this is fucked
-            qemu_mutex_lock(&d->pgraph.pgraph_lock);
-            //make pgraph busy
-            qemu_mutex_unlock(&d->pfifo.pfifo_lock);
-
             pgraph_wait_fifo_access(d);
-            pgraph_handle_method(d, subchannel, method, parameter);
-
-            // make pgraph not busy
-            qemu_mutex_unlock(&d->pgraph.pgraph_lock);
-            qemu_mutex_lock(&d->pfifo.pfifo_lock);
-        } else {
-            assert(false);
+            pgraph_handle_method(d, pulled->subchannel, pulled->method, pulled->parameter);
         }
 
+        // make pgraph not busy
+        qemu_mutex_unlock(&d->pgraph.pgraph_lock);
+        qemu_mutex_lock(&d->pfifo.pfifo_lock);
+
+        d->pfifo.methods_pulled += working_cache_size;
+        d->pfifo.batches_pulled++;
+
+        if ((d->pfifo.batches_pulled % NV2A_PULLER_REPORT_BATCHES) == 0) {
+            LOG_CHECK_ENABLED(LOG_LEVEL::DEBUG) {
+                EmuLog(LOG_LEVEL::DEBUG, "Puller : %llu methods in %llu batches (%.1f methods per batch), %llu of %llu RAMHT lookups cached",
+                    (unsigned long long)d->pfifo.methods_pulled,
+                    (unsigned long long)d->pfifo.batches_pulled,
+                    (double)d->pfifo.methods_pulled / d->pfifo.batches_pulled,
+                    (unsigned long long)d->pfifo.ramht_cache_hits,
+                    (unsigned long long)d->pfifo.ramht_lookups);
+            }
+        }
     }
 }
 
@@ -251,8 +202,6 @@ static void pfifo_run_pusher(NV2AState *d)
     uint32_t *dma_dcount = &d->pfifo.regs[NV_PFIFO_CACHE1_DMA_DCOUNT];
 
     uint32_t *status = &d->pfifo.regs[NV_PFIFO_CACHE1_STATUS];
-    uint32_t *get_reg = &d->pfifo.regs[NV_PFIFO_CACHE1_GET];
-    uint32_t *put_reg = &d->pfifo.regs[NV_PFIFO_CACHE1_PUT];
 
     if (!GET_MASK(*push0, NV_PFIFO_CACHE1_PUSH0_ACCESS)) return;
     if (!GET_MASK(*dma_push, NV_PFIFO_CACHE1_DMA_PUSH_ACCESS)) return;
@@ -285,6 +234,10 @@ static void pfifo_run_pusher(NV2AState *d)
     hwaddr dma_len;
     uint8_t *dma = (uint8_t*)nv_dma_map(d, dma_instance, &dma_len);
 
+    if (g_nv2a_pbcapture_active) {
+        nv2a_pbcapture_lle_commands(dma, dma_len, *dma_get, *dma_put);
+    }
+
 	/* based on the convenient pseudocode in envytools */
     while (true) {
         uint32_t dma_get_v = *dma_get;
@@ -320,30 +273,8 @@ static void pfifo_run_pusher(NV2AState *d)
             /* data word of methods command */
             d->pfifo.regs[NV_PFIFO_CACHE1_DMA_DATA_SHADOW] = word;
 
-            uint32_t put = *put_reg;
-            uint32_t get = *get_reg;
-
-            assert((method & 3) == 0);
-            uint32_t method_entry = 0;
-            SET_MASK(method_entry, NV_PFIFO_CACHE1_METHOD_ADDRESS, method >> 2);
-            SET_MASK(method_entry, NV_PFIFO_CACHE1_METHOD_TYPE, method_type);
-            SET_MASK(method_entry, NV_PFIFO_CACHE1_METHOD_SUBCHANNEL, method_subchannel);
-
-            // NV2A_DPRINTF("push %d 0x%08X 0x%08X - subch %d\n", put/4, method_entry, word, method_subchannel);
-
-            assert(put < 128*4 && (put%4) == 0);
-            d->pfifo.regs[NV_PFIFO_CACHE1_METHOD + put*2] = method_entry;
-            d->pfifo.regs[NV_PFIFO_CACHE1_DATA + put*2] = word;
-
-            uint32_t new_put = (put+4) & 0x1fc;
-            *put_reg = new_put;
-            if (new_put == get) {
-                // set high mark
-                *status |= NV_PFIFO_CACHE1_STATUS_HIGH_MARK;
-            }
-            if (*status & NV_PFIFO_CACHE1_STATUS_LOW_MARK) {
-                // unset low mark
-                *status &= ~NV_PFIFO_CACHE1_STATUS_LOW_MARK;
+            // NV2A_DPRINTF("push 0x%08X 0x%08X - subch %d\n", method, word, method_subchannel);
+            if (nv2a_cache1_push(d->pfifo.regs, method, method_type, method_subchannel, word)) {
                 // signal puller
                 qemu_cond_signal(&d->pfifo.puller_cond);
             }
@@ -494,7 +425,7 @@ static uint32_t ramht_hash(NV2AState *d, uint32_t handle)
 	return hash;
 }
 
-static RAMHTEntry ramht_lookup(NV2AState *d, uint32_t handle)
+static uint32_t ramht_entry_offset(NV2AState *d, uint32_t handle)
 {
 	uint32_t hash = ramht_hash(d, handle);
 	assert(hash * 8 < ramht_size(d));
@@ -503,11 +434,11 @@ static RAMHTEntry ramht_lookup(NV2AState *d, uint32_t handle)
 		GET_MASK(d->pfifo.regs[NV_PFIFO_RAMHT],
 			NV_PFIFO_RAMHT_BASE_ADDRESS_MASK) << 12;
 
-	uint8_t *entry_ptr = d->pramin.ramin_ptr + ramht_address + hash * 8;
-
-	uint32_t entry_handle = ldl_le_p((uint32_t*)entry_ptr);
-	uint32_t entry_context = ldl_le_p((uint32_t*)(entry_ptr + 4));
+	return ramht_address + hash * 8;
+}
 
+static RAMHTEntry ramht_decode_entry(uint32_t entry_handle, uint32_t entry_context)
+{
 	RAMHTEntry entry;
 	entry.handle = entry_handle;
 	entry.instance = (entry_context & NV_RAMHT_INSTANCE) << 4;
@@ -517,3 +448,46 @@ static RAMHTEntry ramht_lookup(NV2AState *d, uint32_t handle)
 
 	return entry;
 }
+
+static RAMHTEntry ramht_lookup_cached(NV2AState *d, uint32_t handle)
+{
+	unsigned int channel_id = GET_MASK(d->pfifo.regs[NV_PFIFO_CACHE1_PUSH1],
+	                                   NV_PFIFO_CACHE1_PUSH1_CHID);
+
+	RAMHTCacheEntry *cache_entry = &d->pfifo.ramht_cache[channel_id][
+		(handle ^ (handle >> 16)) & (NV2A_RAMHT_CACHE_SIZE - 1)];
+
+	d->pfifo.ramht_lookups++;
+	if (cache_entry->context != 0 && cache_entry->handle == handle) {
+		d->pfifo.ramht_cache_hits++;
+		return ramht_decode_entry(handle, cache_entry->context);
+	}
+
+	uint8_t *entry_ptr = d->pramin.ramin_ptr + ramht_entry_offset(d, handle);
+
+	uint32_t entry_handle = ldl_le_p((uint32_t*)entry_ptr);
+	uint32_t entry_context = ldl_le_p((uint32_t*)(entry_ptr + 4));
+
+	RAMHTEntry entry = ramht_decode_entry(entry_handle, entry_context);
+	if (entry.valid && entry_handle == handle) {
+		cache_entry->handle = handle;
+		cache_entry->context = entry_context;
+	}
+
+	return entry;
+}
+
+static void ramht_cache_flush(NV2AState *d)
+{
+	memset(d->pfifo.ramht_cache, 0, sizeof(d->pfifo.ramht_cache));
+}
+
+// Returns true when a PRAMIN write to addr lands inside the RAMHT
+static bool ramht_contains(NV2AState *d, uint32_t addr)
+{
+	xbox::addr ramht_address =
+		GET_MASK(d->pfifo.regs[NV_PFIFO_RAMHT],
+			NV_PFIFO_RAMHT_BASE_ADDRESS_MASK) << 12;
+
+	return addr >= ramht_address && addr - ramht_address < ramht_size(d);
+}
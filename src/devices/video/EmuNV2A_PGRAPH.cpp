@@ -427,18 +427,17 @@ static float convert_f24_to_float(uint32_t f24);
 static uint8_t* convert_texture_data(const unsigned int color_format, const uint8_t *data, const uint8_t *palette_data, const unsigned int width, const unsigned int height, const unsigned int depth, const unsigned int row_pitch, const unsigned int slice_pitch);
 static int upload_gl_texture(GLenum gl_target, const TextureShape s, const uint8_t *texture_data, const uint8_t *palette_data);
 static TextureBinding* generate_texture(const TextureShape s, const uint8_t *texture_data, const uint8_t *palette_data);
-static guint texture_key_hash(gconstpointer key);
-static gboolean texture_key_equal(gconstpointer a, gconstpointer b);
-static gpointer texture_key_retrieve(gpointer key, gpointer user_data, GError **error);
-static void texture_key_destroy(gpointer data);
 static void texture_binding_destroy(gpointer data);
-static guint shader_hash(gconstpointer key);
-static gboolean shader_equal(gconstpointer a, gconstpointer b);
+static GLuint pgraph_get_sampler(PGRAPHState *pg, uint64_t sampler_key);
+static void pgraph_texture_cache_trim(PGRAPHState *pg);
+static void pgraph_mark_memory_written(NV2AState *d, hwaddr addr, hwaddr size);
+static void pgraph_collect_cpu_writes(PGRAPHState *pg);
+static void pgraph_pbcapture_draw(NV2AState *d);
+static void pgraph_build_shader_state(PGRAPHState *pg, ShaderState &state);
+static bool pgraph_method_keeps_shader_state(unsigned int method);
 static unsigned int kelvin_map_stencil_op(uint32_t parameter);
 static unsigned int kelvin_map_polygon_mode(uint32_t parameter);
 static unsigned int kelvin_map_texgen(uint32_t parameter, unsigned int channel);
-static uint64_t fnv_hash(const uint8_t *data, size_t len);
-static uint64_t fast_hash(const uint8_t *data, size_t len, unsigned int samples);
 
 /* PGRAPH - accelerated 2d/3d drawing engine */
 DEVICE_READ32(PGRAPH)
@@ -515,6 +514,7 @@ DEVICE_WRITE32(PGRAPH)
     }
 	default: 
 		DEVICE_WRITE32_REG(pgraph); // Was : DEBUG_WRITE32_UNHANDLED(PGRAPH);
+		d->pgraph.shaders_dirty = true;
 		break;
 	}
 
@@ -1042,6 +1042,34 @@ void OpenGL_init_pgraph_plugins()
 	pgraph_draw_clear = OpenGL_draw_clear;
 }
 
+/* Per-frame bookkeeping. Called on NV097_FLIP_STALL, and by the patched
+ * D3DDevice_Swap (as HLE never pushes a flip) */
+void pgraph_frame_boundary(NV2AState *d)
+{
+	PGRAPHState *pg = &d->pgraph;
+
+	nv2a_pbcapture_frame(d);
+
+	pg->frame_number++;
+	if (pg->opengl_enabled) {
+		pgraph_texture_cache_trim(pg);
+
+		if ((pg->frame_number % NV2A_TEXTURE_CACHE_REPORT_FRAMES) == 0) {
+			LOG_CHECK_ENABLED(LOG_LEVEL::DEBUG) {
+				EmuLog(LOG_LEVEL::DEBUG, "Texture cache : %zu entries, %llu hits, %llu misses, "
+					"%llu revalidations (%llu aged, of which %llu found unseen writes), %llu bytes uploaded",
+					pg->texture_cache.size(),
+					(unsigned long long)pg->texture_cache_counters.hits,
+					(unsigned long long)pg->texture_cache_counters.misses,
+					(unsigned long long)pg->texture_cache_counters.revalidations,
+					(unsigned long long)pg->texture_cache_counters.aged_revalidations,
+					(unsigned long long)pg->texture_cache_counters.unseen_writes,
+					(unsigned long long)pg->texture_cache_counters.upload_bytes);
+			}
+		}
+	}
+}
+
 void pgraph_handle_method(NV2AState *d,
 							unsigned int subchannel,
 							unsigned int method,
@@ -1064,32 +1092,15 @@ void pgraph_handle_method(NV2AState *d,
 
     assert(subchannel < 8);
 
+	if (!pgraph_method_keeps_shader_state(method)) {
+		pg->shaders_dirty = true;
+	}
+
 	if (method == NV_SET_OBJECT) {
         assert(parameter < d->pramin.ramin_size);
-        uint8_t *obj_ptr = d->pramin.ramin_ptr + parameter;
-
-        uint32_t ctx_1 = ldl_le_p((uint32_t*)obj_ptr);
-        uint32_t ctx_2 = ldl_le_p((uint32_t*)(obj_ptr+4));
-        uint32_t ctx_3 = ldl_le_p((uint32_t*)(obj_ptr+8));
-        uint32_t ctx_4 = ldl_le_p((uint32_t*)(obj_ptr+12));
-        uint32_t ctx_5 = parameter;
-
-        pg->regs[NV_PGRAPH_CTX_CACHE1 + subchannel * 4] = ctx_1;
-        pg->regs[NV_PGRAPH_CTX_CACHE2 + subchannel * 4] = ctx_2;
-        pg->regs[NV_PGRAPH_CTX_CACHE3 + subchannel * 4] = ctx_3;
-        pg->regs[NV_PGRAPH_CTX_CACHE4 + subchannel * 4] = ctx_4;
-        pg->regs[NV_PGRAPH_CTX_CACHE5 + subchannel * 4] = ctx_5;
     }
 
-    // is this right?
-    pg->regs[NV_PGRAPH_CTX_SWITCH1] = pg->regs[NV_PGRAPH_CTX_CACHE1 + subchannel * 4];
-    pg->regs[NV_PGRAPH_CTX_SWITCH2] = pg->regs[NV_PGRAPH_CTX_CACHE2 + subchannel * 4];
-    pg->regs[NV_PGRAPH_CTX_SWITCH3] = pg->regs[NV_PGRAPH_CTX_CACHE3 + subchannel * 4];
-    pg->regs[NV_PGRAPH_CTX_SWITCH4] = pg->regs[NV_PGRAPH_CTX_CACHE4 + subchannel * 4];
-    pg->regs[NV_PGRAPH_CTX_SWITCH5] = pg->regs[NV_PGRAPH_CTX_CACHE5 + subchannel * 4];
-
-    uint32_t graphics_class = GET_MASK(pg->regs[NV_PGRAPH_CTX_SWITCH1],
-                                       NV_PGRAPH_CTX_SWITCH1_GRCLASS);
+    uint32_t graphics_class = nv2a_pgraph_select_object(pg->regs, d->pramin.ramin_ptr, subchannel, method, parameter);
 
 	// Logging is slow.. disable for now..
 	//pgraph_log_method(subchannel, graphics_class, method, parameter);
@@ -1222,6 +1233,10 @@ void pgraph_handle_method(NV2AState *d,
 						image_blit->width * bytes_per_pixel);
 				}
 
+				pgraph_mark_memory_written(d,
+					(dest - d->vram_ptr) + image_blit->out_y * context_surfaces->dest_pitch,
+					image_blit->height * context_surfaces->dest_pitch);
+
 			} else {
 				assert(false);
 			}
@@ -1312,6 +1327,7 @@ void pgraph_handle_method(NV2AState *d,
 		case NV097_FLIP_STALL:
 			pgraph_update_surface(d, false, true, true);
 
+			pgraph_frame_boundary(d);
 
 			// TODO: Fix this (why does it hang?)
 			/* while (true) */ {
@@ -2338,6 +2354,10 @@ void pgraph_handle_method(NV2AState *d,
 
 			if (parameter == NV097_SET_BEGIN_END_OP_END) {
 
+				if (g_nv2a_pbcapture_active) {
+					pgraph_pbcapture_draw(d);
+				}
+
 				if (pg->draw_arrays_length) {
 
 					NV2A_GL_DPRINTF(false, "Draw Arrays");
@@ -2943,27 +2963,11 @@ void pgraph_init(NV2AState *d)
 
     //glPolygonMode( GL_FRONT_AND_BACK, GL_LINE );
 
-#ifdef USE_TEXTURE_CACHE
-    pg->texture_cache = g_lru_cache_new_full(
-        0,
-        NULL,
-        texture_key_destroy,
-        0,
-        NULL,
-        texture_binding_destroy,
-        texture_key_hash,
-        texture_key_equal,
-        texture_key_retrieve,
-        NULL,
-        NULL
-        );
-
-    g_lru_cache_set_max_size(pg->texture_cache, 512);
-#endif
+    pg->memory_page_generation.assign(
+        (d->vram_size + (1 << NV2A_TEXTURE_CACHE_PAGE_BITS) - 1) >> NV2A_TEXTURE_CACHE_PAGE_BITS, 0);
 
-#ifdef USE_SHADER_CACHE
-    pg->shader_cache = g_hash_table_new(shader_hash, shader_equal);
-#endif
+    shader_cache_init((std::string(szFolder_CxbxReloadedData) + "\\ShaderCache\\").c_str());
+    pg->shaders_dirty = true;
 
     for (i=0; i<NV2A_VERTEXSHADER_ATTRIBUTES; i++) {
         glGenBuffers(1, &pg->vertex_attributes[i].gl_converted_buffer);
@@ -3006,8 +3010,29 @@ void pgraph_destroy(PGRAPHState *pg)
 		}
 		glDeleteFramebuffers(1, &pg->gl_framebuffer);
 
-		// TODO: clear out shader cached
-		// TODO: clear out texture cache
+		glUseProgram(0);
+		for (auto &it : pg->shader_cache) {
+			glDeleteProgram(it.second->gl_program);
+			free(it.second);
+		}
+		pg->shader_cache.clear();
+		pg->shader_binding = NULL;
+		shader_cache_shutdown();
+
+		for (int i = 0; i < NV2A_MAX_TEXTURES; i++) {
+			if (pg->texture_binding[i]) {
+				texture_binding_destroy(pg->texture_binding[i]);
+				pg->texture_binding[i] = NULL;
+			}
+		}
+		for (auto &it : pg->texture_cache) {
+			texture_binding_destroy(it.second.binding);
+		}
+		pg->texture_cache.clear();
+		for (auto &it : pg->sampler_cache) {
+			glDeleteSamplers(1, &it.second);
+		}
+		pg->sampler_cache.clear();
 
 		glo_set_current(NULL);
 
@@ -3203,10 +3228,8 @@ static void pgraph_update_shader_constants(PGRAPHState *pg,
 
 }
 
-static void pgraph_bind_shaders(PGRAPHState *pg)
+static void pgraph_build_shader_state(PGRAPHState *pg, ShaderState &state)
 {
-	assert(pg->opengl_enabled);
-
 	unsigned int i, j;
 
 	uint32_t csv0_d = pg->regs[NV_PGRAPH_CSV0_D];
@@ -3220,13 +3243,9 @@ static void pgraph_bind_shaders(PGRAPHState *pg)
     int program_start = GET_MASK(csv0_c,
                                  NV_PGRAPH_CSV0_C_CHEOPS_PROGRAM_START);
 
-    NV2A_GL_DGROUP_BEGIN("%s (VP: %s FFP: %s)", __func__,
-                         vertex_program ? "yes" : "no",
-                         fixed_function ? "yes" : "no");
-
-	ShaderBinding* old_binding = pg->shader_binding;
+	/* Padding takes part in hashing and comparing states */
+	memset(&state, 0, sizeof(ShaderState));
 
-	ShaderState state;
 	/* register combiner stuff */
 	state.psh.window_clip_exclusive = pg->regs[NV_PGRAPH_SETUPRASTER]
                                        & NV_PGRAPH_SETUPRASTER_WINDOWCLIPTYPE,
@@ -3392,31 +3411,53 @@ static void pgraph_bind_shaders(PGRAPHState *pg)
         state.psh.alphakill[i] = pg->regs[NV_PGRAPH_TEXCTL0_0 + i*4]
                                & NV_PGRAPH_TEXCTL0_0_ALPHAKILLEN;
     }
+}
 
-#ifdef USE_SHADER_CACHE
-	ShaderBinding* cached_shader = (ShaderBinding*)g_hash_table_lookup(pg->shader_cache, &state);
+static void pgraph_bind_shaders(PGRAPHState *pg)
+{
+	assert(pg->opengl_enabled);
 
-    if (cached_shader) {
-        pg->shader_binding = cached_shader;
-    } else {
-#endif
-        pg->shader_binding = generate_shaders(state);
-
-#ifdef USE_SHADER_CACHE
-        /* cache it */
-        ShaderState *cache_state = (ShaderState *)g_malloc(sizeof(*cache_state));
-        memcpy(cache_state, &state, sizeof(*cache_state));
-        g_hash_table_insert(pg->shader_cache, cache_state,
-                            (gpointer)pg->shader_binding);
-    }
-#endif
+	unsigned int i;
+
+	uint32_t csv0_d = pg->regs[NV_PGRAPH_CSV0_D];
+    bool vertex_program = GET_MASK(csv0_d,
+                                   NV_PGRAPH_CSV0_D_MODE) == 2;
+
+    bool fixed_function = GET_MASK(csv0_d,
+                                   NV_PGRAPH_CSV0_D_MODE) == 0;
+
+    NV2A_GL_DGROUP_BEGIN("%s (VP: %s FFP: %s)", __func__,
+                         vertex_program ? "yes" : "no",
+                         fixed_function ? "yes" : "no");
+
+	ShaderBinding* old_binding = pg->shader_binding;
+
+	/* The state only needs to be rebuilt (and looked up) after methods
+	 * that might have changed it, or when the primitive type changed */
+	if (pg->shaders_dirty || pg->shader_binding == NULL
+		|| pg->shader_state.primitive_mode != (enum ShaderPrimitiveMode)pg->primitive_mode) {
+		ShaderState &state = pg->shader_state;
+		pgraph_build_shader_state(pg, state);
+		pg->shaders_dirty = false;
+
+		auto it = pg->shader_cache.find(state);
+		if (it != pg->shader_cache.end()) {
+			pg->shader_binding = it->second;
+		} else {
+			ShaderSources sources;
+			generate_shader_sources(&state, &sources);
+			pg->shader_binding = shader_cache_create_binding(&sources);
+			pg->shader_cache.emplace(state, pg->shader_binding);
+			shader_cache_record_state(&state);
+		}
+	}
 
     bool binding_changed = (pg->shader_binding != old_binding);
 
     glUseProgram(pg->shader_binding->gl_program);
 
     /* Clipping regions */
-    for (i = 0; i < state.psh.window_clip_count; i++) {
+    for (i = 0; i < pg->shader_state.psh.window_clip_count; i++) {
         if (pg->shader_binding->clip_region_loc[i] == -1) {
             continue;
         }
@@ -3448,6 +3489,44 @@ static void pgraph_bind_shaders(PGRAPHState *pg)
     NV2A_GL_DGROUP_END();
 }
 
+/* Methods that only feed vertex data, constants or texture offsets; these
+ * never change what pgraph_build_shader_state reads. (The primitive mode
+ * set by NV097_SET_BEGIN_END is compared separately.) */
+static bool pgraph_method_keeps_shader_state(unsigned int method)
+{
+    if (method >= NV097_SET_TRANSFORM_CONSTANT
+        && method < NV097_SET_TRANSFORM_CONSTANT + 32 * 4) {
+        return true;
+    }
+    if (method >= NV097_SET_VERTEX3F && method < NV097_SET_VERTEX4F + 4 * 4) {
+        return true;
+    }
+    if (method >= NV097_SET_VERTEX_DATA_ARRAY_OFFSET
+        && method < NV097_SET_VERTEX_DATA_ARRAY_OFFSET + 16 * 4) {
+        return true;
+    }
+    if (method >= NV097_ARRAY_ELEMENT16 && method <= NV097_INLINE_ARRAY) {
+        return true;
+    }
+    /* NV097_SET_VERTEX_DATA2F_M up to and including NV097_SET_VERTEX_DATA4F_M */
+    if (method >= NV097_SET_VERTEX_DATA2F_M && method < NV097_SET_TEXTURE_OFFSET) {
+        return true;
+    }
+    if (method >= NV097_SET_TEXTURE_OFFSET && method < NV097_SET_TEXTURE_OFFSET + 4 * 64
+        && (method & 63) == 0) {
+        return true;
+    }
+
+    switch (method) {
+    case NV097_NO_OPERATION:
+    case NV097_SET_BEGIN_END:
+    case NV097_SET_TRANSFORM_CONSTANT_LOAD:
+        return true;
+    default:
+        return false;
+    }
+}
+
 static bool pgraph_get_framebuffer_dirty(PGRAPHState *pg)
 {
     bool shape_changed = memcmp(&pg->surface_shape, &pg->last_surface_shape,
@@ -3711,6 +3790,8 @@ static void pgraph_update_surface_part(NV2AState *d, bool upload, bool color) {
         //                                dma.address + surface->offset,
         //                                surface->pitch * height,
         //                                DIRTY_MEMORY_VGA);
+        pgraph_mark_memory_written(d, dma.address + surface->offset,
+                                   surface->pitch * height);
 
         if (color) {
             pgraph_update_memory_buffer(d, dma.address + surface->offset,
@@ -3815,6 +3896,8 @@ static void pgraph_bind_textures(NV2AState *d)
 
     NV2A_GL_DGROUP_BEGIN("%s", __func__);
 
+    pgraph_collect_cpu_writes(pg);
+
     for (i=0; i<NV2A_MAX_TEXTURES; i++) {
 
         uint32_t ctl_0 = pg->regs[NV_PGRAPH_TEXCTL0_0 + i*4];
@@ -3896,10 +3979,69 @@ static void pgraph_bind_textures(NV2AState *d)
             glBindTexture(GL_TEXTURE_1D, 0);
             glBindTexture(GL_TEXTURE_2D, 0);
             glBindTexture(GL_TEXTURE_3D, 0);
+            if (pg->texture_sampler_key[i]) {
+                glBindSampler(i, 0);
+                pg->texture_sampler_key[i] = 0;
+            }
             continue;
         }
 
-        if (!pg->texture_dirty[i] && pg->texture_binding[i]) {
+        assert(color_format < ARRAY_SIZE(kelvin_color_format_map));
+        ColorFormatInfo f = kelvin_color_format_map[color_format];
+        if (f.bytes_per_pixel == 0) {
+            fprintf(stderr, "nv2a: unimplemented texture color format 0x%x\n",
+                    color_format);
+            abort();
+        }
+
+        if (f.encoding == linear) {
+            /* sometimes games try to set mipmap min filters on linear textures.
+             * this could indicate a bug... */
+            switch (min_filter) {
+            case NV_PGRAPH_TEXFILTER0_MIN_BOX_NEARESTLOD:
+            case NV_PGRAPH_TEXFILTER0_MIN_BOX_TENT_LOD:
+                min_filter = NV_PGRAPH_TEXFILTER0_MIN_BOX_LOD0;
+                break;
+            case NV_PGRAPH_TEXFILTER0_MIN_TENT_NEARESTLOD:
+            case NV_PGRAPH_TEXFILTER0_MIN_TENT_TENT_LOD:
+                min_filter = NV_PGRAPH_TEXFILTER0_MIN_TENT_LOD0;
+                break;
+            }
+        }
+
+        /* Sampler state lives in sampler objects, so filter, wrap and border
+         * changes (which don't mark the texture dirty) take effect without
+         * touching the texture. Layout of the key :
+         *   0-3 min filter, 4-7 mag filter, 8-11 wrap s, 12-15 wrap t,
+         *   16-19 wrap r, 20 rectangle texture, 21 border color, 31 valid,
+         *   32-63 border color */
+        assert(addru < ARRAY_SIZE(pgraph_texture_addr_map));
+        assert(addrv < ARRAY_SIZE(pgraph_texture_addr_map));
+        assert(addrp < ARRAY_SIZE(pgraph_texture_addr_map));
+        uint64_t sampler_key = (1u << 31)
+            | (min_filter & 0xF) | ((mag_filter & 0xF) << 4)
+            | (addru << 8)
+            | ((dimensionality > 1 ? addrv : 0) << 12)
+            | ((dimensionality > 2 ? addrp : 0) << 16);
+        if (f.encoding == linear && !cubemap) {
+            sampler_key |= 1 << 20;
+        }
+        /* FIXME: Only upload if necessary? [s, t or r = GL_CLAMP_TO_BORDER] */
+        if (border_source_color) {
+            sampler_key |= (1 << 21) | ((uint64_t)border_color << 32);
+        }
+
+        if (pg->texture_sampler_key[i] != sampler_key) {
+            glBindSampler(i, pgraph_get_sampler(pg, sampler_key));
+            pg->texture_sampler_key[i] = sampler_key;
+        }
+
+        /* Skip the lookup when nothing changed since the last bind, and no
+         * guest memory writes happened in the meantime (at least once per
+         * frame, the lookup is done anyway, to catch aged entries) */
+        if (!pg->texture_dirty[i] && pg->texture_binding[i]
+            && pg->texture_bound_generation[i] == pg->memory_generation
+            && pg->texture_bound_frame[i] == pg->frame_number) {
             glBindTexture(pg->texture_binding[i]->gl_target,
                           pg->texture_binding[i]->gl_texture);
             continue;
@@ -3916,14 +4058,6 @@ static void pgraph_bind_textures(NV2AState *d)
                      min_mipmap_level, max_mipmap_level, levels,
                      lod_bias);
 
-        assert(color_format < ARRAY_SIZE(kelvin_color_format_map));
-        ColorFormatInfo f = kelvin_color_format_map[color_format];
-        if (f.bytes_per_pixel == 0) {
-            fprintf(stderr, "nv2a: unimplemented texture color format 0x%x\n",
-                    color_format);
-            abort();
-        }
-
         unsigned int width, height, depth;
         if (f.encoding == linear) {
             assert(dimensionality == 2);
@@ -4045,6 +4179,7 @@ static void pgraph_bind_textures(NV2AState *d)
         }
 
 		TextureShape state;
+		memset(&state, 0, sizeof(state));
 		state.cubemap = cubemap;
 		state.dimensionality = dimensionality;
 		state.color_format = color_format;
@@ -4056,81 +4191,69 @@ static void pgraph_bind_textures(NV2AState *d)
 		state.max_mipmap_level = max_mipmap_level;
         state.pitch = pitch;
 
-#ifdef USE_TEXTURE_CACHE
-		TextureKey key;
-		key.state = state;
-		key.data_hash = fast_hash(texture_data, length, 5003)
-			^ fnv_hash(palette_data, palette_length);
-		key.texture_data = texture_data;
-		key.palette_data = palette_data;
-
-        gpointer cache_key = g_malloc(sizeof(TextureKey));
-        memcpy(cache_key, &key, sizeof(TextureKey));
-
-        GError *err;
-        TextureBinding *binding = (TextureBinding *)g_lru_cache_get(pg->texture_cache, cache_key, &err);
-        assert(binding);
-        binding->refcnt++;
-#else
-        TextureBinding *binding = generate_texture(state,
-                                                   texture_data, palette_data);
-#endif
+        bool palettized = (color_format == NV097_SET_TEXTURE_FORMAT_COLOR_SZ_I8_A8R8G8B8);
 
-        glBindTexture(binding->gl_target, binding->gl_texture);
+        TextureCacheKey key;
+        memset(&key, 0, sizeof(key));
+        key.texture_address = (xbox::addr)(texture_data - d->vram_ptr);
+        if (palettized) {
+            key.palette_address = (xbox::addr)(palette_data - d->vram_ptr);
+            key.palette_length = palette_length;
+        }
+        memcpy(&key.state, &state, sizeof(TextureShape));
 
+        auto it = pg->texture_cache.find(key);
+        NV2ATextureCheck check = NV2A_TEXTURE_CURRENT;
+        if (it != pg->texture_cache.end()) {
+            check = nv2a_texture_cache_check(it->second.validation, pg->memory_page_generation, pg->frame_number,
+                key.texture_address, key.palette_address, key.palette_length * 4);
+        }
+        if (it == pg->texture_cache.end() || check != NV2A_TEXTURE_CURRENT) {
+            /* Watch for CPU writes before reading the data, so that none
+             * can slip in between */
+            nv2a_write_watch_protect(key.texture_address, length);
+            if (palettized) {
+                nv2a_write_watch_protect(key.palette_address, palette_length * 4);
+            }
+        }
 
-        if (f.encoding == linear) {
-            /* sometimes games try to set mipmap min filters on linear textures.
-             * this could indicate a bug... */
-            switch (min_filter) {
-            case NV_PGRAPH_TEXFILTER0_MIN_BOX_NEARESTLOD:
-            case NV_PGRAPH_TEXFILTER0_MIN_BOX_TENT_LOD:
-                min_filter = NV_PGRAPH_TEXFILTER0_MIN_BOX_LOD0;
-                break;
-            case NV_PGRAPH_TEXFILTER0_MIN_TENT_NEARESTLOD:
-            case NV_PGRAPH_TEXFILTER0_MIN_TENT_TENT_LOD:
-                min_filter = NV_PGRAPH_TEXFILTER0_MIN_TENT_LOD0;
-                break;
+        if (it == pg->texture_cache.end()) {
+            TextureCacheEntry entry;
+            entry.binding = generate_texture(state, texture_data, palette_data);
+            uint64_t data_hash = ComputeHash(texture_data, length)
+                ^ (palettized ? ComputeHash(palette_data, palette_length * 4) : 0);
+            nv2a_texture_cache_uploaded(entry.validation, data_hash, length, pg->memory_generation, pg->frame_number,
+                pg->texture_cache_counters);
+            it = pg->texture_cache.emplace(key, entry).first;
+        } else if (check != NV2A_TEXTURE_CURRENT) {
+            /* The data might have been written since it was last seen,
+             * only upload it again when it really changed */
+            TextureCacheEntry &entry = it->second;
+            uint64_t data_hash = ComputeHash(texture_data, length)
+                ^ (palettized ? ComputeHash(palette_data, palette_length * 4) : 0);
+            if (nv2a_texture_cache_revalidate(entry.validation, check, data_hash, pg->memory_generation, pg->frame_number,
+                pg->texture_cache_counters)) {
+                texture_binding_destroy(entry.binding);
+                entry.binding = generate_texture(state, texture_data, palette_data);
             }
+        } else {
+            pg->texture_cache_counters.hits++;
         }
 
-        glTexParameteri(binding->gl_target, GL_TEXTURE_MIN_FILTER,
-            pgraph_texture_min_filter_map[min_filter]);
-        glTexParameteri(binding->gl_target, GL_TEXTURE_MAG_FILTER,
-            pgraph_texture_mag_filter_map[mag_filter]);
+        it->second.last_used_frame = pg->frame_number;
 
-        /* Texture wrapping */
-        assert(addru < ARRAY_SIZE(pgraph_texture_addr_map));
-        glTexParameteri(binding->gl_target, GL_TEXTURE_WRAP_S,
-            pgraph_texture_addr_map[addru]);
-        if (dimensionality > 1) {
-            assert(addrv < ARRAY_SIZE(pgraph_texture_addr_map));
-            glTexParameteri(binding->gl_target, GL_TEXTURE_WRAP_T,
-                pgraph_texture_addr_map[addrv]);
-        }
-        if (dimensionality > 2) {
-            assert(addrp < ARRAY_SIZE(pgraph_texture_addr_map));
-            glTexParameteri(binding->gl_target, GL_TEXTURE_WRAP_R,
-                pgraph_texture_addr_map[addrp]);
-        }
+        /* The slot holds its own reference, next to the cache's */
+        TextureBinding *binding = it->second.binding;
+        binding->refcnt++;
 
-        /* FIXME: Only upload if necessary? [s, t or r = GL_CLAMP_TO_BORDER] */
-        if (border_source_color) {
-            GLfloat gl_border_color[] = {
-                /* FIXME: Color channels might be wrong order */
-                ((border_color >> 16) & 0xFF) / 255.0f, /* red */
-                ((border_color >> 8) & 0xFF) / 255.0f,  /* green */
-                (border_color & 0xFF) / 255.0f,         /* blue */
-                ((border_color >> 24) & 0xFF) / 255.0f  /* alpha */
-            };
-            glTexParameterfv(binding->gl_target, GL_TEXTURE_BORDER_COLOR,
-                gl_border_color);
-        }
+        glBindTexture(binding->gl_target, binding->gl_texture);
 
         if (pg->texture_binding[i]) {
             texture_binding_destroy(pg->texture_binding[i]);
         }
         pg->texture_binding[i] = binding;
+        pg->texture_bound_generation[i] = pg->memory_generation;
+        pg->texture_bound_frame[i] = pg->frame_number;
         pg->texture_dirty[i] = false;
     }
     NV2A_GL_DGROUP_END();
@@ -4715,36 +4838,6 @@ static TextureBinding* generate_texture(const TextureShape s,
     return ret;
 }
 
-// NOTE: Might want to change guint to guint64 for return.
-/* functions for texture LRU cache */
-static guint texture_key_hash(gconstpointer key)
-{
-    const TextureKey *k = (const TextureKey *)key;
-    uint64_t state_hash = fnv_hash(
-        (const uint8_t*)&k->state, sizeof(TextureShape));
-    return guint(state_hash ^ k->data_hash);
-}
-static gboolean texture_key_equal(gconstpointer a, gconstpointer b)
-{
-    const TextureKey *ak = (const TextureKey *)a, *bk = (const TextureKey *)b;
-    return memcmp(&ak->state, &bk->state, sizeof(TextureShape)) == 0
-            && ak->data_hash == bk->data_hash;
-}
-static gpointer texture_key_retrieve(gpointer key, gpointer user_data, GError **error)
-{
-    const TextureKey *k = (const TextureKey *)key;
-    TextureBinding *v = generate_texture(k->state,
-                                         k->texture_data,
-                                         k->palette_data);
-    if (error != NULL) {
-        *error = NULL;
-    }
-    return v;
-}
-static void texture_key_destroy(gpointer data)
-{
-    g_free(data);
-}
 static void texture_binding_destroy(gpointer data)
 {
     TextureBinding *binding = (TextureBinding *)data;
@@ -4759,16 +4852,199 @@ static void texture_binding_destroy(gpointer data)
     }
 }
 
-// NOTE: Might want to change guint to guint64 for return.
-/* hash and equality for shader cache hash table */
-static guint shader_hash(gconstpointer key)
+/* sampler objects, see pgraph_bind_textures for the key layout */
+static GLuint pgraph_get_sampler(PGRAPHState *pg, uint64_t sampler_key)
 {
-    return (guint)fnv_hash((const uint8_t *)key, sizeof(ShaderState));
+    auto it = pg->sampler_cache.find(sampler_key);
+    if (it != pg->sampler_cache.end()) {
+        return it->second;
+    }
+
+    GLuint sampler;
+    glGenSamplers(1, &sampler);
+
+    glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER,
+        pgraph_texture_min_filter_map[sampler_key & 0xF]);
+    glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER,
+        pgraph_texture_mag_filter_map[(sampler_key >> 4) & 0xF]);
+
+    /* Texture wrapping. Rectangle textures don't allow repeat and mirror
+     * wrap modes (these were silently ignored with glTexParameteri) */
+    static const GLenum wrap_names[] = { GL_TEXTURE_WRAP_S, GL_TEXTURE_WRAP_T, GL_TEXTURE_WRAP_R };
+    bool rectangle = sampler_key & (1 << 20);
+    for (int i = 0; i < 3; i++) {
+        unsigned int addr = (sampler_key >> (8 + i * 4)) & 0xF;
+        if (addr == 0) {
+            continue;
+        }
+
+        GLenum wrap = pgraph_texture_addr_map[addr];
+        if (rectangle && (wrap == GL_REPEAT || wrap == GL_MIRRORED_REPEAT)) {
+            wrap = GL_CLAMP_TO_EDGE;
+        }
+        glSamplerParameteri(sampler, wrap_names[i], wrap);
+    }
+
+    if (sampler_key & (1 << 21)) {
+        uint32_t border_color = (uint32_t)(sampler_key >> 32);
+        GLfloat gl_border_color[] = {
+            /* FIXME: Color channels might be wrong order */
+            ((border_color >> 16) & 0xFF) / 255.0f, /* red */
+            ((border_color >> 8) & 0xFF) / 255.0f,  /* green */
+            (border_color & 0xFF) / 255.0f,         /* blue */
+            ((border_color >> 24) & 0xFF) / 255.0f  /* alpha */
+        };
+        glSamplerParameterfv(sampler, GL_TEXTURE_BORDER_COLOR,
+            gl_border_color);
+    }
+
+    pg->sampler_cache[sampler_key] = sampler;
+    return sampler;
+}
+
+/* functions for generation based texture cache invalidation */
+static void pgraph_mark_memory_written(NV2AState *d, hwaddr addr, hwaddr size)
+{
+    PGRAPHState *pg = &d->pgraph;
+
+    if (size == 0 || pg->memory_page_generation.empty()) {
+        return;
+    }
+
+    nv2a_texture_cache_mark_written(pg->memory_page_generation, ++pg->memory_generation, addr, size);
 }
-static gboolean shader_equal(gconstpointer a, gconstpointer b)
+
+typedef struct CPUWriteCollection {
+    PGRAPHState *pg;
+    uint32_t generation;
+    bool written;
+} CPUWriteCollection;
+
+static void pgraph_mark_page_written(size_t page, void *context)
 {
-    const ShaderState *as = (const ShaderState *)a, *bs = (const ShaderState *)b;
-    return memcmp(as, bs, sizeof(ShaderState)) == 0;
+    CPUWriteCollection *collection = (CPUWriteCollection *)context;
+
+    if (page < collection->pg->memory_page_generation.size()) {
+        collection->pg->memory_page_generation[page] = collection->generation;
+        collection->written = true;
+    }
+}
+
+static_assert(NV2A_TEXTURE_CACHE_PAGE_BITS == NV2A_WRITE_WATCH_PAGE_BITS, "write watch pages must match memory_page_generation");
+
+/* Turns the CPU writes seen by the write watch into page generations */
+static void pgraph_collect_cpu_writes(PGRAPHState *pg)
+{
+    CPUWriteCollection collection = { pg, pg->memory_generation + 1, false };
+    nv2a_write_watch_collect(pgraph_mark_page_written, &collection);
+    if (collection.written) {
+        pg->memory_generation = collection.generation;
+    }
+}
+
+/* Drops textures that weren't used for a while, once the cache grows large */
+#define NV2A_TEXTURE_CACHE_SIZE 512
+#define NV2A_TEXTURE_CACHE_MAX_UNUSED_FRAMES 60
+
+static void pgraph_texture_cache_trim(PGRAPHState *pg)
+{
+    if (pg->texture_cache.size() <= NV2A_TEXTURE_CACHE_SIZE) {
+        return;
+    }
+
+    for (auto it = pg->texture_cache.begin(); it != pg->texture_cache.end();) {
+        if (pg->frame_number - it->second.last_used_frame > NV2A_TEXTURE_CACHE_MAX_UNUSED_FRAMES) {
+            texture_binding_destroy(it->second.binding);
+            it = pg->texture_cache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+/* Records the guest memory a draw is about to read, sized from the
+ * current vertex array and texture state */
+static void pgraph_pbcapture_draw(NV2AState *d)
+{
+    PGRAPHState *pg = &d->pgraph;
+
+    unsigned int vertex_count = 0;
+    if (pg->draw_arrays_length) {
+        vertex_count = pg->draw_arrays_max_count;
+    } else if (pg->inline_elements_length) {
+        for (unsigned int i = 0; i < pg->inline_elements_length; i++) {
+            vertex_count = MAX(vertex_count, pg->inline_elements[i] + 1);
+        }
+    }
+
+    /* Inline arrays and inline buffers carry their data in the pushbuffer */
+    if (vertex_count > 0) {
+        for (int i = 0; i < NV2A_VERTEXSHADER_ATTRIBUTES; i++) {
+            VertexAttribute *vertex_attribute = &pg->vertex_attributes[i];
+            if (vertex_attribute->count == 0) {
+                continue;
+            }
+
+            size_t length = (size_t)(vertex_count - 1) * vertex_attribute->stride
+                + vertex_attribute->size * vertex_attribute->count;
+            nv2a_pbcapture_memory(d, vertex_attribute->offset, length, NV2A_PBCAPTURE_MEMORY_VERTEX);
+        }
+    }
+
+    for (int i = 0; i < NV2A_MAX_TEXTURES; i++) {
+        uint32_t ctl_0 = pg->regs[NV_PGRAPH_TEXCTL0_0 + i*4];
+        if (!(ctl_0 & NV_PGRAPH_TEXCTL0_0_ENABLE)) {
+            continue;
+        }
+
+        uint32_t ctl_1 = pg->regs[NV_PGRAPH_TEXCTL1_0 + i*4];
+        uint32_t fmt = pg->regs[NV_PGRAPH_TEXFMT0 + i*4];
+        uint32_t palette = pg->regs[NV_PGRAPH_TEXPALETTE0 + i*4];
+
+        unsigned int color_format = GET_MASK(fmt, NV_PGRAPH_TEXFMT0_COLOR);
+        if (color_format >= ARRAY_SIZE(kelvin_color_format_map)
+            || kelvin_color_format_map[color_format].bytes_per_pixel == 0) {
+            continue;
+        }
+
+        ColorFormatInfo f = kelvin_color_format_map[color_format];
+        unsigned int levels = MAX(GET_MASK(fmt, NV_PGRAPH_TEXFMT0_MIPMAP_LEVELS), 1);
+
+        /* Unlike pgraph_bind_textures, this covers every mipmap level the
+         * guest declared, as the replay might sample any of them */
+        size_t length = 0;
+        if (f.encoding == linear) {
+            length = (size_t)GET_MASK(pg->regs[NV_PGRAPH_TEXIMAGERECT0 + i*4], NV_PGRAPH_TEXIMAGERECT0_HEIGHT)
+                * GET_MASK(ctl_1, NV_PGRAPH_TEXCTL1_0_IMAGE_PITCH);
+        } else {
+            unsigned int w = 1 << GET_MASK(fmt, NV_PGRAPH_TEXFMT0_BASE_SIZE_U);
+            unsigned int h = 1 << GET_MASK(fmt, NV_PGRAPH_TEXFMT0_BASE_SIZE_V);
+            for (unsigned int level = 0; level < levels; level++) {
+                if (f.encoding == swizzled) {
+                    w = MAX(w, 1); h = MAX(h, 1);
+                    length += (size_t)w * h * f.bytes_per_pixel;
+                } else {
+                    w = MAX(w, 4); h = MAX(h, 4);
+                    length += (size_t)(w / 4) * (h / 4)
+                        * (f.gl_internal_format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT ? 8 : 16);
+                }
+                w /= 2; h /= 2;
+            }
+            if (fmt & NV_PGRAPH_TEXFMT0_CUBEMAPENABLE) {
+                length *= 6;
+            }
+            if (GET_MASK(fmt, NV_PGRAPH_TEXFMT0_DIMENSIONALITY) >= 3) {
+                length *= (size_t)1 << GET_MASK(fmt, NV_PGRAPH_TEXFMT0_BASE_SIZE_P);
+            }
+        }
+
+        nv2a_pbcapture_memory(d, pg->regs[NV_PGRAPH_TEXOFFSET0 + i*4], length, NV2A_PBCAPTURE_MEMORY_TEXTURE);
+
+        if (color_format == NV097_SET_TEXTURE_FORMAT_COLOR_SZ_I8_A8R8G8B8) {
+            size_t palette_length = 256 >> GET_MASK(palette, NV_PGRAPH_TEXPALETTE0_LENGTH);
+            nv2a_pbcapture_memory(d, palette & NV_PGRAPH_TEXPALETTE0_OFFSET, palette_length * 4, NV2A_PBCAPTURE_MEMORY_PALETTE);
+        }
+    }
 }
 
 static unsigned int kelvin_map_stencil_op(uint32_t parameter)
@@ -4841,54 +5117,3 @@ static unsigned int kelvin_map_texgen(uint32_t parameter, unsigned int channel)
 	}
 	return texgen;
 }
-
-static uint64_t fnv_hash(const uint8_t *data, size_t len)
-{
-    /* 64 bit Fowler/Noll/Vo FNV-1a hash code */
-    uint64_t hval = 0xcbf29ce484222325ULL;
-    const uint8_t *dp = data;
-    const uint8_t *de = data + len;
-    while (dp < de) {
-        hval ^= (uint64_t) *dp++;
-        hval += (hval << 1) + (hval << 4) + (hval << 5) +
-            (hval << 7) + (hval << 8) + (hval << 40);
-    }
-
-    return hval;
-}
-
-static uint64_t fast_hash(const uint8_t *data, size_t len, unsigned int samples)
-{
-#ifdef __SSE4_2__
-    uint64_t h[4] = {len, 0, 0, 0};
-    assert(samples > 0);
-
-    if (len < 8 || len % 8) {
-        return fnv_hash(data, len);
-    }
-
-    assert(len >= 8 && len % 8 == 0);
-    const uint64_t *dp = (const uint64_t*)data;
-    const uint64_t *de = dp + (len / 8);
-    size_t step = len / 8 / samples;
-    if (step == 0) step = 1;
-
-    while (dp < de - step * 3) {
-        h[0] = __builtin_ia32_crc32di(h[0], dp[step * 0]);
-        h[1] = __builtin_ia32_crc32di(h[1], dp[step * 1]);
-        h[2] = __builtin_ia32_crc32di(h[2], dp[step * 2]);
-        h[3] = __builtin_ia32_crc32di(h[3], dp[step * 3]);
-        dp += step * 4;
-    }
-    if (dp < de - step * 0)
-        h[0] = __builtin_ia32_crc32di(h[0], dp[step * 0]);
-    if (dp < de - step * 1)
-        h[1] = __builtin_ia32_crc32di(h[1], dp[step * 1]);
-    if (dp < de - step * 2)
-        h[2] = __builtin_ia32_crc32di(h[2], dp[step * 2]);
-
-    return h[0] + (h[1] << 10) + (h[2] << 21) + (h[3] << 32);
-#else
-    return fnv_hash(data, len);
-#endif
-}
@@ -42,7 +42,17 @@ DEVICE_READ32(PRAMIN)
 
 DEVICE_WRITE32(PRAMIN)
 {
-	*((uint32_t*)(d->pramin.ramin_ptr + addr)) = value;
+	if (ramht_contains(d, addr)) {
+		// The puller caches RAMHT slots, so rewriting one must flush that cache.
+		// Holding pfifo_lock keeps the puller from caching the old slot contents
+		// between the write and the flush.
+		qemu_mutex_lock(&d->pfifo.pfifo_lock);
+		*((uint32_t*)(d->pramin.ramin_ptr + addr)) = value;
+		ramht_cache_flush(d);
+		qemu_mutex_unlock(&d->pfifo.pfifo_lock);
+	} else {
+		*((uint32_t*)(d->pramin.ramin_ptr + addr)) = value;
+	}
 
 	DEVICE_WRITE32_END(PRAMIN);
 }
@@ -59,6 +59,9 @@
 #include "vga.h"
 #include "nv2a.h" // For NV2AState
 #include "nv2a_int.h" // from https://github.com/espes/xqemu/tree/xbox/hw/xbox
+#include "nv2a_pbcapture.h" // For nv2a_pbcapture_*
+#include "nv2a_write_watch.h" // For nv2a_write_watch_*
+#include "nv2a_shader_cache.h" // For shader_cache_*
 //#include <gl\glew.h>
 #include <gl\GL.h>
 #include <gl\GLU.h>
@@ -87,10 +90,6 @@ struct _GError
 
 #include "common\util\gloffscreen\glextensions.h" // for glextensions_init
 
-GLuint create_gl_shader(GLenum gl_shader_type,
-	const char *code,
-	const char *name); // forward to nv2a_shaders.cpp
-
 static void update_irq(NV2AState *d)
 {
 	/* PFIFO */
@@ -1185,6 +1184,7 @@ void NV2ADevice::Init()
 
 	d->vram_ptr = (uint8_t*)PHYSICAL_MAP_BASE;
 	d->vram_size = g_SystemMaxMemory;
+	nv2a_write_watch_init(d->vram_ptr, d->vram_size);
 
 	d->pramdac.core_clock_coeff = 0x00011c01; /* 189MHz...? */
 	d->pramdac.core_clock_freq = 189000000;
@@ -0,0 +1,237 @@
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+#pragma once
+
+// PFIFO CACHE1 queueing and pulling, and PGRAPH object selection, shared by
+// the PFIFO/PGRAPH emulation and the cxbxr-pbreplay tool. Like
+// nv2a_pushbuffer.h, this header must stay free of emulator (and Windows)
+// dependencies, so that the replay tool drives the very same method
+// dispatch as the emulator.
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+#include "nv2a_regs.h"
+
+enum FIFOEngine {
+	ENGINE_SOFTWARE = 0,
+	ENGINE_GRAPHICS = 1,
+	ENGINE_DVD = 2,
+};
+
+typedef struct RAMHTEntry {
+	uint32_t handle;
+	uint32_t instance;
+	enum FIFOEngine engine;
+	unsigned int channel_id : 5;
+	bool valid;
+} RAMHTEntry;
+
+/* A CACHE1 entry pulled by the puller, ready to be handed to PGRAPH */
+typedef struct PullerMethod {
+	uint32_t subchannel;
+	uint32_t method;
+	uint32_t parameter;
+	int channel_id; // channel to switch PGRAPH to (object binds only), otherwise -1
+} PullerMethod;
+
+static inline uint32_t nv2a_fifo_get_mask(uint32_t v, uint32_t mask)
+{
+	uint32_t shift = 0;
+	while (!(mask & (1u << shift))) {
+		shift++;
+	}
+
+	return (v & mask) >> shift;
+}
+
+static inline void nv2a_fifo_set_mask(uint32_t &v, uint32_t mask, uint32_t val)
+{
+	uint32_t shift = 0;
+	while (!(mask & (1u << shift))) {
+		shift++;
+	}
+
+	v = (v & ~mask) | ((val << shift) & mask);
+}
+
+// Queues a method in CACHE1 (the caller must check there's room, see
+// NV_PFIFO_CACHE1_STATUS_HIGH_MARK). pfifo_regs is indexed by register
+// address. Returns true when CACHE1 was empty, so the puller must be
+// signalled.
+static inline bool nv2a_cache1_push(uint32_t *pfifo_regs, uint32_t method, uint32_t method_type, uint32_t subchannel, uint32_t parameter)
+{
+	uint32_t *status = &pfifo_regs[NV_PFIFO_CACHE1_STATUS];
+	uint32_t put = pfifo_regs[NV_PFIFO_CACHE1_PUT];
+	uint32_t get = pfifo_regs[NV_PFIFO_CACHE1_GET];
+
+	assert((method & 3) == 0);
+	uint32_t method_entry = 0;
+	nv2a_fifo_set_mask(method_entry, NV_PFIFO_CACHE1_METHOD_ADDRESS, method >> 2);
+	nv2a_fifo_set_mask(method_entry, NV_PFIFO_CACHE1_METHOD_TYPE, method_type);
+	nv2a_fifo_set_mask(method_entry, NV_PFIFO_CACHE1_METHOD_SUBCHANNEL, subchannel);
+
+	assert(put < 128*4 && (put%4) == 0);
+	pfifo_regs[NV_PFIFO_CACHE1_METHOD + put*2] = method_entry;
+	pfifo_regs[NV_PFIFO_CACHE1_DATA + put*2] = parameter;
+
+	uint32_t new_put = (put+4) & 0x1fc;
+	pfifo_regs[NV_PFIFO_CACHE1_PUT] = new_put;
+	if (new_put == get) {
+		// set high mark
+		*status |= NV_PFIFO_CACHE1_STATUS_HIGH_MARK;
+	}
+	if (*status & NV_PFIFO_CACHE1_STATUS_LOW_MARK) {
+		// unset low mark
+		*status &= ~NV_PFIFO_CACHE1_STATUS_LOW_MARK;
+		return true;
+	}
+
+	return false;
+}
+
+// Drains CACHE1 into batch (room for NV2A_CACHE1_SIZE entries), resolving
+// object handles and binding engines to subchannels on the way. Returns
+// the number of methods pulled.
+//
+// The Backend type must provide :
+//   RAMHTEntry RamhtLookup(uint32_t handle);
+//   void SignalPusher(); // CACHE1 is no longer full
+template<class Backend>
+int nv2a_puller_fill_batch(uint32_t *pfifo_regs, PullerMethod *batch, Backend &backend)
+{
+	uint32_t *pull1 = &pfifo_regs[NV_PFIFO_CACHE1_PULL1];
+	uint32_t *engine_reg = &pfifo_regs[NV_PFIFO_CACHE1_ENGINE];
+
+	uint32_t *status = &pfifo_regs[NV_PFIFO_CACHE1_STATUS];
+	uint32_t *get_reg = &pfifo_regs[NV_PFIFO_CACHE1_GET];
+	uint32_t *put_reg = &pfifo_regs[NV_PFIFO_CACHE1_PUT];
+
+	int batch_size = 0;
+	while (batch_size < NV2A_CACHE1_SIZE) {
+		/* empty cache1 */
+		if (*status & NV_PFIFO_CACHE1_STATUS_LOW_MARK) break;
+
+		uint32_t get = *get_reg;
+		uint32_t put = *put_reg;
+
+		assert(get < 128*4 && (get % 4) == 0);
+		uint32_t method_entry = pfifo_regs[NV_PFIFO_CACHE1_METHOD + get*2];
+		uint32_t parameter = pfifo_regs[NV_PFIFO_CACHE1_DATA + get*2];
+
+		uint32_t new_get = (get+4) & 0x1fc;
+		*get_reg = new_get;
+
+		if (new_get == put) {
+			// set low mark
+			*status |= NV_PFIFO_CACHE1_STATUS_LOW_MARK;
+		}
+		if (*status & NV_PFIFO_CACHE1_STATUS_HIGH_MARK) {
+			// unset high mark
+			*status &= ~NV_PFIFO_CACHE1_STATUS_HIGH_MARK;
+			// signal pusher
+			backend.SignalPusher();
+		}
+
+		uint32_t method = method_entry & 0x1FFC;
+		uint32_t subchannel = nv2a_fifo_get_mask(method_entry, NV_PFIFO_CACHE1_METHOD_SUBCHANNEL);
+
+		PullerMethod *pulled = &batch[batch_size];
+		pulled->subchannel = subchannel;
+		pulled->method = method;
+		pulled->channel_id = -1;
+
+		if (method == 0) {
+			RAMHTEntry entry = backend.RamhtLookup(parameter);
+			assert(entry.valid);
+
+			// assert(entry.channel_id == state->channel_id);
+
+			assert(entry.engine == ENGINE_GRAPHICS);
+
+			/* the engine is bound to the subchannel */
+			assert(subchannel < 8);
+			nv2a_fifo_set_mask(*engine_reg, 3 << (4*subchannel), entry.engine);
+			nv2a_fifo_set_mask(*pull1, NV_PFIFO_CACHE1_PULL1_ENGINE, entry.engine);
+
+			pulled->parameter = entry.instance;
+			pulled->channel_id = entry.channel_id;
+		} else if (method >= 0x100) {
+			// method passed to engine
+
+			/* methods that take objects.
+			 * TODO: Check this range is correct for the nv2a */
+			if (method >= 0x180 && method < 0x200) {
+				RAMHTEntry entry = backend.RamhtLookup(parameter);
+				assert(entry.valid);
+				// assert(entry.channel_id == state->channel_id);
+				parameter = entry.instance;
+			}
+
+			enum FIFOEngine engine = (enum FIFOEngine)nv2a_fifo_get_mask(*engine_reg, 3 << (4*subchannel));
+			assert(engine == ENGINE_GRAPHICS);
+			nv2a_fifo_set_mask(*pull1, NV_PFIFO_CACHE1_PULL1_ENGINE, engine);
+
+			pulled->parameter = parameter;
+		} else {
+			assert(false);
+			continue;
+		}
+
+		batch_size++;
+	}
+
+	return batch_size;
+}
+
+// Selects the object a PGRAPH method is for : NV_SET_OBJECT loads the
+// object at 'parameter' in ramin into the subchannel, and every method
+// makes its subchannel's object the current one. pgraph_regs is indexed
+// by register address. Returns the graphics class of the object.
+static inline uint32_t nv2a_pgraph_select_object(uint32_t *pgraph_regs, const uint8_t *ramin, uint32_t subchannel, uint32_t method, uint32_t parameter)
+{
+	assert(subchannel < 8);
+
+	if (method == NV_SET_OBJECT) {
+		const uint8_t *obj_ptr = ramin + parameter;
+
+		uint32_t ctx[4];
+		memcpy(ctx, obj_ptr, sizeof(ctx)); // little endian, like ldl_le_p
+
+		pgraph_regs[NV_PGRAPH_CTX_CACHE1 + subchannel * 4] = ctx[0];
+		pgraph_regs[NV_PGRAPH_CTX_CACHE2 + subchannel * 4] = ctx[1];
+		pgraph_regs[NV_PGRAPH_CTX_CACHE3 + subchannel * 4] = ctx[2];
+		pgraph_regs[NV_PGRAPH_CTX_CACHE4 + subchannel * 4] = ctx[3];
+		pgraph_regs[NV_PGRAPH_CTX_CACHE5 + subchannel * 4] = parameter;
+	}
+
+	// is this right?
+	pgraph_regs[NV_PGRAPH_CTX_SWITCH1] = pgraph_regs[NV_PGRAPH_CTX_CACHE1 + subchannel * 4];
+	pgraph_regs[NV_PGRAPH_CTX_SWITCH2] = pgraph_regs[NV_PGRAPH_CTX_CACHE2 + subchannel * 4];
+	pgraph_regs[NV_PGRAPH_CTX_SWITCH3] = pgraph_regs[NV_PGRAPH_CTX_CACHE3 + subchannel * 4];
+	pgraph_regs[NV_PGRAPH_CTX_SWITCH4] = pgraph_regs[NV_PGRAPH_CTX_CACHE4 + subchannel * 4];
+	pgraph_regs[NV_PGRAPH_CTX_SWITCH5] = pgraph_regs[NV_PGRAPH_CTX_CACHE5 + subchannel * 4];
+
+	return nv2a_fifo_get_mask(pgraph_regs[NV_PGRAPH_CTX_SWITCH1], NV_PGRAPH_CTX_SWITCH1_GRCLASS);
+}
@@ -23,24 +23,25 @@
 #ifndef HW_NV2A_INT_H
 #define HW_NV2A_INT_H
 
-#undef USE_SHADER_CACHE
-
+#include <cstring>
 #include <queue>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 #include <GL/glew.h>
 
 #include "xbox_types.h" // For xbox::addr
 
 #include "qemu-thread.h" // For qemu_mutex, etc
 
-#ifdef USE_SHADER_CACHE
-#include "glib_compat.h" // For GHashTable, g_hash_table_new, g_hash_table_lookup, g_hash_table_insert
-#endif
 #include "common\util\gloffscreen\gloffscreen.h" // For GloContext, etc
+#include "common\util\hasher.h" // For ComputeHash
 
 #include "swizzle.h"
 
 #include "nv2a_debug.h" // For HWADDR_PRIx, NV2A_DPRINTF, NV2A_GL_DPRINTF, etc.
+#include "nv2a_fifo.h" // For FIFOEngine, PullerMethod, etc
+#include "nv2a_texture_cache.h" // For NV2ATextureValidation, NV2A_TEXTURE_CACHE_PAGE_BITS, etc
 #include "nv2a_shaders.h" // For ShaderBinding, etc
 #include "nv2a_regs.h" // For NV2A_MAX_TEXTURES, etc
 
@@ -66,8 +67,6 @@ typedef uint32_t value_t; // Compatibility; Cxbx values are uint32_t (xqemu and
 #define g_malloc0(x) calloc(1, x) // Compatibility
 #define g_realloc(x, y) realloc(x, y) // Compatibility
 
-#undef USE_TEXTURE_CACHE
-
 #if __cplusplus >= 201402L
 #  define NV2A_CONSTEXPR constexpr
 #else
@@ -118,12 +117,6 @@ static int ffs(int valu)
 //void reg_log_read(int block, hwaddr addr, uint64_t val);
 //void reg_log_write(int block, hwaddr addr, uint64_t val);
 
-enum FIFOEngine {
-	ENGINE_SOFTWARE = 0,
-	ENGINE_GRAPHICS = 1,
-	ENGINE_DVD = 2,
-};
-
 typedef struct DMAObject {
 	unsigned int dma_class;
 	unsigned int dma_target;
@@ -192,19 +185,61 @@ typedef struct TextureShape {
 	unsigned int pitch;
 } TextureShape;
 
-typedef struct TextureKey {
-	TextureShape state;
-	uint64_t data_hash;
-	uint8_t* texture_data;
-	uint8_t* palette_data;
-} TextureKey;
-
 typedef struct TextureBinding {
 	GLenum gl_target;
 	GLuint gl_texture;
 	unsigned int refcnt;
 } TextureBinding;
 
+/* Texture cache key; instances must be zeroed before filling them in,
+ * since the padding bytes take part in hashing and comparison. */
+typedef struct TextureCacheKey {
+	xbox::addr texture_address; // offset of the texture data in vram
+	xbox::addr palette_address; // offset of the palette in vram (palettized formats only)
+	unsigned int palette_length; // in entries (palettized formats only)
+	TextureShape state;
+} TextureCacheKey;
+
+typedef struct TextureCacheEntry {
+	TextureBinding *binding; // the cache holds one reference
+	NV2ATextureValidation validation;
+	uint32_t last_used_frame;
+} TextureCacheEntry;
+
+struct TextureCacheKeyHash {
+	size_t operator()(const TextureCacheKey &key) const {
+		/* FNV-1a; the key is small, so this is cheap enough */
+		const uint8_t *data = (const uint8_t *)&key;
+		uint32_t hash = 0x811c9dc5;
+		for (size_t i = 0; i < sizeof(TextureCacheKey); i++) {
+			hash = (hash ^ data[i]) * 0x01000193;
+		}
+		return hash;
+	}
+};
+
+struct TextureCacheKeyEqual {
+	bool operator()(const TextureCacheKey &a, const TextureCacheKey &b) const {
+		return memcmp(&a, &b, sizeof(TextureCacheKey)) == 0;
+	}
+};
+
+/* ShaderStates must be zeroed before filling them in, like TextureCacheKey */
+struct ShaderStateHash {
+	size_t operator()(const ShaderState &state) const {
+		return (size_t)ComputeHash((void*)&state, sizeof(ShaderState));
+	}
+};
+
+struct ShaderStateEqual {
+	bool operator()(const ShaderState &a, const ShaderState &b) const {
+		return memcmp(&a, &b, sizeof(ShaderState)) == 0;
+	}
+};
+
+/* Number of frames between two texture cache statistics reports */
+#define NV2A_TEXTURE_CACHE_REPORT_FRAMES 60
+
 typedef struct KelvinState {
 	xbox::addr object_instance;
 } KelvinState;
@@ -250,16 +285,29 @@ typedef struct PGRAPHState {
 	SurfaceShape last_surface_shape;
 
 	xbox::addr dma_a, dma_b;
-#ifdef USE_TEXTURE_CACHE
-	GLruCache *texture_cache;
-#endif
+	std::unordered_map<TextureCacheKey, TextureCacheEntry, TextureCacheKeyHash, TextureCacheKeyEqual> texture_cache;
+	std::unordered_map<uint64_t, GLuint> sampler_cache; // packed sampler state -> sampler object
 	bool texture_dirty[NV2A_MAX_TEXTURES];
 	TextureBinding *texture_binding[NV2A_MAX_TEXTURES];
-
-#ifdef USE_SHADER_CACHE
-	GHashTable *shader_cache;
-#endif
+	uint64_t texture_sampler_key[NV2A_MAX_TEXTURES]; // sampler state bound to each unit, zero when none
+	uint32_t texture_bound_generation[NV2A_MAX_TEXTURES]; // memory generation at which each unit was bound
+	uint32_t texture_bound_frame[NV2A_MAX_TEXTURES]; // frame in which each unit was bound
+
+	/* Generation based invalidation of cached textures. memory_generation
+	 * is bumped on every tracked guest memory write, memory_page_generation
+	 * holds the generation of the last write to each page. PGRAPH marks its
+	 * own writes, CPU writes are collected from nv2a_write_watch (see
+	 * nv2a_texture_cache.h for the writes that aren't seen). */
+	std::vector<uint32_t> memory_page_generation;
+	uint32_t memory_generation;
+	uint32_t frame_number;
+
+	NV2ATextureCacheCounters texture_cache_counters;
+
+	std::unordered_map<ShaderState, ShaderBinding*, ShaderStateHash, ShaderStateEqual> shader_cache;
 	ShaderBinding *shader_binding;
+	ShaderState shader_state; // state shader_binding was looked up with
+	bool shaders_dirty; // set by methods that might change shader_state
 
 	bool texture_matrix_enable[NV2A_MAX_TEXTURES];
 
@@ -356,6 +404,15 @@ typedef struct OverlayState {
 	GLuint gl_texture;
 } OverlayState;
 
+/* Small direct-mapped cache of RAMHT slots, per channel. Flushed when
+ * NV_PFIFO_RAMHT changes, or when PRAMIN writes land inside the RAMHT. */
+#define NV2A_RAMHT_CACHE_SIZE 8
+
+typedef struct RAMHTCacheEntry {
+	uint32_t handle;
+	uint32_t context; // raw RAMHT context word, zero when unused
+} RAMHTCacheEntry;
+
 typedef struct NV2AState {
     // PCIDevice dev;
     // qemu_irq irq;
@@ -394,6 +451,11 @@ typedef struct NV2AState {
 		QemuCond puller_cond;
 		std::thread pusher_thread;
 		QemuCond pusher_cond;
+		RAMHTCacheEntry ramht_cache[NV2A_NUM_CHANNELS][NV2A_RAMHT_CACHE_SIZE];
+		uint64_t methods_pulled; // total methods handed to PGRAPH
+		uint64_t batches_pulled; // total pgraph_lock acquisitions by the puller
+		uint64_t ramht_lookups; // object handle lookups done by the puller
+		uint64_t ramht_cache_hits; // lookups served by ramht_cache
     } pfifo;
 
     struct {
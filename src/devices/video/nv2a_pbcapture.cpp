@@ -0,0 +1,138 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+#define LOG_PREFIX CXBXR_MODULE::NV2A
+
+#include <cstdio>
+#include <mutex>
+
+#include "devices/video/nv2a.h" // For NV2AState
+#include "devices/video/nv2a_pbcapture.h"
+#include "devices/video/nv2a_pbcapture_writer.h"
+#include "common/util/hasher.h" // For ComputeHash
+#include "Logging.h"
+
+volatile bool g_nv2a_pbcapture_active = false;
+
+static std::mutex g_pbcapture_mutex;
+static NV2APBCaptureWriter g_pbcapture_writer = {};
+static unsigned int g_pbcapture_frames_requested = 0;
+static unsigned int g_pbcapture_file_number = 0;
+
+void nv2a_pbcapture_request(unsigned int frame_count)
+{
+	std::lock_guard<std::mutex> lock(g_pbcapture_mutex);
+
+	// Ignore requests while a capture is still running
+	if (g_pbcapture_writer.file == nullptr) {
+		g_pbcapture_frames_requested = frame_count;
+	}
+}
+
+static NV2APBCaptureStats pbcapture_get_stats(NV2AState *d)
+{
+	NV2APBCaptureStats stats;
+	stats.texture_cache_hits = d->pgraph.texture_cache_counters.hits;
+	stats.texture_cache_misses = d->pgraph.texture_cache_counters.misses;
+	stats.texture_cache_revalidations = d->pgraph.texture_cache_counters.revalidations;
+	stats.texture_upload_bytes = d->pgraph.texture_cache_counters.upload_bytes;
+	return stats;
+}
+
+void nv2a_pbcapture_frame(NV2AState *d)
+{
+	std::lock_guard<std::mutex> lock(g_pbcapture_mutex);
+
+	NV2APBCaptureStats stats = pbcapture_get_stats(d);
+
+	if (g_pbcapture_writer.file != nullptr) {
+		if (nv2a_pbcapture_writer_end_frame(g_pbcapture_writer, stats)) {
+			g_nv2a_pbcapture_active = false;
+			EmuLog(LOG_LEVEL::INFO, "Pushbuffer capture finished after %u frames", g_pbcapture_writer.frame_number);
+			return;
+		}
+	}
+	else {
+		if (g_pbcapture_frames_requested == 0) {
+			return;
+		}
+
+		char szFileName[32];
+		sprintf(szFileName, "pbcapture%03u.nv2a", g_pbcapture_file_number++);
+		FILE *file = fopen(szFileName, "wb");
+		if (file == nullptr) {
+			EmuLog(LOG_LEVEL::WARNING, "Couldn't create pushbuffer capture file %s", szFileName);
+			g_pbcapture_frames_requested = 0;
+			return;
+		}
+
+		EmuLog(LOG_LEVEL::INFO, "Capturing %u frames to %s", g_pbcapture_frames_requested, szFileName);
+
+		// Starts over from a clean context, including the LLE pusher position left by a previous capture
+		nv2a_pbcapture_writer_begin(g_pbcapture_writer, file, g_pbcapture_frames_requested, NV_PGRAPH_SIZE);
+		g_pbcapture_frames_requested = 0;
+		g_nv2a_pbcapture_active = true;
+	}
+
+	nv2a_pbcapture_writer_start_frame(g_pbcapture_writer, d->pgraph.regs, NV_PGRAPH_SIZE, stats);
+}
+
+void nv2a_pbcapture_commands(const uint32_t *words, uint32_t address, uint32_t size_in_bytes, uint32_t flags)
+{
+	std::lock_guard<std::mutex> lock(g_pbcapture_mutex);
+
+	if (g_pbcapture_writer.file == nullptr) {
+		return;
+	}
+
+	nv2a_pbcapture_writer_commands(g_pbcapture_writer, words, address, size_in_bytes, flags);
+}
+
+void nv2a_pbcapture_lle_commands(const uint8_t *dma, uint64_t dma_len, uint32_t dma_get, uint32_t dma_put)
+{
+	std::lock_guard<std::mutex> lock(g_pbcapture_mutex);
+
+	if (g_pbcapture_writer.file == nullptr) {
+		return;
+	}
+
+	nv2a_pbcapture_writer_lle_commands(g_pbcapture_writer, dma, dma_len, dma_get, dma_put);
+}
+
+void nv2a_pbcapture_memory(NV2AState *d, uint32_t offset, size_t size, uint32_t flags)
+{
+	std::lock_guard<std::mutex> lock(g_pbcapture_mutex);
+
+	if (g_pbcapture_writer.file == nullptr || offset >= d->vram_size || size == 0) {
+		return;
+	}
+
+	if (size > d->vram_size - offset) {
+		size = (size_t)(d->vram_size - offset);
+	}
+
+	uint64_t hash = ComputeHash(d->vram_ptr + offset, size);
+	nv2a_pbcapture_writer_memory(g_pbcapture_writer, d->vram_ptr + offset, offset, size, hash, flags);
+}
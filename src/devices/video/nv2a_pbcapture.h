@@ -0,0 +1,103 @@
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+#pragma once
+
+// Pushbuffer capture file format. Like nv2a_pushbuffer.h, the format part
+// of this header must stay free of emulator dependencies, since it's
+// shared with the cxbxr-pbreplay tool.
+//
+// A capture file starts with an NV2APBCaptureHeader, followed by a
+// sequence of chunks, each an NV2APBCaptureChunk followed by 'size' bytes
+// of payload. Every captured frame starts with a FRAME chunk, followed
+// by the COMMANDS and MEMORY chunks recorded during that frame. MEMORY
+// chunks hold the guest memory read by the draws in the preceding
+// COMMANDS chunk, as it was when those draws were handled. A STATS chunk
+// closes every frame.
+
+#include <cstddef>
+#include <cstdint>
+
+#define NV2A_PBCAPTURE_MAGIC 0x50425843 // "CXBP"
+#define NV2A_PBCAPTURE_VERSION 2
+
+typedef struct {
+	uint32_t magic; // NV2A_PBCAPTURE_MAGIC
+	uint32_t version; // NV2A_PBCAPTURE_VERSION
+	uint32_t pgraph_register_count; // Number of DWORDs in each FRAME chunk payload
+	uint32_t reserved;
+} NV2APBCaptureHeader;
+
+typedef enum : uint32_t {
+	// Payload : PGRAPH registers at the start of the frame; 'address' holds the frame number
+	NV2A_PBCAPTURE_CHUNK_FRAME = 1,
+	// Payload : command words, as consumed by the pusher; 'address' holds the address of the first word
+	NV2A_PBCAPTURE_CHUNK_COMMANDS = 2,
+	// Payload : guest memory read by a draw; 'address' holds the offset of the first byte
+	NV2A_PBCAPTURE_CHUNK_MEMORY = 3,
+	// Payload : NV2APBCaptureStats for the frame that just ended; 'address' holds the frame number
+	NV2A_PBCAPTURE_CHUNK_STATS = 4,
+} NV2APBCaptureChunkType;
+
+// Values for NV2APBCaptureChunk.flags of COMMANDS chunks
+#define NV2A_PBCAPTURE_COMMANDS_HLE 0 // EmuExecutePushBufferRaw (contiguous memory addresses)
+#define NV2A_PBCAPTURE_COMMANDS_LLE 1 // pfifo_run_pusher (DMA object relative addresses)
+
+// Values for NV2APBCaptureChunk.flags of MEMORY chunks
+#define NV2A_PBCAPTURE_MEMORY_VERTEX  0
+#define NV2A_PBCAPTURE_MEMORY_TEXTURE 1
+#define NV2A_PBCAPTURE_MEMORY_PALETTE 2
+
+// PGRAPH texture cache counters during one frame, so the emulator's cache
+// behaviour can be compared against replays
+typedef struct {
+	uint64_t texture_cache_hits;
+	uint64_t texture_cache_misses;
+	uint64_t texture_cache_revalidations;
+	uint64_t texture_upload_bytes;
+} NV2APBCaptureStats;
+
+typedef struct {
+	uint32_t type; // NV2APBCaptureChunkType
+	uint32_t size; // Size of the payload in bytes
+	uint32_t address;
+	uint32_t flags;
+} NV2APBCaptureChunk;
+
+#ifndef NV2A_PBCAPTURE_FORMAT_ONLY
+
+struct NV2AState;
+
+// Requests capturing the given number of frames, starting at the next frame boundary
+void nv2a_pbcapture_request(unsigned int frame_count);
+// Called (only) by pgraph_frame_boundary, once per frame; starts and ends captures
+void nv2a_pbcapture_frame(NV2AState *d);
+// Records the command words about to be consumed by a pusher
+void nv2a_pbcapture_commands(const uint32_t *words, uint32_t address, uint32_t size_in_bytes, uint32_t flags);
+// Records the commands pfifo_run_pusher is about to consume (skipping those recorded by its previous run)
+void nv2a_pbcapture_lle_commands(const uint8_t *dma, uint64_t dma_len, uint32_t dma_get, uint32_t dma_put);
+// Records guest memory that a draw is about to read (skipped when unchanged since it was last recorded)
+void nv2a_pbcapture_memory(NV2AState *d, uint32_t offset, size_t size, uint32_t flags);
+
+extern volatile bool g_nv2a_pbcapture_active;
+
+#endif // !NV2A_PBCAPTURE_FORMAT_ONLY
@@ -0,0 +1,139 @@
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+#pragma once
+
+// Writing of pushbuffer capture files (see nv2a_pbcapture.h), shared by
+// nv2a_pbcapture.cpp and the round trip test of cxbxr-pbreplay. Like the
+// format part of nv2a_pbcapture.h, this header must stay free of emulator
+// dependencies; callers pass in what they need from the emulator (register
+// contents, counters, memory hashes).
+
+#include <cstdio>
+#include <unordered_map>
+
+#include "nv2a_pbcapture.h"
+
+typedef struct {
+	size_t size;
+	uint64_t hash;
+} NV2APBCaptureMemory;
+
+// Everything about the capture being written, reset by nv2a_pbcapture_writer_begin
+typedef struct {
+	FILE *file; // nullptr while not capturing
+	unsigned int frames_left;
+	unsigned int frame_number;
+	std::unordered_map<uint32_t, NV2APBCaptureMemory> memory_captured; // Last memory captured at each offset
+	NV2APBCaptureStats frame_start_stats; // PGRAPH counters at the start of the current frame
+	uint32_t lle_captured_put; // End of the commands recorded by the last LLE pusher run
+} NV2APBCaptureWriter;
+
+static inline void nv2a_pbcapture_writer_chunk(NV2APBCaptureWriter &writer, uint32_t type, uint32_t address, uint32_t flags, const void *payload, uint32_t size)
+{
+	NV2APBCaptureChunk chunk;
+	chunk.type = type;
+	chunk.size = size;
+	chunk.address = address;
+	chunk.flags = flags;
+
+	fwrite(&chunk, sizeof(chunk), 1, writer.file);
+	fwrite(payload, size, 1, writer.file);
+}
+
+// Starts capturing frame_count frames to file (which the writer then owns)
+static inline void nv2a_pbcapture_writer_begin(NV2APBCaptureWriter &writer, FILE *file, unsigned int frame_count, uint32_t pgraph_register_count)
+{
+	NV2APBCaptureHeader header = {};
+	header.magic = NV2A_PBCAPTURE_MAGIC;
+	header.version = NV2A_PBCAPTURE_VERSION;
+	header.pgraph_register_count = pgraph_register_count;
+	fwrite(&header, sizeof(header), 1, file);
+
+	writer.file = file;
+	writer.frames_left = frame_count;
+	writer.frame_number = 0;
+	writer.memory_captured.clear();
+	writer.frame_start_stats = {};
+	writer.lle_captured_put = 0;
+}
+
+// Records the start of a frame, with the PGRAPH registers and counters at that point
+static inline void nv2a_pbcapture_writer_start_frame(NV2APBCaptureWriter &writer, const uint32_t *pgraph_regs, uint32_t pgraph_register_count, const NV2APBCaptureStats &stats)
+{
+	writer.frame_start_stats = stats;
+	nv2a_pbcapture_writer_chunk(writer, NV2A_PBCAPTURE_CHUNK_FRAME, writer.frame_number++, 0, pgraph_regs, pgraph_register_count * sizeof(uint32_t));
+}
+
+// Records the end of the current frame, with the PGRAPH counters at that
+// point. Returns true when that was the last frame to capture, in which
+// case the file is closed.
+static inline bool nv2a_pbcapture_writer_end_frame(NV2APBCaptureWriter &writer, const NV2APBCaptureStats &stats)
+{
+	NV2APBCaptureStats frame_stats;
+	frame_stats.texture_cache_hits = stats.texture_cache_hits - writer.frame_start_stats.texture_cache_hits;
+	frame_stats.texture_cache_misses = stats.texture_cache_misses - writer.frame_start_stats.texture_cache_misses;
+	frame_stats.texture_cache_revalidations = stats.texture_cache_revalidations - writer.frame_start_stats.texture_cache_revalidations;
+	frame_stats.texture_upload_bytes = stats.texture_upload_bytes - writer.frame_start_stats.texture_upload_bytes;
+	nv2a_pbcapture_writer_chunk(writer, NV2A_PBCAPTURE_CHUNK_STATS, writer.frame_number - 1, 0, &frame_stats, sizeof(frame_stats));
+
+	if (--writer.frames_left > 0) {
+		return false;
+	}
+
+	fclose(writer.file);
+	writer.file = nullptr;
+	return true;
+}
+
+static inline void nv2a_pbcapture_writer_commands(NV2APBCaptureWriter &writer, const uint32_t *words, uint32_t address, uint32_t size_in_bytes, uint32_t flags)
+{
+	nv2a_pbcapture_writer_chunk(writer, NV2A_PBCAPTURE_CHUNK_COMMANDS, address, flags, words, size_in_bytes);
+}
+
+// Records the commands an LLE pusher run is about to consume, from dma_get
+// up to dma_put in the pushbuffer at dma (of dma_len bytes). A run stops
+// early when CACHE1 fills up, and the next one continues from where it
+// stopped, so words already recorded by the previous run are skipped.
+static inline void nv2a_pbcapture_writer_lle_commands(NV2APBCaptureWriter &writer, const uint8_t *dma, uint64_t dma_len, uint32_t dma_get, uint32_t dma_put)
+{
+	uint32_t capture_get = (dma_get <= writer.lle_captured_put && writer.lle_captured_put <= dma_put) ? writer.lle_captured_put : dma_get;
+	if (capture_get < dma_put && dma_put <= dma_len) {
+		nv2a_pbcapture_writer_commands(writer, (const uint32_t *)(dma + capture_get), capture_get, dma_put - capture_get, NV2A_PBCAPTURE_COMMANDS_LLE);
+		writer.lle_captured_put = dma_put;
+	}
+}
+
+// Records memory that a draw is about to read, unless it has the same size
+// and hash as what was last recorded at its offset (draws tend to read the
+// same buffers over and over)
+static inline void nv2a_pbcapture_writer_memory(NV2APBCaptureWriter &writer, const uint8_t *data, uint32_t offset, size_t size, uint64_t hash, uint32_t flags)
+{
+	NV2APBCaptureMemory &captured = writer.memory_captured[offset];
+	if (captured.size == size && captured.hash == hash) {
+		return;
+	}
+
+	captured.size = size;
+	captured.hash = hash;
+	nv2a_pbcapture_writer_chunk(writer, NV2A_PBCAPTURE_CHUNK_MEMORY, offset, flags, data, (uint32_t)size);
+}
@@ -590,7 +590,7 @@ static QString* psh_convert(struct PixelShader *ps)
     qstring_append(vars, "vec4 v0 = pD0;\n");
     qstring_append(vars, "vec4 v1 = pD1;\n");
 
-    ps->code = qstring_new();
+    ps->code = qstring_new_sized(QSTRING_SHADER_CAPACITY);
 
     for (i = 0; i < 4; i++) {
 
@@ -778,7 +778,7 @@ static QString* psh_convert(struct PixelShader *ps)
         }
     }
 
-    QString *final = qstring_new();
+    QString *final = qstring_new_sized(QSTRING_SHADER_CAPACITY);
     qstring_append(final, "#version 330\n\n");
     qstring_append(final, qstring_get_str(preflight));
     qstring_append(final, "void main() {\n");
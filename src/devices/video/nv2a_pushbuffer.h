@@ -0,0 +1,259 @@
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+#pragma once
+
+// NV-4-style DMA pusher command parser, shared by EmuExecutePushBufferRaw
+// and the cxbxr-pbreplay tool. This header must stay free of emulator
+// (and Windows) dependencies, so that the replay tool builds standalone.
+
+#include <cstdint>
+
+typedef union {
+/* https://envytools.readthedocs.io/en/latest/hw/fifo/dma-pusher.html#the-commands-pre-gf100-format
+
+	000 CCCCCCCCCCC 00 SSS MMMMMMMMMMM 00	increasing methods [NV4+]
+	000 00000000000 10 000 00000000000 00	return [NV1A+, NV4-style only]
+	001 JJJJJJJJJJJ JJ JJJ JJJJJJJJJJJ 00	old jump [NV4+, NV4-style only]
+	010 CCCCCCCCCCC 00 SSS MMMMMMMMMMM 00	non-increasing methods [NV10+]
+	JJJ JJJJJJJJJJJ JJ JJJ JJJJJJJJJJJ 01	jump [NV1A+, NV4-style only]
+	JJJ JJJJJJJJJJJ JJ JJJ JJJJJJJJJJJ 10	call [NV1A+, NV4-style only]
+
+	C = method Count, S = Subchannel, M = first Method, J = Jump address
+*/
+	// Entire 32 bit command word, and an overlay for the above use-cases :
+	uint32_t            word;                    /*  0 .. 31 */
+	struct {
+		uint32_t        type         : 2;        /*  0 ..  1 */
+			// See https://envytools.readthedocs.io/en/latest/hw/fifo/dma-pusher.html#nv4-control-flow-commands
+				#define COMMAND_TYPE_NONE        0
+				#define COMMAND_TYPE_JUMP_LONG   1
+				#define COMMAND_TYPE_CALL        2
+		uint32_t        method       : 11;       /*  2 .. 12 */
+		uint32_t        subchannel   : 3;        /* 13 .. 15 */
+		uint32_t        flags        : 2;        /* 16 .. 17 */
+			// See https://envytools.readthedocs.io/en/latest/hw/fifo/dma-pusher.html#nv4-method-submission-commands
+				#define COMMAND_FLAGS_NONE                         0
+				#define COMMAND_FLAGS_SLI_CONDITIONAL              1 // (NV40+)
+				#define COMMAND_FLAGS_RETURN                       2
+				#define COMMAND_FLAGS_LONG_NON_INCREASING_METHODS  3 // [IB-mode only]
+		uint32_t        method_count : 11;       /* 18 .. 28 */
+		uint32_t        instruction  : 3;        /* 29 .. 31 */
+				#define COMMAND_INSTRUCTION_INCREASING_METHODS     0
+				#define COMMAND_INSTRUCTION_JUMP                   1
+				#define COMMAND_INSTRUCTION_NON_INCREASING_METHODS 2
+	};
+	#define COMMAND_WORD_MASK_JUMP      0x1FFFFFFC /*  2 .. 31 */
+	#define COMMAND_WORD_MASK_JUMP_LONG 0xFFFFFFFC /*  2 .. 28 */
+} nv_fifo_command;
+
+// Noteworthy situations encountered by nv2a_pushbuffer_run. The ones
+// marked 'aborts' make the parser stop processing the pushbuffer.
+typedef enum {
+	NV_PUSHER_EVENT_END_OF_DATA_EXCEEDED,      // aborts
+	NV_PUSHER_EVENT_JUMP_LONG,
+	NV_PUSHER_EVENT_CALL,
+	NV_PUSHER_EVENT_CALL_WHILE_ACTIVE,         // aborts
+	NV_PUSHER_EVENT_UNKNOWN_TYPE,              // aborts
+	NV_PUSHER_EVENT_JUMP,
+	NV_PUSHER_EVENT_UNKNOWN_INSTRUCTION,       // aborts
+	NV_PUSHER_EVENT_RETURN,
+	NV_PUSHER_EVENT_RETURN_EXTRA_BITS,         // aborts
+	NV_PUSHER_EVENT_RETURN_WHILE_INACTIVE,     // aborts
+	NV_PUSHER_EVENT_SLI_CONDITIONAL,           // aborts
+	NV_PUSHER_EVENT_LONG_NON_INCREASING,       // aborts
+	NV_PUSHER_EVENT_UNKNOWN_FLAGS,             // aborts
+	NV_PUSHER_EVENT_JUMP_TARGET_UNAVAILABLE,   // aborts
+} nv_pusher_event;
+
+// DMA Pusher state -- see https://envytools.readthedocs.io/en/latest/hw/fifo/dma-pusher.html#pusher-state
+typedef struct {
+	struct {
+		uint32_t mthd; // Current method
+		uint32_t subc; // :3 = Current subchannel
+		uint32_t mcnt; // :24 = Current method count
+		bool ni; // Current command's NI (non-increasing) flag
+	} dma_state;
+
+	uint32_t dcount_shadow; // [NV5:] Number of already-processed methods in cmd]
+	bool subr_active; // Subroutine active
+	uint32_t *subr_return; // Subroutine return address
+	// bool big_endian; // Pushbuffer endian switch
+
+	// DMA troubleshooting values -- see https://envytools.readthedocs.io/en/latest/hw/fifo/dma-pusher.html#errors
+	uint32_t *dma_get_jmp_shadow; // value of dma_get before the last jump
+	uint32_t rsvd_shadow; // the first word of last-read command
+	uint32_t data_shadow; // the last-read data word
+} nv_pusher_state;
+
+// Runs the NV-4-style PFIFO DMA command stream pusher over [dma_get, dma_put).
+// See https://envytools.readthedocs.io/en/latest/hw/fifo/dma-pusher.html#the-pusher-pseudocode-pre-gf100
+//
+// The Handler type must provide :
+//   void Method(uint32_t subc, uint32_t mthd, uint32_t word, bool ni); // mthd is a DWORD index (not multiplied by four)
+//   uint32_t *JumpTarget(uint32_t address); // translates a jump/call address, nullptr when not available
+//   void Event(nv_pusher_event event);
+//
+// Returns false when parsing was aborted.
+template<class Handler>
+bool nv2a_pushbuffer_run(nv_pusher_state &state, uint32_t *dma_get, uint32_t *dma_put, uint32_t *dma_limit, Handler &handler)
+{
+	// Overlay, to ease decoding the PFIFO command word
+	nv_fifo_command command;
+
+	state.dma_state = {};
+
+	while (dma_get != dma_put) {
+		// Check if loop reaches end of pushbuffer
+		if (dma_get >= dma_limit) {
+			// TODO : throw DMA_PUSHER(MEM_FAULT);
+			handler.Event(NV_PUSHER_EVENT_END_OF_DATA_EXCEEDED);
+			return false; // For now, don't even attempt to run through
+		}
+
+		// Read a DWORD from the current push buffer pointer
+		command.word = *dma_get++;
+		/* now, see if we're in the middle of a command */
+		if (state.dma_state.mcnt) {
+			/* data word of methods command */
+			state.data_shadow = command.word;
+#if 0
+			if (!PULLER_KNOWS_MTHD(state.dma_state.mthd)) {
+				throw DMA_PUSHER(INVALID_MTHD);
+				return false; // For now, don't even attempt to run through
+			}
+#endif
+			handler.Method(state.dma_state.subc, state.dma_state.mthd, command.word, state.dma_state.ni);
+			if (!state.dma_state.ni) {
+				state.dma_state.mthd++;
+			}
+
+			state.dma_state.mcnt--;
+			state.dcount_shadow++;
+			continue; // while
+		}
+
+		/* no command active - this is the first word of a new one */
+		state.rsvd_shadow = command.word;
+		// Check and handle command type, then instruction, then flags
+		switch (command.type) {
+		case COMMAND_TYPE_NONE:
+			break; // fall through
+		case COMMAND_TYPE_JUMP_LONG:
+			handler.Event(NV_PUSHER_EVENT_JUMP_LONG);
+			state.dma_get_jmp_shadow = dma_get;
+			dma_get = handler.JumpTarget(command.word & COMMAND_WORD_MASK_JUMP_LONG);
+			if (dma_get == nullptr) {
+				handler.Event(NV_PUSHER_EVENT_JUMP_TARGET_UNAVAILABLE);
+				return false;
+			}
+			continue; // while
+		case COMMAND_TYPE_CALL: // Note : NV2A return is said not to work?
+			if (state.subr_active) {
+				// TODO : throw DMA_PUSHER(CALL_SUBR_ACTIVE);
+				handler.Event(NV_PUSHER_EVENT_CALL_WHILE_ACTIVE);
+				return false; // For now, don't even attempt to run through
+			}
+
+			handler.Event(NV_PUSHER_EVENT_CALL);
+			state.subr_return = dma_get;
+			state.subr_active = true;
+			dma_get = handler.JumpTarget(command.word & COMMAND_WORD_MASK_JUMP_LONG);
+			if (dma_get == nullptr) {
+				handler.Event(NV_PUSHER_EVENT_JUMP_TARGET_UNAVAILABLE);
+				return false;
+			}
+			continue; // while
+		default:
+			// TODO : throw DMA_PUSHER(INVALID_CMD);
+			handler.Event(NV_PUSHER_EVENT_UNKNOWN_TYPE);
+			return false; // For now, don't even attempt to run through
+		} // switch type
+
+		switch (command.instruction) {
+		case COMMAND_INSTRUCTION_INCREASING_METHODS:
+			state.dma_state.ni = false;
+			break;
+		case COMMAND_INSTRUCTION_JUMP:
+			handler.Event(NV_PUSHER_EVENT_JUMP);
+			state.dma_get_jmp_shadow = dma_get;
+			dma_get = handler.JumpTarget(command.word & COMMAND_WORD_MASK_JUMP);
+			if (dma_get == nullptr) {
+				handler.Event(NV_PUSHER_EVENT_JUMP_TARGET_UNAVAILABLE);
+				return false;
+			}
+			continue; // while
+		case COMMAND_INSTRUCTION_NON_INCREASING_METHODS:
+			state.dma_state.ni = true;
+			break;
+		default:
+			// TODO : throw DMA_PUSHER(INVALID_CMD);
+			handler.Event(NV_PUSHER_EVENT_UNKNOWN_INSTRUCTION);
+			return false; // For now, don't even attempt to run through
+		} // switch instruction
+
+		switch (command.flags) {
+		case COMMAND_FLAGS_NONE: // Decode push buffer method & size (inverse of D3DPUSH_ENCODE)
+			state.dma_state.mthd = command.method;
+			state.dma_state.subc = command.subchannel;
+			state.dma_state.mcnt = command.method_count;
+			break; // fall through
+		case COMMAND_FLAGS_RETURN: // Note : NV2A return is said not to work?
+			if (command.word != 0x00020000) {
+				handler.Event(NV_PUSHER_EVENT_RETURN_EXTRA_BITS);
+				return false; // For now, don't even attempt to run through
+			}
+
+			handler.Event(NV_PUSHER_EVENT_RETURN);
+			if (!state.subr_active) {
+				// TODO : throw DMA_PUSHER(RET_SUBR_INACTIVE);
+				handler.Event(NV_PUSHER_EVENT_RETURN_WHILE_INACTIVE);
+				return false; // For now, don't even attempt to run through
+			}
+
+			dma_get = state.subr_return;
+			state.subr_active = false;
+			continue; // while
+		default:
+			if (command.flags == COMMAND_FLAGS_SLI_CONDITIONAL) {
+				handler.Event(NV_PUSHER_EVENT_SLI_CONDITIONAL);
+			} else if (command.flags == COMMAND_FLAGS_LONG_NON_INCREASING_METHODS) {
+				/// No need to do: state.dma_state.mthd = command.method; state.dma_state.ni = true;
+				/// state.dma_state.mcnt = *dma_get++ & 0x00FFFFFF; // Long NI method command count is read from low 24 bits of next word
+				/// dma_get += state.dma_state.mcnt; // To be safe, skip method data
+				/// continue;
+				handler.Event(NV_PUSHER_EVENT_LONG_NON_INCREASING);
+			} else {
+				handler.Event(NV_PUSHER_EVENT_UNKNOWN_FLAGS);
+			}
+
+			/// dma_get += command.method_count; // To be safe, skip method data
+			/// continue;
+			// TODO : throw DMA_PUSHER(INVALID_CMD);
+			return false; // For now, don't even attempt to run through
+		} // switch flags
+
+		state.dcount_shadow = 0;
+	} // while (dma_get != dma_put)
+
+	return true;
+}
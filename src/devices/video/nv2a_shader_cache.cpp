@@ -0,0 +1,425 @@
+/*
+ * QEMU Geforce NV2A shader cache
+ *
+ * Copyright (c) 2015 espes
+ * Copyright (c) 2015 Jannik Vogel
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define LOG_PREFIX CXBXR_MODULE::NV2A
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <filesystem>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "nv2a_debug.h"
+#include "nv2a_shader_cache.h"
+#include "common\util\hasher.h" // For ComputeHash
+#include "Logging.h"
+
+// Enable to record each distinct ShaderState to the corpus for cxbxr-shaderbench
+//#define NV2A_RECORD_SHADER_STATES
+
+/* Program binary file : a ProgramBinaryHeader, followed by the binary */
+#define NV2A_PROGRAM_BINARY_MAGIC 0x50584243 /* "CBXP" */
+
+typedef struct ProgramBinaryHeader {
+    uint32_t magic;
+    uint32_t binary_format; /* as returned by glGetProgramBinary */
+    uint32_t binary_length;
+    uint32_t reserved;
+    uint64_t sources_hash;
+} ProgramBinaryHeader;
+
+static std::string g_shader_cache_path; /* empty when disabled */
+static bool g_program_binaries_supported = false;
+static FILE *g_shader_corpus_file = NULL;
+static std::unordered_set<uint64_t> g_shader_corpus_hashes; /* of the states in the corpus */
+
+static uint64_t shader_state_hash(const ShaderState *state)
+{
+    return ComputeHash((void*)state, sizeof(ShaderState));
+}
+
+GLuint create_gl_shader(GLenum gl_shader_type,
+                        const char *code,
+                        const char *name)
+{
+    GLint compiled = 0;
+
+    NV2A_GL_DGROUP_BEGIN("Creating new %s", name);
+
+    NV2A_DPRINTF("compile new %s, code:\n%s\n", name, code);
+
+    GLuint shader = glCreateShader(gl_shader_type);
+    glShaderSource(shader, 1, &code, NULL);
+    glCompileShader(shader);
+
+    /* Check it compiled */
+    compiled = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled) {
+        GLchar* log;
+        GLint log_length;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_length);
+        log = (GLchar*)malloc(log_length * sizeof(GLchar));
+        glGetShaderInfoLog(shader, log_length, NULL, log);
+        fprintf(stderr, "nv2a: %s compilation failed: %s\n", name, log);
+        free(log);
+
+        NV2A_GL_DGROUP_END();
+        abort();
+    }
+
+    NV2A_GL_DGROUP_END();
+
+    return shader;
+}
+
+void shader_cache_init(const char *path)
+{
+    g_shader_cache_path.clear();
+    if (path == NULL) {
+        return;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(path, error);
+    if (!std::filesystem::is_directory(path, error)) {
+        EmuLog(LOG_LEVEL::WARNING, "Couldn't create shader cache folder %s", path);
+        return;
+    }
+
+    g_shader_cache_path = path;
+
+    GLint binary_format_count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binary_format_count);
+    g_program_binaries_supported = (binary_format_count > 0);
+    if (!g_program_binaries_supported) {
+        EmuLog(LOG_LEVEL::INFO, "Program binaries aren't supported, shaders will be compiled on every run");
+    }
+
+#ifdef NV2A_RECORD_SHADER_STATES
+    /* Keep appending to the corpus of an earlier run of the same build,
+     * skipping the states it already holds */
+    std::string corpus_path = g_shader_cache_path + NV2A_SHADER_CORPUS_FILENAME;
+    ShaderCorpusHeader header = {};
+    FILE *f = fopen(corpus_path.c_str(), "rb");
+    bool matches = false;
+    g_shader_corpus_hashes.clear();
+    if (f != NULL) {
+        matches = fread(&header, sizeof(header), 1, f) == 1
+            && header.magic == NV2A_SHADER_CORPUS_MAGIC
+            && header.state_size == sizeof(ShaderState);
+        if (matches) {
+            ShaderState state;
+            while (fread(&state, sizeof(state), 1, f) == 1) {
+                g_shader_corpus_hashes.insert(shader_state_hash(&state));
+            }
+        }
+        fclose(f);
+    }
+
+    if (matches) {
+        g_shader_corpus_file = fopen(corpus_path.c_str(), "ab");
+    } else {
+        g_shader_corpus_file = fopen(corpus_path.c_str(), "wb");
+        if (g_shader_corpus_file != NULL) {
+            header.magic = NV2A_SHADER_CORPUS_MAGIC;
+            header.state_size = sizeof(ShaderState);
+            fwrite(&header, sizeof(header), 1, g_shader_corpus_file);
+        }
+    }
+#endif
+}
+
+void shader_cache_shutdown(void)
+{
+    if (g_shader_corpus_file != NULL) {
+        fclose(g_shader_corpus_file);
+        g_shader_corpus_file = NULL;
+    }
+
+    g_shader_corpus_hashes.clear();
+}
+
+void shader_cache_record_state(const ShaderState *state)
+{
+    if (g_shader_corpus_file == NULL) {
+        return;
+    }
+
+    if (!g_shader_corpus_hashes.insert(shader_state_hash(state)).second) {
+        return;
+    }
+
+    /* Written out when the buffer fills up, or at shutdown */
+    fwrite(state, sizeof(ShaderState), 1, g_shader_corpus_file);
+}
+
+static uint64_t shader_sources_hash(const ShaderSources *sources)
+{
+    /* The geometry shader is optional, so separate the sources */
+    std::string all;
+    all.reserve(sources->geometry.size() + sources->vertex.size() + sources->fragment.size() + 2);
+    all += sources->geometry;
+    all += '\0';
+    all += sources->vertex;
+    all += '\0';
+    all += sources->fragment;
+
+    return ComputeHash((void*)all.data(), all.size());
+}
+
+static std::string program_binary_path(uint64_t sources_hash)
+{
+    char filename[32];
+    snprintf(filename, sizeof(filename), "%016llx.bin", (unsigned long long)sources_hash);
+    return g_shader_cache_path + filename;
+}
+
+static GLuint load_program_binary(uint64_t sources_hash)
+{
+    FILE *f = fopen(program_binary_path(sources_hash).c_str(), "rb");
+    if (f == NULL) {
+        return 0;
+    }
+
+    ProgramBinaryHeader header;
+    std::vector<uint8_t> binary;
+    bool read = fread(&header, sizeof(header), 1, f) == 1
+        && header.magic == NV2A_PROGRAM_BINARY_MAGIC
+        && header.sources_hash == sources_hash;
+    if (read) {
+        binary.resize(header.binary_length);
+        read = header.binary_length > 0
+            && fread(binary.data(), header.binary_length, 1, f) == 1;
+    }
+    fclose(f);
+
+    if (!read) {
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.binary_format, binary.data(), header.binary_length);
+
+    /* Binaries are rejected after driver updates, these get recompiled */
+    GLint linked = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    return program;
+}
+
+static void store_program_binary(GLuint program, uint64_t sources_hash)
+{
+    GLint binary_length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binary_length);
+    if (binary_length <= 0) {
+        return;
+    }
+
+    ProgramBinaryHeader header = {};
+    std::vector<uint8_t> binary(binary_length);
+    GLenum binary_format;
+    glGetProgramBinary(program, binary_length, NULL, &binary_format, binary.data());
+
+    header.magic = NV2A_PROGRAM_BINARY_MAGIC;
+    header.binary_format = binary_format;
+    header.binary_length = binary_length;
+    header.sources_hash = sources_hash;
+
+    FILE *f = fopen(program_binary_path(sources_hash).c_str(), "wb");
+    if (f == NULL) {
+        return;
+    }
+
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(binary.data(), binary_length, 1, f);
+    fclose(f);
+}
+
+static GLuint link_program(const ShaderSources *sources)
+{
+    int i;
+    char tmp[64];
+
+    GLuint program = glCreateProgram();
+    GLuint shaders[3];
+    int shader_count = 0;
+
+    if (!sources->geometry.empty()) {
+        shaders[shader_count++] = create_gl_shader(GL_GEOMETRY_SHADER,
+                                                   sources->geometry.c_str(),
+                                                   "geometry shader");
+    }
+
+    shaders[shader_count++] = create_gl_shader(GL_VERTEX_SHADER,
+                                               sources->vertex.c_str(),
+                                               "vertex shader");
+
+    shaders[shader_count++] = create_gl_shader(GL_FRAGMENT_SHADER,
+                                               sources->fragment.c_str(),
+                                               "fragment shader");
+
+    for (i = 0; i < shader_count; i++) {
+        glAttachShader(program, shaders[i]);
+    }
+
+    /* Bind attributes for vertices */
+    for(i = 0; i < NV2A_VERTEXSHADER_ATTRIBUTES; i++) {
+        snprintf(tmp, sizeof(tmp), "v%d", i);
+        glBindAttribLocation(program, i, tmp);
+    }
+
+    if (g_program_binaries_supported) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    /* link the program */
+    glLinkProgram(program);
+    GLint linked = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if(!linked) {
+        GLchar log[2048];
+        glGetProgramInfoLog(program, 2048, NULL, log);
+        fprintf(stderr, "nv2a: shader linking failed: %s\n", log);
+        abort();
+    }
+
+    /* The program keeps the shaders alive as long as it needs them */
+    for (i = 0; i < shader_count; i++) {
+        glDetachShader(program, shaders[i]);
+        glDeleteShader(shaders[i]);
+    }
+
+    return program;
+}
+
+ShaderBinding* shader_cache_create_binding(const ShaderSources *sources)
+{
+    int i, j;
+    char tmp[64];
+
+    GLuint program = 0;
+    uint64_t sources_hash = 0;
+
+    if (g_program_binaries_supported) {
+        sources_hash = shader_sources_hash(sources);
+        program = load_program_binary(sources_hash);
+    }
+
+    if (program == 0) {
+        program = link_program(sources);
+
+        if (g_program_binaries_supported) {
+            store_program_binary(program, sources_hash);
+        }
+    }
+
+    glUseProgram(program);
+
+    /* set texture samplers */
+    for (i = 0; i < NV2A_MAX_TEXTURES; i++) {
+        char samplerName[16];
+        snprintf(samplerName, sizeof(samplerName), "texSamp%d", i);
+        GLint texSampLoc = glGetUniformLocation(program, samplerName);
+        if (texSampLoc >= 0) {
+            glUniform1i(texSampLoc, i);
+        }
+    }
+
+    /* validate the program */
+    glValidateProgram(program);
+    GLint valid = 0;
+    glGetProgramiv(program, GL_VALIDATE_STATUS, &valid);
+    if (!valid) {
+        GLchar log[1024];
+        glGetProgramInfoLog(program, 1024, NULL, log);
+        fprintf(stderr, "nv2a: shader validation failed: %s\n", log);
+        abort();
+    }
+
+    ShaderBinding* ret = (ShaderBinding*)malloc(sizeof(ShaderBinding));
+    ret->gl_program = program;
+    ret->gl_primitive_mode = sources->gl_primitive_mode;
+
+    /* lookup fragment shader uniforms */
+    for (i=0; i<=8; i++) {
+        for (j=0; j<2; j++) {
+            snprintf(tmp, sizeof(tmp), "c_%d_%d", i, j);
+            ret->psh_constant_loc[i][j] = glGetUniformLocation(program, tmp);
+        }
+    }
+    ret->alpha_ref_loc = glGetUniformLocation(program, "alphaRef");
+    for (i = 1; i < NV2A_MAX_TEXTURES; i++) {
+        snprintf(tmp, sizeof(tmp), "bumpMat%d", i);
+        ret->bump_mat_loc[i] = glGetUniformLocation(program, tmp);
+        snprintf(tmp, sizeof(tmp), "bumpScale%d", i);
+        ret->bump_scale_loc[i] = glGetUniformLocation(program, tmp);
+        snprintf(tmp, sizeof(tmp), "bumpOffset%d", i);
+        ret->bump_offset_loc[i] = glGetUniformLocation(program, tmp);
+    }
+
+    /* lookup vertex shader uniforms */
+    for(i = 0; i < NV2A_VERTEXSHADER_CONSTANTS; i++) {
+        snprintf(tmp, sizeof(tmp), "c[%d]", i);
+        ret->vsh_constant_loc[i] = glGetUniformLocation(program, tmp);
+    }
+    ret->surface_size_loc = glGetUniformLocation(program, "surfaceSize");
+    ret->clip_range_loc = glGetUniformLocation(program, "clipRange");
+    ret->fog_color_loc = glGetUniformLocation(program, "fogColor");
+    ret->fog_param_loc[0] = glGetUniformLocation(program, "fogParam[0]");
+    ret->fog_param_loc[1] = glGetUniformLocation(program, "fogParam[1]");
+
+    ret->inv_viewport_loc = glGetUniformLocation(program, "invViewport");
+    for (i = 0; i < NV2A_LTCTXA_COUNT; i++) {
+        snprintf(tmp, sizeof(tmp), "ltctxa[%d]", i);
+        ret->ltctxa_loc[i] = glGetUniformLocation(program, tmp);
+    }
+    for (i = 0; i < NV2A_LTCTXB_COUNT; i++) {
+        snprintf(tmp, sizeof(tmp), "ltctxb[%d]", i);
+        ret->ltctxb_loc[i] = glGetUniformLocation(program, tmp);
+    }
+    for (i = 0; i < NV2A_LTC1_COUNT; i++) {
+        snprintf(tmp, sizeof(tmp), "ltc1[%d]", i);
+        ret->ltc1_loc[i] = glGetUniformLocation(program, tmp);
+    }
+    for (i = 0; i < NV2A_MAX_LIGHTS; i++) {
+        snprintf(tmp, sizeof(tmp), "lightInfiniteHalfVector%d", i);
+        ret->light_infinite_half_vector_loc[i] = glGetUniformLocation(program, tmp);
+        snprintf(tmp, sizeof(tmp), "lightInfiniteDirection%d", i);
+        ret->light_infinite_direction_loc[i] = glGetUniformLocation(program, tmp);
+
+        snprintf(tmp, sizeof(tmp), "lightLocalPosition%d", i);
+        ret->light_local_position_loc[i] = glGetUniformLocation(program, tmp);
+        snprintf(tmp, sizeof(tmp), "lightLocalAttenuation%d", i);
+        ret->light_local_attenuation_loc[i] = glGetUniformLocation(program, tmp);
+    }
+    for (i = 0; i < 8; i++) {
+        snprintf(tmp, sizeof(tmp), "clipRegion[%d]", i);
+        ret->clip_region_loc[i] = glGetUniformLocation(program, tmp);
+    }
+
+    return ret;
+}
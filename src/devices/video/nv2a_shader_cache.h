@@ -0,0 +1,50 @@
+/*
+ * QEMU Geforce NV2A shader cache
+ *
+ * Copyright (c) 2015 espes
+ * Copyright (c) 2015 Jannik Vogel
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HW_NV2A_SHADER_CACHE_H
+#define HW_NV2A_SHADER_CACHE_H
+
+#include "nv2a_shaders.h"
+
+/* The LLE shader cache has two levels : PGRAPH maps each ShaderState to a
+ * ShaderBinding in memory, and on a miss, generates the GLSL sources and
+ * hands them to shader_cache_create_binding. That one keeps the linked
+ * programs on disk as program binaries (when the driver supports them),
+ * keyed by a hash of the sources, so later runs skip compiling them. */
+
+/* Sets the folder used for program binaries and the ShaderState corpus
+ * (only recorded when NV2A_RECORD_SHADER_STATES is defined);
+ * NULL disables both. Must be called with the OpenGL context current. */
+void shader_cache_init(const char *path);
+void shader_cache_shutdown(void);
+
+/* Loads the program binary for the given sources, or compiles and links
+ * them (and stores the program binary for next time) */
+ShaderBinding* shader_cache_create_binding(const ShaderSources *sources);
+
+/* Compiles a single shader, aborts on failure */
+GLuint create_gl_shader(GLenum gl_shader_type,
+                        const char *code,
+                        const char *name);
+
+/* Appends the state to the corpus for cxbxr-shaderbench, unless it's already in there */
+void shader_cache_record_state(const ShaderState *state);
+
+#endif
@@ -641,6 +641,7 @@ GLSL_DEFINE(texMat3, GLSL_C_MAT4(NV_IGRAPH_XF_XFCTX_T3MAT))
 "vec4 oT3 = vec4(0.0,0.0,0.0,1.0);\n"
 "\n"
 STRUCT_VERTEX_DATA);
+    qstring_reserve(header, QSTRING_SHADER_CAPACITY);
 
     qstring_append_fmt(header, "noperspective out VertexData %c_vtx;\n",
                        vtx_prefix);
@@ -653,6 +654,7 @@ STRUCT_VERTEX_DATA);
     qstring_append(header, "\n");
 
     QString *body = qstring_from_str("void main() {\n");
+    qstring_reserve(body, QSTRING_SHADER_CAPACITY);
 
     if (state.fixed_function) {
         generate_fixed_function(state, header, body);
@@ -764,198 +766,37 @@ STRUCT_VERTEX_DATA);
 
 }
 
-/*static*/ GLuint create_gl_shader(GLenum gl_shader_type,
-                               const char *code,
-                               const char *name)
+void generate_shader_sources(const ShaderState *state, ShaderSources *sources)
 {
-    GLint compiled = 0;
-
-    NV2A_GL_DGROUP_BEGIN("Creating new %s", name);
-
-    NV2A_DPRINTF("compile new %s, code:\n%s\n", name, code);
-
-    GLuint shader = glCreateShader(gl_shader_type);
-    glShaderSource(shader, 1, &code, NULL);
-    glCompileShader(shader);
-
-    /* Check it compiled */
-    compiled = 0;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
-    if (!compiled) {
-        GLchar* log;
-        GLint log_length;
-        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_length);
-        log = (GLchar*)malloc(log_length * sizeof(GLchar));
-        glGetShaderInfoLog(shader, log_length, NULL, log);
-        fprintf(stderr, "nv2a: %s compilation failed: %s\n", name, log);
-        free(log);
-
-        NV2A_GL_DGROUP_END();
-        abort();
-    }
-
-    NV2A_GL_DGROUP_END();
-
-    return shader;
-}
-
-ShaderBinding* generate_shaders(const ShaderState state)
-{
-    int i, j;
-    char tmp[64];
-
     char vtx_prefix;
-    GLuint program = glCreateProgram();
 
     /* Create an option geometry shader and find primitive type */
 
-    GLenum gl_primitive_mode;
     QString* geometry_shader_code =
-        generate_geometry_shader(state.polygon_front_mode,
-                                 state.polygon_back_mode,
-                                 state.primitive_mode,
-                                 &gl_primitive_mode);
+        generate_geometry_shader(state->polygon_front_mode,
+                                 state->polygon_back_mode,
+                                 state->primitive_mode,
+                                 &sources->gl_primitive_mode);
     if (geometry_shader_code) {
-        const char* geometry_shader_code_str =
-             qstring_get_str(geometry_shader_code);
-
-        GLuint geometry_shader = create_gl_shader(GL_GEOMETRY_SHADER,
-                                                  geometry_shader_code_str,
-                                                  "geometry shader");
-        glAttachShader(program, geometry_shader);
-
-        qobject_unref(geometry_shader_code);
+        sources->geometry.swap(*geometry_shader_code);
+        delete geometry_shader_code;
 
         vtx_prefix = 'v';
     } else {
+        sources->geometry.clear();
+
         vtx_prefix = 'g';
     }
 
     /* create the vertex shader */
 
-    QString *vertex_shader_code = generate_vertex_shader(state, vtx_prefix);
-    GLuint vertex_shader = create_gl_shader(GL_VERTEX_SHADER,
-                                            qstring_get_str(vertex_shader_code),
-                                            "vertex shader");
-    glAttachShader(program, vertex_shader);
-    qobject_unref(vertex_shader_code);
-
-
-    /* Bind attributes for vertices */
-    for(i = 0; i < NV2A_VERTEXSHADER_ATTRIBUTES; i++) {
-        snprintf(tmp, sizeof(tmp), "v%d", i);
-        glBindAttribLocation(program, i, tmp);
-    }
-
+    QString *vertex_shader_code = generate_vertex_shader(*state, vtx_prefix);
+    sources->vertex.swap(*vertex_shader_code);
+    delete vertex_shader_code;
 
     /* generate a fragment shader from register combiners */
 
-    QString *fragment_shader_code = psh_translate(state.psh);
-
-    const char *fragment_shader_code_str = qstring_get_str(fragment_shader_code);
-
-    GLuint fragment_shader = create_gl_shader(GL_FRAGMENT_SHADER,
-                                              fragment_shader_code_str,
-                                              "fragment shader");
-    glAttachShader(program, fragment_shader);
-
-    qobject_unref(fragment_shader_code);
-
-
-    /* link the program */
-    glLinkProgram(program);
-    GLint linked = 0;
-    glGetProgramiv(program, GL_LINK_STATUS, &linked);
-    if(!linked) {
-        GLchar log[2048];
-        glGetProgramInfoLog(program, 2048, NULL, log);
-        fprintf(stderr, "nv2a: shader linking failed: %s\n", log);
-        abort();
-    }
-
-    glUseProgram(program);
-
-    /* set texture samplers */
-    for (i = 0; i < NV2A_MAX_TEXTURES; i++) {
-        char samplerName[16];
-        snprintf(samplerName, sizeof(samplerName), "texSamp%d", i);
-        GLint texSampLoc = glGetUniformLocation(program, samplerName);
-        if (texSampLoc >= 0) {
-            glUniform1i(texSampLoc, i);
-        }
-    }
-
-    /* validate the program */
-    glValidateProgram(program);
-    GLint valid = 0;
-    glGetProgramiv(program, GL_VALIDATE_STATUS, &valid);
-    if (!valid) {
-        GLchar log[1024];
-        glGetProgramInfoLog(program, 1024, NULL, log);
-        fprintf(stderr, "nv2a: shader validation failed: %s\n", log);
-        abort();
-    }
-
-    ShaderBinding* ret = (ShaderBinding*)malloc(sizeof(ShaderBinding));
-    ret->gl_program = program;
-    ret->gl_primitive_mode = gl_primitive_mode;
-
-    /* lookup fragment shader uniforms */
-    for (i=0; i<=8; i++) {
-        for (j=0; j<2; j++) {
-            snprintf(tmp, sizeof(tmp), "c_%d_%d", i, j);
-            ret->psh_constant_loc[i][j] = glGetUniformLocation(program, tmp);
-        }
-    }
-    ret->alpha_ref_loc = glGetUniformLocation(program, "alphaRef");
-    for (i = 1; i < NV2A_MAX_TEXTURES; i++) {
-        snprintf(tmp, sizeof(tmp), "bumpMat%d", i);
-        ret->bump_mat_loc[i] = glGetUniformLocation(program, tmp);
-        snprintf(tmp, sizeof(tmp), "bumpScale%d", i);
-        ret->bump_scale_loc[i] = glGetUniformLocation(program, tmp);
-        snprintf(tmp, sizeof(tmp), "bumpOffset%d", i);
-        ret->bump_offset_loc[i] = glGetUniformLocation(program, tmp);
-    }
-
-    /* lookup vertex shader uniforms */
-    for(i = 0; i < NV2A_VERTEXSHADER_CONSTANTS; i++) {
-        snprintf(tmp, sizeof(tmp), "c[%d]", i);
-        ret->vsh_constant_loc[i] = glGetUniformLocation(program, tmp);
-    }
-    ret->surface_size_loc = glGetUniformLocation(program, "surfaceSize");
-    ret->clip_range_loc = glGetUniformLocation(program, "clipRange");
-    ret->fog_color_loc = glGetUniformLocation(program, "fogColor");
-    ret->fog_param_loc[0] = glGetUniformLocation(program, "fogParam[0]");
-    ret->fog_param_loc[1] = glGetUniformLocation(program, "fogParam[1]");
-
-    ret->inv_viewport_loc = glGetUniformLocation(program, "invViewport");
-    for (i = 0; i < NV2A_LTCTXA_COUNT; i++) {
-        snprintf(tmp, sizeof(tmp), "ltctxa[%d]", i);
-        ret->ltctxa_loc[i] = glGetUniformLocation(program, tmp);
-    }
-    for (i = 0; i < NV2A_LTCTXB_COUNT; i++) {
-        snprintf(tmp, sizeof(tmp), "ltctxb[%d]", i);
-        ret->ltctxb_loc[i] = glGetUniformLocation(program, tmp);
-    }
-    for (i = 0; i < NV2A_LTC1_COUNT; i++) {
-        snprintf(tmp, sizeof(tmp), "ltc1[%d]", i);
-        ret->ltc1_loc[i] = glGetUniformLocation(program, tmp);
-    }
-    for (i = 0; i < NV2A_MAX_LIGHTS; i++) {
-        snprintf(tmp, sizeof(tmp), "lightInfiniteHalfVector%d", i);
-        ret->light_infinite_half_vector_loc[i] = glGetUniformLocation(program, tmp);
-        snprintf(tmp, sizeof(tmp), "lightInfiniteDirection%d", i);
-        ret->light_infinite_direction_loc[i] = glGetUniformLocation(program, tmp);
-
-        snprintf(tmp, sizeof(tmp), "lightLocalPosition%d", i);
-        ret->light_local_position_loc[i] = glGetUniformLocation(program, tmp);
-        snprintf(tmp, sizeof(tmp), "lightLocalAttenuation%d", i);
-        ret->light_local_attenuation_loc[i] = glGetUniformLocation(program, tmp);
-    }
-    for (i = 0; i < 8; i++) {
-        snprintf(tmp, sizeof(tmp), "clipRegion[%d]", i);
-        ret->clip_region_loc[i] = glGetUniformLocation(program, tmp);
-    }
-
-    return ret;
+    QString *fragment_shader_code = psh_translate(state->psh);
+    sources->fragment.swap(*fragment_shader_code);
+    delete fragment_shader_code;
 }
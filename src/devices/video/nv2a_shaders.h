@@ -22,7 +22,7 @@
 #define HW_NV2A_SHADERS_H
 
 #include "qstring.h"
-#include "common\util\gloffscreen\gloffscreen.h" // For GLenum, etc
+#include <GL/glew.h> // For GLenum, etc
 
 #include "nv2a_vsh.h"
 #include "nv2a_psh.h"
@@ -110,6 +110,24 @@ typedef struct ShaderBinding {
     GLint clip_region_loc[8];
 } ShaderBinding;
 
-ShaderBinding* generate_shaders(const ShaderState state);
+typedef struct ShaderSources {
+    QString geometry; /* empty when no geometry shader is needed */
+    QString vertex;
+    QString fragment;
+    GLenum gl_primitive_mode;
+} ShaderSources;
+
+/* Generates the GLSL for the given state; doesn't need an OpenGL context */
+void generate_shader_sources(const ShaderState *state, ShaderSources *sources);
+
+/* Recorded ShaderState corpus (see shader_cache_record_state) : a
+ * ShaderCorpusHeader, followed by raw ShaderState structures */
+#define NV2A_SHADER_CORPUS_FILENAME "shader_states.bin"
+#define NV2A_SHADER_CORPUS_MAGIC 0x53584243 /* "CBXS" */
+
+typedef struct ShaderCorpusHeader {
+    uint32_t magic;
+    uint32_t state_size; /* sizeof(ShaderState), corpora only match the build that recorded them */
+} ShaderCorpusHeader;
 
 #endif
@@ -0,0 +1,171 @@
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+#pragma once
+
+// Generation based validation of cached textures, shared by
+// pgraph_bind_textures and the cxbxr-pbreplay tool (so that replays count
+// texture cache hits and misses exactly like the emulator does). Like
+// nv2a_pushbuffer.h, this header must stay free of emulator (and Windows)
+// dependencies.
+//
+// Guest memory writes are tracked per page : PGRAPH marks its own writes
+// (surface downloads, blits), CPU writes are reported by nv2a_write_watch.
+// Cached textures on pages written since their last validation are hashed
+// again, and only uploaded again when their data really changed.
+//
+// The write watch only sees writes through the contiguous view of guest
+// memory, not through the other views of the same pages (the user virtual
+// addresses titles write textures through, the 0xF0000000 aperture), so
+// cached textures are also hashed again once they went unvalidated for
+// NV2A_TEXTURE_CACHE_REVALIDATE_FRAMES frames. That bounds how long such
+// a write can go unnoticed, at the cost of hashing every texture in use
+// once per that many frames.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Guest memory writes are tracked per page of this size */
+#define NV2A_TEXTURE_CACHE_PAGE_BITS 12
+
+/* Cached textures not validated for this many frames are hashed again on their next use */
+#define NV2A_TEXTURE_CACHE_REVALIDATE_FRAMES 30
+
+typedef struct NV2ATextureCacheCounters {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t revalidations; // binds that needed hashing of texture data
+	uint64_t aged_revalidations; // revalidations for lack of recent validation, not for a tracked write
+	uint64_t unseen_writes; // aged revalidations that found the data changed (written without being tracked)
+	uint64_t upload_bytes;
+} NV2ATextureCacheCounters;
+
+/* What's known about the data of a cached texture */
+typedef struct NV2ATextureValidation {
+	uint64_t data_hash; // hash over texture (and palette) data at the last validation
+	size_t length; // size of the texture data in bytes
+	uint32_t generation; // memory generation at the last validation
+	uint32_t frame_number; // frame of the last validation
+} NV2ATextureValidation;
+
+typedef enum {
+	NV2A_TEXTURE_CURRENT, // can be used as is
+	NV2A_TEXTURE_WRITTEN, // must be hashed again, it's on pages written since its last validation
+	NV2A_TEXTURE_AGED, // must be hashed again, it wasn't validated for too long
+} NV2ATextureCheck;
+
+/* Stamps the pages holding [addr, addr + size) with the given generation */
+static inline void nv2a_texture_cache_mark_written(std::vector<uint32_t> &page_generation, uint32_t generation, size_t addr, size_t size)
+{
+	size_t page_count = page_generation.size();
+	if (size == 0 || page_count == 0) {
+		return;
+	}
+
+	size_t first = addr >> NV2A_TEXTURE_CACHE_PAGE_BITS;
+	size_t last = (addr + size - 1) >> NV2A_TEXTURE_CACHE_PAGE_BITS;
+	if (last >= page_count) {
+		last = page_count - 1;
+	}
+
+	for (size_t page = first; page <= last; page++) {
+		page_generation[page] = generation;
+	}
+}
+
+static inline bool nv2a_texture_cache_written_since(const std::vector<uint32_t> &page_generation, size_t addr, size_t size, uint32_t generation)
+{
+	size_t page_count = page_generation.size();
+	if (size == 0 || page_count == 0) {
+		return false;
+	}
+
+	size_t first = addr >> NV2A_TEXTURE_CACHE_PAGE_BITS;
+	size_t last = (addr + size - 1) >> NV2A_TEXTURE_CACHE_PAGE_BITS;
+	if (last >= page_count) {
+		last = page_count - 1;
+	}
+
+	for (size_t page = first; page <= last; page++) {
+		if (page_generation[page] > generation) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Decides whether a cached texture can be used without looking at its data */
+static inline NV2ATextureCheck nv2a_texture_cache_check(const NV2ATextureValidation &validation, const std::vector<uint32_t> &page_generation, uint32_t frame_number,
+	size_t texture_address, size_t palette_address, size_t palette_size)
+{
+	if (nv2a_texture_cache_written_since(page_generation, texture_address, validation.length, validation.generation)
+		|| nv2a_texture_cache_written_since(page_generation, palette_address, palette_size, validation.generation)) {
+		return NV2A_TEXTURE_WRITTEN;
+	}
+
+	if (frame_number - validation.frame_number >= NV2A_TEXTURE_CACHE_REVALIDATE_FRAMES) {
+		return NV2A_TEXTURE_AGED;
+	}
+
+	return NV2A_TEXTURE_CURRENT;
+}
+
+/* Records that a texture was uploaded, from data with the given hash */
+static inline void nv2a_texture_cache_uploaded(NV2ATextureValidation &validation, uint64_t data_hash, size_t length, uint32_t generation, uint32_t frame_number,
+	NV2ATextureCacheCounters &counters)
+{
+	validation.data_hash = data_hash;
+	validation.length = length;
+	validation.generation = generation;
+	validation.frame_number = frame_number;
+
+	counters.misses++;
+	counters.upload_bytes += length;
+}
+
+/* Records the hash of the data of a cached texture that nv2a_texture_cache_check
+ * didn't consider current. Returns true when the data changed, in which case the
+ * texture must be uploaded again. */
+static inline bool nv2a_texture_cache_revalidate(NV2ATextureValidation &validation, NV2ATextureCheck check, uint64_t data_hash, uint32_t generation, uint32_t frame_number,
+	NV2ATextureCacheCounters &counters)
+{
+	counters.revalidations++;
+	if (check == NV2A_TEXTURE_AGED) {
+		counters.aged_revalidations++;
+	}
+
+	if (data_hash == validation.data_hash) {
+		validation.generation = generation;
+		validation.frame_number = frame_number;
+		counters.hits++;
+		return false;
+	}
+
+	if (check == NV2A_TEXTURE_AGED) {
+		counters.unseen_writes++;
+	}
+
+	nv2a_texture_cache_uploaded(validation, data_hash, validation.length, generation, frame_number, counters);
+	return true;
+}
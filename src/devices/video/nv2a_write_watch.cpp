@@ -0,0 +1,179 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+#define LOG_PREFIX CXBXR_MODULE::NV2A
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include <windows.h>
+
+#include "devices/video/nv2a_write_watch.h"
+#include "Logging.h"
+
+#define WRITE_WATCH_PAGE_SIZE ((size_t)1 << NV2A_WRITE_WATCH_PAGE_BITS)
+
+static uint8_t *g_write_watch_base = nullptr;
+static size_t g_write_watch_page_count = 0;
+// Serializes changing page protections, so a faulting thread never sees a
+// page that's read-only while it isn't marked as watched (yet)
+static std::mutex g_write_watch_mutex;
+static std::unique_ptr<bool[]> g_write_watch_watched;
+static std::unique_ptr<DWORD[]> g_write_watch_protection; // Protection to restore, per watched page
+static std::unique_ptr<std::atomic<uint32_t>[]> g_write_watch_dirty; // One bit per page
+static std::atomic<bool> g_write_watch_any_dirty(false);
+
+static bool write_watch_is_writable(DWORD protection)
+{
+	return (protection & (PAGE_READWRITE | PAGE_EXECUTE_READWRITE)) != 0
+		&& (protection & PAGE_GUARD) == 0;
+}
+
+// Must be called with g_write_watch_mutex held
+static void write_watch_unprotect_page(size_t page)
+{
+	DWORD old_protection;
+	VirtualProtect(g_write_watch_base + (page << NV2A_WRITE_WATCH_PAGE_BITS), WRITE_WATCH_PAGE_SIZE,
+		g_write_watch_protection[page], &old_protection);
+	g_write_watch_watched[page] = false;
+	g_write_watch_dirty[page / 32].fetch_or(1u << (page % 32));
+	g_write_watch_any_dirty = true;
+}
+
+void nv2a_write_watch_init(uint8_t *base, size_t size)
+{
+	std::lock_guard<std::mutex> lock(g_write_watch_mutex);
+
+	g_write_watch_base = base;
+	g_write_watch_page_count = size >> NV2A_WRITE_WATCH_PAGE_BITS;
+	g_write_watch_watched.reset(new bool[g_write_watch_page_count]());
+	g_write_watch_protection.reset(new DWORD[g_write_watch_page_count]());
+	g_write_watch_dirty.reset(new std::atomic<uint32_t>[(g_write_watch_page_count + 31) / 32]());
+}
+
+void nv2a_write_watch_protect(size_t offset, size_t size)
+{
+	if (size == 0 || offset >= (g_write_watch_page_count << NV2A_WRITE_WATCH_PAGE_BITS)) {
+		return;
+	}
+
+	size_t first = offset >> NV2A_WRITE_WATCH_PAGE_BITS;
+	size_t last = std::min((offset + size - 1) >> NV2A_WRITE_WATCH_PAGE_BITS, g_write_watch_page_count - 1);
+
+	std::lock_guard<std::mutex> lock(g_write_watch_mutex);
+
+	for (size_t page = first; page <= last; page++) {
+		if (g_write_watch_watched[page]) {
+			continue;
+		}
+
+		uint8_t *address = g_write_watch_base + (page << NV2A_WRITE_WATCH_PAGE_BITS);
+		MEMORY_BASIC_INFORMATION info;
+		if (VirtualQuery(address, &info, sizeof(info)) == 0
+			|| info.State != MEM_COMMIT || !write_watch_is_writable(info.Protect)) {
+			// Pages the guest can't write to don't need watching
+			continue;
+		}
+
+		DWORD old_protection;
+		DWORD protection = (info.Protect & PAGE_EXECUTE_READWRITE) ? PAGE_EXECUTE_READ : PAGE_READONLY;
+		if (!VirtualProtect(address, WRITE_WATCH_PAGE_SIZE, protection, &old_protection)) {
+			continue;
+		}
+
+		g_write_watch_protection[page] = old_protection;
+		g_write_watch_watched[page] = true;
+	}
+}
+
+void nv2a_write_watch_release(void *address, size_t size)
+{
+	if (size == 0 || (uint8_t *)address < g_write_watch_base) {
+		return;
+	}
+
+	size_t offset = (uint8_t *)address - g_write_watch_base;
+	if (offset >= (g_write_watch_page_count << NV2A_WRITE_WATCH_PAGE_BITS)) {
+		return;
+	}
+
+	size_t first = offset >> NV2A_WRITE_WATCH_PAGE_BITS;
+	size_t last = std::min((offset + size - 1) >> NV2A_WRITE_WATCH_PAGE_BITS, g_write_watch_page_count - 1);
+
+	std::lock_guard<std::mutex> lock(g_write_watch_mutex);
+
+	for (size_t page = first; page <= last; page++) {
+		if (g_write_watch_watched[page]) {
+			write_watch_unprotect_page(page);
+		}
+	}
+}
+
+bool nv2a_write_watch_handle_fault(void *address)
+{
+	if ((uint8_t *)address < g_write_watch_base) {
+		return false;
+	}
+
+	size_t page = ((uint8_t *)address - g_write_watch_base) >> NV2A_WRITE_WATCH_PAGE_BITS;
+	if (page >= g_write_watch_page_count) {
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(g_write_watch_mutex);
+
+	if (g_write_watch_watched[page]) {
+		write_watch_unprotect_page(page);
+		return true;
+	}
+
+	// Another thread might have unprotected the page in the meantime,
+	// in which case the write can simply be retried
+	MEMORY_BASIC_INFORMATION info;
+	return VirtualQuery(address, &info, sizeof(info)) != 0
+		&& info.State == MEM_COMMIT && write_watch_is_writable(info.Protect);
+}
+
+void nv2a_write_watch_collect(void (*dirty)(size_t page, void *context), void *context)
+{
+	if (!g_write_watch_any_dirty.exchange(false)) {
+		return;
+	}
+
+	for (size_t i = 0; i < (g_write_watch_page_count + 31) / 32; i++) {
+		uint32_t bits = g_write_watch_dirty[i].exchange(0);
+		while (bits) {
+			unsigned int bit = 0;
+			while (!(bits & (1u << bit))) {
+				bit++;
+			}
+
+			bits &= ~(1u << bit);
+			dirty(i * 32 + bit, context);
+		}
+	}
+}
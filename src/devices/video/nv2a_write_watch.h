@@ -0,0 +1,48 @@
+// ******************************************************************
+// *
+// *  This file is part of the Cxbx project.
+// *
+// *  Cxbx and Cxbe are free software; you can redistribute them
+// *  and/or modify them under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+#pragma once
+
+// Tracks CPU writes to guest memory that PGRAPH cached (like textures).
+// Watched pages are made read-only in the contiguous memory view; the
+// first write to such a page faults, after which the page is made
+// writable again and reported as dirty. Writes through other views of
+// the same physical memory aren't seen (the texture cache catches those
+// by hashing cached textures again every so often, see nv2a_texture_cache.h).
+
+#include <cstddef>
+#include <cstdint>
+
+// Sets up tracking for the given memory (the contiguous view of guest memory)
+void nv2a_write_watch_init(uint8_t *base, size_t size);
+// Starts watching the pages holding the given range (offsets relative to base)
+void nv2a_write_watch_protect(size_t offset, size_t size);
+// Stops watching the pages holding the given host address range, marking them dirty.
+// Must be called before the host OS writes there on behalf of the guest (like NtReadFile),
+// since such writes fail instead of faulting.
+void nv2a_write_watch_release(void *address, size_t size);
+// Called from the exception handler for write access violations; returns true when handled
+bool nv2a_write_watch_handle_fault(void *address);
+// Calls 'dirty' for the page index of each page written since the previous call
+void nv2a_write_watch_collect(void (*dirty)(size_t page, void *context), void *context);
+
+#define NV2A_WRITE_WATCH_PAGE_BITS 12 // = host page size
@@ -3,28 +3,52 @@
 // Tiny compatibility layer until we have proper C++ strings (or something)
 
 #include <cstdarg>
+#include <cstdio>
 #include <string>
 
 typedef std::string QString;
 
-static QString* qstring_from_fmt(std::string fmt, ...) {
-	int size = ((int)fmt.size()) * 2 + 50;   // Use a rubric appropriate for your code
-	std::string *str = new std::string("");
-	va_list ap;
-	while (1) {     // Maximum two passes on a POSIX system...
-		str->resize(size);
-		va_start(ap, fmt);
-		int n = vsnprintf((char *)str->data(), size, fmt.c_str(), ap);
-		va_end(ap);
-		if (n > -1 && n < size) {  // Everything worked
-			str->resize(n);
-			return str;
-		}
-		if (n > -1)  // Needed size returned
-			size = n + 1;   // For null char
-		else
-			size *= 2;      // Guess at a larger size (OS specific)
+// Capacity reserved up-front for strings that receive a whole shader
+#define QSTRING_SHADER_CAPACITY (16 * 1024)
+
+// Formats directly at the end of the given string, so that appending
+// doesn't need a temporary string (and usually, no allocation at all)
+static inline void qstring_append_vfmt(QString *qs, const char *fmt, va_list ap) {
+	size_t length = qs->size();
+	size_t room = 128; // Most formatted fragments are short
+
+	va_list ap_retry;
+	va_copy(ap_retry, ap);
+	qs->resize(length + room);
+	int n = vsnprintf(&(*qs)[length], room + 1, fmt, ap);
+	if (n > 0 && (size_t)n > room) {
+		qs->resize(length + n);
+		vsnprintf(&(*qs)[length], n + 1, fmt, ap_retry);
 	}
+	va_end(ap_retry);
+
+	qs->resize(length + (n > 0 ? n : 0));
+}
+
+static inline void qstring_append_fmt_impl(QString *qs, const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	qstring_append_vfmt(qs, fmt, ap);
+	va_end(ap);
+}
+
+static inline QString* qstring_from_fmt(const char *fmt, ...) {
+	QString *str = new std::string();
+	va_list ap;
+	va_start(ap, fmt);
+	qstring_append_vfmt(str, fmt, ap);
+	va_end(ap);
+	return str;
+}
+
+static inline QString* qstring_new_sized(size_t capacity) {
+	QString *str = new std::string();
+	str->reserve(capacity);
 	return str;
 }
 
@@ -34,8 +58,9 @@ static QString* qstring_from_fmt(std::string fmt, ...) {
 #define qstring_append(gs1, s2) gs1->append(s2)
 #define qstring_get_str(gs) gs->c_str() //FIXME: Needs to be free'd later!
 #define qstring_append_int(gs, i) qstring_append_fmt(gs, "%d", (i))
-#define qstring_append_fmt(gs, fmt, ...) gs->append(*(std::string*)(qstring_from_fmt(fmt, ##__VA_ARGS__)))
+#define qstring_append_fmt(gs, fmt, ...) qstring_append_fmt_impl(gs, fmt, ##__VA_ARGS__)
 #define qstring_get_length(gs) gs->size()
+#define qstring_reserve(gs, n) gs->reserve(n)
 
 #define qobject_unref(X) // FIXME: Mostly free, but needs to be reviewed case-by-case
 #define qobject_ref(X) // FIXME: Tricky!
@@ -0,0 +1,365 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of Cxbx-Reloaded.
+// *
+// *  Cxbx-Reloaded is free software; you can redistribute it
+// *  and/or modify it under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+// Stresses the DpcQueue behind KeInsertQueueDpc and KeRemoveQueueDpc, and
+// measures how long queued DPCs wait until they're called. Producer threads
+// insert their own DPCs in batches and then run the queue, like code that
+// raised the IRQL to DISPATCH_LEVEL and lowers it again. They also remove
+// random DPCs of each other, and each one frees (overwrites) a DPC of its
+// own right after removing it, like a driver tearing down its device would.
+//
+// With -test, every insert must be called or removed exactly once, with the
+// arguments it was inserted with, no two DPCs may run at the same time, no
+// DPC may be left queued once every producer ran the queue (checked after
+// each round of inserts), and the queue must never touch a DPC after it was
+// removed.
+//
+// Usage : cxbxr-dpcbench [producer threads] [inserts per thread]
+//         cxbxr-dpcbench -test
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "core/kernel/support/DpcQueue.h"
+
+#define TEST_PRODUCERS 16
+#define TEST_INSERTS 20000
+// DPCs per producer, which the other producers may remove too
+#define SHARED_DPCS 8
+#define DPC_POISON 0xDD
+// Most operations a producer does before it runs the queue
+#define BATCH_MAX 16
+// The inserts per thread are spread over rounds, after each of which no DPC may be left queued
+#define ROUNDS 1000
+// How long each DPC routine works, every so many of which let the host switch to another thread
+#define DPC_WORK_NS 200
+#define DPC_YIELD_INTERVAL 16
+
+typedef std::chrono::steady_clock BenchClock;
+
+static int64_t NowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now().time_since_epoch()).count();
+}
+
+// Same layout as KDPC
+struct BenchListEntry {
+	BenchListEntry *Flink;
+	BenchListEntry *Blink;
+};
+
+struct BenchDpc;
+typedef void(*BenchDeferredRoutine)(BenchDpc *Dpc, void *DeferredContext, void *SystemArgument1, void *SystemArgument2);
+
+struct BenchDpc {
+	short Type;
+	unsigned char Inserted;
+	unsigned char Importance;
+	BenchListEntry DpcListEntry;
+	BenchDeferredRoutine DeferredRoutine;
+	void *DeferredContext;
+	void *SystemArgument1;
+	void *SystemArgument2;
+};
+
+// What the test knows about each DPC, kept outside of it (as it gets overwritten when freed)
+struct DpcRecord {
+	BenchDpc *Dpc;
+	std::atomic<uint64_t> Inserts{ 0 };
+	std::atomic<uint64_t> Removes{ 0 };
+	std::atomic<uint64_t> Calls{ 0 };
+	uintptr_t LastSequence = 0; // Only touched by the DPC routine
+};
+
+static DpcQueue<BenchDpc> g_Queue;
+static std::atomic<unsigned> g_Running{ 0 };
+static std::atomic<unsigned> g_Overlaps{ 0 };
+static std::atomic<unsigned> g_BadCalls{ 0 };
+// Only touched by DPC routines, which never run at the same time
+static std::vector<int64_t> g_Latency;
+
+static void BenchRoutine(BenchDpc *Dpc, void *DeferredContext, void *SystemArgument1, void *SystemArgument2)
+{
+	if (g_Running.fetch_add(1) != 0) {
+		g_Overlaps++;
+	}
+
+	DpcRecord *pRecord = (DpcRecord *)DeferredContext;
+	uintptr_t Sequence = (uintptr_t)SystemArgument1;
+	// Each insert of a DPC passes the next sequence number, and is called at most once
+	if (pRecord->Dpc != Dpc || Sequence <= pRecord->LastSequence) {
+		g_BadCalls++;
+	}
+	pRecord->LastSequence = Sequence;
+	g_Latency.push_back(NowNs() - (int64_t)(intptr_t)SystemArgument2);
+	pRecord->Calls++;
+
+	if (Sequence % DPC_YIELD_INTERVAL == 0) {
+		std::this_thread::yield();
+	}
+	int64_t Start = NowNs();
+	while (NowNs() - Start < DPC_WORK_NS);
+
+	g_Running--;
+}
+
+static void ExecuteDpcQueue()
+{
+	g_Queue.Run([](BenchDpc *pkdpc, const BenchDpc &Dpc) {
+		Dpc.DeferredRoutine(pkdpc, Dpc.DeferredContext, Dpc.SystemArgument1, Dpc.SystemArgument2);
+	});
+}
+
+static void InitializeDpc(DpcRecord &Record)
+{
+	memset(Record.Dpc, 0, sizeof(BenchDpc));
+	Record.Dpc->DeferredRoutine = BenchRoutine;
+	Record.Dpc->DeferredContext = &Record;
+}
+
+static bool InsertDpc(DpcRecord &Record)
+{
+	// Only the owner inserts a DPC, so this is the sequence number of this insert
+	uintptr_t Sequence = (uintptr_t)Record.Inserts.load() + 1;
+	if (!g_Queue.Insert(Record.Dpc, (void *)Sequence, (void *)(intptr_t)NowNs())) {
+		return false;
+	}
+
+	Record.Inserts++;
+	return true;
+}
+
+static bool RemoveDpc(DpcRecord &Record)
+{
+	if (!g_Queue.Remove(Record.Dpc)) {
+		return false;
+	}
+
+	Record.Removes++;
+	return true;
+}
+
+// Lets the producers wait for each other at the end of each round
+class RoundBarrier
+{
+public:
+	RoundBarrier(unsigned Count) : m_Count(Count) {}
+
+	// Returns true for one of the threads, once all of them arrived
+	bool Wait()
+	{
+		std::unique_lock<std::mutex> lock(m_Mtx);
+		unsigned Generation = m_Generation;
+		if (++m_Arrived == m_Count) {
+			m_Arrived = 0;
+			m_Generation++;
+			m_Cv.notify_all();
+			return true;
+		}
+		m_Cv.wait(lock, [&]() { return m_Generation != Generation; });
+		return false;
+	}
+
+private:
+	std::mutex m_Mtx;
+	std::condition_variable m_Cv;
+	unsigned m_Count;
+	unsigned m_Arrived = 0;
+	unsigned m_Generation = 0;
+};
+
+static std::atomic<unsigned> g_LeftQueued{ 0 };
+
+static void CheckLeftQueued(std::vector<DpcRecord> &Records)
+{
+	for (DpcRecord &Record : Records) {
+		g_LeftQueued += Record.Dpc->Inserted ? 1 : 0;
+	}
+
+	// Call them, so that the totals add up regardless
+	ExecuteDpcQueue();
+}
+
+static void Producer(std::vector<DpcRecord> &Records, RoundBarrier &Barrier, unsigned Producers, unsigned Index, unsigned Inserts)
+{
+	std::mt19937 rng(Index);
+	// Each producer owns SHARED_DPCS + 1 DPCs, the last of which is only touched by itself, and freed
+	DpcRecord *Own = &Records[Index * (SHARED_DPCS + 1)];
+	DpcRecord &Freed = Own[SHARED_DPCS];
+
+	unsigned Inserted = 0;
+	for (unsigned Round = 1; Round <= ROUNDS; Round++) {
+		unsigned RoundInserts = (unsigned)(((uint64_t)Inserts * Round) / ROUNDS);
+		while (Inserted < RoundInserts) {
+			// Like code running at DISPATCH_LEVEL, a batch of operations only runs the queue once it's done
+			unsigned Batch = 1 + rng() % BATCH_MAX;
+			for (unsigned i = 0; i < Batch; i++) {
+				unsigned Op = rng() % 8;
+				if (Op < 5) {
+					Inserted += InsertDpc(Own[rng() % SHARED_DPCS]) ? 1 : 0;
+				} else if (Op < 7) {
+					unsigned Other = rng() % Producers;
+					RemoveDpc(Records[Other * (SHARED_DPCS + 1) + rng() % SHARED_DPCS]);
+				} else {
+					Inserted += InsertDpc(Freed) ? 1 : 0;
+					if (RemoveDpc(Freed) || (rng() % 2)) {
+						// Wait for a call that's already running, then free the DPC and initialize it again
+						while (Freed.Calls + Freed.Removes != Freed.Inserts) {
+							std::this_thread::yield();
+						}
+						memset(Freed.Dpc, DPC_POISON, sizeof(BenchDpc));
+						std::this_thread::yield();
+						InitializeDpc(Freed);
+					}
+				}
+			}
+
+			ExecuteDpcQueue();
+		}
+
+		// With every producer done with the queue, nothing may be left queued
+		if (Barrier.Wait()) {
+			CheckLeftQueued(Records);
+		}
+		Barrier.Wait();
+	}
+}
+
+struct BenchResult {
+	uint64_t inserts;
+	uint64_t removes;
+	uint64_t calls;
+	unsigned leftQueued;  // DPCs still queued after a round in which every producer ran the queue
+	unsigned mismatches;  // DPCs whose inserts weren't all called or removed
+	double seconds;
+};
+
+static BenchResult RunBench(unsigned Producers, unsigned Inserts)
+{
+	std::vector<BenchDpc> Dpcs(Producers * (SHARED_DPCS + 1));
+	std::vector<DpcRecord> Records(Dpcs.size());
+	for (size_t i = 0; i < Records.size(); i++) {
+		Records[i].Dpc = &Dpcs[i];
+		InitializeDpc(Records[i]);
+	}
+	g_Latency.clear();
+	g_Latency.reserve((size_t)Producers * Inserts);
+
+	g_LeftQueued = 0;
+	RoundBarrier Barrier(Producers);
+
+	int64_t Start = NowNs();
+	std::vector<std::thread> Threads;
+	for (unsigned i = 0; i < Producers; i++) {
+		Threads.emplace_back(Producer, std::ref(Records), std::ref(Barrier), Producers, i, Inserts);
+	}
+	for (std::thread &Thread : Threads) {
+		Thread.join();
+	}
+
+	BenchResult result = {};
+	result.seconds = (NowNs() - Start) / 1e9;
+	result.leftQueued = g_LeftQueued;
+	for (DpcRecord &Record : Records) {
+		result.inserts += Record.Inserts;
+		result.removes += Record.Removes;
+		result.calls += Record.Calls;
+		if (Record.Calls + Record.Removes != Record.Inserts || Record.Dpc->Inserted) {
+			result.mismatches++;
+		}
+	}
+	return result;
+}
+
+static double Percentile_US(std::vector<int64_t> Values, double p)
+{
+	if (Values.empty()) {
+		return 0.0;
+	}
+	size_t i = std::min(Values.size() - 1, (size_t)(p * Values.size()));
+	std::nth_element(Values.begin(), Values.begin() + i, Values.end());
+	return Values[i] / 1000.0;
+}
+
+static void PrintResult(unsigned Producers, const BenchResult &result)
+{
+	printf("%u producers : %llu inserts, %llu calls, %llu removes in %.2f s (%.0f inserts per second)\n", Producers,
+		(unsigned long long)result.inserts, (unsigned long long)result.calls, (unsigned long long)result.removes,
+		result.seconds, result.inserts / result.seconds);
+	printf("insert to call us p50 %7.1f, p99 %7.1f, max %7.1f\n",
+		Percentile_US(g_Latency, 0.5), Percentile_US(g_Latency, 0.99), Percentile_US(g_Latency, 1.0));
+}
+
+int main(int argc, char *argv[])
+{
+	bool bTest = (argc == 2 && strcmp(argv[1], "-test") == 0);
+	if (argc > 1 && !bTest && (argv[1][0] < '0' || argv[1][0] > '9')) {
+		printf("Usage : cxbxr-dpcbench [producer threads] [inserts per thread]\n");
+		printf("        cxbxr-dpcbench -test\n");
+		return 1;
+	}
+
+	unsigned Producers = (argc > 1 && !bTest) ? strtoul(argv[1], nullptr, 0) : TEST_PRODUCERS;
+	unsigned Inserts = (argc > 2) ? strtoul(argv[2], nullptr, 0) : TEST_INSERTS;
+	if (Producers == 0) {
+		Producers = 1;
+	}
+
+	BenchResult result = RunBench(Producers, Inserts);
+	PrintResult(Producers, result);
+
+	if (bTest) {
+		unsigned failures = 0;
+		if (result.mismatches != 0) {
+			printf("FAIL : %u DPCs weren't called or removed exactly once per insert\n", result.mismatches);
+			failures++;
+		}
+		if (g_BadCalls != 0) {
+			printf("FAIL : %u calls had the wrong DPC or arguments\n", g_BadCalls.load());
+			failures++;
+		}
+		if (g_Overlaps != 0) {
+			printf("FAIL : %u DPCs ran while another one was running\n", g_Overlaps.load());
+			failures++;
+		}
+		if (result.leftQueued != 0) {
+			printf("FAIL : %u DPCs were left queued\n", result.leftQueued);
+			failures++;
+		}
+		printf("%u failure(s)\n", failures);
+		return failures ? 1 : 0;
+	}
+
+	return 0;
+}
@@ -0,0 +1,475 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of Cxbx-Reloaded.
+// *
+// *  Cxbx-Reloaded is free software; you can redistribute it
+// *  and/or modify it under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+// Drives DirectSound streams with synthetic packets, and measures how late
+// packet completion callbacks come in and how much CPU time the worker
+// thread takes. Streams follow the packet manager's rules (one completion
+// per visit, one second of upload ahead) against a host buffer whose play
+// cursor runs in real time, and are scheduled by the same functions as
+// DSStream_PacketManager (see DSStream_Schedule.hpp). Titles submit the next
+// packet from their completion callback, which processes the stream again,
+// so each stream keeps a fixed number of packets queued.
+//
+// With -poll, the worker visits all streams at a fixed interval instead,
+// like the emulator did before streams were scheduled.
+//
+// The test checks the scheduling functions on their own, then runs the
+// scheduled worker's passes on a simulated clock (so without depending on
+// how the host schedules threads) and requires that no stream is visited
+// more often than DSSTREAM_WORK_MIN_INTERVAL, that callbacks come at most
+// that late, that packets are uploaded before they're played, and that the
+// worker visits streams less often than polling at that interval would.
+//
+// Usage : cxbxr-dsstreambench <stream count> [seconds] [-poll [interval ms]]
+//         cxbxr-dsstreambench -test
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "core/hle/DSOUND/DirectSound/DSStream_Schedule.hpp"
+
+// Same as dsound_thread_worker
+#define BENCH_WORKER_MAX_WAIT_MS 300
+// 48 kHz, 16 bit stereo
+#define BENCH_AVG_BYTES_PER_SEC (48000 * 2 * 2)
+#define BENCH_QUEUED_PACKETS 4
+
+struct BenchPacket {
+	uint64_t start; // Stream offset of the first byte
+	uint32_t dwMaxSize;
+	uint32_t bufPlayed;
+	uint32_t bufWrittenBytes;
+};
+
+struct BenchStream {
+	std::deque<BenchPacket> packets;
+	uint32_t packetSize;
+	uint64_t nextStart; // Stream offset of the next packet to submit
+	bool isProcessing;
+	int64_t rtPlayStart; // When the host buffer started playing...
+	uint64_t playStartOffset; // ...and from which stream offset
+	int64_t rtNextWork;
+};
+
+static std::mutex g_Mutex;
+static std::condition_variable g_WorkerEvent;
+static bool g_WorkerSignaled = false;
+static int64_t g_rtWorkerNextWork = 0;
+static bool g_Quit = false;
+static std::vector<BenchStream> g_Streams;
+static std::vector<int64_t> g_Latencies; // In 100ns units
+static uint64_t g_Starvations = 0; // Host buffer played past the queued packets
+static uint64_t g_LateUploads = 0; // Host buffer played past the uploaded part of a packet
+static uint64_t g_Visits = 0;
+static uint64_t g_Wakeups = 0;
+
+static const auto g_Epoch = std::chrono::steady_clock::now();
+
+static int64_t Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_Epoch).count() / 100;
+}
+
+static double CpuSeconds()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime; k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime; u.HighPart = user.dwHighDateTime;
+	return (k.QuadPart + u.QuadPart) / 1e7;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+static uint64_t PlayCursor(const BenchStream &stream, int64_t rtNow)
+{
+	return stream.playStartOffset + (uint64_t)(rtNow - stream.rtPlayStart) * BENCH_AVG_BYTES_PER_SEC / 10000000;
+}
+
+// Same as DSStream_Packet_UploadPartial, minus the copy
+static void UploadPartial(BenchPacket &packet)
+{
+	if (packet.bufWrittenBytes < packet.dwMaxSize && packet.bufWrittenBytes <= packet.bufPlayed + BENCH_AVG_BYTES_PER_SEC) {
+		packet.bufWrittenBytes += std::min<uint32_t>(BENCH_AVG_BYTES_PER_SEC, packet.dwMaxSize - packet.bufWrittenBytes);
+	}
+}
+
+// Same as DSStream_Packet_Prefill : uploads the packets that play within the next second
+static void Prefill(BenchStream &stream)
+{
+	uint32_t streamBufferSize = 0;
+	for (BenchPacket &packet : stream.packets) {
+		if (packet.bufWrittenBytes == 0) {
+			UploadPartial(packet);
+		}
+		streamBufferSize += packet.dwMaxSize - packet.bufPlayed;
+		if (streamBufferSize > BENCH_AVG_BYTES_PER_SEC) {
+			break;
+		}
+	}
+}
+
+static void Submit(BenchStream &stream, int64_t rtNow);
+
+// Same flow as DSStream_Packet_Process_Internal
+static void Process(BenchStream &stream, int64_t rtNow)
+{
+	if (stream.packets.empty()) {
+		return;
+	}
+
+	if (!stream.isProcessing) {
+		stream.isProcessing = true;
+		stream.rtPlayStart = rtNow;
+		stream.playStartOffset = stream.packets.front().start;
+		Prefill(stream);
+		return;
+	}
+
+	BenchPacket &packet = stream.packets.front();
+	uint64_t cursor = PlayCursor(stream, rtNow);
+	packet.bufPlayed = (uint32_t)std::min<uint64_t>(cursor > packet.start ? cursor - packet.start : 0, packet.dwMaxSize);
+	if (packet.bufPlayed > packet.bufWrittenBytes) {
+		g_LateUploads++;
+	}
+	if (packet.bufPlayed < packet.dwMaxSize) {
+		UploadPartial(packet);
+		Prefill(stream);
+		return;
+	}
+
+	// Completed; compare with the time the host buffer got past its last byte
+	uint64_t end = packet.start + packet.dwMaxSize;
+	int64_t rtCompleted = stream.rtPlayStart + (int64_t)((end - stream.playStartOffset) * 10000000 / BENCH_AVG_BYTES_PER_SEC);
+	g_Latencies.push_back(rtNow - rtCompleted);
+	stream.packets.pop_front();
+	if (cursor >= stream.nextStart) {
+		g_Starvations++;
+	}
+	Prefill(stream);
+
+	// The title submits the next packet from its callback
+	Submit(stream, rtNow);
+}
+
+// Same as DSStream_Packet_NextWork, for a stream that's never paused or flushed
+static int64_t NextWork(const BenchStream &stream, int64_t rtNow)
+{
+	if (stream.packets.empty() || !stream.isProcessing) {
+		return DSSTREAM_WORK_IDLE;
+	}
+
+	const BenchPacket &packet = stream.packets.front();
+	int64_t rtNextWork = rtNow + DSStream_Packet_TimeUntilWork(packet.dwMaxSize, packet.bufPlayed, packet.bufWrittenBytes, BENCH_AVG_BYTES_PER_SEC);
+	return DSStream_Packet_ClampNextWork(rtNextWork, rtNow);
+}
+
+// Same as DSStream_Packet_Schedule
+static void Schedule(BenchStream &stream, int64_t rtNow)
+{
+	stream.rtNextWork = NextWork(stream, rtNow);
+	if (stream.rtNextWork < g_rtWorkerNextWork) {
+		g_rtWorkerNextWork = stream.rtNextWork;
+		g_WorkerSignaled = true;
+		g_WorkerEvent.notify_one();
+	}
+}
+
+// Same as the CDirectSoundStream_Process patch
+static void Submit(BenchStream &stream, int64_t rtNow)
+{
+	BenchPacket packet = { stream.nextStart, stream.packetSize, 0, 0 };
+	stream.nextStart += stream.packetSize;
+	stream.packets.push_back(packet);
+	// Submitting from a callback completes the next packet too, when it's due already
+	Process(stream, rtNow);
+	Schedule(stream, rtNow);
+}
+
+// One pass of dsound_thread_worker with DirectSoundDoWork_Stream, returns when the next one is due
+static int64_t VisitDueStreams(int64_t rtNow)
+{
+	g_rtWorkerNextWork = 0;
+	int64_t rtNextWork = DSSTREAM_WORK_IDLE;
+	for (BenchStream &stream : g_Streams) {
+		if (stream.rtNextWork <= rtNow) {
+			Process(stream, rtNow);
+			Schedule(stream, rtNow);
+			g_Visits++;
+		}
+		rtNextWork = std::min(rtNextWork, stream.rtNextWork);
+	}
+	rtNextWork = std::min(rtNextWork, rtNow + (int64_t)BENCH_WORKER_MAX_WAIT_MS * 10000);
+	g_rtWorkerNextWork = rtNextWork;
+	return rtNextWork;
+}
+
+// Round up, so the earliest stream is due by the time the worker wakes up
+static int64_t WorkerWaitMs(int64_t rtNextWork, int64_t rtNow)
+{
+	int64_t rtWait = rtNextWork - rtNow;
+	return rtWait > 0 ? (rtWait + 9999) / 10000 : 0;
+}
+
+static void ScheduledWorker()
+{
+	std::unique_lock<std::mutex> lock(g_Mutex);
+	while (!g_Quit) {
+		int64_t rtNow = Now();
+		int64_t rtNextWork = VisitDueStreams(rtNow);
+
+		auto wait = std::chrono::milliseconds(WorkerWaitMs(rtNextWork, rtNow));
+		g_WorkerEvent.wait_for(lock, wait, [] { return g_WorkerSignaled || g_Quit; });
+		g_WorkerSignaled = false;
+		g_Wakeups++;
+	}
+}
+
+static void PollingWorker(unsigned int intervalMs)
+{
+	std::unique_lock<std::mutex> lock(g_Mutex);
+	while (!g_Quit) {
+		int64_t rtNow = Now();
+		for (BenchStream &stream : g_Streams) {
+			Process(stream, rtNow);
+			g_Visits++;
+		}
+		g_WorkerEvent.wait_for(lock, std::chrono::milliseconds(intervalMs), [] { return g_Quit; });
+		g_Wakeups++;
+	}
+}
+
+// Packet sizes titles use, from 256 bytes (Gauntlet Dark Legacy intro) up to about 85 ms worth
+static const uint32_t g_PacketSizes[] = { 256, 2048, 4096, 8192, 16384 };
+
+static void StartStreams(unsigned int streamCount, const uint32_t *packetSizes, size_t packetSizeCount, int64_t rtNow)
+{
+	g_Streams.clear();
+	g_Streams.resize(streamCount);
+	for (unsigned int i = 0; i < streamCount; i++) {
+		BenchStream &stream = g_Streams[i];
+		stream.packetSize = packetSizes[i % packetSizeCount];
+		stream.nextStart = 0;
+		stream.isProcessing = false;
+		stream.rtNextWork = DSSTREAM_WORK_IDLE;
+		for (unsigned int j = 0; j < BENCH_QUEUED_PACKETS; j++) {
+			Submit(stream, rtNow);
+		}
+	}
+}
+
+static unsigned int g_Failures = 0;
+
+static void ExpectTime(int64_t rtTime, int64_t rtExpected, const char *szCase)
+{
+	if (rtTime != rtExpected) {
+		printf("FAIL : %s : %lld, expected %lld\n", szCase, (long long)rtTime, (long long)rtExpected);
+		g_Failures++;
+	}
+}
+
+static void TestScheduleFunctions()
+{
+	const uint32_t avg = BENCH_AVG_BYTES_PER_SEC;
+
+	// Uploaded packets need the worker once they're completed
+	ExpectTime(DSStream_Packet_TimeUntilWork(avg / 10, 0, avg / 10, avg), 1000000, "uploaded packet");
+	ExpectTime(DSStream_Packet_TimeUntilWork(avg / 10, avg / 20, avg / 10, avg), 500000, "half played packet");
+	ExpectTime(DSStream_Packet_TimeUntilWork(avg / 10, avg / 10, avg / 10, avg), 0, "played packet");
+	ExpectTime(DSStream_Packet_TimeUntilWork(0xFFFFFFFF, 0, 0xFFFFFFFF, avg), 0xFFFFFFFFLL * 10000000 / avg, "largest packet");
+
+	// Partially uploaded ones as soon as a second of uploaded data is left
+	ExpectTime(DSStream_Packet_TimeUntilWork(10 * avg, 0, 2 * avg, avg), 10000000, "partially uploaded packet");
+	ExpectTime(DSStream_Packet_TimeUntilWork(10 * avg, avg / 2, 2 * avg, avg), 5000000, "partially uploaded, played packet");
+	ExpectTime(DSStream_Packet_TimeUntilWork(10 * avg, avg / 2, avg, avg), 0, "partially uploaded packet, less than a second left");
+
+	// The worker never comes back sooner than DSSTREAM_WORK_MIN_INTERVAL
+	const int64_t rtNow = 123456789;
+	ExpectTime(DSStream_Packet_ClampNextWork(rtNow - 5, rtNow), rtNow + DSSTREAM_WORK_MIN_INTERVAL, "next work in the past");
+	ExpectTime(DSStream_Packet_ClampNextWork(rtNow + 1, rtNow), rtNow + DSSTREAM_WORK_MIN_INTERVAL, "next work too soon");
+	ExpectTime(DSStream_Packet_ClampNextWork(rtNow + DSSTREAM_WORK_MIN_INTERVAL + 1, rtNow), rtNow + DSSTREAM_WORK_MIN_INTERVAL + 1, "next work later");
+	ExpectTime(DSStream_Packet_ClampNextWork(DSSTREAM_WORK_IDLE, rtNow), DSSTREAM_WORK_IDLE, "idle stream");
+}
+
+// Runs the scheduled worker's passes on a simulated clock, waking up when it asks to
+static void TestScheduledWorker()
+{
+	// Plus packets too large to upload at once
+	static const uint32_t packetSizes[] = { 256, 2048, 4096, 8192, 16384, 3 * BENCH_AVG_BYTES_PER_SEC + 100 };
+	const size_t packetSizeCount = sizeof(packetSizes) / sizeof(packetSizes[0]);
+	const int64_t rtEnd = 60 * 10000000LL;
+
+	g_Latencies.clear();
+	g_Starvations = g_LateUploads = g_Visits = 0;
+	StartStreams(2 * packetSizeCount, packetSizes, packetSizeCount, 0);
+
+	std::vector<int64_t> lastVisits(g_Streams.size(), INT64_MIN / 2);
+	uint64_t tooSoon = 0;
+	int64_t rtNow = 0;
+	while (rtNow < rtEnd) {
+		for (size_t i = 0; i < g_Streams.size(); i++) {
+			if (g_Streams[i].rtNextWork <= rtNow) {
+				if (rtNow - lastVisits[i] < DSSTREAM_WORK_MIN_INTERVAL) {
+					tooSoon++;
+				}
+				lastVisits[i] = rtNow;
+			}
+		}
+
+		int64_t rtNextWork = VisitDueStreams(rtNow);
+		rtNow += WorkerWaitMs(rtNextWork, rtNow) * 10000;
+	}
+
+	int64_t maxLatency = *std::max_element(g_Latencies.begin(), g_Latencies.end());
+	int64_t minLatency = *std::min_element(g_Latencies.begin(), g_Latencies.end());
+	// Polling every DSSTREAM_WORK_MIN_INTERVAL visits every stream each time
+	uint64_t pollVisits = g_Streams.size() * (rtEnd / DSSTREAM_WORK_MIN_INTERVAL);
+
+	printf("Simulated %lld s : %zu completions, %llu stream visits (%llu when polling), latency %.2f to %.2f ms\n",
+		(long long)(rtEnd / 10000000), g_Latencies.size(), (unsigned long long)g_Visits, (unsigned long long)pollVisits,
+		minLatency / 10000.0, maxLatency / 10000.0);
+
+	// Up to a millisecond more, from rounding up the wait
+	if (minLatency < 0 || maxLatency > DSSTREAM_WORK_MIN_INTERVAL + 10000) {
+		printf("FAIL : callback latency out of range\n");
+		g_Failures++;
+	}
+	if (tooSoon != 0 || g_LateUploads != 0 || g_Visits >= pollVisits) {
+		printf("FAIL : %llu visits sooner than the minimum interval, %llu late uploads, %llu visits\n",
+			(unsigned long long)tooSoon, (unsigned long long)g_LateUploads, (unsigned long long)g_Visits);
+		g_Failures++;
+	}
+
+	// Every stream played its packets all the way
+	for (const BenchStream &stream : g_Streams) {
+		if (PlayCursor(stream, rtEnd) >= stream.nextStart || stream.packets.size() != BENCH_QUEUED_PACKETS) {
+			printf("FAIL : stream of %u byte packets fell behind\n", stream.packetSize);
+			g_Failures++;
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 2 && strcmp(argv[1], "-test") == 0) {
+		TestScheduleFunctions();
+		TestScheduledWorker();
+		printf("%u failure(s)\n", g_Failures);
+		return g_Failures ? 1 : 0;
+	}
+
+	if (argc < 2) {
+		printf("Usage : cxbxr-dsstreambench <stream count> [seconds] [-poll [interval ms]]\n");
+		printf("        cxbxr-dsstreambench -test\n");
+		return 1;
+	}
+
+	unsigned int streamCount = (unsigned int)atoi(argv[1]);
+	double seconds = 5.0;
+	bool poll = false;
+	unsigned int pollMs = BENCH_WORKER_MAX_WAIT_MS;
+	for (int i = 2; i < argc; i++) {
+		if (strcmp(argv[i], "-poll") == 0) {
+			poll = true;
+			if (i + 1 < argc && atoi(argv[i + 1]) > 0) {
+				pollMs = (unsigned int)atoi(argv[++i]);
+			}
+		} else {
+			seconds = atof(argv[i]);
+		}
+	}
+
+	if (streamCount == 0 || seconds <= 0.0) {
+		printf("Invalid stream count or duration\n");
+		return 1;
+	}
+
+	double cpuStart = CpuSeconds();
+	std::thread worker;
+	{
+		std::lock_guard<std::mutex> lock(g_Mutex);
+		StartStreams(streamCount, g_PacketSizes, sizeof(g_PacketSizes) / sizeof(g_PacketSizes[0]), Now());
+	}
+
+	if (poll) {
+		worker = std::thread(PollingWorker, pollMs);
+	} else {
+		worker = std::thread(ScheduledWorker);
+	}
+
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	{
+		std::lock_guard<std::mutex> lock(g_Mutex);
+		g_Quit = true;
+		g_WorkerEvent.notify_one();
+	}
+	worker.join();
+	double cpu = CpuSeconds() - cpuStart;
+
+	if (g_Latencies.empty()) {
+		printf("No packets completed\n");
+		return 1;
+	}
+
+	std::sort(g_Latencies.begin(), g_Latencies.end());
+	auto percentile = [](double p) {
+		return g_Latencies[std::min(g_Latencies.size() - 1, (size_t)(p * g_Latencies.size()))] / 10000.0;
+	};
+
+	if (poll) {
+		printf("Worker            : polling every %u ms\n", pollMs);
+	} else {
+		printf("Worker            : scheduled\n");
+	}
+	printf("Streams           : %u, %d packets queued each, %.1f s\n", streamCount, BENCH_QUEUED_PACKETS, seconds);
+	printf("Completions       : %zu (%.0f/s), %llu with all queued packets played, %llu visits past the uploaded data\n", g_Latencies.size(),
+		g_Latencies.size() / seconds, (unsigned long long)g_Starvations, (unsigned long long)g_LateUploads);
+	printf("Callback latency  : mean %.2f ms, median %.2f ms, p99 %.2f ms, max %.2f ms\n",
+		[] { double sum = 0; for (int64_t l : g_Latencies) sum += l; return sum / g_Latencies.size() / 10000.0; }(),
+		percentile(0.5), percentile(0.99), g_Latencies.back() / 10000.0);
+	printf("Worker            : %llu wake ups (%.0f/s), %llu stream visits\n", (unsigned long long)g_Wakeups,
+		g_Wakeups / seconds, (unsigned long long)g_Visits);
+	printf("CPU time          : %.3f s (%.2f%% of one core)\n", cpu, cpu * 100.0 / seconds);
+
+	return 0;
+}
@@ -0,0 +1,237 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of Cxbx-Reloaded.
+// *
+// *  Cxbx-Reloaded is free software; you can redistribute it
+// *  and/or modify it under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+// Measures the index kernels of WalkIndexBuffer.cpp, which the draw calls
+// use to copy or convert the Xbox index data while finding the range of
+// indices in use, with both their SSE4.1 and plain implementations.
+//
+// With -test, both implementations are instead checked against a reference
+// written here, bit for bit, on random index data of every length up to a
+// few hundred indices plus some long ones, read from unaligned addresses.
+// Writing past the end of the expected output counts as a failure too.
+//
+// Usage : cxbxr-indexbench [index count] [seconds]
+//         cxbxr-indexbench -test
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "common/util/CPUID.h"
+#include "core/hle/D3D8/Direct3D9/WalkIndexBuffer.h"
+
+// Output words after the expected output, which the kernels must leave alone
+#define TEST_GUARD_WORDS 32
+#define TEST_GUARD_VALUE 0xCDCD
+// Every length up to this is tested, then TEST_LONG_RUNS random ones up to TEST_LONG_MAX
+#define TEST_ALL_LENGTHS 300
+#define TEST_LONG_RUNS 200
+#define TEST_LONG_MAX 70000
+
+static unsigned g_Failures = 0;
+
+// Quad ABCD becomes triangles ABC+CDA (clockwise) or ADC+CBA (counter-clockwise), see WalkIndexBuffer.cpp
+static const unsigned RefCW[6] = { 0, 1, 2, 2, 3, 0 };
+static const unsigned RefCCW[6] = { 0, 3, 2, 2, 1, 0 };
+
+static void RefMinMax(uint16_t &LowIndex, uint16_t &HighIndex, const uint16_t *pIndexData, uint32_t dwIndexCount)
+{
+	LowIndex = *std::min_element(pIndexData, pIndexData + dwIndexCount);
+	HighIndex = *std::max_element(pIndexData, pIndexData + dwIndexCount);
+}
+
+static uint32_t RefConvertQuads(uint16_t *pOutput, const uint16_t *pQuadIndexData, uint32_t dwQuadIndexCount, bool bClockWise)
+{
+	const unsigned *Order = bClockWise ? RefCW : RefCCW;
+	uint32_t n = 0;
+	for (uint32_t q = 0; q < dwQuadIndexCount / 4; q++) {
+		for (unsigned v = 0; v < 6; v++) {
+			// A null pQuadIndexData generates the indices of a non-indexed quad list
+			pOutput[n++] = pQuadIndexData ? pQuadIndexData[q * 4 + Order[v]] : (uint16_t)(q * 4 + Order[v]);
+		}
+	}
+	return n;
+}
+
+// Compares the output (and its guard words) with the expected output
+static bool CheckOutput(const std::vector<uint16_t> &Output, const std::vector<uint16_t> &Expected, uint32_t dwCount)
+{
+	if (memcmp(Output.data(), Expected.data(), dwCount * sizeof(uint16_t)) != 0) {
+		return false;
+	}
+	for (uint32_t i = dwCount; i < dwCount + TEST_GUARD_WORDS; i++) {
+		if (Output[i] != TEST_GUARD_VALUE) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void TestLength(std::mt19937 &rng, uint32_t dwCount, bool bSIMD)
+{
+	// Mostly random indices, but also narrow ranges, runs and the extremes of the index range
+	std::vector<uint16_t> Buffer(dwCount + 1);
+	int Pattern = rng() % 4;
+	uint16_t Base = (uint16_t)rng();
+	for (uint32_t i = 0; i < dwCount + 1; i++) {
+		switch (Pattern) {
+		case 0: Buffer[i] = (uint16_t)rng(); break;
+		case 1: Buffer[i] = (uint16_t)(Base + (rng() % 64)); break;
+		case 2: Buffer[i] = (uint16_t)(Base + i / 3); break;
+		default: Buffer[i] = (rng() % 2) ? 0xFFFF : (uint16_t)(rng() % 3); break;
+		}
+	}
+	// The Xbox index data has no alignment the kernels could rely on
+	uint16_t *pIndexData = Buffer.data() + 1;
+
+	uint16_t RefLow, RefHigh;
+	RefMinMax(RefLow, RefHigh, pIndexData, dwCount);
+
+	std::vector<uint16_t> Expected(dwCount * 2 + TEST_GUARD_WORDS);
+	std::vector<uint16_t> Output(dwCount * 2 + TEST_GUARD_WORDS);
+	const char *szMode = bSIMD ? "SSE4.1" : "plain";
+
+	uint16_t Low = 0, High = 0;
+	WalkIndexBuffer(Low, High, pIndexData, dwCount);
+	if (Low != RefLow || High != RefHigh) {
+		printf("FAIL : %s WalkIndexBuffer of %u indices\n", szMode, dwCount);
+		g_Failures++;
+	}
+
+	std::fill(Output.begin(), Output.end(), (uint16_t)TEST_GUARD_VALUE);
+	std::copy(pIndexData, pIndexData + dwCount, Expected.begin());
+	Low = High = 0;
+	WalkAndCopyIndexBuffer(Low, High, Output.data(), pIndexData, dwCount);
+	if (Low != RefLow || High != RefHigh || !CheckOutput(Output, Expected, dwCount)) {
+		printf("FAIL : %s WalkAndCopyIndexBuffer of %u indices\n", szMode, dwCount);
+		g_Failures++;
+	}
+
+	for (bool bClockWise : { true, false }) {
+		uint32_t dwExpected = RefConvertQuads(Expected.data(), pIndexData, dwCount, bClockWise);
+		std::fill(Output.begin(), Output.end(), (uint16_t)TEST_GUARD_VALUE);
+		Low = High = 0;
+		WalkAndConvertQuadListIndices(Low, High, Output.data(), pIndexData, dwCount, bClockWise);
+		if (Low != RefLow || High != RefHigh || !CheckOutput(Output, Expected, dwExpected)) {
+			printf("FAIL : %s WalkAndConvertQuadListIndices (%s) of %u indices\n", szMode, bClockWise ? "CW" : "CCW", dwCount);
+			g_Failures++;
+		}
+
+		RefConvertQuads(Expected.data(), nullptr, dwCount, bClockWise);
+		std::fill(Output.begin(), Output.end(), (uint16_t)TEST_GUARD_VALUE);
+		GenerateQuadListIndices(Output.data(), dwCount, bClockWise);
+		if (!CheckOutput(Output, Expected, dwExpected)) {
+			printf("FAIL : %s GenerateQuadListIndices (%s) of %u indices\n", szMode, bClockWise ? "CW" : "CCW", dwCount);
+			g_Failures++;
+		}
+	}
+}
+
+static void TestKernels(bool bSIMD)
+{
+	IndexKernelsUseSIMD(bSIMD);
+	std::mt19937 rng(0x1D3B);
+	for (uint32_t dwCount = 1; dwCount <= TEST_ALL_LENGTHS; dwCount++) {
+		TestLength(rng, dwCount, bSIMD);
+	}
+	for (unsigned i = 0; i < TEST_LONG_RUNS; i++) {
+		TestLength(rng, 1 + rng() % TEST_LONG_MAX, bSIMD);
+	}
+}
+
+typedef std::chrono::steady_clock BenchClock;
+
+// Runs Kernel over and over for the given time, and returns the indices it read per second
+template<typename Kernel>
+static double Measure(double Seconds, uint32_t dwCount, Kernel kernel)
+{
+	uint64_t Runs = 0;
+	auto Start = BenchClock::now();
+	double Elapsed;
+	do {
+		for (unsigned i = 0; i < 16; i++) {
+			kernel();
+		}
+		Runs += 16;
+		Elapsed = std::chrono::duration<double>(BenchClock::now() - Start).count();
+	} while (Elapsed < Seconds);
+	return (double)Runs * dwCount / Elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 2 && strcmp(argv[1], "-test") == 0) {
+		SimdCaps supports;
+		if (!supports.SSE41()) {
+			printf("This host has no SSE4.1, both runs use the plain kernels\n");
+		}
+		TestKernels(false);
+		TestKernels(true);
+		printf("%u failure(s)\n", g_Failures);
+		return g_Failures ? 1 : 0;
+	}
+
+	if (argc > 1 && (argv[1][0] < '0' || argv[1][0] > '9')) {
+		printf("Usage : cxbxr-indexbench [index count] [seconds]\n");
+		printf("        cxbxr-indexbench -test\n");
+		return 1;
+	}
+
+	// Quad lists of 16-bit indices
+	uint32_t dwCount = (argc > 1) ? strtoul(argv[1], nullptr, 0) & ~3u : 65532;
+	double Seconds = (argc > 2) ? atof(argv[2]) : 1.0;
+	if (dwCount == 0) {
+		dwCount = 4;
+	}
+
+	std::mt19937 rng(0x1D3B);
+	std::vector<uint16_t> Input(dwCount);
+	for (auto &Index : Input) {
+		Index = (uint16_t)rng();
+	}
+	std::vector<uint16_t> Output(dwCount * 2);
+	uint16_t Low, High;
+
+	printf("%u indices, million indices per second\n", dwCount);
+	printf("%-32s %10s %10s\n", "kernel", "plain", "SSE4.1");
+	const char *Names[] = { "WalkIndexBuffer", "WalkAndCopyIndexBuffer", "WalkAndConvertQuadListIndices", "GenerateQuadListIndices" };
+	double Rates[4][2];
+	for (int Mode = 0; Mode < 2; Mode++) {
+		IndexKernelsUseSIMD(Mode == 1);
+		Rates[0][Mode] = Measure(Seconds, dwCount, [&]() { WalkIndexBuffer(Low, High, Input.data(), dwCount); });
+		Rates[1][Mode] = Measure(Seconds, dwCount, [&]() { WalkAndCopyIndexBuffer(Low, High, Output.data(), Input.data(), dwCount); });
+		Rates[2][Mode] = Measure(Seconds, dwCount, [&]() { WalkAndConvertQuadListIndices(Low, High, Output.data(), Input.data(), dwCount, true); });
+		Rates[3][Mode] = Measure(Seconds, dwCount, [&]() { GenerateQuadListIndices(Output.data(), dwCount, true); });
+	}
+	for (int i = 0; i < 4; i++) {
+		printf("%-32s %10.1f %10.1f\n", Names[i], Rates[i][0] / 1e6, Rates[i][1] / 1e6);
+	}
+
+	return 0;
+}
@@ -0,0 +1,327 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of Cxbx-Reloaded.
+// *
+// *  Cxbx-Reloaded is free software; you can redistribute it
+// *  and/or modify it under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+// Drives the xpad snapshot exchange of InputDeviceManager with a synthetic
+// host device, and measures how long input takes to reach the guest and how
+// long the guest's input and rumble calls take. Like the emulator, a polling
+// thread samples the device every XPAD_POLL_INTERVAL_MS while holding the
+// device manager's mutex and publishes an XpadSnapshot when the input
+// changed, and applies the XpadRumble the guest asked for. A contending
+// thread holds the same mutex for long stretches, the way device
+// enumeration does, while the guest reads its port every millisecond.
+//
+// Every report encodes its packet number, so the guest can check that it
+// never sees a torn or older report and never misses a packet.
+//
+// With -locked, the guest's rumble call takes the mutex itself, like the
+// emulator did before the rumble went through the polling thread.
+//
+// Usage : cxbxr-inputbench [seconds] [-locked]
+//         cxbxr-inputbench -test
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common/input/XpadSnapshot.h"
+
+// The synthetic device changes its input this often (in microseconds), faster than it is polled
+#define BENCH_DEVICE_INTERVAL_US 1000
+// The guest reads its port this often (in microseconds)
+#define BENCH_GUEST_INTERVAL_US 1000
+// The contending thread holds the manager's mutex this long, every BENCH_CONTENTION_PERIOD_MS
+#define BENCH_CONTENTION_HOLD_MS 20
+#define BENCH_CONTENTION_PERIOD_MS 50
+// Device state changes remembered for latency measurements
+#define BENCH_STATE_HISTORY 65536
+// Longest the guest may spend in a single input or rumble call in the -test run (in microseconds).
+// The calls are lock-free, anything close to BENCH_CONTENTION_HOLD_MS means they waited on the mutex.
+#define TEST_MAX_GUEST_CALL_US 5000
+
+typedef std::chrono::steady_clock BenchClock;
+
+static int64_t NowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now().time_since_epoch()).count();
+}
+
+struct BenchResult {
+	uint64_t reads;        // Guest input calls
+	uint64_t packets;      // New reports seen by the guest
+	uint64_t torn;         // Reports whose fields don't all belong to the same packet
+	uint64_t backwards;    // Reports older than one the guest already saw
+	uint64_t missed;       // Packets published but never seen by the guest
+	uint64_t published;    // Packets published by the polling thread
+	uint64_t coalesced;    // Device changes that happened between two polls
+	int64_t maxCallNs;     // Longest guest input or rumble call
+	std::vector<int64_t> latencyNs; // Device change to the guest's first read of it (or of a later change), per change
+	uint32_t rumbleWanted; // Last rumble the guest asked for...
+	uint32_t rumbleApplied; // ...and the last one the device got
+};
+
+// Fills a report with fields that all derive from its packet number
+static void EncodeReport(uint32_t packet_number, uint32_t state, XpadInput *in_buf)
+{
+	in_buf->wButtons = (uint16_t)packet_number;
+	for (int i = 0; i < 8; i++) {
+		in_buf->bAnalogButtons[i] = (uint8_t)(packet_number * (i + 3));
+	}
+	in_buf->sThumbLX = (int16_t)(packet_number >> 16);
+	in_buf->sThumbLY = (int16_t)~packet_number;
+	in_buf->sThumbRX = (int16_t)state;
+	in_buf->sThumbRY = (int16_t)(state >> 16);
+}
+
+static bool CheckReport(uint32_t packet_number, const XpadInput *in_buf)
+{
+	XpadInput expected;
+	EncodeReport(packet_number, (uint16_t)in_buf->sThumbRX | ((uint32_t)(uint16_t)in_buf->sThumbRY << 16), &expected);
+	return memcmp(&expected, in_buf, sizeof(XpadInput)) == 0;
+}
+
+static BenchResult RunBench(unsigned Milliseconds, bool bLocked)
+{
+	BenchResult result = {};
+	XpadSnapshot snapshot = {};
+	XpadRumble rumble = {};
+	std::mutex mtx; // Stands for InputDeviceManager::m_Mtx
+	std::atomic<bool> stop { false };
+	std::atomic<bool> stopGuest { false };
+
+	// The synthetic device : a state number, and when each state began
+	std::atomic<uint32_t> deviceState { 0 };
+	std::vector<std::atomic<int64_t>> stateTimeNs(BENCH_STATE_HISTORY);
+	stateTimeNs[0].store(NowNs());
+	std::atomic<uint32_t> appliedRumble { 0 };
+
+	std::thread device([&]() {
+		uint32_t state = 0;
+		while (!stop) {
+			std::this_thread::sleep_for(std::chrono::microseconds(BENCH_DEVICE_INTERVAL_US));
+			state++;
+			stateTimeNs[state % BENCH_STATE_HISTORY].store(NowNs(), std::memory_order_relaxed);
+			deviceState.store(state, std::memory_order_release);
+		}
+	});
+
+	std::thread contender([&]() {
+		while (!stop) {
+			{
+				std::lock_guard<std::mutex> lck(mtx);
+				std::this_thread::sleep_for(std::chrono::milliseconds(BENCH_CONTENTION_HOLD_MS));
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(BENCH_CONTENTION_PERIOD_MS - BENCH_CONTENTION_HOLD_MS));
+		}
+	});
+
+	// Same as InputDeviceManager::PollXboxPorts, for one port
+	std::thread poller([&]() {
+		uint32_t packet_number = 0;
+		uint32_t polled_state = 0;
+		uint32_t rumble_applied = 0;
+		while (true) {
+			// Once the guest is gone, one more pass applies its last rumble
+			bool last_pass = stop;
+			std::unique_lock<std::mutex> lck(mtx);
+			uint32_t rumble_strengths = rumble.Get();
+			if (rumble_strengths != rumble_applied) {
+				appliedRumble.store(rumble_strengths, std::memory_order_relaxed);
+				rumble_applied = rumble_strengths;
+			}
+			uint32_t state = deviceState.load(std::memory_order_acquire);
+			if (state != polled_state || packet_number == 0) {
+				if (packet_number != 0) {
+					result.coalesced += state - polled_state - 1;
+				}
+				polled_state = state;
+				if (++packet_number == 0) {
+					packet_number = 1;
+				}
+				XpadInput in_buf;
+				EncodeReport(packet_number, state, &in_buf);
+				snapshot.Publish(&in_buf, packet_number);
+			}
+			lck.unlock();
+			if (last_pass) {
+				break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(XPAD_POLL_INTERVAL_MS));
+		}
+		result.published = packet_number;
+	});
+
+	// The guest : reads its port and sets the rumble, like the xpad's interrupt endpoints
+	std::thread guest([&]() {
+		uint32_t last_packet = 0;
+		uint32_t last_state = 0;
+		uint16_t strength = 0;
+		while (!stopGuest) {
+			int64_t start = NowNs();
+			XpadInput in_buf;
+			uint32_t packet_number = snapshot.Read(&in_buf);
+			int64_t now = NowNs();
+			result.maxCallNs = std::max(result.maxCallNs, now - start);
+			result.reads++;
+
+			if (packet_number != 0 && packet_number != last_packet) {
+				if (!CheckReport(packet_number, &in_buf)) {
+					result.torn++;
+				}
+				else if (packet_number < last_packet) {
+					result.backwards++;
+				}
+				else {
+					if (last_packet != 0) {
+						result.missed += packet_number - last_packet - 1;
+					}
+					// Changes coalesced between two polls reach the guest together with the latest one
+					uint32_t state = (uint16_t)in_buf.sThumbRX | ((uint32_t)(uint16_t)in_buf.sThumbRY << 16);
+					for (uint32_t s = last_state + 1; s <= state; s++) {
+						result.latencyNs.push_back(now - stateTimeNs[s % BENCH_STATE_HISTORY].load(std::memory_order_relaxed));
+					}
+					last_state = state;
+					result.packets++;
+				}
+				last_packet = packet_number;
+			}
+
+			// The rumble changes on every read, the worst case for the polling thread
+			XpadOutput out_buf = { ++strength, (uint16_t)~strength };
+			start = NowNs();
+			if (bLocked) {
+				std::lock_guard<std::mutex> lck(mtx);
+				rumble.Set(&out_buf);
+			}
+			else {
+				rumble.Set(&out_buf);
+			}
+			result.maxCallNs = std::max(result.maxCallNs, NowNs() - start);
+			result.rumbleWanted = rumble.Get();
+
+			std::this_thread::sleep_for(std::chrono::microseconds(BENCH_GUEST_INTERVAL_US));
+		}
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(Milliseconds));
+	// The guest stops first, so that the polling thread sees its last rumble
+	stopGuest = true;
+	guest.join();
+	stop = true;
+	device.join();
+	contender.join();
+	poller.join();
+	result.rumbleApplied = appliedRumble.load();
+
+	return result;
+}
+
+static double Percentile(std::vector<int64_t> &values, double p)
+{
+	if (values.empty()) {
+		return 0.0;
+	}
+	size_t i = std::min(values.size() - 1, (size_t)(p * values.size()));
+	std::nth_element(values.begin(), values.begin() + i, values.end());
+	return values[i] / 1000000.0;
+}
+
+static void PrintResult(BenchResult &result)
+{
+	double mean = 0.0;
+	for (int64_t latency : result.latencyNs) {
+		mean += latency / 1000000.0;
+	}
+	if (!result.latencyNs.empty()) {
+		mean /= result.latencyNs.size();
+	}
+
+	printf("guest reads      : %llu\n", (unsigned long long)result.reads);
+	printf("packets          : %llu published, %llu seen, %llu missed\n",
+		(unsigned long long)result.published, (unsigned long long)result.packets, (unsigned long long)result.missed);
+	printf("bad reports      : %llu torn, %llu backwards\n",
+		(unsigned long long)result.torn, (unsigned long long)result.backwards);
+	printf("device changes   : %llu coalesced between polls\n", (unsigned long long)result.coalesced);
+	printf("input latency ms : mean %.2f, p50 %.2f, p99 %.2f, max %.2f\n", mean,
+		Percentile(result.latencyNs, 0.50), Percentile(result.latencyNs, 0.99), Percentile(result.latencyNs, 1.0));
+	printf("guest call ms    : max %.3f\n", result.maxCallNs / 1000000.0);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 2 && strcmp(argv[1], "-test") == 0) {
+		BenchResult result = RunBench(2000, false);
+		PrintResult(result);
+		unsigned failures = 0;
+		if (result.packets == 0) {
+			printf("FAIL : the guest saw no input\n");
+			failures++;
+		}
+		if (result.torn != 0 || result.backwards != 0) {
+			printf("FAIL : the guest saw inconsistent reports\n");
+			failures++;
+		}
+		if (result.missed != 0) {
+			printf("FAIL : the guest missed published reports\n");
+			failures++;
+		}
+		if (result.maxCallNs > TEST_MAX_GUEST_CALL_US * 1000LL) {
+			printf("FAIL : a guest call blocked for %.3f ms\n", result.maxCallNs / 1000000.0);
+			failures++;
+		}
+		if (result.rumbleApplied != result.rumbleWanted) {
+			printf("FAIL : the device didn't get the last rumble\n");
+			failures++;
+		}
+		printf("%u failure(s)\n", failures);
+		return failures ? 1 : 0;
+	}
+
+	unsigned Seconds = 10;
+	bool bLocked = false;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-locked") == 0) {
+			bLocked = true;
+		}
+		else if (argv[i][0] >= '0' && argv[i][0] <= '9') {
+			Seconds = strtoul(argv[i], nullptr, 0);
+		}
+		else {
+			printf("Usage : cxbxr-inputbench [seconds] [-locked]\n");
+			printf("        cxbxr-inputbench -test\n");
+			return 1;
+		}
+	}
+
+	printf("%u seconds, guest rumble %s\n", Seconds, bLocked ? "takes the mutex" : "lock-free");
+	BenchResult result = RunBench(Seconds * 1000, bLocked);
+	PrintResult(result);
+	return 0;
+}
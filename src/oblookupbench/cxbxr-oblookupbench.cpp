@@ -0,0 +1,412 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of Cxbx-Reloaded.
+// *
+// *  Cxbx-Reloaded is free software; you can redistribute it
+// *  and/or modify it under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+// Checks and times the ObLookupCache behind ObpLookupElementNameInDirectory,
+// against walking the hash chain of the directory like before.
+//
+// The test checks ObpComputeNameHash against known values, then creates,
+// looks up (in any case) and closes named objects in a few directories at
+// random, and requires every lookup to return what the chain walk returns.
+// Closing an object purges it like ObfDereferenceObject does, then unlinks it
+// and leaves its name info in place as freed, so a cache returning a freed
+// name info is caught. It also runs lookups of different names with the same
+// hash and length, of the same name in directories sharing cache slots, and
+// of a name closed and created again, and requires repeated lookups to hit.
+//
+// The benchmark reports the time per lookup in a directory of the given
+// number of objects, with the cache and with the chain walk.
+//
+// Usage : cxbxr-oblookupbench [objects] [seconds]
+//         cxbxr-oblookupbench -test
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "core/kernel/support/ObLookupCache.h"
+
+// Same as in ob.h
+#define OB_NUMBER_HASH_BUCKETS 11
+#define TEST_DIRECTORIES 3
+#define TEST_NAMES 400
+#define TEST_HOT_NAMES 32
+#define TEST_OPERATIONS 200000
+
+static unsigned g_Failures = 0;
+
+struct TestNameInfo;
+
+struct TestString {
+	uint16_t Length;
+	uint16_t MaximumLength;
+	char    *Buffer;
+};
+
+struct TestDirectory {
+	TestNameInfo *HashBuckets[OB_NUMBER_HASH_BUCKETS];
+};
+
+struct TestNameInfo {
+	TestNameInfo  *ChainLink;
+	TestDirectory *Directory;
+	TestString     Name;
+	bool           bFreed;
+	char           Storage[32];
+};
+
+// Directories a multiple of the cache size (in slots, times 16) apart, so the same name in each of them
+// lands in the same cache slot
+struct alignas(4096) PaddedDirectory {
+	TestDirectory Directory;
+};
+
+typedef ObLookupCache<TestDirectory, TestNameInfo, OB_NUMBER_HASH_BUCKETS> TestLookupCache;
+
+// Counts the name compares, a cache hit takes one
+static unsigned g_Compares = 0;
+
+// As RtlEqualString with CaseInSensitive
+static bool EqualName(const TestString &Name, const std::string &ElementName)
+{
+	g_Compares++;
+	if (Name.Length != ElementName.length()) {
+		return false;
+	}
+	for (size_t i = 0; i < ElementName.length(); i++) {
+		char a = Name.Buffer[i], b = ElementName[i];
+		if (a >= 'a' && a <= 'z') {
+			a -= 'a' - 'A';
+		}
+		if (b >= 'a' && b <= 'z') {
+			b -= 'a' - 'A';
+		}
+		if (a != b) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static TestNameInfo *CachedLookup(TestLookupCache &Cache, TestDirectory *Directory, const std::string &ElementName)
+{
+	return Cache.Lookup(Directory, ObpComputeNameHash(ElementName.c_str(), ElementName.length()), ElementName.length(),
+		[&ElementName](TestNameInfo *NameInfo) { return EqualName(NameInfo->Name, ElementName); });
+}
+
+// The chain walk ObpLookupElementNameInDirectory did before the cache
+static TestNameInfo *ChainLookup(TestDirectory *Directory, const std::string &ElementName)
+{
+	uint32_t HashIndex = ObpComputeNameHash(ElementName.c_str(), ElementName.length()) % OB_NUMBER_HASH_BUCKETS;
+	for (TestNameInfo *NameInfo = Directory->HashBuckets[HashIndex]; NameInfo != nullptr; NameInfo = NameInfo->ChainLink) {
+		if (EqualName(NameInfo->Name, ElementName)) {
+			return NameInfo;
+		}
+	}
+	return nullptr;
+}
+
+// Links a new name info in, like ObInsertObject
+static TestNameInfo *Create(TestDirectory *Directory, const std::string &Name, std::vector<TestNameInfo *> &Allocated)
+{
+	TestNameInfo *NameInfo = new TestNameInfo();
+	Allocated.push_back(NameInfo);
+	memcpy(NameInfo->Storage, Name.c_str(), Name.length());
+	NameInfo->Name.Buffer = NameInfo->Storage;
+	NameInfo->Name.Length = (uint16_t)Name.length();
+	NameInfo->Name.MaximumLength = (uint16_t)sizeof(NameInfo->Storage);
+	uint32_t HashIndex = ObpComputeNameHash(Name.c_str(), Name.length()) % OB_NUMBER_HASH_BUCKETS;
+	NameInfo->Directory = Directory;
+	NameInfo->ChainLink = Directory->HashBuckets[HashIndex];
+	Directory->HashBuckets[HashIndex] = NameInfo;
+	return NameInfo;
+}
+
+// Purges the name info like ObfDereferenceObject, then unlinks it and marks it freed. Its memory is
+// kept as it was, like freed pool memory that wasn't reused yet.
+static void Close(TestLookupCache &Cache, TestNameInfo *NameInfo)
+{
+	Cache.Purge(NameInfo);
+	TestNameInfo **pLink = &NameInfo->Directory->HashBuckets[ObpComputeNameHash(NameInfo->Name.Buffer, NameInfo->Name.Length) % OB_NUMBER_HASH_BUCKETS];
+	while (*pLink != NameInfo) {
+		pLink = &(*pLink)->ChainLink;
+	}
+	*pLink = NameInfo->ChainLink;
+	NameInfo->bFreed = true;
+}
+
+static void CheckLookup(TestLookupCache &Cache, TestDirectory *Directory, const std::string &ElementName, const char *szCase)
+{
+	TestNameInfo *Expected = ChainLookup(Directory, ElementName);
+	TestNameInfo *Found = CachedLookup(Cache, Directory, ElementName);
+	if (Found != Expected) {
+		printf("FAIL : Lookup of \"%s\" %s returned %s\n", ElementName.c_str(), szCase,
+			(Found == nullptr) ? "nothing" : (Found->bFreed ? "a freed name" : "another name"));
+		g_Failures++;
+	}
+}
+
+// Requires the lookup to be answered by the cache, with a single compare
+static void CheckHit(TestLookupCache &Cache, TestDirectory *Directory, const std::string &ElementName, TestNameInfo *Expected, const char *szCase)
+{
+	g_Compares = 0;
+	TestNameInfo *Found = CachedLookup(Cache, Directory, ElementName);
+	if (Found != Expected || g_Compares != 1) {
+		printf("FAIL : Lookup of \"%s\" %s took %u compares\n", ElementName.c_str(), szCase, g_Compares);
+		g_Failures++;
+	}
+}
+
+static void TestHash()
+{
+	static const struct { const char *Name; uint32_t Hash; } Known[] = {
+		{ "", 0 },
+		{ "a", 0x61 },
+		{ "ab", 0x1B5 }, // 0x61 * 3 + 0x61 / 2 + 0x62
+		{ "AB", 0x1B5 },
+		{ "a\x80" "b", 0x1B5 }, // Characters from 0x80 on are skipped
+	};
+	for (const auto &Case : Known) {
+		uint32_t Hash = ObpComputeNameHash(Case.Name, strlen(Case.Name));
+		if (Hash != Case.Hash) {
+			printf("FAIL : ObpComputeNameHash(\"%s\") is 0x%X instead of 0x%X\n", Case.Name, Hash, Case.Hash);
+			g_Failures++;
+		}
+	}
+	if (ObpComputeNameHash("\\Device\\CdRom0", 14) != ObpComputeNameHash("\\DEVICE\\cdrom0", 14)) {
+		printf("FAIL : ObpComputeNameHash is not case folded\n");
+		g_Failures++;
+	}
+}
+
+// Names with a single character changed to one that hashes the same : the 0x20 bit is folded away for
+// any character, but only a letter compares equal in another case
+static std::string CollidingName(const std::string &Name)
+{
+	std::string Colliding = Name;
+	for (char &Char : Colliding) {
+		if (Char == '@' || Char == '`' || (Char >= '0' && Char <= '9')) {
+			Char ^= 0x20;
+			break;
+		}
+		if ((uint8_t)Char >= 0x80) {
+			Char ^= 1;
+			break;
+		}
+	}
+	return Colliding;
+}
+
+static std::string RandomCase(std::mt19937 &rng, std::string Name)
+{
+	for (char &Char : Name) {
+		if (((Char >= 'a' && Char <= 'z') || (Char >= 'A' && Char <= 'Z')) && rng() % 2) {
+			Char ^= 0x20;
+		}
+	}
+	return Name;
+}
+
+static void TestCollisions()
+{
+	std::vector<TestNameInfo *> Allocated;
+	std::vector<PaddedDirectory> Directories(2);
+	TestDirectory *Directory = &Directories[0].Directory;
+	TestDirectory *Other = &Directories[1].Directory;
+	TestLookupCache Cache;
+
+	// Different names with the same hash and length in one directory, which share a cache slot
+	static const char *Names[] = { "Event@1", "Event`1", "Event\x81" "1", "Event\x80" "1" };
+	TestNameInfo *NameInfos[4];
+	for (int i = 0; i < 4; i++) {
+		NameInfos[i] = Create(Directory, Names[i], Allocated);
+	}
+	for (int Round = 0; Round < 3; Round++) {
+		for (int i = 0; i < 4; i++) {
+			CheckLookup(Cache, Directory, Names[i], "sharing a hash");
+			CheckHit(Cache, Directory, Names[i], NameInfos[i], "sharing a hash, again");
+		}
+	}
+	if (CachedLookup(Cache, Directory, "Event\x82" "1") != nullptr) {
+		printf("FAIL : Lookup of a missing name sharing a hash found something\n");
+		g_Failures++;
+	}
+
+	// The same name in directories sharing the cache slots
+	TestNameInfo *OtherInfo = Create(Other, "Event@1", Allocated);
+	for (int Round = 0; Round < 3; Round++) {
+		CheckLookup(Cache, Directory, "EVENT@1", "in one of two directories");
+		CheckLookup(Cache, Other, "event@1", "in the other one of two directories");
+	}
+	CheckHit(Cache, Other, "Event@1", OtherInfo, "in the other directory, again");
+
+	// A cached name that is closed, looked up, and created again
+	CheckHit(Cache, Other, "Event@1", OtherInfo, "before closing it");
+	Close(Cache, OtherInfo);
+	CheckLookup(Cache, Other, "Event@1", "after closing it");
+	CheckLookup(Cache, Directory, "Event@1", "after closing it in the other directory");
+	OtherInfo = Create(Other, "Event@1", Allocated);
+	CheckLookup(Cache, Other, "Event@1", "after creating it again");
+	CheckHit(Cache, Other, "Event@1", OtherInfo, "after creating it again");
+
+	for (TestNameInfo *NameInfo : Allocated) {
+		delete NameInfo;
+	}
+}
+
+static void TestChurn()
+{
+	std::mt19937 rng(0x0B1EC7);
+	std::vector<TestNameInfo *> Allocated;
+	std::vector<PaddedDirectory> Directories(TEST_DIRECTORIES);
+	TestLookupCache Cache;
+
+	// Names like titles use, half of them with a colliding twin
+	std::vector<std::string> Names;
+	for (unsigned i = 0; i < TEST_NAMES / 2; i++) {
+		std::string Name = "Obj" + std::to_string(i % 7) + "_" + std::to_string(rng() % 100000) + ((i % 3 == 0) ? "@x" : "\xA0y");
+		Names.push_back(Name);
+		Names.push_back(CollidingName(Name));
+	}
+
+	// The name info each name has in each directory, nullptr if it isn't there
+	std::vector<std::vector<TestNameInfo *>> Live(TEST_DIRECTORIES, std::vector<TestNameInfo *>(Names.size(), nullptr));
+	unsigned Found = 0, Hits = 0;
+	for (unsigned i = 0; i < TEST_OPERATIONS; i++) {
+		unsigned d = rng() % TEST_DIRECTORIES;
+		// Mostly the same few names (with their twins), like a title opening the same events over and over
+		unsigned n = (rng() % 8 != 0) ? rng() % TEST_HOT_NAMES : rng() % Names.size();
+		TestDirectory *Directory = &Directories[d].Directory;
+		unsigned Operation = rng() % 10;
+		if (Operation == 0 && Live[d][n] == nullptr) {
+			Live[d][n] = Create(Directory, Names[n], Allocated);
+		} else if (Operation == 1 && Live[d][n] != nullptr) {
+			Close(Cache, Live[d][n]);
+			Live[d][n] = nullptr;
+			CheckLookup(Cache, Directory, Names[n], "right after closing it");
+		} else {
+			std::string ElementName = RandomCase(rng, Names[n]);
+			g_Compares = 0;
+			TestNameInfo *NameInfo = CachedLookup(Cache, Directory, ElementName);
+			if (NameInfo != Live[d][n]) {
+				printf("FAIL : Lookup of \"%s\" returned %s\n", ElementName.c_str(),
+					(NameInfo == nullptr) ? "nothing" : (NameInfo->bFreed ? "a freed name" : "another name"));
+				g_Failures++;
+			}
+			if (NameInfo != nullptr) {
+				Found++;
+				Hits += (g_Compares == 1);
+			}
+		}
+	}
+
+	// Twins and other names sharing a slot push each other out, but most of the names found should hit
+	if (Hits < Found / 3) {
+		printf("FAIL : Only %u of %u names found hit\n", Hits, Found);
+		g_Failures++;
+	}
+
+	for (TestNameInfo *NameInfo : Allocated) {
+		delete NameInfo;
+	}
+}
+
+typedef std::chrono::steady_clock BenchClock;
+
+// Runs Lookup over and over for the given time, and returns the nanoseconds per lookup
+template<typename Finder>
+static double Measure(double Seconds, const std::vector<std::string> &Trace, Finder Lookup)
+{
+	uint64_t Lookups = 0;
+	size_t Found = 0;
+	auto Start = BenchClock::now();
+	double Elapsed;
+	do {
+		for (const std::string &Name : Trace) {
+			Found += (Lookup(Name) != nullptr);
+		}
+		Lookups += Trace.size();
+		Elapsed = std::chrono::duration<double>(BenchClock::now() - Start).count();
+	} while (Elapsed < Seconds);
+	if (Found != Lookups) {
+		printf("Not every name found\n");
+	}
+	return Elapsed * 1e9 / (double)Lookups;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 2 && strcmp(argv[1], "-test") == 0) {
+		TestHash();
+		TestCollisions();
+		TestChurn();
+		printf("%u failure(s)\n", g_Failures);
+		return g_Failures ? 1 : 0;
+	}
+
+	if (argc > 1 && (argv[1][0] < '0' || argv[1][0] > '9')) {
+		printf("Usage : cxbxr-oblookupbench [objects] [seconds]\n");
+		printf("        cxbxr-oblookupbench -test\n");
+		return 1;
+	}
+
+	unsigned ObjectCount = (argc > 1) ? (unsigned)atoi(argv[1]) : 2000;
+	double Seconds = (argc > 2) ? atof(argv[2]) : 1.0;
+	if (ObjectCount == 0) {
+		ObjectCount = 1;
+	}
+
+	std::mt19937 rng(0x0B1EC7);
+	std::vector<TestNameInfo *> Allocated;
+	PaddedDirectory Directory = {};
+	std::vector<std::string> Names;
+	for (unsigned i = 0; i < ObjectCount; i++) {
+		Names.push_back("Object" + std::to_string(i));
+		Create(&Directory.Directory, Names.back(), Allocated);
+	}
+
+	// Mostly the same few dozen names, like a title waiting on the same events over and over
+	std::vector<std::string> Trace;
+	for (unsigned i = 0; i < 10000; i++) {
+		Trace.push_back(Names[(rng() % 8 != 0) ? rng() % std::min(ObjectCount, 64u) : rng() % ObjectCount]);
+	}
+
+	TestLookupCache Cache;
+	printf("%u objects, ns per lookup\n", ObjectCount);
+	double Chain = Measure(Seconds, Trace, [&](const std::string &Name) { return ChainLookup(&Directory.Directory, Name); });
+	printf("%-24s %10.1f\n", "Chain walk", Chain);
+	double Cached = Measure(Seconds, Trace, [&](const std::string &Name) { return CachedLookup(Cache, &Directory.Directory, Name); });
+	printf("%-24s %10.1f\n", "ObLookupCache", Cached);
+
+	for (TestNameInfo *NameInfo : Allocated) {
+		delete NameInfo;
+	}
+	return 0;
+}
@@ -0,0 +1,565 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of Cxbx-Reloaded.
+// *
+// *  Cxbx-Reloaded is free software; you can redistribute it
+// *  and/or modify it under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+// Checks and times PhysicalFreeBlocks, the index of free physical pages
+// PhysicalMemory allocates from, against the LIST_ENTRY free list it used
+// before (copied below, without its page counters and with the aligned end
+// fix).
+//
+// The test runs random allocations (any size, alignment and pfn range), runs
+// of pages taken a run at a time (against the same pages taken one at a time
+// from the old list) and frees on both, on retail and devkit layouts, and
+// requires the same returned pfn's and the same free blocks after every
+// operation. It also requires the retail and debugger page counters, kept like
+// PhysicalMemory::UpdateAvailablePages does, to match a recount of the free
+// blocks.
+//
+// The benchmark reports the time to allocate and free a number of pages, one
+// page at a time on the old list and a run at a time on the new index, with
+// the free pages in one block or fragmented.
+//
+// Usage : cxbxr-pagebench [seconds per measurement]
+//         cxbxr-pagebench -test
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "core/kernel/memory-manager/PhysicalFreeBlocks.h"
+
+// Same as in CxbxKrnl.h
+#define X64M_PHYSICAL_PAGE 0x4000
+#define X128M_PHYSICAL_PAGE 0x8000
+#define DEBUGKIT_FIRST_UPPER_HALF_PAGE X64M_PHYSICAL_PAGE
+
+#define TEST_ROUNDS 200
+#define TEST_OPERATIONS 2000
+#define BENCH_SECONDS 0.5
+
+typedef std::vector<std::pair<PFN, PFN_COUNT>> BlockList;
+
+// ******************************************************************
+// * The free list PhysicalMemory used before
+// ******************************************************************
+
+struct LIST_ENTRY
+{
+	LIST_ENTRY *Flink;
+	LIST_ENTRY *Blink;
+};
+typedef LIST_ENTRY *PLIST_ENTRY;
+
+#define LIST_ENTRY_INITIALIZE(e) ((e)->Flink = (e)->Blink = nullptr)
+
+static inline void RemoveEntryList(PLIST_ENTRY Entry)
+{
+	Entry->Blink->Flink = Entry->Flink;
+	Entry->Flink->Blink = Entry->Blink;
+}
+
+static inline void InsertHeadList(PLIST_ENTRY Head, PLIST_ENTRY Entry)
+{
+	Entry->Flink = Head->Flink;
+	Entry->Blink = Head;
+	Head->Flink->Blink = Entry;
+	Head->Flink = Entry;
+}
+
+struct FreeBlock
+{
+	PFN start;
+	PFN_COUNT size;
+	LIST_ENTRY ListEntry;
+};
+typedef FreeBlock *PFreeBlock;
+
+static inline PFreeBlock ListEntryToFreeBlock(PLIST_ENTRY Entry)
+{
+	return (PFreeBlock)((char *)Entry - offsetof(FreeBlock, ListEntry));
+}
+
+class OldFreeList
+{
+	public:
+		OldFreeList(PFN_COUNT NumberOfPages)
+		{
+			FreeList.Flink = FreeList.Blink = &FreeList;
+			PFreeBlock block = new FreeBlock;
+			block->start = 0;
+			block->size = NumberOfPages;
+			LIST_ENTRY_INITIALIZE(&block->ListEntry);
+			InsertHeadList(&FreeList, &block->ListEntry);
+		}
+		~OldFreeList()
+		{
+			while (FreeList.Flink != &FreeList) {
+				PLIST_ENTRY ListEntry = FreeList.Flink;
+				RemoveEntryList(ListEntry);
+				delete ListEntryToFreeBlock(ListEntry);
+			}
+		}
+		bool RemoveFree(PFN_COUNT NumberOfPages, PFN* result, PFN_COUNT PfnAlignment, PFN start, PFN end);
+		void InsertFree(PFN start, PFN end);
+		BlockList Blocks() const
+		{
+			BlockList Blocks;
+			for (PLIST_ENTRY ListEntry = FreeList.Flink; ListEntry != &FreeList; ListEntry = ListEntry->Flink) {
+				Blocks.push_back({ ListEntryToFreeBlock(ListEntry)->start, ListEntryToFreeBlock(ListEntry)->size });
+			}
+			return Blocks;
+		}
+
+	private:
+		LIST_ENTRY FreeList;
+};
+
+bool OldFreeList::RemoveFree(PFN_COUNT NumberOfPages, PFN* result, PFN_COUNT PfnAlignment, PFN start, PFN end)
+{
+	PLIST_ENTRY ListEntry;
+	PFN PfnStart;
+	PFN PfnEnd;
+	PFN IntersectionStart;
+	PFN IntersectionEnd;
+	PFN_COUNT PfnCount;
+	PFN_COUNT PfnAlignmentMask = 0;
+	PFN_COUNT PfnAlignmentSubtraction = 0;
+
+	if (NumberOfPages == 0) { return false; }
+
+	if (PfnAlignment)
+	{
+		PfnAlignmentMask = ~(PfnAlignment - 1);
+		PfnAlignmentSubtraction = ((NumberOfPages + PfnAlignment - 1) & PfnAlignmentMask) - NumberOfPages + 1;
+	}
+
+	ListEntry = FreeList.Blink; // search from the top
+
+	while (ListEntry != &FreeList)
+	{
+		if (ListEntryToFreeBlock(ListEntry)->size >= NumberOfPages) // search for a block with enough pages
+		{
+			PfnStart = ListEntryToFreeBlock(ListEntry)->start;
+			PfnCount = ListEntryToFreeBlock(ListEntry)->size;
+			PfnEnd = PfnStart + PfnCount - 1;
+			IntersectionStart = start >= PfnStart ? start : PfnStart;
+			IntersectionEnd = end <= PfnEnd ? end : PfnEnd;
+
+			if (IntersectionEnd < IntersectionStart) { goto InvalidBlock; }
+
+			if (IntersectionEnd - IntersectionStart + 1 < NumberOfPages) { goto InvalidBlock; }
+
+			if (PfnAlignment)
+			{
+				// Fixed like in PhysicalFreeBlocks, the aligned end could wrap around below pfn zero
+				if (((IntersectionEnd + 1) & PfnAlignmentMask) < PfnAlignmentSubtraction) { goto InvalidBlock; }
+
+				IntersectionEnd = ((IntersectionEnd + 1) & PfnAlignmentMask) - PfnAlignmentSubtraction;
+
+				if (IntersectionEnd < IntersectionStart || IntersectionEnd - IntersectionStart + 1 < NumberOfPages) { goto InvalidBlock; }
+			}
+
+			if (IntersectionStart == PfnStart)
+			{
+				if (IntersectionEnd == PfnEnd)
+				{
+					PfnCount -= NumberOfPages;
+					if (!PfnCount)
+					{
+						RemoveEntryList(ListEntry);
+						delete ListEntryToFreeBlock(ListEntry);
+					}
+					else { ListEntryToFreeBlock(ListEntry)->size = PfnCount; }
+				}
+				else
+				{
+					PFreeBlock block = new FreeBlock;
+					block->start = IntersectionEnd + 1;
+					block->size = PfnStart + PfnCount - IntersectionEnd - 1;
+					LIST_ENTRY_INITIALIZE(&block->ListEntry);
+					InsertHeadList(ListEntry, &block->ListEntry);
+
+					PfnCount = IntersectionEnd - PfnStart - NumberOfPages + 1;
+					if (!PfnCount)
+					{
+						RemoveEntryList(ListEntry);
+						delete ListEntryToFreeBlock(ListEntry);
+					}
+					else { ListEntryToFreeBlock(ListEntry)->size = PfnCount; }
+				}
+			}
+			else
+			{
+				if (IntersectionEnd == PfnEnd)
+				{
+					PfnCount -= NumberOfPages;
+					ListEntryToFreeBlock(ListEntry)->size = PfnCount;
+				}
+				else
+				{
+					PFreeBlock block = new FreeBlock;
+					block->start = IntersectionEnd + 1;
+					block->size = PfnStart + PfnCount - IntersectionEnd - 1;
+					LIST_ENTRY_INITIALIZE(&block->ListEntry);
+					InsertHeadList(ListEntry, &block->ListEntry);
+
+					PfnCount = IntersectionEnd - PfnStart - NumberOfPages + 1;
+					ListEntryToFreeBlock(ListEntry)->size = PfnCount;
+				}
+			}
+			*result = PfnStart + PfnCount;
+			return true;
+		}
+		InvalidBlock:
+		ListEntry = ListEntry->Blink;
+	}
+	return false;
+}
+
+void OldFreeList::InsertFree(PFN start, PFN end)
+{
+	PLIST_ENTRY ListEntry;
+	PFN_COUNT size = end - start + 1;
+
+	ListEntry = FreeList.Blink; // search from the top
+
+	while (true)
+	{
+		if (ListEntry == &FreeList || ListEntryToFreeBlock(ListEntry)->start < start)
+		{
+			PFreeBlock block = new FreeBlock;
+			block->start = start;
+			block->size = size;
+			LIST_ENTRY_INITIALIZE(&block->ListEntry);
+			InsertHeadList(ListEntry, &block->ListEntry);
+
+			ListEntry = ListEntry->Flink; // move to the new created block
+
+			if (ListEntry->Flink != &FreeList &&
+				start + size == ListEntryToFreeBlock(ListEntry->Flink)->start)
+			{
+				// Merge forward
+				PLIST_ENTRY temp = ListEntry->Flink;
+				ListEntryToFreeBlock(ListEntry)->size += ListEntryToFreeBlock(temp)->size;
+				RemoveEntryList(temp);
+				delete ListEntryToFreeBlock(temp);
+			}
+			if (ListEntry->Blink != &FreeList &&
+				ListEntryToFreeBlock(ListEntry->Blink)->start + ListEntryToFreeBlock(ListEntry->Blink)->size == start)
+			{
+				// Merge backward
+				ListEntryToFreeBlock(ListEntry->Blink)->size += ListEntryToFreeBlock(ListEntry)->size;
+				RemoveEntryList(ListEntry);
+				delete block;
+			}
+
+			return;
+		}
+		ListEntry = ListEntry->Blink;
+	}
+}
+
+// ******************************************************************
+// * PhysicalFreeBlocks with the page counters of PhysicalMemory
+// ******************************************************************
+
+struct FreePages
+{
+	PhysicalFreeBlocks m_FreeBlocks;
+	PFN_COUNT m_PhysicalPagesAvailable;
+	PFN_COUNT m_DebuggerPagesAvailable = 0;
+	bool m_MmLayoutDebug;
+
+	FreePages(PFN_COUNT NumberOfPages, bool bDebug) : m_PhysicalPagesAvailable(NumberOfPages), m_MmLayoutDebug(bDebug)
+	{
+		m_FreeBlocks.Reset(NumberOfPages);
+		if (bDebug) {
+			m_DebuggerPagesAvailable = PagesAbove(0, NumberOfPages, DEBUGKIT_FIRST_UPPER_HALF_PAGE);
+			m_PhysicalPagesAvailable -= m_DebuggerPagesAvailable;
+		}
+	}
+	void UpdateAvailablePages(PFN start, PFN_COUNT NumberOfPages, bool bFree)
+	{
+		PFN_COUNT DebuggerPages = m_MmLayoutDebug ? PagesAbove(start, NumberOfPages, DEBUGKIT_FIRST_UPPER_HALF_PAGE) : 0;
+		if (bFree) {
+			m_DebuggerPagesAvailable += DebuggerPages;
+			m_PhysicalPagesAvailable += NumberOfPages - DebuggerPages;
+		}
+		else {
+			m_DebuggerPagesAvailable -= DebuggerPages;
+			m_PhysicalPagesAvailable -= NumberOfPages - DebuggerPages;
+		}
+	}
+	bool RemoveFree(PFN_COUNT NumberOfPages, PFN* result, PFN_COUNT PfnAlignment, PFN start, PFN end)
+	{
+		if (!m_FreeBlocks.RemoveFree(NumberOfPages, result, PfnAlignment, start, end)) { return false; }
+		UpdateAvailablePages(*result, NumberOfPages, false);
+		return true;
+	}
+	PFN_COUNT RemoveFreeRun(PFN_COUNT NumberOfPages, PFN* result, PFN start, PFN end)
+	{
+		PFN_COUNT PfnCount = m_FreeBlocks.RemoveFreeRun(NumberOfPages, result, start, end);
+		if (PfnCount) { UpdateAvailablePages(*result, PfnCount, false); }
+		return PfnCount;
+	}
+	void InsertFree(PFN start, PFN end)
+	{
+		m_FreeBlocks.InsertFree(start, end);
+		UpdateAvailablePages(start, end - start + 1, true);
+	}
+	BlockList Blocks() const
+	{
+		return BlockList(m_FreeBlocks.Blocks().begin(), m_FreeBlocks.Blocks().end());
+	}
+};
+
+// Returns the number of operations after which the old and new state differed
+static unsigned CompareRandom(unsigned *pOperations)
+{
+	const PFN_COUNT NumberOfPages = X128M_PHYSICAL_PAGE;
+	std::mt19937 Rng(5);
+	unsigned Mismatches = 0;
+	*pOperations = 0;
+	for (unsigned Round = 0; Round < TEST_ROUNDS; Round++) {
+		bool bDebug = Round & 1;
+		OldFreeList Old(NumberOfPages);
+		FreePages New(NumberOfPages, bDebug);
+		std::vector<std::pair<PFN, PFN_COUNT>> Allocated;
+		for (unsigned Op = 0; Op < TEST_OPERATIONS; Op++) {
+			unsigned Kind = Rng() % 10;
+			if (Kind < 4) {
+				// A contiguous allocation, with or without alignment, anywhere or in a range
+				PFN_COUNT Count = 1 + ((Rng() % 4 == 0) ? Rng() % 2048 : Rng() % 16);
+				PFN_COUNT Alignment = (Rng() % 3 == 0) ? (1u << (Rng() % 6)) : 0;
+				PFN Start = Rng() % NumberOfPages;
+				PFN End = Rng() % NumberOfPages;
+				if (Start > End) {
+					std::swap(Start, End);
+				}
+				if (Rng() % 2) {
+					Start = 0;
+					End = NumberOfPages - 1;
+				}
+				PFN OldPfn = ~0u, NewPfn = ~0u;
+				bool bOld = Old.RemoveFree(Count, &OldPfn, Alignment, Start, End);
+				bool bNew = New.RemoveFree(Count, &NewPfn, Alignment, Start, End);
+				if (bOld != bNew || (bOld && OldPfn != NewPfn)) {
+					if (Mismatches < 5) {
+						printf("FAIL : round %u, RemoveFree(%u) returned %s 0x%x instead of %s 0x%x\n", Round, Count,
+							bNew ? "true" : "false", NewPfn, bOld ? "true" : "false", OldPfn);
+					}
+					Mismatches++;
+					break;
+				}
+				if (bOld) {
+					Allocated.push_back({ OldPfn, Count });
+				}
+			}
+			else if (Kind < 7) {
+				// Pages without contiguity requirements, one at a time before and a run at a time now
+				PFN_COUNT Count = 1 + Rng() % 4096;
+				PFN End = (Rng() % 2) ? NumberOfPages - 1 : Rng() % NumberOfPages;
+				std::set<PFN> OldPages, NewPages;
+				for (PFN_COUNT i = 0; i < Count; i++) {
+					PFN Pfn;
+					if (!Old.RemoveFree(1, &Pfn, 0, 0, End)) {
+						break;
+					}
+					OldPages.insert(Pfn);
+					Allocated.push_back({ Pfn, 1 });
+				}
+				PFN_COUNT Left = (PFN_COUNT)OldPages.size();
+				while (Left) {
+					PFN Pfn;
+					PFN_COUNT Taken = New.RemoveFreeRun(Left, &Pfn, 0, End);
+					if (Taken == 0) {
+						break;
+					}
+					for (PFN_COUNT i = 0; i < Taken; i++) {
+						NewPages.insert(Pfn + i);
+					}
+					Left -= Taken;
+				}
+				if (OldPages != NewPages) {
+					if (Mismatches < 5) {
+						printf("FAIL : round %u, RemoveFreeRun took %zu other pages than %zu calls to RemoveFree(1)\n", Round,
+							NewPages.size(), OldPages.size());
+					}
+					Mismatches++;
+					break;
+				}
+			}
+			else if (!Allocated.empty()) {
+				size_t i = Rng() % Allocated.size();
+				auto Block = Allocated[i];
+				Allocated[i] = Allocated.back();
+				Allocated.pop_back();
+				Old.InsertFree(Block.first, Block.first + Block.second - 1);
+				New.InsertFree(Block.first, Block.first + Block.second - 1);
+			}
+			(*pOperations)++;
+
+			BlockList Blocks = New.Blocks();
+			PFN_COUNT RetailPages = 0, DebuggerPages = 0;
+			for (const auto &Block : Blocks) {
+				PFN_COUNT Upper = bDebug ? PagesAbove(Block.first, Block.second, DEBUGKIT_FIRST_UPPER_HALF_PAGE) : 0;
+				DebuggerPages += Upper;
+				RetailPages += Block.second - Upper;
+			}
+			if (Blocks != Old.Blocks()) {
+				if (Mismatches < 5) {
+					printf("FAIL : round %u, operation %u left other free blocks than the free list\n", Round, Op);
+				}
+				Mismatches++;
+				break;
+			}
+			if (RetailPages != New.m_PhysicalPagesAvailable || DebuggerPages != New.m_DebuggerPagesAvailable) {
+				if (Mismatches < 5) {
+					printf("FAIL : round %u, operation %u counted %u retail and %u debugger pages, there are %u and %u\n", Round, Op,
+						New.m_PhysicalPagesAvailable, New.m_DebuggerPagesAvailable, RetailPages, DebuggerPages);
+				}
+				Mismatches++;
+				break;
+			}
+		}
+	}
+
+	return Mismatches;
+}
+
+// ******************************************************************
+// * Benchmark
+// ******************************************************************
+
+// Takes all pages, then frees every other run of Gap pages
+template<typename T>
+static void Fragment(T &FreeList, PFN_COUNT NumberOfPages, PFN_COUNT Gap)
+{
+	PFN Pfn;
+	while (FreeList.RemoveFree(1, &Pfn, 0, 0, NumberOfPages - 1)) {}
+	for (PFN Start = 0; Start < NumberOfPages; Start += 2 * Gap) {
+		FreeList.InsertFree(Start, Start + Gap - 1);
+	}
+}
+
+// Microseconds per call, over at least Seconds
+template<typename F>
+static double TimeCalls(double Seconds, F Call)
+{
+	using Clock = std::chrono::steady_clock;
+	unsigned Calls = 0;
+	double Elapsed;
+	auto Start = Clock::now();
+	do {
+		Call();
+		Calls++;
+		Elapsed = std::chrono::duration<double>(Clock::now() - Start).count();
+	} while (Elapsed < Seconds);
+
+	return Elapsed / Calls * 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 2 && strcmp(argv[1], "-test") == 0) {
+		unsigned failures = 0;
+		unsigned Operations;
+		unsigned Mismatches = CompareRandom(&Operations);
+		printf("%u operations over %u rounds (retail and devkit), %u mismatches\n", Operations, TEST_ROUNDS, Mismatches);
+		if (Mismatches != 0) {
+			printf("FAIL : %u rounds differed from the free list\n", Mismatches);
+			failures++;
+		}
+		printf("%u failure(s)\n", failures);
+		return failures ? 1 : 0;
+	}
+
+	double Seconds = BENCH_SECONDS;
+	if (argc > 2 || (argc == 2 && (argv[1][0] < '0' || argv[1][0] > '9'))) {
+		printf("Usage : cxbxr-pagebench [seconds per measurement]\n");
+		printf("        cxbxr-pagebench -test\n");
+		return 1;
+	}
+	if (argc == 2) {
+		Seconds = strtod(argv[1], nullptr);
+	}
+
+	const PFN_COUNT NumberOfPages = X128M_PHYSICAL_PAGE;
+	static const struct {
+		const char *Name;
+		PFN_COUNT Pages;
+		PFN_COUNT Gap; // Zero when the free pages are in one block
+	} Cases[] = {
+		{ "64 MiB, unfragmented", 0x4000, 0 },
+		{ "16 KiB, unfragmented", 4, 0 },
+		{ "64 MiB, runs of 64 pages", 0x2000, 64 },
+		{ "64 MiB, runs of 1 page", 0x2000, 1 },
+		{ "1 MiB, runs of 16 pages", 256, 16 },
+	};
+	printf("Allocate and free on %u pages\n", NumberOfPages);
+	for (const auto &Case : Cases) {
+		OldFreeList Old(NumberOfPages);
+		FreePages New(NumberOfPages, false);
+		if (Case.Gap) {
+			Fragment(Old, NumberOfPages, Case.Gap);
+			Fragment(New, NumberOfPages, Case.Gap);
+		}
+
+		std::vector<PFN> Pages;
+		double OldUs = TimeCalls(Seconds, [&]() {
+			Pages.clear();
+			PFN Pfn;
+			for (PFN_COUNT i = 0; i < Case.Pages && Old.RemoveFree(1, &Pfn, 0, 0, NumberOfPages - 1); i++) {
+				Pages.push_back(Pfn);
+			}
+			for (PFN Page : Pages) {
+				Old.InsertFree(Page, Page);
+			}
+		});
+
+		std::vector<std::pair<PFN, PFN_COUNT>> Runs;
+		double NewUs = TimeCalls(Seconds, [&]() {
+			Runs.clear();
+			PFN Pfn;
+			for (PFN_COUNT Left = Case.Pages, Taken; Left && (Taken = New.RemoveFreeRun(Left, &Pfn, 0, NumberOfPages - 1)) != 0; Left -= Taken) {
+				Runs.push_back({ Pfn, Taken });
+			}
+			for (const auto &Run : Runs) {
+				New.InsertFree(Run.first, Run.first + Run.second - 1);
+			}
+		});
+
+		printf("%-26s : free list, a page at a time %10.1f us, free blocks, a run at a time %8.2f us (%.0fx, %zu runs)\n",
+			Case.Name, OldUs, NewUs, OldUs / NewUs, Runs.size());
+	}
+
+	return 0;
+}
@@ -0,0 +1,596 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of Cxbx-Reloaded.
+// *
+// *  Cxbx-Reloaded is free software; you can redistribute it
+// *  and/or modify it under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+// Checks and times EmuFilePathCache, which CxbxObjectAttributesToNT uses to
+// skip CxbxConvertFilePath for paths it converted before.
+//
+// The file system below is a model of the one in EmuFile.cpp : drive letters
+// linked to (sub folders of) devices, device paths resolved through those
+// links, and Harddisk0 partitions and partition headers resolved to the base
+// directory. Link, Unlink and RegisterDevice flush the cache where
+// EmuNtSymbolicLinkObject::Init, its destructor and CxbxRegisterDeviceHostPath
+// do.
+//
+// The test replays a trace of opens, mixed with drive letters being linked to
+// other folders, unlinked and devices being registered, through the cache the
+// way CxbxObjectAttributesToNT does, and requires every open to resolve to
+// the same host directory and path as converting it without the cache. It
+// requires each kind of change to flush the cache, and replays the trace
+// again without flushing on each kind of link change, requiring stale results
+// then (so the trace really depends on those flushes). It also checks LRU
+// replacement, that results of a conversion that raced with a flush are
+// dropped, and that host paths which don't fit the caller's buffer miss.
+//
+// The benchmark reports the time per open of the trace with and without the
+// cache, and the hit rate.
+//
+// Usage : cxbxr-pathcachebench [opens] [seconds]
+//         cxbxr-pathcachebench -test
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "core/kernel/support/EmuFilePathCache.h"
+
+// Same as the size of NativeObjectAttributes::wszObjectName
+#define HOST_PATH_CHARS 160
+// Distinct files in the trace, and how many of them are opened most of the time
+#define TRACE_FILES 600
+#define TRACE_HOT_FILES 60
+// Opens between changes to the links or devices
+#define TRACE_CHANGE_INTERVAL 2000
+#define TEST_OPENS 200000
+
+static unsigned g_Failures = 0;
+
+static const std::string DrivePrefix = "\\??\\";
+static const std::string DevicePrefix = "\\Device\\";
+static const std::string DeviceHarddisk0 = "\\Device\\Harddisk0";
+static const std::string DeviceHarddisk0PartitionPrefix = "\\Device\\Harddisk0\\Partition";
+
+// Stand-ins for host handles, only compared
+#define BASE_PATH_HANDLE ((void *)(uintptr_t)0x100)
+#define OPEN_DIRECTORY_HANDLE ((void *)(uintptr_t)0x200)
+
+enum FileSystemChange { CHANGE_LINK, CHANGE_UNLINK, CHANGE_REGISTER, CHANGE_COUNT };
+static const char *ChangeNames[CHANGE_COUNT] = { "link", "unlink", "device registration" };
+
+struct ModelLink {
+	bool        bLinked;
+	std::string XboxPath; // The device path (or sub folder of it) the drive letter is linked to
+	void       *Handle;   // A new one on every link, like the CreateFile in EmuNtSymbolicLinkObject::Init
+};
+
+struct ModelDevice {
+	std::string XboxDevicePath;
+	std::string HostDevicePath;
+};
+
+class ModelFileSystem
+{
+public:
+	EmuFilePathCache Cache;
+	ModelLink        Links[26];
+	std::vector<ModelDevice> Devices;
+	// Cleared to check that the trace needs the flush on that kind of change
+	bool             bInvalidate[CHANGE_COUNT];
+	unsigned         Changes[CHANGE_COUNT];
+
+	ModelFileSystem() : Links(), m_NextHandle(0x1000)
+	{
+		for (int i = 0; i < CHANGE_COUNT; i++) {
+			bInvalidate[i] = true;
+			Changes[i] = 0;
+		}
+		RegisterDevice("\\Device\\CdRom0", "xbe");
+		for (int i = 1; i <= 7; i++) {
+			RegisterDevice(DeviceHarddisk0PartitionPrefix + std::to_string(i), "Partition" + std::to_string(i));
+		}
+		Changes[CHANGE_REGISTER] = 0;
+		Link('D', "\\Device\\CdRom0");
+		Link('C', "\\Device\\Harddisk0\\Partition2");
+		Link('E', "\\Device\\Harddisk0\\Partition1");
+		Link('T', "\\Device\\Harddisk0\\Partition1\\TDATA\\4d530004");
+		Link('U', "\\Device\\Harddisk0\\Partition1\\UDATA\\4d530004");
+		Link('Z', "\\Device\\Harddisk0\\Partition5");
+		Changes[CHANGE_LINK] = 0;
+	}
+
+	// As CxbxRegisterDeviceHostPath
+	void RegisterDevice(const std::string &XboxDevicePath, const std::string &HostDevicePath)
+	{
+		Devices.push_back({ XboxDevicePath, HostDevicePath });
+		Changes[CHANGE_REGISTER]++;
+		if (bInvalidate[CHANGE_REGISTER]) {
+			Cache.Invalidate();
+		}
+	}
+
+	// As EmuNtSymbolicLinkObject::Init
+	bool Link(char DriveLetter, const std::string &XboxPath)
+	{
+		ModelLink &link = Links[DriveLetter - 'A'];
+		if (link.bLinked || DeviceIndexByDevicePath(XboxPath) < 0) {
+			return false;
+		}
+		link.bLinked = true;
+		link.XboxPath = XboxPath;
+		link.Handle = (void *)m_NextHandle;
+		m_NextHandle += 4;
+		Changes[CHANGE_LINK]++;
+		if (bInvalidate[CHANGE_LINK]) {
+			Cache.Invalidate();
+		}
+		return true;
+	}
+
+	// As ~EmuNtSymbolicLinkObject
+	void Unlink(char DriveLetter)
+	{
+		ModelLink &link = Links[DriveLetter - 'A'];
+		if (!link.bLinked) {
+			return;
+		}
+		link.bLinked = false;
+		Changes[CHANGE_UNLINK]++;
+		if (bInvalidate[CHANGE_UNLINK]) {
+			Cache.Invalidate();
+		}
+	}
+
+	// The resolution of CxbxConvertFilePath, for the paths the trace uses
+	bool ConvertFilePath(const std::string &OriginalPath, void **pRootDirectory, bool bPartitionHeader, std::wstring &RelativeHostPath) const
+	{
+		std::string RelativePath = OriginalPath;
+		if (RelativePath.compare(0, DrivePrefix.length(), DrivePrefix) == 0) {
+			RelativePath.erase(0, DrivePrefix.length());
+		}
+
+		const ModelLink *pLink = nullptr;
+		if (bPartitionHeader) {
+			*pRootDirectory = BASE_PATH_HANDLE;
+			RelativePath = RelativePath.substr(DeviceHarddisk0.length()) + ".bin";
+		} else if (RelativePath.length() >= 2 && RelativePath[1] == ':') {
+			pLink = LinkByDriveLetter(RelativePath[0]);
+			RelativePath.erase(0, 2);
+			if (pLink == nullptr) {
+				return false;
+			}
+		} else if (RelativePath.compare(0, DevicePrefix.length(), DevicePrefix) == 0) {
+			pLink = LinkByDevice(RelativePath);
+			if (pLink != nullptr) {
+				RelativePath.erase(0, pLink->XboxPath.length());
+			} else if (RelativePath.compare(0, DeviceHarddisk0PartitionPrefix.length(), DeviceHarddisk0PartitionPrefix) == 0) {
+				RelativePath.erase(0, DeviceHarddisk0.length() + 1);
+				*pRootDirectory = BASE_PATH_HANDLE;
+			} else {
+				return false;
+			}
+		} else if (*pRootDirectory == nullptr) {
+			// Relative to the Xbe path
+			pLink = LinkByDriveLetter('D');
+			if (pLink == nullptr) {
+				return false;
+			}
+		}
+		// else the path is relative to the given RootDirectory
+
+		if (pLink != nullptr) {
+			*pRootDirectory = pLink->Handle;
+		}
+		if (RelativePath.length() > 0 && RelativePath[0] == '\\') {
+			RelativePath.erase(0, 1);
+		}
+		size_t Pos;
+		while ((Pos = RelativePath.find("\\\\")) != std::string::npos) {
+			RelativePath.erase(Pos, 1);
+		}
+
+		RelativeHostPath.assign(RelativePath.begin(), RelativePath.end());
+		return true;
+	}
+
+private:
+	int DeviceIndexByDevicePath(const std::string &XboxDevicePath) const
+	{
+		for (size_t i = 0; i < Devices.size(); i++) {
+			if (XboxDevicePath.compare(0, Devices[i].XboxDevicePath.length(), Devices[i].XboxDevicePath) == 0) {
+				return (int)i;
+			}
+		}
+		return -1;
+	}
+
+	const ModelLink *LinkByDriveLetter(char DriveLetter) const
+	{
+		if (DriveLetter >= 'a' && DriveLetter <= 'z') {
+			DriveLetter -= 'a' - 'A';
+		}
+		if (DriveLetter < 'A' || DriveLetter > 'Z' || !Links[DriveLetter - 'A'].bLinked) {
+			return nullptr;
+		}
+		return &Links[DriveLetter - 'A'];
+	}
+
+	// As FindNtSymbolicLinkObjectByDevice, the first link the path starts with
+	const ModelLink *LinkByDevice(const std::string &XboxPath) const
+	{
+		for (const ModelLink &link : Links) {
+			if (link.bLinked && XboxPath.compare(0, link.XboxPath.length(), link.XboxPath) == 0) {
+				return &link;
+			}
+		}
+		return nullptr;
+	}
+
+	uintptr_t m_NextHandle;
+};
+
+struct TraceOpen {
+	std::string Path;
+	void       *RootDirectory;
+	bool        bPartitionHeader;
+	int         Change;      // CHANGE_COUNT for an open, otherwise the change made instead
+	char        DriveLetter; // Of a link change
+	std::string LinkPath;    // Of a link, or the device path of a registration
+};
+
+struct Resolution {
+	bool         bOk;
+	void        *RootDirectory;
+	std::wstring HostPath;
+
+	bool operator==(const Resolution &Other) const
+	{
+		return bOk == Other.bOk && (!bOk || (RootDirectory == Other.RootDirectory && HostPath == Other.HostPath));
+	}
+};
+
+static std::string RandomFilePath(std::mt19937 &rng, unsigned File, void **pRootDirectory, bool *pbPartitionHeader)
+{
+	static const char *Folders[] = { "media", "media\\textures", "sound\\music", "levels\\level1", "data" };
+	std::string Name = std::string(Folders[File % 5]) + "\\file" + std::to_string(File) + ".bin";
+	*pRootDirectory = nullptr;
+	*pbPartitionHeader = false;
+	switch (rng() % 10) {
+	case 0: return DrivePrefix + "D:\\" + Name;
+	case 1: return "d:\\" + Name;
+	case 2: return DrivePrefix + "T:\\" + Name;
+	case 3: return DrivePrefix + "U:\\saves\\" + Name;
+	case 4: return DrivePrefix + "Z:\\cache\\" + Name;
+	case 5: return "\\Device\\Harddisk0\\Partition1\\TDATA\\4d530004\\" + Name;
+	case 6: return "\\Device\\Harddisk0\\Partition6\\" + Name;
+	case 7: return Name;
+	case 8:
+		*pRootDirectory = OPEN_DIRECTORY_HANDLE;
+		return Name;
+	default:
+		*pbPartitionHeader = (File % 3 == 0);
+		return DeviceHarddisk0PartitionPrefix + std::to_string(1 + File % 7) + (*pbPartitionHeader ? "" : "\\" + Name);
+	}
+}
+
+// Opens of TRACE_FILES files (mostly the hot ones), each always opened the same way, with a
+// change to the links or devices every TRACE_CHANGE_INTERVAL opens
+static std::vector<TraceOpen> MakeTrace(unsigned OpenCount, bool bChanges)
+{
+	std::mt19937 rng(0xF11E);
+	std::vector<TraceOpen> Files(TRACE_FILES);
+	for (unsigned i = 0; i < TRACE_FILES; i++) {
+		Files[i].Path = RandomFilePath(rng, i, &Files[i].RootDirectory, &Files[i].bPartitionHeader);
+		Files[i].Change = CHANGE_COUNT;
+	}
+
+	std::vector<TraceOpen> Trace;
+	Trace.reserve(OpenCount + OpenCount / TRACE_CHANGE_INTERVAL * 2);
+	static const char ChangingDrives[] = { 'T', 'U', 'Z', 'D' };
+	unsigned NextPartition = 8;
+	for (unsigned i = 0; i < OpenCount; i++) {
+		if (bChanges && i % TRACE_CHANGE_INTERVAL == TRACE_CHANGE_INTERVAL - 1) {
+			TraceOpen Change = {};
+			Change.DriveLetter = ChangingDrives[rng() % 4];
+			if (rng() % 4 == 0) {
+				Change.Change = CHANGE_REGISTER;
+				Change.LinkPath = DeviceHarddisk0PartitionPrefix + std::to_string(NextPartition++);
+				Trace.push_back(Change);
+			} else {
+				// Relinking takes an unlink first (see CxbxCreateSymbolicLink), and some opens
+				// while the drive is gone
+				Change.Change = CHANGE_UNLINK;
+				Trace.push_back(Change);
+				for (unsigned j = 0; j < 50; j++) {
+					Trace.push_back(Files[rng() % TRACE_HOT_FILES]);
+				}
+				Change.Change = CHANGE_LINK;
+				// (Partition6 is reached through the base directory while no drive is linked to it)
+				static const char *Partitions[] = { "1", "2", "6" };
+				Change.LinkPath = (Change.DriveLetter == 'D') ? "\\Device\\CdRom0" :
+					DeviceHarddisk0PartitionPrefix + Partitions[rng() % 3] + ((rng() % 2) ? "\\TDATA\\4d530004" : "");
+				Trace.push_back(Change);
+			}
+		}
+		Trace.push_back(Files[(rng() % 8 != 0) ? rng() % TRACE_HOT_FILES : rng() % TRACE_FILES]);
+	}
+	return Trace;
+}
+
+static void ApplyChange(ModelFileSystem &FileSystem, const TraceOpen &Change)
+{
+	switch (Change.Change) {
+	case CHANGE_LINK: FileSystem.Link(Change.DriveLetter, Change.LinkPath); break;
+	case CHANGE_UNLINK: FileSystem.Unlink(Change.DriveLetter); break;
+	case CHANGE_REGISTER: FileSystem.RegisterDevice(Change.LinkPath, "Partition" + Change.LinkPath.substr(DeviceHarddisk0PartitionPrefix.length())); break;
+	}
+}
+
+static Resolution OpenUncached(const ModelFileSystem &FileSystem, const TraceOpen &Open)
+{
+	Resolution Result;
+	Result.RootDirectory = Open.RootDirectory;
+	Result.bOk = FileSystem.ConvertFilePath(Open.Path, &Result.RootDirectory, Open.bPartitionHeader, Result.HostPath);
+	return Result;
+}
+
+// As CxbxObjectAttributesToNT
+static Resolution OpenCached(ModelFileSystem &FileSystem, const TraceOpen &Open)
+{
+	const char *XboxPath = Open.Path.c_str();
+	size_t XboxPathLength = Open.Path.length();
+	if (XboxPathLength >= DrivePrefix.length() && memcmp(XboxPath, DrivePrefix.c_str(), DrivePrefix.length()) == 0) {
+		XboxPath += DrivePrefix.length();
+		XboxPathLength -= DrivePrefix.length();
+	}
+
+	Resolution Result;
+	Result.RootDirectory = Open.RootDirectory;
+	bool bCacheable = XboxPathLength < PATH_CACHE_MAX_PATH;
+	uint32_t CacheGeneration = 0;
+	wchar_t HostPath[HOST_PATH_CHARS];
+	if (bCacheable && FileSystem.Cache.Lookup(XboxPath, XboxPathLength, Open.RootDirectory, Open.bPartitionHeader,
+		&Result.RootDirectory, HostPath, HOST_PATH_CHARS, &CacheGeneration)) {
+		Result.bOk = true;
+		Result.HostPath = HostPath;
+		return Result;
+	}
+
+	Result.bOk = FileSystem.ConvertFilePath(Open.Path, &Result.RootDirectory, Open.bPartitionHeader, Result.HostPath);
+	if (Result.bOk && bCacheable) {
+		FileSystem.Cache.Insert(CacheGeneration, XboxPath, XboxPathLength, Open.RootDirectory, Open.bPartitionHeader, Result.RootDirectory, Result.HostPath);
+	}
+	return Result;
+}
+
+// Replays the trace through the cache, and returns the number of opens resolved differently than without it
+static unsigned ReplayCompare(ModelFileSystem &FileSystem, const std::vector<TraceOpen> &Trace, bool bCheckFlushes)
+{
+	unsigned Mismatches = 0;
+	for (size_t i = 0; i < Trace.size(); i++) {
+		const TraceOpen &Open = Trace[i];
+		if (Open.Change != CHANGE_COUNT) {
+			uint64_t Misses = FileSystem.Cache.GetMisses();
+			ApplyChange(FileSystem, Open);
+			if (!bCheckFlushes) {
+				continue;
+			}
+			// Opening a file of the previous interval must not hit anymore
+			const TraceOpen &Previous = Trace[i - 1];
+			OpenCached(FileSystem, Previous);
+			if (FileSystem.Cache.GetMisses() == Misses) {
+				printf("FAIL : Cache not flushed on a %s (open %zu)\n", ChangeNames[Open.Change], i);
+				g_Failures++;
+			}
+			continue;
+		}
+
+		if (!(OpenCached(FileSystem, Open) == OpenUncached(FileSystem, Open))) {
+			if (bCheckFlushes && Mismatches < 5) {
+				printf("FAIL : \"%s\" resolved differently through the cache (open %zu)\n", Open.Path.c_str(), i);
+			}
+			Mismatches++;
+		}
+	}
+	return Mismatches;
+}
+
+static void TestTrace()
+{
+	std::vector<TraceOpen> Trace = MakeTrace(TEST_OPENS, true);
+
+	ModelFileSystem FileSystem;
+	unsigned Mismatches = ReplayCompare(FileSystem, Trace, true);
+	if (Mismatches != 0) {
+		printf("FAIL : %u of the opens resolved differently through the cache\n", Mismatches);
+		g_Failures++;
+	}
+	for (int i = 0; i < CHANGE_COUNT; i++) {
+		if (FileSystem.Changes[i] == 0) {
+			printf("FAIL : The trace has no %s\n", ChangeNames[i]);
+			g_Failures++;
+		}
+	}
+	uint64_t Hits = FileSystem.Cache.GetHits();
+	uint64_t Misses = FileSystem.Cache.GetMisses();
+	if (Hits < (Hits + Misses) * 4 / 5) {
+		printf("FAIL : Only %llu of %llu lookups hit\n", (unsigned long long)Hits, (unsigned long long)(Hits + Misses));
+		g_Failures++;
+	}
+
+	// Registering a device doesn't change any resolution by itself (links copy what they need when they're
+	// created), so there's nothing stale to detect; the flush itself is checked above
+	for (int Change : { CHANGE_LINK, CHANGE_UNLINK }) {
+		ModelFileSystem Unflushed;
+		Unflushed.bInvalidate[Change] = false;
+		if (ReplayCompare(Unflushed, Trace, false) == 0) {
+			printf("FAIL : The trace doesn't depend on flushing the cache on a %s\n", ChangeNames[Change]);
+			g_Failures++;
+		}
+	}
+}
+
+static bool TestLookup(EmuFilePathCache &Cache, const std::string &XboxPath, void *ExpectedRoot, const std::wstring &Expected, size_t HostPathChars = HOST_PATH_CHARS)
+{
+	void *HostRoot = nullptr;
+	wchar_t HostPath[HOST_PATH_CHARS];
+	uint32_t Generation;
+	if (!Cache.Lookup(XboxPath.c_str(), XboxPath.length(), nullptr, false, &HostRoot, HostPath, HostPathChars, &Generation)) {
+		return false;
+	}
+	if (HostRoot != ExpectedRoot || Expected != HostPath) {
+		printf("FAIL : Wrong cached result for \"%s\"\n", XboxPath.c_str());
+		g_Failures++;
+	}
+	return true;
+}
+
+static void Insert(EmuFilePathCache &Cache, const std::string &XboxPath, void *HostRoot, const std::wstring &HostPath)
+{
+	void *Root;
+	wchar_t Buffer[HOST_PATH_CHARS];
+	uint32_t Generation;
+	Cache.Lookup(XboxPath.c_str(), XboxPath.length(), nullptr, false, &Root, Buffer, HOST_PATH_CHARS, &Generation);
+	Cache.Insert(Generation, XboxPath.c_str(), XboxPath.length(), nullptr, false, HostRoot, HostPath);
+}
+
+static void TestCache()
+{
+	EmuFilePathCache Cache;
+
+	// The least recently used entries are replaced first
+	for (unsigned i = 0; i < PATH_CACHE_ENTRIES; i++) {
+		Insert(Cache, "D:\\file" + std::to_string(i), (void *)(uintptr_t)(i * 4 + 4), L"file" + std::to_wstring(i));
+	}
+	for (unsigned i = 0; i < PATH_CACHE_ENTRIES / 2; i++) {
+		if (!TestLookup(Cache, "D:\\file" + std::to_string(i), (void *)(uintptr_t)(i * 4 + 4), L"file" + std::to_wstring(i))) {
+			printf("FAIL : Entry %u missing before the cache got full\n", i);
+			g_Failures++;
+		}
+	}
+	for (unsigned i = PATH_CACHE_ENTRIES; i < PATH_CACHE_ENTRIES * 3 / 2; i++) {
+		Insert(Cache, "D:\\file" + std::to_string(i), (void *)(uintptr_t)(i * 4 + 4), L"file" + std::to_wstring(i));
+	}
+	for (unsigned i = 0; i < PATH_CACHE_ENTRIES * 3 / 2; i++) {
+		bool bExpected = (i < PATH_CACHE_ENTRIES / 2) || (i >= PATH_CACHE_ENTRIES);
+		if (TestLookup(Cache, "D:\\file" + std::to_string(i), (void *)(uintptr_t)(i * 4 + 4), L"file" + std::to_wstring(i)) != bExpected) {
+			printf("FAIL : Entry %u %s after replacements\n", i, bExpected ? "missing" : "not replaced");
+			g_Failures++;
+		}
+	}
+
+	// A host path that doesn't fit the caller's buffer misses
+	std::wstring Long(100, L'x');
+	Insert(Cache, "D:\\long", nullptr, Long);
+	if (TestLookup(Cache, "D:\\long", nullptr, Long, Long.length())) {
+		printf("FAIL : Host path longer than the buffer returned\n");
+		g_Failures++;
+	}
+	if (!TestLookup(Cache, "D:\\long", nullptr, Long, Long.length() + 1)) {
+		printf("FAIL : Host path that just fits missed\n");
+		g_Failures++;
+	}
+
+	// A conversion that raced with a flush isn't kept
+	void *Root;
+	wchar_t Buffer[HOST_PATH_CHARS];
+	uint32_t Generation;
+	std::string Raced = "D:\\raced";
+	Cache.Lookup(Raced.c_str(), Raced.length(), nullptr, false, &Root, Buffer, HOST_PATH_CHARS, &Generation);
+	Cache.Invalidate();
+	Cache.Insert(Generation, Raced.c_str(), Raced.length(), nullptr, false, nullptr, L"stale");
+	if (TestLookup(Cache, Raced, nullptr, L"stale")) {
+		printf("FAIL : Result of a conversion that raced with a flush kept\n");
+		g_Failures++;
+	}
+	if (TestLookup(Cache, "D:\\file0", (void *)(uintptr_t)4, L"file0")) {
+		printf("FAIL : Entry kept after a flush\n");
+		g_Failures++;
+	}
+}
+
+typedef std::chrono::steady_clock BenchClock;
+
+// Replays the trace over and over for the given time, and returns the nanoseconds per open
+template<typename Opener>
+static double Measure(double Seconds, const std::vector<TraceOpen> &Trace, Opener Open)
+{
+	uint64_t Opens = 0;
+	size_t Total = 0;
+	auto Start = BenchClock::now();
+	double Elapsed;
+	do {
+		for (const TraceOpen &Item : Trace) {
+			Total += Open(Item).HostPath.length();
+		}
+		Opens += Trace.size();
+		Elapsed = std::chrono::duration<double>(BenchClock::now() - Start).count();
+	} while (Elapsed < Seconds);
+	if (Total == 0) {
+		printf("No paths resolved\n");
+	}
+	return Elapsed * 1e9 / (double)Opens;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 2 && strcmp(argv[1], "-test") == 0) {
+		TestCache();
+		TestTrace();
+		printf("%u failure(s)\n", g_Failures);
+		return g_Failures ? 1 : 0;
+	}
+
+	if (argc > 1 && (argv[1][0] < '0' || argv[1][0] > '9')) {
+		printf("Usage : cxbxr-pathcachebench [opens] [seconds]\n");
+		printf("        cxbxr-pathcachebench -test\n");
+		return 1;
+	}
+
+	unsigned OpenCount = (argc > 1) ? (unsigned)atoi(argv[1]) : TEST_OPENS;
+	double Seconds = (argc > 2) ? atof(argv[2]) : 1.0;
+	if (OpenCount == 0) {
+		OpenCount = 1;
+	}
+
+	// Without the changes, which only disturb the cached replay
+	std::vector<TraceOpen> Trace = MakeTrace(OpenCount, false);
+	ModelFileSystem FileSystem;
+
+	printf("%u opens of %u files, ns per open\n", OpenCount, TRACE_FILES);
+	double Uncached = Measure(Seconds, Trace, [&](const TraceOpen &Open) { return OpenUncached(FileSystem, Open); });
+	printf("%-24s %10.1f\n", "CxbxConvertFilePath", Uncached);
+	double Cached = Measure(Seconds, Trace, [&](const TraceOpen &Open) { return OpenCached(FileSystem, Open); });
+	printf("%-24s %10.1f\n", "EmuFilePathCache", Cached);
+
+	uint64_t Hits = FileSystem.Cache.GetHits();
+	uint64_t Misses = FileSystem.Cache.GetMisses();
+	printf("%-24s %9.1f%%\n", "Hit rate", 100.0 * (double)Hits / (double)(Hits + Misses));
+
+	return 0;
+}
@@ -0,0 +1,1087 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of Cxbx-Reloaded.
+// *
+// *  Cxbx-Reloaded is free software; you can redistribute it
+// *  and/or modify it under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+// Headless replay of pushbuffer captures (see nv2a_pbcapture.h), made with
+// F2 while running a title. The captured command stream is fed through
+// the same pushbuffer parser as EmuExecutePushBufferRaw and
+// pfifo_run_pusher, and from there down the same path as in the emulator :
+// methods of HLE chunks go straight to PGRAPH (only those for subchannel
+// 0, like EmuExecutePushBufferRaw does), while methods of LLE chunks are
+// queued in PFIFO CACHE1 and drained in batches by the PFIFO puller (see
+// nv2a_fifo.h), which resolves object handles and binds subchannels. In
+// PGRAPH every method selects the object of its subchannel, like
+// pgraph_handle_method does, and is then handed to a null renderer that
+// stands in for the per-class method handlers (which need OpenGL), and
+// only tracks method state. Before each frame the captured PGRAPH
+// registers are restored, and before each command chunk the guest memory
+// its draws read is restored, so draws see the textures they saw while
+// capturing. Texture fetches go through a texture cache validated like
+// the one of PGRAPH (see nv2a_texture_cache.h, where restoring memory
+// stands in for the writes nv2a_write_watch reports), which reports hits,
+// misses and upload sizes per frame. This allows benchmarking (and
+// regression testing) the method dispatch without a GPU, and doesn't
+// depend on Windows, so it can be built on any platform.
+//
+// Captures don't hold RAMIN, so objects are made up : each handle gets an
+// instance in a RAMHT of the replay's own, of the class the captured
+// registers have bound to the subchannel it's first bound to (or of no
+// class, for handles that are only passed to methods, like DMA objects).
+//
+// The test replays a capture, and requires the null renderer to get the
+// very same methods as when handing it every method straight from the
+// parser (with object handles resolved), the puller to empty CACHE1 after
+// every chunk, and every method pushed to be pulled. Before that, it
+// checks the texture cache validation on made up writes, including writes
+// that aren't tracked (like those through other views of guest memory),
+// which must be found once the texture went unvalidated for too long.
+//
+// The round trip test writes a capture again, through the same writer as
+// the emulator (see nv2a_pbcapture_writer.h), with LLE chunks consumed in
+// interrupted pusher runs and memory recorded twice, and requires reading
+// it back to give the same frames, commands and memory. It does so twice
+// with the same writer, where the second time each LLE chunk is consumed
+// in a single run, which the writer would skip if it kept the pusher
+// position the first capture left off at.
+//
+// Usage : cxbxr-pbreplay <capture file> [repeat count]
+//         cxbxr-pbreplay -test <capture file>
+//         cxbxr-pbreplay -roundtrip <capture file>
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#define NV2A_PBCAPTURE_FORMAT_ONLY
+#include "devices/video/nv2a_pbcapture.h"
+#include "devices/video/nv2a_pbcapture_writer.h"
+#include "devices/video/nv2a_fifo.h"
+#include "devices/video/nv2a_pushbuffer.h"
+#include "devices/video/nv2a_regs.h" // For NV097_* methods
+#include "devices/video/nv2a_texture_cache.h"
+
+#define REPLAY_CONTIGUOUS_MEMORY_BASE 0x80000000 // = CONTIGUOUS_MEMORY_BASE
+#define REPLAY_METHOD_COUNT (0x2000 / 4)
+
+#define REPLAY_TEXTURES 4 // = NV2A_MAX_TEXTURES
+
+#define REPLAY_PGRAPH_SIZE 0x2000 // = NV_PGRAPH_SIZE
+#define REPLAY_PFIFO_SIZE 0x2000 // = _NV_PFIFO_SIZE
+#define REPLAY_RAMIN_SIZE 0x100000 // = NV_PRAMIN_SIZE
+#define REPLAY_OBJECT_SIZE 16 // The part of an object PGRAPH loads on NV_SET_OBJECT
+#define REPLAY_FIRST_INSTANCE 0x10000 // Made up objects are placed from here on
+
+#define ROUNDTRIP_FILE_NAME "cxbxr-pbreplay-roundtrip.nv2a" // Written to the working directory, and removed afterwards
+
+struct ReplayChunk {
+	const NV2APBCaptureChunk *header;
+	uint32_t *words;
+	std::vector<const NV2APBCaptureChunk *> memory; // Guest memory read by the draws in this chunk
+};
+
+struct ReplayFrame {
+	const uint32_t *pgraph_regs;
+	std::vector<ReplayChunk> commands;
+	unsigned int memory_chunk_count;
+	const NV2APBCaptureStats *stats; // Emulator counters while capturing, if recorded
+};
+
+// A method as handed to the null renderer
+struct ReplayMethod {
+	uint32_t subchannel;
+	uint32_t method;
+	uint32_t parameter;
+};
+
+static uint64_t HashMemory(const uint8_t *data, size_t size)
+{
+	// FNV-1a
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ data[i]) * 0x100000001b3ull;
+	}
+
+	return hash;
+}
+
+// Null renderer : keeps a shadow of the last parameter written to each
+// method of each subchannel, and counts methods, draws and vertices.
+// Texture state lives in the PGRAPH registers, just like in PGRAPH.
+struct NullRenderer {
+	uint32_t shadow[NV2A_NUM_SUBCHANNELS][REPLAY_METHOD_COUNT];
+	uint64_t method_counts[NV2A_NUM_SUBCHANNELS][REPLAY_METHOD_COUNT];
+	uint32_t method_classes[NV2A_NUM_SUBCHANNELS][REPLAY_METHOD_COUNT]; // Graphics class of the last object each method was for
+	uint64_t draw_count;
+	uint64_t vertex_count;
+	std::vector<ReplayMethod> *trace; // If set, receives every method (for the test)
+
+	std::vector<uint32_t> regs; // Indexed like PGRAPHState.regs (by register address)
+	std::vector<uint8_t> vram; // Restored from MEMORY chunks
+	std::unordered_map<uint32_t, uint32_t> texture_sizes; // Size of the texture captured at each offset
+	std::unordered_map<uint64_t, NV2ATextureValidation> texture_cache; // Textures 'uploaded', by size and offset
+	std::vector<uint32_t> memory_page_generation; // Like PGRAPHState.memory_page_generation
+	uint32_t memory_generation;
+	uint32_t frame_number;
+	NV2ATextureCacheCounters texture_counters;
+	uint64_t texture_uncaptured;
+
+	void StartFrame(const uint32_t *pgraph_regs, uint32_t register_count)
+	{
+		memcpy(regs.data(), pgraph_regs, register_count * sizeof(uint32_t));
+		frame_number++;
+	}
+
+	void RestoreMemory(const NV2APBCaptureChunk *memory)
+	{
+		memcpy(vram.data() + memory->address, memory + 1, memory->size);
+		if (memory->flags == NV2A_PBCAPTURE_MEMORY_TEXTURE) {
+			texture_sizes[memory->address] = memory->size;
+		}
+
+		// Where the emulator would have seen CPU writes
+		nv2a_texture_cache_mark_written(memory_page_generation, ++memory_generation, memory->address, memory->size);
+	}
+
+	void FetchTextures()
+	{
+		for (unsigned int i = 0; i < REPLAY_TEXTURES; i++) {
+			if (!(regs[NV_PGRAPH_TEXCTL0_0 + i * 4] & NV_PGRAPH_TEXCTL0_0_ENABLE)) {
+				continue;
+			}
+
+			uint32_t offset = regs[NV_PGRAPH_TEXOFFSET0 + i * 4];
+			auto size = texture_sizes.find(offset);
+			if (size == texture_sizes.end()) {
+				texture_uncaptured++;
+				continue;
+			}
+
+			// Like pgraph_bind_textures
+			uint64_t key = ((uint64_t)size->second << 32) | offset;
+			auto texture = texture_cache.find(key);
+			if (texture == texture_cache.end()) {
+				NV2ATextureValidation validation = {};
+				nv2a_texture_cache_uploaded(validation, HashMemory(vram.data() + offset, size->second), size->second, memory_generation, frame_number, texture_counters);
+				texture_cache.emplace(key, validation);
+				continue;
+			}
+
+			NV2ATextureCheck check = nv2a_texture_cache_check(texture->second, memory_page_generation, frame_number, offset, 0, 0);
+			if (check == NV2A_TEXTURE_CURRENT) {
+				texture_counters.hits++;
+			} else {
+				nv2a_texture_cache_revalidate(texture->second, check, HashMemory(vram.data() + offset, size->second), memory_generation, frame_number, texture_counters);
+			}
+		}
+	}
+
+	void Method(uint32_t graphics_class, uint32_t subchannel, uint32_t method, uint32_t parameter)
+	{
+		uint32_t mthd = method >> 2;
+		shadow[subchannel][mthd] = parameter;
+		method_counts[subchannel][mthd]++;
+		method_classes[subchannel][mthd] = graphics_class;
+		if (trace != nullptr) {
+			trace->push_back({ subchannel, method, parameter });
+		}
+
+		// Only the 3D class draws
+		if (graphics_class != NV_KELVIN_PRIMITIVE) {
+			return;
+		}
+
+		if (method >= NV097_SET_TEXTURE_OFFSET && method < NV097_SET_TEXTURE_OFFSET + REPLAY_TEXTURES * 64) {
+			uint32_t slot = (method - NV097_SET_TEXTURE_OFFSET) / 64;
+			switch (method - slot * 64) {
+			case NV097_SET_TEXTURE_OFFSET:
+				regs[NV_PGRAPH_TEXOFFSET0 + slot * 4] = parameter;
+				break;
+			case NV097_SET_TEXTURE_CONTROL0:
+				regs[NV_PGRAPH_TEXCTL0_0 + slot * 4] = parameter;
+				break;
+			}
+		}
+
+		switch (method) {
+		case NV097_SET_BEGIN_END:
+			if (parameter != NV097_SET_BEGIN_END_OP_END) {
+				draw_count++;
+			} else {
+				FetchTextures();
+			}
+			break;
+		case NV097_ARRAY_ELEMENT16:
+			vertex_count += 2;
+			break;
+		case NV097_ARRAY_ELEMENT32:
+			vertex_count += 1;
+			break;
+		case NV097_DRAW_ARRAYS:
+			vertex_count += ((parameter & NV097_DRAW_ARRAYS_COUNT) >> 24) + 1;
+			break;
+		}
+	}
+};
+
+static uint32_t *ChunkJumpTarget(const ReplayChunk *chunk, uint32_t address)
+{
+	// The parser keeps the original end of data after a jump, so jumps
+	// can only be followed within the chunk that's being replayed
+	uint32_t target = address;
+	if (chunk->header->flags == NV2A_PBCAPTURE_COMMANDS_HLE) {
+		target |= REPLAY_CONTIGUOUS_MEMORY_BASE;
+	}
+
+	if (target >= chunk->header->address && target - chunk->header->address < chunk->header->size) {
+		return chunk->words + (target - chunk->header->address) / 4;
+	}
+
+	return nullptr;
+}
+
+// Methods of LLE chunks that pfifo_run_pusher queues, but that the puller doesn't hand to an engine
+static bool IsDroppedMethod(uint32_t method)
+{
+	return method != NV_SET_OBJECT && method < 0x100;
+}
+
+// Methods the puller resolves the (handle) parameter of, see nv2a_puller_fill_batch
+static bool IsObjectMethod(uint32_t method)
+{
+	return method == NV_SET_OBJECT || (method >= 0x180 && method < 0x200);
+}
+
+// PFIFO and the front of PGRAPH : serves as the handler of the pushbuffer
+// parser (like HLEPushBufferHandler for HLE chunks, and pfifo_run_pusher
+// for LLE chunks), and as the backend of the puller (like pfifo_run_puller)
+struct ReplayNV2A {
+	NullRenderer *renderer;
+	const ReplayChunk *chunk;
+	uint64_t event_counts[NV_PUSHER_EVENT_JUMP_TARGET_UNAVAILABLE + 1];
+
+	std::vector<uint32_t> pfifo_regs; // Indexed like PFIFOState.regs (by register address)
+	std::vector<uint8_t> ramin;
+	std::unordered_map<uint32_t, RAMHTEntry> ramht; // Made up objects, by handle
+	uint32_t next_instance;
+
+	uint64_t methods_pushed;
+	uint64_t methods_pulled;
+	uint64_t methods_dropped;
+	uint64_t batches_pulled;
+	int largest_batch;
+	uint64_t pusher_stalls; // Times CACHE1 filled up
+	uint64_t context_switches;
+	uint64_t bad_objects; // HLE object binds outside of RAMIN (skipped)
+
+	void Init(NullRenderer *null_renderer)
+	{
+		renderer = null_renderer;
+		pfifo_regs.assign(REPLAY_PFIFO_SIZE, 0);
+		ramin.assign(REPLAY_RAMIN_SIZE, 0);
+		next_instance = REPLAY_FIRST_INSTANCE;
+
+		pfifo_regs[NV_PFIFO_CACHE1_STATUS] = NV_PFIFO_CACHE1_STATUS_LOW_MARK;
+		pfifo_regs[NV_PFIFO_CACHE1_PULL0] = NV_PFIFO_CACHE1_PULL0_ACCESS;
+		// Subchannels were bound to PGRAPH before the capture started (it's the only engine there is)
+		for (uint32_t subchannel = 0; subchannel < NV2A_NUM_SUBCHANNELS; subchannel++) {
+			nv2a_fifo_set_mask(pfifo_regs[NV_PFIFO_CACHE1_ENGINE], 3 << (4 * subchannel), ENGINE_GRAPHICS);
+		}
+	}
+
+	uint32_t ChannelId()
+	{
+		return nv2a_fifo_get_mask(renderer->regs[NV_PGRAPH_CTX_USER], NV_PGRAPH_CTX_USER_CHID);
+	}
+
+	void DefineObject(uint32_t handle, uint32_t graphics_class)
+	{
+		if (ramht.count(handle) || next_instance + REPLAY_OBJECT_SIZE > REPLAY_RAMIN_SIZE) {
+			return;
+		}
+
+		RAMHTEntry entry = {};
+		entry.handle = handle;
+		entry.instance = next_instance;
+		entry.engine = ENGINE_GRAPHICS;
+		entry.channel_id = ChannelId();
+		entry.valid = true;
+		ramht[handle] = entry;
+
+		uint32_t ctx_1 = 0;
+		nv2a_fifo_set_mask(ctx_1, NV_PGRAPH_CTX_SWITCH1_GRCLASS, graphics_class);
+		memcpy(ramin.data() + next_instance, &ctx_1, sizeof(ctx_1));
+		next_instance += REPLAY_OBJECT_SIZE;
+	}
+
+	// PGRAPH : selects the object, like pgraph_handle_method, then hands the method to the null renderer
+	void Dispatch(uint32_t subchannel, uint32_t method, uint32_t parameter)
+	{
+		if (method == NV_SET_OBJECT && parameter > REPLAY_RAMIN_SIZE - REPLAY_OBJECT_SIZE) {
+			bad_objects++;
+			return;
+		}
+
+		uint32_t graphics_class = nv2a_pgraph_select_object(renderer->regs.data(), ramin.data(), subchannel, method, parameter);
+		renderer->Method(graphics_class, subchannel, method, parameter);
+	}
+
+	// Stands in for pgraph_switch_context and the interrupt handler it waits for
+	void SwitchContext(uint32_t channel_id)
+	{
+		bool channel_valid = renderer->regs[NV_PGRAPH_CTX_CONTROL] & NV_PGRAPH_CTX_CONTROL_CHID;
+		if (!channel_valid || ChannelId() != channel_id) {
+			context_switches++;
+			nv2a_fifo_set_mask(renderer->regs[NV_PGRAPH_CTX_USER], NV_PGRAPH_CTX_USER_CHID, channel_id);
+			renderer->regs[NV_PGRAPH_CTX_CONTROL] |= NV_PGRAPH_CTX_CONTROL_CHID;
+		}
+	}
+
+	// Puller : drains CACHE1, like pfifo_run_puller
+	void Pull()
+	{
+		PullerMethod batch[NV2A_CACHE1_SIZE];
+		while (true) {
+			int batch_size = nv2a_puller_fill_batch(pfifo_regs.data(), batch, *this);
+			if (batch_size == 0) {
+				break;
+			}
+
+			for (int i = 0; i < batch_size; i++) {
+				if (batch[i].channel_id >= 0) {
+					SwitchContext(batch[i].channel_id);
+				}
+
+				Dispatch(batch[i].subchannel, batch[i].method, batch[i].parameter);
+			}
+
+			methods_pulled += batch_size;
+			batches_pulled++;
+			largest_batch = std::max(largest_batch, batch_size);
+		}
+	}
+
+	// Puller backend
+	RAMHTEntry RamhtLookup(uint32_t handle)
+	{
+		auto entry = ramht.find(handle);
+		return entry != ramht.end() ? entry->second : RAMHTEntry{};
+	}
+
+	void SignalPusher()
+	{
+		pusher_stalls++;
+	}
+
+	// Pusher : queues a method in CACHE1, like pfifo_run_pusher
+	void Push(uint32_t subchannel, uint32_t method, uint32_t parameter, bool ni)
+	{
+		if (IsDroppedMethod(method)) {
+			methods_dropped++;
+			return;
+		}
+
+		if (method == NV_SET_OBJECT) {
+			DefineObject(parameter, nv2a_fifo_get_mask(renderer->regs[NV_PGRAPH_CTX_CACHE1 + subchannel * 4], NV_PGRAPH_CTX_SWITCH1_GRCLASS));
+		} else if (IsObjectMethod(method)) {
+			DefineObject(parameter, 0);
+		}
+
+		// Where pfifo_run_pusher waits for the puller
+		if (pfifo_regs[NV_PFIFO_CACHE1_STATUS] & NV_PFIFO_CACHE1_STATUS_HIGH_MARK) {
+			Pull();
+		}
+
+		nv2a_cache1_push(pfifo_regs.data(), method, ni ? NV_PFIFO_CACHE1_DMA_STATE_METHOD_TYPE_NON_INC : NV_PFIFO_CACHE1_DMA_STATE_METHOD_TYPE_INC, subchannel, parameter);
+		methods_pushed++;
+	}
+
+	// Pushbuffer parser handler
+	void Method(uint32_t subc, uint32_t mthd, uint32_t word, bool ni)
+	{
+		uint32_t method = (mthd & (REPLAY_METHOD_COUNT - 1)) << 2;
+		if (chunk->header->flags != NV2A_PBCAPTURE_COMMANDS_LLE) {
+			if (subc == 0) {
+				Dispatch(subc, method, word);
+			}
+		} else {
+			Push(subc, method, word, ni);
+		}
+	}
+
+	uint32_t *JumpTarget(uint32_t address)
+	{
+		return ChunkJumpTarget(chunk, address);
+	}
+
+	void Event(nv_pusher_event event)
+	{
+		event_counts[event]++;
+	}
+
+	void RunChunk(const ReplayChunk &command_chunk)
+	{
+		// Like EmuExecutePushBufferRaw, each chunk starts without an active method
+		nv_pusher_state pusher_state = {};
+		chunk = &command_chunk;
+		uint32_t *dma_get = chunk->words;
+		uint32_t *dma_put = chunk->words + chunk->header->size / 4;
+		nv2a_pushbuffer_run(pusher_state, dma_get, dma_put, dma_put, *this);
+		// The puller thread catches up with the pusher
+		Pull();
+	}
+};
+
+static const char *EventToString(int event)
+{
+	switch (event) {
+	case NV_PUSHER_EVENT_END_OF_DATA_EXCEEDED: return "end of data exceeded";
+	case NV_PUSHER_EVENT_JUMP_LONG: return "jump (long)";
+	case NV_PUSHER_EVENT_CALL: return "call";
+	case NV_PUSHER_EVENT_CALL_WHILE_ACTIVE: return "call while active";
+	case NV_PUSHER_EVENT_UNKNOWN_TYPE: return "unknown command type";
+	case NV_PUSHER_EVENT_JUMP: return "jump";
+	case NV_PUSHER_EVENT_UNKNOWN_INSTRUCTION: return "unknown instruction";
+	case NV_PUSHER_EVENT_RETURN: return "return";
+	case NV_PUSHER_EVENT_RETURN_EXTRA_BITS: return "return with extra bits";
+	case NV_PUSHER_EVENT_RETURN_WHILE_INACTIVE: return "return while inactive";
+	case NV_PUSHER_EVENT_SLI_CONDITIONAL: return "SLI conditional";
+	case NV_PUSHER_EVENT_LONG_NON_INCREASING: return "long non-increasing methods";
+	case NV_PUSHER_EVENT_UNKNOWN_FLAGS: return "unknown flags";
+	case NV_PUSHER_EVENT_JUMP_TARGET_UNAVAILABLE: return "jump target not captured";
+	default: return "?";
+	}
+}
+
+static bool LoadCapture(const char *szFileName, std::vector<uint8_t> &data, std::vector<ReplayFrame> &frames, uint32_t &register_count, size_t &vram_size)
+{
+	FILE *f = fopen(szFileName, "rb");
+	if (f == nullptr) {
+		printf("Couldn't open %s\n", szFileName);
+		return false;
+	}
+
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	data.resize(size);
+	bool read = size > 0 && fread(data.data(), size, 1, f) == 1;
+	fclose(f);
+
+	if (!read || data.size() < sizeof(NV2APBCaptureHeader)) {
+		printf("Couldn't read %s\n", szFileName);
+		return false;
+	}
+
+	const NV2APBCaptureHeader *header = (const NV2APBCaptureHeader *)data.data();
+	if (header->magic != NV2A_PBCAPTURE_MAGIC || header->version != NV2A_PBCAPTURE_VERSION) {
+		printf("%s is not a supported pushbuffer capture\n", szFileName);
+		return false;
+	}
+
+	register_count = header->pgraph_register_count;
+	vram_size = 0;
+
+	size_t offset = sizeof(NV2APBCaptureHeader);
+	while (offset + sizeof(NV2APBCaptureChunk) <= data.size()) {
+		const NV2APBCaptureChunk *chunk = (const NV2APBCaptureChunk *)(data.data() + offset);
+		offset += sizeof(NV2APBCaptureChunk);
+		if (chunk->size > data.size() - offset) {
+			printf("Truncated chunk at offset %zu, ignoring the remainder\n", offset);
+			break;
+		}
+
+		uint8_t *payload = data.data() + offset;
+		offset += chunk->size;
+
+		switch (chunk->type) {
+		case NV2A_PBCAPTURE_CHUNK_FRAME:
+			if (chunk->size != register_count * sizeof(uint32_t)) {
+				printf("Frame chunk at offset %zu has an unexpected size, ignoring the remainder\n", offset);
+				return true;
+			}
+
+			frames.push_back({ (const uint32_t *)payload, {}, 0, nullptr });
+			break;
+		case NV2A_PBCAPTURE_CHUNK_COMMANDS:
+			if (!frames.empty()) {
+				frames.back().commands.push_back({ chunk, (uint32_t *)payload, {} });
+			}
+			break;
+		case NV2A_PBCAPTURE_CHUNK_MEMORY:
+			// Memory is recorded while the preceding commands are handled
+			if (!frames.empty() && !frames.back().commands.empty()) {
+				frames.back().commands.back().memory.push_back(chunk);
+				frames.back().memory_chunk_count++;
+				vram_size = std::max(vram_size, (size_t)chunk->address + chunk->size);
+			}
+			break;
+		case NV2A_PBCAPTURE_CHUNK_STATS:
+			if (!frames.empty() && chunk->size == sizeof(NV2APBCaptureStats)) {
+				frames.back().stats = (const NV2APBCaptureStats *)payload;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	return true;
+}
+
+// Hands every method straight from the parser to the trace, with the
+// object handles resolved and the methods skipped as by ReplayNV2A
+struct DirectHandler {
+	ReplayNV2A *nv2a;
+	const ReplayChunk *chunk;
+	std::vector<ReplayMethod> trace;
+
+	void Method(uint32_t subc, uint32_t mthd, uint32_t word, bool /*ni*/)
+	{
+		uint32_t method = (mthd & (REPLAY_METHOD_COUNT - 1)) << 2;
+		if (chunk->header->flags != NV2A_PBCAPTURE_COMMANDS_LLE) {
+			if (subc != 0 || (method == NV_SET_OBJECT && word > REPLAY_RAMIN_SIZE - REPLAY_OBJECT_SIZE)) {
+				return;
+			}
+		} else {
+			if (IsDroppedMethod(method)) {
+				return;
+			}
+
+			if (IsObjectMethod(method)) {
+				word = nv2a->RamhtLookup(word).instance;
+			}
+		}
+
+		trace.push_back({ subc, method, word });
+	}
+
+	uint32_t *JumpTarget(uint32_t address)
+	{
+		return ChunkJumpTarget(chunk, address);
+	}
+
+	void Event(nv_pusher_event /*event*/)
+	{
+	}
+};
+
+static NullRenderer *CreateRenderer(uint32_t register_count, size_t vram_size)
+{
+	NullRenderer *renderer = new NullRenderer();
+	renderer->regs.resize(std::max<uint32_t>(register_count, REPLAY_PGRAPH_SIZE));
+	renderer->vram.resize(vram_size);
+	renderer->memory_page_generation.assign((vram_size + (1 << NV2A_TEXTURE_CACHE_PAGE_BITS) - 1) >> NV2A_TEXTURE_CACHE_PAGE_BITS, 0);
+	return renderer;
+}
+
+// Checks nv2a_texture_cache.h on a palettized texture, through writes that
+// are tracked and writes that aren't
+static unsigned int TestTextureValidation()
+{
+	unsigned int failures = 0;
+	std::vector<uint8_t> memory(16 << NV2A_TEXTURE_CACHE_PAGE_BITS, 0x55);
+	std::vector<uint32_t> page_generation(16, 0);
+	uint32_t generation = 0;
+	uint32_t frame_number = 0;
+	NV2ATextureValidation validation = {};
+	NV2ATextureCacheCounters counters = {};
+
+	const size_t texture_address = 1 << NV2A_TEXTURE_CACHE_PAGE_BITS;
+	const size_t texture_length = 2 << NV2A_TEXTURE_CACHE_PAGE_BITS;
+	const size_t palette_address = 8 << NV2A_TEXTURE_CACHE_PAGE_BITS;
+	const size_t palette_size = 1024;
+	auto hash = [&]() {
+		return HashMemory(memory.data() + texture_address, texture_length) ^ HashMemory(memory.data() + palette_address, palette_size);
+	};
+
+	// Uses the texture like pgraph_bind_textures, and requires it to be uploaded again or not
+	auto bind = [&](bool expected, const char *szCase) {
+		bool uploaded = false;
+		NV2ATextureCheck check = nv2a_texture_cache_check(validation, page_generation, frame_number, texture_address, palette_address, palette_size);
+		if (check == NV2A_TEXTURE_CURRENT) {
+			counters.hits++;
+		} else {
+			uploaded = nv2a_texture_cache_revalidate(validation, check, hash(), generation, frame_number, counters);
+		}
+
+		if (uploaded != expected) {
+			printf("FAIL : texture validation, %s : %s\n", szCase, uploaded ? "uploaded again" : "not uploaded again");
+			failures++;
+		}
+	};
+
+	nv2a_texture_cache_uploaded(validation, hash(), texture_length, generation, frame_number, counters);
+	bind(false, "no writes");
+
+	// A tracked write that leaves the data as it was, then one that changes it
+	nv2a_texture_cache_mark_written(page_generation, ++generation, texture_address + 100, 4);
+	bind(false, "unchanged data written");
+	memory[texture_address + 100] ^= 1;
+	nv2a_texture_cache_mark_written(page_generation, ++generation, texture_address + 100, 1);
+	bind(true, "texture written");
+	bind(false, "no writes since the upload");
+
+	// Writes next to the texture don't matter, writes to the palette do
+	memory[texture_address + texture_length] ^= 1;
+	nv2a_texture_cache_mark_written(page_generation, ++generation, texture_address + texture_length, 1);
+	bind(false, "page after the texture written");
+	memory[palette_address + palette_size - 1] ^= 1;
+	nv2a_texture_cache_mark_written(page_generation, ++generation, palette_address + palette_size - 1, 1);
+	bind(true, "palette written");
+
+	// A write that isn't tracked goes unnoticed until the texture is due for validation
+	memory[texture_address + texture_length - 1] ^= 1;
+	for (unsigned int i = 1; i < NV2A_TEXTURE_CACHE_REVALIDATE_FRAMES; i++) {
+		frame_number++;
+		bind(false, "untracked write, before validation is due");
+	}
+
+	frame_number++;
+	bind(true, "untracked write, once validation is due");
+	bind(false, "no writes since the upload");
+
+	// Textures due for validation without any writes are hashed, but not uploaded again
+	frame_number += NV2A_TEXTURE_CACHE_REVALIDATE_FRAMES;
+	bind(false, "validation due, no writes");
+
+	if (counters.misses != 4 || counters.aged_revalidations != 2 || counters.unseen_writes != 1 || counters.upload_bytes != 4 * texture_length) {
+		printf("FAIL : texture validation, %" PRIu64 " misses, %" PRIu64 " aged revalidations, %" PRIu64 " unseen writes, %" PRIu64 " bytes uploaded\n",
+			counters.misses, counters.aged_revalidations, counters.unseen_writes, counters.upload_bytes);
+		failures++;
+	}
+
+	return failures;
+}
+
+static int TestCapture(const std::vector<ReplayFrame> &frames, uint32_t register_count, size_t vram_size)
+{
+	unsigned int failures = TestTextureValidation();
+	NullRenderer *renderer = CreateRenderer(register_count, vram_size);
+	ReplayNV2A *nv2a = new ReplayNV2A();
+	nv2a->Init(renderer);
+
+	std::vector<ReplayMethod> dispatched;
+	renderer->trace = &dispatched;
+	size_t chunk_count = 0;
+	for (size_t i = 0; i < frames.size(); i++) {
+		const ReplayFrame &frame = frames[i];
+		renderer->StartFrame(frame.pgraph_regs, register_count);
+
+		for (size_t j = 0; j < frame.commands.size(); j++) {
+			const ReplayChunk &chunk = frame.commands[j];
+			for (const NV2APBCaptureChunk *memory : chunk.memory) {
+				renderer->RestoreMemory(memory);
+			}
+
+			dispatched.clear();
+			nv2a->RunChunk(chunk);
+			chunk_count++;
+
+			if (!(nv2a->pfifo_regs[NV_PFIFO_CACHE1_STATUS] & NV_PFIFO_CACHE1_STATUS_LOW_MARK)
+				|| nv2a->pfifo_regs[NV_PFIFO_CACHE1_GET] != nv2a->pfifo_regs[NV_PFIFO_CACHE1_PUT]) {
+				printf("FAIL : CACHE1 isn't empty after chunk %zu of frame %zu\n", j, i);
+				failures++;
+			}
+
+			// The objects were defined by the replay above
+			DirectHandler direct = { nv2a, &chunk, {} };
+			nv_pusher_state pusher_state = {};
+			uint32_t *dma_get = chunk.words;
+			uint32_t *dma_put = chunk.words + chunk.header->size / 4;
+			nv2a_pushbuffer_run(pusher_state, dma_get, dma_put, dma_put, direct);
+
+			size_t count = std::min(dispatched.size(), direct.trace.size());
+			size_t k = 0;
+			while (k < count && memcmp(&dispatched[k], &direct.trace[k], sizeof(ReplayMethod)) == 0) {
+				k++;
+			}
+
+			if (k < count) {
+				printf("FAIL : chunk %zu of frame %zu, method %zu is subchannel %u method 0x%04X (0x%08X), instead of subchannel %u method 0x%04X (0x%08X)\n", j, i, k,
+					dispatched[k].subchannel, dispatched[k].method, dispatched[k].parameter,
+					direct.trace[k].subchannel, direct.trace[k].method, direct.trace[k].parameter);
+				failures++;
+			} else if (dispatched.size() != direct.trace.size()) {
+				printf("FAIL : chunk %zu of frame %zu, %zu methods dispatched instead of %zu\n", j, i, dispatched.size(), direct.trace.size());
+				failures++;
+			}
+		}
+	}
+
+	if (nv2a->methods_pulled != nv2a->methods_pushed) {
+		printf("FAIL : %" PRIu64 " methods pulled, of %" PRIu64 " pushed\n", nv2a->methods_pulled, nv2a->methods_pushed);
+		failures++;
+	}
+
+	if (nv2a->largest_batch > NV2A_CACHE1_SIZE) {
+		printf("FAIL : a batch of %d methods, CACHE1 only holds %d\n", nv2a->largest_batch, NV2A_CACHE1_SIZE);
+		failures++;
+	}
+
+	uint64_t methods = 0;
+	for (auto &counts : renderer->method_counts) {
+		for (uint64_t count : counts) {
+			methods += count;
+		}
+	}
+
+	if (methods == 0) {
+		printf("FAIL : no methods were replayed\n");
+		failures++;
+	}
+
+	printf("%zu frames, %zu chunks : %" PRIu64 " methods, %" PRIu64 " through the puller in %" PRIu64 " batches\n",
+		frames.size(), chunk_count, methods, nv2a->methods_pulled, nv2a->batches_pulled);
+	printf("%u failure(s)\n", failures);
+
+	delete nv2a;
+	delete renderer;
+	return failures ? 1 : 0;
+}
+
+// The commands of consecutive COMMANDS chunks that continue each other
+// (like those of interrupted LLE pusher runs), and the memory read by them
+struct RoundTripStream {
+	uint32_t address;
+	uint32_t flags;
+	std::vector<uint32_t> words;
+	std::vector<const NV2APBCaptureChunk *> memory;
+};
+
+static std::vector<RoundTripStream> GetStreams(const ReplayFrame &frame)
+{
+	std::vector<RoundTripStream> streams;
+	for (const ReplayChunk &chunk : frame.commands) {
+		const NV2APBCaptureChunk *header = chunk.header;
+		if (streams.empty() || header->flags != NV2A_PBCAPTURE_COMMANDS_LLE || streams.back().flags != NV2A_PBCAPTURE_COMMANDS_LLE
+			|| streams.back().address + streams.back().words.size() * 4 != header->address) {
+			streams.push_back({ header->address, header->flags, {}, {} });
+		}
+
+		RoundTripStream &stream = streams.back();
+		stream.words.insert(stream.words.end(), chunk.words, chunk.words + header->size / 4);
+		stream.memory.insert(stream.memory.end(), chunk.memory.begin(), chunk.memory.end());
+	}
+
+	return streams;
+}
+
+static bool SameMemory(const std::vector<const NV2APBCaptureChunk *> &a, const std::vector<const NV2APBCaptureChunk *> &b)
+{
+	if (a.size() != b.size()) {
+		return false;
+	}
+
+	for (size_t i = 0; i < a.size(); i++) {
+		if (a[i]->address != b[i]->address || a[i]->flags != b[i]->flags || a[i]->size != b[i]->size
+			|| memcmp(a[i] + 1, b[i] + 1, a[i]->size) != 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Writes the commands of an LLE chunk like pfifo_run_pusher would, in one
+// run, or in a run that's interrupted halfway and one that resumes
+static void WriteLLECommands(NV2APBCaptureWriter &writer, const ReplayChunk &chunk, bool interrupted)
+{
+	uint32_t begin = chunk.header->address;
+	uint32_t end = begin + chunk.header->size;
+	std::vector<uint8_t> dma(end);
+	memcpy(dma.data() + begin, chunk.words, chunk.header->size);
+
+	if (interrupted) {
+		uint32_t put = begin + (chunk.header->size / 8) * 4;
+		uint32_t stopped = begin + (chunk.header->size / 16) * 4;
+		nv2a_pbcapture_writer_lle_commands(writer, dma.data(), dma.size(), begin, put);
+		nv2a_pbcapture_writer_lle_commands(writer, dma.data(), dma.size(), stopped, end);
+	} else {
+		nv2a_pbcapture_writer_lle_commands(writer, dma.data(), dma.size(), begin, end);
+	}
+
+	// The pusher catching up, with nothing new to record
+	nv2a_pbcapture_writer_lle_commands(writer, dma.data(), dma.size(), end, end);
+}
+
+static int TestRoundTrip(const std::vector<ReplayFrame> &frames, uint32_t register_count)
+{
+	unsigned int failures = 0;
+	NV2APBCaptureWriter writer = {};
+	for (int pass = 0; pass < 2; pass++) {
+		FILE *file = fopen(ROUNDTRIP_FILE_NAME, "wb");
+		if (file == nullptr) {
+			printf("Couldn't create %s\n", ROUNDTRIP_FILE_NAME);
+			return 1;
+		}
+
+		nv2a_pbcapture_writer_begin(writer, file, (unsigned int)frames.size(), register_count);
+		NV2APBCaptureStats stats = {};
+		for (size_t i = 0; i < frames.size(); i++) {
+			const ReplayFrame &frame = frames[i];
+			nv2a_pbcapture_writer_start_frame(writer, frame.pgraph_regs, register_count, stats);
+			for (const ReplayChunk &chunk : frame.commands) {
+				if (chunk.header->flags == NV2A_PBCAPTURE_COMMANDS_LLE) {
+					WriteLLECommands(writer, chunk, pass == 0);
+				} else {
+					nv2a_pbcapture_writer_commands(writer, chunk.words, chunk.header->address, chunk.header->size, chunk.header->flags);
+				}
+
+				// The second time, the memory is unchanged, so it must not be recorded again
+				for (int repeat = 0; repeat < 2; repeat++) {
+					for (const NV2APBCaptureChunk *memory : chunk.memory) {
+						const uint8_t *payload = (const uint8_t *)(memory + 1);
+						nv2a_pbcapture_writer_memory(writer, payload, memory->address, memory->size, HashMemory(payload, memory->size), memory->flags);
+					}
+				}
+			}
+
+			if (frame.stats != nullptr) {
+				stats.texture_cache_hits += frame.stats->texture_cache_hits;
+				stats.texture_cache_misses += frame.stats->texture_cache_misses;
+				stats.texture_cache_revalidations += frame.stats->texture_cache_revalidations;
+				stats.texture_upload_bytes += frame.stats->texture_upload_bytes;
+			}
+
+			bool finished = nv2a_pbcapture_writer_end_frame(writer, stats);
+			if (finished != (i + 1 == frames.size())) {
+				printf("FAIL : pass %d, the writer %s after frame %zu of %zu\n", pass, finished ? "finished" : "didn't finish", i, frames.size());
+				failures++;
+			}
+		}
+
+		if (writer.file != nullptr) {
+			fclose(writer.file);
+			writer.file = nullptr;
+		}
+
+		std::vector<uint8_t> data;
+		std::vector<ReplayFrame> written;
+		uint32_t written_register_count;
+		size_t vram_size;
+		if (!LoadCapture(ROUNDTRIP_FILE_NAME, data, written, written_register_count, vram_size)) {
+			printf("FAIL : pass %d, couldn't read back the capture\n", pass);
+			failures++;
+			continue;
+		}
+
+		if (written.size() != frames.size() || written_register_count != register_count) {
+			printf("FAIL : pass %d, read back %zu frames of %u registers, instead of %zu of %u\n", pass, written.size(), written_register_count, frames.size(), register_count);
+			failures++;
+			continue;
+		}
+
+		for (size_t i = 0; i < frames.size(); i++) {
+			if (memcmp(written[i].pgraph_regs, frames[i].pgraph_regs, register_count * sizeof(uint32_t)) != 0) {
+				printf("FAIL : pass %d, frame %zu has other registers\n", pass, i);
+				failures++;
+			}
+
+			if (frames[i].stats != nullptr && (written[i].stats == nullptr || memcmp(written[i].stats, frames[i].stats, sizeof(NV2APBCaptureStats)) != 0)) {
+				printf("FAIL : pass %d, frame %zu has other counters\n", pass, i);
+				failures++;
+			}
+
+			std::vector<RoundTripStream> expected = GetStreams(frames[i]);
+			std::vector<RoundTripStream> streams = GetStreams(written[i]);
+			if (streams.size() != expected.size()) {
+				printf("FAIL : pass %d, frame %zu has %zu command streams instead of %zu\n", pass, i, streams.size(), expected.size());
+				failures++;
+				continue;
+			}
+
+			for (size_t j = 0; j < streams.size(); j++) {
+				if (streams[j].address != expected[j].address || streams[j].flags != expected[j].flags || streams[j].words != expected[j].words) {
+					printf("FAIL : pass %d, frame %zu, command stream %zu has other commands\n", pass, i, j);
+					failures++;
+				}
+
+				if (!SameMemory(streams[j].memory, expected[j].memory)) {
+					printf("FAIL : pass %d, frame %zu, command stream %zu has other memory\n", pass, i, j);
+					failures++;
+				}
+			}
+		}
+	}
+
+	remove(ROUNDTRIP_FILE_NAME);
+
+	printf("%zu frames written and read back twice\n", frames.size());
+	printf("%u failure(s)\n", failures);
+	return failures ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+	bool test = argc == 3 && strcmp(argv[1], "-test") == 0;
+	bool roundtrip = argc == 3 && strcmp(argv[1], "-roundtrip") == 0;
+	if (argc < 2 || (!test && !roundtrip && argv[1][0] == '-')) {
+		printf("Usage : cxbxr-pbreplay <capture file> [repeat count]\n");
+		printf("        cxbxr-pbreplay -test <capture file>\n");
+		printf("        cxbxr-pbreplay -roundtrip <capture file>\n");
+		return 1;
+	}
+
+	const char *szFileName = (test || roundtrip) ? argv[2] : argv[1];
+	int repeat_count = (!test && !roundtrip && argc > 2) ? atoi(argv[2]) : 1;
+	if (repeat_count < 1) {
+		repeat_count = 1;
+	}
+
+	std::vector<uint8_t> data;
+	std::vector<ReplayFrame> frames;
+	uint32_t register_count;
+	size_t vram_size;
+	if (!LoadCapture(szFileName, data, frames, register_count, vram_size)) {
+		return 1;
+	}
+
+	if (test) {
+		return TestCapture(frames, register_count, vram_size);
+	}
+
+	if (roundtrip) {
+		return TestRoundTrip(frames, register_count);
+	}
+
+	NullRenderer *renderer = CreateRenderer(register_count, vram_size);
+	ReplayNV2A *nv2a = new ReplayNV2A();
+	nv2a->Init(renderer);
+	uint64_t total_methods = 0;
+	double total_seconds = 0.0;
+
+	// The 'captured' columns hold the texture cache counters of the emulator while capturing
+	printf("frame  chunks  memory       methods    draws  tex hits  tex misses  tex upload (KiB)  captured hits  captured misses   time (ms)\n");
+	for (int repeat = 0; repeat < repeat_count; repeat++) {
+		for (size_t i = 0; i < frames.size(); i++) {
+			const ReplayFrame &frame = frames[i];
+
+			uint64_t methods_before = 0;
+			for (auto &counts : renderer->method_counts) {
+				for (uint64_t count : counts) {
+					methods_before += count;
+				}
+			}
+			uint64_t draws_before = renderer->draw_count;
+			NV2ATextureCacheCounters texture_counters_before = renderer->texture_counters;
+
+			renderer->StartFrame(frame.pgraph_regs, register_count);
+
+			// Only the method dispatch is timed, not restoring guest memory
+			double seconds = 0.0;
+			for (const ReplayChunk &chunk : frame.commands) {
+				for (const NV2APBCaptureChunk *memory : chunk.memory) {
+					renderer->RestoreMemory(memory);
+				}
+
+				auto start = std::chrono::steady_clock::now();
+				nv2a->RunChunk(chunk);
+				seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			}
+
+			uint64_t methods = 0;
+			for (auto &counts : renderer->method_counts) {
+				for (uint64_t count : counts) {
+					methods += count;
+				}
+			}
+			methods -= methods_before;
+
+			total_methods += methods;
+			total_seconds += seconds;
+			if (repeat == 0) {
+				char captured_hits[24] = "-";
+				char captured_misses[24] = "-";
+				if (frame.stats != nullptr) {
+					snprintf(captured_hits, sizeof(captured_hits), "%" PRIu64, frame.stats->texture_cache_hits);
+					snprintf(captured_misses, sizeof(captured_misses), "%" PRIu64, frame.stats->texture_cache_misses);
+				}
+
+				printf("%5zu %7zu %7u %13" PRIu64 " %8" PRIu64 " %9" PRIu64 " %11" PRIu64 " %17.1f %14s %16s %11.3f\n", i, frame.commands.size(), frame.memory_chunk_count,
+					methods, renderer->draw_count - draws_before,
+					renderer->texture_counters.hits - texture_counters_before.hits, renderer->texture_counters.misses - texture_counters_before.misses,
+					(renderer->texture_counters.upload_bytes - texture_counters_before.upload_bytes) / 1024.0,
+					captured_hits, captured_misses, seconds * 1000.0);
+			}
+		}
+	}
+
+	printf("\n%zu frames x %d : %" PRIu64 " methods in %.3f ms (%.2f M methods/s), %" PRIu64 " draws, %" PRIu64 " vertices\n",
+		frames.size(), repeat_count, total_methods, total_seconds * 1000.0,
+		total_seconds > 0.0 ? total_methods / total_seconds / 1e6 : 0.0,
+		renderer->draw_count, renderer->vertex_count);
+	const NV2ATextureCacheCounters &texture_counters = renderer->texture_counters;
+	printf("textures : %" PRIu64 " hits, %" PRIu64 " misses (%.2f%% hit rate), %.1f KiB uploaded, %" PRIu64 " revalidations (%" PRIu64 " aged), %" PRIu64 " fetches of uncaptured textures\n",
+		texture_counters.hits, texture_counters.misses,
+		texture_counters.hits + texture_counters.misses ? texture_counters.hits * 100.0 / (texture_counters.hits + texture_counters.misses) : 0.0,
+		texture_counters.upload_bytes / 1024.0, texture_counters.revalidations, texture_counters.aged_revalidations, renderer->texture_uncaptured);
+	printf("puller : %" PRIu64 " methods in %" PRIu64 " batches (%.1f methods per batch, at most %d), CACHE1 full %" PRIu64 " times, %" PRIu64 " context switches, %zu objects\n",
+		nv2a->methods_pulled, nv2a->batches_pulled,
+		nv2a->batches_pulled ? (double)nv2a->methods_pulled / nv2a->batches_pulled : 0.0, nv2a->largest_batch,
+		nv2a->pusher_stalls, nv2a->context_switches, nv2a->ramht.size());
+	if (nv2a->methods_dropped || nv2a->bad_objects) {
+		printf("skipped : %" PRIu64 " methods the puller drops, %" PRIu64 " object binds outside of RAMIN\n", nv2a->methods_dropped, nv2a->bad_objects);
+	}
+
+	// Per-method counts, most frequent first
+	struct MethodCount { uint32_t subc; uint32_t graphics_class; uint32_t method; uint64_t count; };
+	std::vector<MethodCount> method_counts;
+	for (uint32_t subc = 0; subc < NV2A_NUM_SUBCHANNELS; subc++) {
+		for (uint32_t mthd = 0; mthd < REPLAY_METHOD_COUNT; mthd++) {
+			if (renderer->method_counts[subc][mthd]) {
+				method_counts.push_back({ subc, renderer->method_classes[subc][mthd], mthd << 2, renderer->method_counts[subc][mthd] });
+			}
+		}
+	}
+
+	std::stable_sort(method_counts.begin(), method_counts.end(),
+		[](const MethodCount &a, const MethodCount &b) { return a.count > b.count; });
+
+	printf("\nsubch  class  method        count    share\n");
+	for (const MethodCount &mc : method_counts) {
+		printf("%5u   0x%02X  0x%04X %12" PRIu64 " %7.2f%%\n", mc.subc, mc.graphics_class, mc.method, mc.count,
+			total_methods ? mc.count * 100.0 / total_methods : 0.0);
+	}
+
+	bool events_printed = false;
+	for (int event = 0; event <= NV_PUSHER_EVENT_JUMP_TARGET_UNAVAILABLE; event++) {
+		if (nv2a->event_counts[event]) {
+			if (!events_printed) {
+				printf("\npusher events :\n");
+				events_printed = true;
+			}
+
+			printf("  %-30s %" PRIu64 "\n", EventToString(event), nv2a->event_counts[event]);
+		}
+	}
+
+	delete nv2a;
+	delete renderer;
+	return 0;
+}
@@ -0,0 +1,398 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of Cxbx-Reloaded.
+// *
+// *  Cxbx-Reloaded is free software; you can redistribute it
+// *  and/or modify it under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+// Checks and times XboxRenderStateConverter::Apply, which diffs the Xbox
+// render state block (RenderStateDiff.h) and dispatches the changed states
+// through a table built once per XDK, against the per-state loop it used
+// before. Both converters are copies of the emulator's, with Apply*RenderState
+// handlers that only record the calls.
+//
+// The test runs both over random XDK layouts (each Cxbx render state missing
+// from some XDKs, like in BuildRenderStateMappingTable) and random sequences
+// of state changes, SetDirty and wireframe toggles, with both diffs, and
+// requires the exact same handler calls in the exact same order.
+//
+// The benchmark reports the time per Apply, so per draw, for a number of
+// states changed between draws.
+//
+// Usage : cxbxr-renderstatebench [applies] [changed states per draw]
+//         cxbxr-renderstatebench -test
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "core/hle/D3D8/Direct3D9/RenderStateDiff.h"
+
+// Same as in XbD3D8Types.h
+#define X_D3DRS_FIRST 0
+#define X_D3DRS_SIMPLE_FIRST 57
+#define X_D3DRS_SIMPLE_LAST 91
+#define X_D3DRS_DEFERRED_LAST 135
+#define X_D3DRS_PSTEXTUREMODES 136
+#define X_D3DRS_FILLMODE 139
+#define X_D3DRS_COMPLEX_LAST 166
+#define X_D3DRS_LAST X_D3DRS_COMPLEX_LAST
+
+#define TEST_LAYOUTS 50
+#define TEST_APPLIES 2000
+#define BENCH_APPLIES 2000000
+
+typedef void(*DiffRenderStatesFn)(const uint32_t*, uint32_t*, unsigned, uint32_t*);
+
+// A handler call : the Cxbx render state, its value, and which Apply*RenderState took it
+struct BenchCall {
+	uint32_t State;
+	uint32_t Value;
+	int Kind;
+	bool operator==(const BenchCall &Other) const { return State == Other.State && Value == Other.Value && Kind == Other.Kind; }
+};
+
+// Where the handlers record their calls, or count them when null
+static std::vector<BenchCall> *g_pCalls = nullptr;
+static unsigned g_CallCount = 0;
+
+// Shared by both converters, like D3D__RenderState and the offsets of the current XDK
+struct BenchXdk {
+	std::array<int, X_D3DRS_LAST + 1> Offsets;
+	unsigned Count;
+	std::vector<uint32_t> Block;
+};
+
+// The handlers aren't inlined, like the emulator's Apply*RenderState
+#ifdef _MSC_VER
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+static BENCH_NOINLINE void RecordCall(uint32_t State, uint32_t Value, int Kind)
+{
+	if (g_pCalls != nullptr) {
+		g_pCalls->push_back({ State, Value, Kind });
+	} else {
+		g_CallCount++;
+	}
+}
+
+// Apply as it was before the render states were diffed (a copy of the previous RenderStates.cpp)
+class OldConverter
+{
+public:
+	explicit OldConverter(BenchXdk &Xdk) : m_Xdk(Xdk) {}
+
+	void Init() { StoreInitialValues(); }
+
+	void SetDirty() { PreviousRenderStateValues.fill(-1); }
+
+	void SetWireFrameMode() { PreviousRenderStateValues[X_D3DRS_FILLMODE] = -1; }
+
+	void Apply()
+	{
+		for (unsigned int RenderState = X_D3DRS_SIMPLE_FIRST; RenderState <= X_D3DRS_LAST; RenderState++) {
+			if (!XboxRenderStateExists(RenderState) || !XboxRenderStateValueChanged(RenderState) || RenderState == X_D3DRS_PSTEXTUREMODES) {
+				continue;
+			}
+
+			auto Value = GetXboxRenderState(RenderState);
+			if (RenderState <= X_D3DRS_SIMPLE_LAST) {
+				ApplySimpleRenderState(RenderState, Value);
+			} else if (RenderState <= X_D3DRS_DEFERRED_LAST) {
+				ApplyDeferredRenderState(RenderState, Value);
+			} else if (RenderState <= X_D3DRS_COMPLEX_LAST) {
+				ApplyComplexRenderState(RenderState, Value);
+			}
+
+			PreviousRenderStateValues[RenderState] = Value;
+		}
+	}
+
+private:
+	bool XboxRenderStateExists(uint32_t State) { return m_Xdk.Offsets[State] >= 0; }
+
+	bool XboxRenderStateValueChanged(uint32_t State)
+	{
+		return XboxRenderStateExists(State) && GetXboxRenderState(State) != PreviousRenderStateValues[State];
+	}
+
+	uint32_t GetXboxRenderState(uint32_t State) { return m_Xdk.Block[m_Xdk.Offsets[State]]; }
+
+	void StoreInitialValues()
+	{
+		for (unsigned int RenderState = X_D3DRS_FIRST; RenderState <= X_D3DRS_LAST; RenderState++) {
+			if (XboxRenderStateExists(RenderState)) {
+				PreviousRenderStateValues[RenderState] = GetXboxRenderState(RenderState);
+			}
+		}
+	}
+
+	void ApplySimpleRenderState(uint32_t State, uint32_t Value) { RecordCall(State, Value, 0); }
+	void ApplyDeferredRenderState(uint32_t State, uint32_t Value) { RecordCall(State, Value, 1); }
+	void ApplyComplexRenderState(uint32_t State, uint32_t Value) { RecordCall(State, Value, 2); }
+
+	BenchXdk &m_Xdk;
+	std::array<uint64_t, X_D3DRS_LAST + 1> PreviousRenderStateValues;
+};
+
+// Apply as it is now (a copy of RenderStates.cpp, with the diff to use passed in)
+class NewConverter
+{
+public:
+	NewConverter(BenchXdk &Xdk, DiffRenderStatesFn Diff) : m_Xdk(Xdk), DiffRenderStates(Diff) {}
+
+	void Init()
+	{
+		XboxRenderStateCount = m_Xdk.Count;
+		BuildApplyTable();
+		std::copy(m_Xdk.Block.begin(), m_Xdk.Block.begin() + XboxRenderStateCount, PreviousRenderStateValues.begin());
+		ForceDirtyStates.fill(0);
+	}
+
+	void SetDirty()
+	{
+		ForceDirtyStates.fill(0);
+		for (unsigned i = 0; i < XboxRenderStateCount; i++) {
+			ForceDirtyStates[i / 32] |= 1u << (i % 32);
+		}
+	}
+
+	void SetWireFrameMode() { SetXboxRenderStateDirty(X_D3DRS_FILLMODE); }
+
+	void Apply()
+	{
+		decltype(ForceDirtyStates) DirtyStates = ForceDirtyStates;
+		ForceDirtyStates.fill(0);
+		DiffRenderStates(m_Xdk.Block.data(), PreviousRenderStateValues.data(), XboxRenderStateCount, DirtyStates.data());
+
+		ForEachRenderStateBit(DirtyStates.data(), (unsigned)DirtyStates.size(), [this](unsigned Index) {
+			const auto &Entry = ApplyRenderStateTable[Index];
+			if (Entry.Fn == nullptr) {
+				return;
+			}
+
+			(this->*Entry.Fn)(Entry.State, PreviousRenderStateValues[Index]);
+		});
+	}
+
+private:
+	typedef void (NewConverter::*ApplyRenderStateFn)(uint32_t State, uint32_t Value);
+	struct ApplyRenderStateEntry {
+		uint32_t State;
+		ApplyRenderStateFn Fn;
+	};
+
+	bool XboxRenderStateExists(uint32_t State) { return m_Xdk.Offsets[State] >= 0; }
+
+	void SetXboxRenderStateDirty(uint32_t State)
+	{
+		if (XboxRenderStateExists(State)) {
+			int Offset = m_Xdk.Offsets[State];
+			ForceDirtyStates[Offset / 32] |= 1u << (Offset % 32);
+		}
+	}
+
+	void BuildApplyTable()
+	{
+		ApplyRenderStateTable.fill({ 0, nullptr });
+		for (unsigned int RenderState = X_D3DRS_SIMPLE_FIRST; RenderState <= X_D3DRS_LAST; RenderState++) {
+			if (!XboxRenderStateExists(RenderState) || RenderState == X_D3DRS_PSTEXTUREMODES) {
+				continue;
+			}
+
+			auto &Entry = ApplyRenderStateTable[m_Xdk.Offsets[RenderState]];
+			Entry.State = RenderState;
+			if (RenderState <= X_D3DRS_SIMPLE_LAST) {
+				Entry.Fn = &NewConverter::ApplySimpleRenderState;
+			} else if (RenderState <= X_D3DRS_DEFERRED_LAST) {
+				Entry.Fn = &NewConverter::ApplyDeferredRenderState;
+			} else if (RenderState <= X_D3DRS_COMPLEX_LAST) {
+				Entry.Fn = &NewConverter::ApplyComplexRenderState;
+			}
+		}
+	}
+
+	void ApplySimpleRenderState(uint32_t State, uint32_t Value) { RecordCall(State, Value, 0); }
+	void ApplyDeferredRenderState(uint32_t State, uint32_t Value) { RecordCall(State, Value, 1); }
+	void ApplyComplexRenderState(uint32_t State, uint32_t Value) { RecordCall(State, Value, 2); }
+
+	BenchXdk &m_Xdk;
+	DiffRenderStatesFn DiffRenderStates;
+	unsigned XboxRenderStateCount = 0;
+	std::array<uint32_t, X_D3DRS_LAST + 1> PreviousRenderStateValues;
+	std::array<uint32_t, (X_D3DRS_LAST + 32) / 32> ForceDirtyStates;
+	std::array<ApplyRenderStateEntry, X_D3DRS_LAST + 1> ApplyRenderStateTable;
+};
+
+// Like BuildRenderStateMappingTable, the states present in the XDK are numbered in Cxbx order
+static void MakeXdk(BenchXdk &Xdk, std::mt19937 &Rng, unsigned MissingPercent)
+{
+	Xdk.Count = 0;
+	for (unsigned State = X_D3DRS_FIRST; State <= X_D3DRS_LAST; State++) {
+		Xdk.Offsets[State] = (Rng() % 100 < MissingPercent) ? -1 : (int)Xdk.Count++;
+	}
+	Xdk.Block.resize(Xdk.Count);
+	for (uint32_t &Value : Xdk.Block) {
+		Value = Rng() % 4;
+	}
+}
+
+// Returns the number of applies whose handler calls differ
+static unsigned CompareApply(DiffRenderStatesFn Diff, unsigned Seed, unsigned *pCalls)
+{
+	std::mt19937 Rng(Seed);
+	unsigned Mismatches = 0;
+	std::vector<BenchCall> OldCalls, NewCalls;
+	for (unsigned Layout = 0; Layout < TEST_LAYOUTS; Layout++) {
+		BenchXdk Xdk;
+		MakeXdk(Xdk, Rng, 10);
+		OldConverter Old(Xdk);
+		NewConverter New(Xdk, Diff);
+		Old.Init();
+		New.Init();
+		for (unsigned i = 0; i < TEST_APPLIES; i++) {
+			// Mostly a few changes per draw, sometimes many, and values which often go back to what they were
+			unsigned Changes = (Rng() % 50 == 0) ? Xdk.Count : Rng() % 6;
+			for (unsigned c = 0; c < Changes; c++) {
+				Xdk.Block[Rng() % Xdk.Count] = (Rng() % 8 == 0) ? Rng() : Rng() % 4;
+			}
+			if (Rng() % 200 == 0) {
+				Old.SetDirty();
+				New.SetDirty();
+			}
+			if (Rng() % 100 == 0) {
+				Old.SetWireFrameMode();
+				New.SetWireFrameMode();
+			}
+
+			OldCalls.clear();
+			NewCalls.clear();
+			g_pCalls = &OldCalls;
+			Old.Apply();
+			g_pCalls = &NewCalls;
+			New.Apply();
+			g_pCalls = nullptr;
+			*pCalls += (unsigned)OldCalls.size();
+			if (OldCalls != NewCalls) {
+				if (Mismatches++ == 0) {
+					printf("Layout %u, apply %u : %u calls before, %u now\n", Layout, i, (unsigned)OldCalls.size(), (unsigned)NewCalls.size());
+				}
+			}
+		}
+	}
+
+	return Mismatches;
+}
+
+// Returns the nanoseconds per Apply, with Changes states changed before each
+template<typename TConverter>
+static double TimeApply(TConverter &Converter, BenchXdk &Xdk, unsigned Applies, unsigned Changes, unsigned Seed)
+{
+	std::mt19937 Rng(Seed);
+	std::vector<uint32_t> Indices(1024 * Changes + 1);
+	for (uint32_t &Index : Indices) {
+		Index = Rng() % Xdk.Count;
+	}
+
+	g_CallCount = 0;
+	auto Start = std::chrono::steady_clock::now();
+	for (unsigned i = 0; i < Applies; i++) {
+		for (unsigned c = 0; c < Changes; c++) {
+			Xdk.Block[Indices[((i % 1024) * Changes) + c]] ^= 1;
+		}
+		Converter.Apply();
+	}
+	auto End = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::nano>(End - Start).count() / Applies;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 2 && strcmp(argv[1], "-test") == 0) {
+		unsigned failures = 0;
+		const struct { const char *Name; DiffRenderStatesFn Diff; } Diffs[] = {
+			{ "sse2", DiffRenderStates_SSE2 },
+			{ "scalar", DiffRenderStates_NoSIMD },
+		};
+		for (const auto &Diff : Diffs) {
+			unsigned Calls = 0;
+			unsigned Mismatches = CompareApply(Diff.Diff, 1, &Calls);
+			printf("%-6s : %u applies over %u XDK layouts, %u handler calls, %u mismatches\n", Diff.Name,
+				TEST_LAYOUTS * TEST_APPLIES, TEST_LAYOUTS, Calls, Mismatches);
+			if (Mismatches != 0) {
+				printf("FAIL : %s diff, %u applies called other handlers than before\n", Diff.Name, Mismatches);
+				failures++;
+			}
+		}
+		printf("%u failure(s)\n", failures);
+		return failures ? 1 : 0;
+	}
+
+	unsigned Applies = BENCH_APPLIES;
+	std::vector<unsigned> ChangeCounts;
+	std::vector<const char *> args;
+	for (int i = 1; i < argc; i++) {
+		if (argv[i][0] >= '0' && argv[i][0] <= '9') {
+			args.push_back(argv[i]);
+		} else {
+			printf("Usage : cxbxr-renderstatebench [applies] [changed states per draw]\n");
+			printf("        cxbxr-renderstatebench -test\n");
+			return 1;
+		}
+	}
+	if (args.size() > 0) {
+		Applies = strtoul(args[0], nullptr, 0);
+	}
+	if (args.size() > 1) {
+		ChangeCounts.push_back(strtoul(args[1], nullptr, 0));
+	} else {
+		ChangeCounts = { 0, 1, 4, 16, 64 };
+	}
+
+	// Every render state present, like the later XDKs
+	std::mt19937 Rng(1);
+	BenchXdk Xdk;
+	MakeXdk(Xdk, Rng, 0);
+	printf("%u applies, %u render states\n", Applies, Xdk.Count);
+	for (unsigned Changes : ChangeCounts) {
+		OldConverter Old(Xdk);
+		NewConverter Scalar(Xdk, DiffRenderStates_NoSIMD);
+		NewConverter Sse2(Xdk, DiffRenderStates_SSE2);
+		Old.Init();
+		double OldNs = TimeApply(Old, Xdk, Applies, Changes, 2);
+		Scalar.Init();
+		double ScalarNs = TimeApply(Scalar, Xdk, Applies, Changes, 2);
+		Sse2.Init();
+		double Sse2Ns = TimeApply(Sse2, Xdk, Applies, Changes, 2);
+		printf("%3u changed states per draw : per-state loop %7.1f ns, scalar diff %7.1f ns, sse2 diff %7.1f ns per Apply\n",
+			Changes, OldNs, ScalarNs, Sse2Ns);
+	}
+
+	return 0;
+}
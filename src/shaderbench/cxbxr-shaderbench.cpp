@@ -0,0 +1,440 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of Cxbx-Reloaded.
+// *
+// *  Cxbx-Reloaded is free software; you can redistribute it
+// *  and/or modify it under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+// Times LLE GLSL generation (generate_shader_sources) over a corpus of
+// ShaderStates, as recorded by the LLE shader cache into
+// <data folder>\ShaderCache\shader_states.bin while running titles.
+// No OpenGL context is needed. Besides timings, a hash over all generated
+// sources is printed, so changes to the output can be spotted too.
+//
+// The test checks what the shader cache relies on : qstring formatting
+// appends the same text as the temporary string formatting it replaced,
+// generating a state into ShaderSources that held another state's sources
+// gives the same sources as generating it into fresh ones, and sources
+// looked up by ShaderState (like PGRAPH looks up bindings) are the sources
+// of that state. Without a corpus file, it uses made up states, covering
+// register combiners, fixed function and vertex programs.
+//
+// Usage : cxbxr-shaderbench <corpus file> [repeat count] [state index to dump]
+//         cxbxr-shaderbench -test [corpus file]
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "devices/video/nv2a_shaders.h"
+
+static uint64_t fnv_hash(uint64_t hval, const std::string &str)
+{
+	for (unsigned char c : str) {
+		hval ^= c;
+		hval *= 0x100000001b3ULL;
+	}
+
+	return hval;
+}
+
+static bool LoadCorpus(const char *szFileName, std::vector<ShaderState> &states)
+{
+	FILE *f = fopen(szFileName, "rb");
+	if (f == nullptr) {
+		printf("Couldn't open %s\n", szFileName);
+		return false;
+	}
+
+	ShaderCorpusHeader header;
+	if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != NV2A_SHADER_CORPUS_MAGIC) {
+		printf("%s is not a shader state corpus\n", szFileName);
+		fclose(f);
+		return false;
+	}
+
+	if (header.state_size != sizeof(ShaderState)) {
+		printf("%s was recorded by a build with a different ShaderState (%u bytes, expected %zu)\n",
+			szFileName, header.state_size, sizeof(ShaderState));
+		fclose(f);
+		return false;
+	}
+
+	ShaderState state;
+	while (fread(&state, sizeof(state), 1, f) == 1) {
+		states.push_back(state);
+	}
+
+	fclose(f);
+	return true;
+}
+
+// Number of made up states the test generates when no corpus is given
+#define TEST_STATE_COUNT 400
+
+static unsigned int g_failures = 0;
+
+// qstring_from_fmt as it was before formatting appended in place
+static std::string ReferenceFormat(const char *fmt, ...)
+{
+	int size = (int)strlen(fmt) * 2 + 50;
+	std::string str;
+	va_list ap;
+	while (1) {
+		str.resize(size);
+		va_start(ap, fmt);
+		int n = vsnprintf((char *)str.data(), size, fmt, ap);
+		va_end(ap);
+		if (n > -1 && n < size) {
+			str.resize(n);
+			return str;
+		}
+		if (n > -1)
+			size = n + 1;
+		else
+			size *= 2;
+	}
+}
+
+// Appends output of every length around the size qstring_append_vfmt
+// formats into first, to strings that are empty and that aren't
+static void TestFormatting()
+{
+	std::string long_arg(400, 'x');
+	for (size_t prefix_length : { 0, 5, 300 }) {
+		for (int length = 0; length <= 300; length++) {
+			QString *qs = qstring_new();
+			qstring_append(qs, std::string(prefix_length, 'p'));
+			qstring_append_fmt(qs, "%.*s%d", length, long_arg.c_str(), length);
+
+			std::string expected = std::string(prefix_length, 'p') + ReferenceFormat("%.*s%d", length, long_arg.c_str(), length);
+			if (*qs != expected) {
+				printf("FAIL : qstring_append_fmt of %d characters after %zu\n", length, prefix_length);
+				g_failures++;
+			}
+			delete qs;
+		}
+	}
+
+	QString *qs = qstring_from_fmt("%s", "");
+	if (!qs->empty()) {
+		printf("FAIL : qstring_from_fmt of nothing\n");
+		g_failures++;
+	}
+	delete qs;
+}
+
+static void RandomVertexProgram(std::mt19937 &rng, ShaderState &state)
+{
+	state.program_length = 1 + rng() % 32;
+	for (int i = 0; i < state.program_length; i++) {
+		uint32_t *token = state.program_data[i];
+		for (int j = 0; j < VSH_TOKEN_SIZE; j++) {
+			token[j] = rng();
+		}
+
+		// Only MAC opcodes up to ARL and PARAM_R/V/C inputs exist
+		token[1] = (token[1] & ~(0xF << 21)) | ((rng() % 14) << 21);
+		token[2] = (token[2] & ~(3 << 26)) | ((1 + rng() % 3) << 26);
+		token[2] = (token[2] & ~(3 << 11)) | ((1 + rng() % 3) << 11);
+		token[3] = (token[3] & ~(3 << 28)) | ((1 + rng() % 3) << 28);
+
+		// FLD_FINAL
+		token[3] = (token[3] & ~1) | (i == state.program_length - 1);
+	}
+}
+
+// Combiner input registers a general combiner stage can read
+static const uint32_t combiner_inputs[] = { 0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x8, 0x9, 0xA, 0xB, 0xC, 0xD };
+// Combiner output registers (or discard)
+static const uint32_t combiner_outputs[] = { 0x0, 0x4, 0x5, 0x8, 0x9, 0xA, 0xB, 0xC, 0xD };
+// Output mappings (PS_COMBINEROUTPUT_*, shifted with the other flags)
+static const uint32_t combiner_mappings[] = { 0x00, 0x08, 0x10, 0x18, 0x20, 0x30 };
+
+static uint32_t RandomCombinerInputs(std::mt19937 &rng, bool final_combiner, bool final_products)
+{
+	uint32_t inputs = 0;
+	for (int i = 0; i < 4; i++) {
+		uint32_t reg = combiner_inputs[rng() % (sizeof(combiner_inputs) / sizeof(combiner_inputs[0]))];
+		if (final_products && rng() % 4 == 0) {
+			reg = 0xE + rng() % 2; // V1R0_SUM, EF_PROD
+		}
+		// The final combiner only has the unsigned identity and invert mappings
+		uint32_t mod = final_combiner ? (rng() % 2) * 0x20 : (rng() % 8) * 0x20;
+		inputs |= (reg | (rng() % 2) * 0x10 | mod) << (i * 8);
+	}
+
+	return inputs;
+}
+
+static uint32_t RandomCombinerOutputs(std::mt19937 &rng, bool alpha)
+{
+	const size_t output_count = sizeof(combiner_outputs) / sizeof(combiner_outputs[0]);
+	uint32_t flags = combiner_mappings[rng() % (sizeof(combiner_mappings) / sizeof(combiner_mappings[0]))] | (rng() % 2) * 4;
+	if (!alpha) {
+		// Dot products and blue to alpha are RGB only
+		flags |= (rng() % 4) | (rng() % 4) * 0x40;
+	}
+
+	return combiner_outputs[rng() % output_count]
+		| combiner_outputs[rng() % output_count] << 4
+		| combiner_outputs[rng() % output_count] << 8
+		| flags << 12;
+}
+
+// A state the generators handle (without reaching their untested paths)
+static ShaderState RandomShaderState(std::mt19937 &rng)
+{
+	ShaderState state;
+	memset(&state, 0, sizeof(state));
+
+	unsigned int stage_count = 1 + rng() % 8;
+	state.psh.combiner_control = stage_count | (rng() % 2) << 8 | (rng() % 2) << 12 | (rng() % 2) << 16;
+	for (unsigned int i = 0; i < stage_count; i++) {
+		state.psh.rgb_inputs[i] = RandomCombinerInputs(rng, false, false);
+		state.psh.alpha_inputs[i] = RandomCombinerInputs(rng, false, false);
+		state.psh.rgb_outputs[i] = RandomCombinerOutputs(rng, false);
+		state.psh.alpha_outputs[i] = RandomCombinerOutputs(rng, true);
+	}
+
+	if (rng() % 2) {
+		state.psh.final_inputs_0 = RandomCombinerInputs(rng, true, true);
+		state.psh.final_inputs_1 = (RandomCombinerInputs(rng, true, false) & ~0xFF) | (rng() % 8) << 5;
+	}
+
+	for (int i = 0; i < 4; i++) {
+		// NONE, PROJECT2D, PROJECT3D, CUBEMAP, PASSTHRU or CLIPPLANE
+		uint32_t mode = rng() % 6;
+		state.psh.shader_stage_program |= mode << (i * 5);
+		state.psh.rect_tex[i] = mode == 1 && rng() % 2;
+		state.psh.alphakill[i] = rng() % 4 == 0;
+		for (int j = 0; j < 4; j++) {
+			state.psh.compare_mode[i][j] = rng() % 2;
+		}
+	}
+
+	state.psh.alpha_test = rng() % 2;
+	state.psh.alpha_func = (enum PshAlphaFunc)(rng() % 8);
+	state.psh.window_clip_count = rng() % 9;
+
+	if (rng() % 3 == 0) {
+		state.vertex_program = true;
+		state.z_perspective = rng() % 2;
+		RandomVertexProgram(rng, state);
+	} else {
+		state.fixed_function = true;
+		state.skinning = (rng() % 4 == 0) ? SKINNING_1WEIGHTS : SKINNING_OFF;
+		state.normalization = rng() % 2;
+		state.lighting = rng() % 2;
+		if (state.lighting) {
+			for (int i = 0; i < NV2A_MAX_LIGHTS; i++) {
+				state.light[i] = (enum VshLight)(rng() % 3); // OFF, INFINITE or LOCAL
+			}
+		}
+
+		for (int i = 0; i < 4; i++) {
+			state.texture_matrix_enable[i] = rng() % 2;
+			for (int j = 0; j < 4; j++) {
+				// Normal and reflection maps only have S, T and R (and the generator asserts the first three stages)
+				static const enum VshTexgen texgens[] = { TEXGEN_DISABLE, TEXGEN_EYE_LINEAR, TEXGEN_NORMAL_MAP, TEXGEN_REFLECTION_MAP };
+				state.texgen[i][j] = texgens[rng() % ((i < 3 && j < 3) ? 4 : 2)];
+			}
+		}
+	}
+
+	state.fog_enable = rng() % 2;
+	if (state.fog_enable) {
+		static const enum VshFogMode fog_modes[] = { FOG_MODE_LINEAR, FOG_MODE_EXP, FOG_MODE_EXP2, FOG_MODE_LINEAR_ABS, FOG_MODE_EXP_ABS, FOG_MODE_EXP2_ABS };
+		state.fog_mode = fog_modes[rng() % 6];
+		static const enum VshFoggen foggens[] = { FOGGEN_SPEC_ALPHA, FOGGEN_RADIAL, FOGGEN_PLANAR, FOGGEN_ABS_PLANAR, FOGGEN_FOG_X };
+		state.foggen = foggens[rng() % 5];
+	}
+
+	state.primitive_mode = (enum ShaderPrimitiveMode)(1 + rng() % 10);
+	state.polygon_front_mode = (rng() % 2) ? POLY_MODE_LINE : POLY_MODE_FILL;
+	state.polygon_back_mode = state.polygon_front_mode;
+
+	return state;
+}
+
+static bool SameSources(const ShaderSources &a, const ShaderSources &b)
+{
+	return a.geometry == b.geometry && a.vertex == b.vertex && a.fragment == b.fragment
+		&& a.gl_primitive_mode == b.gl_primitive_mode;
+}
+
+// Keyed like the shader cache in PGRAPH (nv2a_int.h), on all the bytes of the state
+struct TestStateHash {
+	size_t operator()(const ShaderState &state) const {
+		return (size_t)fnv_hash(0xcbf29ce484222325ULL, std::string((const char *)&state, sizeof(state)));
+	}
+};
+
+struct TestStateEqual {
+	bool operator()(const ShaderState &a, const ShaderState &b) const {
+		return memcmp(&a, &b, sizeof(ShaderState)) == 0;
+	}
+};
+
+static void TestSources(const std::vector<ShaderState> &states)
+{
+	std::vector<ShaderSources> expected(states.size());
+	for (size_t i = 0; i < states.size(); i++) {
+		generate_shader_sources(&states[i], &expected[i]);
+	}
+
+	// The same sources object for every state, in both directions
+	ShaderSources reused;
+	for (size_t n = 0; n < 2 * states.size(); n++) {
+		size_t i = (n < states.size()) ? n : 2 * states.size() - 1 - n;
+		generate_shader_sources(&states[i], &reused);
+		if (!SameSources(reused, expected[i])) {
+			printf("FAIL : state %zu generated after state %zu differs\n", i, (n < states.size()) ? i - 1 : i + 1);
+			g_failures++;
+		}
+	}
+
+	// Every state twice, the second time (and copies of a state) from the map
+	std::unordered_map<ShaderState, ShaderSources, TestStateHash, TestStateEqual> cache;
+	size_t generated = 0;
+	for (size_t n = 0; n < 2 * states.size(); n++) {
+		size_t i = n % states.size();
+		auto it = cache.find(states[i]);
+		if (it == cache.end()) {
+			ShaderSources sources;
+			generate_shader_sources(&states[i], &sources);
+			it = cache.emplace(states[i], sources).first;
+			generated++;
+		}
+
+		if (!SameSources(it->second, expected[i])) {
+			printf("FAIL : sources looked up for state %zu differ\n", i);
+			g_failures++;
+		}
+	}
+
+	if (generated != cache.size() || generated > states.size()) {
+		printf("FAIL : %zu sources generated for %zu states, %zu cached\n", generated, states.size(), cache.size());
+		g_failures++;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc >= 2 && strcmp(argv[1], "-test") == 0) {
+		std::vector<ShaderState> states;
+		if (argc > 2) {
+			if (!LoadCorpus(argv[2], states)) {
+				return 1;
+			}
+		} else {
+			std::mt19937 rng(0x5ADE);
+			for (int i = 0; i < TEST_STATE_COUNT; i++) {
+				states.push_back(RandomShaderState(rng));
+			}
+			// Copies of earlier states, which must come from the cache
+			states.push_back(states[0]);
+			states.push_back(states[TEST_STATE_COUNT / 2]);
+		}
+
+		TestFormatting();
+		TestSources(states);
+		printf("%zu states, %u failure(s)\n", states.size(), g_failures);
+		return g_failures ? 1 : 0;
+	}
+
+	if (argc < 2) {
+		printf("Usage : cxbxr-shaderbench <corpus file> [repeat count] [state index to dump]\n");
+		printf("        cxbxr-shaderbench -test [corpus file]\n");
+		return 1;
+	}
+
+	int repeat_count = (argc > 2) ? atoi(argv[2]) : 1;
+	if (repeat_count < 1) {
+		repeat_count = 1;
+	}
+
+	std::vector<ShaderState> states;
+	if (!LoadCorpus(argv[1], states)) {
+		return 1;
+	}
+
+	if (states.empty()) {
+		printf("%s holds no states\n", argv[1]);
+		return 1;
+	}
+
+	if (argc > 3) {
+		size_t index = strtoul(argv[3], nullptr, 0);
+		if (index >= states.size()) {
+			printf("State index %zu out of range (%zu states)\n", index, states.size());
+			return 1;
+		}
+
+		ShaderSources sources;
+		generate_shader_sources(&states[index], &sources);
+		printf("// geometry shader\n%s\n// vertex shader\n%s\n// fragment shader\n%s\n",
+			sources.geometry.c_str(), sources.vertex.c_str(), sources.fragment.c_str());
+		return 0;
+	}
+
+	ShaderSources sources;
+	uint64_t output_hash = 0xcbf29ce484222325ULL;
+	size_t output_bytes = 0;
+	double slowest_seconds = 0.0;
+	size_t slowest_index = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for (int repeat = 0; repeat < repeat_count; repeat++) {
+		for (size_t i = 0; i < states.size(); i++) {
+			auto state_start = std::chrono::steady_clock::now();
+			generate_shader_sources(&states[i], &sources);
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - state_start).count();
+
+			if (seconds > slowest_seconds) {
+				slowest_seconds = seconds;
+				slowest_index = i;
+			}
+
+			if (repeat == 0) {
+				output_hash = fnv_hash(output_hash, sources.geometry);
+				output_hash = fnv_hash(output_hash, sources.vertex);
+				output_hash = fnv_hash(output_hash, sources.fragment);
+				output_bytes += sources.geometry.size() + sources.vertex.size() + sources.fragment.size();
+			}
+		}
+	}
+	double total_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	size_t generated = states.size() * repeat_count;
+	printf("%zu states x %d : %.3f ms total, %.1f us per state (slowest : state %zu, %.1f us)\n",
+		states.size(), repeat_count, total_seconds * 1000.0, total_seconds * 1e6 / generated,
+		slowest_index, slowest_seconds * 1e6);
+	printf("%zu bytes of GLSL per pass, output hash %016llx\n",
+		output_bytes, (unsigned long long)output_hash);
+
+	return 0;
+}
@@ -0,0 +1,449 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of Cxbx-Reloaded.
+// *
+// *  Cxbx-Reloaded is free software; you can redistribute it
+// *  and/or modify it under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+// Measures the contention between two processes sharing the state EmuShared
+// shares between the GUI and the emulation process, on a POSIX shared memory
+// mapping with the layout of EmuShared. The emulation process sets the FPS
+// and reads the core and hack settings each frame, while the GUI process
+// polls the FPS, the emulation status and the log modules, and now and then
+// writes settings. Scalars are atomics and settings go through the sequence
+// lock of SeqLock.h, like EmuShared does. With -locked, every access instead
+// takes the Mutex that EmuShared inherits from (ported here, with its Sleep(1)
+// spin), like EmuShared did before.
+//
+// With -test, the settings every read returns must be ones that were written
+// as a whole, and the FPS values the GUI reads must never go back.
+//
+// Usage : cxbxr-sharedbench [frames] [-locked]
+//         cxbxr-sharedbench -test
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "common/util/SeqLock.h"
+
+#define TEST_FRAMES 200000
+// GUI polls between settings writes
+#define GUI_WRITE_INTERVAL 64
+#define MAX_PATH 260
+#define NUM_INTEGERS_LOG 2
+
+typedef std::chrono::steady_clock BenchClock;
+
+static int64_t NowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now().time_since_epoch()).count();
+}
+
+// Same as Mutex (Mutex.cpp), which EmuShared inherits from. Both processes are single threaded here,
+// so the owner thread is the process too.
+class BenchMutex
+{
+public:
+	void Lock()
+	{
+		int32_t CurrentProcessId = (int32_t)getpid();
+		while (true) {
+			// Grab the lock, letting us look at the variables
+			int32_t Expected = 0;
+			while (!m_MutexLock.compare_exchange_strong(Expected, 1)) {
+				Expected = 0;
+				Sleep1();
+			}
+
+			// Are we the new owner?
+			if (!m_OwnerProcess) {
+				m_OwnerProcess = CurrentProcessId;
+				m_OwnerThread = CurrentProcessId;
+				m_LockCount = 1;
+				m_MutexLock = 0;
+				return;
+			}
+
+			// If a different process owns this mutex right now, unlock the mutex lock and wait
+			if (m_OwnerProcess != CurrentProcessId) {
+				m_MutexLock = 0;
+				Sleep1();
+				continue;
+			}
+
+			m_LockCount++;
+			m_MutexLock = 0;
+			return;
+		}
+	}
+
+	void Unlock()
+	{
+		int32_t Expected = 0;
+		while (!m_MutexLock.compare_exchange_strong(Expected, 1)) {
+			Expected = 0;
+			Sleep1();
+		}
+
+		if (--m_LockCount == 0) {
+			m_OwnerProcess = 0;
+			m_OwnerThread = 0;
+		}
+
+		m_MutexLock = 0;
+	}
+
+private:
+	static void Sleep1() { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+
+	std::atomic<int32_t> m_MutexLock{ 0 };
+	std::atomic<int32_t> m_OwnerProcess{ 0 };
+	std::atomic<int32_t> m_OwnerThread{ 0 };
+	std::atomic<int32_t> m_LockCount{ 0 };
+};
+
+// Same layout as Settings::s_core and Settings::s_hack
+struct BenchCore {
+	unsigned int Revision;
+	unsigned int FlagsLLE;
+	int KrnlDebugMode;
+	char szKrnlDebug[MAX_PATH];
+	char szStorageLocation[MAX_PATH];
+	unsigned int LoggedModules[NUM_INTEGERS_LOG];
+	int LogLevel;
+	bool bUseLoaderExec;
+	bool allowAdminPrivilege;
+	bool bLogPopupTestCase;
+	bool Reserved4;
+	int  Reserved99[10];
+};
+static_assert(sizeof(BenchCore) == 0x24C, "BenchCore must have the layout of Settings::s_core");
+
+struct BenchHack {
+	bool DisablePixelShaders;
+	bool Reserved2;
+	bool UseAllCores;
+	bool SkipRdtscPatching;
+	bool Reserved3;
+	bool Reserved4;
+	bool Reserved7;
+	bool Reserved8;
+	int  Reserved99[8];
+};
+static_assert(sizeof(BenchHack) == 0x28, "BenchHack must have the layout of Settings::s_hack");
+
+// How one side of the benchmark did, written to the shared memory by the emulation process
+struct BenchStats {
+	uint64_t accesses;
+	uint64_t torn;      // Settings reads that mixed two writes
+	uint64_t backwards; // FPS reads older than the one before
+	double p50_US;
+	double p99_US;
+	double max_US;
+	double seconds;
+};
+
+static bool g_bLocked = false;
+
+// The accessors of EmuShared that are used every frame or poll, on the same kind of fields
+class BenchShared : public BenchMutex
+{
+public:
+	void GetCurrentFPS(float *value) { if (g_bLocked) { Lock(); *value = m_FPS_status; Unlock(); } else { *value = m_FPS_status; } }
+	void SetCurrentFPS(const float *value) { if (g_bLocked) { Lock(); m_FPS_status = *value; Unlock(); } else { m_FPS_status = *value; } }
+	void GetIsEmulating(bool *isEmulating) { if (g_bLocked) { Lock(); *isEmulating = m_bEmulating_status; Unlock(); } else { *isEmulating = m_bEmulating_status; } }
+	void SetIsEmulating(const bool isEmulating) { if (g_bLocked) { Lock(); m_bEmulating_status = isEmulating; Unlock(); } else { m_bEmulating_status = isEmulating; } }
+
+	void GetCoreSettings(      BenchCore *emulate) { ReadSettings([&] { *emulate = m_core; }); }
+	void SetCoreSettings(const BenchCore *emulate) { WriteSettings([&] { m_core = *emulate; }); }
+	void GetHackSettings(BenchHack *hacks) { ReadSettings([&] { *hacks = m_hacks; }); }
+	void SetHackSettings(BenchHack *hacks) { WriteSettings([&] { m_hacks = *hacks; }); }
+	void GetFlagsLLE(unsigned int *flags) { ReadSettings([&] { *flags = m_core.FlagsLLE; }); }
+	void GetLogModules(unsigned int *value)
+	{
+		ReadSettings([&] {
+			for (int i = 0; i < NUM_INTEGERS_LOG; ++i) {
+				value[i] = m_core.LoggedModules[i];
+			}
+		});
+	}
+
+	std::atomic_bool m_bEmulatorDone{ false };
+	BenchStats m_EmulatorStats = {};
+
+private:
+	template<typename Copy> void ReadSettings(Copy copy)
+	{
+		if (g_bLocked) {
+			Lock(); copy(); Unlock();
+		} else {
+			SeqLock_Read(m_SettingsVersion, copy);
+		}
+	}
+	template<typename Copy> void WriteSettings(Copy copy)
+	{
+		Lock();
+		if (g_bLocked) {
+			copy();
+		} else {
+			SeqLock_Write(m_SettingsVersion, copy);
+		}
+		Unlock();
+	}
+
+	std::atomic<float> m_FPS_status{ 0 };
+	std::atomic_bool m_bEmulating_status{ false };
+	std::atomic_uint m_SettingsVersion{ 0 };
+	BenchCore m_core = {};
+	BenchHack m_hacks = {};
+};
+
+// Every word the GUI writes into the settings is derived from one generation number, so readers can
+// tell when a copy mixed two writes
+static void MakeSettings(unsigned Generation, BenchCore &core, BenchHack &hacks)
+{
+	memset(&core, (int)(Generation & 0xFF), sizeof(core));
+	core.Revision = Generation;
+	core.FlagsLLE = Generation * 3;
+	core.LoggedModules[0] = Generation * 5;
+	core.LoggedModules[1] = Generation * 7;
+	memset(&hacks, (int)(Generation & 0xFF), sizeof(hacks));
+	hacks.Reserved99[0] = (int)Generation;
+}
+
+// The bytes memset fills the rest with, as they read in an int
+static unsigned FillOf(unsigned Generation)
+{
+	return (Generation & 0xFF) * 0x01010101u;
+}
+
+static bool IsWholeCore(const BenchCore &core)
+{
+	unsigned Generation = core.Revision;
+	unsigned Fill = FillOf(Generation);
+	return core.FlagsLLE == Generation * 3 && core.LoggedModules[0] == Generation * 5 && core.LoggedModules[1] == Generation * 7 &&
+		(unsigned)core.KrnlDebugMode == Fill && (unsigned char)core.szStorageLocation[MAX_PATH - 1] == (Fill & 0xFF) &&
+		(unsigned)core.Reserved99[9] == Fill;
+}
+
+static bool IsWholeHack(const BenchHack &hacks)
+{
+	unsigned Generation = (unsigned)hacks.Reserved99[0];
+	return (unsigned)hacks.Reserved99[1] == FillOf(Generation) && (unsigned)hacks.Reserved99[7] == FillOf(Generation);
+}
+
+static BenchStats Summarize(std::vector<int64_t> &Latency, int64_t StartNs)
+{
+	BenchStats Stats = {};
+	Stats.seconds = (NowNs() - StartNs) / 1e9;
+	Stats.accesses = Latency.size();
+	if (!Latency.empty()) {
+		std::sort(Latency.begin(), Latency.end());
+		Stats.p50_US = Latency[Latency.size() / 2] / 1000.0;
+		Stats.p99_US = Latency[std::min(Latency.size() - 1, (Latency.size() * 99) / 100)] / 1000.0;
+		Stats.max_US = Latency.back() / 1000.0;
+	}
+	return Stats;
+}
+
+// Each frame sets the FPS, and reads the settings the emulation consults while it runs
+static void EmulatorProcess(BenchShared *pShared, unsigned Frames)
+{
+	std::vector<int64_t> Latency;
+	Latency.reserve((size_t)Frames * 4);
+	BenchStats Stats = {};
+	BenchCore core;
+	BenchHack hacks;
+	unsigned int FlagsLLE;
+
+	pShared->SetIsEmulating(true);
+	int64_t Start = NowNs();
+	for (unsigned Frame = 1; Frame <= Frames; Frame++) {
+		float FPS = (float)Frame;
+		int64_t t0 = NowNs();
+		pShared->SetCurrentFPS(&FPS);
+		int64_t t1 = NowNs();
+		pShared->GetFlagsLLE(&FlagsLLE);
+		int64_t t2 = NowNs();
+		pShared->GetHackSettings(&hacks);
+		int64_t t3 = NowNs();
+		pShared->GetCoreSettings(&core);
+		int64_t t4 = NowNs();
+		Latency.push_back(t1 - t0);
+		Latency.push_back(t2 - t1);
+		Latency.push_back(t3 - t2);
+		Latency.push_back(t4 - t3);
+
+		Stats.torn += IsWholeHack(hacks) ? 0 : 1;
+		Stats.torn += IsWholeCore(core) ? 0 : 1;
+	}
+
+	BenchStats Summary = Summarize(Latency, Start);
+	Summary.torn = Stats.torn;
+	pShared->m_EmulatorStats = Summary;
+	pShared->SetIsEmulating(false);
+	pShared->m_bEmulatorDone = true;
+}
+
+// Polls what the GUI shows, and writes settings now and then, until the emulation process is done
+static BenchStats GuiProcess(BenchShared *pShared)
+{
+	std::vector<int64_t> Latency;
+	BenchStats Stats = {};
+	unsigned Generation = 1;
+	float LastFPS = 0;
+	BenchCore core;
+	BenchHack hacks;
+	unsigned int LogModules[NUM_INTEGERS_LOG];
+	bool bEmulating;
+
+	int64_t Start = NowNs();
+	for (unsigned Poll = 1; !pShared->m_bEmulatorDone; Poll++) {
+		float FPS;
+		int64_t t0 = NowNs();
+		pShared->GetCurrentFPS(&FPS);
+		int64_t t1 = NowNs();
+		pShared->GetIsEmulating(&bEmulating);
+		int64_t t2 = NowNs();
+		pShared->GetLogModules(LogModules);
+		int64_t t3 = NowNs();
+		Latency.push_back(t1 - t0);
+		Latency.push_back(t2 - t1);
+		Latency.push_back(t3 - t2);
+
+		Stats.backwards += (FPS < LastFPS) ? 1 : 0;
+		LastFPS = FPS;
+		Stats.torn += (LogModules[1] * 5 == LogModules[0] * 7) ? 0 : 1;
+
+		if (Poll % GUI_WRITE_INTERVAL == 0) {
+			Generation++;
+			MakeSettings(Generation, core, hacks);
+			int64_t t4 = NowNs();
+			pShared->SetCoreSettings(&core);
+			pShared->SetHackSettings(&hacks);
+			Latency.push_back(NowNs() - t4);
+		}
+	}
+
+	BenchStats Summary = Summarize(Latency, Start);
+	Summary.torn = Stats.torn;
+	Summary.backwards = Stats.backwards;
+	return Summary;
+}
+
+static void PrintStats(const char *szSide, const BenchStats &Stats)
+{
+	printf("%-9s : %9llu accesses in %6.2f s, us per access p50 %6.2f, p99 %8.2f, max %9.1f\n", szSide,
+		(unsigned long long)Stats.accesses, Stats.seconds, Stats.p50_US, Stats.p99_US, Stats.max_US);
+}
+
+int main(int argc, char *argv[])
+{
+	bool bTest = false;
+	unsigned Frames = TEST_FRAMES;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-test") == 0 && argc == 2) {
+			bTest = true;
+		} else if (strcmp(argv[i], "-locked") == 0) {
+			g_bLocked = true;
+		} else if (argv[i][0] >= '0' && argv[i][0] <= '9') {
+			Frames = strtoul(argv[i], nullptr, 0);
+		} else {
+			printf("Usage : cxbxr-sharedbench [frames] [-locked]\n");
+			printf("        cxbxr-sharedbench -test\n");
+			return 1;
+		}
+	}
+
+	// Like EmuShared, a named mapping both processes open (the child inherits it here)
+	char szName[64];
+	snprintf(szName, sizeof(szName), "/cxbxr-sharedbench-%d", (int)getpid());
+	int fd = shm_open(szName, O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0 || ftruncate(fd, sizeof(BenchShared)) != 0) {
+		perror("shm_open");
+		return 1;
+	}
+	void *pMemory = mmap(nullptr, sizeof(BenchShared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	shm_unlink(szName);
+	if (pMemory == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	BenchShared *pShared = new (pMemory) BenchShared();
+	BenchCore core;
+	BenchHack hacks;
+	MakeSettings(1, core, hacks);
+	pShared->SetCoreSettings(&core);
+	pShared->SetHackSettings(&hacks);
+
+	printf("%u frames, %s\n", Frames, g_bLocked ? "every access takes the lock" : "atomics and sequence lock");
+	fflush(stdout);
+	pid_t Child = fork();
+	if (Child < 0) {
+		perror("fork");
+		return 1;
+	}
+	if (Child == 0) {
+		EmulatorProcess(pShared, Frames);
+		_exit(0);
+	}
+
+	BenchStats Gui = GuiProcess(pShared);
+	int Status;
+	waitpid(Child, &Status, 0);
+	BenchStats Emulator = pShared->m_EmulatorStats;
+	PrintStats("emulation", Emulator);
+	PrintStats("GUI", Gui);
+
+	if (bTest) {
+		unsigned failures = 0;
+		if (!WIFEXITED(Status) || WEXITSTATUS(Status) != 0 || Emulator.accesses != (uint64_t)Frames * 4) {
+			printf("FAIL : the emulation process didn't finish\n");
+			failures++;
+		}
+		if (Emulator.torn + Gui.torn != 0) {
+			printf("FAIL : %llu settings reads mixed two writes\n", (unsigned long long)(Emulator.torn + Gui.torn));
+			failures++;
+		}
+		if (Gui.backwards != 0) {
+			printf("FAIL : the FPS went back %llu times\n", (unsigned long long)Gui.backwards);
+			failures++;
+		}
+		printf("%u failure(s)\n", failures);
+		return failures ? 1 : 0;
+	}
+
+	return 0;
+}
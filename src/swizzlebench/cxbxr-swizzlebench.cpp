@@ -0,0 +1,276 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of Cxbx-Reloaded.
+// *
+// *  Cxbx-Reloaded is free software; you can redistribute it
+// *  and/or modify it under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+// Checks and times SwizzleBox and UnswizzleBox (XbSwizzle.cpp), which the
+// XGSwizzle*/XGUnswizzle* patches and EmuUnswizzleBox use, against a copy
+// that computes the swizzled offset of every texel on its own.
+//
+// The test copies random boxes, at random positions, of random textures
+// (2D and volumes), with random texel sizes and row and slice pitches, both
+// ways, and requires the exact same bytes as the per-texel copy, including
+// the texels outside the box (and the pitch padding) staying untouched.
+//
+// The benchmark reports the time to swizzle and unswizzle a few common
+// texture sizes and a sub rectangle, next to the masked-increment loop the
+// XDK's XGSwizzleRect runs on the guest.
+//
+// Usage : cxbxr-swizzlebench [seconds per measurement]
+//         cxbxr-swizzlebench -test
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "core/hle/D3D8/XbSwizzle.h"
+
+#define TEST_TEXTURES 6000
+#define TEST_MAX_TEXELS (1 << 18)
+#define BENCH_SECONDS 0.3
+
+// The bits of the swizzled offset each coordinate uses, like the XDK computes them
+static void SwizzleMasks(uint32_t Width, uint32_t Height, uint32_t Depth, uint32_t *pMaskX, uint32_t *pMaskY, uint32_t *pMaskZ)
+{
+	uint32_t MaskX = 0, MaskY = 0, MaskZ = 0;
+	for (uint32_t i = 1, j = 1; i < Width || i < Height || i < Depth; i <<= 1) {
+		if (i < Width) {
+			MaskX |= j;
+			j <<= 1;
+		}
+		if (i < Height) {
+			MaskY |= j;
+			j <<= 1;
+		}
+		if (i < Depth) {
+			MaskZ |= j;
+			j <<= 1;
+		}
+	}
+
+	*pMaskX = MaskX;
+	*pMaskY = MaskY;
+	*pMaskZ = MaskZ;
+}
+
+// Deposits the low bits of Value into the bits set in Mask, lowest first
+static uint32_t SpreadBits(uint32_t Value, uint32_t Mask)
+{
+	uint32_t Result = 0;
+	for (; Mask != 0; Mask &= Mask - 1, Value >>= 1) {
+		if (Value & 1) {
+			Result |= Mask & (0 - Mask);
+		}
+	}
+
+	return Result;
+}
+
+static uint32_t SwizzledOffset(uint32_t x, uint32_t y, uint32_t z, uint32_t Width, uint32_t Height, uint32_t Depth)
+{
+	uint32_t MaskX, MaskY, MaskZ;
+	SwizzleMasks(Width, Height, Depth, &MaskX, &MaskY, &MaskZ);
+	return SpreadBits(x, MaskX) | SpreadBits(y, MaskY) | SpreadBits(z, MaskZ);
+}
+
+static unsigned CompareRandom(unsigned *pCopies)
+{
+	static const uint32_t TexelSizes[] = { 1, 2, 3, 4, 8, 16 };
+
+	std::mt19937 Rng(1);
+	unsigned Mismatches = 0;
+	*pCopies = 0;
+	for (unsigned n = 0; n < TEST_TEXTURES; n++) {
+		uint32_t Width = 1u << (Rng() % 9);
+		uint32_t Height = 1u << (Rng() % 9);
+		uint32_t Depth = (Rng() % 4 == 0) ? 1u << (Rng() % 5) : 1;
+		if ((uint64_t)Width * Height * Depth > TEST_MAX_TEXELS) {
+			continue;
+		}
+
+		uint32_t BytesPerPixel = TexelSizes[Rng() % 6];
+		uint32_t BoxWidth = 1 + Rng() % Width;
+		uint32_t BoxHeight = 1 + Rng() % Height;
+		uint32_t BoxDepth = 1 + Rng() % Depth;
+		uint32_t X = Rng() % (Width - BoxWidth + 1);
+		uint32_t Y = Rng() % (Height - BoxHeight + 1);
+		uint32_t Z = Rng() % (Depth - BoxDepth + 1);
+		// Pitches with some padding, not always a multiple of the texel size
+		uint32_t RowPitch = BoxWidth * BytesPerPixel + (Rng() % 3) * BytesPerPixel + Rng() % 2;
+		uint32_t SlicePitch = RowPitch * BoxHeight + (Rng() % 3) * RowPitch;
+		size_t LinearSize = (size_t)SlicePitch * BoxDepth;
+
+		std::vector<uint8_t> Linear(LinearSize);
+		std::vector<uint8_t> Swizzled((size_t)Width * Height * Depth * BytesPerPixel);
+		for (auto &Byte : Linear) {
+			Byte = (uint8_t)Rng();
+		}
+		for (auto &Byte : Swizzled) {
+			Byte = (uint8_t)Rng();
+		}
+
+		std::vector<uint8_t> Expected = Swizzled;
+		std::vector<uint8_t> Result = Swizzled;
+		SwizzleBox(Linear.data(), RowPitch, SlicePitch, Result.data(), Width, Height, Depth, X, Y, Z, BoxWidth, BoxHeight, BoxDepth, BytesPerPixel);
+		for (uint32_t z = 0; z < BoxDepth; z++) {
+			for (uint32_t y = 0; y < BoxHeight; y++) {
+				for (uint32_t x = 0; x < BoxWidth; x++) {
+					memcpy(&Expected[(size_t)SwizzledOffset(X + x, Y + y, Z + z, Width, Height, Depth) * BytesPerPixel],
+						&Linear[(size_t)z * SlicePitch + y * RowPitch + x * BytesPerPixel], BytesPerPixel);
+				}
+			}
+		}
+		if (Result != Expected) {
+			if (Mismatches < 5) {
+				printf("FAIL : SwizzleBox of %ux%ux%u at %u,%u,%u into %ux%ux%u, %u bytes per texel\n",
+					BoxWidth, BoxHeight, BoxDepth, X, Y, Z, Width, Height, Depth, BytesPerPixel);
+			}
+			Mismatches++;
+		}
+
+		std::vector<uint8_t> ExpectedLinear(LinearSize, 0xCD);
+		std::vector<uint8_t> ResultLinear(LinearSize, 0xCD);
+		UnswizzleBox(Swizzled.data(), Width, Height, Depth, X, Y, Z, BoxWidth, BoxHeight, BoxDepth, ResultLinear.data(), RowPitch, SlicePitch, BytesPerPixel);
+		for (uint32_t z = 0; z < BoxDepth; z++) {
+			for (uint32_t y = 0; y < BoxHeight; y++) {
+				for (uint32_t x = 0; x < BoxWidth; x++) {
+					memcpy(&ExpectedLinear[(size_t)z * SlicePitch + y * RowPitch + x * BytesPerPixel],
+						&Swizzled[(size_t)SwizzledOffset(X + x, Y + y, Z + z, Width, Height, Depth) * BytesPerPixel], BytesPerPixel);
+				}
+			}
+		}
+		if (ResultLinear != ExpectedLinear) {
+			if (Mismatches < 5) {
+				printf("FAIL : UnswizzleBox of %ux%ux%u at %u,%u,%u from %ux%ux%u, %u bytes per texel\n",
+					BoxWidth, BoxHeight, BoxDepth, X, Y, Z, Width, Height, Depth, BytesPerPixel);
+			}
+			Mismatches++;
+		}
+
+		(*pCopies) += 2;
+	}
+
+	return Mismatches;
+}
+
+// The masked-increment loop of the XDK's XGSwizzleRect, one texel at a time
+template<typename T>
+static void GuestSwizzleRect(const uint8_t *pSource, uint32_t Pitch, uint8_t *pDest, uint32_t Width, uint32_t Height,
+	uint32_t X, uint32_t Y, uint32_t RectWidth, uint32_t RectHeight)
+{
+	uint32_t MaskX, MaskY, MaskZ;
+	SwizzleMasks(Width, Height, 1, &MaskX, &MaskY, &MaskZ);
+	uint32_t OffsetY = SpreadBits(Y, MaskY);
+	uint32_t StartX = SpreadBits(X, MaskX);
+	T *pTexels = (T *)pDest;
+	for (uint32_t y = 0; y < RectHeight; y++) {
+		const T *pRow = (const T *)(pSource + y * Pitch);
+		uint32_t OffsetX = StartX;
+		for (uint32_t x = 0; x < RectWidth; x++) {
+			pTexels[OffsetX | OffsetY] = pRow[x];
+			OffsetX = (OffsetX - MaskX) & MaskX;
+		}
+		OffsetY = (OffsetY - MaskY) & MaskY;
+	}
+}
+
+// Microseconds per call, over at least Seconds
+template<typename F>
+static double TimeCalls(double Seconds, F Call)
+{
+	using Clock = std::chrono::steady_clock;
+	unsigned Calls = 0;
+	double Elapsed;
+	auto Start = Clock::now();
+	do {
+		Call();
+		Calls++;
+		Elapsed = std::chrono::duration<double>(Clock::now() - Start).count();
+	} while (Elapsed < Seconds);
+
+	return Elapsed / Calls * 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 2 && strcmp(argv[1], "-test") == 0) {
+		unsigned failures = 0;
+		unsigned Copies;
+		unsigned Mismatches = CompareRandom(&Copies);
+		printf("%u random copies, %u mismatches\n", Copies, Mismatches);
+		if (Mismatches != 0) {
+			printf("FAIL : %u copies wrote other bytes than the per-texel copy\n", Mismatches);
+			failures++;
+		}
+		printf("%u failure(s)\n", failures);
+		return failures ? 1 : 0;
+	}
+
+	double Seconds = BENCH_SECONDS;
+	if (argc > 2 || (argc == 2 && (argv[1][0] < '0' || argv[1][0] > '9'))) {
+		printf("Usage : cxbxr-swizzlebench [seconds per measurement]\n");
+		printf("        cxbxr-swizzlebench -test\n");
+		return 1;
+	}
+	if (argc == 2) {
+		Seconds = strtod(argv[1], nullptr);
+	}
+
+	static const struct {
+		uint32_t Width, Height, BytesPerPixel;
+		uint32_t X, Y, RectWidth, RectHeight;
+	} Cases[] = {
+		{ 256, 256, 4, 0, 0, 256, 256 },
+		{ 512, 512, 4, 0, 0, 512, 512 },
+		{ 256, 256, 2, 0, 0, 256, 256 },
+		{ 256, 256, 1, 0, 0, 256, 256 },
+		{ 256, 256, 4, 3, 5, 200, 150 },
+		{ 1024, 1024, 4, 0, 0, 1024, 1024 },
+	};
+	for (const auto &Case : Cases) {
+		uint32_t Pitch = Case.RectWidth * Case.BytesPerPixel;
+		std::vector<uint8_t> Linear((size_t)Pitch * Case.RectHeight, 7);
+		std::vector<uint8_t> Swizzled((size_t)Case.Width * Case.Height * Case.BytesPerPixel);
+		auto Guest = [&]() {
+			switch (Case.BytesPerPixel) {
+			case 1: GuestSwizzleRect<uint8_t>(Linear.data(), Pitch, Swizzled.data(), Case.Width, Case.Height, Case.X, Case.Y, Case.RectWidth, Case.RectHeight); break;
+			case 2: GuestSwizzleRect<uint16_t>(Linear.data(), Pitch, Swizzled.data(), Case.Width, Case.Height, Case.X, Case.Y, Case.RectWidth, Case.RectHeight); break;
+			default: GuestSwizzleRect<uint32_t>(Linear.data(), Pitch, Swizzled.data(), Case.Width, Case.Height, Case.X, Case.Y, Case.RectWidth, Case.RectHeight); break;
+			}
+		};
+		double GuestUs = TimeCalls(Seconds, Guest);
+		double SwizzleUs = TimeCalls(Seconds, [&]() {
+			SwizzleBox(Linear.data(), Pitch, 0, Swizzled.data(), Case.Width, Case.Height, 1, Case.X, Case.Y, 0, Case.RectWidth, Case.RectHeight, 1, Case.BytesPerPixel);
+		});
+		double UnswizzleUs = TimeCalls(Seconds, [&]() {
+			UnswizzleBox(Swizzled.data(), Case.Width, Case.Height, 1, Case.X, Case.Y, 0, Case.RectWidth, Case.RectHeight, 1, Linear.data(), Pitch, 0, Case.BytesPerPixel);
+		});
+		printf("%4ux%-4u %u bytes, rect %4ux%-4u : guest loop %8.1f us, SwizzleBox %8.1f us (%.1fx), UnswizzleBox %8.1f us\n",
+			Case.Width, Case.Height, Case.BytesPerPixel, Case.RectWidth, Case.RectHeight, GuestUs, SwizzleUs, GuestUs / SwizzleUs, UnswizzleUs);
+	}
+
+	return 0;
+}
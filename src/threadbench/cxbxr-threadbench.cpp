@@ -0,0 +1,261 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of Cxbx-Reloaded.
+// *
+// *  Cxbx-Reloaded is free software; you can redistribute it
+// *  and/or modify it under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+// Creates threads the way PsCreateSystemThreadEx does, and measures how
+// long each creation blocks the creator and how long until the new thread
+// runs. Like the emulator, each thread is a proxy that waits on its start
+// event until the creator hands it a routine, then signals its started
+// event; the creator waits for that handshake. Proxies come from the same
+// PrestartedPool as the emulator uses, with its pool size.
+//
+// With -inline, the creator refills the pool itself after each creation,
+// and with -spawn, it starts a new proxy for every creation (no pool).
+//
+// Usage : cxbxr-threadbench [thread count] [interval us] [-inline | -spawn]
+//         cxbxr-threadbench -test
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common/util/PrestartedPool.h"
+
+// Same as PCST_POOL_SIZE
+#define BENCH_POOL_SIZE 4
+#define TEST_THREAD_COUNT 100
+// Titles start their threads a little apart (each one initializes something first)
+#define TEST_INTERVAL_US 1000
+
+typedef std::chrono::steady_clock BenchClock;
+
+static int64_t NowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now().time_since_epoch()).count();
+}
+
+// Same as a host event created by CreateEvent
+class BenchEvent
+{
+public:
+	void Set() { std::lock_guard<std::mutex> lock(m_Mtx); m_bSet = true; m_Cv.notify_all(); }
+	void Wait() { std::unique_lock<std::mutex> lock(m_Mtx); m_Cv.wait(lock, [this]() { return m_bSet; }); }
+
+private:
+	std::mutex m_Mtx;
+	std::condition_variable m_Cv;
+	bool m_bSet = false;
+};
+
+// Same as PCSTProxyParam
+struct BenchProxy {
+	std::thread Thread;
+	BenchEvent StartEvent;
+	BenchEvent StartedEvent;
+	std::atomic<int64_t> *pRunNs; // Where the start routine records when it ran, null to exit
+};
+
+static void BenchProxyThread(BenchProxy *pProxy)
+{
+	pProxy->StartEvent.Wait();
+	std::atomic<int64_t> *pRunNs = pProxy->pRunNs;
+	pProxy->StartedEvent.Set();
+	if (pRunNs != nullptr) {
+		// The start routine
+		*pRunNs = NowNs();
+	}
+}
+
+static BenchProxy *BenchProxySpawn()
+{
+	BenchProxy *pProxy = new BenchProxy();
+	pProxy->Thread = std::thread(BenchProxyThread, pProxy);
+	return pProxy;
+}
+
+enum class BenchMode { Prestarted, Inline, Spawn };
+
+struct BenchResult {
+	std::vector<int64_t> createNs;  // How long each creation blocked the creator
+	std::vector<int64_t> runningNs; // From the start of each creation until its thread ran
+	int64_t totalCreateNs;
+	unsigned spawnedByCreator;      // Proxies started on the creator's thread
+	unsigned ran;                   // Threads whose start routine ran
+};
+
+static BenchResult RunBench(unsigned ThreadCount, unsigned Interval_US, BenchMode Mode)
+{
+	BenchResult result = {};
+	std::vector<int64_t> StartNs(ThreadCount, 0);
+	std::vector<std::atomic<int64_t>> RunNs(ThreadCount);
+	std::vector<BenchProxy*> Proxies;
+	PrestartedPool<BenchProxy*> Pool(BENCH_POOL_SIZE, BenchProxySpawn);
+	// What the reviewed PsCreateSystemThreadEx did : take from a pool, then refill it on the creator's thread
+	std::vector<BenchProxy*> InlinePool;
+
+	// Let the pools fill up, like they would while the title boots
+	Pool.Start();
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	for (unsigned i = 0; i < BENCH_POOL_SIZE; i++) {
+		InlinePool.push_back(BenchProxySpawn());
+	}
+
+	for (unsigned i = 0; i < ThreadCount; i++) {
+		int64_t Start = NowNs();
+		StartNs[i] = Start;
+		BenchProxy *pProxy;
+		if (Mode == BenchMode::Prestarted) {
+			bool bFromPool;
+			pProxy = Pool.Acquire(&bFromPool);
+			result.spawnedByCreator += bFromPool ? 0 : 1;
+		} else if (Mode == BenchMode::Inline) {
+			pProxy = InlinePool.back();
+			InlinePool.pop_back();
+		} else {
+			pProxy = BenchProxySpawn();
+			result.spawnedByCreator++;
+		}
+
+		pProxy->pRunNs = &RunNs[i];
+		pProxy->StartEvent.Set();
+		pProxy->StartedEvent.Wait();
+
+		if (Mode == BenchMode::Inline) {
+			while (InlinePool.size() < BENCH_POOL_SIZE) {
+				InlinePool.push_back(BenchProxySpawn());
+				result.spawnedByCreator++;
+			}
+		}
+
+		int64_t End = NowNs();
+		result.createNs.push_back(End - Start);
+		result.totalCreateNs += End - Start;
+		Proxies.push_back(pProxy);
+		if (Interval_US != 0) {
+			std::this_thread::sleep_for(std::chrono::microseconds(Interval_US));
+		}
+	}
+
+	// Stop every proxy that was never used
+	for (BenchProxy *pProxy : Pool.Shutdown()) {
+		InlinePool.push_back(pProxy);
+	}
+	for (BenchProxy *pProxy : InlinePool) {
+		pProxy->pRunNs = nullptr;
+		pProxy->StartEvent.Set();
+		Proxies.push_back(pProxy);
+	}
+	for (BenchProxy *pProxy : Proxies) {
+		pProxy->Thread.join();
+		delete pProxy;
+	}
+
+	for (unsigned i = 0; i < ThreadCount; i++) {
+		if (RunNs[i] != 0) {
+			result.runningNs.push_back(RunNs[i] - StartNs[i]);
+			result.ran++;
+		}
+	}
+	return result;
+}
+
+static double Percentile_US(std::vector<int64_t> Values, double p)
+{
+	if (Values.empty()) {
+		return 0.0;
+	}
+	size_t i = std::min(Values.size() - 1, (size_t)(p * Values.size()));
+	std::nth_element(Values.begin(), Values.begin() + i, Values.end());
+	return Values[i] / 1000.0;
+}
+
+static void PrintResult(const char *szMode, const BenchResult &result)
+{
+	printf("%-10s : %u threads in %8.2f ms, %3u proxies started by the creator\n", szMode,
+		(unsigned)result.createNs.size(), result.totalCreateNs / 1e6, result.spawnedByCreator);
+	printf("%-10s   creation us p50 %7.1f, p99 %7.1f, max %7.1f | create to running us p50 %7.1f, max %7.1f\n", "",
+		Percentile_US(result.createNs, 0.5), Percentile_US(result.createNs, 0.99), Percentile_US(result.createNs, 1.0),
+		Percentile_US(result.runningNs, 0.5), Percentile_US(result.runningNs, 1.0));
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 2 && strcmp(argv[1], "-test") == 0) {
+		unsigned failures = 0;
+		BenchResult result = RunBench(TEST_THREAD_COUNT, TEST_INTERVAL_US, BenchMode::Prestarted);
+		PrintResult("prestarted", result);
+		if (result.ran != TEST_THREAD_COUNT) {
+			printf("FAIL : %u of %u threads ran\n", result.ran, TEST_THREAD_COUNT);
+			failures++;
+		}
+		if (result.spawnedByCreator != 0) {
+			printf("FAIL : the creator had to start %u proxies itself\n", result.spawnedByCreator);
+			failures++;
+		}
+		printf("%u failure(s)\n", failures);
+		return failures ? 1 : 0;
+	}
+
+	unsigned ThreadCount = TEST_THREAD_COUNT;
+	unsigned Interval_US = 0;
+	std::vector<BenchMode> Modes;
+	std::vector<const char *> args;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-inline") == 0) {
+			Modes.push_back(BenchMode::Inline);
+		} else if (strcmp(argv[i], "-spawn") == 0) {
+			Modes.push_back(BenchMode::Spawn);
+		} else if (argv[i][0] >= '0' && argv[i][0] <= '9') {
+			args.push_back(argv[i]);
+		} else {
+			printf("Usage : cxbxr-threadbench [thread count] [interval us] [-inline | -spawn]\n");
+			printf("        cxbxr-threadbench -test\n");
+			return 1;
+		}
+	}
+	if (args.size() > 0) {
+		ThreadCount = strtoul(args[0], nullptr, 0);
+	}
+	if (args.size() > 1) {
+		Interval_US = strtoul(args[1], nullptr, 0);
+	}
+	if (Modes.empty()) {
+		Modes = { BenchMode::Prestarted, BenchMode::Inline, BenchMode::Spawn };
+	}
+
+	printf("%u threads, %u us apart\n", ThreadCount, Interval_US);
+	for (BenchMode Mode : Modes) {
+		BenchResult result = RunBench(ThreadCount, Interval_US, Mode);
+		PrintResult(Mode == BenchMode::Prestarted ? "prestarted" : Mode == BenchMode::Inline ? "inline" : "spawn", result);
+	}
+
+	return 0;
+}
@@ -0,0 +1,293 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of Cxbx-Reloaded.
+// *
+// *  Cxbx-Reloaded is free software; you can redistribute it
+// *  and/or modify it under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+// Drives the OHCIFrameSchedule of the emulated host controller with simulated
+// time, and measures how many frames it processes and how long a gamepad
+// waits until its new input reaches the guest. Nothing here sleeps, so runs
+// are deterministic for a given seed.
+//
+// Like on the Xbox, the HCD keeps an IN TD queued on the interrupt ED of the
+// gamepad, which sits in every 4th slot of the interrupt table (bInterval 4).
+// The gamepad NAKs it until the input polling thread publishes new input
+// (every XPAD_POLL_INTERVAL_MS or a little later, with idle and busy
+// stretches). The end-of-frame timer ticks about every ms, a little late at
+// times like a sleep based timer is. A retired TD makes the HCD acknowledge
+// the done queue interrupt, which writes a register and so schedules a frame.
+//
+// Modes :
+//   wake   : the gamepad schedules a frame when its input changes (XidGamepad)
+//   poll   : it doesn't, an idle controller finds the input on its next poll
+//   always : every frame is processed, like before the idle frames were skipped
+//
+// Usage : cxbxr-usbbench [seconds] [seed] [-wake | -poll | -always]
+//         cxbxr-usbbench -test
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <vector>
+
+#include "devices/usb/OHCIFrameSchedule.h"
+#include "common/input/XpadSnapshot.h"
+
+#define FRAME_NS 1000000LL
+// Same as the bInterval of the gamepad's interrupt endpoint, and the slot of the interrupt table it starts at
+#define XID_INTERVAL 4
+#define XID_SLOT 1
+// The end-of-frame timer is up to this late
+#define TIMER_JITTER_NS 600000LL
+// Interrupt EDs the HCD links in every slot besides the gamepad's (the hub and the other ports)
+#define OTHER_EDS 3
+#define TEST_SECONDS 20
+#define TEST_SEED 1
+// A woken controller reports within the endpoint interval, plus the frame it was woken in and a late tick
+#define TEST_MAX_LATENCY_NS ((XID_INTERVAL + 1) * FRAME_NS + TIMER_JITTER_NS)
+
+enum class BenchMode { Wake, Poll, Always };
+
+struct BenchResult {
+	std::vector<int64_t> latencyNs; // From the first unreported input change until its report
+	unsigned changes;               // Input changes published by the polling thread
+	unsigned reports;               // IN TDs retired with a report
+	unsigned naks;                  // IN TDs NAKed
+	unsigned ticks;                 // End-of-frame timer ticks
+	unsigned batches;               // Ticks which processed frames (and took the frame lock)
+	uint64_t edVisits;              // Interrupt EDs walked
+	unsigned unreported;            // Changes still waiting for a report at the end
+	double cpuMs;                   // Host CPU time spent in the worker model
+};
+
+// Stands in for the HCCA and the interrupt EDs in guest memory, so that processing a frame costs what reading them does
+struct BenchMemory {
+	uint32_t Hcca[64];
+	uint32_t Eds[32][(OTHER_EDS + 1) * 4];
+};
+
+static uint32_t WalkEds(const BenchMemory &Memory, int Slot)
+{
+	uint32_t Sum = 0;
+	for (int i = 0; i < (OTHER_EDS + 1) * 4; i++) {
+		Sum += Memory.Eds[Slot][i];
+	}
+	return Sum;
+}
+
+static BenchResult RunBench(unsigned Seconds, unsigned Seed, BenchMode Mode)
+{
+	BenchResult result = {};
+	std::mt19937 Rng(Seed);
+	OHCIFrameSchedule Schedule;
+	BenchMemory Memory;
+	for (int i = 0; i < 64; i++) {
+		Memory.Hcca[i] = Rng();
+	}
+	for (int i = 0; i < 32; i++) {
+		for (int j = 0; j < (OTHER_EDS + 1) * 4; j++) {
+			Memory.Eds[i][j] = Rng();
+		}
+	}
+
+	const int64_t EndNs = Seconds * 1000000000LL;
+	// No new input in the last 100 ms, so that every change can be reported
+	const int64_t LastInputNs = EndNs - 100 * FRAME_NS;
+
+	uint32_t PacketNumber = 0;       // Of the last input published by the polling thread
+	uint32_t ReportedPacket = 0;     // Of the last input reported to the guest
+	int64_t FirstUnreportedNs = -1;  // When the oldest input not reported yet was published
+	bool bAckPending = false;        // The HCD acknowledges the done queue interrupt on the next tick
+	uint16_t FmNumber = 0;
+	uint32_t Checksum = 0;
+
+	// The input polling thread, alternating between idle stretches and stretches where the input keeps changing
+	int64_t PollNs = XPAD_POLL_INTERVAL_MS * FRAME_NS / 2;
+	int64_t StretchEndNs = 0;
+	bool bActive = false;
+
+	std::clock_t CpuStart = std::clock();
+	for (int64_t TickNs = FRAME_NS; TickNs < EndNs; TickNs += FRAME_NS + (int64_t)(Rng() % TIMER_JITTER_NS)) {
+		// Publish the input of every poll before this tick
+		for (; PollNs < TickNs; PollNs += XPAD_POLL_INTERVAL_MS * FRAME_NS + (int64_t)(Rng() % TIMER_JITTER_NS)) {
+			if (PollNs >= StretchEndNs) {
+				bActive = !bActive;
+				StretchEndNs = PollNs + (int64_t)(bActive ? 20 + Rng() % 200 : 50 + Rng() % 500) * FRAME_NS;
+			}
+			if (bActive && PollNs < LastInputNs && Rng() % 10 < 7) {
+				PacketNumber++;
+				result.changes++;
+				if (FirstUnreportedNs < 0) {
+					FirstUnreportedNs = PollNs;
+				}
+				if (Mode == BenchMode::Wake) {
+					// XidGamepad::UsbXid_InputChanged
+					Schedule.Schedule();
+				}
+			}
+		}
+
+		// The end-of-frame timer
+		result.ticks++;
+		if (bAckPending || Mode == BenchMode::Always) {
+			Schedule.Schedule();
+			bAckPending = false;
+		}
+		bool bScheduled = false;
+		uint64_t Frames = Schedule.Begin(TickNs / FRAME_NS, &bScheduled);
+		if (Frames == 0) {
+			continue;
+		}
+
+		// Same as OHCI_FrameBoundaryWorker : read the HCCA, then service the interrupt slots of every frame since the
+		// last processed one
+		result.batches++;
+		bool bRetired = false;
+		for (int i = 0; i < 64; i++) {
+			Checksum += Memory.Hcca[i];
+		}
+		for (uint64_t i = Frames - std::min<uint64_t>(Frames, 32); i < Frames; i++) {
+			int Slot = (FmNumber + i) & 0x1F;
+			Checksum += WalkEds(Memory, Slot);
+			result.edVisits += OTHER_EDS;
+			if (Slot % XID_INTERVAL != XID_SLOT) {
+				continue;
+			}
+
+			// Same as UsbXid_HandleData : report the input only when it changed since the last report
+			result.edVisits++;
+			if (PacketNumber != ReportedPacket) {
+				ReportedPacket = PacketNumber;
+				result.reports++;
+				// The frame this slot belongs to ends at the tick which processes it
+				result.latencyNs.push_back(TickNs - FirstUnreportedNs);
+				FirstUnreportedNs = -1;
+				bRetired = true;
+				bAckPending = true;
+			} else {
+				result.naks++;
+			}
+		}
+		FmNumber = (FmNumber + Frames) & 0xFFFF;
+		Schedule.End(Frames, bScheduled || bRetired);
+	}
+	result.cpuMs = (std::clock() - CpuStart) * 1000.0 / CLOCKS_PER_SEC;
+	result.unreported = (PacketNumber != ReportedPacket) ? 1 : 0;
+	if (Checksum == 0x12345678) {
+		// Keeps the memory reads from being optimized out
+		printf(" ");
+	}
+
+	return result;
+}
+
+static double Percentile_MS(std::vector<int64_t> Values, double p)
+{
+	if (Values.empty()) {
+		return 0.0;
+	}
+	size_t i = std::min(Values.size() - 1, (size_t)(p * Values.size()));
+	std::nth_element(Values.begin(), Values.begin() + i, Values.end());
+	return Values[i] / 1e6;
+}
+
+static const char *ModeName(BenchMode Mode)
+{
+	return Mode == BenchMode::Wake ? "wake" : Mode == BenchMode::Poll ? "poll" : "always";
+}
+
+static void PrintResult(BenchMode Mode, const BenchResult &result)
+{
+	printf("%-6s : %6u of %6u ticks processed, %8llu EDs walked, %7.2f ms cpu | %5u changes, %5u reports, %6u naks\n",
+		ModeName(Mode), result.batches, result.ticks, (unsigned long long)result.edVisits, result.cpuMs,
+		result.changes, result.reports, result.naks);
+	printf("%-6s   input to report ms p50 %5.2f, p99 %5.2f, max %5.2f\n", "",
+		Percentile_MS(result.latencyNs, 0.5), Percentile_MS(result.latencyNs, 0.99), Percentile_MS(result.latencyNs, 1.0));
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 2 && strcmp(argv[1], "-test") == 0) {
+		unsigned failures = 0;
+		BenchResult wake = RunBench(TEST_SECONDS, TEST_SEED, BenchMode::Wake);
+		BenchResult always = RunBench(TEST_SECONDS, TEST_SEED, BenchMode::Always);
+		PrintResult(BenchMode::Wake, wake);
+		PrintResult(BenchMode::Always, always);
+		if (wake.reports == 0 || wake.unreported != 0) {
+			printf("FAIL : %u reports, the last input was%s reported\n", wake.reports, wake.unreported ? " not" : "");
+			failures++;
+		}
+		int64_t MaxLatencyNs = *std::max_element(wake.latencyNs.begin(), wake.latencyNs.end());
+		if (MaxLatencyNs > TEST_MAX_LATENCY_NS) {
+			printf("FAIL : an input change took %.2f ms to be reported, more than %.2f ms\n",
+				MaxLatencyNs / 1e6, TEST_MAX_LATENCY_NS / 1e6);
+			failures++;
+		}
+		if (wake.batches * 2 > always.batches) {
+			printf("FAIL : %u ticks processed frames, not much less than the %u of always processing them\n",
+				wake.batches, always.batches);
+			failures++;
+		}
+		printf("%u failure(s)\n", failures);
+		return failures ? 1 : 0;
+	}
+
+	unsigned Seconds = TEST_SECONDS;
+	unsigned Seed = TEST_SEED;
+	std::vector<BenchMode> Modes;
+	std::vector<const char *> args;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-wake") == 0) {
+			Modes.push_back(BenchMode::Wake);
+		} else if (strcmp(argv[i], "-poll") == 0) {
+			Modes.push_back(BenchMode::Poll);
+		} else if (strcmp(argv[i], "-always") == 0) {
+			Modes.push_back(BenchMode::Always);
+		} else if (argv[i][0] >= '0' && argv[i][0] <= '9') {
+			args.push_back(argv[i]);
+		} else {
+			printf("Usage : cxbxr-usbbench [seconds] [seed] [-wake | -poll | -always]\n");
+			printf("        cxbxr-usbbench -test\n");
+			return 1;
+		}
+	}
+	if (args.size() > 0) {
+		Seconds = strtoul(args[0], nullptr, 0);
+	}
+	if (args.size() > 1) {
+		Seed = strtoul(args[1], nullptr, 0);
+	}
+	if (Modes.empty()) {
+		Modes = { BenchMode::Wake, BenchMode::Poll, BenchMode::Always };
+	}
+
+	printf("%u simulated seconds, seed %u\n", Seconds, Seed);
+	for (BenchMode Mode : Modes) {
+		PrintResult(Mode, RunBench(Seconds, Seed, Mode));
+	}
+
+	return 0;
+}
@@ -0,0 +1,538 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of Cxbx-Reloaded.
+// *
+// *  Cxbx-Reloaded is free software; you can redistribute it
+// *  and/or modify it under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+// Checks and times the compiled vertex stream conversion, which patches Xbox
+// vertex elements into the host declaration types, against the per-vertex
+// conversion it replaced in CxbxVertexBufferConverter::ConvertStream.
+//
+// The test converts every single vertex element type, runs of every value of
+// the normalized shorts, packed normals and packed bytes, and random streams
+// of up to X_VSH_MAX_ATTRIBUTES elements (skips included) with padded Xbox
+// strides, under each combination of the SHORT2N, SHORT4N and UBYTE4N host
+// caps. Element sizes are chosen the way VshConvertToken_STREAMDATA_REG does.
+// Both conversions write into buffers filled with the same guard bytes, which
+// must come out identical, so host bytes the old conversion left alone must
+// be left alone too.
+//
+// The benchmark reports the vertices converted per second by both, for a few
+// typical declarations.
+//
+// Usage : cxbxr-vertexbench [vertices] [seconds]
+//         cxbxr-vertexbench -test
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "core/hle/D3D8/XbVertexStreamConversion.h"
+
+// Same as in XbD3D8Types.h
+#define X_VSH_MAX_ATTRIBUTES 16
+// Host bytes after the converted vertices, which neither conversion may touch
+#define TEST_GUARD_BYTES 64
+#define TEST_GUARD_VALUE 0xCD
+#define TEST_RANDOM_STREAMS 2000
+
+static unsigned g_Failures = 0;
+
+static const unsigned AllTypes[] = {
+	xbox::X_D3DVSDT_FLOAT1, xbox::X_D3DVSDT_FLOAT2, xbox::X_D3DVSDT_FLOAT3, xbox::X_D3DVSDT_FLOAT4,
+	xbox::X_D3DVSDT_D3DCOLOR, xbox::X_D3DVSDT_SHORT2, xbox::X_D3DVSDT_SHORT4,
+	xbox::X_D3DVSDT_NORMSHORT1, xbox::X_D3DVSDT_NORMSHORT2, xbox::X_D3DVSDT_NORMSHORT3, xbox::X_D3DVSDT_NORMSHORT4,
+	xbox::X_D3DVSDT_NORMPACKED3, xbox::X_D3DVSDT_SHORT1, xbox::X_D3DVSDT_SHORT3,
+	xbox::X_D3DVSDT_PBYTE1, xbox::X_D3DVSDT_PBYTE2, xbox::X_D3DVSDT_PBYTE3, xbox::X_D3DVSDT_PBYTE4,
+	xbox::X_D3DVSDT_FLOAT2H, xbox::X_D3DVSDT_NONE,
+};
+
+static const char *TypeName(unsigned XboxType)
+{
+	switch (XboxType) {
+	case xbox::X_D3DVSDT_FLOAT1: return "FLOAT1";
+	case xbox::X_D3DVSDT_FLOAT2: return "FLOAT2";
+	case xbox::X_D3DVSDT_FLOAT3: return "FLOAT3";
+	case xbox::X_D3DVSDT_FLOAT4: return "FLOAT4";
+	case xbox::X_D3DVSDT_D3DCOLOR: return "D3DCOLOR";
+	case xbox::X_D3DVSDT_SHORT2: return "SHORT2";
+	case xbox::X_D3DVSDT_SHORT4: return "SHORT4";
+	case xbox::X_D3DVSDT_NORMSHORT1: return "NORMSHORT1";
+	case xbox::X_D3DVSDT_NORMSHORT2: return "NORMSHORT2";
+	case xbox::X_D3DVSDT_NORMSHORT3: return "NORMSHORT3";
+	case xbox::X_D3DVSDT_NORMSHORT4: return "NORMSHORT4";
+	case xbox::X_D3DVSDT_NORMPACKED3: return "NORMPACKED3";
+	case xbox::X_D3DVSDT_SHORT1: return "SHORT1";
+	case xbox::X_D3DVSDT_SHORT3: return "SHORT3";
+	case xbox::X_D3DVSDT_PBYTE1: return "PBYTE1";
+	case xbox::X_D3DVSDT_PBYTE2: return "PBYTE2";
+	case xbox::X_D3DVSDT_PBYTE3: return "PBYTE3";
+	case xbox::X_D3DVSDT_PBYTE4: return "PBYTE4";
+	case xbox::X_D3DVSDT_FLOAT2H: return "FLOAT2H";
+	case xbox::X_D3DVSDT_NONE: return "NONE";
+	}
+	return "?";
+}
+
+// The element sizes VshConvertToken_STREAMDATA_REG registers for a type (a skip for X_D3DVSDT_NONE),
+// returns whether the element needs patching
+static bool MakeElement(unsigned XboxType, const CxbxVertexStreamConversionCaps &Caps, unsigned SkipBytes, CxbxVertexShaderStreamElement &Element)
+{
+	unsigned XboxSize = 0;
+	unsigned HostSize = 0;
+	bool NeedPatching = false;
+
+	switch (XboxType) {
+	case xbox::X_D3DVSDT_FLOAT1: HostSize = 4; break;
+	case xbox::X_D3DVSDT_FLOAT2: HostSize = 8; break;
+	case xbox::X_D3DVSDT_FLOAT3: HostSize = 12; break;
+	case xbox::X_D3DVSDT_FLOAT4: HostSize = 16; break;
+	case xbox::X_D3DVSDT_D3DCOLOR: HostSize = 4; break;
+	case xbox::X_D3DVSDT_SHORT2: HostSize = 4; break;
+	case xbox::X_D3DVSDT_SHORT4: HostSize = 8; break;
+	case xbox::X_D3DVSDT_NORMSHORT1: HostSize = 4; XboxSize = 2; NeedPatching = true; break;
+	case xbox::X_D3DVSDT_NORMSHORT2:
+		if (Caps.bShort2N) { HostSize = 4; } else { HostSize = 8; XboxSize = 4; NeedPatching = true; }
+		break;
+	case xbox::X_D3DVSDT_NORMSHORT3: HostSize = Caps.bShort4N ? 8 : 12; XboxSize = 6; NeedPatching = true; break;
+	case xbox::X_D3DVSDT_NORMSHORT4:
+		if (Caps.bShort4N) { HostSize = 8; } else { HostSize = 16; XboxSize = 8; NeedPatching = true; }
+		break;
+	case xbox::X_D3DVSDT_NORMPACKED3: HostSize = 12; XboxSize = 4; NeedPatching = true; break;
+	case xbox::X_D3DVSDT_SHORT1: HostSize = 4; XboxSize = 2; NeedPatching = true; break;
+	case xbox::X_D3DVSDT_SHORT3: HostSize = 8; XboxSize = 6; NeedPatching = true; break;
+	case xbox::X_D3DVSDT_PBYTE1: HostSize = 4; XboxSize = 1; NeedPatching = true; break;
+	case xbox::X_D3DVSDT_PBYTE2: HostSize = Caps.bUByte4N ? 4 : 8; XboxSize = 2; NeedPatching = true; break;
+	case xbox::X_D3DVSDT_PBYTE3: HostSize = Caps.bUByte4N ? 4 : 12; XboxSize = 3; NeedPatching = true; break;
+	case xbox::X_D3DVSDT_PBYTE4:
+		if (Caps.bUByte4N) { HostSize = 4; } else { HostSize = 16; XboxSize = 4; NeedPatching = true; }
+		break;
+	case xbox::X_D3DVSDT_FLOAT2H: HostSize = 16; XboxSize = 12; NeedPatching = true; break;
+	case xbox::X_D3DVSDT_NONE: XboxSize = SkipBytes; NeedPatching = true; break; // See VshConvert_SkipBytes
+	}
+
+	Element.XboxType = XboxType;
+	Element.XboxByteSize = NeedPatching ? XboxSize : HostSize;
+	Element.HostByteSize = HostSize;
+	return NeedPatching;
+}
+
+// The per-vertex conversion from CxbxVertexBufferConverter::ConvertStream, with the caps passed in
+
+static inline float RefPackedIntToFloat(const int value, const float PosFactor, const float NegFactor)
+{
+	if (value >= 0) {
+		return ((float)value) / PosFactor;
+	}
+	else {
+		return ((float)value) / NegFactor;
+	}
+}
+
+static inline float RefNormShortToFloat(const int16_t value)
+{
+	return RefPackedIntToFloat((int)value, 32767.0f, 32768.0f);
+}
+
+static inline float RefByteToFloat(const uint8_t value)
+{
+	return ((float)value) / 255.0f;
+}
+
+static void RefConvertStream
+(
+	const CxbxVertexShaderStreamElement  *pElements,
+	unsigned                              uiElementCount,
+	const CxbxVertexStreamConversionCaps &Caps,
+	const uint8_t                        *pXboxVertexData,
+	uint8_t                              *pHostVertexData,
+	unsigned                              uiVertexCount,
+	unsigned                              uiXboxVertexStride,
+	unsigned                              uiHostVertexStride
+)
+{
+	for (unsigned uiVertex = 0; uiVertex < uiVertexCount; uiVertex++) {
+		const uint8_t *pXboxVertexAsByte = &pXboxVertexData[uiVertex * uiXboxVertexStride];
+		uint8_t *pHostVertexAsByte = &pHostVertexData[uiVertex * uiHostVertexStride];
+		for (unsigned uiElement = 0; uiElement < uiElementCount; uiElement++) {
+			const float *pXboxVertexAsFloat = (const float*)pXboxVertexAsByte;
+			const int16_t *pXboxVertexAsShort = (const int16_t*)pXboxVertexAsByte;
+			const unsigned XboxElementByteSize = pElements[uiElement].XboxByteSize;
+			float *pHostVertexAsFloat = (float*)pHostVertexAsByte;
+			int16_t *pHostVertexAsShort = (int16_t*)pHostVertexAsByte;
+			switch (pElements[uiElement].XboxType) {
+			case xbox::X_D3DVSDT_NORMSHORT1:
+				if (Caps.bShort2N) {
+					pHostVertexAsShort[0] = pXboxVertexAsShort[0];
+					pHostVertexAsShort[1] = 0;
+				}
+				else {
+					pHostVertexAsFloat[0] = RefNormShortToFloat(pXboxVertexAsShort[0]);
+				}
+				break;
+			case xbox::X_D3DVSDT_NORMSHORT2:
+				if (Caps.bShort2N) {
+					pHostVertexAsShort[0] = pXboxVertexAsShort[0];
+					pHostVertexAsShort[1] = pXboxVertexAsShort[1];
+				}
+				else {
+					pHostVertexAsFloat[0] = RefNormShortToFloat(pXboxVertexAsShort[0]);
+					pHostVertexAsFloat[1] = RefNormShortToFloat(pXboxVertexAsShort[1]);
+				}
+				break;
+			case xbox::X_D3DVSDT_NORMSHORT3:
+				if (Caps.bShort4N) {
+					pHostVertexAsShort[0] = pXboxVertexAsShort[0];
+					pHostVertexAsShort[1] = pXboxVertexAsShort[1];
+					pHostVertexAsShort[2] = pXboxVertexAsShort[2];
+					pHostVertexAsShort[3] = 32767;
+				}
+				else {
+					pHostVertexAsFloat[0] = RefNormShortToFloat(pXboxVertexAsShort[0]);
+					pHostVertexAsFloat[1] = RefNormShortToFloat(pXboxVertexAsShort[1]);
+					pHostVertexAsFloat[2] = RefNormShortToFloat(pXboxVertexAsShort[2]);
+				}
+				break;
+			case xbox::X_D3DVSDT_NORMSHORT4:
+				if (Caps.bShort4N) {
+					pHostVertexAsShort[0] = pXboxVertexAsShort[0];
+					pHostVertexAsShort[1] = pXboxVertexAsShort[1];
+					pHostVertexAsShort[2] = pXboxVertexAsShort[2];
+					pHostVertexAsShort[3] = pXboxVertexAsShort[3];
+				}
+				else {
+					pHostVertexAsFloat[0] = RefNormShortToFloat(pXboxVertexAsShort[0]);
+					pHostVertexAsFloat[1] = RefNormShortToFloat(pXboxVertexAsShort[1]);
+					pHostVertexAsFloat[2] = RefNormShortToFloat(pXboxVertexAsShort[2]);
+					pHostVertexAsFloat[3] = RefNormShortToFloat(pXboxVertexAsShort[3]);
+				}
+				break;
+			case xbox::X_D3DVSDT_NORMPACKED3: {
+				union {
+					int32_t value;
+					struct {
+						int x : 11;
+						int y : 11;
+						int z : 10;
+					};
+				} NormPacked3;
+
+				NormPacked3.value = ((const int32_t*)pXboxVertexAsByte)[0];
+
+				pHostVertexAsFloat[0] = RefPackedIntToFloat(NormPacked3.x, 1023.0f, 1024.f);
+				pHostVertexAsFloat[1] = RefPackedIntToFloat(NormPacked3.y, 1023.0f, 1024.f);
+				pHostVertexAsFloat[2] = RefPackedIntToFloat(NormPacked3.z, 511.0f, 512.f);
+				break;
+			}
+			case xbox::X_D3DVSDT_SHORT1:
+				pHostVertexAsShort[0] = pXboxVertexAsShort[0];
+				pHostVertexAsShort[1] = 0;
+				break;
+			case xbox::X_D3DVSDT_SHORT3:
+				pHostVertexAsShort[0] = pXboxVertexAsShort[0];
+				pHostVertexAsShort[1] = pXboxVertexAsShort[1];
+				pHostVertexAsShort[2] = pXboxVertexAsShort[2];
+				pHostVertexAsShort[3] = 1;
+				break;
+			case xbox::X_D3DVSDT_PBYTE1:
+				if (Caps.bUByte4N) {
+					pHostVertexAsByte[0] = pXboxVertexAsByte[0];
+					pHostVertexAsByte[1] = 0;
+					pHostVertexAsByte[2] = 0;
+					pHostVertexAsByte[3] = 255;
+				}
+				else {
+					pHostVertexAsFloat[0] = RefByteToFloat(pXboxVertexAsByte[0]);
+				}
+				break;
+			case xbox::X_D3DVSDT_PBYTE2:
+				if (Caps.bUByte4N) {
+					pHostVertexAsByte[0] = pXboxVertexAsByte[0];
+					pHostVertexAsByte[1] = pXboxVertexAsByte[1];
+					pHostVertexAsByte[2] = 0;
+					pHostVertexAsByte[3] = 255;
+				}
+				else {
+					pHostVertexAsFloat[0] = RefByteToFloat(pXboxVertexAsByte[0]);
+					pHostVertexAsFloat[1] = RefByteToFloat(pXboxVertexAsByte[1]);
+				}
+				break;
+			case xbox::X_D3DVSDT_PBYTE3:
+				if (Caps.bUByte4N) {
+					pHostVertexAsByte[0] = pXboxVertexAsByte[0];
+					pHostVertexAsByte[1] = pXboxVertexAsByte[1];
+					pHostVertexAsByte[2] = pXboxVertexAsByte[2];
+					pHostVertexAsByte[3] = 255;
+				}
+				else {
+					pHostVertexAsFloat[0] = RefByteToFloat(pXboxVertexAsByte[0]);
+					pHostVertexAsFloat[1] = RefByteToFloat(pXboxVertexAsByte[1]);
+					pHostVertexAsFloat[2] = RefByteToFloat(pXboxVertexAsByte[2]);
+				}
+				break;
+			case xbox::X_D3DVSDT_PBYTE4:
+				if (Caps.bUByte4N) {
+					pHostVertexAsByte[0] = pXboxVertexAsByte[0];
+					pHostVertexAsByte[1] = pXboxVertexAsByte[1];
+					pHostVertexAsByte[2] = pXboxVertexAsByte[2];
+					pHostVertexAsByte[3] = pXboxVertexAsByte[3];
+				}
+				else {
+					pHostVertexAsFloat[0] = RefByteToFloat(pXboxVertexAsByte[0]);
+					pHostVertexAsFloat[1] = RefByteToFloat(pXboxVertexAsByte[1]);
+					pHostVertexAsFloat[2] = RefByteToFloat(pXboxVertexAsByte[2]);
+					pHostVertexAsFloat[3] = RefByteToFloat(pXboxVertexAsByte[3]);
+				}
+				break;
+			case xbox::X_D3DVSDT_FLOAT2H:
+				pHostVertexAsFloat[0] = pXboxVertexAsFloat[0];
+				pHostVertexAsFloat[1] = pXboxVertexAsFloat[1];
+				pHostVertexAsFloat[2] = 0.0f;
+				pHostVertexAsFloat[3] = pXboxVertexAsFloat[2];
+				break;
+			case xbox::X_D3DVSDT_NONE:
+				// No host element data (but Xbox size can be above zero, when used for X_D3DVSD_MASK_SKIP*
+				break;
+			default:
+				memcpy(pHostVertexAsByte, pXboxVertexAsByte, XboxElementByteSize);
+				break;
+			}
+
+			pXboxVertexAsByte += XboxElementByteSize;
+			pHostVertexAsByte += pElements[uiElement].HostByteSize;
+		}
+	}
+}
+
+// A stream of vertex data, described the way the declaration converter describes it
+struct TestStream
+{
+	std::vector<CxbxVertexShaderStreamElement> Elements;
+	unsigned XboxStride = 0;
+	unsigned HostStride = 0;
+	std::vector<uint8_t> XboxData;
+
+	void Add(unsigned XboxType, const CxbxVertexStreamConversionCaps &Caps, unsigned SkipBytes = 4)
+	{
+		CxbxVertexShaderStreamElement Element;
+		MakeElement(XboxType, Caps, SkipBytes, Element);
+		Elements.push_back(Element);
+		XboxStride += Element.XboxByteSize;
+		HostStride += Element.HostByteSize;
+	}
+};
+
+static void RandomData(std::mt19937 &rng, TestStream &Stream, unsigned uiVertexCount)
+{
+	Stream.XboxData.resize(Stream.XboxStride * uiVertexCount);
+	for (auto &Byte : Stream.XboxData) {
+		Byte = (uint8_t)rng();
+	}
+}
+
+static void CapsName(const CxbxVertexStreamConversionCaps &Caps, char *szName, size_t Size)
+{
+	snprintf(szName, Size, "%s%s%s", Caps.bShort2N ? " SHORT2N" : "", Caps.bShort4N ? " SHORT4N" : "", Caps.bUByte4N ? " UBYTE4N" : "");
+}
+
+static void TestStreamConversion(const TestStream &Stream, const CxbxVertexStreamConversionCaps &Caps, unsigned uiVertexCount, const char *szCase)
+{
+	std::vector<uint8_t> Expected(Stream.HostStride * uiVertexCount + TEST_GUARD_BYTES, TEST_GUARD_VALUE);
+	std::vector<uint8_t> Output(Expected.size(), TEST_GUARD_VALUE);
+
+	RefConvertStream(Stream.Elements.data(), (unsigned)Stream.Elements.size(), Caps, Stream.XboxData.data(), Expected.data(), uiVertexCount, Stream.XboxStride, Stream.HostStride);
+
+	CxbxVertexStreamConversionOp Ops[X_VSH_MAX_ATTRIBUTES + 16];
+	unsigned uiOpCount = CxbxCompileVertexElementConversions(Stream.Elements.data(), (unsigned)Stream.Elements.size(), Caps, Ops);
+	CxbxExecuteVertexElementConversions(Ops, uiOpCount, Stream.XboxData.data(), Output.data(), uiVertexCount, Stream.XboxStride, Stream.HostStride);
+
+	if (uiOpCount > Stream.Elements.size() || Output != Expected) {
+		char szCaps[32];
+		CapsName(Caps, szCaps, sizeof(szCaps));
+		printf("FAIL : %s, %u vertices, caps%s :", szCase, uiVertexCount, szCaps);
+		for (auto &Element : Stream.Elements) {
+			printf(" %s(%u>%u)", TypeName(Element.XboxType), Element.XboxByteSize, Element.HostByteSize);
+		}
+		printf("\n");
+		g_Failures++;
+	}
+}
+
+static void TestSingleElements(std::mt19937 &rng, const CxbxVertexStreamConversionCaps &Caps)
+{
+	for (unsigned XboxType : AllTypes) {
+		// Alone, then between elements that only get copied (which the converter merges into one copy)
+		TestStream Alone;
+		Alone.Add(XboxType, Caps);
+		RandomData(rng, Alone, 37);
+		TestStreamConversion(Alone, Caps, 37, TypeName(XboxType));
+
+		TestStream Between;
+		Between.Add(xbox::X_D3DVSDT_FLOAT3, Caps);
+		Between.Add(XboxType, Caps);
+		Between.Add(xbox::X_D3DVSDT_D3DCOLOR, Caps);
+		Between.Add(xbox::X_D3DVSDT_FLOAT2, Caps);
+		RandomData(rng, Between, 37);
+		TestStreamConversion(Between, Caps, 37, TypeName(XboxType));
+	}
+}
+
+// Every value of the converted components, so the float conversions are checked for all inputs
+static void TestAllValues(const CxbxVertexStreamConversionCaps &Caps)
+{
+	TestStream NormShort;
+	NormShort.Add(xbox::X_D3DVSDT_NORMSHORT1, Caps);
+	NormShort.XboxData.resize(65536 * 2);
+	for (unsigned i = 0; i < 65536; i++) {
+		memcpy(&NormShort.XboxData[i * 2], &i, 2);
+	}
+	TestStreamConversion(NormShort, Caps, 65536, "every NORMSHORT1 value");
+
+	// x and y go through all 11 bit values (in opposite directions), z through all 10 bit values
+	TestStream NormPacked;
+	NormPacked.Add(xbox::X_D3DVSDT_NORMPACKED3, Caps);
+	NormPacked.XboxData.resize(2048 * 4);
+	for (uint32_t i = 0; i < 2048; i++) {
+		uint32_t Packed = (i & 0x7FF) | ((~i & 0x7FF) << 11) | ((i & 0x3FF) << 22);
+		memcpy(&NormPacked.XboxData[i * 4], &Packed, 4);
+	}
+	TestStreamConversion(NormPacked, Caps, 2048, "every NORMPACKED3 component value");
+
+	TestStream PByte;
+	PByte.Add(xbox::X_D3DVSDT_PBYTE1, Caps);
+	PByte.XboxData.resize(256);
+	for (unsigned i = 0; i < 256; i++) {
+		PByte.XboxData[i] = (uint8_t)i;
+	}
+	TestStreamConversion(PByte, Caps, 256, "every PBYTE1 value");
+}
+
+static void TestRandomStreams(std::mt19937 &rng, const CxbxVertexStreamConversionCaps &Caps)
+{
+	const unsigned TypeCount = sizeof(AllTypes) / sizeof(AllTypes[0]);
+	for (unsigned i = 0; i < TEST_RANDOM_STREAMS; i++) {
+		TestStream Stream;
+		unsigned uiElementCount = 1 + rng() % X_VSH_MAX_ATTRIBUTES;
+		for (unsigned e = 0; e < uiElementCount; e++) {
+			// Skips are either whole DWORDs (D3DVSD_SKIP) or any byte count (D3DVSD_SKIPBYTES)
+			unsigned SkipBytes = (rng() % 2) ? 4 * (1 + rng() % 4) : 1 + rng() % 7;
+			Stream.Add(AllTypes[rng() % TypeCount], Caps, SkipBytes);
+		}
+		// Xbox vertices can have trailing bytes no element covers
+		Stream.XboxStride += rng() % 9;
+		unsigned uiVertexCount = rng() % 64;
+		RandomData(rng, Stream, uiVertexCount);
+		TestStreamConversion(Stream, Caps, uiVertexCount, "random stream");
+	}
+}
+
+typedef std::chrono::steady_clock BenchClock;
+
+// Runs Convert over and over for the given time, and returns the vertices it converted per second
+template<typename Converter>
+static double Measure(double Seconds, unsigned uiVertexCount, Converter Convert)
+{
+	uint64_t Vertices = 0;
+	auto Start = BenchClock::now();
+	double Elapsed;
+	do {
+		for (unsigned i = 0; i < 16; i++) {
+			Convert();
+			Vertices += uiVertexCount;
+		}
+		Elapsed = std::chrono::duration<double>(BenchClock::now() - Start).count();
+	} while (Elapsed < Seconds);
+	return (double)Vertices / Elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 2 && strcmp(argv[1], "-test") == 0) {
+		std::mt19937 rng(0x7E47E);
+		for (unsigned CapBits = 0; CapBits < 8; CapBits++) {
+			CxbxVertexStreamConversionCaps Caps;
+			Caps.bShort2N = (CapBits & 1) != 0;
+			Caps.bShort4N = (CapBits & 2) != 0;
+			Caps.bUByte4N = (CapBits & 4) != 0;
+			TestSingleElements(rng, Caps);
+			TestAllValues(Caps);
+			TestRandomStreams(rng, Caps);
+		}
+		printf("%u failure(s)\n", g_Failures);
+		return g_Failures ? 1 : 0;
+	}
+
+	if (argc > 1 && (argv[1][0] < '0' || argv[1][0] > '9')) {
+		printf("Usage : cxbxr-vertexbench [vertices] [seconds]\n");
+		printf("        cxbxr-vertexbench -test\n");
+		return 1;
+	}
+
+	unsigned uiVertexCount = (argc > 1) ? (unsigned)atoi(argv[1]) : 10000;
+	double Seconds = (argc > 2) ? atof(argv[2]) : 1.0;
+	if (uiVertexCount == 0) {
+		uiVertexCount = 1;
+	}
+
+	// The caps of current host GPUs
+	CxbxVertexStreamConversionCaps Caps = { true, true, true };
+
+	struct {
+		const char *szName;
+		std::vector<unsigned> Types;
+	} Declarations[] = {
+		{ "pos, packed normal, uv", { xbox::X_D3DVSDT_FLOAT3, xbox::X_D3DVSDT_NORMPACKED3, xbox::X_D3DVSDT_FLOAT2 } },
+		{ "pos, normshorts, color", { xbox::X_D3DVSDT_FLOAT3, xbox::X_D3DVSDT_NORMSHORT3, xbox::X_D3DVSDT_D3DCOLOR, xbox::X_D3DVSDT_NORMSHORT2 } },
+		{ "pos, normal, float2h", { xbox::X_D3DVSDT_FLOAT3, xbox::X_D3DVSDT_FLOAT3, xbox::X_D3DVSDT_FLOAT2H } },
+		{ "pos, pbytes, short3", { xbox::X_D3DVSDT_FLOAT3, xbox::X_D3DVSDT_PBYTE3, xbox::X_D3DVSDT_SHORT3, xbox::X_D3DVSDT_FLOAT2 } },
+	};
+
+	std::mt19937 rng(0x7E47E);
+	printf("%u vertices, Mvertices per second\n", uiVertexCount);
+	printf("%-24s %10s %10s\n", "declaration", "per-vertex", "compiled");
+	for (auto &Declaration : Declarations) {
+		TestStream Stream;
+		for (unsigned XboxType : Declaration.Types) {
+			Stream.Add(XboxType, Caps);
+		}
+		RandomData(rng, Stream, uiVertexCount);
+		std::vector<uint8_t> HostData(Stream.HostStride * uiVertexCount);
+
+		double OldRate = Measure(Seconds, uiVertexCount, [&]() {
+			RefConvertStream(Stream.Elements.data(), (unsigned)Stream.Elements.size(), Caps, Stream.XboxData.data(), HostData.data(), uiVertexCount, Stream.XboxStride, Stream.HostStride);
+		});
+
+		// Compiled once, like the declaration converter does
+		CxbxVertexStreamConversionOp Ops[X_VSH_MAX_ATTRIBUTES + 16];
+		unsigned uiOpCount = CxbxCompileVertexElementConversions(Stream.Elements.data(), (unsigned)Stream.Elements.size(), Caps, Ops);
+		double NewRate = Measure(Seconds, uiVertexCount, [&]() {
+			CxbxExecuteVertexElementConversions(Ops, uiOpCount, Stream.XboxData.data(), HostData.data(), uiVertexCount, Stream.XboxStride, Stream.HostStride);
+		});
+
+		printf("%-24s %10.1f %10.1f\n", Declaration.szName, OldRate / 1e6, NewRate / 1e6);
+	}
+
+	return 0;
+}
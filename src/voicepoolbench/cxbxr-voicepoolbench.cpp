@@ -0,0 +1,429 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of Cxbx-Reloaded.
+// *
+// *  Cxbx-Reloaded is free software; you can redistribute it
+// *  and/or modify it under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+// Checks and times DSVoice_BufferPool, which holds the xbox buffer cache of
+// DirectSoundBuffers and the packet data of DirectSoundStreams, under the
+// create/resize/release churn of titles that resize their buffers or submit
+// packets of other sizes every frame.
+//
+// The test requires blocks to hold their whole size class (run it under a
+// memory checker to catch the ones that don't), blocks released in a class
+// to come back for the next request in that class, resizes within a class
+// to keep their block, and the pool to give back blocks past what it keeps
+// per class. It then runs random churn over voices through the same steps
+// as GenerateXboxBufferCache, requires every voice to keep its contents and
+// its own block, and the pool's counters to match a model of its free lists.
+//
+// The benchmark times the same churn through the pool, and through malloc
+// and free like before the pool, and prints the allocations it avoided.
+//
+// Usage : cxbxr-voicepoolbench [voices] [seconds]
+//         cxbxr-voicepoolbench -test
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "core/hle/DSOUND/DirectSound/DSVoice_BufferPool.hpp"
+
+// Same as in DSVoice_BufferPool.cpp
+#define DSVOICE_POOL_CLASS_COUNT 11
+#define DSVOICE_POOL_CLASS_KEEP 0x800000
+
+// Random operations of the test's churn, and how often all voices are checked
+#define TEST_CHURN_STEPS 20000
+#define TEST_CHURN_VOICES 48
+#define TEST_CHECK_INTERVAL 500
+
+static unsigned g_Failures = 0;
+
+struct BenchVoice {
+	void *pBuffer;
+	uint32_t dwSize;
+	uint8_t Fill; // Every byte of the buffer, so that copies and shared blocks show
+};
+
+// The pool's free lists and counters, following the rules in DSVoice_BufferPool.cpp
+struct PoolModel {
+	size_t FreeCount[DSVOICE_POOL_CLASS_COUNT] = {};
+	DSVoicePoolStats Stats = {};
+
+	static int GetClass(uint32_t dwSize)
+	{
+		if (dwSize > DSVOICE_POOL_MAX_SIZE) {
+			return -1;
+		}
+		int sizeClass = 0;
+		while ((uint32_t)(DSVOICE_POOL_MIN_SIZE << sizeClass) < dwSize) {
+			sizeClass++;
+		}
+		return sizeClass;
+	}
+
+	// Returns whether the allocation should reuse a block
+	bool Alloc(uint32_t dwSize)
+	{
+		Stats.Allocs++;
+		int sizeClass = GetClass(dwSize);
+		if (sizeClass < 0) {
+			Stats.Bypassed++;
+			return false;
+		}
+		if (FreeCount[sizeClass] == 0) {
+			return false;
+		}
+		FreeCount[sizeClass]--;
+		Stats.Reused++;
+		return true;
+	}
+
+	void Free(uint32_t dwSize)
+	{
+		int sizeClass = GetClass(dwSize);
+		if (sizeClass < 0) {
+			return;
+		}
+		size_t keepCount = std::max<size_t>(DSVOICE_POOL_CLASS_KEEP / (DSVOICE_POOL_MIN_SIZE << sizeClass), 2);
+		if (FreeCount[sizeClass] < keepCount) {
+			FreeCount[sizeClass]++;
+		} else {
+			Stats.Released++;
+		}
+	}
+
+	bool CanResize(uint32_t dwSizeOld, uint32_t dwSizeNew)
+	{
+		int sizeClass = GetClass(dwSizeOld);
+		if (sizeClass >= 0 && sizeClass == GetClass(dwSizeNew)) {
+			Stats.Kept++;
+			return true;
+		}
+		return false;
+	}
+};
+
+static PoolModel g_Model;
+
+static void CheckStats(const char *szCase)
+{
+	DSVoicePoolStats Stats = DSVoice_Pool_GetStats();
+	const DSVoicePoolStats &Expected = g_Model.Stats;
+	if (Stats.Allocs != Expected.Allocs || Stats.Reused != Expected.Reused || Stats.Bypassed != Expected.Bypassed
+		|| Stats.Kept != Expected.Kept || Stats.Released != Expected.Released) {
+		printf("FAIL : %s : %llu allocs, %llu reused, %llu bypassed, %llu kept, %llu released, expected %llu, %llu, %llu, %llu, %llu\n", szCase,
+			(unsigned long long)Stats.Allocs, (unsigned long long)Stats.Reused, (unsigned long long)Stats.Bypassed,
+			(unsigned long long)Stats.Kept, (unsigned long long)Stats.Released,
+			(unsigned long long)Expected.Allocs, (unsigned long long)Expected.Reused, (unsigned long long)Expected.Bypassed,
+			(unsigned long long)Expected.Kept, (unsigned long long)Expected.Released);
+		g_Failures++;
+		g_Model.Stats = Stats;
+	}
+}
+
+static void *TestAlloc(uint32_t dwSize)
+{
+	g_Model.Alloc(dwSize);
+	return DSVoice_Pool_Alloc(dwSize);
+}
+
+static void TestFree(void *pBuffer, uint32_t dwSize)
+{
+	g_Model.Free(dwSize);
+	DSVoice_Pool_Free(pBuffer, dwSize);
+}
+
+static bool TestCanResize(uint32_t dwSizeOld, uint32_t dwSizeNew)
+{
+	g_Model.CanResize(dwSizeOld, dwSizeNew);
+	return DSVoice_Pool_CanResize(dwSizeOld, dwSizeNew);
+}
+
+// Same steps as GenerateXboxBufferCache; new bytes get the voice's fill, like the title would write them
+template<typename Alloc, typename Free, typename CanResize>
+static void ResizeVoice(BenchVoice &Voice, uint32_t dwSize, Alloc &&PoolAlloc, Free &&PoolFree, CanResize &&PoolCanResize)
+{
+	if (Voice.dwSize == dwSize) {
+		return;
+	}
+
+	if (Voice.pBuffer != nullptr) {
+		if (!PoolCanResize(Voice.dwSize, dwSize)) {
+			void *pOld = Voice.pBuffer;
+			Voice.pBuffer = PoolAlloc(dwSize);
+			memcpy(Voice.pBuffer, pOld, std::min(Voice.dwSize, dwSize));
+			PoolFree(pOld, Voice.dwSize);
+		}
+	} else {
+		Voice.pBuffer = PoolAlloc(dwSize);
+		memset(Voice.pBuffer, 0, dwSize);
+	}
+
+	if (dwSize > Voice.dwSize) {
+		memset((uint8_t *)Voice.pBuffer + Voice.dwSize, Voice.Fill, dwSize - Voice.dwSize);
+	}
+	Voice.dwSize = dwSize;
+}
+
+template<typename Free>
+static void ReleaseVoice(BenchVoice &Voice, Free &&PoolFree)
+{
+	PoolFree(Voice.pBuffer, Voice.dwSize);
+	Voice.pBuffer = nullptr;
+	Voice.dwSize = 0;
+}
+
+// Buffer and packet sizes : mostly up to 64 KiB, some up to 1 MiB, and a few that bypass the pool
+static uint32_t RandomSize(std::mt19937 &rng)
+{
+	switch (rng() % 16) {
+	case 0:
+		return DSVOICE_POOL_MAX_SIZE + 1 + rng() % DSVOICE_POOL_MIN_SIZE;
+	case 1:
+	case 2:
+	case 3:
+		return 1 + rng() % 0x100000;
+	default:
+		return 1 + rng() % 0x10000;
+	}
+}
+
+static void TestClasses()
+{
+	for (int sizeClass = 0; sizeClass < DSVOICE_POOL_CLASS_COUNT; sizeClass++) {
+		uint32_t dwClassSize = DSVOICE_POOL_MIN_SIZE << sizeClass;
+		uint32_t dwSmallest = sizeClass ? dwClassSize / 2 + 1 : 1;
+
+		// The smallest request of the class must get a block for the whole class
+		uint8_t *pBuffer = (uint8_t *)TestAlloc(dwSmallest);
+		memset(pBuffer, 0x5A, dwClassSize);
+		TestFree(pBuffer, dwSmallest);
+
+		// The block comes back for the largest request of the class
+		uint8_t *pReused = (uint8_t *)TestAlloc(dwClassSize);
+		if (pReused != pBuffer) {
+			printf("FAIL : block of %u bytes not reused for %u bytes\n", dwSmallest, dwClassSize);
+			g_Failures++;
+		}
+		memset(pReused, 0xA5, dwClassSize);
+
+		// Resizes keep the block within the class only
+		if (!TestCanResize(dwClassSize, dwSmallest) || TestCanResize(dwClassSize, dwClassSize + 1)
+			|| (sizeClass && TestCanResize(dwSmallest, dwSmallest - 1))) {
+			printf("FAIL : resizes of %u byte blocks\n", dwClassSize);
+			g_Failures++;
+		}
+		TestFree(pReused, dwClassSize);
+	}
+
+	// Requests past DSVOICE_POOL_MAX_SIZE bypass the pool
+	if (TestCanResize(DSVOICE_POOL_MAX_SIZE + 1, DSVOICE_POOL_MAX_SIZE + 1)) {
+		printf("FAIL : blocks larger than DSVOICE_POOL_MAX_SIZE kept on resize\n");
+		g_Failures++;
+	}
+	void *pLarge = TestAlloc(DSVOICE_POOL_MAX_SIZE + 1);
+	memset(pLarge, 0x5A, DSVOICE_POOL_MAX_SIZE + 1);
+	TestFree(pLarge, DSVOICE_POOL_MAX_SIZE + 1);
+
+	CheckStats("size classes");
+}
+
+static void TestKeepLimit()
+{
+	// Enough blocks of the smallest and largest classes to go past what the pool keeps of them
+	for (uint32_t dwSize : { (uint32_t)DSVOICE_POOL_MIN_SIZE, (uint32_t)DSVOICE_POOL_MAX_SIZE }) {
+		size_t count = std::max<size_t>(DSVOICE_POOL_CLASS_KEEP / dwSize, 2) + 3;
+		std::vector<void *> Blocks;
+		for (size_t i = 0; i < count; i++) {
+			Blocks.push_back(TestAlloc(dwSize));
+		}
+		for (void *pBuffer : Blocks) {
+			TestFree(pBuffer, dwSize);
+		}
+		CheckStats(dwSize == DSVOICE_POOL_MIN_SIZE ? "smallest blocks past the keep limit" : "largest blocks past the keep limit");
+	}
+}
+
+static bool VoiceIntact(const BenchVoice &Voice)
+{
+	const uint8_t *pBytes = (const uint8_t *)Voice.pBuffer;
+	for (uint32_t i = 0; i < Voice.dwSize; i++) {
+		if (pBytes[i] != Voice.Fill) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void CheckVoices(const std::vector<BenchVoice> &Voices, int step)
+{
+	std::vector<void *> Blocks;
+	for (const BenchVoice &Voice : Voices) {
+		if (Voice.pBuffer == nullptr) {
+			continue;
+		}
+		if (!VoiceIntact(Voice)) {
+			printf("FAIL : voice of %u bytes changed by step %d\n", Voice.dwSize, step);
+			g_Failures++;
+		}
+		Blocks.push_back(Voice.pBuffer);
+	}
+
+	std::sort(Blocks.begin(), Blocks.end());
+	if (std::adjacent_find(Blocks.begin(), Blocks.end()) != Blocks.end()) {
+		printf("FAIL : voices share a block after step %d\n", step);
+		g_Failures++;
+	}
+}
+
+static void TestChurn()
+{
+	std::mt19937 rng(0xD5B0);
+	std::vector<BenchVoice> Voices(TEST_CHURN_VOICES, BenchVoice{ nullptr, 0, 0 });
+
+	for (int step = 0; step < TEST_CHURN_STEPS; step++) {
+		BenchVoice &Voice = Voices[rng() % Voices.size()];
+		switch (rng() % 8) {
+		case 0:
+			// Released, and created again later on
+			if (Voice.pBuffer != nullptr) {
+				ReleaseVoice(Voice, TestFree);
+			}
+			break;
+		case 1:
+		case 2: {
+			// Small changes, which mostly stay within the class
+			uint32_t dwSize = Voice.dwSize ? Voice.dwSize : RandomSize(rng);
+			dwSize = std::max<uint32_t>(1, dwSize + (int32_t)(rng() % 513) - 256);
+			ResizeVoice(Voice, dwSize, TestAlloc, TestFree, TestCanResize);
+			break;
+		}
+		default:
+			ResizeVoice(Voice, RandomSize(rng), TestAlloc, TestFree, TestCanResize);
+			break;
+		}
+
+		// The title writes something else once in a while
+		if (Voice.pBuffer != nullptr && rng() % 4 == 0) {
+			Voice.Fill = (uint8_t)rng();
+			memset(Voice.pBuffer, Voice.Fill, Voice.dwSize);
+		}
+
+		if (step % TEST_CHECK_INTERVAL == 0) {
+			CheckVoices(Voices, step);
+		}
+	}
+
+	CheckVoices(Voices, TEST_CHURN_STEPS);
+	for (BenchVoice &Voice : Voices) {
+		if (Voice.pBuffer != nullptr) {
+			ReleaseVoice(Voice, TestFree);
+		}
+	}
+	CheckStats("churn");
+
+	DSVoicePoolStats Stats = DSVoice_Pool_GetStats();
+	printf("%llu allocations and %llu resizes kept : %llu blocks reused, %llu released, %llu bypassed\n",
+		(unsigned long long)Stats.Allocs, (unsigned long long)Stats.Kept, (unsigned long long)Stats.Reused,
+		(unsigned long long)Stats.Released, (unsigned long long)Stats.Bypassed);
+}
+
+typedef std::chrono::steady_clock BenchClock;
+
+// Runs the churn for the given time, and returns the operations per second
+template<typename Alloc, typename Free, typename CanResize>
+static double Measure(unsigned VoiceCount, double Seconds, Alloc &&PoolAlloc, Free &&PoolFree, CanResize &&PoolCanResize)
+{
+	std::mt19937 rng(0xD5B0);
+	std::vector<BenchVoice> Voices(VoiceCount, BenchVoice{ nullptr, 0, 0 });
+	uint64_t Operations = 0;
+	auto Start = BenchClock::now();
+	double Elapsed;
+	do {
+		for (unsigned i = 0; i < 256; i++) {
+			BenchVoice &Voice = Voices[rng() % Voices.size()];
+			if (rng() % 8 == 0 && Voice.pBuffer != nullptr) {
+				ReleaseVoice(Voice, PoolFree);
+			} else {
+				ResizeVoice(Voice, RandomSize(rng), PoolAlloc, PoolFree, PoolCanResize);
+			}
+		}
+		Operations += 256;
+		Elapsed = std::chrono::duration<double>(BenchClock::now() - Start).count();
+	} while (Elapsed < Seconds);
+
+	for (BenchVoice &Voice : Voices) {
+		if (Voice.pBuffer != nullptr) {
+			ReleaseVoice(Voice, PoolFree);
+		}
+	}
+	return (double)Operations / Elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 2 && strcmp(argv[1], "-test") == 0) {
+		TestClasses();
+		TestKeepLimit();
+		TestChurn();
+		printf("%u failure(s)\n", g_Failures);
+		return g_Failures ? 1 : 0;
+	}
+
+	if (argc > 1 && (argv[1][0] < '0' || argv[1][0] > '9')) {
+		printf("Usage : cxbxr-voicepoolbench [voices] [seconds]\n");
+		printf("        cxbxr-voicepoolbench -test\n");
+		return 1;
+	}
+
+	unsigned VoiceCount = (argc > 1) ? (unsigned)atoi(argv[1]) : 64;
+	double Seconds = (argc > 2) ? atof(argv[2]) : 1.0;
+	if (VoiceCount == 0) {
+		VoiceCount = 1;
+	}
+
+	printf("%u voices, create/resize/release operations per second\n", VoiceCount);
+
+	double Rate = Measure(VoiceCount, Seconds,
+		[](uint32_t dwSize) { return malloc(dwSize); },
+		[](void *pBuffer, uint32_t) { free(pBuffer); },
+		[](uint32_t, uint32_t) { return false; });
+	printf("%-24s %12.0f\n", "malloc and free", Rate);
+
+	Rate = Measure(VoiceCount, Seconds, DSVoice_Pool_Alloc, DSVoice_Pool_Free, DSVoice_Pool_CanResize);
+	printf("%-24s %12.0f\n", "pool", Rate);
+
+	DSVoicePoolStats Stats = DSVoice_Pool_GetStats();
+	uint64_t Requests = Stats.Allocs + Stats.Kept;
+	printf("Allocations avoided : %llu of %llu (%.1f%%), %llu reused blocks and %llu resizes in place, %llu blocks released\n",
+		(unsigned long long)(Stats.Reused + Stats.Kept), (unsigned long long)Requests,
+		Requests ? (Stats.Reused + Stats.Kept) * 100.0 / Requests : 0.0,
+		(unsigned long long)Stats.Reused, (unsigned long long)Stats.Kept, (unsigned long long)Stats.Released);
+
+	return 0;
+}
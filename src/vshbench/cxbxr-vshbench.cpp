@@ -0,0 +1,960 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// ******************************************************************
+// *
+// *  This file is part of Cxbx-Reloaded.
+// *
+// *  Cxbx-Reloaded is free software; you can redistribute it
+// *  and/or modify it under the terms of the GNU General Public
+// *  License as published by the Free Software Foundation; either
+// *  version 2 of the license, or (at your option) any later version.
+// *
+// *  This program is distributed in the hope that it will be useful,
+// *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+// *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// *  GNU General Public License for more details.
+// *
+// *  You should have recieved a copy of the GNU General Public License
+// *  along with this program; see the file COPYING.
+// *  If not, write to the Free Software Foundation, Inc.,
+// *  59 Temple Place - Suite 330, Bostom, MA 02111-1307, USA.
+// *
+// *  All rights reserved
+// *
+// ******************************************************************
+
+// Checks and times VshEmitBytecode, which translates intermediate Xbox vertex
+// shaders straight into vs_3_0 tokens, against the HLSL path it bypasses
+// (CxbxVertexShaderTemplate.hlsl populated by BuildShader, then D3DCompile).
+//
+// The test runs random intermediate programs through a model of the HLSL
+// template semantics, and the emitted tokens through a small vs_3_0
+// interpreter, with the same constants and inputs, and requires the same
+// outputs. It also requires a few hand written shaders to emit token streams
+// identical to the frozen goldens below (-print disassembles them, to review a
+// deliberate change before updating the goldens), and shaders writing to
+// constants to be left to the HLSL path.
+//
+// The benchmark reports the time per shader of HLSL text generation (plus
+// D3DCompile on Windows) and of bytecode emission, for random title-sized
+// shaders.
+//
+// Usage : cxbxr-vshbench [shaders] [repeats]
+//         cxbxr-vshbench -test
+//         cxbxr-vshbench -print
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <d3dcompiler.h>
+#endif
+
+#include "core/hle/D3D8/Direct3D9/VertexShaderBytecode.h"
+#include "core/hle/D3D8/Direct3D9/VertexShaderHlsl.h"
+
+#define TEST_PROGRAMS 5000
+#define TEST_SEED 1234
+#define BENCH_SHADERS 200
+#define BENCH_REPEATS 50
+#define BENCH_SHADER_LENGTH 60 // Instructions, as split by the parser (about 40 Xbox slots)
+#define BENCH_SEED 7
+
+// Same as in XbD3D8Types.h and CxbxVertexShaderTemplate.hlsl
+#define X_D3DSCM_CORRECTION 96
+#define X_D3DVS_CONSTREG_COUNT 192
+#define CONSTREG_VREGDEFAULTS_BASE 192
+#define CONSTREG_VREGDEFAULTS_FLAG_BASE 208
+#define CONSTREG_VIEWPORT_SCALE 212
+#define CONSTREG_VIEWPORT_OFFSET 213
+
+#define MASK_XYZW (MASK_X | MASK_Y | MASK_Z | MASK_W)
+
+// The host outputs, in o# order (see HostOutputs in VertexShaderBytecode.cpp)
+#define HOST_OUTPUT_COUNT 11
+
+struct Vec4
+{
+	float v[4];
+	float &operator[](int i) { return v[i]; }
+	float operator[](int i) const { return v[i]; }
+};
+
+static const Vec4 Zero = { { 0, 0, 0, 0 } };
+
+// ******************************************************************
+// * Reference : the semantics of the HLSL template, on the intermediate format
+// ******************************************************************
+
+struct RefState
+{
+	// Inputs
+	Vec4 C[X_D3DVS_CONSTREG_COUNT];
+	Vec4 Defaults[16];
+	Vec4 Flags[4]; // One per vertex register, four per Vec4
+	Vec4 Scale, Offset;
+	Vec4 In[16];
+	// Registers
+	Vec4 r[13]; // r12 is oPos
+	Vec4 v[16];
+	Vec4 o[16]; // Indexed with VSH_OREG_NAME
+	int a0;
+	// Set when a result depends on how the host rounds or handles non-finite values
+	bool bUndefined;
+	// Set when a reciprocal of zero was taken, the sign of that zero (so of the infinity) can differ
+	// between the template and the emitted instructions
+	bool bZeroReciprocal;
+};
+
+// See x_floor in the template
+static float XFloor(float f)
+{
+	return std::floor(f + 0.001f);
+}
+
+static Vec4 RefConstant(const RefState &s, int Index)
+{
+	Index += X_D3DSCM_CORRECTION;
+	if (Index < 0 || Index >= X_D3DVS_CONSTREG_COUNT) {
+		return Zero;
+	}
+
+	return s.C[Index];
+}
+
+static Vec4 RefParameter(const RefState &s, const VSH_IMD_PARAMETER &Param, bool bRelative)
+{
+	Vec4 x;
+	switch (Param.ParameterType) {
+	case PARAM_R: x = s.r[Param.Address]; break;
+	case PARAM_V: x = s.v[Param.Address]; break;
+	case PARAM_C: x = RefConstant(s, bRelative ? s.a0 + Param.Address : Param.Address); break;
+	default: x = Zero; break;
+	}
+
+	Vec4 y;
+	for (int i = 0; i < 4; i++) {
+		y[i] = Param.Neg ? -x[Param.Swizzle[i]] : x[Param.Swizzle[i]];
+	}
+
+	return y;
+}
+
+static void RefRun(RefState &s, const std::vector<VSH_INTERMEDIATE_FORMAT> &Program)
+{
+	for (int i = 0; i < 16; i++) {
+		s.o[i] = { { 0, 0, 0, 1 } };
+	}
+	s.o[OREG_OFOG] = Zero;
+	s.o[OREG_OPTS] = Zero;
+	for (int i = 0; i < 12; i++) {
+		s.r[i] = Zero;
+	}
+	s.r[12] = { { 0, 0, 0, 1 } };
+	s.a0 = 0;
+	s.bUndefined = false;
+	s.bZeroReciprocal = false;
+	// Vertex registers without data get their default
+	for (int i = 0; i < 16; i++) {
+		float Flag = s.Flags[i / 4][i % 4];
+		for (int c = 0; c < 4; c++) {
+			s.v[i][c] = s.In[i][c] + Flag * (s.Defaults[i][c] - s.In[i][c]);
+		}
+	}
+
+	for (const auto &I : Program) {
+		Vec4 a = I.ParamCount > 0 ? RefParameter(s, I.Parameters[0], I.IndexesWithA0_X) : Zero;
+		Vec4 b = I.ParamCount > 1 ? RefParameter(s, I.Parameters[1], I.IndexesWithA0_X) : Zero;
+		Vec4 c = I.ParamCount > 2 ? RefParameter(s, I.Parameters[2], I.IndexesWithA0_X) : Zero;
+		Vec4 d = Zero;
+		if (I.MAC == MAC_NOP && I.ILU >= ILU_RCC && !std::isfinite(a[0])) {
+			s.bUndefined = true; // frexp or floor of inf or nan
+		}
+		if (I.MAC == MAC_NOP && (I.ILU == ILU_RCP || I.ILU == ILU_RCC) && a[0] == 0) {
+			s.bZeroReciprocal = true;
+		}
+
+		if (I.MAC == MAC_ARL) {
+			s.a0 = (int)XFloor(a[0]);
+			continue;
+		}
+
+		switch (I.MAC) {
+		case MAC_MOV: d = a; break;
+		case MAC_MUL: for (int k = 0; k < 4; k++) d[k] = a[k] * b[k]; break;
+		case MAC_ADD: for (int k = 0; k < 4; k++) d[k] = a[k] + b[k]; break;
+		case MAC_MAD: for (int k = 0; k < 4; k++) d[k] = a[k] * b[k] + c[k]; break;
+		case MAC_DP3: { float t = a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; d = { { t, t, t, t } }; break; }
+		case MAC_DPH: { float t = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + b[3]; d = { { t, t, t, t } }; break; }
+		case MAC_DP4: { float t = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3]; d = { { t, t, t, t } }; break; }
+		case MAC_DST: d = { { 1, a[1] * b[1], a[2], b[3] } }; break;
+		case MAC_MIN: for (int k = 0; k < 4; k++) d[k] = std::fmin(a[k], b[k]); break;
+		case MAC_MAX: for (int k = 0; k < 4; k++) d[k] = std::fmax(a[k], b[k]); break;
+		case MAC_SLT: for (int k = 0; k < 4; k++) d[k] = a[k] < b[k]; break;
+		case MAC_SGE: for (int k = 0; k < 4; k++) d[k] = a[k] >= b[k]; break;
+		default:
+			switch (I.ILU) {
+			case ILU_MOV: d = a; break;
+			case ILU_RCP: { float t = 1 / a[0]; d = { { t, t, t, t } }; break; }
+			case ILU_RSQ: { float t = 1 / std::sqrt(std::fabs(a[0])); d = { { t, t, t, t } }; break; }
+			case ILU_RCC: {
+				float t = 1 / a[0];
+				t = (t >= 0) ? std::fmin(std::fmax(t, 5.42101e-020f), 1.84467e+019f) : std::fmin(std::fmax(t, -1.84467e+019f), -5.42101e-020f);
+				d = { { t, t, t, t } };
+				break;
+			}
+			case ILU_EXP: { float f = XFloor(a[0]); d = { { std::exp2(f), a[0] - f, std::exp2(a[0]), 1 } }; break; }
+			case ILU_LOG: { int e; float m = std::frexp(a[0], &e); d = { { (float)e, m, std::log2(std::fabs(a[0])), 1 } }; break; }
+			case ILU_LIT: {
+				float Power = std::fmin(std::fmax(a[3], -(128 - 1 / 256.f)), 128 - 1 / 256.f);
+				d = { { 1, std::fmax(0.f, a[0]), (a[0] > 0 && a[1] > 0) ? std::pow(a[1], Power) : 0, 1 } };
+				break;
+			}
+			default: break;
+			}
+			break;
+		}
+
+		Vec4 *pDest;
+		if (I.Output.Type == IMD_OUTPUT_R) {
+			pDest = &s.r[I.Output.Address];
+		} else if (I.Output.Address == OREG_OPOS) {
+			pDest = &s.r[12];
+		} else {
+			pDest = &s.o[I.Output.Address];
+		}
+		if (I.Output.Mask & MASK_X) (*pDest)[0] = d[0];
+		if (I.Output.Mask & MASK_Y) (*pDest)[1] = d[1];
+		if (I.Output.Mask & MASK_Z) (*pDest)[2] = d[2];
+		if (I.Output.Mask & MASK_W) (*pDest)[3] = d[3];
+	}
+}
+
+// The outputs as the template writes them, in host o# order
+static void RefOutputs(const RefState &s, Vec4 Out[HOST_OUTPUT_COUNT])
+{
+	auto Saturate = [](Vec4 x) {
+		for (int k = 0; k < 4; k++) {
+			x[k] = std::fmin(std::fmax(x[k], 0.f), 1.f);
+		}
+		return x;
+	};
+
+	// Reverse the viewport transform the Xbox shader applied
+	Vec4 Pos = s.r[12];
+	for (int k = 0; k < 3; k++) {
+		Pos[k] = (Pos[k] - s.Offset[k]) * Pos[3] * (1 / s.Scale[k]);
+	}
+	Out[0] = Pos;
+	Out[1] = Saturate(s.o[OREG_OD0]);
+	Out[2] = Saturate(s.o[OREG_OD1]);
+	Out[3] = { { s.o[OREG_OFOG][0], 0, 0, 0 } };
+	Out[4] = { { s.o[OREG_OPTS][0], 0, 0, 0 } };
+	Out[5] = Saturate(s.o[OREG_OB0]);
+	Out[6] = Saturate(s.o[OREG_OB1]);
+	for (int i = 0; i < 4; i++) {
+		Out[7 + i] = s.o[OREG_OT0 + i];
+	}
+}
+
+// ******************************************************************
+// * A vs_3_0 token interpreter, for the instructions VshEmitBytecode uses
+// ******************************************************************
+
+struct HostMachine
+{
+	Vec4 c[256];
+	Vec4 r[32];
+	Vec4 v[16];
+	Vec4 o[12];
+	int a0;
+};
+
+static unsigned TokenRegisterType(uint32_t Token)
+{
+	return ((Token >> 28) & 7) | ((Token >> 8) & 0x18);
+}
+
+// Returns false for token streams it doesn't understand, or that don't end
+static bool Interpret(HostMachine &m, const std::vector<uint32_t> &Tokens)
+{
+	if (Tokens.empty() || Tokens[0] != 0xFFFE0300) {
+		return false;
+	}
+
+	for (size_t i = 1; i < Tokens.size(); ) {
+		uint32_t Instruction = Tokens[i];
+		if (Instruction == 0x0000FFFF) {
+			return true;
+		}
+
+		uint32_t Opcode = Instruction & 0xFFFF;
+		uint32_t Length = (Instruction >> 24) & 0xF;
+		if (i + 1 + Length > Tokens.size()) {
+			return false;
+		}
+		const uint32_t *p = &Tokens[i + 1];
+		i += 1 + Length;
+		if (Opcode == 31) { // dcl
+			continue;
+		}
+		if (Opcode == 81) { // def
+			std::memcpy(&m.c[p[0] & 0x7FF], p + 1, sizeof(Vec4));
+			continue;
+		}
+
+		Vec4 Src[3] = { Zero, Zero, Zero };
+		unsigned SrcCount = 0;
+		for (uint32_t k = 1; k < Length && SrcCount < 3; ) {
+			uint32_t Token = p[k++];
+			int Number = Token & 0x7FF;
+			if (Token & (1 << 13)) { // Relative, skip the a0.x token
+				k++;
+				Number += m.a0;
+			}
+			Vec4 x;
+			switch (TokenRegisterType(Token)) {
+			case 0: x = m.r[Number]; break;
+			case 1: x = m.v[Number]; break;
+			case 2: x = (Number >= 0 && Number < 256) ? m.c[Number] : Zero; break;
+			default: return false;
+			}
+			Vec4 &y = Src[SrcCount++];
+			for (int q = 0; q < 4; q++) {
+				y[q] = x[(Token >> (16 + 2 * q)) & 3];
+			}
+			switch ((Token >> 24) & 0xF) {
+			case 0: break;
+			case 1: for (int q = 0; q < 4; q++) y[q] = -y[q]; break;
+			default: return false;
+			}
+		}
+
+		const Vec4 &a = Src[0], &b = Src[1], &c = Src[2];
+		Vec4 d = Zero;
+		switch (Opcode) {
+		case 1: d = a; break; // mov
+		case 2: for (int q = 0; q < 4; q++) d[q] = a[q] + b[q]; break; // add
+		case 4: for (int q = 0; q < 4; q++) d[q] = a[q] * b[q] + c[q]; break; // mad
+		case 5: for (int q = 0; q < 4; q++) d[q] = a[q] * b[q]; break; // mul
+		// The scalar instructions use the last component of their (replicated) source
+		case 6: { float t = 1 / a[3]; d = { { t, t, t, t } }; break; } // rcp
+		case 7: { float t = 1 / std::sqrt(std::fabs(a[3])); d = { { t, t, t, t } }; break; } // rsq
+		case 8: { float t = a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; d = { { t, t, t, t } }; break; } // dp3
+		case 9: { float t = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3]; d = { { t, t, t, t } }; break; } // dp4
+		case 10: for (int q = 0; q < 4; q++) d[q] = std::fmin(a[q], b[q]); break; // min
+		case 11: for (int q = 0; q < 4; q++) d[q] = std::fmax(a[q], b[q]); break; // max
+		case 12: for (int q = 0; q < 4; q++) d[q] = a[q] < b[q]; break; // slt
+		case 13: for (int q = 0; q < 4; q++) d[q] = a[q] >= b[q]; break; // sge
+		case 14: { float t = std::exp2(a[3]); d = { { t, t, t, t } }; break; } // exp
+		case 15: { float t = std::log2(std::fabs(a[3])); d = { { t, t, t, t } }; break; } // log
+		case 16: { // lit
+			float Power = std::fmin(std::fmax(a[3], -127.9961f), 127.9961f);
+			d = { { 1, 0, 0, 1 } };
+			if (a[0] > 0) {
+				d[1] = a[0];
+				if (a[1] > 0) {
+					d[2] = std::pow(a[1], Power);
+				}
+			}
+			break;
+		}
+		case 17: d = { { 1, a[1] * b[1], a[2], b[3] } }; break; // dst
+		case 18: for (int q = 0; q < 4; q++) d[q] = a[q] * (b[q] - c[q]) + c[q]; break; // lrp
+		case 19: for (int q = 0; q < 4; q++) d[q] = a[q] - std::floor(a[q]); break; // frc
+		case 46: m.a0 = (int)std::lrint(a[0]); continue; // mova
+		default: return false;
+		}
+
+		uint32_t Dest = p[0];
+		if (Dest & (1 << 20)) { // _sat
+			for (int q = 0; q < 4; q++) {
+				d[q] = std::fmin(std::fmax(d[q], 0.f), 1.f);
+			}
+		}
+		Vec4 *pDest;
+		switch (TokenRegisterType(Dest)) {
+		case 0: pDest = &m.r[Dest & 0x7FF]; break;
+		case 6: pDest = &m.o[Dest & 0x7FF]; break;
+		default: return false;
+		}
+		for (int q = 0; q < 4; q++) {
+			if (Dest & (1 << (16 + q))) {
+				(*pDest)[q] = d[q];
+			}
+		}
+	}
+
+	return false;
+}
+
+// ******************************************************************
+// * Random intermediate programs
+// ******************************************************************
+
+static int RandomInt(std::mt19937 &Rng, int Min, int Max)
+{
+	return std::uniform_int_distribution<int>(Min, Max)(Rng);
+}
+
+static float RandomFloat(std::mt19937 &Rng)
+{
+	return std::uniform_real_distribution<float>(-3.f, 3.f)(Rng);
+}
+
+// Parameter count of each VSH_MAC
+static const unsigned MacParamCount[] = { 0, 1, 2, 2, 3, 2, 2, 2, 2, 2, 2, 2, 2, 1 };
+
+static VSH_IMD_PARAMETER RandomParameter(std::mt19937 &Rng, int ConstantAddress)
+{
+	VSH_IMD_PARAMETER Param;
+	Param.ParameterType = (VSH_PARAMETER_TYPE)RandomInt(Rng, PARAM_R, PARAM_C);
+	switch (Param.ParameterType) {
+	case PARAM_R: Param.Address = RandomInt(Rng, 0, 12); break;
+	case PARAM_V: Param.Address = RandomInt(Rng, 0, 15); break;
+	default: Param.Address = ConstantAddress; break; // Instructions read one constant at most
+	}
+	Param.Neg = RandomInt(Rng, 0, 1);
+	for (int i = 0; i < 4; i++) {
+		Param.Swizzle[i] = (VSH_SWIZZLE)RandomInt(Rng, 0, 3);
+	}
+	if (RandomInt(Rng, 0, 2) == 0) {
+		for (int i = 0; i < 4; i++) {
+			Param.Swizzle[i] = (VSH_SWIZZLE)i;
+		}
+	}
+
+	return Param;
+}
+
+static std::vector<VSH_INTERMEDIATE_FORMAT> RandomProgram(std::mt19937 &Rng)
+{
+	// Xbox outputs that exist on the host
+	static const int16_t Outputs[] = { OREG_OPOS, OREG_OD0, OREG_OD1, OREG_OFOG, OREG_OPTS, OREG_OB0, OREG_OB1, OREG_OT0, OREG_OT1, OREG_OT2, OREG_OT3 };
+
+	std::vector<VSH_INTERMEDIATE_FORMAT> Program(RandomInt(Rng, 1, 40));
+	for (auto &I : Program) {
+		I = {};
+		// Mostly the 192 Xbox constants, sometimes out of range
+		int ConstantAddress = (RandomInt(Rng, 0, 9) == 0) ? RandomInt(Rng, 96, 159) : RandomInt(Rng, -96, 95);
+		I.IndexesWithA0_X = RandomInt(Rng, 0, 3) == 0;
+		if (I.IndexesWithA0_X) {
+			ConstantAddress = RandomInt(Rng, -10, 10);
+		}
+		if (RandomInt(Rng, 0, 2) != 0) {
+			I.MAC = (VSH_MAC)RandomInt(Rng, MAC_MOV, MAC_ARL);
+			I.ILU = ILU_NOP;
+			I.ParamCount = MacParamCount[I.MAC];
+		} else {
+			I.MAC = MAC_NOP;
+			I.ILU = (VSH_ILU)RandomInt(Rng, ILU_MOV, ILU_LIT);
+			I.ParamCount = 1;
+		}
+		for (unsigned k = 0; k < I.ParamCount; k++) {
+			I.Parameters[k] = RandomParameter(Rng, ConstantAddress);
+		}
+
+		if (I.MAC == MAC_ARL) {
+			// Index with constants, those are set to integers in range below
+			I.Output = { IMD_OUTPUT_A0X, 0, MASK_X };
+			I.Parameters[0].ParameterType = PARAM_C;
+			I.Parameters[0].Address = RandomInt(Rng, -96, 95);
+			I.IndexesWithA0_X = false;
+		} else if (RandomInt(Rng, 0, 1) != 0) {
+			I.Output = { IMD_OUTPUT_R, (int16_t)RandomInt(Rng, 0, 12), (int8_t)RandomInt(Rng, 1, 15) };
+		} else {
+			I.Output = { IMD_OUTPUT_O, Outputs[RandomInt(Rng, 0, 10)], (int8_t)RandomInt(Rng, 1, 15) };
+		}
+	}
+
+	return Program;
+}
+
+static bool Close(float a, float b)
+{
+	if (std::isnan(a) && std::isnan(b)) {
+		return true;
+	}
+	if (std::isinf(a) || std::isinf(b)) {
+		return a == b;
+	}
+
+	return std::fabs(a - b) <= 1e-3f * std::fmax(1.f, std::fmax(std::fabs(a), std::fabs(b)));
+}
+
+// Runs Count random programs through the reference and through the emitted tokens, returns the number
+// of programs with different outputs, or ~0u when the interpreter didn't understand the tokens
+static unsigned CompareRandom(unsigned Count, unsigned *pRejected, unsigned *pUndefined)
+{
+	std::mt19937 Rng(TEST_SEED);
+	unsigned Mismatches = 0;
+	*pRejected = 0;
+	*pUndefined = 0;
+	for (unsigned n = 0; n < Count; n++) {
+		auto Program = RandomProgram(Rng);
+		std::vector<uint32_t> Tokens;
+		if (!VshEmitBytecode(Program, Tokens)) {
+			(*pRejected)++;
+			continue;
+		}
+
+		static RefState s;
+		static HostMachine m;
+		s = {};
+		m = {};
+		for (int i = 0; i < X_D3DVS_CONSTREG_COUNT; i++) {
+			for (int c = 0; c < 4; c++) {
+				s.C[i][c] = RandomFloat(Rng);
+			}
+		}
+		// Make some constants usable as an index (by mov a0.x)
+		for (int i = 0; i < X_D3DVS_CONSTREG_COUNT; i += 3) {
+			s.C[i][0] = (float)RandomInt(Rng, -100, 100);
+		}
+		for (int i = 0; i < 16; i++) {
+			for (int c = 0; c < 4; c++) {
+				s.Defaults[i][c] = RandomFloat(Rng);
+				s.In[i][c] = RandomFloat(Rng);
+			}
+		}
+		for (int i = 0; i < 16; i++) {
+			s.Flags[i / 4][i % 4] = (float)RandomInt(Rng, 0, 1);
+		}
+		for (int c = 0; c < 4; c++) {
+			s.Scale[c] = RandomFloat(Rng) + 5;
+			s.Offset[c] = RandomFloat(Rng);
+		}
+
+		// The same, in the host constant layout of the template
+		for (int i = 0; i < X_D3DVS_CONSTREG_COUNT; i++) {
+			m.c[i] = s.C[i];
+		}
+		for (int i = 0; i < 16; i++) {
+			m.c[CONSTREG_VREGDEFAULTS_BASE + i] = s.Defaults[i];
+			m.v[i] = s.In[i];
+		}
+		for (int i = 0; i < 4; i++) {
+			m.c[CONSTREG_VREGDEFAULTS_FLAG_BASE + i] = s.Flags[i];
+		}
+		m.c[CONSTREG_VIEWPORT_SCALE] = s.Scale;
+		m.c[CONSTREG_VIEWPORT_OFFSET] = s.Offset;
+		// Catch reads of temporaries and outputs the emitter didn't initialize
+		for (auto &r : m.r) {
+			r = { { NAN, NAN, NAN, NAN } };
+		}
+		for (auto &o : m.o) {
+			o = { { NAN, NAN, NAN, NAN } };
+		}
+
+		if (!Interpret(m, Tokens)) {
+			printf("FAIL : program %u, the interpreter doesn't understand the emitted tokens\n", n);
+			return ~0u;
+		}
+
+		RefRun(s, Program);
+		if (s.bUndefined) {
+			(*pUndefined)++;
+			continue;
+		}
+
+		Vec4 Expected[HOST_OUTPUT_COUNT];
+		RefOutputs(s, Expected);
+		bool bMismatch = false;
+		for (int i = 0; i < HOST_OUTPUT_COUNT && !bMismatch; i++) {
+			int Components = (i == 3 || i == 4) ? 1 : 4; // oFog and oPts are scalars
+			for (int c = 0; c < Components; c++) {
+				if (!Close(Expected[i][c], m.o[i][c])) {
+					if (Mismatches < 5 && !s.bZeroReciprocal) {
+						printf("FAIL : program %u, o%d.%c is %g instead of %g\n", n, i, "xyzw"[c], m.o[i][c], Expected[i][c]);
+					}
+					bMismatch = true;
+					break;
+				}
+			}
+		}
+		if (bMismatch && s.bZeroReciprocal) {
+			(*pUndefined)++;
+		} else {
+			Mismatches += bMismatch;
+		}
+	}
+
+	return Mismatches;
+}
+
+// ******************************************************************
+// * Golden token streams
+// ******************************************************************
+
+static std::string Disassemble(const std::vector<uint32_t> &Tokens)
+{
+	auto Register = [](uint32_t Token) {
+		static const char *Names[] = { "r", "v", "c", "a", "?", "?", "o", "?" };
+		unsigned Type = TokenRegisterType(Token);
+		return std::string(Type < 8 ? Names[Type] : "?") + std::to_string(Token & 0x7FF);
+	};
+	auto WriteMask = [](uint32_t Token) {
+		std::string s;
+		if (((Token >> 16) & 0xF) != 0xF) {
+			s += ".";
+			for (int q = 0; q < 4; q++) {
+				if (Token & (1 << (16 + q))) {
+					s += "xyzw"[q];
+				}
+			}
+		}
+		return s;
+	};
+	auto Opcode = [](uint32_t Opcode) -> const char* {
+		switch (Opcode) {
+		case 1: return "mov"; case 2: return "add"; case 4: return "mad"; case 5: return "mul";
+		case 6: return "rcp"; case 7: return "rsq"; case 8: return "dp3"; case 9: return "dp4";
+		case 10: return "min"; case 11: return "max"; case 12: return "slt"; case 13: return "sge";
+		case 14: return "exp"; case 15: return "log"; case 16: return "lit"; case 17: return "dst";
+		case 18: return "lrp"; case 19: return "frc"; case 31: return "dcl"; case 46: return "mova";
+		case 81: return "def";
+		default: return "??";
+		}
+	};
+
+	char Line[128];
+	snprintf(Line, sizeof(Line), "vs_%u_%u\n", (Tokens[0] >> 8) & 0xFF, Tokens[0] & 0xFF);
+	std::string s = Line;
+	for (size_t i = 1; i < Tokens.size(); ) {
+		uint32_t Instruction = Tokens[i];
+		if (Instruction == 0x0000FFFF) {
+			s += "end\n";
+			break;
+		}
+
+		uint32_t Op = Instruction & 0xFFFF;
+		uint32_t Length = (Instruction >> 24) & 0xF;
+		const uint32_t *p = &Tokens[i + 1];
+		i += 1 + Length;
+		s += Opcode(Op);
+		if (Op == 31) {
+			static const char *Usages[] = { "position", "", "", "", "psize", "texcoord", "", "", "", "", "color", "fog" };
+			unsigned Usage = p[0] & 31;
+			snprintf(Line, sizeof(Line), "_%s%u %s%s\n", Usage < 12 ? Usages[Usage] : "?", (p[0] >> 16) & 15, Register(p[1]).c_str(), WriteMask(p[1]).c_str());
+			s += Line;
+			continue;
+		}
+		if (Op == 81) {
+			float f[4];
+			std::memcpy(f, p + 1, sizeof(f));
+			snprintf(Line, sizeof(Line), " %s, %g, %g, %g, %g\n", Register(p[0]).c_str(), f[0], f[1], f[2], f[3]);
+			s += Line;
+			continue;
+		}
+
+		if (p[0] & (1 << 20)) {
+			s += "_sat";
+		}
+		s += " " + Register(p[0]) + WriteMask(p[0]);
+		for (uint32_t k = 1; k < Length; ) {
+			uint32_t Token = p[k++];
+			s += ", ";
+			if (((Token >> 24) & 0xF) == 1) {
+				s += "-";
+			}
+			if (Token & (1 << 13)) {
+				s += "c[a0.x + " + std::to_string(Token & 0x7FF) + "]";
+				k++;
+			} else {
+				s += Register(Token);
+			}
+			uint32_t Swizzle = (Token >> 16) & 0xFF;
+			if (Swizzle != 0xE4) {
+				s += ".";
+				for (int q = 0; q < 4; q++) {
+					s += "xyzw"[(Swizzle >> (2 * q)) & 3];
+				}
+			}
+		}
+		s += "\n";
+	}
+
+	return s;
+}
+
+// FNV-1a over the bytes of the token stream
+static uint32_t HashTokens(const std::vector<uint32_t> &Tokens)
+{
+	uint32_t Hash = 2166136261u;
+	for (uint32_t Token : Tokens) {
+		for (int i = 0; i < 4; i++) {
+			Hash = (Hash ^ ((Token >> (8 * i)) & 0xFF)) * 16777619u;
+		}
+	}
+
+	return Hash;
+}
+
+static VSH_IMD_PARAMETER Param(VSH_PARAMETER_TYPE Type, int16_t Address, bool bNeg = false, int x = 0, int y = 1, int z = 2, int w = 3)
+{
+	VSH_IMD_PARAMETER p;
+	p.ParameterType = Type;
+	p.Address = Address;
+	p.Neg = bNeg;
+	p.Swizzle[0] = (VSH_SWIZZLE)x;
+	p.Swizzle[1] = (VSH_SWIZZLE)y;
+	p.Swizzle[2] = (VSH_SWIZZLE)z;
+	p.Swizzle[3] = (VSH_SWIZZLE)w;
+	return p;
+}
+
+static VSH_INTERMEDIATE_FORMAT Instr(VSH_MAC Mac, VSH_ILU Ilu, VSH_IMD_OUTPUT_TYPE OutputType, int16_t OutputAddress, int8_t Mask,
+	std::initializer_list<VSH_IMD_PARAMETER> Params, bool bRelative = false)
+{
+	VSH_INTERMEDIATE_FORMAT I = {};
+	I.MAC = Mac;
+	I.ILU = Ilu;
+	I.Output = { OutputType, OutputAddress, Mask };
+	for (const auto &p : Params) {
+		I.Parameters[I.ParamCount++] = p;
+	}
+	I.IndexesWithA0_X = bRelative;
+	return I;
+}
+
+struct GoldenCase
+{
+	const char *Name;
+	std::vector<VSH_INTERMEDIATE_FORMAT> Program;
+	bool bEmitted; // False when it must be left to the HLSL path
+	size_t TokenCount;
+	uint32_t Hash;
+};
+
+// Update these only after reviewing the -print disassembly
+static std::vector<GoldenCase> GoldenCases()
+{
+	return {
+		// dp4 oPos.x..w, v0, c[-96..-93] ; mov oD0, v3
+		{ "transform", {
+			Instr(MAC_DP4, ILU_NOP, IMD_OUTPUT_O, OREG_OPOS, MASK_X, { Param(PARAM_V, 0), Param(PARAM_C, -96) }),
+			Instr(MAC_DP4, ILU_NOP, IMD_OUTPUT_O, OREG_OPOS, MASK_Y, { Param(PARAM_V, 0), Param(PARAM_C, -95) }),
+			Instr(MAC_DP4, ILU_NOP, IMD_OUTPUT_O, OREG_OPOS, MASK_Z, { Param(PARAM_V, 0), Param(PARAM_C, -94) }),
+			Instr(MAC_DP4, ILU_NOP, IMD_OUTPUT_O, OREG_OPOS, MASK_W, { Param(PARAM_V, 0), Param(PARAM_C, -93) }),
+			Instr(MAC_MOV, ILU_NOP, IMD_OUTPUT_O, OREG_OD0, MASK_XYZW, { Param(PARAM_V, 3) }),
+		}, true, 133, 0x5f10ac2b },
+		// A MAC and ILU pair (as split by the parser), with outputs muxed from both
+		{ "paired", {
+			Instr(MAC_MUL, ILU_NOP, IMD_OUTPUT_R, 0, MASK_XYZW, { Param(PARAM_V, 0, false, 1, 0, 3, 2), Param(PARAM_C, 0, true) }),
+			Instr(MAC_NOP, ILU_RCP, IMD_OUTPUT_R, 1, MASK_X, { Param(PARAM_V, 0, false, 3, 3, 3, 3) }),
+			Instr(MAC_NOP, ILU_RCP, IMD_OUTPUT_O, OREG_OT0, MASK_X | MASK_Y, { Param(PARAM_V, 0, false, 3, 3, 3, 3) }),
+			Instr(MAC_MAD, ILU_NOP, IMD_OUTPUT_O, OREG_OFOG, MASK_X | MASK_W, { Param(PARAM_R, 0), Param(PARAM_R, 1, false, 0, 0, 0, 0), Param(PARAM_C, 0) }),
+		}, true, 127, 0x648209a3 },
+		// arl a0.x, v1.x ; mov oT1, c[a0.x + 5] ; dph oT1.z, v1, -c[a0.x + 5].zyxy
+		{ "relative", {
+			Instr(MAC_ARL, ILU_NOP, IMD_OUTPUT_A0X, 0, MASK_X, { Param(PARAM_V, 1) }),
+			Instr(MAC_MOV, ILU_NOP, IMD_OUTPUT_O, OREG_OT1, MASK_XYZW, { Param(PARAM_C, 5) }, true),
+			Instr(MAC_DPH, ILU_NOP, IMD_OUTPUT_O, OREG_OT1, MASK_Z, { Param(PARAM_V, 1), Param(PARAM_C, 5, true, 2, 1, 0, 1) }, true),
+		}, true, 164, 0x3f9ced86 },
+		// Writes to constants go through the HLSL path
+		{ "constant write", {
+			Instr(MAC_MOV, ILU_NOP, IMD_OUTPUT_C, 3, MASK_XYZW, { Param(PARAM_V, 0) }),
+		}, false, 0, 0 },
+	};
+}
+
+static unsigned CheckGoldens(bool bPrint)
+{
+	unsigned Failures = 0;
+	for (const auto &Case : GoldenCases()) {
+		std::vector<uint32_t> Tokens;
+		bool bEmitted = VshEmitBytecode(Case.Program, Tokens);
+		if (bEmitted != Case.bEmitted) {
+			printf("FAIL : %s was %s\n", Case.Name, bEmitted ? "emitted instead of left to the HLSL path" : "not emitted");
+			Failures++;
+			continue;
+		}
+		if (!bEmitted) {
+			printf("%-14s : left to the HLSL path\n", Case.Name);
+			continue;
+		}
+
+		uint32_t Hash = HashTokens(Tokens);
+		if (bPrint) {
+			printf("--- %s (%zu tokens, hash 0x%08x)\n%s", Case.Name, Tokens.size(), Hash, Disassemble(Tokens).c_str());
+		} else if (Tokens.size() != Case.TokenCount || Hash != Case.Hash) {
+			printf("FAIL : %s emitted %zu tokens with hash 0x%08x instead of the golden %zu tokens with hash 0x%08x\n",
+				Case.Name, Tokens.size(), Hash, Case.TokenCount, Case.Hash);
+			Failures++;
+		} else {
+			printf("%-14s : matches the golden token stream\n", Case.Name);
+		}
+	}
+
+	return Failures;
+}
+
+// ******************************************************************
+// * Benchmark
+// ******************************************************************
+
+// About what titles use : mostly transforms, lighting and texture coordinate generation into temporaries
+static std::vector<VSH_INTERMEDIATE_FORMAT> RandomTitleShader(std::mt19937 &Rng)
+{
+	static const int16_t Outputs[] = { OREG_OPOS, OREG_OD0, OREG_OD1, OREG_OFOG, OREG_OT0, OREG_OT1 };
+
+	std::vector<VSH_INTERMEDIATE_FORMAT> Program(BENCH_SHADER_LENGTH);
+	for (auto &I : Program) {
+		I = {};
+		bool bIlu = RandomInt(Rng, 0, 4) == 0;
+		I.MAC = bIlu ? MAC_NOP : (VSH_MAC)RandomInt(Rng, MAC_MOV, MAC_SGE);
+		I.ILU = bIlu ? (VSH_ILU)RandomInt(Rng, ILU_MOV, ILU_LIT) : ILU_NOP;
+		I.ParamCount = bIlu ? 1 : MacParamCount[I.MAC];
+		int16_t ConstantAddress = (int16_t)RandomInt(Rng, -96, 95);
+		I.IndexesWithA0_X = RandomInt(Rng, 0, 9) == 0;
+		for (unsigned k = 0; k < I.ParamCount; k++) {
+			auto &p = I.Parameters[k];
+			p.ParameterType = (VSH_PARAMETER_TYPE)RandomInt(Rng, PARAM_R, PARAM_C);
+			p.Address = (p.ParameterType == PARAM_C) ? ConstantAddress : (int16_t)RandomInt(Rng, 0, 11);
+			p.Neg = RandomInt(Rng, 0, 3) == 0;
+			for (int q = 0; q < 4; q++) {
+				p.Swizzle[q] = (VSH_SWIZZLE)(RandomInt(Rng, 0, 2) != 0 ? q : RandomInt(Rng, 0, 3));
+			}
+		}
+		if (RandomInt(Rng, 0, 3) == 0) {
+			I.Output = { IMD_OUTPUT_O, Outputs[RandomInt(Rng, 0, 5)], (int8_t)RandomInt(Rng, 1, 15) };
+		} else {
+			I.Output = { IMD_OUTPUT_R, (int16_t)RandomInt(Rng, 0, 11), (int8_t)RandomInt(Rng, 1, 15) };
+		}
+	}
+
+	return Program;
+}
+
+// Same as in EmuCompileShader
+static std::string HlslShader(const std::vector<VSH_INTERMEDIATE_FORMAT> &Program)
+{
+	static std::string hlsl_template[2] = {
+		#include "core/hle/D3D8/Direct3D9/CxbxVertexShaderTemplate.hlsl"
+	};
+
+	std::stringstream hlsl_stream;
+	hlsl_stream << hlsl_template[0];
+	BuildShader(Program, hlsl_stream);
+	hlsl_stream << hlsl_template[1];
+	return hlsl_stream.str();
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 2 && strcmp(argv[1], "-test") == 0) {
+		unsigned failures = 0;
+		unsigned Rejected, Undefined;
+		unsigned Mismatches = CompareRandom(TEST_PROGRAMS, &Rejected, &Undefined);
+		if (Mismatches == ~0u) {
+			failures++;
+		} else {
+			printf("%u random programs, %u left to the HLSL path, %u with undefined results, %u mismatches\n",
+				TEST_PROGRAMS, Rejected, Undefined, Mismatches);
+			if (Mismatches != 0) {
+				printf("FAIL : %u programs output other values than the HLSL template would\n", Mismatches);
+				failures++;
+			}
+			if (Rejected + Undefined > TEST_PROGRAMS / 2) {
+				printf("FAIL : too few programs were compared\n");
+				failures++;
+			}
+		}
+		failures += CheckGoldens(false);
+		printf("%u failure(s)\n", failures);
+		return failures ? 1 : 0;
+	}
+
+	if (argc == 2 && strcmp(argv[1], "-print") == 0) {
+		return CheckGoldens(true) ? 1 : 0;
+	}
+
+	unsigned Shaders = BENCH_SHADERS;
+	unsigned Repeats = BENCH_REPEATS;
+	std::vector<const char *> args;
+	for (int i = 1; i < argc; i++) {
+		if (argv[i][0] >= '0' && argv[i][0] <= '9') {
+			args.push_back(argv[i]);
+		} else {
+			printf("Usage : cxbxr-vshbench [shaders] [repeats]\n");
+			printf("        cxbxr-vshbench -test\n");
+			printf("        cxbxr-vshbench -print\n");
+			return 1;
+		}
+	}
+	if (args.size() > 0) {
+		Shaders = strtoul(args[0], nullptr, 0);
+	}
+	if (args.size() > 1) {
+		Repeats = strtoul(args[1], nullptr, 0);
+	}
+	if (Shaders == 0 || Repeats == 0) {
+		printf("Nothing to do\n");
+		return 1;
+	}
+
+	std::mt19937 Rng(BENCH_SEED);
+	std::vector<std::vector<VSH_INTERMEDIATE_FORMAT>> Programs(Shaders);
+	for (auto &Program : Programs) {
+		Program = RandomTitleShader(Rng);
+	}
+	printf("%u shaders of %u instructions, %u times\n", Shaders, BENCH_SHADER_LENGTH, Repeats);
+
+	using Clock = std::chrono::steady_clock;
+	double Count = (double)Shaders * Repeats;
+	size_t Sink = 0;
+
+	auto Start = Clock::now();
+	for (unsigned r = 0; r < Repeats; r++) {
+		for (const auto &Program : Programs) {
+			Sink += HlslShader(Program).size();
+		}
+	}
+	double HlslUs = std::chrono::duration<double, std::micro>(Clock::now() - Start).count() / Count;
+	printf("HLSL generation   : %9.1f us per shader\n", HlslUs);
+
+#ifdef _WIN32
+	// Compiling is far slower, once per shader is plenty
+	Start = Clock::now();
+	for (const auto &Program : Programs) {
+		std::string hlsl_str = HlslShader(Program);
+		ID3DBlob *pShader = nullptr;
+		ID3DBlob *pErrors = nullptr;
+		HRESULT hRet = D3DCompile(hlsl_str.c_str(), hlsl_str.length(), nullptr, nullptr, nullptr, "main", "vs_3_0",
+			D3DCOMPILE_OPTIMIZATION_LEVEL3 | D3DCOMPILE_AVOID_FLOW_CONTROL, 0, &pShader, &pErrors);
+		if (SUCCEEDED(hRet)) {
+			Sink += pShader->GetBufferSize();
+			pShader->Release();
+		}
+		if (pErrors) {
+			pErrors->Release();
+		}
+	}
+	double CompileUs = std::chrono::duration<double, std::micro>(Clock::now() - Start).count() / Shaders;
+	printf("  + D3DCompile    : %9.1f us per shader\n", CompileUs);
+#endif
+
+	std::vector<uint32_t> Tokens;
+	Start = Clock::now();
+	for (unsigned r = 0; r < Repeats; r++) {
+		for (const auto &Program : Programs) {
+			if (!VshEmitBytecode(Program, Tokens)) {
+				printf("A benchmark shader was left to the HLSL path\n");
+				return 1;
+			}
+			Sink += Tokens.size();
+		}
+	}
+	double BytecodeUs = std::chrono::duration<double, std::micro>(Clock::now() - Start).count() / Count;
+	printf("Bytecode emission : %9.1f us per shader\n", BytecodeUs);
+	printf("(%zu)\n", Sink);
+
+	return 0;
+}